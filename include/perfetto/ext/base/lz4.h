@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_LZ4_H_
+#define INCLUDE_PERFETTO_EXT_BASE_LZ4_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+namespace perfetto {
+namespace base {
+
+// A minimal implementation of the LZ4 block format, see
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md.
+// It trades compression ratio for speed: compressing and, even more so,
+// decompressing are several times faster than zlib. The output can be
+// decompressed by any LZ4 implementation (e.g. LZ4_decompress_safe()) and
+// vice versa.
+// The frame format (magic number, checksums, etc.) is not supported: callers
+// are expected to store the size of the uncompressed data next to the block.
+
+// Returns the maximum size of the block obtained by compressing |size| bytes.
+constexpr size_t Lz4CompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+// Compresses buffers into LZ4 blocks. The compressor is stateless across
+// calls; an instance only holds the hash table, so that it doesn't have to be
+// reallocated for every block.
+class Lz4Compressor {
+ public:
+  Lz4Compressor();
+  ~Lz4Compressor();
+
+  // Compresses the |size| bytes of |data| into |out|, which must be at least
+  // Lz4CompressBound(size) bytes long. Returns the size of the block.
+  size_t Compress(const uint8_t* data, size_t size, uint8_t* out);
+
+ private:
+  Lz4Compressor(const Lz4Compressor&) = delete;
+  Lz4Compressor& operator=(const Lz4Compressor&) = delete;
+
+  std::unique_ptr<uint32_t[]> hash_table_;
+};
+
+// Decompresses the |size| bytes LZ4 block at |data| into |out|. Returns false
+// if the block is malformed or if it doesn't decompress to exactly |out_size|
+// bytes. Never reads or writes outside of the given buffers.
+bool Lz4Decompress(const uint8_t* data,
+                   size_t size,
+                   uint8_t* out,
+                   size_t out_size);
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_LZ4_H_
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INCLUDE_PERFETTO_EXT_BASE_THREAD_POOL_H_
+#define INCLUDE_PERFETTO_EXT_BASE_THREAD_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace perfetto {
+namespace base {
+
+// A fixed-size pool of worker threads to run fork-join style data-parallel
+// work (e.g. decoding or sorting independent chunks of data).
+//
+// The pool has no task queue: the only entry point is ParallelFor(), which
+// blocks the caller until all its tasks have run. The calling thread takes part
+// in running the tasks, so a pool with 0 threads is valid and just runs
+// everything inline. This is also what happens in builds without thread
+// support (i.e. WASM), where no thread is ever created.
+//
+// ParallelFor() must not be called concurrently from different threads, nor
+// from within one of its own tasks.
+class ThreadPool {
+ public:
+  // Creates a pool with |num_threads| workers, named |name| (only used for
+  // debugging, see base::MaybeSetThreadName()).
+  explicit ThreadPool(uint32_t num_threads, const std::string& name = "");
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Runs fn(0), fn(1), ..., fn(num_tasks - 1) on the workers and on the
+  // calling thread, and returns once all of them have completed. Tasks are
+  // handed out dynamically, in increasing order, so it's fine for their cost
+  // to be unbalanced.
+  void ParallelFor(size_t num_tasks, const std::function<void(size_t)>& fn);
+
+  uint32_t num_threads() const {
+    return static_cast<uint32_t>(threads_.size());
+  }
+
+  // Returns the number of workers that saturates the CPUs of the machine,
+  // accounting for the thread that calls ParallelFor().
+  static uint32_t DefaultNumThreads();
+
+ private:
+  void WorkerMain(std::string name);
+
+  // Runs tasks of the current job until none is left, returns how many it ran.
+  size_t RunTasks(const std::function<void(size_t)>& fn, size_t num_tasks);
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+
+  // The current job. All these fields are guarded by |mutex_|.
+  const std::function<void(size_t)>* job_fn_ = nullptr;
+  size_t job_size_ = 0;
+  size_t tasks_done_ = 0;
+  uint64_t job_generation_ = 0;
+  uint32_t busy_workers_ = 0;
+  bool quit_ = false;
+
+  // Index of the next task to hand out, for the current job.
+  std::atomic<size_t> next_task_{0};
+
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace base
+}  // namespace perfetto
+
+#endif  // INCLUDE_PERFETTO_EXT_BASE_THREAD_POOL_H_
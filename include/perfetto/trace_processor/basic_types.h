@@ -49,6 +49,56 @@ struct PERFETTO_EXPORT Config {
   // this flag is false and all other events which parse into the raw table are
   // unaffected by this flag.
   bool ingest_ftrace_in_raw_table = true;
+
+  // When set to true, proto traces are ingested with a two-stage pipeline: a
+  // dedicated thread splits the chunks passed to Parse() into TracePackets
+  // (inflating compressed packets along the way, in parallel on all cores)
+  // while the calling thread tokenizes, sorts and parses the packets framed so
+  // far. Likewise, gzip traces are inflated on a dedicated thread, with
+  // members of known size (e.g. BGZF blocks) inflated in parallel. This speeds
+  // up the import of large traces, especially compressed ones, at the cost of
+  // extra threads and of errors being reported by a later Parse() call than
+  // the one which passed the offending data.
+  // This option is ignored in builds without thread support (e.g. WASM).
+  bool pipelined_ingestion = false;
+
+  // When set to true, the ftrace events of proto traces are decoded by a pool
+  // of worker threads, one CPU at a time, right before being parsed in
+  // timestamp order. Only the insertion into the tables stays serial. This
+  // speeds up the import of ftrace-heavy traces on multi-core machines.
+  bool parallel_ftrace_decoding = false;
+
+  // When non-zero, the events of proto traces waiting to be sorted are moved
+  // to a temporary file whenever they take more than this many bytes of
+  // memory, and merged back in timestamp order when parsed. This allows to
+  // import traces which don't fit in memory (e.g. with |force_full_sort|) at
+  // the cost of the disk I/O. The stats table reports how much was spilled.
+  // This option is ignored on Windows and in WASM.
+  uint64_t sorter_memory_budget_bytes = 0;
+
+  // When greater than one, span joins of two tables partitioned by the same
+  // column (e.g. cpu or utid) read both tables into memory and join their
+  // partitions in parallel on up to this many threads, including the one
+  // running the query. The joined spans are returned in the same order as
+  // when streaming through the partitions one at a time, which is what
+  // happens otherwise. In builds without thread support (e.g. WASM), the
+  // partitions are still joined from memory but on the calling thread.
+  uint32_t span_join_threads = 0;
+
+  // When set, the interned strings are stored in the file at this path, which
+  // is created if needed, rather than in anonymous memory. This keeps them out
+  // of the RSS of trace processor on traces with many unique strings. If the
+  // file was already used by another instance of trace processor, the strings
+  // it contains are reused. If the file can't be used, strings are kept in
+  // memory. This option is ignored on Windows and in WASM.
+  std::string string_pool_file;
+
+  // When set, once the trace is loaded, the integer columns of the tables are
+  // stored in a compressed form when this saves at least half of their
+  // memory (e.g. delta encoding for timestamps, bit packing for cpus or
+  // utids). Filtering them remains fast but reading random rows is slower.
+  // The memory saved is reported in the column_compaction_bytes_saved stat.
+  bool compact_columns = false;
 };
 
 // Represents a dynamically typed value returned by SQL.
@@ -18,6 +18,7 @@
 #define INCLUDE_PERFETTO_TRACE_PROCESSOR_READ_TRACE_H_
 
 #include <functional>
+#include <string>
 #include <vector>
 
 #include "perfetto/base/export.h"
@@ -33,6 +34,53 @@ util::Status PERFETTO_EXPORT ReadTrace(
     const char* filename,
     const std::function<void(uint64_t parsed_size)>& progress_callback = {});
 
+// Same as ReadTrace() but, where supported (Linux, Android and Mac), maps the
+// trace file in memory rather than reading it. The trace data retained after
+// parsing then refers to file-backed pages, which the kernel can reclaim,
+// instead of being copied on the heap. The file must not be truncated or
+// modified as long as |tp| is alive. Falls back on ReadTrace() if the file
+// cannot be mapped (e.g. it is a pipe).
+util::Status PERFETTO_EXPORT ReadTraceMapped(
+    TraceProcessor* tp,
+    const char* filename,
+    const std::function<void(uint64_t parsed_size)>& progress_callback = {});
+
+// Imports a trace file while it is still being written (e.g. by a tracing
+// session with write_into_file set), so that it can be queried as it grows.
+// Each ReadNewData() call only parses the data appended to the file since the
+// previous one. The file must only be appended to.
+class PERFETTO_EXPORT TraceFileTailer {
+ public:
+  // |tp| must outlive the tailer.
+  TraceFileTailer(TraceProcessor* tp, std::string filename);
+  ~TraceFileTailer();
+
+  TraceFileTailer(const TraceFileTailer&) = delete;
+  TraceFileTailer& operator=(const TraceFileTailer&) = delete;
+
+  // Parses the data appended to the file since the previous call (opening the
+  // file on the first one) and makes it visible to queries, see
+  // TraceProcessorStorage::Flush(). If not null, |new_bytes| is set to the
+  // size of that data.
+  util::Status ReadNewData(uint64_t* new_bytes = nullptr);
+
+  // Parses the rest of the file and calls NotifyEndOfFile(). To be called once
+  // the file is complete: no more data can be read afterwards.
+  util::Status Finish();
+
+  // The size of the data parsed so far.
+  uint64_t bytes_read() const { return bytes_read_; }
+
+ private:
+  util::Status ParseNewData(uint64_t* new_bytes);
+
+  TraceProcessor* const tp_;
+  const std::string filename_;
+  int fd_ = -1;
+  uint64_t bytes_read_ = 0;
+  bool finished_ = false;
+};
+
 util::Status PERFETTO_EXPORT DecompressTrace(const uint8_t* data,
                                              size_t size,
                                              std::vector<uint8_t>* output);
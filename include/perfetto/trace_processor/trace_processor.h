@@ -108,6 +108,16 @@ class PERFETTO_EXPORT TraceProcessor : public TraceProcessorStorage {
   // by the ingestion process. Returns the number of table/views deleted.
   virtual size_t RestoreInitialTables() = 0;
 
+  // Saves the contents of the trace storage to |path| so that the trace can be
+  // reloaded with LoadSnapshot() without being parsed again. Should be called
+  // after NotifyEndOfFile(). Snapshots can only be loaded by the same version
+  // of trace processor.
+  virtual util::Status SaveSnapshot(const std::string& path) = 0;
+
+  // Loads a snapshot written by SaveSnapshot(). This replaces parsing a trace:
+  // it must be called before Parse() and no more data can be parsed after it.
+  virtual util::Status LoadSnapshot(const std::string& path) = 0;
+
   // Sets/returns the name of the currently loaded trace or an empty string if
   // no trace is fully loaded yet. This has no effect on the Trace Processor
   // functionality and is used for UI purposes only.
@@ -45,6 +45,31 @@ class PERFETTO_EXPORT TraceProcessorStorage {
   // floor and return errors forever.
   virtual util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
 
+  // Same as Parse(), for a buffer whose ownership is shared with the caller,
+  // e.g. a chunk of a memory-mapped trace file (see the aliasing constructor
+  // of std::shared_ptr). The importers which retain trace data refer to the
+  // buffer rather than copying it, so it must not be modified afterwards.
+  // The default implementation copies the buffer and calls Parse().
+  virtual util::Status ParseSharedBuffer(std::shared_ptr<const uint8_t>,
+                                         size_t);
+
+  // Makes the data passed to Parse() so far visible to queries, to import a
+  // trace which is still being written (e.g. by a write_into_file tracing
+  // session) without waiting for NotifyEndOfFile(). More data can be parsed
+  // afterwards and later Flush() calls only import the new data.
+  // Only the events which can't be reordered anymore by the data which
+  // follows are imported: for proto traces with write_into_file set, those
+  // older than the sorting window (twice the flush_period_ms of the trace
+  // config) with respect to the newest event. Traces which are fully sorted
+  // (e.g. JSON traces or Config::force_full_sort) are only imported by
+  // NotifyEndOfFile(). Similarly, the state which depends on the end of the
+  // trace (e.g. the duration of the slices still open) is only finalized by
+  // NotifyEndOfFile().
+  // Returns the same errors as Parse().
+  // The default implementation does nothing, i.e. the data only becomes
+  // visible at NotifyEndOfFile().
+  virtual util::Status Flush();
+
   // When parsing a bounded file (as opposite to streaming from a device) this
   // function should be called when the last chunk of the file has been passed
   // into Parse(). This allows to flush the events queued in the ordering stage,
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/lz4.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace perfetto {
+namespace base {
+namespace {
+
+// A block is a sequence of (literals, match) pairs, each starting with a token
+// byte holding the literals length in its high nibble and the match length
+// (minus kMinMatch) in its low nibble. Lengths which don't fit in a nibble
+// continue with extra bytes, each one adding up to 255.
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+constexpr uint32_t kNibbleMask = 15;
+
+// The last kLastLiterals bytes of a block are always literals and a match
+// can't start in the last kMatchStartLimit bytes. Decoders rely on this to
+// copy data in large strides.
+constexpr size_t kLastLiterals = 5;
+constexpr size_t kMatchStartLimit = 12;
+
+constexpr uint32_t kHashLog = 12;
+
+// The lookup of the next match gets faster (and less thorough) as the number
+// of bytes since the last match grows, so that incompressible data is skipped
+// over quickly.
+constexpr uint32_t kSkipTrigger = 6;
+
+inline uint32_t Read32(const uint8_t* ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+inline uint64_t Read64(const uint8_t* ptr) {
+  uint64_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+inline uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - kHashLog);
+}
+
+// Writes the bytes which extend a length that doesn't fit in a nibble.
+inline uint8_t* WriteLength(size_t length, uint8_t* out) {
+  length -= kNibbleMask;
+  for (; length >= 255; length -= 255)
+    *out++ = 255;
+  *out++ = static_cast<uint8_t>(length);
+  return out;
+}
+
+// Writes the token and the literals [literals, literals_end), returning a
+// pointer to the token so that the match length can be added to it.
+inline uint8_t* WriteLiterals(const uint8_t* literals,
+                              const uint8_t* literals_end,
+                              uint8_t** out) {
+  const size_t length = static_cast<size_t>(literals_end - literals);
+  uint8_t* token = (*out)++;
+  if (length >= kNibbleMask) {
+    *token = kNibbleMask << 4;
+    *out = WriteLength(length, *out);
+  } else {
+    *token = static_cast<uint8_t>(length << 4);
+  }
+  memcpy(*out, literals, length);
+  *out += length;
+  return token;
+}
+
+// Reads the bytes which extend a length that doesn't fit in a nibble. Returns
+// false if the block ends before the length.
+inline bool ReadLength(const uint8_t** ptr, const uint8_t* end, size_t* length) {
+  for (;;) {
+    if (*ptr >= end)
+      return false;
+    uint8_t byte = *(*ptr)++;
+    *length += byte;
+    if (byte != 255)
+      return true;
+  }
+}
+
+}  // namespace
+
+Lz4Compressor::Lz4Compressor() : hash_table_(new uint32_t[1 << kHashLog]) {}
+
+Lz4Compressor::~Lz4Compressor() = default;
+
+size_t Lz4Compressor::Compress(const uint8_t* data,
+                               size_t size,
+                               uint8_t* out) {
+  const uint8_t* const end = data + size;
+  const uint8_t* anchor = data;
+  uint8_t* op = out;
+
+  if (size > kMatchStartLimit) {
+    // The table maps the hash of 4 bytes to the last offset they were seen at.
+    // Stale or colliding entries are harmless: candidates are always checked.
+    memset(hash_table_.get(), 0, sizeof(uint32_t) << kHashLog);
+    const uint8_t* const match_start_limit = end - kMatchStartLimit;
+    const uint8_t* const match_end_limit = end - kLastLiterals;
+    for (const uint8_t* ip = data + 1; ip < match_start_limit;) {
+      const uint32_t sequence = Read32(ip);
+      uint32_t* entry = &hash_table_[Hash(sequence)];
+      const uint8_t* ref = data + *entry;
+      *entry = static_cast<uint32_t>(ip - data);
+      if (ref >= ip || static_cast<size_t>(ip - ref) > kMaxOffset ||
+          Read32(ref) != sequence) {
+        ip += 1 + (static_cast<size_t>(ip - anchor) >> kSkipTrigger);
+        continue;
+      }
+
+      // Extend the match backwards, over the pending literals, and forwards.
+      while (ip > anchor && ref > data && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const uint8_t* match_end = ip + kMinMatch;
+      const uint8_t* ref_end = ref + kMinMatch;
+      while (match_end + sizeof(uint64_t) <= match_end_limit &&
+             Read64(match_end) == Read64(ref_end)) {
+        match_end += sizeof(uint64_t);
+        ref_end += sizeof(uint64_t);
+      }
+      while (match_end < match_end_limit && *match_end == *ref_end) {
+        match_end++;
+        ref_end++;
+      }
+
+      uint8_t* token = WriteLiterals(anchor, ip, &op);
+      const size_t offset = static_cast<size_t>(ip - ref);
+      *op++ = static_cast<uint8_t>(offset);
+      *op++ = static_cast<uint8_t>(offset >> 8);
+      const size_t match_length =
+          static_cast<size_t>(match_end - ip) - kMinMatch;
+      if (match_length >= kNibbleMask) {
+        *token |= kNibbleMask;
+        op = WriteLength(match_length, op);
+      } else {
+        *token |= static_cast<uint8_t>(match_length);
+      }
+      ip = anchor = match_end;
+    }
+  }
+
+  WriteLiterals(anchor, end, &op);
+  return static_cast<size_t>(op - out);
+}
+
+bool Lz4Decompress(const uint8_t* data,
+                   size_t size,
+                   uint8_t* out,
+                   size_t out_size) {
+  const uint8_t* ip = data;
+  const uint8_t* const end = data + size;
+  uint8_t* op = out;
+  uint8_t* const out_end = out + out_size;
+
+  for (;;) {
+    if (ip >= end)
+      return false;
+    const uint8_t token = *ip++;
+
+    size_t literals = token >> 4;
+    if (literals == kNibbleMask && !ReadLength(&ip, end, &literals))
+      return false;
+    if (literals > static_cast<size_t>(end - ip) ||
+        literals > static_cast<size_t>(out_end - op)) {
+      return false;
+    }
+    memcpy(op, ip, literals);
+    ip += literals;
+    op += literals;
+
+    // The last sequence of a block has no match.
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return false;
+    const size_t offset = static_cast<size_t>(ip[0] | (ip[1] << 8));
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - out))
+      return false;
+
+    size_t match_length = token & kNibbleMask;
+    if (match_length == kNibbleMask && !ReadLength(&ip, end, &match_length))
+      return false;
+    match_length += kMinMatch;
+    if (match_length > static_cast<size_t>(out_end - op))
+      return false;
+
+    // The match may overlap with the data it produces (e.g. an offset of 1
+    // repeats the last byte), so copy it in strides of at most |offset|.
+    for (size_t left = match_length; left > 0;) {
+      const size_t stride = std::min(left, offset);
+      memcpy(op, op - offset, stride);
+      op += stride;
+      left -= stride;
+    }
+  }
+  return op == out_end;
+}
+
+}  // namespace base
+}  // namespace perfetto
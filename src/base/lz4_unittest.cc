@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/lz4.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+std::vector<uint8_t> Compress(const std::string& data) {
+  Lz4Compressor compressor;
+  std::vector<uint8_t> block(Lz4CompressBound(data.size()));
+  size_t size = compressor.Compress(
+      reinterpret_cast<const uint8_t*>(data.data()), data.size(), block.data());
+  EXPECT_LE(size, block.size());
+  block.resize(size);
+  return block;
+}
+
+std::string RoundTrip(const std::string& data) {
+  std::vector<uint8_t> block = Compress(data);
+  std::string out(data.size(), '\0');
+  EXPECT_TRUE(Lz4Decompress(block.data(), block.size(),
+                            reinterpret_cast<uint8_t*>(&out[0]), out.size()));
+  return out;
+}
+
+std::string RandomString(size_t size, uint32_t alphabet) {
+  std::minstd_rand0 rnd(0);
+  std::string s(size, '\0');
+  for (size_t i = 0; i < size; i++)
+    s[i] = static_cast<char>('a' + rnd() % alphabet);
+  return s;
+}
+
+TEST(Lz4Test, RoundTrip) {
+  std::string text;
+  for (uint32_t i = 0; i < 10000; i++)
+    text += "sched_switch: prev_pid=" + std::to_string(i * 7919 % 10007) + "\n";
+
+  for (const std::string& data :
+       {std::string(), std::string("a"), std::string("0123456789abc"),
+        std::string(100000, 'x'), RandomString(100000, 256),
+        RandomString(100000, 4), text}) {
+    ASSERT_EQ(RoundTrip(data), data) << data.size();
+  }
+}
+
+TEST(Lz4Test, CompressesRepetitiveData) {
+  std::string data;
+  for (uint32_t i = 0; i < 1000; i++)
+    data += "trace_packet";
+  EXPECT_LT(Compress(data).size(), data.size() / 50);
+}
+
+TEST(Lz4Test, DecompressesReferenceBlock) {
+  // "abcabcabcabcabcabcabcabc", encoded by hand following the format spec:
+  // three literals, then a match of 16 bytes at offset 3 and 5 last literals.
+  const uint8_t kBlock[] = {0x3c, 'a', 'b', 'c', 0x03, 0x00,
+                            0x50, 'b', 'c', 'a', 'b', 'c'};
+  std::string out(24, '\0');
+  ASSERT_TRUE(Lz4Decompress(kBlock, sizeof(kBlock),
+                            reinterpret_cast<uint8_t*>(&out[0]), out.size()));
+  EXPECT_EQ(out, "abcabcabcabcabcabcabcabc");
+}
+
+TEST(Lz4Test, RejectsMalformedBlocks) {
+  std::string data = RandomString(10000, 8);
+  std::vector<uint8_t> block = Compress(data);
+  std::vector<uint8_t> out(data.size());
+
+  // Wrong decompressed size.
+  EXPECT_FALSE(
+      Lz4Decompress(block.data(), block.size(), out.data(), out.size() - 1));
+  std::vector<uint8_t> larger_out(data.size() + 1);
+  EXPECT_FALSE(Lz4Decompress(block.data(), block.size(), larger_out.data(),
+                             larger_out.size()));
+
+  // Truncated block.
+  for (size_t size = 0; size < block.size(); size += 97)
+    EXPECT_FALSE(Lz4Decompress(block.data(), size, out.data(), out.size()));
+
+  // Offset before the beginning of the output.
+  const uint8_t kBadOffset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+  EXPECT_FALSE(Lz4Decompress(kBadOffset, sizeof(kBadOffset), out.data(), 5));
+
+  // Random corruptions must never crash (this is mostly for ASan).
+  std::minstd_rand0 rnd(0);
+  for (uint32_t i = 0; i < 1000; i++) {
+    std::vector<uint8_t> corrupt = block;
+    corrupt[rnd() % corrupt.size()] = static_cast<uint8_t>(rnd());
+    Lz4Decompress(corrupt.data(), corrupt.size(), out.data(), out.size());
+  }
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/thread_pool.h"
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_utils.h"
+
+namespace perfetto {
+namespace base {
+
+ThreadPool::ThreadPool(uint32_t num_threads, const std::string& name) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  base::ignore_result(num_threads);
+  base::ignore_result(name);
+#else
+  threads_.reserve(num_threads);
+  for (uint32_t i = 0; i < num_threads; i++)
+    threads_.emplace_back(&ThreadPool::WorkerMain, this, name);
+#endif
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread& thread : threads_)
+    thread.join();
+}
+
+// static
+uint32_t ThreadPool::DefaultNumThreads() {
+  uint32_t num_cpus = std::thread::hardware_concurrency();
+  return num_cpus > 1 ? num_cpus - 1 : 0;
+}
+
+void ThreadPool::ParallelFor(size_t num_tasks,
+                             const std::function<void(size_t)>& fn) {
+  if (threads_.empty() || num_tasks <= 1) {
+    for (size_t i = 0; i < num_tasks; i++)
+      fn(i);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PERFETTO_DCHECK(!job_fn_);
+    job_fn_ = &fn;
+    job_size_ = num_tasks;
+    tasks_done_ = 0;
+    job_generation_++;
+    next_task_.store(0, std::memory_order_relaxed);
+  }
+  work_cv_.notify_all();
+
+  size_t done = RunTasks(fn, num_tasks);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  tasks_done_ += done;
+
+  // Wait also for the workers which picked up the job but didn't find any task
+  // left: they must not be running RunTasks() when the next job starts.
+  done_cv_.wait(lock, [this] {
+    return tasks_done_ == job_size_ && busy_workers_ == 0;
+  });
+  job_fn_ = nullptr;
+}
+
+size_t ThreadPool::RunTasks(const std::function<void(size_t)>& fn,
+                            size_t num_tasks) {
+  size_t done = 0;
+  for (;;) {
+    size_t task = next_task_.fetch_add(1, std::memory_order_relaxed);
+    if (task >= num_tasks)
+      break;
+    fn(task);
+    done++;
+  }
+  return done;
+}
+
+void ThreadPool::WorkerMain(std::string name) {
+  if (!name.empty())
+    base::MaybeSetThreadName(name);
+
+  uint64_t last_generation = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_cv_.wait(lock, [this, last_generation] {
+      return quit_ || (job_fn_ && job_generation_ != last_generation);
+    });
+    if (quit_)
+      return;
+
+    last_generation = job_generation_;
+    const std::function<void(size_t)>* fn = job_fn_;
+    size_t num_tasks = job_size_;
+    busy_workers_++;
+
+    lock.unlock();
+    size_t done = RunTasks(*fn, num_tasks);
+    lock.lock();
+
+    busy_workers_--;
+    tasks_done_ += done;
+    if (tasks_done_ == job_size_ && busy_workers_ == 0)
+      done_cv_.notify_one();
+  }
+}
+
+}  // namespace base
+}  // namespace perfetto
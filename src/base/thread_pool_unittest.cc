@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfetto/ext/base/thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace base {
+namespace {
+
+TEST(ThreadPoolTest, NoThreadsRunsInline) {
+  ThreadPool pool(0);
+  std::vector<size_t> order;
+  pool.ParallelFor(5, [&order](size_t i) { order.push_back(i); });
+  ASSERT_EQ(order, std::vector<size_t>({0, 1, 2, 3, 4}));
+}
+
+TEST(ThreadPoolTest, RunsEveryTaskOnce) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<uint32_t>> runs(1000);
+  pool.ParallelFor(runs.size(), [&runs](size_t i) { runs[i]++; });
+  for (const auto& r : runs)
+    ASSERT_EQ(r.load(), 1u);
+}
+
+TEST(ThreadPoolTest, ManyJobs) {
+  // Back-to-back jobs, some smaller than the number of workers, to catch
+  // workers leaking from one job into the next one.
+  ThreadPool pool(3);
+  for (size_t job = 0; job < 500; job++) {
+    size_t num_tasks = job % 7;
+    std::vector<uint32_t> runs(num_tasks);
+    pool.ParallelFor(num_tasks, [&runs](size_t i) { runs[i]++; });
+    for (uint32_t r : runs)
+      ASSERT_EQ(r, 1u);
+  }
+}
+
+}  // namespace
+}  // namespace base
+}  // namespace perfetto
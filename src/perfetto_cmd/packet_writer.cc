@@ -26,6 +26,7 @@
 #include <unistd.h>
 
 #include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/lz4.h"
 #include "perfetto/ext/base/paged_memory.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
@@ -48,18 +49,29 @@ using Preamble = std::array<char, 16>;
 // want to depend on protos/trace:lite for binary size saving reasons.
 constexpr uint32_t kPacketId = 1;
 
-#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
-
-// ID of |compressed_packets| in trace_packet.proto.
-constexpr uint32_t kCompressedPacketsId = 50;
-
 // Some transport mechanisms have a 512kb limit on packet size.
-// ZipPacketWriter respects this limit where possible and does
+// ZipPacketWriter and Lz4PacketWriter respect this limit where possible and do
 // not produce compressed packets larger than 512kb. This is
 // constant is deliberately conservative to leave plenty of
 // room for the transport to add additional headers etc.
 const size_t kMaxPacketSize = 500 * 1024;
 
+// ID of |lz4_compressed_packets| in trace_packet.proto.
+constexpr uint32_t kLz4CompressedPacketsId = 72;
+
+// Lz4PacketWriter compresses at most this many bytes in each packet, so that
+// even incompressible data fits in kMaxPacketSize.
+constexpr size_t kLz4MaxUncompressedSize = 480 * 1024;
+static_assert(base::Lz4CompressBound(kLz4MaxUncompressedSize) +
+                      2 * protozero::proto_utils::kMaxSimpleFieldEncodedSize <
+                  kMaxPacketSize,
+              "Lz4PacketWriter can exceed kMaxPacketSize");
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+// ID of |compressed_packets| in trace_packet.proto.
+constexpr uint32_t kCompressedPacketsId = 50;
+
 // After every kPendingBytesLimit we do a Z_SYNC_FLUSH in the zlib stream.
 const size_t kPendingBytesLimit = 32 * 1024;
 
@@ -253,6 +265,77 @@ void ZipPacketWriter::Deflate(const uint8_t* ptr, size_t size) {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+// Unlike ZipPacketWriter, which streams into a single deflate stream until the
+// output is full, compresses each batch of kLz4MaxUncompressedSize bytes of
+// packets into an independent LZ4 block.
+class Lz4PacketWriter : public PacketWriter {
+ public:
+  Lz4PacketWriter(std::unique_ptr<PacketWriter>);
+  ~Lz4PacketWriter() override;
+  bool WritePacket(const TracePacket& packet) override;
+
+ private:
+  bool FinalizeCompressedPacket();
+
+  std::unique_ptr<PacketWriter> writer_;
+  base::Lz4Compressor compressor_;
+
+  // The packets, with their preamble, not compressed yet.
+  std::vector<uint8_t> pending_;
+  std::unique_ptr<uint8_t[]> compressed_;
+};
+
+Lz4PacketWriter::Lz4PacketWriter(std::unique_ptr<PacketWriter> writer)
+    : writer_(std::move(writer)), compressed_(new uint8_t[kMaxPacketSize]) {
+  pending_.reserve(kLz4MaxUncompressedSize);
+}
+
+Lz4PacketWriter::~Lz4PacketWriter() {
+  FinalizeCompressedPacket();
+}
+
+bool Lz4PacketWriter::WritePacket(const TracePacket& packet) {
+  Preamble packet_hdr;
+  size_t packet_hdr_size = GetPreamble<kPacketId>(packet.size(), &packet_hdr);
+  const size_t size = packet_hdr_size + packet.size();
+  if (pending_.size() + size > kLz4MaxUncompressedSize) {
+    if (!FinalizeCompressedPacket())
+      return false;
+  }
+
+  // As in ZipPacketWriter, large packets are written uncompressed.
+  if (size > kLz4MaxUncompressedSize)
+    return writer_->WritePacket(packet);
+
+  pending_.insert(pending_.end(), packet_hdr.data(),
+                  packet_hdr.data() + packet_hdr_size);
+  for (const Slice& slice : packet.slices()) {
+    const uint8_t* start = static_cast<const uint8_t*>(slice.start);
+    pending_.insert(pending_.end(), start, start + slice.size);
+  }
+  return true;
+}
+
+bool Lz4PacketWriter::FinalizeCompressedPacket() {
+  if (pending_.empty())
+    return true;
+
+  // The field contains the uncompressed size followed by the LZ4 block.
+  uint8_t* ptr = WriteVarInt(pending_.size(), &compressed_[0]);
+  ptr += compressor_.Compress(pending_.data(), pending_.size(), ptr);
+  size_t size = static_cast<size_t>(ptr - &compressed_[0]);
+  Preamble preamble;
+  size_t preamble_size = GetPreamble<kLz4CompressedPacketsId>(size, &preamble);
+
+  std::vector<TracePacket> out_packets(1);
+  TracePacket& out_packet = out_packets[0];
+  out_packet.AddSlice(preamble.data(), preamble_size);
+  out_packet.AddSlice(&compressed_[0], size);
+
+  pending_.clear();
+  return writer_->WritePackets(out_packets);
+}
+
 }  // namespace
 
 PacketWriter::PacketWriter() {}
@@ -263,6 +346,11 @@ std::unique_ptr<PacketWriter> CreateFilePacketWriter(FILE* fd) {
   return std::unique_ptr<PacketWriter>(new FilePacketWriter(fd));
 }
 
+std::unique_ptr<PacketWriter> CreateLz4PacketWriter(
+    std::unique_ptr<PacketWriter> writer) {
+  return std::unique_ptr<PacketWriter>(new Lz4PacketWriter(std::move(writer)));
+}
+
 #if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 std::unique_ptr<PacketWriter> CreateZipPacketWriter(
     std::unique_ptr<PacketWriter> writer) {
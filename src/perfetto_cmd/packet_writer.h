@@ -44,6 +44,8 @@ class PacketWriter {
 std::unique_ptr<PacketWriter> CreateFilePacketWriter(FILE*);
 std::unique_ptr<PacketWriter> CreateZipPacketWriter(
     std::unique_ptr<PacketWriter>);
+std::unique_ptr<PacketWriter> CreateLz4PacketWriter(
+    std::unique_ptr<PacketWriter>);
 
 }  // namespace perfetto
 
@@ -23,9 +23,11 @@
 
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/lz4.h"
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "src/perfetto_cmd/packet_writer.h"
 #include "test/gtest_and_gmock.h"
 
@@ -54,7 +56,6 @@ TracePacket CreateTracePacket(F fill_function) {
   return packet;
 }
 
-#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 std::string RandomString(size_t size) {
   std::minstd_rand0 rnd(0);
   std::uniform_int_distribution<> dist(0, 255);
@@ -65,6 +66,20 @@ std::string RandomString(size_t size) {
   return s;
 }
 
+std::string DecompressLz4(const std::string& data) {
+  const uint8_t* start = reinterpret_cast<const uint8_t*>(data.data());
+  const uint8_t* end = start + data.size();
+  uint64_t size = 0;
+  const uint8_t* block = protozero::proto_utils::ParseVarInt(start, end, &size);
+  EXPECT_NE(block, start);
+  std::string s(static_cast<size_t>(size), '\0');
+  EXPECT_TRUE(base::Lz4Decompress(block, static_cast<size_t>(end - block),
+                                  reinterpret_cast<uint8_t*>(&s[0]),
+                                  s.size()));
+  return s;
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 std::string Decompress(const std::string& data) {
   uint8_t out[1024];
 
@@ -318,5 +333,68 @@ TEST(PacketWriterTest, ZipPacketWriter_ShouldSplitPackets) {
 
 #endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
 
+TEST(PacketWriterTest, Lz4PacketWriter_Empty) {
+  base::TempFile tmp = base::TempFile::CreateUnlinked();
+  base::ScopedResource<FILE*, fclose, nullptr> f(
+      fdopen(tmp.ReleaseFD().release(), "wb"));
+
+  {
+    std::unique_ptr<PacketWriter> writer =
+        CreateLz4PacketWriter(CreateFilePacketWriter(*f));
+    writer->WritePackets(std::vector<TracePacket>());
+  }
+
+  EXPECT_EQ(fseek(*f, 0, SEEK_END), 0);
+}
+
+TEST(PacketWriterTest, Lz4PacketWriter_ShouldSplitPackets) {
+  base::TempFile tmp = base::TempFile::CreateUnlinked();
+  base::ScopedResource<FILE*, fclose, nullptr> f(
+      fdopen(tmp.ReleaseFD().release(), "wb"));
+
+  // Packets of 1KB, with a few ones too large to be compressed.
+  std::vector<perfetto::TracePacket> packets;
+  for (uint32_t i = 0; i < 1000; i++) {
+    size_t size = i % 300 == 299 ? 1024 * 1024 : 1024;
+    packets.push_back(CreateTracePacket([i, size](TracePacketProto* msg) {
+      auto* for_testing = msg->mutable_for_testing();
+      for_testing->set_seq_value(i);
+      for_testing->set_str(RandomString(size));
+    }));
+  }
+
+  {
+    std::unique_ptr<PacketWriter> writer =
+        CreateLz4PacketWriter(CreateFilePacketWriter(*f));
+    EXPECT_TRUE(writer->WritePackets(std::move(packets)));
+  }
+
+  std::string s;
+  fseek(*f, 0, SEEK_SET);
+  EXPECT_TRUE(base::ReadFileStream(*f, &s));
+  EXPECT_GT(s.size(), 0u);
+
+  protos::gen::Trace trace;
+  EXPECT_TRUE(trace.ParseFromString(s));
+
+  uint32_t packet_count = 0;
+  for (const auto& packet : trace.packet()) {
+    if (packet.has_for_testing()) {
+      EXPECT_EQ(packet.for_testing().seq_value(), packet_count++);
+      continue;
+    }
+    const std::string& data = packet.lz4_compressed_packets();
+    EXPECT_GT(data.size(), 0u);
+    EXPECT_LT(data.size(), 500 * 1024u);
+    protos::gen::Trace subtrace;
+    EXPECT_TRUE(subtrace.ParseFromString(DecompressLz4(data)));
+    for (const auto& subpacket : subtrace.packet()) {
+      EXPECT_EQ(subpacket.for_testing().seq_value(), packet_count++);
+    }
+  }
+
+  EXPECT_EQ(packet_count, 1000u);
+}
+
 }  // namespace
 }  // namespace perfetto
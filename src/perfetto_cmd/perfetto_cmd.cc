@@ -632,6 +632,11 @@ int PerfettoCmd::Main(int argc, char** argv) {
     } else {
       PERFETTO_ELOG("Cannot compress when tracing directly to file.");
     }
+  } else if (trace_config_->compression_type() ==
+             TraceConfig::COMPRESSION_TYPE_LZ4) {
+    // When tracing directly to file the service compresses the packets.
+    if (packet_writer_)
+      packet_writer_ = CreateLz4PacketWriter(std::move(packet_writer_));
   }
 
   RateLimiter::Args args{};
@@ -20,10 +20,13 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <string.h>
+
 #include <memory>
 
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/trace_blob_view.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -40,6 +43,21 @@ class ChunkedTraceReader {
   // The buffer size is guaranteed to be > 0.
   virtual util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) = 0;
 
+  // Same as Parse(), for data which can be retained without being copied
+  // (e.g. a chunk of a memory-mapped trace file). Readers which don't retain
+  // the data they are passed get a copy of it.
+  virtual util::Status ParseBlob(TraceBlobView blob) {
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[blob.length()]);
+    memcpy(buf.get(), blob.data(), blob.length());
+    return Parse(std::move(buf), blob.length());
+  }
+
+  // Parses all the data passed so far, including the one buffered in
+  // pipeline threads, except for the incomplete lines/protos at the end of it.
+  // Unlike NotifyEndOfFile(), more data can be passed afterwards: this is
+  // used to import traces while they are still being written.
+  virtual util::Status Flush() { return util::OkStatus(); }
+
   // Called after the last Parse() call.
   virtual void NotifyEndOfFile() = 0;
 };
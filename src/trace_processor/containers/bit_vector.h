@@ -223,6 +223,11 @@ class BitVector {
         // If the new space should be filled with true, then set all the bits
         // between the address of the old size and the new last address.
         const Address& start = IndexToAddress(old_size);
+
+        // If the old size was a multiple of the block size, the first block
+        // we set bits in is a new one so its count also needs to be set.
+        if (start.block_idx >= old_blocks_size)
+          counts_[start.block_idx] = GetNumBitsSet();
         Set(start, last_addr);
 
         // We then need to update the counts vector to match the changes we
@@ -301,6 +306,61 @@ class BitVector {
     return bv;
   }
 
+  // Same as |Range| but the filler computes up to 64 bits at a time:
+  // |f(index of first bit, n)| returns a word whose bottom |n| bits are the
+  // values of the bits starting at that index (and whose other bits are
+  // ignored). |n| is 64 for all the words inside whole blocks.
+  //
+  // This allows the filler to evaluate many bits at once (e.g. using SIMD
+  // instructions) and avoids setting bits one at a time.
+  template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+  static BitVector RangeWords(uint32_t start, uint32_t end, WordFiller f) {
+    PERFETTO_DCHECK(start <= end);
+
+    BitVector bv(start, false);
+    bv.AppendRangeWords(end, f);
+    return bv;
+  }
+
+  // Grows the BitVector to size |end|, filling the new bits with the word
+  // filler |f| (see |RangeWords|).
+  template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+  void AppendRangeWords(uint32_t end, WordFiller f) {
+    uint32_t start = size();
+    PERFETTO_DCHECK(start <= end);
+
+    uint32_t start_fast_block = BlockCeil(start);
+    uint32_t start_fast_idx = std::min(BlockToIndex(start_fast_block), end);
+    uint32_t end_fast_block = BlockFloor(end);
+    uint32_t end_fast_idx = BlockToIndex(end_fast_block);
+
+    AppendWords(start, start_fast_idx, f);
+    for (uint32_t i = start_fast_block; i < end_fast_block; ++i) {
+      counts_.emplace_back(GetNumBitsSet());
+      blocks_.emplace_back(Block::FromWordFiller(size_, f));
+      size_ += Block::kBits;
+    }
+    AppendWords(std::max(end_fast_idx, start_fast_idx), end, f);
+  }
+
+  // Clears all the bits for which the word filler |f| (see |RangeWords|)
+  // returns an unset bit. |f| is only called for words with some bits set.
+  //
+  // This is the equivalent of |UpdateSetBits| for fillers which work on all
+  // the bits rather than only on the set ones.
+  template <typename WordFiller = uint64_t(uint32_t, uint32_t)>
+  void AndWords(WordFiller f) {
+    static constexpr BlockOffset kLastBlockOffset =
+        BlockOffset{Block::kWords - 1, BitWord::kBits - 1};
+
+    uint32_t set_count = 0;
+    for (uint32_t i = 0; i < blocks_.size(); ++i) {
+      counts_[i] = set_count;
+      blocks_[i].AndWords(BlockToIndex(i), size_, f);
+      set_count += blocks_[i].GetNumBitsSet(kLastBlockOffset);
+    }
+  }
+
   // Updates the ith set bit of this bitvector with the value of
   // |other.IsSet(i)|.
   //
@@ -340,7 +400,7 @@ class BitVector {
   static constexpr uint32_t ApproxBytesCost(uint32_t n) {
     // The two main things making up a bitvector is the cost of the blocks of
     // bits and the cost of the counts vector.
-    return BlockCeil(n) * Block::kBits + BlockCeil(n) * sizeof(uint32_t);
+    return BlockCeil(n) * (Block::kBits / 8) + BlockCeil(n) * sizeof(uint32_t);
   }
 
  private:
@@ -378,6 +438,9 @@ class BitVector {
     // Bitwise ors the given |mask| to the current value.
     void Or(uint64_t mask) { word_ |= mask; }
 
+    // Bitwise ands the given |mask| to the current value.
+    void And(uint64_t mask) { word_ &= mask; }
+
     // Sets the bit at the given index to true.
     void Set(uint32_t idx) {
       PERFETTO_DCHECK(idx < kBits);
@@ -657,6 +720,33 @@ class BitVector {
       return b;
     }
 
+    // Ands each word of this block with the word computed by |f| (see
+    // |RangeWords|) for the same bits. |offset| is the index of the first bit
+    // of this block and |size| the size of the BitVector. Words without any
+    // set bit are skipped.
+    template <typename WordFiller>
+    void AndWords(uint32_t offset, uint32_t size, WordFiller f) {
+      for (uint32_t i = 0; i < kWords; ++i) {
+        uint32_t idx = offset + i * BitWord::kBits;
+        if (idx >= size)
+          break;
+        if (words_[i].GetNumBitsSet() == 0)
+          continue;
+
+        uint32_t n = size - idx < BitWord::kBits ? size - idx : BitWord::kBits;
+        words_[i].And(f(idx, n));
+      }
+    }
+
+    template <typename WordFiller>
+    static Block FromWordFiller(uint32_t offset, WordFiller f) {
+      Block b;
+      for (uint32_t i = 0; i < Block::kWords; ++i) {
+        b.words_[i].Or(f(offset + i * BitWord::kBits, BitWord::kBits));
+      }
+      return b;
+    }
+
    private:
     std::array<BitWord, kWords> words_{};
   };
@@ -668,6 +758,19 @@ class BitVector {
   BitVector(const BitVector&) = delete;
   BitVector& operator=(const BitVector&) = delete;
 
+  // Appends the bits between |start| and |end| computed by the word filler
+  // |f| (see |RangeWords|).
+  template <typename WordFiller>
+  void AppendWords(uint32_t start, uint32_t end, WordFiller f) {
+    for (uint32_t i = start; i < end; i += BitWord::kBits) {
+      uint32_t n = end - i < BitWord::kBits ? end - i : BitWord::kBits;
+      uint64_t word = f(i, n);
+      for (uint32_t j = 0; j < n; ++j) {
+        Append((word >> j) & 1u);
+      }
+    }
+  }
+
   // Set all the bits between the addresses given by |start| and |end|
   // (inclusive).
   // Note: this method does not update the counts vector - that is the
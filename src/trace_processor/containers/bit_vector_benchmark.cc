@@ -18,10 +18,14 @@
 
 #include "src/trace_processor/containers/bit_vector.h"
 #include "src/trace_processor/containers/bit_vector_iterators.h"
+#include "src/trace_processor/db/filter_kernels.h"
 
 namespace {
 
 using perfetto::trace_processor::BitVector;
+using perfetto::trace_processor::FilterOp;
+
+namespace filter_kernels = perfetto::trace_processor::filter_kernels;
 
 bool IsBenchmarkFunctionalOnly() {
   return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
@@ -233,6 +237,67 @@ static void BM_BitVectorRangeFixedSize(benchmark::State& state) {
 }
 BENCHMARK(BM_BitVectorRangeFixedSize)->Apply(BitVectorArgs);
 
+static void BM_BitVectorRangeWordsFixedSize(benchmark::State& state) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  uint32_t size = static_cast<uint32_t>(state.range(0));
+  uint32_t set_percentage = static_cast<uint32_t>(state.range(1));
+
+  std::vector<int64_t> resize_fill_pool(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    resize_fill_pool[i] = rnd_engine() % 100 < set_percentage ? 90 : 100;
+  }
+
+  auto kernel = filter_kernels::GetKernel<int64_t>(FilterOp::kLt);
+  for (auto _ : state) {
+    auto filler = [&resize_fill_pool, kernel](uint32_t i, uint32_t n) {
+      return kernel(resize_fill_pool.data() + i, n, 95);
+    };
+    BitVector bv = BitVector::RangeWords(0, size, filler);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_BitVectorRangeWordsFixedSize)->Apply(BitVectorArgs);
+
+// Computes "ts > X AND dur < Y" on the rows of a 50M rows slice-like table
+// the way a table filter would, with a BitVector computed for the first
+// constraint and then updated for the second one.
+static void BM_BitVectorTsDurScan(benchmark::State& state) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  const uint32_t size =
+      IsBenchmarkFunctionalOnly() ? 64 * 1024 : 50 * 1000 * 1000;
+  std::vector<int64_t> ts(size);
+  std::vector<int64_t> dur(size);
+  int64_t cur_ts = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    cur_ts += rnd_engine() % 1000;
+    ts[i] = cur_ts;
+    dur[i] = rnd_engine() % 1000;
+  }
+  const int64_t ts_value = ts[size / 2];
+  const int64_t dur_value = 500;
+
+  auto gt = filter_kernels::GetKernel<int64_t>(FilterOp::kGt);
+  auto lt = filter_kernels::GetKernel<int64_t>(FilterOp::kLt);
+  for (auto _ : state) {
+    auto ts_filler = [&ts, gt, ts_value](uint32_t i, uint32_t n) {
+      return gt(ts.data() + i, n, ts_value);
+    };
+    BitVector bv = BitVector::RangeWords(0, size, ts_filler);
+    bv.AndWords([&dur, lt, dur_value](uint32_t i, uint32_t n) {
+      return lt(dur.data() + i, n, dur_value);
+    });
+    benchmark::DoNotOptimize(bv.GetNumBitsSet());
+  }
+  state.counters["rows/s"] = benchmark::Counter(
+      static_cast<double>(size) * static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_BitVectorTsDurScan)->Unit(benchmark::kMillisecond);
+
 static void BM_BitVectorUpdateSetBits(benchmark::State& state) {
   static constexpr uint32_t kRandomSeed = 42;
   std::minstd_rand0 rnd_engine(kRandomSeed);
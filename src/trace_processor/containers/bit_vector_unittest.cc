@@ -17,6 +17,7 @@
 #include "src/trace_processor/containers/bit_vector.h"
 
 #include <random>
+#include <vector>
 
 #include "src/trace_processor/containers/bit_vector_iterators.h"
 #include "test/gtest_and_gmock.h"
@@ -211,6 +212,16 @@ TEST(BitVectorUnittest, ResizeHasCorrectCount) {
   ASSERT_EQ(bv.GetNumBitsSet(), 1023u);
 }
 
+TEST(BitVectorUnittest, ResizeTrueFromBlockBoundary) {
+  BitVector bv(1, true);
+  bv.Resize(2048, false);
+  bv.Resize(2050, true);
+
+  ASSERT_EQ(bv.GetNumBitsSet(), 3u);
+  ASSERT_EQ(bv.IndexOfNthSet(1), 2048u);
+  ASSERT_EQ(bv.IndexOfNthSet(2), 2049u);
+}
+
 TEST(BitVectorUnittest, AppendAfterResizeDown) {
   BitVector bv(2049, false);
   bv.Set(2048);
@@ -411,6 +422,67 @@ TEST(BitVectorUnittest, Range) {
   ASSERT_EQ(bv.GetNumBitsSet(), 341u);
 }
 
+// Computes the bits of the word filler from a per-bit filler, so that the
+// result can be compared to the one of |BitVector::Range|.
+template <typename Filler>
+uint64_t WordFromFiller(uint32_t idx, uint32_t n, Filler f) {
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    word |= static_cast<uint64_t>(f(idx + i)) << i;
+  }
+  // Set the bits after |n| to check they are ignored.
+  return n == 64 ? word : word | (~0ull << n);
+}
+
+TEST(BitVectorUnittest, RangeWords) {
+  auto filler = [](uint32_t t) { return t % 3 == 0; };
+  for (uint32_t start : {0u, 1u, 63u, 64u, 513u, 1100u}) {
+    for (uint32_t end : {start, start + 1, 1025u, 1600u}) {
+      if (end < start)
+        continue;
+      BitVector bv = BitVector::RangeWords(
+          start, end, [&filler](uint32_t idx, uint32_t n) {
+            return WordFromFiller(idx, n, filler);
+          });
+      BitVector expected = BitVector::Range(0, end, [&](uint32_t t) {
+        return t >= start && filler(t);
+      });
+      ASSERT_EQ(bv.size(), end);
+      ASSERT_EQ(bv.GetNumBitsSet(), expected.GetNumBitsSet());
+      for (uint32_t i = 0; i < end; ++i) {
+        ASSERT_EQ(bv.IsSet(i), expected.IsSet(i));
+        ASSERT_EQ(bv.GetNumBitsSet(i), expected.GetNumBitsSet(i));
+      }
+    }
+  }
+}
+
+TEST(BitVectorUnittest, AndWords) {
+  BitVector bv = BitVector::Range(0, 1100, [](uint32_t t) { return t % 2; });
+  std::vector<uint32_t> words;
+  bv.AndWords([&words](uint32_t idx, uint32_t n) {
+    words.push_back(idx);
+    return WordFromFiller(idx, n, [](uint32_t t) { return t % 3 == 0; });
+  });
+
+  ASSERT_EQ(bv.size(), 1100u);
+  ASSERT_EQ(words.size(), 18u);
+  for (uint32_t i = 0; i < 1100; ++i) {
+    ASSERT_EQ(bv.IsSet(i), i % 2 == 1 && i % 3 == 0);
+    ASSERT_EQ(bv.GetNumBitsSet(i), (i + 2) / 6);
+  }
+
+  // Words without any set bit should not be computed.
+  bv.AndWords([](uint32_t idx, uint32_t) { return idx < 512 ? ~0ull : 0; });
+  words.clear();
+  bv.AndWords([&words](uint32_t idx, uint32_t) {
+    words.push_back(idx);
+    return ~0ull;
+  });
+  ASSERT_EQ(words.size(), 8u);
+  ASSERT_EQ(bv.GetNumBitsSet(), 85u);
+}
+
 TEST(BitVectorUnittest, QueryStressTest) {
   BitVector bv;
   std::vector<bool> bool_vec;
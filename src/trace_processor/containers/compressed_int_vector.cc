@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/compressed_int_vector.h"
+
+#include <algorithm>
+
+#include "perfetto/base/compiler.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Returns the number of bits needed to store |value|.
+uint32_t BitWidth(uint64_t value) {
+  uint32_t width = 0;
+  for (; value != 0; value >>= 1)
+    width++;
+  return width;
+}
+
+// Returns the number of words needed to store |count| values of |width| bits,
+// including the padding word which allows reading any value with at most two
+// word loads.
+uint64_t PackedWords(uint64_t count, uint32_t width) {
+  return (count * width + 63) / 64 + 1;
+}
+
+// Writes the low |width| bits of |value| at bit |bit| of |words|, which must
+// be zero there.
+void WriteBits(uint64_t* words, uint64_t bit, uint32_t width, uint64_t value) {
+  if (width == 0)
+    return;
+  uint64_t* word = words + bit / 64;
+  uint32_t shift = bit % 64;
+  word[0] |= value << shift;
+  if (shift + width > 64)
+    word[1] |= value >> (64 - shift);
+}
+
+uint64_t Difference(int64_t a, int64_t b) {
+  return static_cast<uint64_t>(a) - static_cast<uint64_t>(b);
+}
+
+// Returns the number of bits needed by the differences between consecutive
+// values of the block of |n| values at |values|.
+uint32_t DeltaWidth(const int64_t* values, uint32_t n) {
+  uint64_t max_delta = 0;
+  for (uint32_t i = 1; i < n; ++i)
+    max_delta = std::max(max_delta, Difference(values[i], values[i - 1]));
+  return BitWidth(max_delta);
+}
+
+}  // namespace
+
+constexpr uint32_t CompressedIntVector::kBlockSize;
+constexpr uint32_t CompressedIntVector::kBitPackedHeaderWords;
+constexpr uint32_t CompressedIntVector::kDeltaHeaderWords;
+
+CompressedIntVector::~CompressedIntVector() = default;
+
+// static
+CompressedIntVector CompressedIntVector::BitPack(const int64_t* values,
+                                                 uint32_t size) {
+  int64_t min = size == 0 ? 0 : *std::min_element(values, values + size);
+  int64_t max = size == 0 ? 0 : *std::max_element(values, values + size);
+  uint32_t width = BitWidth(Difference(max, min));
+
+  CompressedIntVector cv;
+  cv.encoding_ = Encoding::kBitPacked;
+  cv.words_.resize(kBitPackedHeaderWords + PackedWords(size, width));
+  cv.words_[0] = size;
+  cv.words_[1] = static_cast<uint64_t>(min);
+  cv.words_[2] = width;
+
+  uint64_t* data = cv.words_.data() + kBitPackedHeaderWords;
+  for (uint32_t i = 0; i < size; ++i)
+    WriteBits(data, static_cast<uint64_t>(i) * width, width,
+              Difference(values[i], min));
+
+  bool parsed = cv.ParseHeader();
+  PERFETTO_DCHECK(parsed);
+  base::ignore_result(parsed);
+  return cv;
+}
+
+// static
+CompressedIntVector CompressedIntVector::DeltaBitPack(const int64_t* values,
+                                                      uint32_t size) {
+  PERFETTO_DCHECK(std::is_sorted(values, values + size));
+
+  uint32_t num_blocks = (size + kBlockSize - 1) / kBlockSize;
+  uint64_t header_words = kDeltaHeaderWords + 3ull * num_blocks;
+
+  // Compute the width of each block first to know the size of the data.
+  std::vector<uint32_t> widths(num_blocks);
+  uint64_t total_bits = 0;
+  for (uint32_t b = 0; b < num_blocks; ++b) {
+    uint32_t start = b * kBlockSize;
+    uint32_t n = std::min(kBlockSize, size - start);
+    widths[b] = DeltaWidth(values + start, n);
+    total_bits += static_cast<uint64_t>(n - 1) * widths[b];
+  }
+
+  CompressedIntVector cv;
+  cv.encoding_ = Encoding::kDeltaBitPacked;
+  cv.words_.resize(header_words + (total_bits + 63) / 64 + 1);
+  cv.words_[0] = size;
+  cv.words_[1] = num_blocks;
+
+  uint64_t* data = cv.words_.data() + header_words;
+  uint64_t bit = 0;
+  for (uint32_t b = 0; b < num_blocks; ++b) {
+    uint32_t start = b * kBlockSize;
+    uint32_t n = std::min(kBlockSize, size - start);
+    uint64_t* block = cv.words_.data() + kDeltaHeaderWords + b * 3;
+    block[0] = static_cast<uint64_t>(values[start]);
+    block[1] = static_cast<uint64_t>(values[start + n - 1]);
+    block[2] = bit << 8 | widths[b];
+    for (uint32_t i = 1; i < n; ++i) {
+      WriteBits(data, bit, widths[b],
+                Difference(values[start + i], values[start + i - 1]));
+      bit += widths[b];
+    }
+  }
+
+  bool parsed = cv.ParseHeader();
+  PERFETTO_DCHECK(parsed);
+  base::ignore_result(parsed);
+  return cv;
+}
+
+// static
+CompressedIntVector CompressedIntVector::EncodeSmallest(const int64_t* values,
+                                                        uint32_t size) {
+  int64_t min = size == 0 ? 0 : *std::min_element(values, values + size);
+  int64_t max = size == 0 ? 0 : *std::max_element(values, values + size);
+  uint64_t bit_packed_words =
+      kBitPackedHeaderWords + PackedWords(size, BitWidth(Difference(max, min)));
+
+  if (!std::is_sorted(values, values + size))
+    return BitPack(values, size);
+
+  uint32_t num_blocks = (size + kBlockSize - 1) / kBlockSize;
+  uint64_t delta_bits = 0;
+  for (uint32_t b = 0; b < num_blocks; ++b) {
+    uint32_t start = b * kBlockSize;
+    uint32_t n = std::min(kBlockSize, size - start);
+    delta_bits += static_cast<uint64_t>(n - 1) * DeltaWidth(values + start, n);
+  }
+  uint64_t delta_words =
+      kDeltaHeaderWords + 3ull * num_blocks + (delta_bits + 63) / 64 + 1;
+
+  return delta_words < bit_packed_words ? DeltaBitPack(values, size)
+                                        : BitPack(values, size);
+}
+
+// static
+base::Optional<CompressedIntVector> CompressedIntVector::FromWords(
+    Encoding encoding,
+    std::vector<uint64_t> words) {
+  CompressedIntVector cv;
+  cv.encoding_ = encoding;
+  cv.words_ = std::move(words);
+  if (!cv.ParseHeader())
+    return base::nullopt;
+  return base::make_optional(std::move(cv));
+}
+
+bool CompressedIntVector::ParseHeader() {
+  switch (encoding_) {
+    case Encoding::kBitPacked: {
+      if (words_.size() < kBitPackedHeaderWords)
+        return false;
+      if (words_[0] > UINT32_MAX || words_[2] > 64)
+        return false;
+      size_ = static_cast<uint32_t>(words_[0]);
+      base_ = static_cast<int64_t>(words_[1]);
+      width_ = static_cast<uint32_t>(words_[2]);
+      return words_.size() ==
+             kBitPackedHeaderWords + PackedWords(size_, width_);
+    }
+    case Encoding::kDeltaBitPacked: {
+      if (words_.size() < kDeltaHeaderWords || words_[0] > UINT32_MAX)
+        return false;
+      size_ = static_cast<uint32_t>(words_[0]);
+      uint32_t num_blocks = (size_ + kBlockSize - 1) / kBlockSize;
+      if (words_[1] != num_blocks)
+        return false;
+      uint64_t header_words = kDeltaHeaderWords + 3ull * num_blocks;
+      if (words_.size() <= header_words)
+        return false;
+      data_start_ = static_cast<uint32_t>(header_words);
+
+      // Check that all the differences of each block are inside the data, so
+      // that no corrupted header can make Get() read out of bounds.
+      uint64_t data_bits = (words_.size() - header_words - 1) * 64;
+      for (uint32_t b = 0; b < num_blocks; ++b) {
+        uint64_t info = words_[kDeltaHeaderWords + b * 3 + 2];
+        uint64_t bit = info >> 8;
+        uint32_t width = info & 0xff;
+        uint32_t n = std::min(kBlockSize, size_ - b * kBlockSize);
+        if (width > 64 || bit + static_cast<uint64_t>(n - 1) * width > data_bits)
+          return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+int64_t CompressedIntVector::GetDelta(uint32_t idx) const {
+  uint32_t block = idx / kBlockSize;
+  uint32_t offset = idx % kBlockSize;
+  const uint64_t* info = words_.data() + kDeltaHeaderWords + block * 3;
+  uint64_t value = info[0];
+  uint32_t width = info[2] & 0xff;
+  if (width == 0)
+    return static_cast<int64_t>(value);
+
+  const uint64_t* data = words_.data() + data_start_;
+  uint64_t bit = info[2] >> 8;
+  for (uint32_t i = 0; i < offset; ++i, bit += width)
+    value += ReadBits(data, bit, width);
+  return static_cast<int64_t>(value);
+}
+
+void CompressedIntVector::Decode(uint32_t start,
+                                 uint32_t n,
+                                 int64_t* out) const {
+  PERFETTO_DCHECK(start + n <= size_);
+  if (encoding_ == Encoding::kBitPacked) {
+    const uint64_t* data = words_.data() + kBitPackedHeaderWords;
+    uint64_t bit = static_cast<uint64_t>(start) * width_;
+    for (uint32_t i = 0; i < n; ++i, bit += width_)
+      out[i] = static_cast<int64_t>(static_cast<uint64_t>(base_) +
+                                    ReadBits(data, bit, width_));
+    return;
+  }
+
+  const uint64_t* data = words_.data() + data_start_;
+  uint32_t end = start + n;
+  for (uint32_t i = start; i < end;) {
+    uint32_t block = i / kBlockSize;
+    uint32_t block_end = std::min((block + 1) * kBlockSize, end);
+    const uint64_t* info = words_.data() + kDeltaHeaderWords + block * 3;
+    uint32_t width = info[2] & 0xff;
+    uint64_t bit = info[2] >> 8;
+
+    // Sum the differences from the start of the block up to |i|, then output
+    // the values up to the end of the block (or of the range).
+    uint64_t value = info[0];
+    for (uint32_t j = block * kBlockSize; j < i; ++j, bit += width)
+      value += ReadBits(data, bit, width);
+    *out++ = static_cast<int64_t>(value);
+    for (++i; i < block_end; ++i, bit += width) {
+      value += ReadBits(data, bit, width);
+      *out++ = static_cast<int64_t>(value);
+    }
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_INT_VECTOR_H_
+#define SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_INT_VECTOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/optional.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An immutable vector of integers stored in a compressed form which can still
+// be accessed randomly and scanned without being decompressed first.
+//
+// All the data is stored in a single vector of words, |words()|, whose first
+// words describe the layout of the rest (see the encodings below). This allows
+// the vector to be saved and restored as-is (see FromWords()).
+class CompressedIntVector {
+ public:
+  enum class Encoding : uint32_t {
+    // Each value is stored as its difference with the smallest value, using
+    // as many bits as the largest difference needs ("frame of reference" and
+    // bit packing). Get() is O(1). This suits values spanning a small range
+    // (e.g. cpus, priorities, states or utids).
+    //
+    // Layout: [size, smallest value, bits per value, packed values..., 0].
+    kBitPacked = 1,
+
+    // The values are split in blocks of |kBlockSize| values. Each block
+    // stores its first and last values and the difference between each value
+    // and the previous one, bit packed with as many bits as the largest
+    // difference of the block needs. Only sorted values can be stored this
+    // way and Get() is O(kBlockSize). This suits timestamps and ids, which
+    // are sorted and whose differences are much smaller than their values.
+    //
+    // Layout: [size, number of blocks,
+    //          for each block: first value, last value,
+    //                          offset in bits of its differences << 8 |
+    //                          bits per difference,
+    //          packed differences..., 0].
+    kDeltaBitPacked = 2,
+  };
+
+  static constexpr uint32_t kBlockSize = 64;
+
+  CompressedIntVector() = default;
+  ~CompressedIntVector();
+
+  CompressedIntVector(CompressedIntVector&&) noexcept = default;
+  CompressedIntVector& operator=(CompressedIntVector&&) = default;
+
+  // Encodes the |size| values at |values| with kBitPacked.
+  static CompressedIntVector BitPack(const int64_t* values, uint32_t size);
+
+  // Encodes the |size| values at |values|, which must be sorted, with
+  // kDeltaBitPacked.
+  static CompressedIntVector DeltaBitPack(const int64_t* values,
+                                          uint32_t size);
+
+  // Encodes the |size| values at |values| with the encoding taking the least
+  // memory among the ones which can store them.
+  static CompressedIntVector EncodeSmallest(const int64_t* values,
+                                            uint32_t size);
+
+  // Recreates a vector from the |words()| of a vector with |encoding|, e.g.
+  // when loading a snapshot. Returns nullopt if |words| is not valid.
+  static base::Optional<CompressedIntVector> FromWords(
+      Encoding encoding,
+      std::vector<uint64_t> words);
+
+  // Returns the value at |idx|.
+  int64_t Get(uint32_t idx) const {
+    PERFETTO_DCHECK(idx < size_);
+    if (encoding_ == Encoding::kBitPacked)
+      return static_cast<int64_t>(static_cast<uint64_t>(base_) + GetCode(idx));
+    return GetDelta(idx);
+  }
+
+  // Writes the |n| values starting at |start| to |out|.
+  void Decode(uint32_t start, uint32_t n, int64_t* out) const;
+
+  // For kBitPacked, returns the difference between the value at |idx| and
+  // |base()| without adding them, which allows scanning the values as
+  // unsigned integers of |width()| bits.
+  uint64_t GetCode(uint32_t idx) const {
+    PERFETTO_DCHECK(encoding_ == Encoding::kBitPacked);
+    return ReadBits(words_.data() + kBitPackedHeaderWords,
+                    static_cast<uint64_t>(idx) * width_, width_);
+  }
+  int64_t base() const { return base_; }
+  uint32_t width() const { return width_; }
+
+  // For kDeltaBitPacked, returns the first and last values of the block
+  // |block|, which contains the values from |block * kBlockSize|.
+  int64_t BlockFirst(uint32_t block) const {
+    return static_cast<int64_t>(words_[kDeltaHeaderWords + block * 3]);
+  }
+  int64_t BlockLast(uint32_t block) const {
+    return static_cast<int64_t>(words_[kDeltaHeaderWords + block * 3 + 1]);
+  }
+
+  Encoding encoding() const { return encoding_; }
+  uint32_t size() const { return size_; }
+  const std::vector<uint64_t>& words() const { return words_; }
+  size_t size_bytes() const { return words_.size() * sizeof(uint64_t); }
+
+ private:
+  static constexpr uint32_t kBitPackedHeaderWords = 3;
+  static constexpr uint32_t kDeltaHeaderWords = 2;
+
+  // Reads the |width| bits starting at bit |bit| of |words|. As the packed
+  // values are followed by a padding word, the word after the one containing
+  // |bit| can always be read.
+  static uint64_t ReadBits(const uint64_t* words,
+                           uint64_t bit,
+                           uint32_t width) {
+    const uint64_t* word = words + bit / 64;
+    uint32_t shift = bit % 64;
+    uint64_t value = word[0] >> shift;
+    if (shift + width > 64)
+      value |= word[1] << (64 - shift);
+    return width == 64 ? value : value & ((1ull << width) - 1);
+  }
+
+  int64_t GetDelta(uint32_t idx) const;
+
+  // Computes the members caching the header of |words_|.
+  bool ParseHeader();
+
+  Encoding encoding_ = Encoding::kBitPacked;
+  std::vector<uint64_t> words_;
+
+  uint32_t size_ = 0;
+
+  // kBitPacked only.
+  int64_t base_ = 0;
+  uint32_t width_ = 0;
+
+  // kDeltaBitPacked only: the index of the first word of the packed
+  // differences.
+  uint32_t data_start_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_CONTAINERS_COMPRESSED_INT_VECTOR_H_
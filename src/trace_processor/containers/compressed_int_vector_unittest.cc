@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/containers/compressed_int_vector.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Encoding = CompressedIntVector::Encoding;
+
+void CheckValues(const CompressedIntVector& cv,
+                 const std::vector<int64_t>& values) {
+  ASSERT_EQ(cv.size(), values.size());
+  for (uint32_t i = 0; i < values.size(); ++i)
+    ASSERT_EQ(cv.Get(i), values[i]) << "at " << i;
+
+  // Decode ranges which start and end in the middle of blocks.
+  std::vector<int64_t> decoded(values.size());
+  for (uint32_t start = 0; start < values.size(); start += 37) {
+    uint32_t n = std::min(100u, static_cast<uint32_t>(values.size()) - start);
+    cv.Decode(start, n, decoded.data());
+    for (uint32_t i = 0; i < n; ++i)
+      ASSERT_EQ(decoded[i], values[start + i]) << "at " << start + i;
+  }
+}
+
+TEST(CompressedIntVector, BitPack) {
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<int64_t> values(1000);
+  for (int64_t& value : values)
+    value = -5 + static_cast<int64_t>(rnd_engine() % 20);
+
+  CompressedIntVector cv = CompressedIntVector::BitPack(values.data(), 1000);
+  ASSERT_EQ(cv.encoding(), Encoding::kBitPacked);
+  ASSERT_EQ(cv.base(), -5);
+  ASSERT_EQ(cv.width(), 5u);
+  ASSERT_LT(cv.size_bytes(), 1000u);
+  CheckValues(cv, values);
+}
+
+TEST(CompressedIntVector, BitPackExtremes) {
+  std::vector<int64_t> values = {std::numeric_limits<int64_t>::min(), 0,
+                                 std::numeric_limits<int64_t>::max(), -1, 1};
+  CompressedIntVector cv = CompressedIntVector::BitPack(values.data(), 5);
+  ASSERT_EQ(cv.width(), 64u);
+  CheckValues(cv, values);
+
+  std::vector<int64_t> same(100, 7);
+  cv = CompressedIntVector::BitPack(same.data(), 100);
+  ASSERT_EQ(cv.width(), 0u);
+  CheckValues(cv, same);
+}
+
+TEST(CompressedIntVector, DeltaBitPack) {
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<int64_t> values(1000);
+  int64_t ts = 1000000000000;
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    // Leave some blocks with equal values and some with large gaps.
+    uint32_t max_delta = i / 64 == 5 ? 1u << 30 : 1000;
+    if (i / 64 != 3)
+      ts += static_cast<int64_t>(rnd_engine() % max_delta);
+    values[i] = ts;
+  }
+
+  CompressedIntVector cv = CompressedIntVector::DeltaBitPack(values.data(),
+                                                             1000);
+  ASSERT_EQ(cv.encoding(), Encoding::kDeltaBitPacked);
+  ASSERT_LT(cv.size_bytes(), 8000u / 3);
+  for (uint32_t b = 0; b * 64 < 1000; ++b) {
+    ASSERT_EQ(cv.BlockFirst(b), values[b * 64]);
+    ASSERT_EQ(cv.BlockLast(b), values[std::min(b * 64 + 63, 999u)]);
+  }
+  CheckValues(cv, values);
+}
+
+TEST(CompressedIntVector, EncodeSmallest) {
+  std::vector<int64_t> sorted;
+  for (int64_t i = 0; i < 1000; ++i)
+    sorted.push_back(1000000000 + i * 100);
+  ASSERT_EQ(CompressedIntVector::EncodeSmallest(sorted.data(), 1000).encoding(),
+            Encoding::kDeltaBitPacked);
+
+  std::vector<int64_t> small;
+  for (int64_t i = 0; i < 1000; ++i)
+    small.push_back(i % 4);
+  ASSERT_EQ(CompressedIntVector::EncodeSmallest(small.data(), 1000).encoding(),
+            Encoding::kBitPacked);
+
+  CompressedIntVector empty = CompressedIntVector::EncodeSmallest(nullptr, 0);
+  ASSERT_EQ(empty.size(), 0u);
+}
+
+TEST(CompressedIntVector, FromWords) {
+  std::vector<int64_t> values;
+  for (int64_t i = 0; i < 200; ++i)
+    values.push_back(i * i);
+  CompressedIntVector cv = CompressedIntVector::DeltaBitPack(values.data(),
+                                                             200);
+
+  auto restored = CompressedIntVector::FromWords(cv.encoding(), cv.words());
+  ASSERT_TRUE(restored.has_value());
+  CheckValues(*restored, values);
+
+  // Truncated words or headers pointing out of the words are rejected.
+  std::vector<uint64_t> words = cv.words();
+  words.pop_back();
+  ASSERT_FALSE(CompressedIntVector::FromWords(cv.encoding(), words));
+  words = cv.words();
+  words[4] = uint64_t(1) << 40 | 8;
+  ASSERT_FALSE(CompressedIntVector::FromWords(cv.encoding(), words));
+  ASSERT_FALSE(
+      CompressedIntVector::FromWords(Encoding::kBitPacked, cv.words()));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -18,11 +18,15 @@
 #define SRC_TRACE_PROCESSOR_CONTAINERS_NULLABLE_VECTOR_H_
 
 #include <stdint.h>
+#include <string.h>
 
-#include <deque>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/containers/compressed_int_vector.h"
 #include "src/trace_processor/containers/row_map.h"
 
 namespace perfetto {
@@ -40,18 +44,113 @@ class NullableVectorBase {
 
   NullableVectorBase(NullableVectorBase&&) = default;
   NullableVectorBase& operator=(NullableVectorBase&&) noexcept = default;
+
+  // Returns a counter which changes every time the contents of the vector
+  // change; this allows data derived from the vector (e.g. indexes) to detect
+  // when it is stale.
+  uint32_t generation() const { return generation_; }
+
+  // Replaces the storage of the non-null values with a CompressedIntVector if
+  // this saves enough memory. This is only done for vectors of integers and
+  // is meant to be called once the vector is not changed anymore: any
+  // following change decompresses the storage. Returns whether the storage is
+  // now compressed.
+  virtual bool Compact() = 0;
+
+  // The in-memory representation of the vector, used to save it in a snapshot
+  // of the trace storage and to restore it (see trace_storage_snapshot.h).
+  struct RawParts {
+    // The |data_count| entries of NullableVector::data(), each of
+    // |element_size| bytes, or if |encoding| is not zero, the words of the
+    // CompressedIntVector with this encoding storing them.
+    const void* data;
+    uint32_t data_count;
+    uint32_t element_size;
+    uint32_t encoding;
+
+    // The indices of the non-null entries.
+    const RowMap* non_null;
+    uint32_t size;
+  };
+  virtual RawParts GetRawParts() const = 0;
+
+  // Replaces the contents of the vector with |size| entries, the ones at
+  // |non_null| being non-null, and the storage with the |data_count| entries
+  // at |data| (see RawParts). Returns false, leaving the vector unchanged, if
+  // these are inconsistent with each other or with the mode of the vector.
+  virtual bool SetRawParts(const void* data,
+                           uint32_t data_count,
+                           uint32_t encoding,
+                           RowMap non_null,
+                           uint32_t size) = 0;
+
+ protected:
+  uint32_t generation_ = 0;
+};
+
+namespace nullable_vector_internal {
+
+// Converts the values of a NullableVector to and from the values of a
+// CompressedIntVector; only vectors of integers can be compressed.
+template <typename T,
+          bool = std::is_integral<T>::value && !std::is_same<T, bool>::value>
+struct Compression {
+  static constexpr bool kCompressible = false;
+  static base::Optional<CompressedIntVector> Compress(const std::vector<T>&) {
+    return base::nullopt;
+  }
+  static T FromInt64(int64_t) { PERFETTO_FATAL("Vector is not compressible"); }
+  static void Decompress(const CompressedIntVector&, std::vector<T>*) {
+    PERFETTO_FATAL("Vector is not compressible");
+  }
 };
 
+template <typename T>
+struct Compression<T, true> {
+  static constexpr bool kCompressible = true;
+  static base::Optional<CompressedIntVector> Compress(
+      const std::vector<T>& data) {
+    std::vector<int64_t> values(data.begin(), data.end());
+    CompressedIntVector cv = CompressedIntVector::EncodeSmallest(
+        values.data(), static_cast<uint32_t>(values.size()));
+
+    // Reading a compressed vector is slower so only use it if it is at most
+    // half the size of the uncompressed one.
+    if (cv.size_bytes() * 2 > data.size() * sizeof(T))
+      return base::nullopt;
+    return base::make_optional(std::move(cv));
+  }
+  static T FromInt64(int64_t value) { return static_cast<T>(value); }
+  static void Decompress(const CompressedIntVector& cv, std::vector<T>* data) {
+    static constexpr uint32_t kChunkSize = 1024;
+    int64_t chunk[kChunkSize];
+    data->resize(cv.size());
+    for (uint32_t i = 0; i < cv.size(); i += kChunkSize) {
+      uint32_t n = std::min(kChunkSize, cv.size() - i);
+      cv.Decode(i, n, chunk);
+      for (uint32_t j = 0; j < n; ++j)
+        (*data)[i + j] = static_cast<T>(chunk[j]);
+    }
+  }
+};
+
+}  // namespace nullable_vector_internal
+
 // A data structure which compactly stores a list of possibly nullable data.
 //
-// Internally, this class is implemented using a combination of a std::deque
+// Internally, this class is implemented using a combination of a std::vector
 // with a BitVector used to store whether each index is null or not.
 // By default, for each null value, it only uses a single bit inside the
 // BitVector at a slight cost (searching the BitVector to find the index into
-// the std::deque) when looking up the data.
+// the std::vector) when looking up the data.
+//
+// Once the vector is not changed anymore, the std::vector can be replaced by
+// a CompressedIntVector for vectors of integers (see |Compact|).
 template <typename T>
 class NullableVector : public NullableVectorBase {
  private:
+  using Compression = nullable_vector_internal::Compression<T>;
+
   enum class Mode {
     // Sparse mode is the default mode and ensures that nulls are stored using
     // only
@@ -86,10 +185,10 @@ class NullableVector : public NullableVectorBase {
   base::Optional<T> Get(uint32_t idx) const {
     if (mode_ == Mode::kDense) {
       bool contains = valid_.Contains(idx);
-      return contains ? base::Optional<T>(data_[idx]) : base::nullopt;
+      return contains ? base::Optional<T>(GetData(idx)) : base::nullopt;
     } else {
       auto opt_idx = valid_.IndexOf(idx);
-      return opt_idx ? base::Optional<T>(data_[*opt_idx]) : base::nullopt;
+      return opt_idx ? base::Optional<T>(GetData(*opt_idx)) : base::nullopt;
     }
   }
 
@@ -105,25 +204,47 @@ class NullableVector : public NullableVectorBase {
   // ...
   T GetNonNull(uint32_t ordinal) const {
     if (mode_ == Mode::kDense) {
-      return data_[valid_.Get(ordinal)];
+      return GetData(valid_.Get(ordinal));
     } else {
-      PERFETTO_DCHECK(ordinal < data_.size());
-      return data_[ordinal];
+      PERFETTO_DCHECK(ordinal < valid_.size());
+      return GetData(ordinal);
     }
   }
 
+  // Returns a pointer to the contiguous storage backing this vector. In sparse
+  // mode, the entries are indexed by ordinal (see |GetNonNull|); in dense
+  // mode, they are indexed by index. Either way, if there are no null
+  // values, the value at |idx| is |data()[idx]|.
+  //
+  // Must not be called if the storage is compressed: |compressed()| is then
+  // indexed in the same way.
+  const T* data() const {
+    PERFETTO_DCHECK(!compressed_);
+    return data_.data();
+  }
+
+  // Returns the compressed storage backing this vector or nullptr if it is
+  // not compressed (see |Compact|).
+  const CompressedIntVector* compressed() const {
+    return compressed_ ? &*compressed_ : nullptr;
+  }
+
   // Adds the given value to the NullableVector.
   void Append(T val) {
+    MaybeDecompress();
     data_.emplace_back(val);
     valid_.Insert(size_++);
+    generation_++;
   }
 
   // Adds a null value to the NullableVector.
   void AppendNull() {
     if (mode_ == Mode::kDense) {
+      MaybeDecompress();
       data_.emplace_back();
     }
     size_++;
+    generation_++;
   }
 
   // Adds the given optional value to the NullableVector.
@@ -137,6 +258,8 @@ class NullableVector : public NullableVectorBase {
 
   // Sets the value at |idx| to the given |val|.
   void Set(uint32_t idx, T val) {
+    MaybeDecompress();
+    generation_++;
     if (mode_ == Mode::kDense) {
       if (!valid_.Contains(idx)) {
         valid_.Insert(idx);
@@ -165,12 +288,88 @@ class NullableVector : public NullableVectorBase {
   // Returns whether data in this NullableVector is stored densely.
   bool IsDense() const { return mode_ == Mode::kDense; }
 
+  bool Compact() override {
+    if (!compressed_ && !data_.empty()) {
+      compressed_ = Compression::Compress(data_);
+      if (compressed_)
+        data_ = std::vector<T>();
+    }
+    return compressed_.has_value();
+  }
+
+  RawParts GetRawParts() const override {
+    if (compressed_) {
+      const std::vector<uint64_t>& words = compressed_->words();
+      return RawParts{words.data(), static_cast<uint32_t>(words.size()),
+                      sizeof(uint64_t),
+                      static_cast<uint32_t>(compressed_->encoding()), &valid_,
+                      size_};
+    }
+    return RawParts{data_.data(), static_cast<uint32_t>(data_.size()),
+                    sizeof(T),    0,
+                    &valid_,      size_};
+  }
+
+  bool SetRawParts(const void* data,
+                   uint32_t data_count,
+                   uint32_t encoding,
+                   RowMap non_null,
+                   uint32_t size) override {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "The entries are copied as raw bytes");
+    if (non_null.size() > size ||
+        (!non_null.empty() && non_null.Get(non_null.size() - 1) >= size)) {
+      return false;
+    }
+    uint32_t expected_count = mode_ == Mode::kDense ? size : non_null.size();
+    if (encoding == 0) {
+      if (data_count != expected_count)
+        return false;
+      compressed_ = base::nullopt;
+      data_.resize(data_count);
+      if (data_count > 0)
+        memcpy(data_.data(), data, data_count * sizeof(T));
+    } else {
+      if (!Compression::kCompressible)
+        return false;
+      const uint64_t* words = static_cast<const uint64_t*>(data);
+      auto cv = CompressedIntVector::FromWords(
+          static_cast<CompressedIntVector::Encoding>(encoding),
+          std::vector<uint64_t>(words, words + data_count));
+      if (!cv || cv->size() != expected_count)
+        return false;
+      compressed_ = std::move(cv);
+      data_ = std::vector<T>();
+    }
+    valid_ = std::move(non_null);
+    size_ = size;
+    generation_++;
+    return true;
+  }
+
  private:
   NullableVector(Mode mode) : mode_(mode) {}
 
+  T GetData(uint32_t data_idx) const {
+    if (PERFETTO_UNLIKELY(compressed_))
+      return Compression::FromInt64(compressed_->Get(data_idx));
+    return data_[data_idx];
+  }
+
+  void MaybeDecompress() {
+    if (PERFETTO_LIKELY(!compressed_))
+      return;
+    Compression::Decompress(*compressed_, &data_);
+    compressed_ = base::nullopt;
+  }
+
   Mode mode_ = Mode::kSparse;
 
-  std::deque<T> data_;
+  std::vector<T> data_;
+
+  // Replaces |data_| once the vector is compacted.
+  base::Optional<CompressedIntVector> compressed_;
+
   RowMap valid_;
   uint32_t size_ = 0;
 };
@@ -12,11 +12,14 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <random>
 
 #include <benchmark/benchmark.h>
 
+#include "perfetto/base/logging.h"
 #include "src/trace_processor/containers/nullable_vector.h"
+#include "src/trace_processor/db/filter_kernels.h"
 
 namespace {
 
@@ -64,3 +67,129 @@ static void BM_NullableVectorGetNonNull(benchmark::State& state) {
   }
 }
 BENCHMARK(BM_NullableVectorGetNonNull);
+
+namespace {
+
+using perfetto::trace_processor::NullableVector;
+
+// The kinds of integer columns NullableVector::Compact is meant for.
+enum ColumnKind : int64_t {
+  // Sorted timestamps a few microseconds apart, like the ts column of slices.
+  kTimestamps = 0,
+  // Small values in random order, like the cpu column of sched slices.
+  kCpus = 1,
+  // Values from a larger range in random order, like utids.
+  kUtids = 2,
+};
+
+NullableVector<int64_t> CreateColumn(int64_t kind, uint32_t size) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  NullableVector<int64_t> nv;
+  int64_t ts = 1000000000000;
+  for (uint32_t i = 0; i < size; ++i) {
+    switch (kind) {
+      case kTimestamps:
+        ts += rnd_engine() % 10000;
+        nv.Append(ts);
+        break;
+      case kCpus:
+        nv.Append(static_cast<int64_t>(rnd_engine() % 8));
+        break;
+      case kUtids:
+        nv.Append(static_cast<int64_t>(rnd_engine() % 4000));
+        break;
+    }
+  }
+  return nv;
+}
+
+void ColumnKindArgs(benchmark::internal::Benchmark* b) {
+  b->Arg(kTimestamps)->Arg(kCpus)->Arg(kUtids);
+}
+
+uint64_t DataBytes(const NullableVector<int64_t>& nv) {
+  auto parts = nv.GetRawParts();
+  return static_cast<uint64_t>(parts.data_count) * parts.element_size;
+}
+
+}  // namespace
+
+static void BM_NullableVectorCompact(benchmark::State& state) {
+  NullableVector<int64_t> original = CreateColumn(state.range(0), kSize);
+  uint64_t compressed_bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    NullableVector<int64_t> nv = CreateColumn(state.range(0), kSize);
+    state.ResumeTiming();
+
+    benchmark::DoNotOptimize(nv.Compact());
+
+    state.PauseTiming();
+    compressed_bytes = DataBytes(nv);
+    state.ResumeTiming();
+  }
+  state.counters["bytes"] =
+      benchmark::Counter(static_cast<double>(DataBytes(original)));
+  state.counters["compressed_bytes"] =
+      benchmark::Counter(static_cast<double>(compressed_bytes));
+}
+BENCHMARK(BM_NullableVectorCompact)->Apply(ColumnKindArgs);
+
+static void BM_NullableVectorGetNonNullCompressed(benchmark::State& state) {
+  NullableVector<int64_t> nv = CreateColumn(state.range(0), kSize);
+  PERFETTO_CHECK(nv.Compact());
+
+  std::vector<uint32_t> idx_pool(kPoolSize);
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  for (uint32_t i = 0; i < kPoolSize; ++i) {
+    idx_pool[i] = rnd_engine() % kSize;
+  }
+
+  uint32_t pool_idx = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(nv.GetNonNull(idx_pool[pool_idx]));
+    pool_idx = (pool_idx + 1) % kPoolSize;
+  }
+}
+BENCHMARK(BM_NullableVectorGetNonNullCompressed)->Apply(ColumnKindArgs);
+
+// Filters the whole column with a "less than" filter selecting about half of
+// the rows, either on the raw values or decoding the compressed ones.
+static void FilterColumn(benchmark::State& state, bool compressed) {
+  using perfetto::trace_processor::FilterOp;
+  namespace filter_kernels = perfetto::trace_processor::filter_kernels;
+
+  NullableVector<int64_t> nv = CreateColumn(state.range(0), kSize);
+  int64_t value = nv.GetNonNull(kSize / 2);
+  if (compressed)
+    PERFETTO_CHECK(nv.Compact());
+
+  auto kernel = filter_kernels::GetKernel<int64_t>(FilterOp::kLt);
+  for (auto _ : state) {
+    uint64_t words = 0;
+    if (compressed) {
+      filter_kernels::CompressedFilter filter(*nv.compressed(), FilterOp::kLt,
+                                              value);
+      for (uint32_t i = 0; i < kSize; i += 64)
+        words ^= filter.Filter(i, std::min(64u, kSize - i));
+    } else {
+      const int64_t* data = nv.data();
+      for (uint32_t i = 0; i < kSize; i += 64)
+        words ^= kernel(data + i, std::min(64u, kSize - i), value);
+    }
+    benchmark::DoNotOptimize(words);
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * kSize);
+}
+
+static void BM_NullableVectorFilter(benchmark::State& state) {
+  FilterColumn(state, false);
+}
+BENCHMARK(BM_NullableVectorFilter)->Apply(ColumnKindArgs);
+
+static void BM_NullableVectorFilterCompressed(benchmark::State& state) {
+  FilterColumn(state, true);
+}
+BENCHMARK(BM_NullableVectorFilterCompressed)->Apply(ColumnKindArgs);
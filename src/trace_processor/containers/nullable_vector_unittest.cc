@@ -98,6 +98,76 @@ TEST(NullableVector, Dense) {
   ASSERT_EQ(sv.GetNonNull(2), 2);
 }
 
+TEST(NullableVector, Compact) {
+  NullableVector<uint32_t> sv;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    if (i % 3 == 0)
+      sv.AppendNull();
+    else
+      sv.Append(i % 8);
+  }
+
+  ASSERT_TRUE(sv.Compact());
+  ASSERT_NE(sv.compressed(), nullptr);
+  for (uint32_t i = 0; i < 1000; ++i) {
+    if (i % 3 == 0)
+      ASSERT_EQ(sv.Get(i), base::nullopt);
+    else
+      ASSERT_EQ(sv.Get(i), base::Optional<uint32_t>(i % 8));
+  }
+
+  // Changing the vector decompresses it.
+  sv.Set(0, 100);
+  sv.Append(101);
+  ASSERT_EQ(sv.compressed(), nullptr);
+  ASSERT_EQ(sv.Get(0), base::Optional<uint32_t>(100));
+  ASSERT_EQ(sv.Get(1), base::Optional<uint32_t>(1));
+  ASSERT_EQ(sv.Get(1000), base::Optional<uint32_t>(101));
+}
+
+TEST(NullableVector, CompactIncompressible) {
+  NullableVector<int64_t> sv;
+  for (int64_t i = 0; i < 100; ++i)
+    sv.Append(i % 2 == 0 ? i : -i * 1000000000000);
+  ASSERT_FALSE(sv.Compact());
+  ASSERT_EQ(sv.compressed(), nullptr);
+
+  NullableVector<double> dv;
+  for (uint32_t i = 0; i < 100; ++i)
+    dv.Append(1.0);
+  ASSERT_FALSE(dv.Compact());
+}
+
+TEST(NullableVector, CompactRawParts) {
+  auto sv = NullableVector<int64_t>::Dense();
+  for (int64_t i = 0; i < 1000; ++i) {
+    if (i % 5 == 0)
+      sv.AppendNull();
+    else
+      sv.Append(1000000 + i);
+  }
+  ASSERT_TRUE(sv.Compact());
+
+  auto parts = sv.GetRawParts();
+  ASSERT_NE(parts.encoding, 0u);
+  auto restored = NullableVector<int64_t>::Dense();
+  ASSERT_TRUE(restored.SetRawParts(parts.data, parts.data_count,
+                                   parts.encoding, parts.non_null->Copy(),
+                                   parts.size));
+  ASSERT_NE(restored.compressed(), nullptr);
+  for (uint32_t i = 0; i < 1000; ++i)
+    ASSERT_EQ(restored.Get(i), sv.Get(i));
+
+  // Compressed words can't be restored with another size or in a vector
+  // which can't be compressed.
+  ASSERT_FALSE(restored.SetRawParts(parts.data, parts.data_count,
+                                    parts.encoding, parts.non_null->Copy(),
+                                    parts.size + 1));
+  NullableVector<double> dv;
+  ASSERT_FALSE(dv.SetRawParts(parts.data, parts.data_count, parts.encoding,
+                              parts.non_null->Copy(), parts.size));
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
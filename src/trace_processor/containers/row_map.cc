@@ -16,11 +16,36 @@
 
 #include "src/trace_processor/containers/row_map.h"
 
+#include <algorithm>
+
 namespace perfetto {
 namespace trace_processor {
 
+constexpr uint32_t RowMap::kSmallRangeLimit;
+constexpr uint32_t RowMap::kBytesPerRun;
+
 namespace {
 
+using Run = RowMap::Run;
+
+// Appends the rows at the indices between |start| and |end| of the RowMap
+// given by |runs| and |run_offsets| to |out|.
+void AppendRunsBetween(const std::vector<Run>& runs,
+                       const std::vector<uint32_t>& run_offsets,
+                       uint32_t start,
+                       uint32_t end,
+                       std::vector<Run>* out) {
+  if (start >= end)
+    return;
+  auto it = std::upper_bound(run_offsets.begin(), run_offsets.end(), start);
+  auto run = static_cast<size_t>(std::distance(run_offsets.begin(), it)) - 1;
+  for (; run < runs.size() && run_offsets[run] < end; ++run) {
+    uint32_t from = std::max(start, run_offsets[run]) - run_offsets[run];
+    uint32_t to = std::min(end, run_offsets[run + 1]) - run_offsets[run];
+    RowMap::AppendRun(out, runs[run].start + from, runs[run].start + to);
+  }
+}
+
 RowMap SelectRangeWithRange(uint32_t start,
                             uint32_t end,
                             uint32_t selector_start,
@@ -71,6 +96,19 @@ RowMap SelectRangeWithIv(uint32_t start,
   return RowMap(std::move(iv));
 }
 
+RowMap SelectRangeWithRuns(uint32_t start,
+                           uint32_t end,
+                           const std::vector<Run>& selector) {
+  PERFETTO_DCHECK(start <= end);
+
+  std::vector<Run> runs(selector.size());
+  for (uint32_t i = 0; i < selector.size(); ++i) {
+    PERFETTO_DCHECK(selector[i].end <= end - start);
+    runs[i] = Run{selector[i].start + start, selector[i].end + start};
+  }
+  return RowMap::FromRuns(std::move(runs));
+}
+
 RowMap SelectBvWithRange(const BitVector& bv,
                          uint32_t selector_start,
                          uint32_t selector_end) {
@@ -102,6 +140,19 @@ RowMap SelectBvWithIv(const BitVector& bv,
   return RowMap(std::move(iv));
 }
 
+RowMap SelectBvWithRuns(const BitVector& bv, const std::vector<Run>& selector) {
+  BitVector ret = bv.Copy();
+  auto run = selector.begin();
+  for (auto it = ret.IterateSetBits(); it; it.Next()) {
+    uint32_t set_idx = it.ordinal();
+    while (run != selector.end() && set_idx >= run->end)
+      ++run;
+    if (run == selector.end() || set_idx < run->start)
+      it.Clear();
+  }
+  return RowMap(std::move(ret));
+}
+
 RowMap SelectIvWithRange(const std::vector<uint32_t>& iv,
                          uint32_t selector_start,
                          uint32_t selector_end) {
@@ -126,6 +177,58 @@ RowMap SelectIvWithBv(const std::vector<uint32_t>& iv,
   return RowMap(std::move(copy));
 }
 
+RowMap SelectIvWithRuns(const std::vector<uint32_t>& iv,
+                        const std::vector<Run>& selector) {
+  std::vector<uint32_t> ret;
+  for (const Run& run : selector) {
+    PERFETTO_DCHECK(run.end <= iv.size());
+    ret.insert(ret.end(), iv.begin() + run.start, iv.begin() + run.end);
+  }
+  return RowMap(std::move(ret));
+}
+
+RowMap SelectRunsWithRuns(const std::vector<Run>& runs,
+                          const std::vector<uint32_t>& run_offsets,
+                          const std::vector<Run>& selector) {
+  std::vector<Run> ret;
+  for (const Run& run : selector) {
+    PERFETTO_DCHECK(run.end <= run_offsets.back());
+    AppendRunsBetween(runs, run_offsets, run.start, run.end, &ret);
+  }
+  return RowMap::FromRuns(std::move(ret));
+}
+
+RowMap SelectRunsWithRange(const std::vector<Run>& runs,
+                           const std::vector<uint32_t>& run_offsets,
+                           uint32_t selector_start,
+                           uint32_t selector_end) {
+  PERFETTO_DCHECK(selector_start <= selector_end);
+  PERFETTO_DCHECK(selector_end <= run_offsets.back());
+
+  std::vector<Run> ret;
+  AppendRunsBetween(runs, run_offsets, selector_start, selector_end, &ret);
+  return RowMap::FromRuns(std::move(ret));
+}
+
+RowMap SelectRunsWithBv(const std::vector<Run>& runs,
+                        const std::vector<uint32_t>& run_offsets,
+                        const BitVector& selector) {
+  // Group the selected indices into runs so that consecutive rows are
+  // selected together.
+  std::vector<Run> selector_runs;
+  for (auto it = selector.IterateSetBits(); it; it.Next())
+    RowMap::AppendRun(&selector_runs, it.index(), it.index() + 1);
+  return SelectRunsWithRuns(runs, run_offsets, selector_runs);
+}
+
+RowMap SelectRunsWithIv(const RowMap& rm,
+                        const std::vector<uint32_t>& selector) {
+  std::vector<uint32_t> ret(selector.size());
+  for (uint32_t i = 0; i < selector.size(); ++i)
+    ret[i] = rm.Get(selector[i]);
+  return RowMap(std::move(ret));
+}
+
 RowMap SelectIvWithIv(const std::vector<uint32_t>& iv,
                       const std::vector<uint32_t>& selector) {
   std::vector<uint32_t> ret(selector.size());
@@ -152,6 +255,46 @@ RowMap::RowMap(BitVector bit_vector)
 RowMap::RowMap(std::vector<uint32_t> vec)
     : mode_(Mode::kIndexVector), index_vector_(std::move(vec)) {}
 
+// static
+RowMap RowMap::FromRuns(std::vector<Run> runs) {
+  if (runs.empty())
+    return RowMap();
+  if (runs.size() == 1)
+    return RowMap(runs[0].start, runs[0].end);
+
+  uint64_t count = 0;
+  for (const Run& run : runs)
+    count += run.end - run.start;
+
+  uint64_t runs_cost = runs.size() * kBytesPerRun;
+  uint64_t index_vector_cost = count * sizeof(uint32_t);
+  uint64_t bit_vector_cost = BitVector::ApproxBytesCost(runs.back().end);
+  if (index_vector_cost <= std::min(runs_cost, bit_vector_cost)) {
+    std::vector<uint32_t> iv;
+    iv.reserve(static_cast<size_t>(count));
+    for (const Run& run : runs) {
+      for (uint32_t i = run.start; i < run.end; ++i)
+        iv.push_back(i);
+    }
+    return RowMap(std::move(iv));
+  }
+  if (bit_vector_cost < runs_cost)
+    return RowMap(RunsToBitVector(runs, runs.back().end));
+
+  RowMap rm;
+  rm.mode_ = Mode::kRuns;
+  rm.run_offsets_.reserve(runs.size() + 1);
+  uint32_t offset = 0;
+  for (const Run& run : runs) {
+    rm.run_offsets_.push_back(offset);
+    offset += run.end - run.start;
+  }
+  rm.run_offsets_.push_back(offset);
+  runs.shrink_to_fit();
+  rm.runs_ = std::move(runs);
+  return rm;
+}
+
 RowMap RowMap::Copy() const {
   switch (mode_) {
     case Mode::kRange:
@@ -160,10 +303,129 @@ RowMap RowMap::Copy() const {
       return RowMap(bit_vector_.Copy());
     case Mode::kIndexVector:
       return RowMap(index_vector_);
+    case Mode::kRuns: {
+      RowMap rm;
+      rm.mode_ = Mode::kRuns;
+      rm.runs_ = runs_;
+      rm.run_offsets_ = run_offsets_;
+      return rm;
+    }
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+void RowMap::GetRows(uint32_t start_idx,
+                     uint32_t end_idx,
+                     uint32_t* out) const {
+  PERFETTO_DCHECK(start_idx <= end_idx);
+  PERFETTO_DCHECK(end_idx <= size());
+  if (start_idx == end_idx)
+    return;
+
+  switch (mode_) {
+    case Mode::kRange:
+      for (uint32_t i = start_idx; i < end_idx; ++i)
+        *out++ = start_idx_ + i;
+      break;
+    case Mode::kBitVector: {
+      uint32_t row = bit_vector_.IndexOfNthSet(start_idx);
+      for (uint32_t i = start_idx; i < end_idx; ++row) {
+        if (bit_vector_.IsSet(row)) {
+          *out++ = row;
+          ++i;
+        }
+      }
+      break;
+    }
+    case Mode::kIndexVector:
+      std::copy(index_vector_.begin() + start_idx,
+                index_vector_.begin() + end_idx, out);
+      break;
+    case Mode::kRuns: {
+      auto it = std::upper_bound(run_offsets_.begin(), run_offsets_.end(),
+                                 start_idx);
+      auto run = static_cast<size_t>(std::distance(run_offsets_.begin(), it));
+      --run;
+      for (uint32_t i = start_idx; i < end_idx; ++i) {
+        while (i >= run_offsets_[run + 1])
+          ++run;
+        *out++ = runs_[run].start + (i - run_offsets_[run]);
+      }
+      break;
+    }
+  }
+}
+
+uint64_t RowMap::ApproxBytesUsed() const {
+  switch (mode_) {
+    case Mode::kRange:
+      return 0;
+    case Mode::kBitVector:
+      return BitVector::ApproxBytesCost(bit_vector_.size());
+    case Mode::kIndexVector:
+      return index_vector_.size() * sizeof(uint32_t);
+    case Mode::kRuns:
+      return runs_.size() * kBytesPerRun;
   }
   PERFETTO_FATAL("For GCC");
 }
 
+// static
+BitVector RowMap::RunsToBitVector(const std::vector<Run>& runs,
+                                  uint32_t size) {
+  BitVector bv;
+  for (const Run& run : runs) {
+    bv.Resize(run.start, false);
+    bv.Resize(run.end, true);
+  }
+  bv.Resize(size, false);
+  return bv;
+}
+
+BitVector RowMap::ToBitVector() const {
+  PERFETTO_DCHECK(mode_ == Mode::kRuns);
+  return RunsToBitVector(runs_, runs_.back().end);
+}
+
+RowMap RowMap::IntersectRuns(const RowMap& other) const {
+  // Ranges are treated as a single run (or no run at all if empty).
+  auto to_runs = [](const RowMap& rm, Run* range, const Run** begin,
+                    const Run** end) {
+    if (rm.mode_ == Mode::kRuns) {
+      *begin = rm.runs_.data();
+      *end = rm.runs_.data() + rm.runs_.size();
+      return;
+    }
+    PERFETTO_DCHECK(rm.mode_ == Mode::kRange);
+    *range = Run{rm.start_idx_, rm.end_idx_};
+    *begin = range;
+    *end = rm.start_idx_ < rm.end_idx_ ? range + 1 : range;
+  };
+
+  Run this_range;
+  Run other_range;
+  const Run* a;
+  const Run* a_end;
+  const Run* b;
+  const Run* b_end;
+  to_runs(*this, &this_range, &a, &a_end);
+  to_runs(other, &other_range, &b, &b_end);
+
+  std::vector<Run> ret;
+  while (a != a_end && b != b_end) {
+    uint32_t start = std::max(a->start, b->start);
+    uint32_t end = std::min(a->end, b->end);
+    if (start < end)
+      AppendRun(&ret, start, end);
+    if (a->end < b->end) {
+      ++a;
+    } else {
+      ++b;
+    }
+  }
+  return FromRuns(std::move(ret));
+}
+
 RowMap RowMap::SelectRowsSlow(const RowMap& selector) const {
   // Pick the strategy based on the selector as there is more common code
   // between selectors of the same mode than between the RowMaps being
@@ -180,6 +442,9 @@ RowMap RowMap::SelectRowsSlow(const RowMap& selector) const {
         case Mode::kIndexVector:
           return SelectIvWithRange(index_vector_, selector.start_idx_,
                                    selector.end_idx_);
+        case Mode::kRuns:
+          return SelectRunsWithRange(runs_, run_offsets_, selector.start_idx_,
+                                     selector.end_idx_);
       }
       break;
     case Mode::kBitVector:
@@ -190,6 +455,8 @@ RowMap RowMap::SelectRowsSlow(const RowMap& selector) const {
           return SelectBvWithBv(bit_vector_, selector.bit_vector_);
         case Mode::kIndexVector:
           return SelectIvWithBv(index_vector_, selector.bit_vector_);
+        case Mode::kRuns:
+          return SelectRunsWithBv(runs_, run_offsets_, selector.bit_vector_);
       }
       break;
     case Mode::kIndexVector:
@@ -201,6 +468,20 @@ RowMap RowMap::SelectRowsSlow(const RowMap& selector) const {
           return SelectBvWithIv(bit_vector_, selector.index_vector_);
         case Mode::kIndexVector:
           return SelectIvWithIv(index_vector_, selector.index_vector_);
+        case Mode::kRuns:
+          return SelectRunsWithIv(*this, selector.index_vector_);
+      }
+      break;
+    case Mode::kRuns:
+      switch (mode_) {
+        case Mode::kRange:
+          return SelectRangeWithRuns(start_idx_, end_idx_, selector.runs_);
+        case Mode::kBitVector:
+          return SelectBvWithRuns(bit_vector_, selector.runs_);
+        case Mode::kIndexVector:
+          return SelectIvWithRuns(index_vector_, selector.runs_);
+        case Mode::kRuns:
+          return SelectRunsWithRuns(runs_, run_offsets_, selector.runs_);
       }
       break;
   }
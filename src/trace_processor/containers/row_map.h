@@ -36,16 +36,22 @@ namespace trace_processor {
 //
 // Implementation details:
 //
-// Behind the scenes, this class is impelemented using one of three backing
+// Behind the scenes, this class is impelemented using one of four backing
 // data-structures:
 // 1. A start and end index (internally named 'range')
-// 1. BitVector
-// 2. std::vector<uint32_t> (internally named IndexVector).
+// 2. BitVector
+// 3. std::vector<uint32_t> (internally named IndexVector).
+// 4. A sorted list of disjoint ranges (internally named 'runs').
 //
 // Generally the preference for data structures is range > BitVector >
 // std::vector<uint32>; this ordering is based mainly on memory efficiency as we
 // expect RowMaps to be large.
 //
+// Runs are a run-length encoding of a BitVector: they are used instead of a
+// BitVector when the rows are clustered (or very sparse) as a BitVector would
+// then mostly store zeros. For example, filtering a few thousand rows out of
+// 100M would otherwise need a 12MB BitVector.
+//
 // However, BitVector and std::vector<uint32_t> allow things which are not
 // possible with the data-structures preferred to them:
 //  * a range (as the name suggests) can only store a compact set of indices
@@ -104,6 +110,33 @@ class RowMap {
     uint32_t ordinal_ = 0;
   };
 
+  // Iterator for runs mode of RowMap.
+  // This class should act as a drop-in replacement for
+  // BitVector::SetBitsIterator.
+  class RunsIterator {
+   public:
+    RunsIterator(const RowMap* rm)
+        : rm_(rm), index_(rm->runs_.empty() ? 0 : rm->runs_[0].start) {}
+
+    void Next() {
+      ++ordinal_;
+      if (++index_ == rm_->runs_[run_].end && ++run_ < rm_->runs_.size())
+        index_ = rm_->runs_[run_].start;
+    }
+
+    operator bool() const { return run_ < rm_->runs_.size(); }
+
+    uint32_t index() const { return index_; }
+
+    uint32_t ordinal() const { return ordinal_; }
+
+   private:
+    const RowMap* rm_ = nullptr;
+    uint32_t run_ = 0;
+    uint32_t index_ = 0;
+    uint32_t ordinal_ = 0;
+  };
+
  public:
   // Allows efficient iteration over the rows of a RowMap.
   //
@@ -124,6 +157,9 @@ class RowMap {
         case Mode::kIndexVector:
           iv_it_.reset(new IndexVectorIterator(rm));
           break;
+        case Mode::kRuns:
+          runs_it_.reset(new RunsIterator(rm));
+          break;
       }
     }
 
@@ -142,6 +178,9 @@ class RowMap {
         case Mode::kIndexVector:
           iv_it_->Next();
           break;
+        case Mode::kRuns:
+          runs_it_->Next();
+          break;
       }
     }
 
@@ -154,6 +193,8 @@ class RowMap {
           return *set_bits_it_;
         case Mode::kIndexVector:
           return *iv_it_;
+        case Mode::kRuns:
+          return *runs_it_;
       }
       PERFETTO_FATAL("For GCC");
     }
@@ -171,6 +212,8 @@ class RowMap {
           return set_bits_it_->index();
         case Mode::kIndexVector:
           return iv_it_->index();
+        case Mode::kRuns:
+          return runs_it_->index();
       }
       PERFETTO_FATAL("For GCC");
     }
@@ -188,6 +231,8 @@ class RowMap {
           return set_bits_it_->ordinal();
         case Mode::kIndexVector:
           return iv_it_->ordinal();
+        case Mode::kRuns:
+          return runs_it_->ordinal();
       }
       PERFETTO_FATAL("For GCC");
     }
@@ -201,6 +246,7 @@ class RowMap {
     std::unique_ptr<RangeIterator> range_it_;
     std::unique_ptr<BitVector::SetBitsIterator> set_bits_it_;
     std::unique_ptr<IndexVectorIterator> iv_it_;
+    std::unique_ptr<RunsIterator> runs_it_;
 
     const RowMap* rm_ = nullptr;
   };
@@ -228,6 +274,50 @@ class RowMap {
   // Creates a RowMap backed by an std::vector<uint32_t>.
   explicit RowMap(std::vector<uint32_t> vec);
 
+  // A range of consecutive rows, from |start| (inclusive) to |end|
+  // (exclusive).
+  struct Run {
+    uint32_t start;
+    uint32_t end;
+  };
+
+  // Appends the rows between |start| and |end| to |runs|, merging them with
+  // the last run if they are adjacent. |start| should not be smaller than the
+  // end of the last run.
+  static void AppendRun(std::vector<Run>* runs, uint32_t start, uint32_t end) {
+    PERFETTO_DCHECK(start < end);
+    PERFETTO_DCHECK(runs->empty() || runs->back().end <= start);
+    if (!runs->empty() && runs->back().end == start) {
+      runs->back().end = end;
+    } else {
+      runs->push_back(Run{start, end});
+    }
+  }
+
+  // Appends the rows set in |word| to |runs| (see |AppendRun|), where bit i of
+  // |word| corresponds to row |first_row| + i.
+  static void AppendWordRuns(std::vector<Run>* runs,
+                             uint32_t first_row,
+                             uint64_t word) {
+    while (word) {
+      uint32_t first = static_cast<uint32_t>(__builtin_ctzll(word));
+      uint64_t inverted = ~(word >> first);
+      uint32_t len = inverted ? static_cast<uint32_t>(__builtin_ctzll(inverted))
+                              : 64 - first;
+      AppendRun(runs, first_row + first, first_row + first + len);
+      if (first + len >= 64)
+        break;
+      word &= ~0ull << (first + len);
+    }
+  }
+
+  // Creates a RowMap containing the rows in |runs|, which should be sorted,
+  // non-empty and disjoint (e.g. built using |AppendRun|).
+  // This picks the most compact representation for these rows: a range if
+  // there is at most one run, an index vector if the runs are mostly single
+  // rows and runs otherwise.
+  static RowMap FromRuns(std::vector<Run> runs);
+
   // Creates a RowMap containing just |row|.
   // By default this will be implemented using a range.
   static RowMap SingleRow(uint32_t row) { return RowMap(row, row + 1); }
@@ -247,6 +337,8 @@ class RowMap {
         return bit_vector_.GetNumBitsSet();
       case Mode::kIndexVector:
         return static_cast<uint32_t>(index_vector_.size());
+      case Mode::kRuns:
+        return run_offsets_.back();
     }
     PERFETTO_FATAL("For GCC");
   }
@@ -264,10 +356,17 @@ class RowMap {
         return GetBitVector(idx);
       case Mode::kIndexVector:
         return GetIndexVector(idx);
+      case Mode::kRuns:
+        return GetRuns(idx);
     }
     PERFETTO_FATAL("For GCC");
   }
 
+  // Writes the rows at the indices between |start_idx| (inclusive) and
+  // |end_idx| (exclusive) to |out|. This is equivalent to calling Get for each
+  // index but only has to look up where |start_idx| is once.
+  void GetRows(uint32_t start_idx, uint32_t end_idx, uint32_t* out) const;
+
   // Returns whether the RowMap contains the given row.
   bool Contains(uint32_t row) const {
     switch (mode_) {
@@ -281,6 +380,9 @@ class RowMap {
         auto it = std::find(index_vector_.begin(), index_vector_.end(), row);
         return it != index_vector_.end();
       }
+      case Mode::kRuns: {
+        return FindRun(row) < runs_.size();
+      }
     }
     PERFETTO_FATAL("For GCC");
   }
@@ -305,6 +407,13 @@ class RowMap {
                          std::distance(index_vector_.begin(), it)))
                    : base::nullopt;
       }
+      case Mode::kRuns: {
+        uint32_t run = FindRun(row);
+        return run < runs_.size()
+                   ? base::make_optional(run_offsets_[run] + row -
+                                         runs_[run].start)
+                   : base::nullopt;
+      }
     }
     PERFETTO_FATAL("For GCC");
   }
@@ -351,6 +460,13 @@ class RowMap {
         index_vector_.insert(it, row);
         break;
       }
+      case Mode::kRuns: {
+        // Runs are not meant to be built incrementally: switch to a
+        // BitVector.
+        *this = RowMap(ToBitVector());
+        InsertIntoBitVector(row);
+        break;
+      }
     }
   }
 
@@ -381,7 +497,9 @@ class RowMap {
       return RowMap::SingleRow(Get(selector.Get(0)));
 
     // For all other cases, go into the slow-path.
-    return SelectRowsSlow(selector);
+    RowMap ret = SelectRowsSlow(selector);
+    ret.MaybeCompressBitVector();
+    return ret;
   }
 
   // Intersects |other| with |this| writing the result into |this|.
@@ -403,6 +521,15 @@ class RowMap {
       return;
     }
 
+    // Intersections of ranges and runs are computed one run at a time.
+    bool is_runs_or_range = mode_ == Mode::kRuns || mode_ == Mode::kRange;
+    bool other_is_runs_or_range =
+        other.mode_ == Mode::kRuns || other.mode_ == Mode::kRange;
+    if (is_runs_or_range && other_is_runs_or_range) {
+      *this = IntersectRuns(other);
+      return;
+    }
+
     // TODO(lalitm): improve efficiency of this if we end up needing it.
     Filter([&other](uint32_t row) { return other.Contains(row); });
   }
@@ -469,7 +596,73 @@ class RowMap {
         out->Filter(ip);
         break;
       }
+      case Mode::kRuns: {
+        // |out| is sorted so the indices are looked up in increasing order:
+        // walk the runs rather than binary searching for every index.
+        uint32_t run = 0;
+        auto ip = [this, p, &run](uint32_t idx) {
+          PERFETTO_DCHECK(idx >= run_offsets_[run]);
+          while (idx >= run_offsets_[run + 1])
+            run++;
+          return p(runs_[run].start + idx - run_offsets_[run]);
+        };
+        out->Filter(ip);
+        break;
+      }
     }
+    out->MaybeCompressBitVector();
+  }
+
+  // Same as |FilterInto| but |p| decides for up to 64 consecutive rows at a
+  // time: |p(first row, n)| returns a word whose bottom |n| bits are set for
+  // the rows (starting at |first row|) which should be retained. Bits above
+  // the bottom |n| are ignored.
+  //
+  // As the rows passed to |p| have to be consecutive, this is only supported
+  // when |this| is a range.
+  template <typename WordPredicate>
+  void FilterIntoWords(RowMap* out, WordPredicate p) const {
+    PERFETTO_DCHECK(IsRange());
+    PERFETTO_DCHECK(size() >= out->size());
+
+    if (out->empty())
+      return;
+
+    uint32_t start_idx = start_idx_;
+    auto ip = [start_idx, &p](uint32_t idx, uint32_t n) {
+      return p(start_idx + idx, n);
+    };
+    switch (out->mode_) {
+      case Mode::kRange:
+        out->FilterRangeWords(ip);
+        break;
+      case Mode::kBitVector:
+        PERFETTO_DCHECK(out->bit_vector_.size() <= size());
+        out->bit_vector_.AndWords(ip);
+        break;
+      case Mode::kIndexVector: {
+        auto ret = std::remove_if(
+            out->index_vector_.begin(), out->index_vector_.end(),
+            [&ip](uint32_t i) { return (ip(i, 1) & 1u) == 0; });
+        out->index_vector_.erase(ret, out->index_vector_.end());
+        break;
+      }
+      case Mode::kRuns: {
+        std::vector<Run> runs;
+        for (const Run& run : out->runs_) {
+          for (uint32_t i = run.start; i < run.end; i += 64) {
+            uint32_t n = std::min(run.end - i, 64u);
+            uint64_t word = ip(i, n);
+            if (n < 64)
+              word &= (1ull << n) - 1;
+            AppendWordRuns(&runs, i, word);
+          }
+        }
+        *out = FromRuns(std::move(runs));
+        break;
+      }
+    }
+    out->MaybeCompressBitVector();
   }
 
   template <typename Comparator = bool(uint32_t, uint32_t)>
@@ -493,6 +686,12 @@ class RowMap {
                            return c(GetIndexVector(a), GetIndexVector(b));
                          });
         break;
+      case Mode::kRuns:
+        std::stable_sort(out->begin(), out->end(),
+                         [this, c](uint32_t a, uint32_t b) {
+                           return c(GetRuns(a), GetRuns(b));
+                         });
+        break;
     }
   }
 
@@ -502,13 +701,22 @@ class RowMap {
   // Returns if the RowMap is internally represented using a range.
   bool IsRange() const { return mode_ == Mode::kRange; }
 
+  // Returns the approximate number of bytes used to store the rows of this
+  // RowMap.
+  uint64_t ApproxBytesUsed() const;
+
  private:
   enum class Mode {
     kRange,
     kBitVector,
     kIndexVector,
+    kRuns,
   };
 
+  // Ranges with fewer rows than this are always filtered into an index
+  // vector, as it's not worth the hassle of working with a BitVector.
+  static constexpr uint32_t kSmallRangeLimit = 2048;
+
   // Filters the indices in |out| by keeping those which meet |p|.
   template <typename Predicate>
   void Filter(Predicate p) {
@@ -529,6 +737,17 @@ class RowMap {
         index_vector_.erase(ret, index_vector_.end());
         break;
       }
+      case Mode::kRuns: {
+        std::vector<Run> runs;
+        for (const Run& run : runs_) {
+          for (uint32_t i = run.start; i < run.end; ++i) {
+            if (p(i))
+              AppendRun(&runs, i, i + 1);
+          }
+        }
+        *this = FromRuns(std::move(runs));
+        break;
+      }
     }
   }
 
@@ -582,16 +801,31 @@ class RowMap {
         out->index_vector_.erase(iv_it, out->index_vector_.end());
         break;
       }
+      case Mode::kRuns: {
+        std::vector<Run> runs;
+        for (const Run& run : out->runs_) {
+          for (uint32_t i = run.start; i < run.end; ++i) {
+            while (it.ordinal() < i) {
+              it.Next();
+              PERFETTO_DCHECK(it);
+            }
+            if (p(it.index()))
+              AppendRun(&runs, i, i + 1);
+          }
+        }
+        *out = FromRuns(std::move(runs));
+        break;
+      }
     }
   }
 
-  template <typename Predicate>
-  void FilterRange(Predicate p) {
+  // Returns whether filtering this range should produce an index vector
+  // rather than a BitVector.
+  bool ShouldFilterRangeIntoIndexVector() const {
     uint32_t count = end_idx_ - start_idx_;
 
     // Optimization: if we are only going to scan a few rows, it's not
     // worth the haslle of working with a BitVector.
-    constexpr uint32_t kSmallRangeLimit = 2048;
     bool is_small_range = count < kSmallRangeLimit;
 
     // Optimization: weif the cost of a BitVector is more than the highest
@@ -602,8 +836,14 @@ class RowMap {
     // If either of the conditions hold which make it better to use an
     // index vector, use it instead. Alternatively, if we are optimizing for
     // lookup speed, we also want to use an index vector.
-    if (is_small_range || index_vector_cost_ub <= bit_vector_cost ||
-        optimize_for_ == OptimizeFor::kLookupSpeed) {
+    return is_small_range || index_vector_cost_ub <= bit_vector_cost ||
+           optimize_for_ == OptimizeFor::kLookupSpeed;
+  }
+
+  template <typename Predicate>
+  void FilterRange(Predicate p) {
+    uint32_t count = end_idx_ - start_idx_;
+    if (ShouldFilterRangeIntoIndexVector()) {
       // Try and strike a good balance between not making the vector too
       // big and good performance.
       std::vector<uint32_t> iv(std::min(kSmallRangeLimit, count));
@@ -629,9 +869,93 @@ class RowMap {
       return;
     }
 
-    // Otherwise, create a bitvector which spans the full range using
-    // |p| as the filler for the bits between start and end.
-    *this = RowMap(BitVector::Range(start_idx_, end_idx_, p));
+    // Otherwise, evaluate |p| 64 rows at a time to produce either runs or
+    // a BitVector spanning the full range.
+    FilterRangeIntoRunsOrBitVector([&p](uint32_t start, uint32_t n) {
+      uint64_t word = 0;
+      for (uint32_t i = 0; i < n; ++i)
+        word |= static_cast<uint64_t>(p(start + i)) << i;
+      return word;
+    });
+  }
+
+  // Same as |FilterRange| but with a predicate working on words (see
+  // |FilterIntoWords|).
+  template <typename WordPredicate>
+  void FilterRangeWords(WordPredicate p) {
+    PERFETTO_DCHECK(mode_ == Mode::kRange);
+
+    if (ShouldFilterRangeIntoIndexVector()) {
+      std::vector<uint32_t> iv;
+      for (uint32_t i = start_idx_; i < end_idx_; i += 64) {
+        uint32_t n = std::min(end_idx_ - i, 64u);
+        uint64_t word = p(i, n);
+        if (n < 64)
+          word &= (1ull << n) - 1;
+
+        // Extract the set bits, lowest first, until there are none left.
+        for (; word; word &= word - 1)
+          iv.push_back(i + static_cast<uint32_t>(__builtin_ctzll(word)));
+      }
+      iv.shrink_to_fit();
+
+      *this = RowMap(std::move(iv));
+      return;
+    }
+    FilterRangeIntoRunsOrBitVector(p);
+  }
+
+  // Filters this range using the word predicate |p| (see |FilterIntoWords|)
+  // into runs if the rows which are kept are clustered or sparse enough for
+  // runs to be smaller than a BitVector spanning the range, or into that
+  // BitVector otherwise.
+  //
+  // The result starts off being built as runs: as soon as the runs get bigger
+  // than the BitVector, they are converted to one and the rest of the range
+  // is appended to it directly. This means that the BitVector is never
+  // allocated for selective filters.
+  template <typename WordPredicate>
+  void FilterRangeIntoRunsOrBitVector(WordPredicate p) {
+    PERFETTO_DCHECK(mode_ == Mode::kRange);
+
+    uint64_t bit_vector_cost = BitVector::ApproxBytesCost(end_idx_);
+    std::vector<Run> runs;
+    for (uint32_t i = start_idx_; i < end_idx_; i += 64) {
+      uint32_t n = std::min(end_idx_ - i, 64u);
+      uint64_t word = p(i, n);
+      if (n < 64)
+        word &= (1ull << n) - 1;
+      AppendWordRuns(&runs, i, word);
+
+      if (runs.size() * kBytesPerRun > bit_vector_cost) {
+        BitVector bv = RunsToBitVector(runs, i + n);
+        runs.clear();
+        runs.shrink_to_fit();
+        bv.AppendRangeWords(end_idx_, p);
+        *this = RowMap(std::move(bv));
+        return;
+      }
+    }
+    *this = FromRuns(std::move(runs));
+  }
+
+  // If this RowMap is a BitVector with few bits set (e.g. after filtering),
+  // converts it to runs or an index vector, whichever is smaller.
+  void MaybeCompressBitVector() {
+    if (mode_ != Mode::kBitVector)
+      return;
+
+    // As a run contains at least one row, this is an upper bound of the cost
+    // of the runs.
+    uint64_t runs_cost_ub =
+        static_cast<uint64_t>(bit_vector_.GetNumBitsSet()) * kBytesPerRun;
+    if (runs_cost_ub > BitVector::ApproxBytesCost(bit_vector_.size()))
+      return;
+
+    std::vector<Run> runs;
+    for (auto it = bit_vector_.IterateSetBits(); it; it.Next())
+      AppendRun(&runs, it.index(), it.index() + 1);
+    *this = FromRuns(std::move(runs));
   }
 
   void InsertIntoBitVector(uint32_t row) {
@@ -654,9 +978,44 @@ class RowMap {
     PERFETTO_DCHECK(mode_ == Mode::kIndexVector);
     return index_vector_[idx];
   }
+  PERFETTO_ALWAYS_INLINE uint32_t GetRuns(uint32_t idx) const {
+    PERFETTO_DCHECK(mode_ == Mode::kRuns);
+    auto it = std::upper_bound(run_offsets_.begin(), run_offsets_.end(), idx);
+    auto run = static_cast<uint32_t>(std::distance(run_offsets_.begin(), it)) -
+               1;
+    return runs_[run].start + idx - run_offsets_[run];
+  }
+
+  // Returns the index of the run containing |row| or |runs_.size()| if no
+  // run contains it.
+  uint32_t FindRun(uint32_t row) const {
+    PERFETTO_DCHECK(mode_ == Mode::kRuns);
+    auto it = std::upper_bound(
+        runs_.begin(), runs_.end(), row,
+        [](uint32_t r, const Run& run) { return r < run.start; });
+    if (it == runs_.begin() || row >= std::prev(it)->end)
+      return static_cast<uint32_t>(runs_.size());
+    return static_cast<uint32_t>(std::distance(runs_.begin(), it)) - 1;
+  }
+
+  // Returns a BitVector of size |size| with the bits in |runs| set.
+  static BitVector RunsToBitVector(const std::vector<Run>& runs,
+                                   uint32_t size);
+
+  // Returns a BitVector with the rows of this RowMap (which should be in
+  // runs mode) set.
+  BitVector ToBitVector() const;
+
+  // Returns the intersection of this RowMap and |other|, both of which
+  // should be ranges or runs.
+  RowMap IntersectRuns(const RowMap& other) const;
 
   RowMap SelectRowsSlow(const RowMap& selector) const;
 
+  // The approximate cost of each run: the run itself and its entry in
+  // |run_offsets_|.
+  static constexpr uint32_t kBytesPerRun = sizeof(Run) + sizeof(uint32_t);
+
   Mode mode_ = Mode::kRange;
 
   // Only valid when |mode_| == Mode::kRange.
@@ -669,6 +1028,13 @@ class RowMap {
   // Only valid when |mode_| == Mode::kIndexVector.
   std::vector<uint32_t> index_vector_;
 
+  // Only valid when |mode_| == Mode::kRuns. There are always at least two
+  // runs; |run_offsets_[i]| is the index of the first row of |runs_[i]|
+  // and |run_offsets_| has an extra entry at the end with the size of the
+  // RowMap.
+  std::vector<Run> runs_;
+  std::vector<uint32_t> run_offsets_;
+
   OptimizeFor optimize_for_ = OptimizeFor::kMemory;
 };
 
@@ -13,16 +13,25 @@
 // limitations under the License.
 
 #include <random>
+#include <vector>
 
 #include <benchmark/benchmark.h>
 
 #include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/db/filter_kernels.h"
 
 using perfetto::trace_processor::BitVector;
+using perfetto::trace_processor::FilterOp;
 using perfetto::trace_processor::RowMap;
 
+namespace filter_kernels = perfetto::trace_processor::filter_kernels;
+
 namespace {
 
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
 static constexpr uint32_t kPoolSize = 100000;
 static constexpr uint32_t kSize = 123456;
 
@@ -263,3 +272,102 @@ static void BM_RowMapFilterIntoIvWithBv(benchmark::State& state) {
   });
 }
 BENCHMARK(BM_RowMapFilterIntoIvWithBv);
+
+// Scans the rows of a slice-like table with the constraints
+// "ts > X AND dur < Y", both of which select roughly half of the rows.
+// The first argument selects how the values are compared: row by row with
+// FilterInto (-1) or 64 rows at a time with the filter kernels for the given
+// filter_kernels::Isa.
+static void BM_RowMapFilterIntoTsDurScan(benchmark::State& state) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  const uint32_t size =
+      IsBenchmarkFunctionalOnly() ? 64 * 1024 : 50 * 1000 * 1000;
+  std::vector<int64_t> ts(size);
+  std::vector<int64_t> dur(size);
+  int64_t cur_ts = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    cur_ts += rnd_engine() % 1000;
+    ts[i] = cur_ts;
+    dur[i] = rnd_engine() % 1000;
+  }
+  const int64_t ts_value = ts[size / 2];
+  const int64_t dur_value = 500;
+
+  const int64_t isa = state.range(0);
+  if (isa >= 0 &&
+      !filter_kernels::IsSupported(static_cast<filter_kernels::Isa>(isa))) {
+    state.SkipWithError("Instruction set not supported");
+    return;
+  }
+
+  RowMap rm(0, size);
+  for (auto _ : state) {
+    RowMap out(0, size);
+    if (isa < 0) {
+      rm.FilterInto(&out, [&ts, ts_value](uint32_t row) {
+        return ts[row] > ts_value;
+      });
+      rm.FilterInto(&out, [&dur, dur_value](uint32_t row) {
+        return dur[row] < dur_value;
+      });
+    } else {
+      auto filter_isa = static_cast<filter_kernels::Isa>(isa);
+      auto gt = filter_kernels::GetKernel<int64_t>(FilterOp::kGt, filter_isa);
+      auto lt = filter_kernels::GetKernel<int64_t>(FilterOp::kLt, filter_isa);
+      rm.FilterIntoWords(&out, [&ts, gt, ts_value](uint32_t row, uint32_t n) {
+        return gt(ts.data() + row, n, ts_value);
+      });
+      rm.FilterIntoWords(&out,
+                         [&dur, lt, dur_value](uint32_t row, uint32_t n) {
+                           return lt(dur.data() + row, n, dur_value);
+                         });
+    }
+    benchmark::DoNotOptimize(out.size());
+  }
+  state.counters["rows/s"] = benchmark::Counter(
+      static_cast<double>(size) * static_cast<double>(state.iterations()),
+      benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_RowMapFilterIntoTsDurScan)
+    ->ArgName("isa")
+    ->Arg(-1)
+    ->Arg(static_cast<int64_t>(filter_kernels::Isa::kScalar))
+    ->Arg(static_cast<int64_t>(filter_kernels::Isa::kSse42))
+    ->Arg(static_cast<int64_t>(filter_kernels::Isa::kAvx2))
+    ->Unit(benchmark::kMillisecond);
+
+// Filters a large table with a constraint selecting either a few rows spread
+// over the whole table (arg 0) or a few long runs of rows (arg 1), e.g. the
+// slices of a single thread. Reports the memory used by the resulting RowMap.
+static void BM_RowMapFilterIntoSelective(benchmark::State& state) {
+  const uint32_t size =
+      IsBenchmarkFunctionalOnly() ? 64 * 1024 : 50 * 1000 * 1000;
+  const bool clustered = state.range(0) != 0;
+  auto fn = [clustered](uint32_t row) {
+    return clustered ? (row / 100000) % 16 == 3 : row % 1000 == 3;
+  };
+
+  RowMap rm(0, size);
+  uint64_t bytes = 0;
+  for (auto _ : state) {
+    RowMap out(0, size);
+    rm.FilterInto(&out, fn);
+    bytes = out.ApproxBytesUsed();
+    benchmark::DoNotOptimize(out.size());
+  }
+  state.counters["bytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_RowMapFilterIntoSelective)
+    ->ArgName("clustered")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_RowMapRunsGet(benchmark::State& state) {
+  RowMap rm(0, kSize);
+  rm.FilterInto(&rm, [](uint32_t row) { return (row / 1000) % 4 == 0; });
+  BenchRowMapGet(state, std::move(rm));
+}
+BENCHMARK(BM_RowMapRunsGet);
@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/containers/row_map.h"
 
+#include <functional>
 #include <memory>
 
 #include "src/base/test/gtest_test_suite.h"
@@ -449,6 +450,240 @@ TEST(RowMapUnittest, FilterIntoIndexVectorWithIndexVector) {
   ASSERT_EQ(filter.Get(1u), 3u);
 }
 
+// Returns a word predicate computing the bits of |p| one at a time.
+template <typename Predicate>
+std::function<uint64_t(uint32_t, uint32_t)> ToWordPredicate(Predicate p) {
+  return [p](uint32_t row, uint32_t n) {
+    uint64_t word = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      word |= static_cast<uint64_t>(p(row + i)) << i;
+    }
+    return word;
+  };
+}
+
+TEST(RowMapUnittest, FilterIntoWordsRangeWithRange) {
+  RowMap rm(93, 157);
+  RowMap filter(4, 7);
+  rm.FilterIntoWords(&filter, ToWordPredicate([](uint32_t row) {
+                       return row == 97u || row == 98u;
+                     }));
+
+  ASSERT_EQ(filter.size(), 2u);
+  ASSERT_EQ(filter.Get(0u), 4u);
+  ASSERT_EQ(filter.Get(1u), 5u);
+}
+
+TEST(RowMapUnittest, FilterIntoWordsLargeRangeWithRange) {
+  RowMap rm(5, 100005);
+  RowMap filter(3, 100000);
+  rm.FilterIntoWords(&filter, ToWordPredicate([](uint32_t row) {
+                       return row % 2 == 0;
+                     }));
+
+  ASSERT_EQ(filter.size(), 100000u / 2 - 1);
+  for (uint32_t i = 0; i < filter.size(); ++i) {
+    ASSERT_EQ(filter.Get(i), 3u + i * 2);
+  }
+}
+
+TEST(RowMapUnittest, FilterIntoWordsRangeWithBitVector) {
+  RowMap rm(27, 31);
+  RowMap filter(BitVector{true, false, true, true});
+  rm.FilterIntoWords(&filter, ToWordPredicate([](uint32_t row) {
+                       return row == 29u || row == 30u;
+                     }));
+
+  ASSERT_EQ(filter.size(), 2u);
+  ASSERT_EQ(filter.Get(0u), 2u);
+  ASSERT_EQ(filter.Get(1u), 3u);
+}
+
+TEST(RowMapUnittest, FilterIntoWordsRangeWithIndexVector) {
+  RowMap rm(27, 41);
+  RowMap filter(std::vector<uint32_t>{3u, 5u, 7u, 9u, 11u});
+  rm.FilterIntoWords(&filter, ToWordPredicate([](uint32_t row) {
+                       return row == 32u || row == 36u;
+                     }));
+
+  ASSERT_EQ(filter.size(), 2u);
+  ASSERT_EQ(filter.Get(0u), 5u);
+  ASSERT_EQ(filter.Get(1u), 9u);
+}
+
+// Returns a RowMap containing the rows in [0, |size|) where the thousands digit
+// is even: this is stored as runs as there are few long runs of rows.
+RowMap ClusteredRowMap(uint32_t size = 100000) {
+  RowMap rm(0, size);
+  rm.FilterInto(&rm, [](uint32_t row) { return (row / 1000) % 2 == 0; });
+  return rm;
+}
+
+std::vector<uint32_t> ToVector(const RowMap& rm) {
+  std::vector<uint32_t> rows;
+  for (auto it = rm.IterateRows(); it; it.Next())
+    rows.push_back(it.row());
+  return rows;
+}
+
+TEST(RowMapUnittest, GetRows) {
+  BitVector bv(200, false);
+  for (uint32_t i = 0; i < bv.size(); i += 3)
+    bv.Set(i);
+  RowMap rms[] = {RowMap(10, 80), RowMap(std::move(bv)),
+                  RowMap(std::vector<uint32_t>{5, 1, 70, 3, 9, 2, 8}),
+                  ClusteredRowMap()};
+  for (const RowMap& rm : rms) {
+    std::vector<uint32_t> rows(rm.size() - 2);
+    rm.GetRows(2, rm.size(), rows.data());
+    for (uint32_t i = 0; i < rows.size(); ++i)
+      ASSERT_EQ(rows[i], rm.Get(2 + i));
+  }
+}
+
+TEST(RowMapUnittest, FilterIntoClusteredUsesRuns) {
+  RowMap rm = ClusteredRowMap();
+
+  ASSERT_EQ(rm.size(), 50000u);
+  ASSERT_EQ(rm.Get(0u), 0u);
+  ASSERT_EQ(rm.Get(999u), 999u);
+  ASSERT_EQ(rm.Get(1000u), 2000u);
+  ASSERT_EQ(rm.Get(49999u), 98999u);
+  ASSERT_LT(rm.ApproxBytesUsed(), BitVector::ApproxBytesCost(100000u) / 10);
+
+  std::vector<uint32_t> rows = ToVector(rm);
+  ASSERT_EQ(rows.size(), 50000u);
+  for (uint32_t i = 0; i < rows.size(); ++i)
+    ASSERT_EQ(rows[i], rm.Get(i));
+}
+
+TEST(RowMapUnittest, FilterIntoSparseUsesIndexVector) {
+  RowMap rm(0, 1000000);
+  rm.FilterInto(&rm, [](uint32_t row) { return row % 100000 == 7; });
+
+  ASSERT_EQ(rm.size(), 10u);
+  for (uint32_t i = 0; i < rm.size(); ++i)
+    ASSERT_EQ(rm.Get(i), i * 100000 + 7);
+  ASSERT_EQ(rm.ApproxBytesUsed(), 10u * sizeof(uint32_t));
+}
+
+TEST(RowMapUnittest, FilterIntoDenseKeepsBitVector) {
+  RowMap rm(0, 100000);
+  rm.FilterInto(&rm, [](uint32_t row) { return row % 3 != 0; });
+
+  ASSERT_EQ(rm.size(), 66666u);
+  ASSERT_EQ(rm.ApproxBytesUsed(), BitVector::ApproxBytesCost(100000u));
+}
+
+TEST(RowMapUnittest, RunsContainsAndIndexOf) {
+  RowMap rm = ClusteredRowMap();
+
+  ASSERT_TRUE(rm.Contains(0u));
+  ASSERT_TRUE(rm.Contains(2500u));
+  ASSERT_FALSE(rm.Contains(1000u));
+  ASSERT_FALSE(rm.Contains(99999u));
+  ASSERT_FALSE(rm.Contains(100000u));
+
+  ASSERT_EQ(*rm.IndexOf(2500u), 1500u);
+  ASSERT_EQ(*rm.IndexOf(98999u), 49999u);
+  ASSERT_EQ(rm.IndexOf(1999u), base::nullopt);
+}
+
+TEST(RowMapUnittest, RunsInsert) {
+  RowMap rm = ClusteredRowMap();
+  rm.Insert(1500u);
+  rm.Insert(100005u);
+
+  ASSERT_EQ(rm.size(), 50002u);
+  ASSERT_EQ(rm.Get(1000u), 1500u);
+  ASSERT_EQ(rm.Get(1001u), 2000u);
+  ASSERT_EQ(rm.Get(50001u), 100005u);
+}
+
+TEST(RowMapUnittest, RunsFilterInto) {
+  RowMap rm = ClusteredRowMap();
+  RowMap filter(0, rm.size());
+  rm.FilterInto(&filter, [](uint32_t row) { return row % 1000 < 10; });
+
+  ASSERT_EQ(filter.size(), 500u);
+  for (uint32_t i = 0; i < filter.size(); ++i)
+    ASSERT_EQ(rm.Get(filter.Get(i)) % 1000, i % 10);
+}
+
+TEST(RowMapUnittest, RunsSelectRows) {
+  RowMap rm = ClusteredRowMap();
+  std::vector<uint32_t> rows = ToVector(rm);
+
+  auto check = [&rows](const RowMap& res, const RowMap& selector) {
+    ASSERT_EQ(res.size(), selector.size());
+    for (uint32_t i = 0; i < selector.size(); ++i)
+      ASSERT_EQ(res.Get(i), rows[selector.Get(i)]);
+  };
+
+  RowMap range(999, 3001);
+  check(rm.SelectRows(range), range);
+
+  BitVector bv(rm.size(), false);
+  bv.Set(5);
+  bv.Set(999);
+  bv.Set(1000);
+  bv.Set(49999);
+  RowMap bv_rm(std::move(bv));
+  check(rm.SelectRows(bv_rm), bv_rm);
+
+  RowMap iv(std::vector<uint32_t>{49999u, 1u, 1000u});
+  check(rm.SelectRows(iv), iv);
+
+  RowMap runs = ClusteredRowMap(rm.size());
+  check(rm.SelectRows(runs), runs);
+}
+
+TEST(RowMapUnittest, SelectRowsWithRuns) {
+  RowMap runs = ClusteredRowMap();
+
+  RowMap range(10, 100010);
+  RowMap range_res = range.SelectRows(runs);
+  ASSERT_EQ(range_res.size(), runs.size());
+  for (uint32_t i = 0; i < runs.size(); ++i)
+    ASSERT_EQ(range_res.Get(i), runs.Get(i) + 10);
+
+  BitVector bv(200000, false);
+  for (uint32_t i = 0; i < bv.size(); i += 2)
+    bv.Set(i);
+  RowMap bv_rm(std::move(bv));
+  RowMap bv_res = bv_rm.SelectRows(runs);
+  ASSERT_EQ(bv_res.size(), runs.size());
+  for (uint32_t i = 0; i < runs.size(); ++i)
+    ASSERT_EQ(bv_res.Get(i), runs.Get(i) * 2);
+
+  std::vector<uint32_t> iv(100000);
+  for (uint32_t i = 0; i < iv.size(); ++i)
+    iv[i] = 100000 - i;
+  RowMap iv_rm(std::move(iv));
+  RowMap iv_res = iv_rm.SelectRows(runs);
+  ASSERT_EQ(iv_res.size(), runs.size());
+  for (uint32_t i = 0; i < runs.size(); ++i)
+    ASSERT_EQ(iv_res.Get(i), 100000 - runs.Get(i));
+}
+
+TEST(RowMapUnittest, RunsIntersect) {
+  RowMap rm = ClusteredRowMap();
+  rm.Intersect(RowMap(1500, 4500));
+
+  ASSERT_EQ(rm.size(), 1500u);
+  ASSERT_EQ(rm.Get(0u), 2000u);
+  ASSERT_EQ(rm.Get(999u), 2999u);
+  ASSERT_EQ(rm.Get(1000u), 4000u);
+  ASSERT_EQ(rm.Get(1499u), 4499u);
+
+  RowMap other(0, 100000);
+  other.FilterInto(&other, [](uint32_t row) { return (row / 500) % 2 == 0; });
+  other.Intersect(ClusteredRowMap());
+  ASSERT_EQ(other.size(), 25000u);
+  for (uint32_t i = 0; i < other.size(); ++i)
+    ASSERT_EQ(other.Get(i), (i / 500) * 2000 + i % 500);
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -16,14 +16,58 @@
 
 #include "src/trace_processor/containers/string_pool.h"
 
+#include <string.h>
+
+#include <algorithm>
 #include <limits>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/utils.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define PERFETTO_TP_HAS_MMAP() 1
+#else
+#define PERFETTO_TP_HAS_MMAP() 0
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// The header at the start of the backing file of a pool. It is followed by
+// the blocks, each of them taking |kBlockSizeBytes| in the file. The file is
+// sparse: only the bytes of the blocks actually used take space on disk.
+struct BackingFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_blocks;
+  uint32_t num_large_strings;
+  uint32_t block_pos[64];
+};
+
+constexpr char kBackingFileMagic[8] = {'P', 'F', 'T', 'P', 'S', 'T', 'R', 'S'};
+constexpr uint32_t kBackingFileVersion = 1;
+constexpr size_t kBackingFileHeaderSize = 4096;
+static_assert(sizeof(BackingFileHeader) <= kBackingFileHeaderSize,
+              "The header must fit in its page");
+
+#if PERFETTO_TP_HAS_MMAP()
+void* MapFile(int fd, size_t offset, size_t size) {
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                    static_cast<off_t>(offset));
+  return addr == MAP_FAILED ? nullptr : addr;
+}
+#endif
+
+}  // namespace
+
 // static
 constexpr size_t StringPool::kNumBlockIndexBits;
 // static
@@ -38,12 +82,17 @@ constexpr size_t StringPool::kBlockIndexBitMask;
 constexpr size_t StringPool::kBlockSizeBytes;
 // static
 constexpr size_t StringPool::kMinLargeStringSizeBytes;
+// static
+constexpr uint32_t StringPool::StringIndex::kInitialSlots;
 
 StringPool::StringPool() {
   static_assert(
       StringPool::kMinLargeStringSizeBytes <= StringPool::kBlockSizeBytes + 1,
       "minimum size of large strings must be small enough to support any "
       "string that doesn't fit in a Block.");
+  static_assert(sizeof(BackingFileHeader::block_pos) / sizeof(uint32_t) ==
+                    1u << kNumBlockIndexBits,
+                "The backing file header must have room for all the blocks");
 
   blocks_.emplace_back(kBlockSizeBytes);
 
@@ -71,7 +120,7 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
     if (str.size() + kMaxMetadataSize >= kMinLargeStringSizeBytes) {
       return InsertLargeString(str, hash);
     } else {
-      blocks_.emplace_back(kBlockSizeBytes);
+      AddBlock();
     }
 
     // Try and reserve space again - this time we should definitely succeed.
@@ -82,7 +131,7 @@ StringPool::Id StringPool::InsertString(base::StringView str, uint64_t hash) {
   // Compute the id from the block index and offset and add a mapping from the
   // hash to the id.
   Id string_id = Id::BlockString(blocks_.size() - 1, offset);
-  string_index_.emplace(hash, string_id);
+  string_index_.Insert(hash, string_id);
   return string_id;
 }
 
@@ -91,10 +140,126 @@ StringPool::Id StringPool::InsertLargeString(base::StringView str,
   large_strings_.emplace_back(new std::string(str.begin(), str.size()));
   // Compute id from the index and add a mapping from the hash to the id.
   Id string_id = Id::LargeString(large_strings_.size() - 1);
-  string_index_.emplace(hash, string_id);
+  string_index_.Insert(hash, string_id);
+  if (backing_header_.IsValid()) {
+    auto* header = reinterpret_cast<BackingFileHeader*>(backing_header_.Get());
+    header->num_large_strings = static_cast<uint32_t>(large_strings_.size());
+  }
   return string_id;
 }
 
+void StringPool::AddBlock() {
+  if (!backing_fd_) {
+    blocks_.emplace_back(kBlockSizeBytes);
+    return;
+  }
+#if PERFETTO_TP_HAS_MMAP()
+  // Growing the file only adds a hole: the pages of the block take space on
+  // disk (and in the page cache) as strings are written to them.
+  size_t index = blocks_.size();
+  size_t offset = kBackingFileHeaderSize + index * kBlockSizeBytes;
+  PERFETTO_CHECK(ftruncate(*backing_fd_,
+                           static_cast<off_t>(offset + kBlockSizeBytes)) == 0);
+  void* addr = MapFile(*backing_fd_, offset, kBlockSizeBytes);
+  PERFETTO_CHECK(addr);
+
+  auto* header = reinterpret_cast<BackingFileHeader*>(backing_header_.Get());
+  header->block_pos[index] = 0;
+  header->num_blocks = static_cast<uint32_t>(index + 1);
+  blocks_.emplace_back(FileMapping(addr, kBlockSizeBytes), kBlockSizeBytes, 0,
+                       &header->block_pos[index]);
+#else
+  PERFETTO_FATAL("Backing files are not supported");
+#endif
+}
+
+bool StringPool::SetBackingFile(base::ScopedFile fd) {
+#if PERFETTO_TP_HAS_MMAP()
+  struct stat st {};
+  if (!fd || backing_fd_ || fstat(*fd, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  auto file_size = static_cast<size_t>(st.st_size);
+  bool is_new = file_size == 0;
+  if (is_new) {
+    // Strings can only be moved to the file if their ids don't change.
+    if (!large_strings_.empty() ||
+        ftruncate(*fd, static_cast<off_t>(kBackingFileHeaderSize)) != 0) {
+      return false;
+    }
+  } else if (file_size < kBackingFileHeaderSize) {
+    return false;
+  }
+
+  FileMapping header_mapping(MapFile(*fd, 0, kBackingFileHeaderSize),
+                             kBackingFileHeaderSize);
+  if (!header_mapping.IsValid())
+    return false;
+  auto* header = reinterpret_cast<BackingFileHeader*>(header_mapping.Get());
+
+  std::vector<base::StringView> blocks;
+  std::vector<FileMapping> block_mappings;
+  if (is_new) {
+    memcpy(header->magic, kBackingFileMagic, sizeof(header->magic));
+    header->version = kBackingFileVersion;
+    header->num_blocks = 0;
+    header->num_large_strings = 0;
+    blocks = GetRawBlocks();
+  } else {
+    if (memcmp(header->magic, kBackingFileMagic, sizeof(header->magic)) != 0 ||
+        header->version != kBackingFileVersion || header->num_blocks == 0 ||
+        header->num_blocks > (1u << kNumBlockIndexBits) ||
+        header->num_large_strings != 0 ||
+        file_size < kBackingFileHeaderSize +
+                        header->num_blocks * kBlockSizeBytes) {
+      return false;
+    }
+    for (uint32_t i = 0; i < header->num_blocks; ++i) {
+      if (header->block_pos[i] > kBlockSizeBytes)
+        return false;
+      size_t offset = kBackingFileHeaderSize + i * kBlockSizeBytes;
+      block_mappings.emplace_back(MapFile(*fd, offset, kBlockSizeBytes),
+                                  kBlockSizeBytes);
+      if (!block_mappings.back().IsValid())
+        return false;
+      blocks.emplace_back(
+          reinterpret_cast<const char*>(block_mappings.back().Get()),
+          header->block_pos[i]);
+    }
+  }
+
+  StringIndex index;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (!IndexBlock(blocks[i], i, &index))
+      return false;
+  }
+  if (blocks[0].empty())
+    return false;
+
+  std::vector<Block> old_blocks = std::move(blocks_);
+  blocks_.clear();
+  backing_fd_ = std::move(fd);
+  backing_header_ = std::move(header_mapping);
+  if (is_new) {
+    // Copy the strings interned so far to the file.
+    for (base::StringView block : blocks) {
+      AddBlock();
+      blocks_.back().Assign(block);
+    }
+  } else {
+    for (uint32_t i = 0; i < header->num_blocks; ++i) {
+      blocks_.emplace_back(std::move(block_mappings[i]), kBlockSizeBytes,
+                           header->block_pos[i], &header->block_pos[i]);
+    }
+    large_strings_.clear();
+  }
+  string_index_ = std::move(index);
+  return true;
+#else
+  base::ignore_result(fd);
+  return false;
+#endif
+}
+
 std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
     base::StringView str) {
   auto str_size = str.size();
@@ -102,8 +267,10 @@ std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
   if (max_pos > size_)
     return std::make_pair(false, 0u);
 
-  // Ensure that we commit up until the end of the string to memory.
-  mem_.EnsureCommitted(max_pos);
+  // Ensure that we commit up until the end of the string to memory. Blocks of
+  // the backing file are always fully mapped.
+  if (!file_.IsValid())
+    mem_.EnsureCommitted(max_pos);
 
   // Get where we should start writing this string.
   uint32_t offset = pos_;
@@ -123,10 +290,162 @@ std::pair<bool /*success*/, uint32_t /*offset*/> StringPool::Block::TryInsert(
 
   // Update the end of the block and return the pointer to the string.
   pos_ = OffsetOf(end);
+  if (pos_in_file_)
+    *pos_in_file_ = pos_;
 
   return std::make_pair(true, offset);
 }
 
+void StringPool::Block::Assign(base::StringView data) {
+  PERFETTO_CHECK(data.size() <= size_);
+  if (!file_.IsValid())
+    mem_.EnsureCommitted(data.size());
+  if (!data.empty())
+    memcpy(Get(0), data.data(), data.size());
+  pos_ = static_cast<uint32_t>(data.size());
+  if (pos_in_file_)
+    *pos_in_file_ = pos_;
+}
+
+std::vector<base::StringView> StringPool::GetRawBlocks() const {
+  std::vector<base::StringView> blocks;
+  for (const Block& block : blocks_) {
+    blocks.emplace_back(reinterpret_cast<const char*>(block.Get(0)),
+                        block.pos());
+  }
+  return blocks;
+}
+
+std::vector<base::StringView> StringPool::GetRawLargeStrings() const {
+  std::vector<base::StringView> large_strings;
+  for (const std::unique_ptr<std::string>& str : large_strings_)
+    large_strings.emplace_back(*str);
+  return large_strings;
+}
+
+bool StringPool::SetRawContents(
+    const std::vector<base::StringView>& blocks,
+    const std::vector<base::StringView>& large_strings) {
+  if (blocks.empty() || blocks.size() > (1u << kNumBlockIndexBits) ||
+      large_strings.size() > kLargeStringFlagBitMask) {
+    return false;
+  }
+
+  StringIndex string_index;
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (!IndexBlock(blocks[i], i, &string_index))
+      return false;
+  }
+  if (blocks[0].empty())
+    return false;
+  for (size_t i = 0; i < large_strings.size(); ++i)
+    string_index.Insert(large_strings[i].Hash(), Id::LargeString(i));
+
+  blocks_.clear();
+  for (base::StringView block : blocks) {
+    AddBlock();
+    blocks_.back().Assign(block);
+  }
+  large_strings_.clear();
+  for (base::StringView str : large_strings)
+    large_strings_.emplace_back(new std::string(str.ToStdString()));
+  if (backing_header_.IsValid()) {
+    auto* header = reinterpret_cast<BackingFileHeader*>(backing_header_.Get());
+    header->num_large_strings = static_cast<uint32_t>(large_strings_.size());
+  }
+  string_index_ = std::move(string_index);
+  return true;
+}
+
+// static
+bool StringPool::IndexBlock(base::StringView block,
+                            size_t block_index,
+                            StringIndex* index) {
+  // Walk through the strings of the block to check that they are well formed
+  // before indexing them: the first one of the first block must be the null
+  // string, and all of them must be null-terminated and end within the block.
+  if (block.size() > kBlockSizeBytes)
+    return false;
+  const auto* start = reinterpret_cast<const uint8_t*>(block.data());
+  const uint8_t* end = start + block.size();
+  for (const uint8_t* ptr = start; ptr < end;) {
+    uint64_t size = 0;
+    const uint8_t* str_ptr = protozero::proto_utils::ParseVarInt(
+        ptr, std::min(ptr + kMaxMetadataSize, end), &size);
+    if (str_ptr == ptr || size >= static_cast<uint64_t>(end - str_ptr) ||
+        str_ptr[size] != '\0') {
+      return false;
+    }
+    auto offset = static_cast<uint32_t>(ptr - start);
+    ptr = str_ptr + size + 1;
+    if (block_index == 0 && offset == 0) {
+      if (size != 0)
+        return false;
+      continue;
+    }
+    base::StringView str(reinterpret_cast<const char*>(str_ptr),
+                         static_cast<size_t>(size));
+    StringHash hash = str.Hash();
+    if (!index->Find(hash))
+      index->Insert(hash, Id::BlockString(block_index, offset));
+  }
+  return true;
+}
+
+StringPool::FileMapping::~FileMapping() {
+#if PERFETTO_TP_HAS_MMAP()
+  if (addr_)
+    munmap(addr_, size_);
+#endif
+}
+
+StringPool::FileMapping::FileMapping(FileMapping&& other) noexcept
+    : addr_(other.addr_), size_(other.size_) {
+  other.addr_ = nullptr;
+  other.size_ = 0;
+}
+
+StringPool::FileMapping& StringPool::FileMapping::operator=(
+    FileMapping&& other) {
+  if (this != &other) {
+    this->~FileMapping();
+    new (this) FileMapping(std::move(other));
+  }
+  return *this;
+}
+
+StringPool::StringIndex::StringIndex()
+    : slots_(kInitialSlots), mask_(kInitialSlots - 1) {}
+
+void StringPool::StringIndex::Insert(StringHash hash, Id id) {
+  PERFETTO_DCHECK(!id.is_null());
+  // Keep the load factor under 3/4 so that probe sequences stay short.
+  if ((size_ + 1) * 4 > slots_.size() * 3)
+    Grow();
+  uint32_t slot = SlotFor(hash);
+  while (slots_[slot].id != 0)
+    slot = (slot + 1) & mask_;
+  slots_[slot] = Slot{static_cast<uint32_t>(hash),
+                      static_cast<uint32_t>(hash >> 32), id.raw_id()};
+  size_++;
+}
+
+void StringPool::StringIndex::Grow() {
+  std::vector<Slot> old_slots(slots_.size() * 2);
+  old_slots.swap(slots_);
+  mask_ = static_cast<uint32_t>(slots_.size() - 1);
+  for (const Slot& old_slot : old_slots) {
+    if (old_slot.id == 0)
+      continue;
+    StringHash hash = (static_cast<uint64_t>(old_slot.hash_hi) << 32) |
+                      old_slot.hash_lo;
+    uint32_t slot = SlotFor(hash);
+    while (slots_[slot].id != 0)
+      slot = (slot + 1) & mask_;
+    slots_[slot] = old_slot;
+  }
+}
+
 StringPool::Iterator::Iterator(const StringPool* pool) : pool_(pool) {}
 
 StringPool::Iterator& StringPool::Iterator::operator++() {
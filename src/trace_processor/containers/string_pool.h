@@ -25,6 +25,7 @@
 
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/paged_memory.h"
+#include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/protozero/proto_utils.h"
 #include "src/trace_processor/containers/null_term_string_view.h"
 
@@ -117,10 +118,10 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
-    auto id_it = string_index_.find(hash);
-    if (id_it != string_index_.end()) {
-      PERFETTO_DCHECK(Get(id_it->second) == str);
-      return id_it->second;
+    base::Optional<Id> id = string_index_.Find(hash);
+    if (id) {
+      PERFETTO_DCHECK(Get(*id) == str);
+      return *id;
     }
     return InsertString(str, hash);
   }
@@ -130,12 +131,9 @@ class StringPool {
       return Id::Null();
 
     auto hash = str.Hash();
-    auto id_it = string_index_.find(hash);
-    if (id_it != string_index_.end()) {
-      PERFETTO_DCHECK(Get(id_it->second) == str);
-      return id_it->second;
-    }
-    return base::nullopt;
+    base::Optional<Id> id = string_index_.Find(hash);
+    PERFETTO_DCHECK(!id || Get(*id) == str);
+    return id;
   }
 
   NullTermStringView Get(Id id) const {
@@ -150,14 +148,126 @@ class StringPool {
 
   size_t size() const { return string_index_.size(); }
 
+  // Returns the bytes used in each block and the large strings of the pool.
+  // Restoring them with |SetRawContents| gives the same ids to all the strings,
+  // which allows saving the pool along with data referring to these ids (e.g.
+  // in a snapshot of the trace storage).
+  std::vector<base::StringView> GetRawBlocks() const;
+  std::vector<base::StringView> GetRawLargeStrings() const;
+
+  // Replaces the contents of the pool with |blocks| and |large_strings| as
+  // returned by the above and rebuilds the index of the strings. Returns
+  // false, leaving the pool unchanged, if |blocks| are not valid blocks.
+  bool SetRawContents(const std::vector<base::StringView>& blocks,
+                      const std::vector<base::StringView>& large_strings);
+
+  // Stores the blocks of the pool in |fd|, which must be opened for reading
+  // and writing, instead of anonymous memory. The strings then live in the
+  // page cache: the kernel can write them back and evict them under memory
+  // pressure instead of counting them towards the RSS of the process.
+  //
+  // If |fd| is empty, the strings interned so far are moved to it. Otherwise,
+  // it must hold a pool written by another StringPool (e.g. by a previous run
+  // of trace processor): the pool is replaced with the strings of the file,
+  // which keep their ids, and new strings are appended to it. A file must only
+  // be used by one pool at a time.
+  //
+  // Large strings (see |kMinLargeStringSizeBytes|) are still kept in memory,
+  // so files containing some can't be reused. Returns false, leaving the pool
+  // unchanged, if the file can't be used or if mmap is not supported.
+  bool SetBackingFile(base::ScopedFile fd);
+
  private:
   using StringHash = uint64_t;
 
+  // A region of the backing file, mapped in memory.
+  class FileMapping {
+   public:
+    FileMapping() = default;
+    FileMapping(void* addr, size_t size) : addr_(addr), size_(size) {}
+    ~FileMapping();
+
+    FileMapping(FileMapping&&) noexcept;
+    FileMapping& operator=(FileMapping&&);
+
+    uint8_t* Get() const { return static_cast<uint8_t*>(addr_); }
+    bool IsValid() const { return addr_ != nullptr; }
+
+   private:
+    FileMapping(const FileMapping&) = delete;
+    FileMapping& operator=(const FileMapping&) = delete;
+
+    void* addr_ = nullptr;
+    size_t size_ = 0;
+  };
+
+  // Maps hashes of strings to their Id. This is a hash table using open
+  // addressing with linear probing over a flat array of slots: it takes a
+  // fraction of the memory of a node-based map and needs a single random
+  // memory access for most lookups.
+  class StringIndex {
+   public:
+    StringIndex();
+
+    base::Optional<Id> Find(StringHash hash) const {
+      for (uint32_t slot = SlotFor(hash);; slot = (slot + 1) & mask_) {
+        const Slot& s = slots_[slot];
+        if (s.id == 0)
+          return base::nullopt;
+        if (s.hash_lo == static_cast<uint32_t>(hash) &&
+            s.hash_hi == static_cast<uint32_t>(hash >> 32)) {
+          return Id::Raw(s.id);
+        }
+      }
+    }
+
+    // Adds a string which is not in the index yet.
+    void Insert(StringHash hash, Id id);
+
+    size_t size() const { return size_; }
+
+   private:
+    // The hash is split in two to keep slots 12 bytes long. Slots with a null
+    // id are empty: the null string is never indexed.
+    struct Slot {
+      uint32_t hash_lo;
+      uint32_t hash_hi;
+      uint32_t id;
+    };
+
+    static constexpr uint32_t kInitialSlots = 1024;
+
+    uint32_t SlotFor(StringHash hash) const {
+      // Fibonacci hashing: the high bits of the product are well mixed even
+      // if the low bits of the hash are not.
+      return static_cast<uint32_t>((hash * 0x9E3779B97F4A7C15ull) >> 32) &
+             mask_;
+    }
+
+    void Grow();
+
+    std::vector<Slot> slots_;
+    uint32_t mask_ = 0;
+    size_t size_ = 0;
+  };
+
   struct Block {
     explicit Block(size_t size)
         : mem_(base::PagedMemory::Allocate(size,
                                            base::PagedMemory::kDontCommit)),
+          base_(static_cast<uint8_t*>(mem_.Get())),
           size_(size) {}
+
+    // Creates a block stored in |mapping|, a region of |size| bytes of the
+    // backing file of which the first |pos| are used. The number of bytes used
+    // is kept up to date in |pos_in_file|.
+    Block(FileMapping mapping, size_t size, uint32_t pos, uint32_t* pos_in_file)
+        : file_(std::move(mapping)),
+          base_(file_.Get()),
+          pos_in_file_(pos_in_file),
+          pos_(pos),
+          size_(size) {}
+
     ~Block() = default;
 
     // Allow std::move().
@@ -168,13 +278,15 @@ class StringPool {
     Block(const Block&) = delete;
     Block& operator=(const Block&) = delete;
 
-    uint8_t* Get(uint32_t offset) const {
-      return static_cast<uint8_t*>(mem_.Get()) + offset;
-    }
+    uint8_t* Get(uint32_t offset) const { return base_ + offset; }
 
     std::pair<bool /*success*/, uint32_t /*offset*/> TryInsert(
         base::StringView str);
 
+    // Replaces the contents of the block with |data|, which must fit in the
+    // block.
+    void Assign(base::StringView data);
+
     uint32_t OffsetOf(const uint8_t* ptr) const {
       PERFETTO_DCHECK(Get(0) < ptr &&
                       ptr <= Get(static_cast<uint32_t>(size_ - 1)));
@@ -185,6 +297,9 @@ class StringPool {
 
    private:
     base::PagedMemory mem_;
+    FileMapping file_;
+    uint8_t* base_ = nullptr;
+    uint32_t* pos_in_file_ = nullptr;
     uint32_t pos_ = 0;
     size_t size_ = 0;
   };
@@ -229,6 +344,15 @@ class StringPool {
   // Insert a large string into the pool and return its Id.
   Id InsertLargeString(base::StringView, uint64_t hash);
 
+  // Appends a new empty block to |blocks_|, in the backing file if any.
+  void AddBlock();
+
+  // Adds the strings of |block|, the contents of the block with the given
+  // index, to |index|. Returns false if |block| is not well formed.
+  static bool IndexBlock(base::StringView block,
+                         size_t block_index,
+                         StringIndex* index);
+
   // The returned pointer points to the start of the string metadata (i.e. the
   // first byte of the size).
   const uint8_t* IdToPtr(Id id) const {
@@ -276,6 +400,11 @@ class StringPool {
     return NullTermStringView(str->c_str(), str->size());
   }
 
+  // Only set when the blocks are stored in a file (see SetBackingFile()). The
+  // header of the file records how many bytes of each block are used.
+  base::ScopedFile backing_fd_;
+  FileMapping backing_header_;
+
   // The actual memory storing the strings.
   std::vector<Block> blocks_;
 
@@ -285,9 +414,7 @@ class StringPool {
   std::vector<std::unique_ptr<std::string>> large_strings_;
 
   // Maps hashes of strings to the Id in the string pool.
-  // TODO(lalitm): At some point we should benchmark just using a static
-  // hashtable of 1M elements, we can afford paying a fixed 8MB here
-  std::unordered_map<StringHash, Id> string_index_;
+  StringIndex string_index_;
 };
 
 }  // namespace trace_processor
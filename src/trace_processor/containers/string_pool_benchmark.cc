@@ -0,0 +1,163 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/string_splitter.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/trace_processor/containers/string_pool.h"
+
+using perfetto::base::StringView;
+using perfetto::trace_processor::StringPool;
+
+namespace {
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Creates |count| unique strings looking like the values of args, with a
+// random length between 8 and 64 characters.
+std::vector<std::string> CreateStrings(uint32_t count) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  std::vector<std::string> strings(count);
+  for (uint32_t i = 0; i < count; ++i) {
+    std::string& str = strings[i];
+    str = "value_" + std::to_string(i) + "_";
+    size_t length = 8 + rnd_engine() % 56;
+    while (str.size() < length)
+      str += static_cast<char>('a' + rnd_engine() % 26);
+  }
+  return strings;
+}
+
+// Returns the anonymous memory used by the process, in bytes, which is what
+// storing the strings in a file saves. Returns 0 if unknown.
+uint64_t GetRssAnonBytes() {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+  std::string status;
+  if (!perfetto::base::ReadFile("/proc/self/status", &status))
+    return 0;
+  for (perfetto::base::StringSplitter lines(std::move(status), '\n');
+       lines.Next();) {
+    if (strncmp(lines.cur_token(), "RssAnon:", 8) != 0)
+      continue;
+    return strtoull(lines.cur_token() + 8, nullptr, 10) * 1024;
+  }
+#endif
+  return 0;
+}
+
+void StringPoolArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1000);
+  } else {
+    b->Arg(100000)->Arg(1000000)->Arg(5000000);
+  }
+}
+
+// Interns |strings| in a new pool, stored in a file if |backing_file| is set,
+// and reports the throughput and the memory used by the pool.
+void InternStrings(benchmark::State& state,
+                   const std::vector<std::string>& strings,
+                   bool backing_file) {
+  uint64_t rss_anon_bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    perfetto::base::TempFile file = perfetto::base::TempFile::Create();
+    uint64_t rss_anon_before = GetRssAnonBytes();
+    {
+      StringPool pool;
+      if (backing_file) {
+        PERFETTO_CHECK(pool.SetBackingFile(
+            perfetto::base::OpenFile(file.path(), O_RDWR)));
+      }
+      state.ResumeTiming();
+
+      for (const std::string& str : strings)
+        benchmark::DoNotOptimize(pool.InternString(StringView(str)));
+
+      state.PauseTiming();
+      uint64_t rss_anon_after = GetRssAnonBytes();
+      rss_anon_bytes = rss_anon_after > rss_anon_before
+                           ? rss_anon_after - rss_anon_before
+                           : 0;
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(strings.size()));
+  state.counters["rss_anon_mb"] =
+      benchmark::Counter(static_cast<double>(rss_anon_bytes) / 1e6);
+}
+
+}  // namespace
+
+static void BM_StringPoolInternUnique(benchmark::State& state) {
+  std::vector<std::string> strings =
+      CreateStrings(static_cast<uint32_t>(state.range(0)));
+  InternStrings(state, strings, false);
+}
+BENCHMARK(BM_StringPoolInternUnique)->Apply(StringPoolArgs);
+
+static void BM_StringPoolInternUniqueBackingFile(benchmark::State& state) {
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+  std::vector<std::string> strings =
+      CreateStrings(static_cast<uint32_t>(state.range(0)));
+  InternStrings(state, strings, true);
+#else
+  state.SkipWithError("Backing files are not supported");
+#endif
+}
+BENCHMARK(BM_StringPoolInternUniqueBackingFile)->Apply(StringPoolArgs);
+
+// Interns strings which are already in the pool, which is what happens for
+// most strings of a trace (e.g. thread names and arg keys).
+static void BM_StringPoolInternDuplicate(benchmark::State& state) {
+  std::vector<std::string> strings =
+      CreateStrings(static_cast<uint32_t>(state.range(0)));
+  StringPool pool;
+  for (const std::string& str : strings)
+    pool.InternString(StringView(str));
+
+  static constexpr uint32_t kRandomSeed = 476;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  std::vector<uint32_t> indices(1024 * 1024);
+  for (uint32_t& index : indices)
+    index = rnd_engine() % strings.size();
+
+  uint32_t i = 0;
+  for (auto _ : state) {
+    const std::string& str = strings[indices[i]];
+    benchmark::DoNotOptimize(pool.InternString(StringView(str)));
+    i = (i + 1) % indices.size();
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+BENCHMARK(BM_StringPoolInternDuplicate)->Apply(StringPoolArgs);
@@ -19,6 +19,9 @@
 #include <array>
 #include <random>
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -197,6 +200,60 @@ TEST_F(StringPoolTest, BigString) {
   }
 }
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+
+TEST_F(StringPoolTest, BackingFile) {
+  base::TempFile file = base::TempFile::Create();
+  StringPool::Id before = pool_.InternString("interned before");
+  ASSERT_TRUE(pool_.SetBackingFile(base::OpenFile(file.path(), O_RDWR)));
+
+  // The strings interned before keep their id and new strings are added to
+  // the file, including new blocks.
+  ASSERT_EQ(pool_.Get(before), "interned before");
+  ASSERT_EQ(pool_.InternString("interned before"), before);
+  std::string medium(3 * 1024 * 1024, 'a');
+  std::vector<StringPool::Id> ids;
+  for (uint32_t i = 0; i < 20; ++i) {
+    medium[0] = static_cast<char>('a' + i);
+    ids.push_back(pool_.InternString(base::StringView(medium)));
+  }
+  ASSERT_EQ(ids.back().block_index(), 1u);
+  StringPool::Id after = pool_.InternString("interned after");
+
+  // Another pool reusing the file sees the same strings with the same ids.
+  StringPool reused;
+  ASSERT_TRUE(reused.SetBackingFile(base::OpenFile(file.path(), O_RDWR)));
+  ASSERT_EQ(reused.size(), pool_.size());
+  ASSERT_EQ(reused.Get(before), "interned before");
+  ASSERT_EQ(reused.Get(after), "interned after");
+  for (uint32_t i = 0; i < ids.size(); ++i) {
+    medium[0] = static_cast<char>('a' + i);
+    ASSERT_EQ(reused.GetId(base::StringView(medium)), ids[i]);
+  }
+  ASSERT_EQ(reused.InternString("interned after"), after);
+}
+
+TEST_F(StringPoolTest, InvalidBackingFile) {
+  base::TempFile file = base::TempFile::Create();
+  base::WriteAll(file.fd(), "not a string pool", 17);
+  StringPool::Id id = pool_.InternString("string");
+  ASSERT_FALSE(pool_.SetBackingFile(base::OpenFile(file.path(), O_RDWR)));
+  ASSERT_EQ(pool_.Get(id), "string");
+
+  // A file can't be reused when some of its strings were not stored in it.
+  base::TempFile large_file = base::TempFile::Create();
+  StringPool pool;
+  ASSERT_TRUE(pool.SetBackingFile(base::OpenFile(large_file.path(), O_RDWR)));
+  pool.InternString(base::StringView(std::string(33 * 1024 * 1024, 'a')));
+  StringPool reused;
+  ASSERT_FALSE(
+      reused.SetBackingFile(base::OpenFile(large_file.path(), O_RDWR)));
+}
+
+#endif
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -16,12 +16,230 @@
 
 #include "src/trace_processor/db/column.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <numeric>
+#include <unordered_set>
+
 #include "src/trace_processor/db/compare.h"
+#include "src/trace_processor/db/filter_kernels.h"
+#include "src/trace_processor/db/glob.h"
+#include "src/trace_processor/db/parallel_sort.h"
 #include "src/trace_processor/db/table.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// Filters the rows of a non-null column whose values are stored contiguously
+// (i.e. |row_map| is a range) using the filter kernels, which compare 64 rows
+// at a time. Returns false if the column and value types are not supported by
+// the kernels, in which case nothing is done.
+//
+// Integer columns compacted by NullableVector::Compact are filtered in the
+// same way, decoding their values on the fly.
+template <typename T>
+bool FilterIntoCompressedWithKernel(const NullableVector<T>& nv,
+                                    const RowMap& row_map,
+                                    FilterOp op,
+                                    SqlValue value,
+                                    RowMap* rm) {
+  const CompressedIntVector* cv = nv.compressed();
+  if (!cv || value.type != SqlValue::Type::kLong || !row_map.IsRange())
+    return false;
+  filter_kernels::CompressedFilter filter(*cv, op, value.long_value);
+  row_map.FilterIntoWords(rm, [&filter](uint32_t row, uint32_t n) {
+    return filter.Filter(row, n);
+  });
+  return true;
+}
+
+template <typename T>
+bool FilterIntoNonNullWithKernel(const NullableVector<T>& nv,
+                                 const RowMap& row_map,
+                                 FilterOp op,
+                                 SqlValue value,
+                                 RowMap* rm) {
+  return FilterIntoCompressedWithKernel(nv, row_map, op, value, rm);
+}
+
+template <typename T>
+void FilterIntoWithKernel(const NullableVector<T>& nv,
+                          const RowMap& row_map,
+                          FilterOp op,
+                          T value,
+                          RowMap* rm) {
+  const T* data = nv.data();
+  filter_kernels::Kernel<T> kernel = filter_kernels::GetKernel<T>(op);
+  row_map.FilterIntoWords(rm, [data, kernel, value](uint32_t row, uint32_t n) {
+    return kernel(data + row, n, value);
+  });
+}
+
+bool FilterIntoNonNullWithKernel(const NullableVector<int64_t>& nv,
+                                 const RowMap& row_map,
+                                 FilterOp op,
+                                 SqlValue value,
+                                 RowMap* rm) {
+  if (FilterIntoCompressedWithKernel(nv, row_map, op, value, rm))
+    return true;
+  if (value.type != SqlValue::Type::kLong || !row_map.IsRange())
+    return false;
+  FilterIntoWithKernel(nv, row_map, op, value.long_value, rm);
+  return true;
+}
+
+bool FilterIntoNonNullWithKernel(const NullableVector<double>& nv,
+                                 const RowMap& row_map,
+                                 FilterOp op,
+                                 SqlValue value,
+                                 RowMap* rm) {
+  if (value.type != SqlValue::Type::kDouble || !row_map.IsRange())
+    return false;
+  FilterIntoWithKernel(nv, row_map, op, value.double_value, rm);
+  return true;
+}
+
+// The distinct strings of a column are only computed when at least 1 /
+// |kDistinctStringsMinFraction| of the rows of the column are being filtered.
+constexpr uint32_t kDistinctStringsMinFraction = 4;
+
+// The largest range of ids for which StringIdSet uses a BitVector (2MB).
+constexpr uint32_t kMaxStringIdSetBitVectorSize = 1u << 24;
+
+// Returns whether the non-null string |v| matches the filter given by |op|
+// and |value|.
+bool StringMatches(FilterOp op,
+                   NullTermStringView v,
+                   NullTermStringView value) {
+  switch (op) {
+    case FilterOp::kEq:
+      return compare::String(v, value) == 0;
+    case FilterOp::kNe:
+      return compare::String(v, value) != 0;
+    case FilterOp::kLt:
+      return compare::String(v, value) < 0;
+    case FilterOp::kGt:
+      return compare::String(v, value) > 0;
+    case FilterOp::kLe:
+      return compare::String(v, value) <= 0;
+    case FilterOp::kGe:
+      return compare::String(v, value) >= 0;
+    case FilterOp::kGlob:
+      return glob::Matches(value.c_str(), v.c_str());
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+      break;
+  }
+  PERFETTO_FATAL("Null checks are handled separately");
+}
+
+// A set of string ids optimized for checking membership of the ids of every
+// row in a column.
+//
+// String ids are offsets into the string pool so they are sparse; when the
+// ids in the set are close enough together, a BitVector covering their range
+// is used, falling back to a hash set otherwise.
+class StringIdSet {
+ public:
+  // |sorted_ids| should be sorted and non-empty.
+  explicit StringIdSet(const std::vector<StringPool::Id>& sorted_ids)
+      : min_(sorted_ids.front().raw_id()) {
+    uint32_t range = sorted_ids.back().raw_id() - min_ + 1;
+    use_bit_vector_ = range <= kMaxStringIdSetBitVectorSize;
+    if (use_bit_vector_) {
+      bit_vector_ = BitVector(range, false);
+      for (StringPool::Id id : sorted_ids)
+        bit_vector_.Set(id.raw_id() - min_);
+    } else {
+      for (StringPool::Id id : sorted_ids)
+        hash_set_.insert(id.raw_id());
+    }
+  }
+
+  bool Contains(StringPool::Id id) const {
+    if (use_bit_vector_) {
+      // Ids smaller than |min_| wrap around to large offsets.
+      uint32_t offset = id.raw_id() - min_;
+      return offset < bit_vector_.size() && bit_vector_.IsSet(offset);
+    }
+    return hash_set_.count(id.raw_id()) > 0;
+  }
+
+ private:
+  uint32_t min_ = 0;
+  bool use_bit_vector_ = false;
+  BitVector bit_vector_;
+  std::unordered_set<uint32_t> hash_set_;
+};
+
+// Index vectors with fewer rows than this are sorted with std::stable_sort
+// rather than with a radix sort.
+constexpr size_t kMinRadixSortSize = 1024;
+
+// Maps integer values to radix sort keys which are ordered in the same way as
+// the values when compared as unsigned integers.
+inline uint64_t ToRadixSortKey(uint32_t value) {
+  return value;
+}
+inline uint64_t ToRadixSortKey(int64_t value) {
+  return static_cast<uint64_t>(value) ^ (1ull << 63);
+}
+inline uint64_t ToRadixSortKey(int32_t value) {
+  return ToRadixSortKey(static_cast<int64_t>(value));
+}
+inline uint64_t ToRadixSortKey(double value) {
+  // -0.0 and 0.0 compare equal so they need to have the same key.
+  if (value == 0)
+    value = 0;
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  // Negative values are ordered in reverse of their bit pattern.
+  return bits & (1ull << 63) ? ~bits : bits ^ (1ull << 63);
+}
+
+// Stable sorts the indices in [begin, end) by the radix sort keys returned by
+// |key_fn| for the rows |row_map| maps the indices to.
+template <bool desc, typename KeyFn>
+void RadixSortIndices(base::ThreadPool* pool,
+                      const RowMap& row_map,
+                      uint32_t* begin,
+                      uint32_t* end,
+                      KeyFn key_fn) {
+  std::vector<RadixSortEntry> entries(static_cast<size_t>(end - begin));
+  for (size_t i = 0; i < entries.size(); ++i) {
+    uint64_t key = key_fn(row_map.Get(begin[i]));
+    // Inverting the keys reverses their order while keeping the sort stable.
+    entries[i].key = desc ? ~key : key;
+    entries[i].value = begin[i];
+  }
+  RadixSort(pool, &entries);
+  for (size_t i = 0; i < entries.size(); ++i)
+    begin[i] = entries[i].value;
+}
+
+// Stable sorts |out| using |comparator| on the rows |row_map| maps the
+// indices to.
+template <typename Comparator>
+void StableSortIndices(base::ThreadPool* pool,
+                       const RowMap& row_map,
+                       std::vector<uint32_t>* out,
+                       Comparator comparator) {
+  if (!pool || out->size() < kMinParallelSortSize) {
+    row_map.StableSort(out, comparator);
+    return;
+  }
+  ParallelStableSort(pool, out,
+                     [&row_map, comparator](uint32_t a, uint32_t b) {
+                       return comparator(row_map.Get(a), row_map.Get(b));
+                     });
+}
+
+}  // namespace
+
 Column::Column(const Column& column,
                Table* table,
                uint32_t col_idx,
@@ -33,7 +251,9 @@ Column::Column(const Column& column,
              col_idx,
              row_map_idx,
              column.nullable_vector_,
-             column.owned_nullable_vector_) {}
+             column.owned_nullable_vector_) {
+  distinct_strings_ = column.distinct_strings_;
+}
 
 Column::Column(const char* name,
                ColumnType type,
@@ -78,15 +298,77 @@ Column Column::IdColumn(Table* table, uint32_t col_idx, uint32_t row_map_idx) {
                 nullptr, nullptr);
 }
 
+void Column::GetRows(uint32_t start_row, uint32_t end_row, Rows* out) const {
+  PERFETTO_DCHECK(start_row <= end_row);
+
+  std::vector<uint32_t> idxs(end_row - start_row);
+  row_map().GetRows(start_row, end_row, idxs.data());
+
+  out->type = type();
+  out->is_null.clear();
+  switch (type_) {
+    case ColumnType::kInt32:
+      GetNumericAtIdxs<int32_t>(idxs, &out->longs, &out->is_null);
+      break;
+    case ColumnType::kUint32:
+      GetNumericAtIdxs<uint32_t>(idxs, &out->longs, &out->is_null);
+      break;
+    case ColumnType::kInt64:
+      GetNumericAtIdxs<int64_t>(idxs, &out->longs, &out->is_null);
+      break;
+    case ColumnType::kDouble:
+      GetNumericAtIdxs<double>(idxs, &out->doubles, &out->is_null);
+      break;
+    case ColumnType::kString:
+      out->strings.resize(idxs.size());
+      for (uint32_t i = 0; i < idxs.size(); ++i)
+        out->strings[i] = GetStringPoolStringAtIdx(idxs[i]).c_str();
+      break;
+    case ColumnType::kId:
+      out->longs.assign(idxs.begin(), idxs.end());
+      break;
+  }
+}
+
+template <typename T, typename V>
+void Column::GetNumericAtIdxs(const std::vector<uint32_t>& idxs,
+                              std::vector<V>* values,
+                              std::vector<uint8_t>* is_null) const {
+  const auto& nv = nullable_vector<T>();
+  values->resize(idxs.size());
+  if (!IsNullable() && !nv.compressed()) {
+    // Without nulls, the values are stored contiguously so they can be read
+    // directly (see NullableVector::data()).
+    const T* data = nv.data();
+    for (uint32_t i = 0; i < idxs.size(); ++i)
+      (*values)[i] = static_cast<V>(data[idxs[i]]);
+    return;
+  }
+  is_null->resize(idxs.size());
+  for (uint32_t i = 0; i < idxs.size(); ++i) {
+    auto opt_value = nv.Get(idxs[i]);
+    (*is_null)[i] = !opt_value;
+    (*values)[i] = opt_value ? static_cast<V>(*opt_value) : V();
+  }
+}
+
 void Column::StableSort(bool desc, std::vector<uint32_t>* idx) const {
+  SortThreadPool sort_pool;
   if (desc) {
-    StableSort<true /* desc */>(idx);
+    StableSort<true /* desc */>(sort_pool.pool(), idx);
   } else {
-    StableSort<false /* desc */>(idx);
+    StableSort<false /* desc */>(sort_pool.pool(), idx);
   }
 }
 
 void Column::FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const {
+  if (op == FilterOp::kGlob && type_ != ColumnType::kString) {
+    // As with comparisions between strings and numerics, we are stricter than
+    // SQLite here and never match numerics with a glob.
+    rm->Intersect(RowMap());
+    return;
+  }
+
   switch (type_) {
     case ColumnType::kInt32: {
       if (IsNullable()) {
@@ -159,6 +441,14 @@ void Column::FilterIntoNumericSlow(FilterOp op,
     return;
   }
 
+  // Fast path: non-null int64/double columns compared to a value of the same
+  // type (or compressed integer columns compared to a long) are filtered 64
+  // rows at a time.
+  if (!is_nullable && FilterIntoNonNullWithKernel(nullable_vector<T>(),
+                                                  row_map(), op, value, rm)) {
+    return;
+  }
+
   if (value.type == SqlValue::Type::kDouble) {
     double double_value = value.double_value;
     if (std::is_same<T, double>::value) {
@@ -264,6 +554,7 @@ void Column::FilterIntoNumericWithComparatorSlow(FilterOp op,
       break;
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
       PERFETTO_FATAL("Should be handled above");
   }
 }
@@ -295,6 +586,59 @@ void Column::FilterIntoStringSlow(FilterOp op,
   NullTermStringView str_value = value.string_value;
   PERFETTO_DCHECK(str_value.data() != nullptr);
 
+  // String storage never contains nulls (null strings are stored as the null
+  // id) so the id of every row can be read directly from the storage.
+  const auto& nv = nullable_vector<StringPool::Id>();
+  const StringPool::Id* ids = nv.data();
+
+  // As strings are interned, (in)equality can be computed by comparing ids
+  // without looking at the strings at all.
+  if (op == FilterOp::kEq || op == FilterOp::kNe) {
+    base::Optional<StringPool::Id> opt_id = string_pool_->GetId(str_value);
+    if (op == FilterOp::kEq) {
+      if (!opt_id) {
+        rm->Intersect(RowMap());
+        return;
+      }
+      StringPool::Id id = *opt_id;
+      row_map().FilterInto(rm,
+                           [ids, id](uint32_t idx) { return ids[idx] == id; });
+    } else {
+      StringPool::Id id = opt_id ? *opt_id : StringPool::Id::Null();
+      row_map().FilterInto(rm, [ids, id](uint32_t idx) {
+        return !ids[idx].is_null() && ids[idx] != id;
+      });
+    }
+    return;
+  }
+
+  // For the other ops, evaluate the predicate once for every distinct string
+  // in the column and then only check the ids of the rows. We only pay for
+  // computing the distinct strings when a good fraction of the column is
+  // being filtered; after that, they are reused until the column changes.
+  bool compute_distinct = rm->size() >= nv.size() / kDistinctStringsMinFraction;
+  const DistinctStrings* distinct = GetDistinctStrings(compute_distinct);
+  if (distinct && distinct->ids.size() < rm->size()) {
+    std::vector<StringPool::Id> matching;
+    for (StringPool::Id id : distinct->ids) {
+      if (StringMatches(op, string_pool_->Get(id), str_value))
+        matching.push_back(id);
+    }
+
+    if (matching.empty()) {
+      rm->Intersect(RowMap());
+    } else if (matching.size() == distinct->ids.size()) {
+      row_map().FilterInto(
+          rm, [ids](uint32_t idx) { return !ids[idx].is_null(); });
+    } else {
+      StringIdSet id_set(matching);
+      row_map().FilterInto(rm, [ids, &id_set](uint32_t idx) {
+        return id_set.Contains(ids[idx]);
+      });
+    }
+    return;
+  }
+
   switch (op) {
     case FilterOp::kLt:
       row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
@@ -302,24 +646,12 @@ void Column::FilterIntoStringSlow(FilterOp op,
         return v.data() != nullptr && compare::String(v, str_value) < 0;
       });
       break;
-    case FilterOp::kEq:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) == 0;
-      });
-      break;
     case FilterOp::kGt:
       row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
         auto v = GetStringPoolStringAtIdx(idx);
         return v.data() != nullptr && compare::String(v, str_value) > 0;
       });
       break;
-    case FilterOp::kNe:
-      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
-        auto v = GetStringPoolStringAtIdx(idx);
-        return v.data() != nullptr && compare::String(v, str_value) != 0;
-      });
-      break;
     case FilterOp::kLe:
       row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
         auto v = GetStringPoolStringAtIdx(idx);
@@ -332,12 +664,53 @@ void Column::FilterIntoStringSlow(FilterOp op,
         return v.data() != nullptr && compare::String(v, str_value) >= 0;
       });
       break;
+    case FilterOp::kGlob:
+      row_map().FilterInto(rm, [this, str_value](uint32_t idx) {
+        auto v = GetStringPoolStringAtIdx(idx);
+        return v.data() != nullptr &&
+               glob::Matches(str_value.c_str(), v.c_str());
+      });
+      break;
+    case FilterOp::kEq:
+    case FilterOp::kNe:
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
       PERFETTO_FATAL("Should be handled above");
   }
 }
 
+const Column::DistinctStrings* Column::GetDistinctStrings(bool compute) const {
+  PERFETTO_DCHECK(type_ == ColumnType::kString);
+
+  const auto& nv = nullable_vector<StringPool::Id>();
+  if (distinct_strings_ && distinct_strings_->generation == nv.generation())
+    return distinct_strings_.get();
+  if (!compute)
+    return nullptr;
+
+  // Consecutive rows often contain the same string so skip repeated ids
+  // before going to the hash set.
+  std::unordered_set<uint32_t> seen;
+  const StringPool::Id* ids = nv.data();
+  StringPool::Id prev = StringPool::Id::Null();
+  for (uint32_t i = 0; i < nv.size(); ++i) {
+    if (ids[i] == prev)
+      continue;
+    prev = ids[i];
+    if (!prev.is_null())
+      seen.insert(prev.raw_id());
+  }
+
+  std::unique_ptr<DistinctStrings> distinct(new DistinctStrings());
+  distinct->generation = nv.generation();
+  distinct->ids.reserve(seen.size());
+  for (uint32_t raw_id : seen)
+    distinct->ids.push_back(StringPool::Id::Raw(raw_id));
+  std::sort(distinct->ids.begin(), distinct->ids.end());
+  distinct_strings_ = std::move(distinct);
+  return distinct_strings_.get();
+}
+
 void Column::FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const {
   PERFETTO_DCHECK(type_ == ColumnType::kId);
 
@@ -389,56 +762,67 @@ void Column::FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const {
       break;
     case FilterOp::kIsNull:
     case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
       PERFETTO_FATAL("Should be handled above");
   }
 }
 
 template <bool desc>
-void Column::StableSort(std::vector<uint32_t>* out) const {
+void Column::StableSort(base::ThreadPool* pool,
+                        std::vector<uint32_t>* out) const {
   switch (type_) {
     case ColumnType::kInt32: {
       if (IsNullable()) {
-        StableSortNumeric<desc, int32_t, true /* is_nullable */>(out);
+        StableSortNumeric<desc, int32_t, true /* is_nullable */>(pool, out);
       } else {
-        StableSortNumeric<desc, int32_t, false /* is_nullable */>(out);
+        StableSortNumeric<desc, int32_t, false /* is_nullable */>(pool, out);
       }
       break;
     }
     case ColumnType::kUint32: {
       if (IsNullable()) {
-        StableSortNumeric<desc, uint32_t, true /* is_nullable */>(out);
+        StableSortNumeric<desc, uint32_t, true /* is_nullable */>(pool, out);
       } else {
-        StableSortNumeric<desc, uint32_t, false /* is_nullable */>(out);
+        StableSortNumeric<desc, uint32_t, false /* is_nullable */>(pool, out);
       }
       break;
     }
     case ColumnType::kInt64: {
       if (IsNullable()) {
-        StableSortNumeric<desc, int64_t, true /* is_nullable */>(out);
+        StableSortNumeric<desc, int64_t, true /* is_nullable */>(pool, out);
       } else {
-        StableSortNumeric<desc, int64_t, false /* is_nullable */>(out);
+        StableSortNumeric<desc, int64_t, false /* is_nullable */>(pool, out);
       }
       break;
     }
     case ColumnType::kDouble: {
       if (IsNullable()) {
-        StableSortNumeric<desc, double, true /* is_nullable */>(out);
+        StableSortNumeric<desc, double, true /* is_nullable */>(pool, out);
       } else {
-        StableSortNumeric<desc, double, false /* is_nullable */>(out);
+        StableSortNumeric<desc, double, false /* is_nullable */>(pool, out);
       }
       break;
     }
     case ColumnType::kString: {
-      row_map().StableSort(out, [this](uint32_t a_idx, uint32_t b_idx) {
-        auto a_str = GetStringPoolStringAtIdx(a_idx);
-        auto b_str = GetStringPoolStringAtIdx(b_idx);
+      if (StableSortStringsByRank<desc>(pool, out))
+        break;
+      StableSortIndices(pool, row_map(), out,
+                        [this](uint32_t a_idx, uint32_t b_idx) {
+                          auto a_str = GetStringPoolStringAtIdx(a_idx);
+                          auto b_str = GetStringPoolStringAtIdx(b_idx);
 
-        int res = compare::NullableString(a_str, b_str);
-        return desc ? res > 0 : res < 0;
-      });
+                          int res = compare::NullableString(a_str, b_str);
+                          return desc ? res > 0 : res < 0;
+                        });
       break;
     }
     case ColumnType::kId:
+      if (out->size() >= kMinRadixSortSize) {
+        RadixSortIndices<desc>(pool, row_map(), out->data(),
+                               out->data() + out->size(),
+                               [](uint32_t idx) { return idx; });
+        break;
+      }
       row_map().StableSort(out, [](uint32_t a_idx, uint32_t b_idx) {
         int res = compare::Numeric(a_idx, b_idx);
         return desc ? res > 0 : res < 0;
@@ -447,12 +831,43 @@ void Column::StableSort(std::vector<uint32_t>* out) const {
 }
 
 template <bool desc, typename T, bool is_nullable>
-void Column::StableSortNumeric(std::vector<uint32_t>* out) const {
+void Column::StableSortNumeric(base::ThreadPool* pool,
+                               std::vector<uint32_t>* out) const {
   PERFETTO_DCHECK(IsNullable() == is_nullable);
   PERFETTO_DCHECK(ToColumnType<T>() == type_);
 
   const auto& nv = nullable_vector<T>();
-  row_map().StableSort(out, [&nv](uint32_t a_idx, uint32_t b_idx) {
+  if (out->size() >= kMinRadixSortSize) {
+    uint32_t* begin = out->data();
+    uint32_t* end = out->data() + out->size();
+    if (is_nullable) {
+      // Nulls compare smaller than every other value so move them to the
+      // start (or end, if sorting in descending order) and radix sort the
+      // other rows.
+      const RowMap& rm = row_map();
+      auto* split =
+          std::stable_partition(begin, end, [&nv, &rm](uint32_t idx) {
+            bool is_null = !nv.Get(rm.Get(idx)).has_value();
+            return desc ? !is_null : is_null;
+          });
+      if (desc) {
+        end = split;
+      } else {
+        begin = split;
+      }
+      RadixSortIndices<desc>(pool, rm, begin, end, [&nv](uint32_t idx) {
+        return ToRadixSortKey(*nv.Get(idx));
+      });
+    } else {
+      RadixSortIndices<desc>(pool, row_map(), begin, end, [&nv](uint32_t idx) {
+        return ToRadixSortKey(nv.GetNonNull(idx));
+      });
+    }
+    return;
+  }
+
+  StableSortIndices(pool, row_map(), out, [&nv](uint32_t a_idx,
+                                                uint32_t b_idx) {
     if (is_nullable) {
       auto a_val = nv.Get(a_idx);
       auto b_val = nv.Get(b_idx);
@@ -468,6 +883,47 @@ void Column::StableSortNumeric(std::vector<uint32_t>* out) const {
   });
 }
 
+template <bool desc>
+bool Column::StableSortStringsByRank(base::ThreadPool* pool,
+                                     std::vector<uint32_t>* out) const {
+  PERFETTO_DCHECK(type_ == ColumnType::kString);
+
+  const auto& nv = nullable_vector<StringPool::Id>();
+  if (out->size() < kMinRadixSortSize)
+    return false;
+  bool compute_distinct =
+      out->size() >= nv.size() / kDistinctStringsMinFraction;
+  const DistinctStrings* distinct = GetDistinctStrings(compute_distinct);
+  if (!distinct)
+    return false;
+
+  // Strings are interned so the distinct strings are all different: ranking
+  // them by value gives a key which orders the rows like the strings do. The
+  // null string is given rank 0 as it compares smaller than all the others.
+  const std::vector<StringPool::Id>& ids = distinct->ids;
+  std::vector<uint32_t> order(ids.size());
+  std::iota(order.begin(), order.end(), 0u);
+  std::sort(order.begin(), order.end(), [this, &ids](uint32_t a, uint32_t b) {
+    return compare::String(string_pool_->Get(ids[a]),
+                           string_pool_->Get(ids[b])) < 0;
+  });
+  std::vector<uint32_t> ranks(ids.size());
+  for (uint32_t i = 0; i < order.size(); ++i)
+    ranks[order[i]] = i + 1;
+
+  const StringPool::Id* data = nv.data();
+  RadixSortIndices<desc>(
+      pool, row_map(), out->data(), out->data() + out->size(),
+      [data, &ids, &ranks](uint32_t idx) -> uint64_t {
+        StringPool::Id id = data[idx];
+        if (id.is_null())
+          return 0;
+        auto it = std::lower_bound(ids.begin(), ids.end(), id);
+        return ranks[static_cast<size_t>(std::distance(ids.begin(), it))];
+      });
+  return true;
+}
+
 const RowMap& Column::row_map() const {
   return table_->row_maps_[row_map_idx_];
 }
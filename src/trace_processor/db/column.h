@@ -28,6 +28,10 @@
 #include "src/trace_processor/db/compare.h"
 
 namespace perfetto {
+namespace base {
+class ThreadPool;
+}  // namespace base
+
 namespace trace_processor {
 
 // Id type which can be used as a base for strongly typed ids.
@@ -53,6 +57,10 @@ enum class FilterOp {
   kLe,
   kIsNull,
   kIsNotNull,
+
+  // Matches strings against a glob pattern with the semantics of the GLOB
+  // operator in SQLite. Only supported on string columns.
+  kGlob,
 };
 
 // Represents a constraint on a column.
@@ -73,6 +81,23 @@ struct JoinKey {
   uint32_t col_idx;
 };
 
+// Represents an aggregate computed over the rows of each group of a group by
+// operation.
+struct Aggregate {
+  enum class Op {
+    kCount,
+    kSum,
+    kMin,
+    kMax,
+    kAvg,
+  };
+  Op op;
+
+  // The column aggregated. Only kCount can leave this unset, in which case
+  // all the rows of the group are counted rather than only the non-null ones.
+  base::Optional<uint32_t> col_idx;
+};
+
 class Table;
 
 // Represents a named, strongly typed list of data.
@@ -114,6 +139,36 @@ class Column {
   // Flags specified for an id column.
   static constexpr uint32_t kIdFlags = Flag::kSorted | Flag::kNonNull;
 
+  // The values of consecutive rows of a Column (see |GetRows|). The values
+  // are stored in the buffer matching |type|: |longs| for kLong, |doubles| for
+  // kDouble and |strings| for kString (where null strings are nullptr).
+  // |is_null| is only filled for nullable numeric columns.
+  struct Rows {
+    SqlValue::Type type = SqlValue::Type::kNull;
+    std::vector<int64_t> longs;
+    std::vector<double> doubles;
+    std::vector<const char*> strings;
+    std::vector<uint8_t> is_null;
+
+    // Returns the value of the |i|-th row.
+    SqlValue Get(uint32_t i) const {
+      if (!is_null.empty() && is_null[i])
+        return SqlValue();
+      switch (type) {
+        case SqlValue::Type::kLong:
+          return SqlValue::Long(longs[i]);
+        case SqlValue::Type::kDouble:
+          return SqlValue::Double(doubles[i]);
+        case SqlValue::Type::kString:
+          return strings[i] ? SqlValue::String(strings[i]) : SqlValue();
+        case SqlValue::Type::kNull:
+        case SqlValue::Type::kBytes:
+          break;
+      }
+      PERFETTO_FATAL("For GCC");
+    }
+  };
+
   template <typename T>
   Column(const char* name,
          NullableVector<T>* storage,
@@ -161,6 +216,12 @@ class Column {
   // Gets the value of the Column at the given |row|.
   SqlValue Get(uint32_t row) const { return GetAtIdx(row_map().Get(row)); }
 
+  // Writes the values of the Column at the rows between |start_row|
+  // (inclusive) and |end_row| (exclusive) to |out|. This is equivalent to
+  // calling Get for each row but only switches on the type of the column once
+  // and stores the values in a buffer of the type of the column.
+  void GetRows(uint32_t start_row, uint32_t end_row, Rows* out) const;
+
   // Returns the row containing the given value in the Column.
   base::Optional<uint32_t> IndexOf(SqlValue value) const {
     switch (type_) {
@@ -291,6 +352,23 @@ class Column {
   // Returns true if this column is a dense column.
   bool IsDense() const { return (flags_ & Flag::kDense) != 0; }
 
+  // Returns true if this column is hidden from users of the table.
+  bool IsHidden() const { return (flags_ & Flag::kHidden) != 0; }
+
+  // Returns a counter which changes every time the data backing this column
+  // changes. See NullableVectorBase::generation() for details.
+  uint32_t generation() const {
+    return nullable_vector_ ? nullable_vector_->generation() : 0;
+  }
+
+  // Returns the storage backing this column, or nullptr for id columns.
+  const NullableVectorBase* nullable_vector_base() const {
+    return nullable_vector_;
+  }
+  NullableVectorBase* mutable_nullable_vector_base() {
+    return nullable_vector_;
+  }
+
   // Returns the backing RowMap for this Column.
   // This function is defined out of line because of a circular dependency
   // between |Table| and |Column|.
@@ -330,6 +408,9 @@ class Column {
   Constraint le_value(SqlValue value) const {
     return Constraint{col_idx_in_table_, FilterOp::kLe, value};
   }
+  Constraint glob_value(SqlValue value) const {
+    return Constraint{col_idx_in_table_, FilterOp::kGlob, value};
+  }
   Constraint is_not_null() const {
     return Constraint{col_idx_in_table_, FilterOp::kIsNotNull, SqlValue()};
   }
@@ -513,6 +594,7 @@ class Column {
       case FilterOp::kNe:
       case FilterOp::kIsNull:
       case FilterOp::kIsNotNull:
+      case FilterOp::kGlob:
         break;
     }
     return false;
@@ -521,6 +603,20 @@ class Column {
   // Slow path filter method which will perform a full table scan.
   void FilterIntoSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
+  // The distinct (non-null) string ids stored in a string column; this allows
+  // string predicates to be evaluated once per distinct string rather than
+  // once per row.
+  struct DistinctStrings {
+    // The generation of the storage when the ids were computed.
+    uint32_t generation;
+    std::vector<StringPool::Id> ids;
+  };
+
+  // Returns the distinct strings stored in this string column, computing them
+  // if |compute| is true and they are not cached or stale. Returns nullptr if
+  // they are not available.
+  const DistinctStrings* GetDistinctStrings(bool compute) const;
+
   // Slow path filter method for numerics which will perform a full table scan.
   template <typename T, bool is_nullable>
   void FilterIntoNumericSlow(FilterOp op, SqlValue value, RowMap* rm) const;
@@ -538,14 +634,31 @@ class Column {
   // Slow path filter method for ids which will perform a full table scan.
   void FilterIntoIdSlow(FilterOp op, SqlValue value, RowMap* rm) const;
 
-  // Stable sorts this column storing the result in |out|.
+  // Writes the values at the indices |idxs| in the storage of this column to
+  // |values| (and whether they are null to |is_null| for nullable columns).
+  // |T| should match the type of this column.
+  template <typename T, typename V>
+  void GetNumericAtIdxs(const std::vector<uint32_t>& idxs,
+                        std::vector<V>* values,
+                        std::vector<uint8_t>* is_null) const;
+
+  // Stable sorts this column storing the result in |out|. Large sorts are
+  // split across |pool| if it is not null.
   template <bool desc>
-  void StableSort(std::vector<uint32_t>* out) const;
+  void StableSort(base::ThreadPool* pool, std::vector<uint32_t>* out) const;
 
   // Stable sorts this column storing the result in |out|.
   // |T| and |is_nullable| should match the type and nullability of this column.
   template <bool desc, typename T, bool is_nullable>
-  void StableSortNumeric(std::vector<uint32_t>* out) const;
+  void StableSortNumeric(base::ThreadPool* pool,
+                         std::vector<uint32_t>* out) const;
+
+  // Stable sorts this string column by radix sorting the rank of each string
+  // among the distinct strings of the column. Returns false, without touching
+  // |out|, if the distinct strings are not worth computing for this sort.
+  template <bool desc>
+  bool StableSortStringsByRank(base::ThreadPool* pool,
+                               std::vector<uint32_t>* out) const;
 
   template <typename T>
   static ColumnType ToColumnType() {
@@ -601,6 +714,10 @@ class Column {
   uint32_t col_idx_in_table_ = 0;
   uint32_t row_map_idx_ = 0;
   const StringPool* string_pool_ = nullptr;
+
+  // Only used by string columns; computed lazily and shared between the copies
+  // of the column as they are backed by the same storage.
+  mutable std::shared_ptr<const DistinctStrings> distinct_strings_;
 };
 
 }  // namespace trace_processor
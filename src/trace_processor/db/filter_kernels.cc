@@ -0,0 +1,413 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/filter_kernels.h"
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/db/compare.h"
+
+// The SIMD kernels are compiled with the target attribute so that they can be
+// built without changing the flags of the whole binary; which one is used is
+// then decided at runtime based on the CPU.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define PERFETTO_TP_X86_FILTER_KERNELS() 1
+#include <immintrin.h>
+#else
+#define PERFETTO_TP_X86_FILTER_KERNELS() 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+
+namespace {
+
+// All the filters are computed as one of three base comparisions, possibly
+// negated: for example, a <= b is computed as !(a > b). Together with the
+// comparisions below, this gives the same results as compare::Numeric for NaN
+// values.
+enum class BaseCmp {
+  kLt,
+  kGt,
+  kEq,
+};
+
+constexpr BaseCmp BaseCmpFor(FilterOp op) {
+  return op == FilterOp::kLt || op == FilterOp::kGe
+             ? BaseCmp::kLt
+             : (op == FilterOp::kGt || op == FilterOp::kLe ? BaseCmp::kGt
+                                                           : BaseCmp::kEq);
+}
+
+constexpr bool IsNegated(FilterOp op) {
+  return op == FilterOp::kGe || op == FilterOp::kLe || op == FilterOp::kNe;
+}
+
+template <FilterOp op>
+bool Matches(int cmp) {
+  switch (op) {
+    case FilterOp::kEq:
+      return cmp == 0;
+    case FilterOp::kNe:
+      return cmp != 0;
+    case FilterOp::kLt:
+      return cmp < 0;
+    case FilterOp::kGt:
+      return cmp > 0;
+    case FilterOp::kLe:
+      return cmp <= 0;
+    case FilterOp::kGe:
+      return cmp >= 0;
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      break;
+  }
+  PERFETTO_FATAL("Null checks and globs are not supported by filter kernels");
+}
+
+template <typename T, FilterOp op>
+uint64_t ScalarKernel(const T* data, uint32_t n, T value) {
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    bool res = Matches<op>(compare::Numeric(data[i], value));
+    word |= static_cast<uint64_t>(res) << i;
+  }
+  return word;
+}
+
+#if PERFETTO_TP_X86_FILTER_KERNELS()
+
+template <FilterOp op>
+__attribute__((target("sse4.2"))) uint64_t Int64Sse42Kernel(
+    const int64_t* data,
+    uint32_t n,
+    int64_t value) {
+  if (n != 64)
+    return ScalarKernel<int64_t, op>(data, n, value);
+
+  const __m128i v = _mm_set1_epi64x(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < 64; i += 2) {
+    __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i res;
+    switch (BaseCmpFor(op)) {
+      case BaseCmp::kLt:
+        res = _mm_cmpgt_epi64(v, d);
+        break;
+      case BaseCmp::kGt:
+        res = _mm_cmpgt_epi64(d, v);
+        break;
+      case BaseCmp::kEq:
+        res = _mm_cmpeq_epi64(d, v);
+        break;
+    }
+    uint32_t bits =
+        static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(res)));
+    word |= static_cast<uint64_t>(bits) << i;
+  }
+  return IsNegated(op) ? ~word : word;
+}
+
+template <FilterOp op>
+__attribute__((target("sse4.2"))) uint64_t DoubleSse42Kernel(
+    const double* data,
+    uint32_t n,
+    double value) {
+  if (n != 64)
+    return ScalarKernel<double, op>(data, n, value);
+
+  const __m128d v = _mm_set1_pd(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < 64; i += 2) {
+    __m128d d = _mm_loadu_pd(data + i);
+    __m128d res;
+    switch (BaseCmpFor(op)) {
+      case BaseCmp::kLt:
+        res = _mm_cmplt_pd(d, v);
+        break;
+      case BaseCmp::kGt:
+        res = _mm_cmpgt_pd(d, v);
+        break;
+      case BaseCmp::kEq:
+        // NaN compares equal to everything so we need an unordered compare.
+        res = _mm_or_pd(_mm_cmpeq_pd(d, v), _mm_cmpunord_pd(d, v));
+        break;
+    }
+    uint32_t bits = static_cast<uint32_t>(_mm_movemask_pd(res));
+    word |= static_cast<uint64_t>(bits) << i;
+  }
+  return IsNegated(op) ? ~word : word;
+}
+
+template <FilterOp op>
+__attribute__((target("avx2"))) uint64_t Int64Avx2Kernel(const int64_t* data,
+                                                          uint32_t n,
+                                                          int64_t value) {
+  if (n != 64)
+    return ScalarKernel<int64_t, op>(data, n, value);
+
+  const __m256i v = _mm256_set1_epi64x(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < 64; i += 4) {
+    __m256i d =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i res;
+    switch (BaseCmpFor(op)) {
+      case BaseCmp::kLt:
+        res = _mm256_cmpgt_epi64(v, d);
+        break;
+      case BaseCmp::kGt:
+        res = _mm256_cmpgt_epi64(d, v);
+        break;
+      case BaseCmp::kEq:
+        res = _mm256_cmpeq_epi64(d, v);
+        break;
+    }
+    uint32_t bits =
+        static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(res)));
+    word |= static_cast<uint64_t>(bits) << i;
+  }
+  return IsNegated(op) ? ~word : word;
+}
+
+template <FilterOp op>
+__attribute__((target("avx2"))) uint64_t DoubleAvx2Kernel(const double* data,
+                                                           uint32_t n,
+                                                           double value) {
+  if (n != 64)
+    return ScalarKernel<double, op>(data, n, value);
+
+  const __m256d v = _mm256_set1_pd(value);
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < 64; i += 4) {
+    __m256d d = _mm256_loadu_pd(data + i);
+    __m256d res;
+    switch (BaseCmpFor(op)) {
+      case BaseCmp::kLt:
+        res = _mm256_cmp_pd(d, v, _CMP_LT_OQ);
+        break;
+      case BaseCmp::kGt:
+        res = _mm256_cmp_pd(d, v, _CMP_GT_OQ);
+        break;
+      case BaseCmp::kEq:
+        // NaN compares equal to everything so we need an unordered compare.
+        res = _mm256_cmp_pd(d, v, _CMP_EQ_UQ);
+        break;
+    }
+    uint32_t bits = static_cast<uint32_t>(_mm256_movemask_pd(res));
+    word |= static_cast<uint64_t>(bits) << i;
+  }
+  return IsNegated(op) ? ~word : word;
+}
+
+#endif  // PERFETTO_TP_X86_FILTER_KERNELS()
+
+template <FilterOp op>
+Kernel<int64_t> GetInt64Kernel(Isa isa) {
+  switch (isa) {
+#if PERFETTO_TP_X86_FILTER_KERNELS()
+    case Isa::kAvx2:
+      return &Int64Avx2Kernel<op>;
+    case Isa::kSse42:
+      return &Int64Sse42Kernel<op>;
+#else
+    case Isa::kAvx2:
+    case Isa::kSse42:
+#endif
+    case Isa::kScalar:
+      return &ScalarKernel<int64_t, op>;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+template <FilterOp op>
+Kernel<double> GetDoubleKernel(Isa isa) {
+  switch (isa) {
+#if PERFETTO_TP_X86_FILTER_KERNELS()
+    case Isa::kAvx2:
+      return &DoubleAvx2Kernel<op>;
+    case Isa::kSse42:
+      return &DoubleSse42Kernel<op>;
+#else
+    case Isa::kAvx2:
+    case Isa::kSse42:
+#endif
+    case Isa::kScalar:
+      return &ScalarKernel<double, op>;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+}  // namespace
+
+bool IsSupported(Isa isa) {
+  switch (isa) {
+    case Isa::kScalar:
+      return true;
+#if PERFETTO_TP_X86_FILTER_KERNELS()
+    case Isa::kSse42:
+      return __builtin_cpu_supports("sse4.2");
+    case Isa::kAvx2:
+      return __builtin_cpu_supports("avx2");
+#else
+    case Isa::kSse42:
+    case Isa::kAvx2:
+      return false;
+#endif
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+Isa BestSupportedIsa() {
+  static const Isa isa = IsSupported(Isa::kAvx2)
+                             ? Isa::kAvx2
+                             : (IsSupported(Isa::kSse42) ? Isa::kSse42
+                                                         : Isa::kScalar);
+  return isa;
+}
+
+template <>
+Kernel<int64_t> GetKernel<int64_t>(FilterOp op, Isa isa) {
+  PERFETTO_DCHECK(IsSupported(isa));
+  switch (op) {
+    case FilterOp::kEq:
+      return GetInt64Kernel<FilterOp::kEq>(isa);
+    case FilterOp::kNe:
+      return GetInt64Kernel<FilterOp::kNe>(isa);
+    case FilterOp::kLt:
+      return GetInt64Kernel<FilterOp::kLt>(isa);
+    case FilterOp::kGt:
+      return GetInt64Kernel<FilterOp::kGt>(isa);
+    case FilterOp::kLe:
+      return GetInt64Kernel<FilterOp::kLe>(isa);
+    case FilterOp::kGe:
+      return GetInt64Kernel<FilterOp::kGe>(isa);
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      break;
+  }
+  PERFETTO_FATAL("Null checks and globs are not supported by filter kernels");
+}
+
+template <>
+Kernel<double> GetKernel<double>(FilterOp op, Isa isa) {
+  PERFETTO_DCHECK(IsSupported(isa));
+  switch (op) {
+    case FilterOp::kEq:
+      return GetDoubleKernel<FilterOp::kEq>(isa);
+    case FilterOp::kNe:
+      return GetDoubleKernel<FilterOp::kNe>(isa);
+    case FilterOp::kLt:
+      return GetDoubleKernel<FilterOp::kLt>(isa);
+    case FilterOp::kGt:
+      return GetDoubleKernel<FilterOp::kGt>(isa);
+    case FilterOp::kLe:
+      return GetDoubleKernel<FilterOp::kLe>(isa);
+    case FilterOp::kGe:
+      return GetDoubleKernel<FilterOp::kGe>(isa);
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      break;
+  }
+  PERFETTO_FATAL("Null checks and globs are not supported by filter kernels");
+}
+
+CompressedFilter::CompressedFilter(const CompressedIntVector& cv,
+                                   FilterOp op,
+                                   int64_t value)
+    : cv_(cv), op_(op), value_(value), kernel_(GetKernel<int64_t>(op)) {}
+
+uint64_t CompressedFilter::Filter(uint32_t start, uint32_t n) const {
+  PERFETTO_DCHECK(n <= 64);
+  int64_t values[64];
+  if (cv_.encoding() != CompressedIntVector::Encoding::kDeltaBitPacked) {
+    cv_.Decode(start, n, values);
+    return kernel_(values, n, value_);
+  }
+
+  // The range may overlap two blocks: each part is either resolved from the
+  // bounds of its block or decoded and compared.
+  static constexpr uint32_t kBlockSize = CompressedIntVector::kBlockSize;
+  uint64_t word = 0;
+  for (uint32_t i = 0; i < n;) {
+    uint32_t row = start + i;
+    uint32_t block = row / kBlockSize;
+    uint32_t len = std::min(n - i, (block + 1) * kBlockSize - row);
+    uint64_t mask = len == 64 ? ~0ull : (1ull << len) - 1;
+    switch (MatchBlock(block)) {
+      case BlockMatch::kAll:
+        word |= mask << i;
+        break;
+      case BlockMatch::kNone:
+        break;
+      case BlockMatch::kSome:
+        cv_.Decode(row, len, values);
+        word |= (kernel_(values, len, value_) & mask) << i;
+        break;
+    }
+    i += len;
+  }
+  return word;
+}
+
+CompressedFilter::BlockMatch CompressedFilter::MatchBlock(
+    uint32_t block) const {
+  // The values of a block are sorted so they are all in [first, last].
+  int64_t first = cv_.BlockFirst(block);
+  int64_t last = cv_.BlockLast(block);
+  switch (op_) {
+    case FilterOp::kEq:
+    case FilterOp::kNe: {
+      bool none_eq = value_ < first || value_ > last;
+      bool all_eq = first == value_ && last == value_;
+      if (none_eq || all_eq) {
+        return all_eq == (op_ == FilterOp::kEq) ? BlockMatch::kAll
+                                                : BlockMatch::kNone;
+      }
+      return BlockMatch::kSome;
+    }
+    case FilterOp::kLt:
+      if (last < value_)
+        return BlockMatch::kAll;
+      return first >= value_ ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kLe:
+      if (last <= value_)
+        return BlockMatch::kAll;
+      return first > value_ ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kGt:
+      if (first > value_)
+        return BlockMatch::kAll;
+      return last <= value_ ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kGe:
+      if (first >= value_)
+        return BlockMatch::kAll;
+      return last < value_ ? BlockMatch::kNone : BlockMatch::kSome;
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      break;
+  }
+  return BlockMatch::kSome;
+}
+
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
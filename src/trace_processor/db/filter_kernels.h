@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_FILTER_KERNELS_H_
+#define SRC_TRACE_PROCESSOR_DB_FILTER_KERNELS_H_
+
+#include <stdint.h>
+
+#include "src/trace_processor/containers/compressed_int_vector.h"
+#include "src/trace_processor/db/column.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+
+// This file contains kernels which filter blocks of contiguous numeric values
+// against a constant, producing one bit per value. They are used when
+// filtering dense columns as they allow the comparisions to be vectorized and
+// the result to be written directly into the words of a BitVector.
+//
+// The results always match the comparisions in compare.h (i.e. NaN compares
+// equal to every value).
+
+// The instruction sets the kernels are implemented for. The kernels for SSE4.2
+// and AVX2 are only available on x86-64 and are selected at runtime depending
+// on the CPU.
+enum class Isa {
+  kScalar,
+  kSse42,
+  kAvx2,
+};
+
+// Compares the |n| (at most 64) consecutive values starting at |data| with
+// |value|: bit i of the returned word is set if |data[i]| matches the filter.
+// The bits from |n| upwards are unspecified.
+template <typename T>
+using Kernel = uint64_t (*)(const T* data, uint32_t n, T value);
+
+// Returns whether the kernels for |isa| can run on this CPU.
+bool IsSupported(Isa isa);
+
+// Returns the most efficient instruction set supported by this CPU.
+Isa BestSupportedIsa();
+
+// Returns the kernel comparing values using |op| (which cannot be a null
+// check or a glob) implemented with the instructions of |isa| (which must be
+// supported). Only int64_t and double values are supported.
+template <typename T>
+Kernel<T> GetKernel(FilterOp op, Isa isa);
+
+template <>
+Kernel<int64_t> GetKernel<int64_t>(FilterOp op, Isa isa);
+
+template <>
+Kernel<double> GetKernel<double>(FilterOp op, Isa isa);
+
+template <typename T>
+Kernel<T> GetKernel(FilterOp op) {
+  return GetKernel<T>(op, BestSupportedIsa());
+}
+
+// Filters the values of a CompressedIntVector in the same way as the kernels
+// above, decoding them on the fly into a buffer of 64 values which is then
+// passed to the int64_t kernel. For kDeltaBitPacked vectors, the values of a
+// block whose first and last values show that all of them or none of them
+// match are not decoded at all.
+class CompressedFilter {
+ public:
+  // |op| has the same restrictions as for GetKernel.
+  CompressedFilter(const CompressedIntVector& cv, FilterOp op, int64_t value);
+
+  // Compares the |n| (at most 64) values starting at |start| with the value:
+  // bit i of the returned word is set if the value at |start + i| matches.
+  // The bits from |n| upwards are unspecified.
+  uint64_t Filter(uint32_t start, uint32_t n) const;
+
+ private:
+  enum class BlockMatch {
+    kAll,
+    kNone,
+    kSome,
+  };
+
+  BlockMatch MatchBlock(uint32_t block) const;
+
+  const CompressedIntVector& cv_;
+  FilterOp op_;
+  int64_t value_;
+  Kernel<int64_t> kernel_;
+};
+
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_FILTER_KERNELS_H_
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/filter_kernels.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "src/trace_processor/db/compare.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace filter_kernels {
+namespace {
+
+constexpr FilterOp kOps[] = {FilterOp::kEq, FilterOp::kNe, FilterOp::kLt,
+                             FilterOp::kGt, FilterOp::kLe, FilterOp::kGe};
+constexpr Isa kIsas[] = {Isa::kScalar, Isa::kSse42, Isa::kAvx2};
+
+bool Matches(FilterOp op, int cmp) {
+  switch (op) {
+    case FilterOp::kEq:
+      return cmp == 0;
+    case FilterOp::kNe:
+      return cmp != 0;
+    case FilterOp::kLt:
+      return cmp < 0;
+    case FilterOp::kGt:
+      return cmp > 0;
+    case FilterOp::kLe:
+      return cmp <= 0;
+    case FilterOp::kGe:
+      return cmp >= 0;
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      break;
+  }
+  PERFETTO_FATAL("Unexpected op");
+}
+
+// Checks that the kernels for all the ops and instruction sets give the same
+// result as compare::Numeric for every prefix of |data| and every |values|.
+template <typename T>
+void CheckKernels(const std::vector<T>& data, const std::vector<T>& values) {
+  ASSERT_EQ(data.size(), 64u);
+  for (Isa isa : kIsas) {
+    if (!IsSupported(isa))
+      continue;
+    for (FilterOp op : kOps) {
+      Kernel<T> kernel = GetKernel<T>(op, isa);
+      for (T value : values) {
+        for (uint32_t n : {1u, 5u, 63u, 64u}) {
+          uint64_t word = kernel(data.data(), n, value);
+          for (uint32_t i = 0; i < n; ++i) {
+            bool expected = Matches(op, compare::Numeric(data[i], value));
+            ASSERT_EQ((word >> i) & 1u, expected)
+                << "isa " << static_cast<int>(isa) << ", op "
+                << static_cast<int>(op) << ", n " << n << ", idx " << i;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(FilterKernelsTest, ScalarAlwaysSupported) {
+  ASSERT_TRUE(IsSupported(Isa::kScalar));
+  ASSERT_TRUE(IsSupported(BestSupportedIsa()));
+}
+
+TEST(FilterKernelsTest, Int64) {
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<int64_t> data;
+  for (uint32_t i = 0; i < 64; ++i) {
+    data.push_back(static_cast<int64_t>(rnd_engine() % 16) - 8);
+  }
+  data[3] = std::numeric_limits<int64_t>::max();
+  data[17] = std::numeric_limits<int64_t>::min();
+  CheckKernels<int64_t>(data, {-8, -1, 0, 3, 7, 100,
+                               std::numeric_limits<int64_t>::max(),
+                               std::numeric_limits<int64_t>::min()});
+}
+
+TEST(FilterKernelsTest, Double) {
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<double> data;
+  for (uint32_t i = 0; i < 64; ++i) {
+    data.push_back(static_cast<double>(rnd_engine() % 16) / 2 - 4);
+  }
+  data[5] = std::numeric_limits<double>::quiet_NaN();
+  data[40] = -0.0;
+  data[62] = std::numeric_limits<double>::infinity();
+  CheckKernels<double>(data, {-4.0, -0.5, 0.0, 1.5, 3.5, 10.0,
+                              std::numeric_limits<double>::quiet_NaN(),
+                              -std::numeric_limits<double>::infinity()});
+}
+
+TEST(FilterKernelsTest, Compressed) {
+  // Sorted values with runs of equal values, so that some blocks of the delta
+  // encoding are fully resolved from their bounds and some are decoded.
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<int64_t> data;
+  int64_t value = 1000;
+  for (uint32_t i = 0; i < 500; ++i) {
+    if (i < 128 || i > 300)
+      value += static_cast<int64_t>(rnd_engine() % 3);
+    data.push_back(value);
+  }
+  std::vector<int64_t> values = {0, data[0], data[10], data[200], data[350],
+                                 data[499], 100000};
+
+  std::vector<CompressedIntVector> cvs;
+  cvs.emplace_back(CompressedIntVector::BitPack(data.data(), 500));
+  cvs.emplace_back(CompressedIntVector::DeltaBitPack(data.data(), 500));
+  for (const CompressedIntVector& cv : cvs) {
+    for (FilterOp op : kOps) {
+      for (int64_t v : values) {
+        CompressedFilter filter(cv, op, v);
+        // Unaligned ranges overlap two blocks of the delta encoding.
+        for (uint32_t start = 0; start < 500; start += 50) {
+          uint32_t n = std::min(64u, 500 - start);
+          uint64_t word = filter.Filter(start, n);
+          for (uint32_t i = 0; i < n; ++i) {
+            bool expected = Matches(op, compare::Numeric(data[start + i], v));
+            ASSERT_EQ((word >> i) & 1u, expected)
+                << "encoding " << static_cast<int>(cv.encoding()) << ", op "
+                << static_cast<int>(op) << ", idx " << start + i;
+          }
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace filter_kernels
+}  // namespace trace_processor
+}  // namespace perfetto
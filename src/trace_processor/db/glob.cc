@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/glob.h"
+
+#include <stdint.h>
+
+namespace perfetto {
+namespace trace_processor {
+namespace glob {
+
+namespace {
+
+// Reads the UTF-8 code point starting at |*it| and advances |*it| past it.
+// This matches the behaviour of sqlite3Utf8Read: bytes which do not start a
+// multi-byte sequence are returned as is and invalid sequences are decoded as
+// U+FFFD.
+uint32_t ReadCodePoint(const char** it) {
+  uint32_t c = static_cast<uint8_t>(*(*it)++);
+  if (c < 0xc0)
+    return c;
+
+  // Only keep the bits of the leading byte which are not part of the length
+  // prefix.
+  if (c < 0xe0) {
+    c &= 0x1f;
+  } else if (c < 0xf0) {
+    c &= 0x0f;
+  } else if (c < 0xf8) {
+    c &= 0x07;
+  } else if (c < 0xfc) {
+    c &= 0x03;
+  } else if (c < 0xfe) {
+    c &= 0x01;
+  } else {
+    c = 0;
+  }
+  for (; (static_cast<uint8_t>(**it) & 0xc0) == 0x80; ++*it) {
+    c = (c << 6) + (static_cast<uint8_t>(**it) & 0x3f);
+  }
+  if (c < 0x80 || (c & 0xfffff800) == 0xd800 || (c & 0xfffffffe) == 0xfffe)
+    return 0xfffd;
+  return c;
+}
+
+// Same as ReadCodePoint but returns 0 without advancing at the end of the
+// string.
+uint32_t ReadPatternCodePoint(const char** it) {
+  return **it ? ReadCodePoint(it) : 0;
+}
+
+// Returns whether |c| is part of the set starting at |*pattern| (just after
+// the opening '[') and advances |*pattern| past the closing ']'. Sets which are
+// not closed never match.
+bool MatchSet(const char** pattern, uint32_t c) {
+  bool seen = false;
+  bool invert = false;
+  uint32_t pc = ReadPatternCodePoint(pattern);
+  if (pc == '^') {
+    invert = true;
+    pc = ReadPatternCodePoint(pattern);
+  }
+  if (pc == ']') {
+    seen = c == ']';
+    pc = ReadPatternCodePoint(pattern);
+  }
+
+  uint32_t prior = 0;
+  while (pc != 0 && pc != ']') {
+    char next = **pattern;
+    if (pc == '-' && next != ']' && next != 0 && prior > 0) {
+      pc = ReadPatternCodePoint(pattern);
+      seen |= c >= prior && c <= pc;
+      prior = 0;
+    } else {
+      seen |= c == pc;
+      prior = pc;
+    }
+    pc = ReadPatternCodePoint(pattern);
+  }
+  return pc == ']' && seen != invert;
+}
+
+// Matches the element of the pattern starting at |*pattern| (which cannot be
+// '*') with the (non-empty) string starting at |*str|, advancing both past the
+// element.
+bool MatchOne(const char** pattern, const char** str) {
+  uint32_t pc = ReadCodePoint(pattern);
+  uint32_t c = ReadCodePoint(str);
+  if (pc == '?')
+    return true;
+  if (pc == '[')
+    return MatchSet(pattern, c);
+  return pc == c;
+}
+
+}  // namespace
+
+bool Matches(const char* pattern, const char* str) {
+  // Every element other than '*' matches exactly one character so it's enough
+  // to backtrack to the last '*' seen when the match fails, letting it consume
+  // one more character each time. This keeps matching linear in the length
+  // of the pattern times the length of the string.
+  const char* star_pattern = nullptr;
+  const char* star_str = nullptr;
+  while (*str) {
+    if (*pattern == '*') {
+      star_pattern = ++pattern;
+      star_str = str;
+      continue;
+    }
+
+    const char* next_pattern = pattern;
+    const char* next_str = str;
+    if (*pattern && MatchOne(&next_pattern, &next_str)) {
+      pattern = next_pattern;
+      str = next_str;
+      continue;
+    }
+
+    if (!star_pattern)
+      return false;
+    ReadCodePoint(&star_str);
+    pattern = star_pattern;
+    str = star_str;
+  }
+  while (*pattern == '*')
+    ++pattern;
+  return *pattern == '\0';
+}
+
+}  // namespace glob
+}  // namespace trace_processor
+}  // namespace perfetto
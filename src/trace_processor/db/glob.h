@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_GLOB_H_
+#define SRC_TRACE_PROCESSOR_DB_GLOB_H_
+
+namespace perfetto {
+namespace trace_processor {
+namespace glob {
+
+// Returns whether the null terminated string |str| matches the glob |pattern|.
+//
+// This matches the behaviour of the GLOB operator in SQLite (i.e.
+// sqlite3_strglob) so that GLOB constraints can be computed without depending
+// on SQLite:
+//  * '*' matches any sequence of characters (including the empty one).
+//  * '?' matches exactly one character.
+//  * '[...]' matches one character in the set; the set can contain ranges
+//    (e.g. "a-z"), is inverted if it starts with '^' and a ']' directly after
+//    the opening bracket (or '^') is part of the set.
+//  * Every other character matches itself; matching is case sensitive.
+// Characters are UTF-8 code points rather than bytes.
+bool Matches(const char* pattern, const char* str);
+
+}  // namespace glob
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_GLOB_H_
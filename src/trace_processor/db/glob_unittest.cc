@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/glob.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace glob {
+namespace {
+
+TEST(GlobTest, Literal) {
+  ASSERT_TRUE(Matches("", ""));
+  ASSERT_TRUE(Matches("abc", "abc"));
+  ASSERT_FALSE(Matches("abc", "ab"));
+  ASSERT_FALSE(Matches("ab", "abc"));
+  ASSERT_FALSE(Matches("abc", "ABC"));
+}
+
+TEST(GlobTest, Star) {
+  ASSERT_TRUE(Matches("*", ""));
+  ASSERT_TRUE(Matches("*", "abc"));
+  ASSERT_TRUE(Matches("binder*", "binder transaction"));
+  ASSERT_FALSE(Matches("binder*", "binde"));
+  ASSERT_TRUE(Matches("*reply", "binder reply"));
+  ASSERT_TRUE(Matches("a*b*c", "aXbYbZc"));
+  ASSERT_FALSE(Matches("a*b*c", "aXbYbZ"));
+  ASSERT_TRUE(Matches("a**c", "abc"));
+}
+
+TEST(GlobTest, QuestionMark) {
+  ASSERT_TRUE(Matches("?", "a"));
+  ASSERT_FALSE(Matches("?", ""));
+  ASSERT_FALSE(Matches("?", "ab"));
+  ASSERT_TRUE(Matches("a?c", "abc"));
+  ASSERT_FALSE(Matches("*?", ""));
+  ASSERT_TRUE(Matches("*?", "a"));
+
+  // Multi-byte characters are matched as a whole.
+  ASSERT_TRUE(Matches("?", "\xc3\xa9"));
+  ASSERT_TRUE(Matches("caf?", "caf\xc3\xa9"));
+}
+
+TEST(GlobTest, Set) {
+  ASSERT_TRUE(Matches("[abc]", "b"));
+  ASSERT_FALSE(Matches("[abc]", "d"));
+  ASSERT_TRUE(Matches("[a-c]x", "bx"));
+  ASSERT_FALSE(Matches("[a-c]x", "dx"));
+  ASSERT_TRUE(Matches("[^a-c]", "d"));
+  ASSERT_FALSE(Matches("[^a-c]", "a"));
+
+  // ']' is part of the set if it comes first and '-' if it is at either end.
+  ASSERT_TRUE(Matches("[]a]", "]"));
+  ASSERT_TRUE(Matches("[^]a]", "b"));
+  ASSERT_FALSE(Matches("[^]a]", "]"));
+  ASSERT_TRUE(Matches("[a-]", "-"));
+  ASSERT_TRUE(Matches("[-a]", "-"));
+
+  // Sets which are not closed never match.
+  ASSERT_FALSE(Matches("[abc", "a"));
+  ASSERT_FALSE(Matches("*[abc", "a"));
+}
+
+TEST(GlobTest, SpecialCharactersInString) {
+  ASSERT_TRUE(Matches("a[*]b", "a*b"));
+  ASSERT_FALSE(Matches("a[*]b", "axb"));
+  ASSERT_TRUE(Matches("a[?]", "a?"));
+  ASSERT_TRUE(Matches("[[]", "["));
+}
+
+}  // namespace
+}  // namespace glob
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/group_by.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Number of rows of a column which are read at once.
+constexpr uint32_t kBatchSize = 1024;
+
+constexpr uint32_t kEmptySlot = std::numeric_limits<uint32_t>::max();
+
+// Reads the rows [start_row, end_row) of |col| as 64 bit keys which are equal
+// iff the values are equal. |is_null| is set for the null values.
+void GetKeys(const Column& col,
+             uint32_t start_row,
+             uint32_t end_row,
+             Column::Rows* rows,
+             uint64_t* keys,
+             uint8_t* is_null) {
+  col.GetRows(start_row, end_row, rows);
+
+  uint32_t size = end_row - start_row;
+  switch (rows->type) {
+    case SqlValue::Type::kLong:
+      for (uint32_t i = 0; i < size; ++i)
+        keys[i] = static_cast<uint64_t>(rows->longs[i]);
+      break;
+    case SqlValue::Type::kDouble:
+      for (uint32_t i = 0; i < size; ++i) {
+        // -0.0 == 0.0 but they have different bit patterns.
+        double value = rows->doubles[i] == 0 ? 0 : rows->doubles[i];
+        memcpy(&keys[i], &value, sizeof(value));
+      }
+      break;
+    case SqlValue::Type::kString:
+      // Strings are interned so equal strings have equal pointers.
+      for (uint32_t i = 0; i < size; ++i)
+        keys[i] = reinterpret_cast<uintptr_t>(rows->strings[i]);
+      break;
+    case SqlValue::Type::kNull:
+    case SqlValue::Type::kBytes:
+      PERFETTO_FATAL("Unsupported key type");
+  }
+
+  if (rows->is_null.empty()) {
+    for (uint32_t i = 0; i < size; ++i)
+      is_null[i] = rows->type == SqlValue::Type::kString && !keys[i];
+  } else {
+    memcpy(is_null, rows->is_null.data(), size);
+  }
+}
+
+// Hash table from the values of the key columns to the group having these
+// values. It uses open addressing with linear probing: each slot stores the
+// index of a group and the keys are stored per group.
+class GroupHashTable {
+ public:
+  explicit GroupHashTable(uint32_t num_keys)
+      : num_keys_(num_keys), slots_(kInitialSlots, kEmptySlot) {}
+
+  // Returns the group with the given |keys| and |nulls| (a bitmask of the
+  // keys which are null), creating it if it does not exist yet.
+  uint32_t FindOrInsert(const uint64_t* keys, uint64_t nulls, bool* inserted) {
+    uint64_t hash = Hash(keys, nulls);
+    uint32_t mask = static_cast<uint32_t>(slots_.size() - 1);
+    for (uint32_t slot = static_cast<uint32_t>(hash) & mask;;
+         slot = (slot + 1) & mask) {
+      uint32_t group = slots_[slot];
+      if (group == kEmptySlot) {
+        group = static_cast<uint32_t>(group_hashes_.size());
+        slots_[slot] = group;
+        group_hashes_.push_back(hash);
+        group_nulls_.push_back(nulls);
+        group_keys_.insert(group_keys_.end(), keys, keys + num_keys_);
+        *inserted = true;
+        if (group_hashes_.size() * 2 > slots_.size())
+          Grow();
+        return group;
+      }
+      if (group_hashes_[group] == hash && group_nulls_[group] == nulls &&
+          std::equal(keys, keys + num_keys_,
+                     group_keys_.begin() + group * num_keys_)) {
+        *inserted = false;
+        return group;
+      }
+    }
+  }
+
+ private:
+  static constexpr uint32_t kInitialSlots = 1024;
+
+  uint64_t Hash(const uint64_t* keys, uint64_t nulls) const {
+    uint64_t hash = nulls;
+    for (uint32_t i = 0; i < num_keys_; ++i)
+      hash = (hash ^ keys[i]) * 0x9E3779B97F4A7C15ull;
+    // Fold the high bits, which are the best mixed, into the low bits used to
+    // pick the slot.
+    return hash ^ (hash >> 32);
+  }
+
+  void Grow() {
+    slots_.assign(slots_.size() * 2, kEmptySlot);
+    uint32_t mask = static_cast<uint32_t>(slots_.size() - 1);
+    for (uint32_t group = 0; group < group_hashes_.size(); ++group) {
+      uint32_t slot = static_cast<uint32_t>(group_hashes_[group]) & mask;
+      while (slots_[slot] != kEmptySlot)
+        slot = (slot + 1) & mask;
+      slots_[slot] = group;
+    }
+  }
+
+  uint32_t num_keys_ = 0;
+  std::vector<uint32_t> slots_;
+
+  std::vector<uint64_t> group_hashes_;
+  std::vector<uint64_t> group_nulls_;
+  std::vector<uint64_t> group_keys_;
+};
+
+// static
+constexpr uint32_t GroupHashTable::kInitialSlots;
+
+void GroupSortedRows(const Column& key,
+                     uint32_t row_count,
+                     std::vector<uint32_t>* row_groups,
+                     std::vector<uint32_t>* group_first_rows) {
+  Column::Rows rows;
+  uint64_t keys[kBatchSize];
+  uint8_t is_null[kBatchSize];
+  uint64_t prev_key = 0;
+  uint8_t prev_is_null = 0;
+  uint32_t group = 0;
+  for (uint32_t start = 0; start < row_count; start += kBatchSize) {
+    uint32_t end = std::min(start + kBatchSize, row_count);
+    GetKeys(key, start, end, &rows, keys, is_null);
+    for (uint32_t i = 0; i < end - start; ++i) {
+      uint32_t row = start + i;
+      if (row == 0 || keys[i] != prev_key || is_null[i] != prev_is_null) {
+        group = static_cast<uint32_t>(group_first_rows->size());
+        group_first_rows->push_back(row);
+        prev_key = keys[i];
+        prev_is_null = is_null[i];
+      }
+      (*row_groups)[row] = group;
+    }
+  }
+}
+
+// Returns the values of type V of |rows|.
+const std::vector<int64_t>& Values(const Column::Rows& rows, int64_t*) {
+  return rows.longs;
+}
+const std::vector<double>& Values(const Column::Rows& rows, double*) {
+  return rows.doubles;
+}
+
+// Integer sums wrap around on overflow rather than being undefined.
+int64_t Add(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) +
+                              static_cast<uint64_t>(b));
+}
+double Add(double a, double b) {
+  return a + b;
+}
+
+// Calls |fn(row, i)| for each row of |col| which is not null, |i| being the
+// index of the row in |rows|.
+template <typename Fn>
+void ForEachNonNull(const Column& col, Column::Rows* rows, Fn fn) {
+  uint32_t row_count = col.row_map().size();
+  for (uint32_t start = 0; start < row_count; start += kBatchSize) {
+    uint32_t end = std::min(start + kBatchSize, row_count);
+    col.GetRows(start, end, rows);
+    for (uint32_t i = 0; i < end - start; ++i) {
+      bool is_null = rows->type == SqlValue::Type::kString
+                         ? !rows->strings[i]
+                         : !rows->is_null.empty() && rows->is_null[i];
+      if (!is_null)
+        fn(start + i, i);
+    }
+  }
+}
+
+template <typename V>
+void ComputeNumericAggregate(const Column& col,
+                             Aggregate::Op op,
+                             const std::vector<uint32_t>& row_groups,
+                             uint32_t num_groups,
+                             std::vector<V>* values,
+                             std::vector<uint8_t>* is_null) {
+  values->assign(num_groups, V());
+  std::vector<uint32_t> counts(num_groups, 0);
+  Column::Rows rows;
+  ForEachNonNull(col, &rows, [&](uint32_t row, uint32_t i) {
+    uint32_t group = row_groups[row];
+    V value = Values(rows, static_cast<V*>(nullptr))[i];
+    V& acc = (*values)[group];
+    switch (op) {
+      case Aggregate::Op::kSum:
+        acc = Add(acc, value);
+        break;
+      case Aggregate::Op::kMin:
+        acc = counts[group] == 0 ? value : std::min(acc, value);
+        break;
+      case Aggregate::Op::kMax:
+        acc = counts[group] == 0 ? value : std::max(acc, value);
+        break;
+      case Aggregate::Op::kCount:
+      case Aggregate::Op::kAvg:
+        PERFETTO_FATAL("Not handled here");
+    }
+    counts[group]++;
+  });
+
+  is_null->clear();
+  for (uint32_t group = 0; group < num_groups; ++group) {
+    if (counts[group] > 0)
+      continue;
+    is_null->resize(num_groups, 0);
+    (*is_null)[group] = 1;
+  }
+}
+
+}  // namespace
+
+void GroupRows(const std::vector<const Column*>& keys,
+               uint32_t row_count,
+               std::vector<uint32_t>* row_groups,
+               std::vector<uint32_t>* group_first_rows) {
+  row_groups->resize(row_count);
+  group_first_rows->clear();
+
+  // Without keys, all the rows are part of a single group.
+  if (keys.empty()) {
+    std::fill(row_groups->begin(), row_groups->end(), 0);
+    if (row_count > 0)
+      group_first_rows->push_back(0);
+    return;
+  }
+
+  if (keys.size() == 1 && keys[0]->IsSorted()) {
+    GroupSortedRows(*keys[0], row_count, row_groups, group_first_rows);
+    return;
+  }
+
+  // The nulls of a row are stored as a bitmask.
+  PERFETTO_CHECK(keys.size() <= 64);
+  uint32_t num_keys = static_cast<uint32_t>(keys.size());
+
+  GroupHashTable hash_table(num_keys);
+  Column::Rows rows;
+  std::vector<uint64_t> batch_keys(kBatchSize * num_keys);
+  std::vector<uint8_t> batch_nulls(kBatchSize * num_keys);
+  std::vector<uint64_t> row_keys(num_keys);
+  for (uint32_t start = 0; start < row_count; start += kBatchSize) {
+    uint32_t end = std::min(start + kBatchSize, row_count);
+    for (uint32_t k = 0; k < num_keys; ++k) {
+      GetKeys(*keys[k], start, end, &rows, &batch_keys[k * kBatchSize],
+              &batch_nulls[k * kBatchSize]);
+    }
+    for (uint32_t i = 0; i < end - start; ++i) {
+      uint64_t nulls = 0;
+      for (uint32_t k = 0; k < num_keys; ++k) {
+        row_keys[k] = batch_keys[k * kBatchSize + i];
+        nulls |= static_cast<uint64_t>(batch_nulls[k * kBatchSize + i]) << k;
+      }
+      bool inserted;
+      uint32_t group = hash_table.FindOrInsert(row_keys.data(), nulls,
+                                               &inserted);
+      if (inserted)
+        group_first_rows->push_back(start + i);
+      (*row_groups)[start + i] = group;
+    }
+  }
+}
+
+void ComputeAggregate(const Column* col,
+                      Aggregate::Op op,
+                      const std::vector<uint32_t>& row_groups,
+                      uint32_t num_groups,
+                      AggregateValues* out) {
+  out->is_null.clear();
+  Column::Rows rows;
+  switch (op) {
+    case Aggregate::Op::kCount: {
+      out->type = SqlValue::Type::kLong;
+      out->longs.assign(num_groups, 0);
+      if (!col) {
+        for (uint32_t group : row_groups)
+          out->longs[group]++;
+        break;
+      }
+      ForEachNonNull(*col, &rows, [&](uint32_t row, uint32_t) {
+        out->longs[row_groups[row]]++;
+      });
+      break;
+    }
+    case Aggregate::Op::kAvg: {
+      PERFETTO_CHECK(col && col->type() != SqlValue::Type::kString);
+      out->type = SqlValue::Type::kDouble;
+      out->doubles.assign(num_groups, 0);
+      std::vector<uint32_t> counts(num_groups, 0);
+      ForEachNonNull(*col, &rows, [&](uint32_t row, uint32_t i) {
+        uint32_t group = row_groups[row];
+        out->doubles[group] += rows.type == SqlValue::Type::kDouble
+                                   ? rows.doubles[i]
+                                   : static_cast<double>(rows.longs[i]);
+        counts[group]++;
+      });
+      for (uint32_t group = 0; group < num_groups; ++group) {
+        if (counts[group] > 0) {
+          out->doubles[group] /= counts[group];
+          continue;
+        }
+        out->is_null.resize(num_groups, 0);
+        out->is_null[group] = 1;
+      }
+      break;
+    }
+    case Aggregate::Op::kSum:
+    case Aggregate::Op::kMin:
+    case Aggregate::Op::kMax:
+      PERFETTO_CHECK(col && col->type() != SqlValue::Type::kString);
+      out->type = col->type();
+      if (out->type == SqlValue::Type::kDouble) {
+        ComputeNumericAggregate(*col, op, row_groups, num_groups,
+                                &out->doubles, &out->is_null);
+      } else {
+        ComputeNumericAggregate(*col, op, row_groups, num_groups, &out->longs,
+                                &out->is_null);
+      }
+      break;
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_GROUP_BY_H_
+#define SRC_TRACE_PROCESSOR_DB_GROUP_BY_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/db/column.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Splits the |row_count| rows of the table containing the |keys| columns into
+// groups of rows having the same values for all the |keys|; as in SQL, nulls
+// are grouped together.
+//
+// |row_groups| is filled with the group of each row and |group_first_rows|
+// with the first row of each group. Groups are numbered in the order of their
+// first row.
+//
+// When grouping by a single sorted column, groups are runs of consecutive rows
+// so are found without hashing.
+void GroupRows(const std::vector<const Column*>& keys,
+               uint32_t row_count,
+               std::vector<uint32_t>* row_groups,
+               std::vector<uint32_t>* group_first_rows);
+
+// The values of an aggregate for each group.
+struct AggregateValues {
+  SqlValue::Type type = SqlValue::Type::kLong;
+  std::vector<int64_t> longs;
+  std::vector<double> doubles;
+
+  // Empty if none of the values are null.
+  std::vector<uint8_t> is_null;
+};
+
+// Computes the aggregate |op| of |col| (which can be nullptr for kCount) for
+// each of the |num_groups| groups, |row_groups| being the group of each row
+// as returned by GroupRows.
+//
+// The types of the values follow SQLite: counts are longs, sums and min/max
+// have the type of |col| and averages are doubles. All but counts are null
+// for groups without any non-null value. |col| must be numeric unless |op| is
+// kCount.
+void ComputeAggregate(const Column* col,
+                      Aggregate::Op op,
+                      const std::vector<uint32_t>& row_groups,
+                      uint32_t num_groups,
+                      AggregateValues* out);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_GROUP_BY_H_
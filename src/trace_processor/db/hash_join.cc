@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/hash_join.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "src/trace_processor/db/column.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Number of rows of a column which are converted to keys at once.
+constexpr uint32_t kBatchSize = 1024;
+
+// The representation of the values of both columns used as keys of the hash
+// table.
+enum class KeyType {
+  kLong,
+  kDouble,
+  kString,
+};
+
+// Returns the 64 bit key for |value| such that two doubles have the same key
+// iff they compare equal.
+uint64_t DoubleKey(double value) {
+  // -0.0 == 0.0 but they have different bit patterns.
+  if (value == 0)
+    value = 0;
+  uint64_t key;
+  memcpy(&key, &value, sizeof(key));
+  return key;
+}
+
+// Converts the rows [start_row, end_row) of |col| to keys. |valid[i]| is set
+// to 0 for the rows which can never match anything (nulls and NaNs).
+void GetKeys(const Column& col,
+             KeyType key_type,
+             uint32_t start_row,
+             uint32_t end_row,
+             Column::Rows* rows,
+             std::vector<uint64_t>* keys,
+             std::vector<uint8_t>* valid) {
+  col.GetRows(start_row, end_row, rows);
+
+  uint32_t size = end_row - start_row;
+  keys->resize(size);
+  valid->assign(size, 1);
+  if (!rows->is_null.empty()) {
+    for (uint32_t i = 0; i < size; ++i)
+      (*valid)[i] = !rows->is_null[i];
+  }
+
+  switch (key_type) {
+    case KeyType::kLong:
+      for (uint32_t i = 0; i < size; ++i)
+        (*keys)[i] = static_cast<uint64_t>(rows->longs[i]);
+      break;
+    case KeyType::kDouble:
+      for (uint32_t i = 0; i < size; ++i) {
+        double value = rows->type == SqlValue::Type::kDouble
+                           ? rows->doubles[i]
+                           : static_cast<double>(rows->longs[i]);
+        (*keys)[i] = DoubleKey(value);
+        if (std::isnan(value))
+          (*valid)[i] = 0;
+      }
+      break;
+    case KeyType::kString:
+      // Strings are interned so equal strings have equal pointers.
+      for (uint32_t i = 0; i < size; ++i) {
+        (*keys)[i] = reinterpret_cast<uintptr_t>(rows->strings[i]);
+        if (!rows->strings[i])
+          (*valid)[i] = 0;
+      }
+      break;
+  }
+}
+
+// Hash table from key to the rows of the build side with that key.
+//
+// The entries are stored grouped by bucket in a single vector (like a CSR
+// matrix) rather than chained: this makes probing a bucket a linear scan over
+// contiguous memory.
+class JoinHashTable {
+ public:
+  explicit JoinHashTable(const Column& col, KeyType key_type) {
+    uint32_t size = col.row_map().size();
+
+    // Use at least twice as many buckets as rows to keep buckets short.
+    shift_ = 63;
+    while (shift_ > 1 && (uint64_t(1) << (64 - shift_)) < uint64_t(size) * 2)
+      shift_--;
+    uint32_t num_buckets = 1u << (64 - shift_);
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> rows;
+    Column::Rows col_rows;
+    std::vector<uint64_t> batch_keys;
+    std::vector<uint8_t> valid;
+    for (uint32_t start = 0; start < size; start += kBatchSize) {
+      uint32_t end = std::min(start + kBatchSize, size);
+      GetKeys(col, key_type, start, end, &col_rows, &batch_keys, &valid);
+      for (uint32_t i = 0; i < end - start; ++i) {
+        if (!valid[i])
+          continue;
+        keys.push_back(batch_keys[i]);
+        rows.push_back(start + i);
+      }
+    }
+
+    // Counting sort the rows by bucket: this keeps the rows of each bucket in
+    // increasing order.
+    bucket_offsets_.assign(num_buckets + 1, 0);
+    for (uint64_t key : keys)
+      bucket_offsets_[Bucket(key) + 1]++;
+    for (uint32_t i = 0; i < num_buckets; ++i)
+      bucket_offsets_[i + 1] += bucket_offsets_[i];
+
+    std::vector<uint32_t> next(bucket_offsets_.begin(),
+                               bucket_offsets_.end() - 1);
+    entries_.resize(keys.size());
+    for (uint32_t i = 0; i < keys.size(); ++i)
+      entries_[next[Bucket(keys[i])]++] = Entry{keys[i], rows[i]};
+  }
+
+  // Appends all the matches of the |n| keys in |keys|, belonging to the rows
+  // starting at |start_row| of the probe side, to |probe_rows| and
+  // |build_rows|.
+  void Probe(const uint64_t* keys,
+             const uint8_t* valid,
+             uint32_t n,
+             uint32_t start_row,
+             std::vector<uint32_t>* probe_rows,
+             std::vector<uint32_t>* build_rows) const {
+    // Compute all the buckets first: this loop is vectorizable and allows the
+    // loads of the offsets below to overlap.
+    uint32_t buckets[kBatchSize];
+    for (uint32_t i = 0; i < n; ++i)
+      buckets[i] = Bucket(keys[i]);
+
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!valid[i])
+        continue;
+      uint32_t begin = bucket_offsets_[buckets[i]];
+      uint32_t end = bucket_offsets_[buckets[i] + 1];
+      for (uint32_t j = begin; j < end; ++j) {
+        if (entries_[j].key != keys[i])
+          continue;
+        probe_rows->push_back(start_row + i);
+        build_rows->push_back(entries_[j].row);
+      }
+    }
+  }
+
+ private:
+  struct Entry {
+    uint64_t key;
+    uint32_t row;
+  };
+
+  uint32_t Bucket(uint64_t key) const {
+    // Fibonacci hashing: the multiplication mixes the low bits of the key
+    // (which vary the most for ids and pointers) into the high bits.
+    return static_cast<uint32_t>((key * 0x9E3779B97F4A7C15ull) >> shift_);
+  }
+
+  uint32_t shift_ = 0;
+  std::vector<uint32_t> bucket_offsets_;
+  std::vector<Entry> entries_;
+};
+
+}  // namespace
+
+void HashJoinRows(const Column& left,
+                  const Column& right,
+                  std::vector<uint32_t>* left_rows,
+                  std::vector<uint32_t>* right_rows) {
+  SqlValue::Type left_type = left.type();
+  SqlValue::Type right_type = right.type();
+
+  KeyType key_type;
+  if (left_type == SqlValue::Type::kString ||
+      right_type == SqlValue::Type::kString) {
+    if (left_type != right_type)
+      return;
+    key_type = KeyType::kString;
+  } else if (left_type == SqlValue::Type::kDouble ||
+             right_type == SqlValue::Type::kDouble) {
+    key_type = KeyType::kDouble;
+  } else {
+    key_type = KeyType::kLong;
+  }
+
+  JoinHashTable hash_table(right, key_type);
+
+  uint32_t size = left.row_map().size();
+  Column::Rows rows;
+  std::vector<uint64_t> keys;
+  std::vector<uint8_t> valid;
+  for (uint32_t start = 0; start < size; start += kBatchSize) {
+    uint32_t end = std::min(start + kBatchSize, size);
+    GetKeys(left, key_type, start, end, &rows, &keys, &valid);
+    hash_table.Probe(keys.data(), valid.data(), end - start, start, left_rows,
+                     right_rows);
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
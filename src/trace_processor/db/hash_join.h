@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_HASH_JOIN_H_
+#define SRC_TRACE_PROCESSOR_DB_HASH_JOIN_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+namespace perfetto {
+namespace trace_processor {
+
+class Column;
+
+// Computes the rows of the inner equi-join of |left| and |right|: for each
+// pair of rows (l, r) where the value of |left| at row l is equal to the value
+// of |right| at row r, l is appended to |left_rows| and r to |right_rows|.
+// Pairs are ordered by l and then by r.
+//
+// |right| is used to build the hash table while |left| is only streamed
+// through it in batches so |right| should be the smaller of the two columns.
+//
+// Values are compared following SQLite semantics: nulls never match, integers
+// and doubles compare by value and strings only match other strings. String
+// columns are compared by interned pointer so must share the same StringPool.
+void HashJoinRows(const Column& left,
+                  const Column& right,
+                  std::vector<uint32_t>* left_rows,
+                  std::vector<uint32_t>* right_rows);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_HASH_JOIN_H_
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/interval_index.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "src/trace_processor/db/column.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// The number of rows of the columns read at once when building the index.
+constexpr uint32_t kBuildBatchSize = 1024;
+
+// Subtrees with a root at this level or below (i.e. with at most 15 nodes)
+// are scanned linearly rather than traversed as this is cheaper.
+constexpr uint32_t kMaxScanLevel = 3;
+
+int64_t IntervalEnd(int64_t ts, int64_t dur) {
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  if (dur <= 0)
+    return ts == kMax ? ts : ts + 1;
+  return ts > kMax - dur ? kMax : ts + dur;
+}
+
+}  // namespace
+
+// static
+bool IntervalIndex::IsSupported(const Column& ts, const Column& dur) {
+  return ts.type() == SqlValue::Type::kLong &&
+         dur.type() == SqlValue::Type::kLong;
+}
+
+// static
+IntervalIndex IntervalIndex::Build(const Column& ts, const Column& dur) {
+  PERFETTO_DCHECK(IsSupported(ts, dur));
+  PERFETTO_DCHECK(ts.row_map().size() == dur.row_map().size());
+
+  IntervalIndex index;
+  index.row_count_ = ts.row_map().size();
+  index.ts_generation_ = ts.generation();
+  index.dur_generation_ = dur.generation();
+  index.nodes_.reserve(index.row_count_);
+
+  Column::Rows ts_rows;
+  Column::Rows dur_rows;
+  for (uint32_t start = 0; start < index.row_count_;
+       start += kBuildBatchSize) {
+    uint32_t end = std::min(start + kBuildBatchSize, index.row_count_);
+    ts.GetRows(start, end, &ts_rows);
+    dur.GetRows(start, end, &dur_rows);
+    for (uint32_t i = 0; i < end - start; ++i) {
+      if (!ts_rows.is_null.empty() && ts_rows.is_null[i])
+        continue;
+      bool dur_is_null = !dur_rows.is_null.empty() && dur_rows.is_null[i];
+      int64_t node_ts = ts_rows.longs[i];
+      int64_t node_dur = dur_is_null ? 0 : dur_rows.longs[i];
+      index.nodes_.emplace_back(
+          Node{node_ts, IntervalEnd(node_ts, node_dur), 0, start + i});
+    }
+  }
+
+  // Timestamp columns are usually sorted so this can be skipped.
+  if (!ts.IsSorted()) {
+    std::stable_sort(
+        index.nodes_.begin(), index.nodes_.end(),
+        [](const Node& a, const Node& b) { return a.start < b.start; });
+  }
+  index.root_level_ = index.ComputeMaxEnds();
+  return index;
+}
+
+uint32_t IntervalIndex::ComputeMaxEnds() {
+  size_t size = nodes_.size();
+  if (size == 0)
+    return 0;
+
+  // The leaves are the nodes at even positions. As the tree is only complete
+  // if its size is a power of two minus one, nodes can be missing the root of
+  // their right subtree: these use the max end of the last node of the
+  // previous level instead, which is the root of the last (and incomplete)
+  // subtree of that level.
+  size_t last = 0;
+  int64_t last_max_end = 0;
+  for (size_t i = 0; i < size; i += 2) {
+    nodes_[i].max_end = nodes_[i].end;
+    last = i;
+    last_max_end = nodes_[i].end;
+  }
+
+  uint32_t level = 1;
+  for (; (size_t(1) << level) <= size; ++level) {
+    size_t child_offset = size_t(1) << (level - 1);
+    size_t step = child_offset << 2;
+    for (size_t i = (child_offset << 1) - 1; i < size; i += step) {
+      int64_t left = nodes_[i - child_offset].max_end;
+      int64_t right = i + child_offset < size
+                          ? nodes_[i + child_offset].max_end
+                          : last_max_end;
+      nodes_[i].max_end = std::max(nodes_[i].end, std::max(left, right));
+    }
+    last = (last >> level) & 1 ? last - child_offset : last + child_offset;
+    if (last < size && nodes_[last].max_end > last_max_end)
+      last_max_end = nodes_[last].max_end;
+  }
+  return level - 1;
+}
+
+bool IntervalIndex::IsStale(const Column& ts, const Column& dur) const {
+  return ts.row_map().size() != row_count_ ||
+         ts.generation() != ts_generation_ ||
+         dur.generation() != dur_generation_;
+}
+
+RowMap IntervalIndex::FindOverlapping(int64_t start, int64_t end) const {
+  std::vector<uint32_t> rows;
+  size_t size = nodes_.size();
+  if (size == 0 || start >= end)
+    return RowMap(std::move(rows));
+
+  // The nodes are visited in order using an explicit stack: every node is
+  // pushed twice, once to visit its left subtree and then to visit itself and
+  // its right subtree.
+  struct StackEntry {
+    size_t pos;
+    uint32_t level;
+    bool left_visited;
+  };
+  std::vector<StackEntry> stack;
+  stack.push_back(
+      StackEntry{(size_t(1) << root_level_) - 1, root_level_, false});
+  while (!stack.empty()) {
+    StackEntry entry = stack.back();
+    stack.pop_back();
+
+    if (entry.level <= kMaxScanLevel) {
+      size_t first = entry.pos >> entry.level << entry.level;
+      size_t last =
+          std::min(first + (size_t(1) << (entry.level + 1)) - 1, size);
+      for (size_t i = first; i < last && nodes_[i].start < end; ++i) {
+        if (nodes_[i].end > start)
+          rows.push_back(nodes_[i].row);
+      }
+      continue;
+    }
+
+    size_t child_offset = size_t(1) << (entry.level - 1);
+    if (!entry.left_visited) {
+      // The left subtree only needs to be visited if one of its intervals
+      // ends after |start|; missing nodes have no max end so are always
+      // visited.
+      size_t left = entry.pos - child_offset;
+      stack.push_back(StackEntry{entry.pos, entry.level, true});
+      if (left >= size || nodes_[left].max_end > start)
+        stack.push_back(StackEntry{left, entry.level - 1, false});
+    } else if (entry.pos < size && nodes_[entry.pos].start < end) {
+      // The intervals in the right subtree start after this one so can only
+      // overlap if this one starts before |end|.
+      if (nodes_[entry.pos].end > start)
+        rows.push_back(nodes_[entry.pos].row);
+      stack.push_back(
+          StackEntry{entry.pos + child_offset, entry.level - 1, false});
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+  return RowMap(std::move(rows));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_INTERVAL_INDEX_H_
+#define SRC_TRACE_PROCESSOR_DB_INTERVAL_INDEX_H_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "src/trace_processor/containers/row_map.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class Column;
+
+// An index over the intervals [ts, ts + dur) given by a timestamp and a
+// duration column which allows finding the rows overlapping a range of
+// timestamps without scanning every row.
+//
+// The intervals follow the conventions of span_join: an interval with a zero,
+// negative (i.e. incomplete) or null duration is an instant which overlaps a
+// range only if its timestamp is inside the range. Rows with a null timestamp
+// never overlap any range.
+//
+// The index is an implicit interval tree: the intervals are sorted by start
+// and the array is seen as a complete binary tree where the node at position
+// i on level k (i.e. i has exactly k trailing one bits) has its children at
+// i -/+ 2^(k-1). Each node also stores the max end of the intervals in its
+// subtree which allows skipping subtrees which end before the queried range.
+// Finding the k intervals overlapping a range takes O(log(n) + k) and the
+// index has no memory overhead other than the intervals themselves.
+class IntervalIndex {
+ public:
+  // Returns whether an index can be built on |ts| and |dur|.
+  static bool IsSupported(const Column& ts, const Column& dur);
+
+  // Builds an index over all the rows of |ts| and |dur|.
+  static IntervalIndex Build(const Column& ts, const Column& dur);
+
+  IntervalIndex(IntervalIndex&&) noexcept = default;
+  IntervalIndex& operator=(IntervalIndex&&) = default;
+
+  // Returns whether the contents of |ts| or |dur| changed since this index was
+  // built, in which case the index should not be used anymore.
+  bool IsStale(const Column& ts, const Column& dur) const;
+
+  // Returns the rows whose interval overlaps [start, end).
+  RowMap FindOverlapping(int64_t start, int64_t end) const;
+
+  // Returns the number of intervals in the index.
+  uint32_t size() const { return static_cast<uint32_t>(nodes_.size()); }
+
+ private:
+  struct Node {
+    int64_t start;
+    int64_t end;
+
+    // The max |end| of all the nodes in the subtree rooted at this node.
+    int64_t max_end;
+
+    uint32_t row;
+  };
+
+  IntervalIndex() = default;
+
+  // Computes |max_end| for every node and returns the level of the root.
+  uint32_t ComputeMaxEnds();
+
+  // The size and generation of the columns when this index was built; used
+  // to detect if the columns changed.
+  uint32_t row_count_ = 0;
+  uint32_t ts_generation_ = 0;
+  uint32_t dur_generation_ = 0;
+
+  // The intervals of the rows with a non-null timestamp sorted by start.
+  std::vector<Node> nodes_;
+  uint32_t root_level_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_INTERVAL_INDEX_H_
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/interval_index.h"
+
+#include <random>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_INTERVAL_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestIntervalTable, "interval")                        \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)               \
+  C(int64_t, ts)                                             \
+  C(base::Optional<int64_t>, dur)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_INTERVAL_TABLE_DEF);
+
+TestIntervalTable::~TestIntervalTable() = default;
+
+std::vector<uint32_t> ToVector(const RowMap& rm) {
+  std::vector<uint32_t> rows;
+  for (uint32_t i = 0; i < rm.size(); ++i)
+    rows.push_back(rm.Get(i));
+  return rows;
+}
+
+class IntervalIndexTest : public ::testing::Test {
+ protected:
+  void Insert(int64_t ts, base::Optional<int64_t> dur) {
+    TestIntervalTable::Row row;
+    row.ts = ts;
+    row.dur = dur;
+    table_.Insert(row);
+  }
+
+  IntervalIndex Build() {
+    return IntervalIndex::Build(table_.ts(), table_.dur());
+  }
+
+  // Returns the rows overlapping [start, end) by scanning the table.
+  std::vector<uint32_t> Scan(int64_t start, int64_t end) {
+    std::vector<uint32_t> rows;
+    for (uint32_t i = 0; i < table_.row_count(); ++i) {
+      int64_t ts = table_.ts()[i];
+      int64_t dur = table_.dur()[i].value_or(0);
+      int64_t ts_end = dur > 0 ? ts + dur : ts + 1;
+      if (ts < end && ts_end > start)
+        rows.push_back(i);
+    }
+    return rows;
+  }
+
+  StringPool pool_;
+  TestIntervalTable table_{&pool_, nullptr};
+};
+
+TEST_F(IntervalIndexTest, Empty) {
+  IntervalIndex index = Build();
+  ASSERT_EQ(index.size(), 0u);
+  ASSERT_EQ(index.FindOverlapping(0, 100).size(), 0u);
+}
+
+TEST_F(IntervalIndexTest, Overlapping) {
+  Insert(10, 10);             // [10, 20)
+  Insert(0, 5);               // [0, 5)
+  Insert(15, 0);              // Instant at 15.
+  Insert(30, -1);             // Incomplete: instant at 30.
+  Insert(18, base::nullopt);  // Instant at 18.
+  Insert(5, 100);             // [5, 105)
+
+  IntervalIndex index = Build();
+  ASSERT_EQ(index.size(), 6u);
+
+  using ::testing::ElementsAre;
+  ASSERT_THAT(ToVector(index.FindOverlapping(0, 1)), ElementsAre(1u));
+  ASSERT_THAT(ToVector(index.FindOverlapping(5, 10)), ElementsAre(5u));
+  ASSERT_THAT(ToVector(index.FindOverlapping(15, 16)),
+              ElementsAre(0u, 2u, 5u));
+  ASSERT_THAT(ToVector(index.FindOverlapping(16, 30)),
+              ElementsAre(0u, 4u, 5u));
+  ASSERT_THAT(ToVector(index.FindOverlapping(20, 31)), ElementsAre(3u, 5u));
+  ASSERT_THAT(ToVector(index.FindOverlapping(105, 1000)), ElementsAre());
+
+  // Empty ranges never overlap anything.
+  ASSERT_THAT(ToVector(index.FindOverlapping(15, 15)), ElementsAre());
+}
+
+TEST_F(IntervalIndexTest, MatchesScan) {
+  std::minstd_rand0 rnd_engine(42);
+
+  // Use sizes around powers of two as these change the shape of the tree.
+  uint32_t row_count = 0;
+  for (uint32_t size : {1u, 2u, 3u, 7u, 8u, 9u, 31u, 100u, 1023u, 1025u}) {
+    for (; row_count < size; ++row_count) {
+      base::Optional<int64_t> dur;
+      if (rnd_engine() % 8 != 0)
+        dur = static_cast<int64_t>(rnd_engine() % 200) - 10;
+      Insert(static_cast<int64_t>(rnd_engine() % 5000), dur);
+    }
+
+    IntervalIndex index = Build();
+    ASSERT_EQ(index.size(), size);
+    for (uint32_t i = 0; i < 100; ++i) {
+      int64_t start = static_cast<int64_t>(rnd_engine() % 5200) - 100;
+      int64_t end = start + static_cast<int64_t>(rnd_engine() % 300);
+      ASSERT_EQ(ToVector(index.FindOverlapping(start, end)),
+                Scan(start, end))
+          << "size " << size << " range [" << start << ", " << end << ")";
+    }
+  }
+}
+
+TEST_F(IntervalIndexTest, Stale) {
+  Insert(0, 10);
+  IntervalIndex index = Build();
+  ASSERT_FALSE(index.IsStale(table_.ts(), table_.dur()));
+
+  table_.mutable_dur()->Set(0, 20);
+  ASSERT_TRUE(index.IsStale(table_.ts(), table_.dur()));
+
+  index = Build();
+  Insert(5, 10);
+  ASSERT_TRUE(index.IsStale(table_.ts(), table_.dur()));
+}
+
+TEST_F(IntervalIndexTest, TableFilterOverlapping) {
+  Insert(0, 10);
+  Insert(20, 10);
+
+  uint32_t ts = table_.ts().index_in_table();
+  uint32_t dur = table_.dur().index_in_table();
+  using ::testing::ElementsAre;
+  ASSERT_THAT(ToVector(table_.FilterOverlappingToRowMap(ts, dur, 5, 25)),
+              ElementsAre(0u, 1u));
+
+  // The index is rebuilt when the table changes.
+  Insert(22, 1);
+  table_.mutable_dur()->Set(0, 1);
+  ASSERT_THAT(ToVector(table_.FilterOverlappingToRowMap(ts, dur, 5, 25)),
+              ElementsAre(1u, 2u));
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/parallel_sort.h"
+
+#include <array>
+#include <functional>
+
+#include "perfetto/ext/base/no_destructor.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr uint32_t kRadixBits = 8;
+constexpr uint32_t kRadixBuckets = 1 << kRadixBits;
+constexpr uint32_t kRadixDigits = 64 / kRadixBits;
+
+using Histogram = std::array<size_t, kRadixBuckets>;
+
+std::mutex& GetSortThreadPoolMutex() {
+  static base::NoDestructor<std::mutex> mutex;
+  return mutex.ref();
+}
+
+inline uint32_t Digit(uint64_t key, uint32_t digit) {
+  return static_cast<uint32_t>(key >> (digit * kRadixBits)) &
+         (kRadixBuckets - 1);
+}
+
+}  // namespace
+
+SortThreadPool::SortThreadPool()
+    : lock_(GetSortThreadPoolMutex(), std::try_to_lock) {
+  if (!lock_.owns_lock())
+    return;
+
+  static base::NoDestructor<base::ThreadPool> pool(
+      base::ThreadPool::DefaultNumThreads(), "TableSort");
+  if (pool.ref().num_threads() > 0)
+    pool_ = &pool.ref();
+}
+
+SortThreadPool::~SortThreadPool() = default;
+
+void RadixSort(base::ThreadPool* pool, std::vector<RadixSortEntry>* entries) {
+  size_t size = entries->size();
+  size_t num_chunks = 1;
+  if (pool && size >= kMinParallelSortSize)
+    num_chunks = pool->num_threads() + 1;
+  auto chunk_start = [size, num_chunks](size_t chunk) {
+    return size * chunk / num_chunks;
+  };
+  auto parallel_for = [pool, num_chunks](
+                          const std::function<void(size_t)>& fn) {
+    if (num_chunks == 1) {
+      fn(0);
+    } else {
+      pool->ParallelFor(num_chunks, fn);
+    }
+  };
+
+  // First find which digits actually need sorting: a digit can be skipped if
+  // all the keys have the same value for it. This is the case for the high
+  // digits of most keys in practice.
+  std::vector<std::array<Histogram, kRadixDigits>> chunk_digit_counts(
+      num_chunks);
+  const RadixSortEntry* data = entries->data();
+  parallel_for([&](size_t chunk) {
+    auto& counts = chunk_digit_counts[chunk];
+    for (Histogram& hist : counts)
+      hist.fill(0);
+    for (size_t i = chunk_start(chunk); i < chunk_start(chunk + 1); ++i) {
+      for (uint32_t digit = 0; digit < kRadixDigits; ++digit)
+        counts[digit][Digit(data[i].key, digit)]++;
+    }
+  });
+
+  std::vector<uint32_t> digits_to_sort;
+  for (uint32_t digit = 0; digit < kRadixDigits; ++digit) {
+    uint32_t bucket = Digit(size == 0 ? 0 : data[0].key, digit);
+    size_t count = 0;
+    for (const auto& counts : chunk_digit_counts)
+      count += counts[digit][bucket];
+    if (count != size)
+      digits_to_sort.push_back(digit);
+  }
+  if (digits_to_sort.empty())
+    return;
+
+  std::vector<RadixSortEntry> buffer(size);
+  std::vector<Histogram> chunk_offsets(num_chunks);
+  RadixSortEntry* src = entries->data();
+  RadixSortEntry* dst = buffer.data();
+  for (uint32_t digit : digits_to_sort) {
+    // Every chunk scatters its entries in its own slice of each bucket: the
+    // slices are ordered by chunk so the sort stays stable.
+    if (digit != digits_to_sort.front()) {
+      parallel_for([&](size_t chunk) {
+        Histogram& hist = chunk_digit_counts[chunk][digit];
+        hist.fill(0);
+        for (size_t i = chunk_start(chunk); i < chunk_start(chunk + 1); ++i)
+          hist[Digit(src[i].key, digit)]++;
+      });
+    }
+    size_t offset = 0;
+    for (uint32_t bucket = 0; bucket < kRadixBuckets; ++bucket) {
+      for (size_t chunk = 0; chunk < num_chunks; ++chunk) {
+        chunk_offsets[chunk][bucket] = offset;
+        offset += chunk_digit_counts[chunk][digit][bucket];
+      }
+    }
+
+    parallel_for([&](size_t chunk) {
+      Histogram& offsets = chunk_offsets[chunk];
+      for (size_t i = chunk_start(chunk); i < chunk_start(chunk + 1); ++i)
+        dst[offsets[Digit(src[i].key, digit)]++] = src[i];
+    });
+    std::swap(src, dst);
+  }
+  if (src != entries->data())
+    entries->swap(buffer);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
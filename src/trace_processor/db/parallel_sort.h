@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_PARALLEL_SORT_H_
+#define SRC_TRACE_PROCESSOR_DB_PARALLEL_SORT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "perfetto/ext/base/thread_pool.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Vectors with fewer elements than this are always sorted on the calling
+// thread: below this size, the cost of waking up the workers dominates.
+constexpr size_t kMinParallelSortSize = 64 * 1024;
+
+// Grants the calling thread exclusive use of the thread pool shared by all the
+// sorts in the process; the pool is created on first use.
+//
+// As base::ThreadPool can only run one job at a time, pool() returns nullptr
+// if another thread is already sorting using the pool (or if the machine has
+// a single CPU). Callers should then sort on the calling thread.
+class SortThreadPool {
+ public:
+  SortThreadPool();
+  ~SortThreadPool();
+
+  base::ThreadPool* pool() const { return pool_; }
+
+ private:
+  std::unique_lock<std::mutex> lock_;
+  base::ThreadPool* pool_ = nullptr;
+};
+
+// An element sorted by RadixSort: |value| is ordered by |key|.
+struct RadixSortEntry {
+  uint64_t key;
+  uint32_t value;
+};
+
+// Stably sorts |entries| in ascending order of key, splitting the work across
+// |pool| (which can be nullptr) for large vectors.
+//
+// This is an LSD radix sort with 8 bit digits: digits which are the same for
+// all the keys are skipped so keys which span a small range (e.g. timestamps
+// in a trace or interned string ids) only take a few passes over the data.
+void RadixSort(base::ThreadPool* pool, std::vector<RadixSortEntry>* entries);
+
+// Returns the number of elements of the first |a_size| elements of |a| which
+// are part of the first |n| elements of the stable merge of |a| and |b|
+// (i.e. where elements of |a| come first when comparing equal).
+template <typename T, typename Comparator>
+size_t MergePathSplit(const T* a,
+                      size_t a_size,
+                      const T* b,
+                      size_t b_size,
+                      size_t n,
+                      Comparator comp) {
+  size_t lo = n > b_size ? n - b_size : 0;
+  size_t hi = std::min(n, a_size);
+  while (lo < hi) {
+    size_t i = lo + (hi - lo) / 2;
+    if (comp(b[n - i - 1], a[i])) {
+      hi = i;
+    } else {
+      lo = i + 1;
+    }
+  }
+  return lo;
+}
+
+// Stably sorts |v| using |comp|, splitting the work across |pool| (which can
+// be nullptr) if |v| has at least |kMinParallelSortSize| elements.
+//
+// The vector is split into one chunk per thread which are sorted in parallel
+// with std::stable_sort; the chunks are then merged pairwise, splitting each
+// merge into independent pieces so that all the threads are used even for the
+// last merges.
+template <typename T, typename Comparator>
+void ParallelStableSort(base::ThreadPool* pool,
+                        std::vector<T>* v,
+                        Comparator comp) {
+  size_t size = v->size();
+  if (!pool || pool->num_threads() == 0 || size < kMinParallelSortSize) {
+    std::stable_sort(v->begin(), v->end(), comp);
+    return;
+  }
+
+  // Use a power of two number of chunks to make the merge tree balanced.
+  size_t num_tasks = pool->num_threads() + 1;
+  size_t num_chunks = 1;
+  while (num_chunks < num_tasks)
+    num_chunks *= 2;
+  auto chunk_start = [size, num_chunks](size_t chunk) {
+    return size * chunk / num_chunks;
+  };
+
+  T* data = v->data();
+  pool->ParallelFor(num_chunks, [&](size_t chunk) {
+    std::stable_sort(data + chunk_start(chunk), data + chunk_start(chunk + 1),
+                     comp);
+  });
+
+  std::vector<T> buffer(size);
+  const T* src = data;
+  T* dst = buffer.data();
+  for (size_t width = 1; width < num_chunks; width *= 2) {
+    size_t num_merges = num_chunks / (2 * width);
+    size_t pieces = (num_tasks + num_merges - 1) / num_merges;
+    pool->ParallelFor(num_merges * pieces, [&](size_t task) {
+      size_t merge = task / pieces;
+      size_t piece = task % pieces;
+      size_t start = chunk_start(2 * merge * width);
+      size_t mid = chunk_start((2 * merge + 1) * width);
+      size_t end = chunk_start((2 * merge + 2) * width);
+
+      const T* a = src + start;
+      const T* b = src + mid;
+      size_t a_size = mid - start;
+      size_t b_size = end - mid;
+      size_t out_start = (end - start) * piece / pieces;
+      size_t out_end = (end - start) * (piece + 1) / pieces;
+      size_t a_start =
+          MergePathSplit(a, a_size, b, b_size, out_start, comp);
+      size_t a_end = MergePathSplit(a, a_size, b, b_size, out_end, comp);
+      std::merge(a + a_start, a + a_end, b + (out_start - a_start),
+                 b + (out_end - a_end), dst + start + out_start, comp);
+    });
+    src = dst;
+    dst = dst == buffer.data() ? data : buffer.data();
+  }
+  if (src != data)
+    v->swap(buffer);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_PARALLEL_SORT_H_
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/parallel_sort.h"
+
+#include <random>
+#include <utility>
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Entry = std::pair<uint32_t, uint32_t>;
+
+bool CompareFirst(const Entry& a, const Entry& b) {
+  return a.first < b.first;
+}
+
+// Returns |size| entries with keys in [0, |max_key|) and increasing values, to
+// check that sorts are stable.
+std::vector<Entry> RandomEntries(size_t size, uint32_t max_key) {
+  std::minstd_rand0 rnd_engine(42);
+  std::vector<Entry> entries;
+  for (uint32_t i = 0; i < size; ++i)
+    entries.emplace_back(rnd_engine() % max_key, i);
+  return entries;
+}
+
+std::vector<Entry> Sorted(std::vector<Entry> entries) {
+  std::stable_sort(entries.begin(), entries.end(), CompareFirst);
+  return entries;
+}
+
+TEST(ParallelSortTest, MergePathSplit) {
+  std::vector<int> a{1, 2, 2, 5};
+  std::vector<int> b{2, 3, 6};
+  auto split = [&a, &b](size_t n) {
+    return MergePathSplit(a.data(), a.size(), b.data(), b.size(), n,
+                          [](int x, int y) { return x < y; });
+  };
+  // The stable merge is 1 2 2 (from a) 2 (from b) 3 5 6.
+  ASSERT_EQ(split(0), 0u);
+  ASSERT_EQ(split(1), 1u);
+  ASSERT_EQ(split(3), 3u);
+  ASSERT_EQ(split(4), 3u);
+  ASSERT_EQ(split(5), 3u);
+  ASSERT_EQ(split(6), 4u);
+  ASSERT_EQ(split(7), 4u);
+}
+
+TEST(ParallelSortTest, StableSortWithoutPool) {
+  auto entries = RandomEntries(1000, 10);
+  auto expected = Sorted(entries);
+  ParallelStableSort(nullptr, &entries, CompareFirst);
+  ASSERT_EQ(entries, expected);
+}
+
+TEST(ParallelSortTest, StableSortWithPool) {
+  // Use a number of threads which doesn't divide the size of the vector.
+  base::ThreadPool pool(4);
+  for (uint32_t max_key : {2u, 1000u, 1000000u}) {
+    auto entries = RandomEntries(kMinParallelSortSize * 3 + 17, max_key);
+    auto expected = Sorted(entries);
+    ParallelStableSort(&pool, &entries, CompareFirst);
+    ASSERT_EQ(entries, expected);
+  }
+}
+
+TEST(ParallelSortTest, RadixSort) {
+  base::ThreadPool pool(3);
+  for (base::ThreadPool* p : {static_cast<base::ThreadPool*>(nullptr), &pool}) {
+    for (size_t size : {size_t(0), size_t(1), size_t(1000),
+                        kMinParallelSortSize * 2 + 5}) {
+      std::minstd_rand0 rnd_engine(42);
+      std::vector<RadixSortEntry> entries(size);
+      std::vector<Entry> expected;
+      for (uint32_t i = 0; i < size; ++i) {
+        // Spread the keys over the high bits too but keep duplicates.
+        uint64_t key = (static_cast<uint64_t>(rnd_engine() % 500) << 40) |
+                       (rnd_engine() % 3);
+        entries[i].key = key;
+        entries[i].value = i;
+        expected.emplace_back(i, i);
+      }
+      std::stable_sort(expected.begin(), expected.end(),
+                       [&entries](const Entry& a, const Entry& b) {
+                         return entries[a.first].key < entries[b.first].key;
+                       });
+
+      RadixSort(p, &entries);
+      ASSERT_EQ(entries.size(), size);
+      for (size_t i = 0; i < size; ++i)
+        ASSERT_EQ(entries[i].value, expected[i].second);
+    }
+  }
+}
+
+TEST(ParallelSortTest, RadixSortAllKeysEqual) {
+  std::vector<RadixSortEntry> entries(100);
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    entries[i].key = 1234;
+    entries[i].value = i;
+  }
+  RadixSort(nullptr, &entries);
+  for (uint32_t i = 0; i < entries.size(); ++i)
+    ASSERT_EQ(entries[i].value, i);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
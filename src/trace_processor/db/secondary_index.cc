@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/secondary_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <tuple>
+
+#include "perfetto/base/logging.h"
+#include "src/trace_processor/db/compare.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Rows matching a range constraint (e.g. <, >=) are spread over the whole
+// column so setting them one by one is only faster than scanning the column
+// when at most this fraction of the rows match.
+constexpr uint32_t kMaxRangeFilterFraction = 8;
+
+bool IsIndexableOp(FilterOp op) {
+  switch (op) {
+    case FilterOp::kEq:
+    case FilterOp::kLt:
+    case FilterOp::kGt:
+    case FilterOp::kLe:
+    case FilterOp::kGe:
+      return true;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      return false;
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+}  // namespace
+
+SecondaryIndex::SecondaryIndex(Type type,
+                               uint32_t row_count,
+                               uint32_t generation)
+    : type_(type), row_count_(row_count), generation_(generation) {}
+
+// static
+bool SecondaryIndex::IsSupported(const Column& col) {
+  if (col.IsId() || col.IsSorted())
+    return false;
+  return col.type() == SqlValue::Type::kLong ||
+         col.type() == SqlValue::Type::kString;
+}
+
+// static
+SecondaryIndex SecondaryIndex::Build(const Column& col, Type type) {
+  PERFETTO_DCHECK(IsSupported(col));
+  PERFETTO_DCHECK(type == Type::kSorted ||
+                  col.type() == SqlValue::Type::kLong);
+
+  uint32_t row_count = col.row_map().size();
+  SecondaryIndex index(type, row_count, col.generation());
+
+  std::vector<uint32_t> rows(row_count);
+  std::iota(rows.begin(), rows.end(), 0u);
+  col.StableSort(false /* desc */, &rows);
+
+  // Nulls are sorted before all other values; they never match any of the
+  // constraints the index is used for so just drop them.
+  auto is_null = [&col](uint32_t row) { return col.Get(row).is_null(); };
+  auto non_null_it = std::partition_point(rows.begin(), rows.end(), is_null);
+  index.sorted_rows_.assign(non_null_it, rows.end());
+
+  if (type == Type::kHash) {
+    const auto& sorted = index.sorted_rows_;
+    uint32_t size = static_cast<uint32_t>(sorted.size());
+    for (uint32_t i = 0; i < size;) {
+      int64_t value = col.Get(sorted[i]).long_value;
+      uint32_t j = i + 1;
+      for (; j < size && col.Get(sorted[j]).long_value == value; ++j) {
+      }
+      index.ranges_.emplace(value, std::make_pair(i, j));
+      i = j;
+    }
+  }
+  return index;
+}
+
+bool SecondaryIndex::IsStale(const Column& col) const {
+  return col.row_map().size() != row_count_ ||
+         col.generation() != generation_;
+}
+
+bool SecondaryIndex::FilterInto(const Column& col,
+                                FilterOp op,
+                                SqlValue value,
+                                RowMap* rm) const {
+  PERFETTO_DCHECK(!IsStale(col));
+
+  // Only values which are ordered in the same way as the values in the index
+  // can be looked up; everything else (e.g. strings on integer columns or NaN)
+  // is left to the scan.
+  bool is_supported_value;
+  if (col.type() == SqlValue::Type::kString) {
+    is_supported_value = value.type == SqlValue::Type::kString;
+  } else if (value.type == SqlValue::Type::kDouble) {
+    is_supported_value = !std::isnan(value.double_value);
+  } else {
+    is_supported_value = value.type == SqlValue::Type::kLong;
+  }
+  if (!is_supported_value)
+    return false;
+
+  uint32_t begin = 0;
+  uint32_t end = static_cast<uint32_t>(sorted_rows_.size());
+  switch (op) {
+    case FilterOp::kEq:
+      std::tie(begin, end) = EqualRange(col, value);
+      break;
+    case FilterOp::kLt:
+      end = LowerBound(col, value);
+      break;
+    case FilterOp::kLe:
+      end = UpperBound(col, value);
+      break;
+    case FilterOp::kGt:
+      begin = UpperBound(col, value);
+      break;
+    case FilterOp::kGe:
+      begin = LowerBound(col, value);
+      break;
+    case FilterOp::kNe:
+    case FilterOp::kIsNull:
+    case FilterOp::kIsNotNull:
+    case FilterOp::kGlob:
+      return false;
+  }
+
+  uint32_t match_count = end - begin;
+  if (op != FilterOp::kEq && match_count > row_count_ / kMaxRangeFilterFraction)
+    return false;
+
+  // If |rm| is a range, only the rows inside it should be kept.
+  uint32_t rm_start = 0;
+  uint32_t rm_end = row_count_;
+  if (rm->IsRange()) {
+    if (rm->empty())
+      return true;
+    rm_start = rm->Get(0);
+    rm_end = rm->Get(rm->size() - 1) + 1;
+  }
+
+  auto first = sorted_rows_.begin() + static_cast<ptrdiff_t>(begin);
+  auto last = sorted_rows_.begin() + static_cast<ptrdiff_t>(end);
+  if (op == FilterOp::kEq && rm->IsRange()) {
+    // As the sort is stable, the rows with the same value are sorted by row so
+    // they can be used as an index vector directly.
+    first = std::lower_bound(first, last, rm_start);
+    last = std::lower_bound(first, last, rm_end);
+    *rm = RowMap(std::vector<uint32_t>(first, last));
+    return true;
+  }
+
+  BitVector bv(row_count_, false);
+  for (auto it = first; it != last; ++it) {
+    if (*it >= rm_start && *it < rm_end)
+      bv.Set(*it);
+  }
+  if (rm->IsRange()) {
+    *rm = RowMap(std::move(bv));
+  } else {
+    rm->Intersect(RowMap(std::move(bv)));
+  }
+  return true;
+}
+
+uint32_t SecondaryIndex::LowerBound(const Column& col, SqlValue value) const {
+  auto it = std::lower_bound(sorted_rows_.begin(), sorted_rows_.end(), value,
+                             [&col](uint32_t row, const SqlValue& v) {
+                               return compare::SqlValue(col.Get(row), v) < 0;
+                             });
+  return static_cast<uint32_t>(std::distance(sorted_rows_.begin(), it));
+}
+
+uint32_t SecondaryIndex::UpperBound(const Column& col, SqlValue value) const {
+  auto it = std::upper_bound(sorted_rows_.begin(), sorted_rows_.end(), value,
+                             [&col](const SqlValue& v, uint32_t row) {
+                               return compare::SqlValue(col.Get(row), v) > 0;
+                             });
+  return static_cast<uint32_t>(std::distance(sorted_rows_.begin(), it));
+}
+
+std::pair<uint32_t, uint32_t> SecondaryIndex::EqualRange(
+    const Column& col,
+    SqlValue value) const {
+  if (type_ == Type::kHash && value.type == SqlValue::Type::kLong) {
+    auto it = ranges_.find(value.long_value);
+    return it == ranges_.end() ? std::make_pair(0u, 0u) : it->second;
+  }
+  return std::make_pair(LowerBound(col, value), UpperBound(col, value));
+}
+
+bool SecondaryIndexCache::FilterInto(const Column& col,
+                                     FilterOp op,
+                                     SqlValue value,
+                                     RowMap* rm) {
+  if (!IsIndexableOp(op) || !SecondaryIndex::IsSupported(col))
+    return false;
+
+  uint32_t col_idx = col.index_in_table();
+  if (col_idx >= entries_.size())
+    entries_.resize(col_idx + 1);
+
+  Entry& entry = entries_[col_idx];
+  if (entry.index && entry.index->IsStale(col)) {
+    entry.index.reset();
+    entry.filter_count = 0;
+  }
+
+  if (!entry.index) {
+    if (++entry.filter_count < kFiltersBeforeIndexing)
+      return false;
+
+    // Hash maps are only worth their memory for equality constraints so base
+    // the type of the index on the constraint which triggered building it.
+    bool use_hash = op == FilterOp::kEq && col.type() == SqlValue::Type::kLong;
+    auto type =
+        use_hash ? SecondaryIndex::Type::kHash : SecondaryIndex::Type::kSorted;
+    entry.index.reset(new SecondaryIndex(SecondaryIndex::Build(col, type)));
+  }
+  return entry.index->FilterInto(col, op, value, rm);
+}
+
+const SecondaryIndex* SecondaryIndexCache::GetIndex(const Column& col) const {
+  uint32_t col_idx = col.index_in_table();
+  if (col_idx >= entries_.size())
+    return nullptr;
+  const auto& index = entries_[col_idx].index;
+  return index && !index->IsStale(col) ? index.get() : nullptr;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
+#define SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/db/column.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// An index over the values of a Column which allows filter constraints to be
+// computed without scanning every row of the column.
+//
+// Id and sorted columns already have fast paths inside Column so indexes are
+// only built for the remaining integer and string columns. Double columns are
+// not supported as NaN values do not have a well defined position in the sort
+// order.
+class SecondaryIndex {
+ public:
+  enum class Type {
+    // Stores the non-null rows of the column sorted by value; constraints are
+    // looked up using binary search.
+    kSorted,
+
+    // In addition to the sorted rows, stores a hash map from each value to
+    // the rows containing it; equality constraints are looked up in constant
+    // time. Only available for integer columns.
+    kHash,
+  };
+
+  // Returns whether an index can be built on |col|.
+  static bool IsSupported(const Column& col);
+
+  // Builds an index of the given |type| over all the rows of |col|.
+  static SecondaryIndex Build(const Column& col, Type type);
+
+  SecondaryIndex(SecondaryIndex&&) noexcept = default;
+  SecondaryIndex& operator=(SecondaryIndex&&) = default;
+
+  // Returns whether the contents of |col| changed since this index was built,
+  // in which case the index should not be used anymore.
+  bool IsStale(const Column& col) const;
+
+  // Updates |rm| to only keep rows where the indexed column |col| matches the
+  // constraint given by |op| and |value|. Returns false and leaves |rm|
+  // untouched if the constraint cannot be computed efficiently using this
+  // index; the caller should then scan the column instead.
+  bool FilterInto(const Column& col,
+                  FilterOp op,
+                  SqlValue value,
+                  RowMap* rm) const;
+
+  Type type() const { return type_; }
+
+ private:
+  SecondaryIndex(Type type, uint32_t row_count, uint32_t generation);
+
+  // Returns the position of the first row in |sorted_rows_| whose value is
+  // not less than (LowerBound) or greater than (UpperBound) |value|.
+  uint32_t LowerBound(const Column& col, SqlValue value) const;
+  uint32_t UpperBound(const Column& col, SqlValue value) const;
+
+  // Returns the range of |sorted_rows_| containing values equal to |value|.
+  std::pair<uint32_t, uint32_t> EqualRange(const Column& col,
+                                           SqlValue value) const;
+
+  Type type_ = Type::kSorted;
+
+  // The size and generation of the column when this index was built; used to
+  // detect if the column changed.
+  uint32_t row_count_ = 0;
+  uint32_t generation_ = 0;
+
+  // The rows of the column containing non-null values, stably sorted by
+  // value.
+  std::vector<uint32_t> sorted_rows_;
+
+  // Only populated if |type_| == kHash. Maps each value of the column to the
+  // range of |sorted_rows_| containing it.
+  std::unordered_map<int64_t, std::pair<uint32_t, uint32_t>> ranges_;
+};
+
+// Decides which columns of a Table are worth indexing and caches the built
+// indexes.
+//
+// Building an index costs a sort of the column so indexes are only built for
+// columns which are repeatedly filtered on; this is typically the case for
+// columns used to join tables (e.g. track_id or utid) as SQLite looks up the
+// join key once for every row of the other table.
+class SecondaryIndexCache {
+ public:
+  // The number of filters on a column which are needed before an index is
+  // built for it.
+  static constexpr uint32_t kFiltersBeforeIndexing = 3;
+
+  // Updates |rm| to only keep rows where |col| matches the constraint given by
+  // |op| and |value| using an index on |col|, building the index if the column
+  // is filtered on often enough. Returns false and leaves |rm| untouched if no
+  // index was used.
+  bool FilterInto(const Column& col, FilterOp op, SqlValue value, RowMap* rm);
+
+  // Returns the index on |col| or nullptr if no (up to date) index exists.
+  const SecondaryIndex* GetIndex(const Column& col) const;
+
+ private:
+  struct Entry {
+    // The number of filters on the column since its index was last dropped.
+    uint32_t filter_count = 0;
+    std::unique_ptr<SecondaryIndex> index;
+  };
+
+  // Indexed by the index of the column in the table.
+  std::vector<Entry> entries_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DB_SECONDARY_INDEX_H_
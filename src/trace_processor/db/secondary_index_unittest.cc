@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/db/secondary_index.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/optional.h"
+#include "src/trace_processor/tables/macros.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#define PERFETTO_TP_TEST_INDEX_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestIndexTable, "index")                           \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)            \
+  C(int64_t, ts, Column::Flag::kSorted)                   \
+  C(uint32_t, utid)                                       \
+  C(base::Optional<int64_t>, arg_set_id)                  \
+  C(double, value)                                        \
+  C(StringPool::Id, name)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_INDEX_TABLE_DEF);
+
+TestIndexTable::~TestIndexTable() = default;
+
+using Type = SecondaryIndex::Type;
+
+constexpr uint32_t kRowCount = 1000;
+
+constexpr FilterOp kOps[] = {FilterOp::kEq, FilterOp::kLt, FilterOp::kGt,
+                             FilterOp::kLe, FilterOp::kGe};
+
+std::vector<uint32_t> ToVector(const RowMap& rm) {
+  std::vector<uint32_t> rows;
+  for (uint32_t i = 0; i < rm.size(); ++i)
+    rows.push_back(rm.Get(i));
+  return rows;
+}
+
+class SecondaryIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::minstd_rand0 rnd_engine(42);
+    for (uint32_t i = 0; i < kRowCount; ++i) {
+      TestIndexTable::Row row;
+      row.ts = i;
+      row.utid = rnd_engine() % 50;
+      if (rnd_engine() % 4 != 0)
+        row.arg_set_id = static_cast<int64_t>(rnd_engine() % 200) - 100;
+      row.value = static_cast<double>(rnd_engine() % 10);
+      row.name = pool_.InternString(
+          base::StringView("name" + std::to_string(rnd_engine() % 30)));
+      table_.Insert(row);
+    }
+  }
+
+  // Checks that filtering with |index| gives the same result as scanning
+  // |col| for all the supported ops and the given values, both when
+  // filtering all the rows and a subset of them.
+  void CheckFilters(const SecondaryIndex& index,
+                    const Column& col,
+                    const std::vector<SqlValue>& values) {
+    BitVector odd_rows(kRowCount, false);
+    for (uint32_t i = 1; i < kRowCount; i += 2)
+      odd_rows.Set(i);
+
+    for (FilterOp op : kOps) {
+      for (const SqlValue& value : values) {
+        std::vector<RowMap> rms;
+        rms.emplace_back(0, kRowCount);
+        rms.emplace_back(100, 300);
+        rms.emplace_back(odd_rows.Copy());
+        for (RowMap& rm : rms) {
+          RowMap expected = rm.Copy();
+          col.FilterInto(op, value, &expected);
+          if (!index.FilterInto(col, op, value, &rm))
+            continue;
+          ASSERT_EQ(ToVector(rm), ToVector(expected))
+              << "op " << static_cast<int>(op);
+        }
+      }
+    }
+  }
+
+  StringPool pool_;
+  TestIndexTable table_{&pool_, nullptr};
+};
+
+TEST_F(SecondaryIndexTest, IsSupported) {
+  ASSERT_FALSE(SecondaryIndex::IsSupported(table_.id()));
+  ASSERT_FALSE(SecondaryIndex::IsSupported(table_.ts()));
+  ASSERT_FALSE(SecondaryIndex::IsSupported(table_.value()));
+  ASSERT_TRUE(SecondaryIndex::IsSupported(table_.utid()));
+  ASSERT_TRUE(SecondaryIndex::IsSupported(table_.arg_set_id()));
+  ASSERT_TRUE(SecondaryIndex::IsSupported(table_.name()));
+}
+
+TEST_F(SecondaryIndexTest, IntegerFilters) {
+  std::vector<SqlValue> values{
+      SqlValue::Long(-1), SqlValue::Long(0),      SqlValue::Long(3),
+      SqlValue::Long(2),  SqlValue::Long(49),     SqlValue::Long(100),
+      SqlValue::Double(2.5), SqlValue::Double(-0.5), SqlValue::Double(1e20)};
+  for (Type type : {Type::kSorted, Type::kHash}) {
+    auto index = SecondaryIndex::Build(table_.utid(), type);
+    CheckFilters(index, table_.utid(), values);
+  }
+}
+
+TEST_F(SecondaryIndexTest, NullableIntegerFilters) {
+  std::vector<SqlValue> values{SqlValue::Long(-100), SqlValue::Long(-95),
+                               SqlValue::Long(0), SqlValue::Long(42),
+                               SqlValue::Long(99), SqlValue::Double(-90.5)};
+  for (Type type : {Type::kSorted, Type::kHash}) {
+    auto index = SecondaryIndex::Build(table_.arg_set_id(), type);
+    CheckFilters(index, table_.arg_set_id(), values);
+  }
+}
+
+TEST_F(SecondaryIndexTest, StringFilters) {
+  std::vector<SqlValue> values{
+      SqlValue::String("name0"), SqlValue::String("name15"),
+      SqlValue::String("name29"), SqlValue::String("name3"),
+      SqlValue::String("a"), SqlValue::String("z")};
+  auto index = SecondaryIndex::Build(table_.name(), Type::kSorted);
+  CheckFilters(index, table_.name(), values);
+}
+
+TEST_F(SecondaryIndexTest, UnsupportedFilters) {
+  auto index = SecondaryIndex::Build(table_.utid(), Type::kHash);
+
+  RowMap rm(0, kRowCount);
+  ASSERT_FALSE(index.FilterInto(table_.utid(), FilterOp::kNe,
+                                SqlValue::Long(1), &rm));
+  ASSERT_FALSE(index.FilterInto(table_.utid(), FilterOp::kEq,
+                                SqlValue::String("1"), &rm));
+  ASSERT_FALSE(
+      index.FilterInto(table_.utid(), FilterOp::kEq, SqlValue(), &rm));
+
+  // Most of the rows match, a scan is cheaper.
+  ASSERT_FALSE(index.FilterInto(table_.utid(), FilterOp::kGe,
+                                SqlValue::Long(1), &rm));
+  ASSERT_EQ(rm.size(), kRowCount);
+}
+
+TEST_F(SecondaryIndexTest, Stale) {
+  auto index = SecondaryIndex::Build(table_.utid(), Type::kHash);
+  ASSERT_FALSE(index.IsStale(table_.utid()));
+
+  table_.mutable_utid()->Set(10, 1);
+  ASSERT_TRUE(index.IsStale(table_.utid()));
+
+  index = SecondaryIndex::Build(table_.utid(), Type::kHash);
+  ASSERT_FALSE(index.IsStale(table_.utid()));
+
+  TestIndexTable::Row row;
+  row.ts = kRowCount;
+  table_.Insert(row);
+  ASSERT_TRUE(index.IsStale(table_.utid()));
+}
+
+TEST_F(SecondaryIndexTest, CacheBuildsIndexOnRepeatedFilters) {
+  SecondaryIndexCache cache;
+  const Column& col = table_.utid();
+  for (uint32_t i = 1; i < SecondaryIndexCache::kFiltersBeforeIndexing; ++i) {
+    RowMap rm(0, kRowCount);
+    ASSERT_FALSE(cache.FilterInto(col, FilterOp::kEq, SqlValue::Long(i), &rm));
+    ASSERT_EQ(cache.GetIndex(col), nullptr);
+  }
+
+  RowMap rm(0, kRowCount);
+  ASSERT_TRUE(cache.FilterInto(col, FilterOp::kEq, SqlValue::Long(4), &rm));
+  ASSERT_NE(cache.GetIndex(col), nullptr);
+  ASSERT_EQ(cache.GetIndex(col)->type(), Type::kHash);
+
+  RowMap expected(0, kRowCount);
+  col.FilterInto(FilterOp::kEq, SqlValue::Long(4), &expected);
+  ASSERT_EQ(ToVector(rm), ToVector(expected));
+
+  // Changing the column should drop the index.
+  table_.mutable_utid()->Set(0, 4);
+  ASSERT_EQ(cache.GetIndex(col), nullptr);
+}
+
+TEST_F(SecondaryIndexTest, TableFilterUsesIndex) {
+  for (uint32_t i = 0; i < 10; ++i) {
+    auto utid = static_cast<uint32_t>(i * 7 % 50);
+    auto arg_set_id = static_cast<int64_t>(i * 13 % 200) - 100;
+    RowMap rm = table_.FilterToRowMap(
+        {table_.utid().eq(utid), table_.arg_set_id().gt(arg_set_id)});
+
+    std::vector<uint32_t> expected;
+    for (uint32_t row = 0; row < kRowCount; ++row) {
+      auto opt_arg_set_id = table_.arg_set_id()[row];
+      if (table_.utid()[row] == utid && opt_arg_set_id &&
+          *opt_arg_set_id > arg_set_id) {
+        expected.push_back(row);
+      }
+    }
+    ASSERT_EQ(ToVector(rm), expected);
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
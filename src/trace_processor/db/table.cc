@@ -16,9 +16,49 @@
 
 #include "src/trace_processor/db/table.h"
 
+#include <string>
+
+#include "src/trace_processor/db/group_by.h"
+#include "src/trace_processor/db/hash_join.h"
+
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+template <typename T>
+std::unique_ptr<NullableVector<T>> ToNullableVector(
+    const std::vector<T>& values,
+    const std::vector<uint8_t>& is_null) {
+  std::unique_ptr<NullableVector<T>> nv(new NullableVector<T>());
+  for (uint32_t i = 0; i < values.size(); ++i) {
+    if (!is_null.empty() && is_null[i]) {
+      nv->AppendNull();
+    } else {
+      nv->Append(values[i]);
+    }
+  }
+  return nv;
+}
+
+const char* AggregateOpName(Aggregate::Op op) {
+  switch (op) {
+    case Aggregate::Op::kCount:
+      return "count";
+    case Aggregate::Op::kSum:
+      return "sum";
+    case Aggregate::Op::kMin:
+      return "min";
+    case Aggregate::Op::kMax:
+      return "max";
+    case Aggregate::Op::kAvg:
+      return "avg";
+  }
+  PERFETTO_FATAL("For GCC");
+}
+
+}  // namespace
+
 Table::Table() = default;
 Table::~Table() = default;
 
@@ -40,6 +80,9 @@ Table& Table::operator=(Table&& other) noexcept {
 
   row_maps_ = std::move(other.row_maps_);
   columns_ = std::move(other.columns_);
+  index_cache_ = std::move(other.index_cache_);
+  interval_index_ = std::move(other.interval_index_);
+  interval_index_cols_ = other.interval_index_cols_;
   for (Column& col : columns_) {
     col.table_ = this;
   }
@@ -64,6 +107,24 @@ Table Table::CopyExceptRowMaps() const {
   return table;
 }
 
+RowMap Table::FilterOverlappingToRowMap(uint32_t ts,
+                                        uint32_t dur,
+                                        int64_t start,
+                                        int64_t end) const {
+  const Column& ts_col = columns_[ts];
+  const Column& dur_col = columns_[dur];
+  PERFETTO_CHECK(IntervalIndex::IsSupported(ts_col, dur_col));
+
+  auto cols = std::make_pair(ts, dur);
+  if (!interval_index_ || interval_index_cols_ != cols ||
+      interval_index_->IsStale(ts_col, dur_col)) {
+    interval_index_.reset(
+        new IntervalIndex(IntervalIndex::Build(ts_col, dur_col)));
+    interval_index_cols_ = cols;
+  }
+  return interval_index_->FindOverlapping(start, end);
+}
+
 Table Table::Sort(const std::vector<Order>& od) const {
   if (od.empty())
     return Copy();
@@ -177,5 +238,114 @@ Table Table::LookupJoin(JoinKey left, const Table& other, JoinKey right) {
   return table;
 }
 
+Table Table::HashJoin(JoinKey left,
+                      const Table& other,
+                      JoinKey right) const {
+  const Column& left_col = columns_[left.col_idx];
+  const Column& right_col = other.columns_[right.col_idx];
+
+  // Strings are compared by their interned pointer.
+  PERFETTO_CHECK(left_col.type() != SqlValue::Type::kString ||
+                 string_pool_ == other.string_pool_);
+
+  std::vector<uint32_t> left_rows;
+  std::vector<uint32_t> right_rows;
+  HashJoinRows(left_col, right_col, &left_rows, &right_rows);
+
+  Table table(string_pool_, nullptr);
+  table.row_count_ = static_cast<uint32_t>(left_rows.size());
+
+  // The ids of the two tables are not unique in the joined table so it gets
+  // its own id column instead.
+  table.row_maps_.emplace_back(RowMap(0, table.row_count_));
+  table.columns_.emplace_back(Column::IdColumn(&table, 0, 0));
+
+  RowMap left_rm(std::move(left_rows));
+  for (const RowMap& rm : row_maps_)
+    table.row_maps_.emplace_back(rm.SelectRows(left_rm));
+
+  // As the rows are in the order of |this| table, the sorted columns of |this|
+  // table stay sorted.
+  for (const Column& col : columns_) {
+    if (col.IsId())
+      continue;
+    table.columns_.emplace_back(col, &table, table.columns_.size(),
+                                col.row_map_idx_ + 1);
+  }
+
+  RowMap right_rm(std::move(right_rows));
+  for (const RowMap& rm : other.row_maps_)
+    table.row_maps_.emplace_back(rm.SelectRows(right_rm));
+
+  uint32_t right_row_map_offset = static_cast<uint32_t>(row_maps_.size()) + 1;
+  for (const Column& col : other.columns_) {
+    if (col.IsId())
+      continue;
+    table.columns_.emplace_back(col, &table, table.columns_.size(),
+                                col.row_map_idx_ + right_row_map_offset);
+    table.columns_.back().flags_ &= ~Column::Flag::kSorted;
+  }
+  return table;
+}
+
+Table Table::GroupBy(const std::vector<uint32_t>& keys,
+                     const std::vector<Aggregate>& aggregates) const {
+  std::vector<const Column*> key_cols;
+  for (uint32_t key : keys)
+    key_cols.push_back(&columns_[key]);
+
+  std::vector<uint32_t> row_groups;
+  std::vector<uint32_t> group_first_rows;
+  GroupRows(key_cols, row_count_, &row_groups, &group_first_rows);
+
+  Table table(string_pool_, nullptr);
+  table.row_count_ = static_cast<uint32_t>(group_first_rows.size());
+
+  // The id column and the aggregates all use this RowMap as they have one
+  // value per group.
+  table.row_maps_.emplace_back(RowMap(0, table.row_count_));
+  table.columns_.emplace_back(Column::IdColumn(&table, 0, 0));
+
+  // The keys are read from the first row of each group. These rows are in
+  // increasing order so sorted keys stay sorted.
+  RowMap first_rows_rm(std::move(group_first_rows));
+  for (const RowMap& rm : row_maps_)
+    table.row_maps_.emplace_back(rm.SelectRows(first_rows_rm));
+  for (const Column* col : key_cols) {
+    table.columns_.emplace_back(*col, &table, table.columns_.size(),
+                                col->row_map_idx_ + 1);
+  }
+
+  for (const Aggregate& agg : aggregates) {
+    const Column* col = agg.col_idx ? &columns_[*agg.col_idx] : nullptr;
+    AggregateValues values;
+    ComputeAggregate(col, agg.op, row_groups, table.row_count_, &values);
+
+    // Columns only keep a pointer to their name so names built at runtime
+    // are interned in the string pool, which outlives the table.
+    const char* name = "count";
+    if (col) {
+      std::string agg_name =
+          std::string(AggregateOpName(agg.op)) + "_" + col->name();
+      StringPool::Id id =
+          string_pool_->InternString(base::StringView(agg_name));
+      name = string_pool_->Get(id).c_str();
+    }
+    uint32_t flags = values.is_null.empty() ? Column::Flag::kNonNull
+                                            : Column::Flag::kNoFlag;
+    uint32_t col_idx = static_cast<uint32_t>(table.columns_.size());
+    if (values.type == SqlValue::Type::kDouble) {
+      table.columns_.emplace_back(Column::WithOwnedStorage(
+          name, ToNullableVector(values.doubles, values.is_null), flags,
+          &table, col_idx, 0));
+    } else {
+      table.columns_.emplace_back(Column::WithOwnedStorage(
+          name, ToNullableVector(values.longs, values.is_null), flags, &table,
+          col_idx, 0));
+    }
+  }
+  return table;
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
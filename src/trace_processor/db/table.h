@@ -20,13 +20,17 @@
 #include <stdint.h>
 
 #include <limits>
+#include <memory>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
 #include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/db/column.h"
+#include "src/trace_processor/db/interval_index.h"
+#include "src/trace_processor/db/secondary_index.h"
 #include "src/trace_processor/db/typed_column.h"
 
 namespace perfetto {
@@ -84,6 +88,10 @@ class Table {
       bool is_id;
       bool is_sorted;
       bool is_hidden;
+
+      // Whether filters on this column can be computed using a secondary
+      // index (see SecondaryIndex) rather than by scanning the column.
+      bool is_indexable;
     };
     std::vector<Column> columns;
   };
@@ -112,11 +120,24 @@ class Table {
       RowMap::OptimizeFor optimize_for = RowMap::OptimizeFor::kMemory) const {
     RowMap rm(0, row_count_, optimize_for);
     for (const Constraint& c : cs) {
-      columns_[c.col_idx].FilterInto(c.op, c.value, &rm);
+      const Column& col = columns_[c.col_idx];
+      if (!index_cache_.FilterInto(col, c.op, c.value, &rm))
+        col.FilterInto(c.op, c.value, &rm);
     }
     return rm;
   }
 
+  // Returns a RowMap which, if applied to the table, would contain the rows
+  // whose interval [ts, ts + dur), given by the columns at index |ts| and
+  // |dur|, overlaps [start, end). See IntervalIndex for the exact semantics.
+  //
+  // The first call builds an interval index over the two columns which is
+  // reused by the following calls until either column changes.
+  RowMap FilterOverlappingToRowMap(uint32_t ts,
+                                   uint32_t dur,
+                                   int64_t start,
+                                   int64_t end) const;
+
   // Applies the given RowMap to the current table by picking out the rows
   // specified in the RowMap to be present in the output table.
   // Note: the RowMap should not reorder this table; this is guaranteed if the
@@ -150,6 +171,29 @@ class Table {
   //  * |left|'s values must exist in |right|
   Table LookupJoin(JoinKey left, const Table& other, JoinKey right);
 
+  // Computes the inner join of |this| table with the |other| table where the
+  // value of column |left| of |this| table is equal to the value of column
+  // |right| of the |other| table.
+  //
+  // The returned table has one row for each pair of matching rows, ordered by
+  // the rows of |this| table. Its columns are an id column numbering these
+  // rows followed by the columns of |this| table and then those of |other|
+  // (except their id columns which would not be unique). The join is computed
+  // using a hash table built from |other| so it should be the smaller of the
+  // two tables.
+  Table HashJoin(JoinKey left, const Table& other, JoinKey right) const;
+
+  // Groups the rows of the table having the same values for the |keys|
+  // columns and computes the |aggregates| over the rows of each group.
+  //
+  // The returned table has one row per group, in the order of the first row
+  // of each group. Its columns are an id column numbering the groups, the
+  // |keys| columns and one column per aggregate named after its function and
+  // the aggregated column (e.g. "sum_dur"; "count" for counts of all the
+  // rows), as in the GROUP_BY operator table.
+  Table GroupBy(const std::vector<uint32_t>& keys,
+                const std::vector<Aggregate>& aggregates) const;
+
   template <typename T>
   Table ExtendWithColumn(const char* name,
                          std::unique_ptr<NullableVector<T>> sv,
@@ -210,6 +254,14 @@ class Table {
  private:
   friend class Column;
 
+  // Indexes built on demand for the columns which are filtered on often.
+  mutable SecondaryIndexCache index_cache_;
+
+  // The interval index last built by |FilterOverlappingToRowMap| and the
+  // indices of the ts and dur columns it was built on.
+  mutable std::unique_ptr<IntervalIndex> interval_index_;
+  mutable std::pair<uint32_t, uint32_t> interval_index_cols_;
+
   Table Copy() const;
   Table CopyExceptRowMaps() const;
 };
@@ -48,6 +48,16 @@ PERFETTO_TP_TABLE(PERFETTO_TP_TEST_EVENT_TABLE_DEF);
 
 TestEventTable::~TestEventTable() = default;
 
+#define PERFETTO_TP_TEST_ARG_TABLE_DEF(NAME, PARENT, C) \
+  NAME(TestArgTable, "arg")                             \
+  PARENT(PERFETTO_TP_ROOT_TABLE_PARENT_DEF, C)          \
+  C(base::Optional<int64_t>, arg_set_id)                \
+  C(double, value)                                      \
+  C(StringPool::Id, key)
+PERFETTO_TP_TABLE(PERFETTO_TP_TEST_ARG_TABLE_DEF);
+
+TestArgTable::~TestArgTable() = default;
+
 TEST(TableTest, ExtendingTableTwice) {
   StringPool pool;
   TestEventTable table{&pool, nullptr};
@@ -65,6 +75,226 @@ TEST(TableTest, ExtendingTableTwice) {
   ASSERT_TRUE(filtered_table.GetColumnByName("b")->Max().has_value());
 }
 
+TEST(TableTest, HashJoin) {
+  StringPool pool;
+  TestEventTable events{&pool, nullptr};
+  TestArgTable args{&pool, nullptr};
+
+  for (int64_t i = 0; i < 6; ++i)
+    events.Insert(TestEventTable::Row(i * 10, i % 3));
+
+  auto add_arg = [&](base::Optional<int64_t> arg_set_id, double value) {
+    TestArgTable::Row row;
+    row.arg_set_id = arg_set_id;
+    row.value = value;
+    args.Insert(row);
+  };
+  add_arg(1, 10);
+  add_arg(base::nullopt, 11);
+  add_arg(2, 12);
+  add_arg(1, 13);
+
+  uint32_t left_col = events.arg_set_id().index_in_table();
+  uint32_t right_col = args.arg_set_id().index_in_table();
+  Table joined =
+      events.HashJoin(JoinKey{left_col}, args, JoinKey{right_col});
+
+  // Events with arg set 1 match two args and those with arg set 2 one arg.
+  std::vector<std::pair<int64_t, double>> expected{
+      {10, 10}, {10, 13}, {20, 12}, {40, 10}, {40, 13}, {50, 12}};
+  ASSERT_EQ(joined.row_count(), expected.size());
+
+  // The joined table numbers its own rows and the sorted columns of the left
+  // table stay sorted.
+  ASSERT_EQ(joined.GetColumnCount(), 1 + 3 + 4u);
+  ASSERT_EQ(joined.GetColumn(0).Get(5).long_value, 5);
+  const auto* ts = joined.GetColumnByName("ts");
+  const auto* value = joined.GetColumnByName("value");
+  ASSERT_TRUE(ts->IsSorted());
+  for (uint32_t i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(ts->Get(i).long_value, expected[i].first);
+    ASSERT_EQ(value->Get(i).double_value, expected[i].second);
+  }
+
+  // Filters on the joined table use the rows of both tables.
+  Table filtered = joined.Filter({ts->gt_value(SqlValue::Long(15)),
+                                  value->lt_value(SqlValue::Double(12.5))});
+  ASSERT_EQ(filtered.row_count(), 3u);
+}
+
+TEST(TableTest, HashJoinMixedTypes) {
+  StringPool pool;
+  TestEventTable events{&pool, nullptr};
+  TestArgTable args{&pool, nullptr};
+
+  for (int64_t i = 0; i < 4; ++i)
+    events.Insert(TestEventTable::Row(i, i));
+  for (double value : {1.0, 2.5, 3.0, -0.0}) {
+    TestArgTable::Row row;
+    row.value = value;
+    args.Insert(row);
+  }
+
+  // Integers compare equal to doubles with the same value.
+  Table joined = events.HashJoin(JoinKey{events.arg_set_id().index_in_table()},
+                                 args, JoinKey{args.value().index_in_table()});
+  ASSERT_EQ(joined.row_count(), 3u);
+  const auto* ts = joined.GetColumnByName("ts");
+  ASSERT_EQ(ts->Get(0).long_value, 0);
+  ASSERT_EQ(ts->Get(1).long_value, 1);
+  ASSERT_EQ(ts->Get(2).long_value, 3);
+}
+
+TEST(TableTest, HashJoinStrings) {
+  StringPool pool;
+  TestArgTable args{&pool, nullptr};
+
+  for (const char* key : {"a", "b", "a", "c"}) {
+    TestArgTable::Row row;
+    row.key = pool.InternString(key);
+    args.Insert(row);
+  }
+  TestArgTable::Row null_key;
+  args.Insert(null_key);
+
+  uint32_t key_col = args.key().index_in_table();
+  Table joined = args.HashJoin(JoinKey{key_col}, args, JoinKey{key_col});
+
+  // "a" matches itself twice on both sides, "b" and "c" match themselves and
+  // nulls never match.
+  ASSERT_EQ(joined.row_count(), 6u);
+
+  // Joining a string with a number never matches.
+  Table mixed = args.HashJoin(JoinKey{key_col}, args,
+                              JoinKey{args.value().index_in_table()});
+  ASSERT_EQ(mixed.row_count(), 0u);
+}
+
+TEST(TableTest, GroupBy) {
+  StringPool pool;
+  TestArgTable args{&pool, nullptr};
+
+  auto add_arg = [&](base::Optional<int64_t> arg_set_id, double value,
+                     const char* key) {
+    TestArgTable::Row row;
+    row.arg_set_id = arg_set_id;
+    row.value = value;
+    row.key = pool.InternString(key);
+    args.Insert(row);
+  };
+  add_arg(2, 1, "a");
+  add_arg(1, 2, "b");
+  add_arg(2, 3, "a");
+  add_arg(base::nullopt, 4, "b");
+  add_arg(2, 5, "b");
+  add_arg(base::nullopt, 6, "b");
+
+  uint32_t arg_set_id = args.arg_set_id().index_in_table();
+  uint32_t value = args.value().index_in_table();
+  uint32_t key = args.key().index_in_table();
+  Table grouped = args.GroupBy(
+      {arg_set_id}, {{Aggregate::Op::kCount, base::nullopt},
+                     {Aggregate::Op::kSum, value},
+                     {Aggregate::Op::kMin, value},
+                     {Aggregate::Op::kAvg, value},
+                     {Aggregate::Op::kCount, arg_set_id}});
+
+  // Groups are in the order of their first row and nulls are grouped
+  // together.
+  ASSERT_EQ(grouped.row_count(), 3u);
+  ASSERT_EQ(grouped.GetColumnCount(), 1 + 1 + 5u);
+  auto get = [&grouped](uint32_t col, uint32_t row) {
+    return grouped.GetColumn(col).Get(row);
+  };
+  ASSERT_EQ(get(1, 0).long_value, 2);
+  ASSERT_EQ(get(1, 1).long_value, 1);
+  ASSERT_TRUE(get(1, 2).is_null());
+
+  ASSERT_EQ(get(2, 0).long_value, 3);
+  ASSERT_EQ(get(3, 0).double_value, 9);
+  ASSERT_EQ(get(4, 0).double_value, 1);
+  ASSERT_EQ(get(5, 0).double_value, 3);
+  ASSERT_EQ(get(6, 0).long_value, 3);
+
+  ASSERT_EQ(get(2, 2).long_value, 2);
+  ASSERT_EQ(get(3, 2).double_value, 10);
+  ASSERT_EQ(get(6, 2).long_value, 0);
+
+  // Group by multiple keys.
+  Table by_two = args.GroupBy({arg_set_id, key},
+                              {{Aggregate::Op::kMax, value}});
+  ASSERT_EQ(by_two.row_count(), 4u);
+  ASSERT_EQ(by_two.GetColumn(3).Get(0).double_value, 3);
+  ASSERT_EQ(by_two.GetColumn(3).Get(2).double_value, 6);
+  ASSERT_EQ(by_two.GetColumn(3).Get(3).double_value, 5);
+}
+
+TEST(TableTest, GroupBySorted) {
+  StringPool pool;
+  TestEventTable events{&pool, nullptr};
+  for (int64_t ts : {1, 1, 2, 5, 5, 5})
+    events.Insert(TestEventTable::Row(ts, ts * 10));
+
+  uint32_t ts = events.ts().index_in_table();
+  uint32_t arg_set_id = events.arg_set_id().index_in_table();
+  Table grouped = events.GroupBy({ts}, {{Aggregate::Op::kSum, arg_set_id},
+                                        {Aggregate::Op::kMax, arg_set_id}});
+  ASSERT_EQ(grouped.row_count(), 3u);
+  ASSERT_TRUE(grouped.GetColumn(1).IsSorted());
+  ASSERT_EQ(grouped.GetColumn(1).Get(2).long_value, 5);
+  ASSERT_EQ(grouped.GetColumn(2).Get(0).long_value, 20);
+  ASSERT_EQ(grouped.GetColumn(2).Get(2).long_value, 150);
+  ASSERT_EQ(grouped.GetColumn(3).Get(1).long_value, 20);
+
+  // Without keys, there is a single group.
+  Table total = events.GroupBy({}, {{Aggregate::Op::kSum, arg_set_id}});
+  ASSERT_EQ(total.row_count(), 1u);
+  ASSERT_EQ(total.GetColumn(1).Get(0).long_value, 190);
+}
+
+TEST(TableTest, GroupByAggregateNames) {
+  StringPool pool;
+  TestEventTable events{&pool, nullptr};
+  for (int64_t ts : {1, 1, 2})
+    events.Insert(TestEventTable::Row(ts, ts * 10));
+
+  uint32_t ts = events.ts().index_in_table();
+  uint32_t arg_set_id = events.arg_set_id().index_in_table();
+  Table grouped = events.GroupBy({ts}, {{Aggregate::Op::kCount, base::nullopt},
+                                        {Aggregate::Op::kSum, arg_set_id},
+                                        {Aggregate::Op::kMax, arg_set_id}});
+
+  // Aggregates over the same column have distinct names.
+  const auto* count = grouped.GetColumnByName("count");
+  const auto* sum = grouped.GetColumnByName("sum_arg_set_id");
+  const auto* max = grouped.GetColumnByName("max_arg_set_id");
+  ASSERT_NE(count, nullptr);
+  ASSERT_NE(sum, nullptr);
+  ASSERT_NE(max, nullptr);
+  ASSERT_EQ(grouped.GetColumnByName("arg_set_id"), nullptr);
+
+  ASSERT_EQ(count->Get(0).long_value, 2);
+  ASSERT_EQ(sum->Get(0).long_value, 20);
+  ASSERT_EQ(max->Get(0).long_value, 10);
+  ASSERT_EQ(sum->Get(1).long_value, 20);
+}
+
+TEST(TableTest, GroupByNullAggregates) {
+  StringPool pool;
+  TestArgTable args{&pool, nullptr};
+  for (int i = 0; i < 2; ++i)
+    args.Insert(TestArgTable::Row());
+
+  uint32_t key = args.key().index_in_table();
+  uint32_t arg_set_id = args.arg_set_id().index_in_table();
+  Table grouped = args.GroupBy({key}, {{Aggregate::Op::kSum, arg_set_id},
+                                       {Aggregate::Op::kAvg, arg_set_id}});
+  ASSERT_EQ(grouped.row_count(), 1u);
+  ASSERT_TRUE(grouped.GetColumn(1).Get(0).is_null());
+  ASSERT_TRUE(grouped.GetColumn(2).Get(0).is_null());
+  ASSERT_TRUE(grouped.GetColumn(3).Get(0).is_null());
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
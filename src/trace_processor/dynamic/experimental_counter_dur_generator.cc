@@ -26,9 +26,9 @@ ExperimentalCounterDurGenerator::~ExperimentalCounterDurGenerator() = default;
 
 Table::Schema ExperimentalCounterDurGenerator::CreateSchema() {
   Table::Schema schema = tables::CounterTable::Schema();
-  schema.columns.emplace_back(
-      Table::Schema::Column{"dur", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+  schema.columns.emplace_back(Table::Schema::Column{
+      "dur", SqlValue::Type::kLong, false /* is_id */, false /* is_sorted */,
+      false /* is_hidden */, false /* is_indexable */});
   return schema;
 }
 
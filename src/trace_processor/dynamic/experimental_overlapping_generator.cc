@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_overlapping_generator.h"
+
+#include "src/trace_processor/sqlite/sqlite_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+constexpr char kStartColumnName[] = "overlap_start";
+constexpr char kEndColumnName[] = "overlap_end";
+
+uint32_t ColumnIndex(const Table::Schema& schema, const char* name) {
+  for (uint32_t i = 0; i < schema.columns.size(); ++i) {
+    if (schema.columns[i].name == name)
+      return i;
+  }
+  PERFETTO_FATAL("Column %s not found", name);
+}
+
+std::unique_ptr<NullableVector<int64_t>> ConstantColumn(int64_t value,
+                                                        uint32_t size) {
+  std::unique_ptr<NullableVector<int64_t>> column(
+      new NullableVector<int64_t>());
+  for (uint32_t i = 0; i < size; ++i)
+    column->Append(value);
+  return column;
+}
+
+}  // namespace
+
+// static
+bool ExperimentalOverlappingGenerator::IsSupported(const Table& table) {
+  const Column* ts = table.GetColumnByName("ts");
+  const Column* dur = table.GetColumnByName("dur");
+  return ts && dur && IntervalIndex::IsSupported(*ts, *dur);
+}
+
+// static
+std::string ExperimentalOverlappingGenerator::TableNameFor(
+    const std::string& table_name) {
+  return "experimental_overlapping_" + table_name;
+}
+
+ExperimentalOverlappingGenerator::ExperimentalOverlappingGenerator(
+    Table::Schema schema,
+    const Table* table,
+    const std::string& table_name)
+    : schema_(std::move(schema)),
+      table_(table),
+      table_name_(TableNameFor(table_name)) {
+  PERFETTO_DCHECK(IsSupported(*table_));
+  ts_col_idx_ = ColumnIndex(schema_, "ts");
+  dur_col_idx_ = ColumnIndex(schema_, "dur");
+
+  // The arguments are passed as equality constraints on hidden columns; the
+  // computed table fills these with the arguments so the rows are not
+  // filtered out again by these constraints.
+  start_col_idx_ = static_cast<uint32_t>(schema_.columns.size());
+  schema_.columns.emplace_back(Table::Schema::Column{
+      kStartColumnName, SqlValue::Type::kLong, false /* is_id */,
+      false /* is_sorted */, true /* is_hidden */, false /* is_indexable */});
+  end_col_idx_ = static_cast<uint32_t>(schema_.columns.size());
+  schema_.columns.emplace_back(Table::Schema::Column{
+      kEndColumnName, SqlValue::Type::kLong, false /* is_id */,
+      false /* is_sorted */, true /* is_hidden */, false /* is_indexable */});
+}
+
+ExperimentalOverlappingGenerator::~ExperimentalOverlappingGenerator() =
+    default;
+
+Table::Schema ExperimentalOverlappingGenerator::CreateSchema() {
+  return schema_;
+}
+
+std::string ExperimentalOverlappingGenerator::TableName() {
+  return table_name_;
+}
+
+uint32_t ExperimentalOverlappingGenerator::EstimateRowCount() {
+  // Overlap queries are usually over a small range of the trace.
+  return table_->row_count() / 16;
+}
+
+util::Status ExperimentalOverlappingGenerator::ValidateConstraints(
+    const QueryConstraints& qc) {
+  bool has_start = false;
+  bool has_end = false;
+  for (const auto& c : qc.constraints()) {
+    if (!sqlite_utils::IsOpEq(c.op))
+      continue;
+    has_start |= static_cast<uint32_t>(c.column) == start_col_idx_;
+    has_end |= static_cast<uint32_t>(c.column) == end_col_idx_;
+  }
+  return has_start && has_end
+             ? util::OkStatus()
+             : util::ErrStatus("%s must have %s and %s constraints",
+                               table_name_.c_str(), kStartColumnName,
+                               kEndColumnName);
+}
+
+std::unique_ptr<Table> ExperimentalOverlappingGenerator::ComputeTable(
+    const std::vector<Constraint>& cs,
+    const std::vector<Order>&) {
+  base::Optional<int64_t> start;
+  base::Optional<int64_t> end;
+  for (const Constraint& c : cs) {
+    if (c.op != FilterOp::kEq || c.value.type != SqlValue::Type::kLong)
+      continue;
+    if (c.col_idx == start_col_idx_) {
+      start = c.value.long_value;
+    } else if (c.col_idx == end_col_idx_) {
+      end = c.value.long_value;
+    }
+  }
+  if (!start || !end)
+    return nullptr;
+
+  Table table = table_->Apply(
+      table_->FilterOverlappingToRowMap(ts_col_idx_, dur_col_idx_, *start,
+                                        *end));
+  uint32_t size = table.row_count();
+  return std::unique_ptr<Table>(new Table(
+      table
+          .ExtendWithColumn(kStartColumnName, ConstantColumn(*start, size),
+                            TypedColumn<int64_t>::default_flags())
+          .ExtendWithColumn(kEndColumnName, ConstantColumn(*end, size),
+                            TypedColumn<int64_t>::default_flags())));
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_GENERATOR_H_
+#define SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_GENERATOR_H_
+
+#include <string>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Dynamic table returning the rows of a table whose [ts, ts + dur) interval
+// overlaps the range [start, end) passed as arguments, e.g.
+// SELECT * FROM experimental_overlapping_sched_slice(1000, 2000).
+//
+// The rows are found using the interval index of the table (see
+// Table::FilterOverlappingToRowMap) rather than by scanning the whole table
+// as SQLite would do for the equivalent ts < end AND ts + dur > start filter.
+class ExperimentalOverlappingGenerator
+    : public DbSqliteTable::DynamicTableGenerator {
+ public:
+  // Returns whether |table| has the ts and dur columns needed to compute
+  // overlapping rows.
+  static bool IsSupported(const Table& table);
+
+  // Returns the name of the table function for the table |table_name|.
+  static std::string TableNameFor(const std::string& table_name);
+
+  ExperimentalOverlappingGenerator(Table::Schema schema,
+                                   const Table* table,
+                                   const std::string& table_name);
+  ~ExperimentalOverlappingGenerator() override;
+
+  Table::Schema CreateSchema() override;
+  std::string TableName() override;
+  uint32_t EstimateRowCount() override;
+  util::Status ValidateConstraints(const QueryConstraints&) override;
+  std::unique_ptr<Table> ComputeTable(const std::vector<Constraint>& cs,
+                                      const std::vector<Order>& ob) override;
+
+ private:
+  Table::Schema schema_;
+  const Table* table_ = nullptr;
+  std::string table_name_;
+
+  uint32_t ts_col_idx_ = 0;
+  uint32_t dur_col_idx_ = 0;
+
+  // The index of the hidden columns storing the arguments of the function.
+  uint32_t start_col_idx_ = 0;
+  uint32_t end_col_idx_ = 0;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_DYNAMIC_EXPERIMENTAL_OVERLAPPING_GENERATOR_H_
@@ -0,0 +1,158 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <sqlite3.h>
+
+#include "src/trace_processor/dynamic/experimental_overlapping_generator.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/sqlite/span_join_operator_table.h"
+#include "src/trace_processor/tables/slice_tables.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using benchmark::Counter;
+using tables::SliceTable;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Fills |slices| with |size| slices spread over 1024 tracks: the slices of a
+// track don't overlap each other, like the slices of a thread at a given
+// depth.
+void FillSlices(uint32_t size, SliceTable* slices) {
+  static constexpr uint32_t kRandomSeed = 476;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+  for (uint32_t i = 0; i < size; ++i) {
+    SliceTable::Row row;
+    row.ts = i;
+    row.dur = rnd_engine() % 1000;
+    row.track_id = tables::TrackTable::Id(i % 1024);
+    slices->Insert(row);
+  }
+}
+
+void ExecOrDie(sqlite3* db, const std::string& sql) {
+  PERFETTO_CHECK(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) ==
+                 SQLITE_OK);
+}
+
+int64_t QueryInt64(sqlite3* db, const std::string& sql) {
+  ScopedStmt stmt;
+  sqlite3_stmt* raw_stmt;
+  PERFETTO_CHECK(sqlite3_prepare_v2(db, sql.c_str(), -1, &raw_stmt,
+                                    nullptr) == SQLITE_OK);
+  stmt.reset(raw_stmt);
+  PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+  return sqlite3_column_int64(*stmt, 0);
+}
+
+// Compares finding the slices overlapping 1% of the trace (directly or by
+// span joining them with a single span) by scanning the slice table with
+// using its interval index. The index is built by the first iteration.
+void BenchmarkOverlap(benchmark::State& state,
+                      bool span_join,
+                      bool interval_index) {
+  const uint32_t size =
+      IsBenchmarkFunctionalOnly() ? 1024 : 10 * 1024 * 1024;
+  StringPool pool;
+  SliceTable slices(&pool, nullptr);
+  FillSlices(size, &slices);
+
+  sqlite3_initialize();
+  QueryCache cache;
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+
+  ExecOrDie(*db, "CREATE TABLE perfetto_tables(name STRING)");
+  DbSqliteTable::RegisterTable(*db, &cache, SliceTable::Schema(), &slices,
+                               slices.table_name());
+
+  SpanJoinOperatorTable::OverlappingTableMap overlapping_tables;
+  if (interval_index) {
+    DbSqliteTable::RegisterTable(
+        *db, &cache,
+        std::unique_ptr<ExperimentalOverlappingGenerator>(
+            new ExperimentalOverlappingGenerator(
+                SliceTable::Schema(), &slices, slices.table_name())));
+    overlapping_tables[slices.table_name()] =
+        ExperimentalOverlappingGenerator::TableNameFor(slices.table_name());
+  }
+  SpanJoinOperatorTable::Context context;
+  context.overlapping_tables = &overlapping_tables;
+  SpanJoinOperatorTable::RegisterTable(*db, context);
+
+  const int64_t start = size / 2;
+  const int64_t end = start + size / 100;
+  ExecOrDie(*db, "CREATE TABLE spans(ts BIG INT, dur BIG INT)");
+  ExecOrDie(*db, "INSERT INTO spans VALUES (0, " + std::to_string(size) + ")");
+  ExecOrDie(*db,
+            "CREATE VIRTUAL TABLE sp "
+            "USING span_join(internal_slice PARTITIONED track_id, spans)");
+
+  std::string range = std::to_string(start) + ", " + std::to_string(end);
+  std::string sql;
+  if (span_join) {
+    sql = "SELECT COUNT(*) FROM sp WHERE ts >= " + std::to_string(start) +
+          " AND ts < " + std::to_string(end);
+  } else if (interval_index) {
+    sql = "SELECT COUNT(*) FROM experimental_overlapping_internal_slice(" +
+          range + ")";
+  } else {
+    sql = "SELECT COUNT(*) FROM internal_slice WHERE ts < " +
+          std::to_string(end) + " AND ts + dur > " + std::to_string(start);
+  }
+
+  int64_t count = 0;
+  for (auto _ : state) {
+    count = QueryInt64(*db, sql);
+    benchmark::DoNotOptimize(count);
+  }
+  state.counters["rows"] =
+      Counter(static_cast<double>(count), Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
+
+static void BM_OverlapScan(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkOverlap(state, false, false);
+}
+BENCHMARK(BM_OverlapScan)->Unit(benchmark::kMillisecond);
+
+static void BM_OverlapIntervalIndex(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkOverlap(state, false, true);
+}
+BENCHMARK(BM_OverlapIntervalIndex)->Unit(benchmark::kMillisecond);
+
+static void BM_SpanJoinOverlapScan(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkOverlap(state, true, false);
+}
+BENCHMARK(BM_SpanJoinOverlapScan)->Unit(benchmark::kMillisecond);
+
+static void BM_SpanJoinOverlapIntervalIndex(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkOverlap(state, true, true);
+}
+BENCHMARK(BM_SpanJoinOverlapIntervalIndex)->Unit(benchmark::kMillisecond);
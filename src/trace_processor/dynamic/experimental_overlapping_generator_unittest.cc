@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/dynamic/experimental_overlapping_generator.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/sqlite/span_join_operator_table.h"
+#include "src/trace_processor/tables/slice_tables.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class ExperimentalOverlappingGeneratorTest : public ::testing::Test {
+ public:
+  ExperimentalOverlappingGeneratorTest() : slices_(&pool_, nullptr) {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    // Slices on 4 tracks which don't overlap on the same track, some of them
+    // being instants or incomplete.
+    std::minstd_rand0 rnd_engine(42);
+    int64_t ts = 0;
+    for (uint32_t i = 0; i < 200; ++i) {
+      tables::SliceTable::Row slice;
+      ts += rnd_engine() % 10;
+      slice.ts = ts;
+      slice.dur = i % 50 == 0 ? -1 : static_cast<int64_t>(rnd_engine() % 4);
+      slice.track_id = tables::TrackTable::Id(i % 4);
+      slices_.Insert(slice);
+    }
+
+    RunStatement("CREATE TABLE perfetto_tables(name STRING)");
+    DbSqliteTable::RegisterTable(db_.get(), &cache_,
+                                 tables::SliceTable::Schema(), &slices_,
+                                 slices_.table_name());
+    DbSqliteTable::RegisterTable(
+        db_.get(), &cache_,
+        std::unique_ptr<ExperimentalOverlappingGenerator>(
+            new ExperimentalOverlappingGenerator(
+                tables::SliceTable::Schema(), &slices_,
+                slices_.table_name())));
+    overlapping_tables_[slices_.table_name()] =
+        ExperimentalOverlappingGenerator::TableNameFor(slices_.table_name());
+    SpanJoinOperatorTable::Context context;
+    context.overlapping_tables = &overlapping_tables_;
+    SpanJoinOperatorTable::RegisterTable(db_.get(), context);
+
+    // A copy of the slices which span_join can only scan.
+    RunStatement(
+        "CREATE TABLE slice_copy AS "
+        "SELECT ts, dur, track_id FROM internal_slice");
+  }
+
+  void PrepareValidStatement(const std::string& sql) {
+    int size = static_cast<int>(sql.size());
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(*db_, sql.c_str(), size, &stmt, nullptr),
+              SQLITE_OK);
+    stmt_.reset(stmt);
+  }
+
+  void RunStatement(const std::string& sql) {
+    PrepareValidStatement(sql);
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+  }
+
+  // Returns the values of the columns of all the rows returned by |sql|.
+  std::vector<int64_t> Query(const std::string& sql) {
+    std::vector<int64_t> values;
+    PrepareValidStatement(sql);
+    while (sqlite3_step(stmt_.get()) == SQLITE_ROW) {
+      for (int i = 0; i < sqlite3_column_count(stmt_.get()); ++i)
+        values.push_back(sqlite3_column_int64(stmt_.get(), i));
+    }
+    return values;
+  }
+
+ protected:
+  StringPool pool_;
+  tables::SliceTable slices_;
+  QueryCache cache_;
+  SpanJoinOperatorTable::OverlappingTableMap overlapping_tables_;
+
+  ScopedDb db_;
+  ScopedStmt stmt_;
+};
+
+TEST_F(ExperimentalOverlappingGeneratorTest, MatchesScan) {
+  for (int64_t start = 0; start < 1000; start += 37) {
+    std::string end = std::to_string(start + 20);
+    std::string overlapping =
+        "SELECT id FROM experimental_overlapping_internal_slice(" +
+        std::to_string(start) + ", " + end + ")";
+    std::string scan =
+        "SELECT id FROM internal_slice WHERE ts < " + end +
+        " AND MAX(ts + dur, ts + 1) > " + std::to_string(start);
+    ASSERT_EQ(Query(overlapping), Query(scan)) << start;
+  }
+}
+
+TEST_F(ExperimentalOverlappingGeneratorTest, RequiresArgs) {
+  sqlite3_stmt* stmt = nullptr;
+  int ret = sqlite3_prepare_v2(
+      *db_, "SELECT * FROM experimental_overlapping_internal_slice", -1, &stmt,
+      nullptr);
+  if (ret == SQLITE_OK)
+    ret = sqlite3_step(stmt);
+  sqlite3_finalize(stmt);
+  ASSERT_NE(ret, SQLITE_ROW);
+  ASSERT_NE(ret, SQLITE_DONE);
+}
+
+TEST_F(ExperimentalOverlappingGeneratorTest, SpanJoin) {
+  RunStatement("CREATE TABLE spans(ts BIG INT, dur BIG INT, track_id INT)");
+  for (int64_t i = 0; i < 40; ++i) {
+    RunStatement("INSERT INTO spans VALUES(" + std::to_string(i * 25) + ", " +
+                 std::to_string(i % 3 == 0 ? 0 : 20) + ", " +
+                 std::to_string(i % 4) + ")");
+  }
+  RunStatement("CREATE TABLE global_spans(ts BIG INT, dur BIG INT)");
+  RunStatement("INSERT INTO global_spans VALUES(0, 1000)");
+
+  // Joins reading the slices through their interval index should return the
+  // same spans as when scanning the copy of the slices, including for left
+  // joins where one of the two tables emits shadows.
+  const char* joins[] = {
+      "span_join(%s PARTITIONED track_id, spans PARTITIONED track_id)",
+      "span_join(%s PARTITIONED track_id, global_spans)",
+      "span_left_join(%s PARTITIONED track_id, spans PARTITIONED track_id)",
+      "span_left_join(spans PARTITIONED track_id, %s PARTITIONED track_id)",
+  };
+  const char* filters[] = {
+      "ts >= 200 AND ts < 400",
+      "ts > 200 AND ts <= 400",
+      "ts = 275",
+      "ts < 100",
+      "ts >= 900",
+  };
+  for (const char* join : joins) {
+    char indexed[256];
+    char scanned[256];
+    snprintf(indexed, sizeof(indexed), join, "internal_slice");
+    snprintf(scanned, sizeof(scanned), join, "slice_copy");
+    RunStatement(std::string("CREATE VIRTUAL TABLE indexed USING ") + indexed);
+    RunStatement(std::string("CREATE VIRTUAL TABLE scanned USING ") + scanned);
+    size_t total_size = 0;
+    for (const char* filter : filters) {
+      std::string where = std::string(" WHERE ") + filter;
+      std::string order = " ORDER BY track_id, ts";
+      std::vector<int64_t> expected =
+          Query("SELECT ts, dur, track_id FROM scanned" + where + order);
+      total_size += expected.size();
+      ASSERT_EQ(Query("SELECT ts, dur, track_id FROM indexed" + where + order),
+                expected)
+          << join << filter;
+    }
+    ASSERT_GT(total_size, 0u) << join;
+    RunStatement("DROP TABLE indexed");
+    RunStatement("DROP TABLE scanned");
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -18,11 +18,13 @@
 
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_utils.h"
+#include "perfetto/ext/base/thread_pool.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/ninja/ninja_log_parser.h"
 #include "src/trace_processor/importers/proto/proto_trace_parser.h"
 #include "src/trace_processor/importers/proto/proto_trace_tokenizer.h"
 #include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/util/status_macros.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -55,90 +57,114 @@ util::Status ForwardingTraceParser::Parse(std::unique_ptr<uint8_t[]> data,
                                           size_t size) {
   // If this is the first Parse() call, guess the trace type and create the
   // appropriate parser.
+  if (!reader_)
+    RETURN_IF_ERROR(CreateReader(data.get(), size));
+  return reader_->Parse(std::move(data), size);
+}
+
+util::Status ForwardingTraceParser::ParseBlob(TraceBlobView blob) {
+  if (!reader_)
+    RETURN_IF_ERROR(CreateReader(blob.data(), blob.length()));
+  return reader_->ParseBlob(std::move(blob));
+}
+
+util::Status ForwardingTraceParser::CreateReader(const uint8_t* data,
+                                                 size_t size) {
   static const int64_t kMaxWindowSize = std::numeric_limits<int64_t>::max();
-  if (!reader_) {
-    TraceType trace_type;
-    {
-      auto scoped_trace = context_->storage->TraceExecutionTimeIntoStats(
-          stats::guess_trace_type_duration_ns);
-      trace_type = GuessTraceType(data.get(), size);
+  TraceType trace_type;
+  {
+    auto scoped_trace = context_->storage->TraceExecutionTimeIntoStats(
+        stats::guess_trace_type_duration_ns);
+    trace_type = GuessTraceType(data, size);
+  }
+  switch (trace_type) {
+    case kJsonTraceType: {
+      PERFETTO_DLOG("JSON trace detected");
+      if (context_->json_trace_tokenizer && context_->json_trace_parser) {
+        reader_ = std::move(context_->json_trace_tokenizer);
+
+        // JSON traces have no guarantees about the order of events in them.
+        context_->sorter.reset(new TraceSorter(
+            std::move(context_->json_trace_parser), kMaxWindowSize));
+      } else {
+        return util::ErrStatus("JSON support is disabled");
+      }
+      break;
     }
-    switch (trace_type) {
-      case kJsonTraceType: {
-        PERFETTO_DLOG("JSON trace detected");
-        if (context_->json_trace_tokenizer && context_->json_trace_parser) {
-          reader_ = std::move(context_->json_trace_tokenizer);
-
-          // JSON traces have no guarantees about the order of events in them.
-          context_->sorter.reset(new TraceSorter(
-              std::move(context_->json_trace_parser), kMaxWindowSize));
-        } else {
-          return util::ErrStatus("JSON support is disabled");
-        }
-        break;
+    case kProtoTraceType: {
+      PERFETTO_DLOG("Proto trace detected");
+      // This will be reduced once we read the trace config and we see flush
+      // period being set.
+      reader_.reset(new ProtoTraceTokenizer(context_));
+      context_->sorter.reset(new TraceSorter(
+          std::unique_ptr<TraceParser>(new ProtoTraceParser(context_)),
+          kMaxWindowSize));
+      if (context_->config.parallel_ftrace_decoding) {
+        context_->sorter->EnableParallelFtraceDecoding(
+            base::ThreadPool::DefaultNumThreads());
       }
-      case kProtoTraceType: {
-        PERFETTO_DLOG("Proto trace detected");
-        // This will be reduced once we read the trace config and we see flush
-        // period being set.
-        reader_.reset(new ProtoTraceTokenizer(context_));
+      if (context_->config.sorter_memory_budget_bytes) {
+        context_->sorter->EnableSpillingToDisk(
+            context_->config.sorter_memory_budget_bytes);
+      }
+      context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
+      break;
+    }
+    case kNinjaLogTraceType: {
+      PERFETTO_DLOG("Ninja log detected");
+      reader_.reset(new NinjaLogParser(context_));
+      break;
+    }
+    case kFuchsiaTraceType: {
+      PERFETTO_DLOG("Fuchsia trace detected");
+      if (context_->fuchsia_trace_parser && context_->fuchsia_trace_tokenizer) {
+        reader_ = std::move(context_->fuchsia_trace_tokenizer);
+
+        // Fuschia traces can have massively out of order events.
         context_->sorter.reset(new TraceSorter(
-            std::unique_ptr<TraceParser>(new ProtoTraceParser(context_)),
-            kMaxWindowSize));
-        context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
-        break;
+            std::move(context_->fuchsia_trace_parser), kMaxWindowSize));
+      } else {
+        return util::ErrStatus("Fuchsia support is disabled");
       }
-      case kNinjaLogTraceType: {
-        PERFETTO_DLOG("Ninja log detected");
-        reader_.reset(new NinjaLogParser(context_));
+      break;
+    }
+    case kSystraceTraceType:
+      PERFETTO_DLOG("Systrace trace detected");
+      context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
+      if (context_->systrace_trace_parser) {
+        reader_ = std::move(context_->systrace_trace_parser);
         break;
+      } else {
+        return util::ErrStatus("Systrace support is disabled");
+      }
+    case kGzipTraceType:
+    case kCtraceTraceType:
+      if (trace_type == kGzipTraceType) {
+        PERFETTO_DLOG("gzip trace detected");
+      } else {
+        PERFETTO_DLOG("ctrace trace detected");
       }
-      case kFuchsiaTraceType: {
-        PERFETTO_DLOG("Fuchsia trace detected");
-        if (context_->fuchsia_trace_parser &&
-            context_->fuchsia_trace_tokenizer) {
-          reader_ = std::move(context_->fuchsia_trace_tokenizer);
-
-          // Fuschia traces can have massively out of order events.
-          context_->sorter.reset(new TraceSorter(
-              std::move(context_->fuchsia_trace_parser), kMaxWindowSize));
-        } else {
-          return util::ErrStatus("Fuchsia support is disabled");
-        }
+      if (context_->gzip_trace_parser) {
+        reader_ = std::move(context_->gzip_trace_parser);
         break;
+      } else {
+        return util::ErrStatus(kNoZlibErr);
       }
-      case kSystraceTraceType:
-        PERFETTO_DLOG("Systrace trace detected");
-        context_->process_tracker->SetPidZeroIgnoredForIdleProcess();
-        if (context_->systrace_trace_parser) {
-          reader_ = std::move(context_->systrace_trace_parser);
-          break;
-        } else {
-          return util::ErrStatus("Systrace support is disabled");
-        }
-      case kGzipTraceType:
-      case kCtraceTraceType:
-        if (trace_type == kGzipTraceType) {
-          PERFETTO_DLOG("gzip trace detected");
-        } else {
-          PERFETTO_DLOG("ctrace trace detected");
-        }
-        if (context_->gzip_trace_parser) {
-          reader_ = std::move(context_->gzip_trace_parser);
-          break;
-        } else {
-          return util::ErrStatus(kNoZlibErr);
-        }
-      case kUnknownTraceType:
-        return util::ErrStatus("Unknown trace type provided");
-    }
+    case kUnknownTraceType:
+      return util::ErrStatus("Unknown trace type provided");
   }
+  return util::OkStatus();
+}
 
-  return reader_->Parse(std::move(data), size);
+util::Status ForwardingTraceParser::Flush() {
+  return reader_ ? reader_->Flush() : util::OkStatus();
 }
 
 void ForwardingTraceParser::NotifyEndOfFile() {
-  reader_->NotifyEndOfFile();
+  // No reader is created if no data was ever pushed, e.g. for the trace inside
+  // an empty gzip stream.
+  if (reader_)
+    reader_->NotifyEndOfFile();
 }
 
 TraceType GuessTraceType(const uint8_t* data, size_t size) {
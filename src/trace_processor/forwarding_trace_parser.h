@@ -44,9 +44,14 @@ class ForwardingTraceParser : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseBlob(TraceBlobView) override;
+  util::Status Flush() override;
   void NotifyEndOfFile() override;
 
  private:
+  // Guesses the trace type from its first chunk and creates |reader_|.
+  util::Status CreateReader(const uint8_t* data, size_t size);
+
   TraceProcessorContext* const context_;
   std::unique_ptr<ChunkedTraceReader> reader_;
 };
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/ftrace/ftrace_event_decoder.h"
+
+#include "perfetto/protozero/proto_decoder.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+void DecodeFtraceEvent(const TimestampedTracePiece& ttp,
+                       DecodedFtraceEvent* out) {
+  using protos::pbzero::FtraceEvent;
+  out->event_id = 0;
+
+  // Inline events are already as compact as they can be.
+  if (ttp.type != TimestampedTracePiece::Type::kFtraceEvent)
+    return;
+
+  const TraceBlobView& event = ttp.ftrace_event;
+  protozero::ProtoDecoder decoder(event.data(), event.length());
+  bool has_pid = false;
+  uint32_t pid = 0;
+  uint32_t event_id = 0;
+  protozero::ConstBytes payload{nullptr, 0};
+  for (auto fld = decoder.ReadField(); fld.valid(); fld = decoder.ReadField()) {
+    if (fld.id() == FtraceEvent::kPidFieldNumber) {
+      has_pid = true;
+      pid = fld.as_uint32();
+      continue;
+    }
+    if (fld.id() == FtraceEvent::kTimestampFieldNumber)
+      continue;
+
+    // Events with more than one payload are left to FtraceParser.
+    if (event_id != 0)
+      return;
+    event_id = fld.id();
+    payload = fld.as_bytes();
+  }
+  if (!has_pid || event_id == 0 || decoder.bytes_left())
+    return;
+
+  if (event_id == FtraceEvent::kSchedSwitchFieldNumber) {
+    protos::pbzero::SchedSwitchFtraceEvent::Decoder ss(payload.data,
+                                                       payload.size);
+    DecodedFtraceEvent::SchedSwitch* sched_switch = &out->sched_switch;
+    sched_switch->prev_comm = ss.prev_comm();
+    sched_switch->next_comm = ss.next_comm();
+    sched_switch->prev_state = ss.prev_state();
+    sched_switch->prev_pid = static_cast<uint32_t>(ss.prev_pid());
+    sched_switch->next_pid = static_cast<uint32_t>(ss.next_pid());
+    sched_switch->prev_prio = ss.prev_prio();
+    sched_switch->next_prio = ss.next_prio();
+  }
+
+  out->pid = pid;
+  out->payload = payload;
+  out->event_id = event_id;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
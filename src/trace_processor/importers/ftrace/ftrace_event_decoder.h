@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_EVENT_DECODER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_EVENT_DECODER_H_
+
+#include <stdint.h>
+
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/protozero/field.h"
+#include "src/trace_processor/timestamped_trace_piece.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// The result of the part of the parsing of a FtraceEvent which doesn't depend
+// on any TraceProcessorContext state: finding the pid and the payload of the
+// event and, for the most frequent events, decoding the payload fields.
+// All the pointers refer to the buffer of the TimestampedTracePiece which was
+// decoded, so this struct must not outlive it.
+struct DecodedFtraceEvent {
+  struct SchedSwitch {
+    base::StringView prev_comm;
+    base::StringView next_comm;
+    int64_t prev_state;
+    uint32_t prev_pid;
+    uint32_t next_pid;
+    int32_t prev_prio;
+    int32_t next_prio;
+  };
+
+  bool is_valid() const { return event_id != 0; }
+
+  // The id of the FtraceEvent field holding the payload of the event (e.g.
+  // FtraceEvent::kSchedSwitchFieldNumber). 0 if the event could not be
+  // decoded, in which case it must go through the regular parsing path.
+  uint32_t event_id = 0;
+  uint32_t pid = 0;
+  protozero::ConstBytes payload{nullptr, 0};
+
+  // Only set if |event_id| == FtraceEvent::kSchedSwitchFieldNumber.
+  SchedSwitch sched_switch;
+};
+
+// Decodes the ftrace event in |ttp| into |out|. Doesn't touch any state other
+// than |out| so can be called concurrently on different events.
+void DecodeFtraceEvent(const TimestampedTracePiece& ttp,
+                       DecodedFtraceEvent* out);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_FTRACE_FTRACE_EVENT_DECODER_H_
@@ -22,5 +22,11 @@ namespace trace_processor {
 void FtraceModule::ParseFtracePacket(uint32_t /*cpu*/,
                                      const TimestampedTracePiece&) {}
 
+void FtraceModule::ParseDecodedFtracePacket(uint32_t cpu,
+                                            const TimestampedTracePiece& ttp,
+                                            const DecodedFtraceEvent&) {
+  ParseFtracePacket(cpu, ttp);
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
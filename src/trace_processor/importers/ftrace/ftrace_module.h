@@ -23,10 +23,17 @@
 namespace perfetto {
 namespace trace_processor {
 
+struct DecodedFtraceEvent;
+
 class FtraceModule : public ProtoImporterModule {
  public:
   virtual void ParseFtracePacket(uint32_t cpu,
                                  const TimestampedTracePiece& ttp);
+
+  // Like ParseFtracePacket(), for events pre-decoded by DecodeFtraceEvent().
+  virtual void ParseDecodedFtracePacket(uint32_t cpu,
+                                        const TimestampedTracePiece& ttp,
+                                        const DecodedFtraceEvent& decoded);
 };
 
 }  // namespace trace_processor
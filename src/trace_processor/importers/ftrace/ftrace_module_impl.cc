@@ -66,5 +66,15 @@ void FtraceModuleImpl::ParseFtracePacket(uint32_t cpu,
   }
 }
 
+void FtraceModuleImpl::ParseDecodedFtracePacket(
+    uint32_t cpu,
+    const TimestampedTracePiece& ttp,
+    const DecodedFtraceEvent& decoded) {
+  util::Status res = parser_.ParseDecodedFtraceEvent(cpu, ttp, decoded);
+  if (!res.ok()) {
+    PERFETTO_ELOG("%s", res.message().c_str());
+  }
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
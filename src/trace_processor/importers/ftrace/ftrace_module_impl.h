@@ -48,6 +48,10 @@ class FtraceModuleImpl : public FtraceModule {
   void ParseFtracePacket(uint32_t cpu,
                          const TimestampedTracePiece& ttp) override;
 
+  void ParseDecodedFtracePacket(uint32_t cpu,
+                                const TimestampedTracePiece& ttp,
+                                const DecodedFtraceEvent& decoded) override;
+
  private:
   FtraceTokenizer tokenizer_;
   FtraceParser parser_;
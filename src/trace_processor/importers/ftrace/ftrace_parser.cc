@@ -21,6 +21,7 @@
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/importers/ftrace/binder_tracker.h"
+#include "src/trace_processor/importers/ftrace/ftrace_event_decoder.h"
 #include "src/trace_processor/importers/syscalls/syscall_tracker.h"
 #include "src/trace_processor/importers/systrace/systrace_parser.h"
 #include "src/trace_processor/storage/stats.h"
@@ -223,145 +224,172 @@ util::Status FtraceParser::ParseFtraceEvent(uint32_t cpu,
                              fld.id() == FtraceEvent::kTimestampFieldNumber;
     if (is_metadata_field)
       continue;
-
-    ConstBytes data = fld.as_bytes();
-    if (fld.id() == FtraceEvent::kGenericFieldNumber) {
-      ParseGenericFtrace(ts, cpu, pid, data);
-    } else if (fld.id() != FtraceEvent::kSchedSwitchFieldNumber) {
-      // sched_switch parsing populates the raw table by itself
-      ParseTypedFtraceToRaw(fld.id(), ts, cpu, pid, data);
-    }
-
-    switch (fld.id()) {
-      case FtraceEvent::kSchedSwitchFieldNumber: {
-        ParseSchedSwitch(cpu, ts, data);
-        break;
-      }
-      case FtraceEvent::kSchedWakeupFieldNumber: {
-        ParseSchedWakeup(ts, data);
-        break;
-      }
-      case FtraceEvent::kSchedWakingFieldNumber: {
-        ParseSchedWaking(ts, data);
-        break;
-      }
-      case FtraceEvent::kSchedProcessFreeFieldNumber: {
-        ParseSchedProcessFree(ts, data);
-        break;
-      }
-      case FtraceEvent::kCpuFrequencyFieldNumber: {
-        ParseCpuFreq(ts, data);
-        break;
-      }
-      case FtraceEvent::kGpuFrequencyFieldNumber: {
-        ParseGpuFreq(ts, data);
-        break;
-      }
-      case FtraceEvent::kCpuIdleFieldNumber: {
-        ParseCpuIdle(ts, data);
-        break;
-      }
-      case FtraceEvent::kPrintFieldNumber: {
-        ParsePrint(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kZeroFieldNumber: {
-        ParseZero(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kRssStatFieldNumber: {
-        rss_stat_tracker_.ParseRssStat(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kIonHeapGrowFieldNumber: {
-        ParseIonHeapGrowOrShrink(ts, pid, data, true);
-        break;
-      }
-      case FtraceEvent::kIonHeapShrinkFieldNumber: {
-        ParseIonHeapGrowOrShrink(ts, pid, data, false);
-        break;
-      }
-      case FtraceEvent::kIonStatFieldNumber: {
-        ParseIonStat(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kSignalGenerateFieldNumber: {
-        ParseSignalGenerate(ts, data);
-        break;
-      }
-      case FtraceEvent::kSignalDeliverFieldNumber: {
-        ParseSignalDeliver(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kLowmemoryKillFieldNumber: {
-        ParseLowmemoryKill(ts, data);
-        break;
-      }
-      case FtraceEvent::kOomScoreAdjUpdateFieldNumber: {
-        ParseOOMScoreAdjUpdate(ts, data);
-        break;
-      }
-      case FtraceEvent::kMarkVictimFieldNumber: {
-        ParseOOMKill(ts, data);
-        break;
-      }
-      case FtraceEvent::kMmEventRecordFieldNumber: {
-        ParseMmEventRecord(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kSysEnterFieldNumber: {
-        ParseSysEvent(ts, pid, true, data);
-        break;
-      }
-      case FtraceEvent::kSysExitFieldNumber: {
-        ParseSysEvent(ts, pid, false, data);
-        break;
-      }
-      case FtraceEvent::kTaskNewtaskFieldNumber: {
-        ParseTaskNewTask(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kTaskRenameFieldNumber: {
-        ParseTaskRename(data);
-        break;
-      }
-      case FtraceEvent::kBinderTransactionFieldNumber: {
-        ParseBinderTransaction(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kBinderTransactionReceivedFieldNumber: {
-        ParseBinderTransactionReceived(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kBinderTransactionAllocBufFieldNumber: {
-        ParseBinderTransactionAllocBuf(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kBinderLockFieldNumber: {
-        ParseBinderLock(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kBinderUnlockFieldNumber: {
-        ParseBinderUnlock(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kBinderLockedFieldNumber: {
-        ParseBinderLocked(ts, pid, data);
-        break;
-      }
-      case FtraceEvent::kSdeTracingMarkWriteFieldNumber: {
-        ParseSdeTracingMarkWrite(ts, pid, data);
-        break;
-      }
-      default:
-        break;
-    }
+    ParseFtraceEventPayload(cpu, ts, pid, fld.id(), fld.as_bytes());
   }
 
   PERFETTO_DCHECK(!decoder.bytes_left());
   return util::OkStatus();
 }
 
+util::Status FtraceParser::ParseDecodedFtraceEvent(
+    uint32_t cpu,
+    const TimestampedTracePiece& ttp,
+    const DecodedFtraceEvent& decoded) {
+  if (!decoded.is_valid())
+    return ParseFtraceEvent(cpu, ttp);
+
+  int64_t ts = ttp.timestamp;
+  if (decoded.event_id == protos::pbzero::FtraceEvent::kSchedSwitchFieldNumber) {
+    const DecodedFtraceEvent::SchedSwitch& ss = decoded.sched_switch;
+    SchedEventTracker::GetOrCreate(context_)->PushSchedSwitch(
+        cpu, ts, ss.prev_pid, ss.prev_comm, ss.prev_prio, ss.prev_state,
+        ss.next_pid, ss.next_comm, ss.next_prio);
+    return util::OkStatus();
+  }
+  ParseFtraceEventPayload(cpu, ts, decoded.pid, decoded.event_id,
+                          decoded.payload);
+  return util::OkStatus();
+}
+
+void FtraceParser::ParseFtraceEventPayload(uint32_t cpu,
+                                           int64_t ts,
+                                           uint32_t pid,
+                                           uint32_t event_id,
+                                           ConstBytes data) {
+  using protos::pbzero::FtraceEvent;
+  if (event_id == FtraceEvent::kGenericFieldNumber) {
+    ParseGenericFtrace(ts, cpu, pid, data);
+  } else if (event_id != FtraceEvent::kSchedSwitchFieldNumber) {
+    // sched_switch parsing populates the raw table by itself
+    ParseTypedFtraceToRaw(event_id, ts, cpu, pid, data);
+  }
+
+  switch (event_id) {
+    case FtraceEvent::kSchedSwitchFieldNumber: {
+      ParseSchedSwitch(cpu, ts, data);
+      break;
+    }
+    case FtraceEvent::kSchedWakeupFieldNumber: {
+      ParseSchedWakeup(ts, data);
+      break;
+    }
+    case FtraceEvent::kSchedWakingFieldNumber: {
+      ParseSchedWaking(ts, data);
+      break;
+    }
+    case FtraceEvent::kSchedProcessFreeFieldNumber: {
+      ParseSchedProcessFree(ts, data);
+      break;
+    }
+    case FtraceEvent::kCpuFrequencyFieldNumber: {
+      ParseCpuFreq(ts, data);
+      break;
+    }
+    case FtraceEvent::kGpuFrequencyFieldNumber: {
+      ParseGpuFreq(ts, data);
+      break;
+    }
+    case FtraceEvent::kCpuIdleFieldNumber: {
+      ParseCpuIdle(ts, data);
+      break;
+    }
+    case FtraceEvent::kPrintFieldNumber: {
+      ParsePrint(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kZeroFieldNumber: {
+      ParseZero(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kRssStatFieldNumber: {
+      rss_stat_tracker_.ParseRssStat(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kIonHeapGrowFieldNumber: {
+      ParseIonHeapGrowOrShrink(ts, pid, data, true);
+      break;
+    }
+    case FtraceEvent::kIonHeapShrinkFieldNumber: {
+      ParseIonHeapGrowOrShrink(ts, pid, data, false);
+      break;
+    }
+    case FtraceEvent::kIonStatFieldNumber: {
+      ParseIonStat(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kSignalGenerateFieldNumber: {
+      ParseSignalGenerate(ts, data);
+      break;
+    }
+    case FtraceEvent::kSignalDeliverFieldNumber: {
+      ParseSignalDeliver(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kLowmemoryKillFieldNumber: {
+      ParseLowmemoryKill(ts, data);
+      break;
+    }
+    case FtraceEvent::kOomScoreAdjUpdateFieldNumber: {
+      ParseOOMScoreAdjUpdate(ts, data);
+      break;
+    }
+    case FtraceEvent::kMarkVictimFieldNumber: {
+      ParseOOMKill(ts, data);
+      break;
+    }
+    case FtraceEvent::kMmEventRecordFieldNumber: {
+      ParseMmEventRecord(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kSysEnterFieldNumber: {
+      ParseSysEvent(ts, pid, true, data);
+      break;
+    }
+    case FtraceEvent::kSysExitFieldNumber: {
+      ParseSysEvent(ts, pid, false, data);
+      break;
+    }
+    case FtraceEvent::kTaskNewtaskFieldNumber: {
+      ParseTaskNewTask(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kTaskRenameFieldNumber: {
+      ParseTaskRename(data);
+      break;
+    }
+    case FtraceEvent::kBinderTransactionFieldNumber: {
+      ParseBinderTransaction(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kBinderTransactionReceivedFieldNumber: {
+      ParseBinderTransactionReceived(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kBinderTransactionAllocBufFieldNumber: {
+      ParseBinderTransactionAllocBuf(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kBinderLockFieldNumber: {
+      ParseBinderLock(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kBinderUnlockFieldNumber: {
+      ParseBinderUnlock(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kBinderLockedFieldNumber: {
+      ParseBinderLocked(ts, pid, data);
+      break;
+    }
+    case FtraceEvent::kSdeTracingMarkWriteFieldNumber: {
+      ParseSdeTracingMarkWrite(ts, pid, data);
+      break;
+    }
+    default:
+      break;
+  }
+}
+
 void FtraceParser::ParseGenericFtrace(int64_t ts,
                                       uint32_t cpu,
                                       uint32_t tid,
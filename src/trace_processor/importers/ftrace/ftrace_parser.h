@@ -30,6 +30,8 @@
 namespace perfetto {
 namespace trace_processor {
 
+struct DecodedFtraceEvent;
+
 class FtraceParser {
  public:
   explicit FtraceParser(TraceProcessorContext* context);
@@ -38,7 +40,18 @@ class FtraceParser {
 
   util::Status ParseFtraceEvent(uint32_t cpu, const TimestampedTracePiece& ttp);
 
+  // Like ParseFtraceEvent(), but skips the decoding of |ttp| if |decoded| is
+  // valid (see DecodeFtraceEvent()).
+  util::Status ParseDecodedFtraceEvent(uint32_t cpu,
+                                       const TimestampedTracePiece& ttp,
+                                       const DecodedFtraceEvent& decoded);
+
  private:
+  void ParseFtraceEventPayload(uint32_t cpu,
+                               int64_t timestamp,
+                               uint32_t pid,
+                               uint32_t event_id,
+                               protozero::ConstBytes);
   void ParseGenericFtrace(int64_t timestamp,
                           uint32_t cpu,
                           uint32_t pid,
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/gzip/gzip_inflater.h"
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_pool.h"
+#include "perfetto/ext/base/thread_utils.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Our default uncompressed buffer size is 32MB as it allows for good
+// throughput. This is also the largest member inflated in parallel.
+constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
+
+// Size of the fixed part of a gzip member header (RFC 1952), followed by the
+// size of the extra field (XLEN), if the FEXTRA flag is set.
+constexpr size_t kHeaderSize = 12;
+constexpr uint8_t kDeflateMethod = 8;
+constexpr uint8_t kExtraFlag = 4;
+
+// The CRC32 and the uncompressed size (ISIZE) of the member.
+constexpr size_t kTrailerSize = 8;
+
+constexpr char kInflateError[] = "Unable to decompress gzip/ctrace trace";
+
+struct MemberHeader {
+  enum Kind {
+    // |size| is the number of bytes needed to read further.
+    kNeedsMoreData,
+    // |size| is the size of the whole member, including the header.
+    kKnownSize,
+    kUnknownSize,
+    kNotGzip,
+  };
+  Kind kind;
+  size_t size;
+};
+
+inline size_t ReadLE16(const uint8_t* ptr) {
+  return static_cast<size_t>(ptr[0] | ptr[1] << 8);
+}
+
+inline size_t ReadLE32(const uint8_t* ptr) {
+  return static_cast<size_t>(static_cast<uint32_t>(ptr[0]) |
+                             static_cast<uint32_t>(ptr[1]) << 8 |
+                             static_cast<uint32_t>(ptr[2]) << 16 |
+                             static_cast<uint32_t>(ptr[3]) << 24);
+}
+
+// Reads the header of the gzip member at the beginning of |data|. If
+// |read_size| is false, only checks that |data| looks like a gzip member.
+// The size of a member is known if its header has a "BC" extra subfield, which
+// BGZF (i.e. bgzip) uses to store the size of the member minus one.
+MemberHeader ReadMemberHeader(const uint8_t* data,
+                              size_t size,
+                              bool read_size) {
+  if (size < 2)
+    return MemberHeader{MemberHeader::kNeedsMoreData, 2};
+  if (data[0] != 0x1f || data[1] != 0x8b)
+    return MemberHeader{MemberHeader::kNotGzip, 0};
+  if (!read_size)
+    return MemberHeader{MemberHeader::kUnknownSize, 0};
+  if (size < kHeaderSize)
+    return MemberHeader{MemberHeader::kNeedsMoreData, kHeaderSize};
+  if (data[2] != kDeflateMethod || !(data[3] & kExtraFlag))
+    return MemberHeader{MemberHeader::kUnknownSize, 0};
+
+  const size_t extra_end = kHeaderSize + ReadLE16(&data[10]);
+  if (size < extra_end)
+    return MemberHeader{MemberHeader::kNeedsMoreData, extra_end};
+  for (size_t off = kHeaderSize; off + 4 <= extra_end;) {
+    size_t subfield_size = ReadLE16(&data[off + 2]);
+    if (data[off] == 'B' && data[off + 1] == 'C' && subfield_size == 2 &&
+        off + 6 <= extra_end) {
+      size_t member_size = ReadLE16(&data[off + 4]) + 1;
+      if (member_size < extra_end + kTrailerSize)
+        break;
+      return MemberHeader{MemberHeader::kKnownSize, member_size};
+    }
+    off += 4 + subfield_size;
+  }
+  return MemberHeader{MemberHeader::kUnknownSize, 0};
+}
+
+}  // namespace
+
+GzipInflater::GzipInflater(base::ThreadPool* pool) : pool_(pool) {}
+
+GzipInflater::~GzipInflater() = default;
+
+util::Status GzipInflater::Inflate(const uint8_t* data,
+                                   size_t size,
+                                   std::vector<TraceBlobView>* out) {
+  if (!partial_member_.empty()) {
+    // Complete the pending header (or member) with the beginning of |data|.
+    for (;;) {
+      MemberHeader header = ReadMemberHeader(
+          partial_member_.data(), partial_member_.size(), pool_ != nullptr);
+      bool incomplete = header.kind == MemberHeader::kNeedsMoreData ||
+                        header.kind == MemberHeader::kKnownSize;
+      size_t wanted = incomplete ? header.size : partial_member_.size();
+      size_t missing = std::min(wanted - partial_member_.size(), size);
+      partial_member_.insert(partial_member_.end(), data, data + missing);
+      data += missing;
+      size -= missing;
+      if (partial_member_.size() < wanted)
+        return util::OkStatus();
+      if (header.kind != MemberHeader::kNeedsMoreData)
+        break;
+    }
+    std::vector<uint8_t> member;
+    member.swap(partial_member_);
+    util::Status status = InflateChunk(member.data(), member.size(), out);
+    if (!status.ok())
+      return status;
+    PERFETTO_DCHECK(partial_member_.empty());
+  }
+  return InflateChunk(data, size, out);
+}
+
+util::Status GzipInflater::InflateChunk(const uint8_t* data,
+                                        size_t size,
+                                        std::vector<TraceBlobView>* out) {
+  while (size > 0) {
+    if (state_ == State::kTrailingData)
+      return util::OkStatus();
+
+    if (state_ == State::kInMember) {
+      size_t consumed = 0;
+      util::Status status = InflateSerially(data, size, &consumed, out);
+      if (!status.ok())
+        return status;
+      data += consumed;
+      size -= consumed;
+      continue;
+    }
+
+    // Look for a run of whole members of known size, which can be inflated
+    // independently of each other.
+    std::vector<std::pair<size_t, size_t>> members;
+    size_t offset = 0;
+    MemberHeader header = ReadMemberHeader(data, size, pool_ != nullptr);
+    while (header.kind == MemberHeader::kKnownSize &&
+           header.size <= size - offset) {
+      const uint8_t* end = data + offset + header.size;
+      if (ReadLE32(end - 4) > kUncompressedBufferSize) {
+        header.kind = MemberHeader::kUnknownSize;
+        break;
+      }
+      members.emplace_back(offset, header.size);
+      offset += header.size;
+      header = ReadMemberHeader(data + offset, size - offset, true);
+    }
+    if (!members.empty()) {
+      util::Status status = InflateMembersInParallel(data, members, out);
+      if (!status.ok())
+        return status;
+      data += offset;
+      size -= offset;
+      continue;
+    }
+
+    switch (header.kind) {
+      case MemberHeader::kNeedsMoreData:
+      case MemberHeader::kKnownSize:
+        partial_member_.assign(data, data + size);
+        return util::OkStatus();
+      case MemberHeader::kNotGzip:
+        // The first member can also be a zlib stream (e.g. in ctrace files),
+        // which the decompressor detects by itself.
+        if (members_inflated_ > 0) {
+          PERFETTO_DLOG("Ignoring %zu bytes after the last gzip member", size);
+          state_ = State::kTrailingData;
+          return util::OkStatus();
+        }
+        decompressor_.Reset();
+        state_ = State::kInMember;
+        break;
+      case MemberHeader::kUnknownSize:
+        decompressor_.Reset();
+        state_ = State::kInMember;
+        break;
+    }
+  }
+  return util::OkStatus();
+}
+
+util::Status GzipInflater::InflateSerially(const uint8_t* data,
+                                           size_t size,
+                                           size_t* consumed,
+                                           std::vector<TraceBlobView>* out) {
+  using ResultCode = GzipDecompressor::ResultCode;
+  decompressor_.SetInput(data, size);
+  for (;;) {
+    // Buffers are only handed over (and reallocated) once data is written
+    // into them, which might take several calls for small chunks.
+    if (!buffer_)
+      buffer_.reset(new uint8_t[kUncompressedBufferSize]);
+    auto result =
+        decompressor_.Decompress(buffer_.get(), kUncompressedBufferSize);
+    if (result.ret == ResultCode::kError ||
+        result.ret == ResultCode::kNoProgress) {
+      return util::ErrStatus(kInflateError);
+    }
+    if (result.ret == ResultCode::kNeedsMoreInput) {
+      *consumed = size;
+      return util::OkStatus();
+    }
+    if (result.bytes_written > 0)
+      out->emplace_back(std::move(buffer_), 0, result.bytes_written);
+    if (result.ret == ResultCode::kEof) {
+      state_ = State::kMemberStart;
+      members_inflated_++;
+      *consumed = size - decompressor_.AvailIn();
+      return util::OkStatus();
+    }
+  }
+}
+
+util::Status GzipInflater::InflateMembersInParallel(
+    const uint8_t* data,
+    const std::vector<std::pair<size_t, size_t>>& members,
+    std::vector<TraceBlobView>* out) {
+  PERFETTO_DCHECK(pool_);
+
+  // The trailer of each member has its uncompressed size, so every member can
+  // be inflated right into its place in the output buffer.
+  std::vector<size_t> out_offsets(members.size() + 1);
+  for (size_t i = 0; i < members.size(); i++) {
+    const uint8_t* end = data + members[i].first + members[i].second;
+    out_offsets[i + 1] = out_offsets[i] + ReadLE32(end - 4);
+  }
+  const size_t total_size = out_offsets.back();
+  std::unique_ptr<uint8_t[]> buffer(
+      new uint8_t[std::max<size_t>(total_size, 1)]);
+
+  // Members are usually small (BGZF ones are at most 64KB), so each task
+  // inflates a range of them, to amortize the setup of its decompressor.
+  const size_t num_tasks =
+      std::min(members.size(), (pool_->num_threads() + size_t(1)) * 4);
+  std::vector<uint8_t> inflated(members.size());
+  pool_->ParallelFor(num_tasks, [&](size_t task) {
+    using ResultCode = GzipDecompressor::ResultCode;
+    GzipDecompressor decompressor;
+    size_t begin = task * members.size() / num_tasks;
+    size_t end = (task + 1) * members.size() / num_tasks;
+    for (size_t i = begin; i < end; i++) {
+      size_t out_size = out_offsets[i + 1] - out_offsets[i];
+      decompressor.Reset();
+      decompressor.SetInput(data + members[i].first, members[i].second);
+      auto result = decompressor.Decompress(&buffer[out_offsets[i]], out_size);
+      inflated[i] = result.ret == ResultCode::kEof &&
+                    result.bytes_written == out_size &&
+                    decompressor.AvailIn() == 0;
+      if (!inflated[i])
+        break;
+    }
+  });
+
+  // Hand over the data of the members before the first failing one, if any.
+  auto failed = std::find(inflated.begin(), inflated.end(), 0);
+  size_t num_inflated = static_cast<size_t>(failed - inflated.begin());
+  members_inflated_ += num_inflated;
+  if (out_offsets[num_inflated] > 0)
+    out->emplace_back(std::move(buffer), 0, out_offsets[num_inflated]);
+  if (failed != inflated.end())
+    return util::ErrStatus(kInflateError);
+  return util::OkStatus();
+}
+
+GzipInflaterThread::GzipInflaterThread(uint32_t num_pool_threads)
+    : pool_(num_pool_threads
+                ? new base::ThreadPool(num_pool_threads, "GzipInflate")
+                : nullptr),
+      inflater_(pool_.get()),
+      thread_(&GzipInflaterThread::ThreadMain, this) {}
+
+GzipInflaterThread::~GzipInflaterThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  input_cv_.notify_one();
+  thread_.join();
+}
+
+void GzipInflaterThread::Push(TraceBlobView chunk) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PERFETTO_DCHECK(!input_eof_);
+    input_.emplace_back(std::move(chunk));
+  }
+  chunks_in_flight_++;
+  input_cv_.notify_one();
+}
+
+void GzipInflaterThread::PushEndOfFile() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    input_eof_ = true;
+  }
+  input_cv_.notify_one();
+}
+
+bool GzipInflaterThread::Pop(bool block,
+                             std::vector<TraceBlobView>* out,
+                             util::Status* status) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (block) {
+    output_cv_.wait(lock, [this] { return !output_.empty() || output_eof_; });
+  }
+  if (output_.empty())
+    return false;
+  *out = std::move(output_.front().buffers);
+  *status = std::move(output_.front().status);
+  output_.pop_front();
+  chunks_in_flight_--;
+  return true;
+}
+
+void GzipInflaterThread::ThreadMain() {
+  base::MaybeSetThreadName("GzipInflater");
+  for (;;) {
+    TraceBlobView chunk(nullptr, 0, 0);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      input_cv_.wait(lock,
+                     [this] { return quit_ || input_eof_ || !input_.empty(); });
+      if (quit_)
+        return;
+      if (input_.empty()) {
+        PERFETTO_DCHECK(input_eof_);
+        output_eof_ = true;
+        output_cv_.notify_one();
+        return;
+      }
+      chunk = std::move(input_.front());
+      input_.pop_front();
+    }
+
+    OutputChunk output;
+    output.status =
+        inflater_.Inflate(chunk.data(), chunk.length(), &output.buffers);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      output_.emplace_back(std::move(output));
+    }
+    output_cv_.notify_one();
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
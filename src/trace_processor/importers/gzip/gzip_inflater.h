@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_INFLATER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_INFLATER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/importers/gzip/gzip_utils.h"
+#include "src/trace_processor/trace_blob_view.h"
+
+namespace perfetto {
+namespace base {
+class ThreadPool;
+}  // namespace base
+
+namespace trace_processor {
+
+// Inflates a gzip (or zlib) stream, pushed in arbitrarily sized chunks.
+// Streams made of several concatenated gzip members (e.g. the output of
+// `cat a.gz b.gz` or of pigz) are inflated as a whole. Any data following the
+// last member which doesn't look like another gzip member is ignored, like
+// gzip does.
+// If a ThreadPool is passed, consecutive members which record their compressed
+// size in their header, like the BGZF blocks written by bgzip, are inflated in
+// parallel. All the other members are inflated serially.
+// This class does not touch any TraceProcessorContext state, which allows to
+// run it on a different thread than the rest of the import pipeline.
+class GzipInflater {
+ public:
+  explicit GzipInflater(base::ThreadPool* pool = nullptr);
+  ~GzipInflater();
+
+  // Appends to |out|, in stream order, all the data that can be inflated after
+  // pushing |size| bytes of |data|. Every buffer appended to |out| starts at
+  // the beginning of its allocation (i.e. has offset() == 0). Data inflated
+  // before an error is encountered is still appended to |out|.
+  util::Status Inflate(const uint8_t* data,
+                       size_t size,
+                       std::vector<TraceBlobView>* out);
+
+  // Returns true if the data pushed so far ends in the middle of a member.
+  bool has_partial_member() const {
+    return state_ == State::kInMember || !partial_member_.empty();
+  }
+
+ private:
+  enum class State {
+    // The next byte is the start of a member (or of the trailing data).
+    kMemberStart,
+    // |decompressor_| is in the middle of a member.
+    kInMember,
+    // All the members have been inflated, the rest of the stream is ignored.
+    kTrailingData,
+  };
+
+  util::Status InflateChunk(const uint8_t* data,
+                            size_t size,
+                            std::vector<TraceBlobView>* out);
+  util::Status InflateSerially(const uint8_t* data,
+                               size_t size,
+                               size_t* consumed,
+                               std::vector<TraceBlobView>* out);
+  // Inflates the whole members of known size at [offset, offset + size) of
+  // |data| into a single buffer.
+  util::Status InflateMembersInParallel(
+      const uint8_t* data,
+      const std::vector<std::pair<size_t, size_t>>& members,
+      std::vector<TraceBlobView>* out);
+
+  base::ThreadPool* const pool_;
+  GzipDecompressor decompressor_;
+  std::unique_ptr<uint8_t[]> buffer_;
+  State state_ = State::kMemberStart;
+  uint64_t members_inflated_ = 0;
+
+  // The beginning of a member whose header (or, for members with a known
+  // size, whose data) spans across two (or more) Inflate() calls.
+  std::vector<uint8_t> partial_member_;
+};
+
+// Runs a GzipInflater on a dedicated thread so that inflating the next chunks
+// overlaps with the parsing of the current one on the calling thread.
+// All the methods must be called on the same (consumer) thread.
+class GzipInflaterThread {
+ public:
+  // If |num_pool_threads| is non-zero, members with a known size are inflated
+  // in parallel on a pool of that many extra threads.
+  explicit GzipInflaterThread(uint32_t num_pool_threads);
+  ~GzipInflaterThread();
+
+  // Hands over a chunk to the inflating thread. Never blocks: callers are
+  // expected to bound the memory usage by looking at chunks_in_flight().
+  void Push(TraceBlobView chunk);
+
+  // Signals that no more chunks will be pushed.
+  void PushEndOfFile();
+
+  // Pops the data inflated out of the next chunk, in the same order chunks
+  // were pushed. If |block| is false, returns false if the inflating thread has
+  // not finished the next chunk yet. If |block| is true, waits for it and
+  // returns false only once all chunks have been popped after
+  // PushEndOfFile().
+  bool Pop(bool block, std::vector<TraceBlobView>* out, util::Status*);
+
+  // Number of chunks pushed and not popped yet.
+  size_t chunks_in_flight() const { return chunks_in_flight_; }
+
+ private:
+  struct OutputChunk {
+    std::vector<TraceBlobView> buffers;
+    util::Status status;
+  };
+
+  void ThreadMain();
+
+  std::unique_ptr<base::ThreadPool> pool_;
+  GzipInflater inflater_;
+  size_t chunks_in_flight_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable input_cv_;
+  std::condition_variable output_cv_;
+  std::deque<TraceBlobView> input_;  // Guarded by |mutex_|.
+  std::deque<OutputChunk> output_;   // Guarded by |mutex_|.
+  bool input_eof_ = false;           // Guarded by |mutex_|.
+  bool output_eof_ = false;          // Guarded by |mutex_|.
+  bool quit_ = false;                // Guarded by |mutex_|.
+
+  std::thread thread_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_INFLATER_H_
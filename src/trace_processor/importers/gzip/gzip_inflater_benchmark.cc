@@ -0,0 +1,221 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the import of gzip traces. Each trace is compressed either
+// as a single gzip member, like gzip does, or as a sequence of BGZF blocks,
+// like bgzip does.
+// BM_GzipInflate measures GzipInflater alone, with and without a ThreadPool
+// to inflate the BGZF blocks in parallel. BM_GzipTraceImport measures the
+// import of a gzipped proto trace end to end, through the TraceProcessor API,
+// with and without Config::pipelined_ingestion.
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_pool.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/importers/gzip/gzip_inflater.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+
+namespace {
+
+using perfetto::base::ThreadPool;
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::GzipInflater;
+using perfetto::trace_processor::TraceBlobView;
+using perfetto::trace_processor::TraceProcessor;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+constexpr size_t kChunkSize = 1024 * 1024;
+
+// The amount of uncompressed data in each block written by bgzip.
+constexpr size_t kBgzfBlockSize = 0xff00;
+
+// Returns a serialized Trace containing |num_bundles| ftrace bundles of
+// sched_switch events.
+std::vector<uint8_t> CreateFtraceTrace(uint32_t num_bundles) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
+  uint64_t ts = 1000;
+  for (uint32_t i = 0; i < num_bundles; i++) {
+    auto* packet = trace->add_packet();
+    packet->set_trusted_packet_sequence_id(1);
+    auto* bundle = packet->set_ftrace_events();
+    bundle->set_cpu(i % 8);
+    for (uint32_t j = 0; j < 64; j++) {
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts += rnd_engine() % 1000);
+      event->set_pid(rnd_engine() % 1000);
+      auto* sched_switch = event->set_sched_switch();
+      sched_switch->set_prev_comm("thread_" + std::to_string(j));
+      sched_switch->set_prev_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_prev_prio(120);
+      sched_switch->set_prev_state(1);
+      sched_switch->set_next_comm("thread_" + std::to_string(j + 1));
+      sched_switch->set_next_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_next_prio(120);
+    }
+  }
+  return trace.SerializeAsArray();
+}
+
+void AppendLE(uint32_t value, size_t bytes, std::vector<uint8_t>* out) {
+  for (size_t i = 0; i < bytes; i++)
+    out->push_back(static_cast<uint8_t>(value >> (i * 8)));
+}
+
+// Appends |size| bytes of |data| to |out|, deflated with the given zlib
+// |window_bits| (i.e. raw deflate data if negative, gzip if above 15).
+void AppendDeflated(const uint8_t* data,
+                    size_t size,
+                    int window_bits,
+                    std::vector<uint8_t>* out) {
+  z_stream stream{};
+  PERFETTO_CHECK(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              window_bits, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  size_t offset = out->size();
+  out->resize(offset + deflateBound(&stream, static_cast<uLong>(size)));
+  stream.next_in = const_cast<uint8_t*>(data);
+  stream.avail_in = static_cast<uInt>(size);
+  stream.next_out = &(*out)[offset];
+  stream.avail_out = static_cast<uInt>(out->size() - offset);
+  PERFETTO_CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  out->resize(offset + stream.total_out);
+  deflateEnd(&stream);
+}
+
+std::vector<uint8_t> Compress(const std::vector<uint8_t>& data, bool bgzf) {
+  std::vector<uint8_t> out;
+  if (!bgzf) {
+    AppendDeflated(data.data(), data.size(), 15 + 16, &out);
+    return out;
+  }
+  // A gzip header with a "BC" extra subfield, which holds the block size.
+  static const uint8_t kBgzfHeader[] = {0x1f, 0x8b, 8, 4,   0,   0, 0, 0,
+                                        0,    0xff, 6, 0, 'B', 'C', 2, 0};
+  for (size_t off = 0; off < data.size(); off += kBgzfBlockSize) {
+    size_t size = std::min(kBgzfBlockSize, data.size() - off);
+    size_t member_start = out.size();
+    out.insert(out.end(), kBgzfHeader, kBgzfHeader + sizeof(kBgzfHeader));
+    AppendLE(0, 2, &out);  // Patched below, once the size is known.
+    AppendDeflated(&data[off], size, -15, &out);
+    uLong crc = crc32(0, &data[off], static_cast<uInt>(size));
+    AppendLE(static_cast<uint32_t>(crc), 4, &out);
+    AppendLE(static_cast<uint32_t>(size), 4, &out);
+    uint32_t block_size = static_cast<uint32_t>(out.size() - member_start - 1);
+    out[member_start + sizeof(kBgzfHeader)] = static_cast<uint8_t>(block_size);
+    out[member_start + sizeof(kBgzfHeader) + 1] =
+        static_cast<uint8_t>(block_size >> 8);
+  }
+  return out;
+}
+
+std::vector<uint8_t> CreateCompressedTrace(bool bgzf) {
+  uint32_t num_bundles = IsBenchmarkFunctionalOnly() ? 64 : 32 * 1024;
+  return Compress(CreateFtraceTrace(num_bundles), bgzf);
+}
+
+void InflateArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"bgzf", "threads"});
+  b->Args({0, 0});
+  b->Args({1, 0});
+  b->Args({1, std::max<int64_t>(ThreadPool::DefaultNumThreads(), 1)});
+}
+
+static void BM_GzipInflate(benchmark::State& state) {
+  const bool bgzf = state.range(0) != 0;
+  const uint32_t num_threads = static_cast<uint32_t>(state.range(1));
+  std::vector<uint8_t> compressed = CreateCompressedTrace(bgzf);
+
+  std::unique_ptr<ThreadPool> pool;
+  if (num_threads > 0)
+    pool.reset(new ThreadPool(num_threads, "GzipInflate"));
+  size_t inflated_size = 0;
+  for (auto _ : state) {
+    GzipInflater inflater(pool.get());
+    inflated_size = 0;
+    for (size_t off = 0; off < compressed.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, compressed.size() - off);
+      std::vector<TraceBlobView> out;
+      PERFETTO_CHECK(inflater.Inflate(&compressed[off], size, &out).ok());
+      for (const TraceBlobView& buffer : out)
+        inflated_size += buffer.length();
+    }
+    PERFETTO_CHECK(!inflater.has_partial_member());
+  }
+  state.counters["ratio"] = benchmark::Counter(
+      static_cast<double>(inflated_size) /
+      static_cast<double>(compressed.size()));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(inflated_size));
+}
+BENCHMARK(BM_GzipInflate)->Apply(InflateArgs)->Unit(benchmark::kMillisecond);
+
+void ImportArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"pipelined", "bgzf"});
+  b->Args({0, 0});
+  b->Args({1, 0});
+  b->Args({0, 1});
+  b->Args({1, 1});
+}
+
+static void BM_GzipTraceImport(benchmark::State& state) {
+  const bool pipelined = state.range(0) != 0;
+  const bool bgzf = state.range(1) != 0;
+  std::vector<uint8_t> compressed = CreateCompressedTrace(bgzf);
+
+  for (auto _ : state) {
+    Config config;
+    config.pipelined_ingestion = pipelined;
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    for (size_t off = 0; off < compressed.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, compressed.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), &compressed[off], size);
+      PERFETTO_CHECK(tp->Parse(std::move(buf), size).ok());
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(compressed.size()));
+}
+BENCHMARK(BM_GzipTraceImport)
+    ->Apply(ImportArgs)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/gzip/gzip_inflater.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/thread_pool.h"
+#include "test/gtest_and_gmock.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+std::string CreateText(uint32_t num_lines) {
+  std::string text;
+  for (uint32_t i = 0; i < num_lines; i++)
+    text += "line " + std::to_string(i * 7919 % 10007) + "\n";
+  return text;
+}
+
+// Compresses |data| into a single gzip member, with a BGZF header if |bgzf|.
+std::string Compress(const std::string& data, bool bgzf) {
+  z_stream stream{};
+  // Raw deflate data for BGZF, as its header is written below.
+  PERFETTO_CHECK(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              bgzf ? -15 : 15 + 16, 8,
+                              Z_DEFAULT_STRATEGY) == Z_OK);
+  std::string deflated(deflateBound(&stream, static_cast<uLong>(data.size())),
+                       '\0');
+  stream.next_in =
+      reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+  stream.avail_out = static_cast<uInt>(deflated.size());
+  PERFETTO_CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  deflated.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (!bgzf)
+    return deflated;
+
+  auto le = [](uint32_t value, size_t bytes) {
+    std::string ret;
+    for (size_t i = 0; i < bytes; i++)
+      ret.push_back(static_cast<char>(value >> (i * 8)));
+    return ret;
+  };
+  const size_t member_size = 18 + deflated.size() + 8;
+  std::string member("\x1f\x8b\x08\x04\0\0\0\0\0\xff\x06\0BC\x02\0", 16);
+  member += le(static_cast<uint32_t>(member_size - 1), 2);
+  member += deflated;
+  uLong crc = crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                    static_cast<uInt>(data.size()));
+  member += le(static_cast<uint32_t>(crc), 4);
+  member += le(static_cast<uint32_t>(data.size()), 4);
+  return member;
+}
+
+// Pushes |compressed| into |inflater| in chunks of |chunk_size| bytes and
+// returns the inflated data.
+std::string Inflate(GzipInflater* inflater,
+                    const std::string& compressed,
+                    size_t chunk_size,
+                    util::Status* status) {
+  std::string inflated;
+  for (size_t off = 0; off < compressed.size(); off += chunk_size) {
+    size_t size = std::min(chunk_size, compressed.size() - off);
+    std::vector<TraceBlobView> out;
+    *status = inflater->Inflate(
+        reinterpret_cast<const uint8_t*>(&compressed[off]), size, &out);
+    for (const TraceBlobView& buffer : out) {
+      EXPECT_EQ(buffer.offset(), 0u);
+      inflated.append(reinterpret_cast<const char*>(buffer.data()),
+                      buffer.length());
+    }
+    if (!status->ok())
+      break;
+  }
+  return inflated;
+}
+
+TEST(GzipInflaterTest, SingleMember) {
+  std::string text = CreateText(10000);
+  std::string compressed = Compress(text, /*bgzf=*/false);
+  for (size_t chunk_size : {1u, 7u, 4096u, 1u << 20}) {
+    GzipInflater inflater;
+    util::Status status;
+    ASSERT_EQ(Inflate(&inflater, compressed, chunk_size, &status), text)
+        << chunk_size;
+    ASSERT_TRUE(status.ok());
+    ASSERT_FALSE(inflater.has_partial_member());
+  }
+}
+
+TEST(GzipInflaterTest, ZlibStream) {
+  std::string text = CreateText(1000);
+  uLongf compressed_size = compressBound(static_cast<uLong>(text.size()));
+  std::string compressed(compressed_size, '\0');
+  ASSERT_EQ(compress(reinterpret_cast<Bytef*>(&compressed[0]),
+                     &compressed_size,
+                     reinterpret_cast<const Bytef*>(text.data()),
+                     static_cast<uLong>(text.size())),
+            Z_OK);
+  compressed.resize(compressed_size);
+
+  GzipInflater inflater;
+  util::Status status;
+  ASSERT_EQ(Inflate(&inflater, compressed, 100, &status), text);
+  ASSERT_TRUE(status.ok());
+}
+
+TEST(GzipInflaterTest, MultipleMembers) {
+  // Mix members of known size (which are inflated in parallel when a pool is
+  // available) with regular ones, and an empty member like the one bgzip
+  // writes at the end of its files.
+  std::string text;
+  std::string compressed;
+  for (uint32_t i = 0; i < 20; i++) {
+    std::string member_text = CreateText(100 + i * 50);
+    text += member_text;
+    compressed += Compress(member_text, /*bgzf=*/i % 4 != 3);
+  }
+  compressed += Compress("", /*bgzf=*/true);
+
+  base::ThreadPool pool(2);
+  for (bool parallel : {false, true}) {
+    for (size_t chunk_size : {1u, 13u, 1000u, 4096u, 1u << 20}) {
+      GzipInflater inflater(parallel ? &pool : nullptr);
+      util::Status status;
+      ASSERT_EQ(Inflate(&inflater, compressed, chunk_size, &status), text)
+          << chunk_size;
+      ASSERT_TRUE(status.ok());
+      ASSERT_FALSE(inflater.has_partial_member());
+    }
+  }
+}
+
+TEST(GzipInflaterTest, TrailingDataIsIgnored) {
+  std::string text = CreateText(100);
+  std::string compressed = Compress(text, /*bgzf=*/true) +
+                           Compress(text, /*bgzf=*/false) +
+                           std::string(100, '\0');
+  base::ThreadPool pool(1);
+  GzipInflater inflater(&pool);
+  util::Status status;
+  ASSERT_EQ(Inflate(&inflater, compressed, 64, &status), text + text);
+  ASSERT_TRUE(status.ok());
+}
+
+TEST(GzipInflaterTest, TruncatedMember) {
+  std::string text = CreateText(1000);
+  std::string compressed = Compress(text, /*bgzf=*/true);
+  compressed.resize(compressed.size() - 10);
+  base::ThreadPool pool(1);
+  GzipInflater inflater(&pool);
+  util::Status status;
+  ASSERT_EQ(Inflate(&inflater, compressed, 1000, &status), "");
+  ASSERT_TRUE(status.ok());
+  ASSERT_TRUE(inflater.has_partial_member());
+}
+
+TEST(GzipInflaterTest, CorruptMember) {
+  std::string first = CreateText(100);
+  std::string second = Compress(CreateText(200), /*bgzf=*/true);
+  second[30] = static_cast<char>(~second[30]);
+  std::string compressed = Compress(first, /*bgzf=*/true) + second;
+
+  for (bool parallel : {false, true}) {
+    base::ThreadPool pool(1);
+    GzipInflater inflater(parallel ? &pool : nullptr);
+    util::Status status;
+    // The data of the members before the corrupt one is still handed over.
+    ASSERT_EQ(Inflate(&inflater, compressed, compressed.size(), &status)
+                  .substr(0, first.size()),
+              first);
+    ASSERT_FALSE(status.ok());
+  }
+}
+
+TEST(GzipInflaterTest, InflaterThreadPreservesOrder) {
+  std::string text;
+  std::string compressed;
+  for (uint32_t i = 0; i < 50; i++) {
+    std::string member_text = CreateText(i * 20);
+    text += member_text;
+    compressed += Compress(member_text, /*bgzf=*/i % 2 == 0);
+  }
+
+  GzipInflaterThread inflater_thread(/*num_pool_threads=*/2);
+  std::string inflated;
+  std::vector<TraceBlobView> out;
+  util::Status status;
+  auto append = [&inflated, &out] {
+    for (const TraceBlobView& buffer : out) {
+      inflated.append(reinterpret_cast<const char*>(buffer.data()),
+                      buffer.length());
+    }
+  };
+  const size_t kChunkSize = 997;
+  for (size_t off = 0; off < compressed.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, compressed.size() - off);
+    std::unique_ptr<uint8_t[]> chunk(new uint8_t[size]);
+    memcpy(chunk.get(), &compressed[off], size);
+    inflater_thread.Push(TraceBlobView(std::move(chunk), 0, size));
+    while (inflater_thread.Pop(/*block=*/false, &out, &status)) {
+      ASSERT_TRUE(status.ok());
+      append();
+    }
+  }
+  inflater_thread.PushEndOfFile();
+  while (inflater_thread.Pop(/*block=*/true, &out, &status)) {
+    ASSERT_TRUE(status.ok());
+    append();
+  }
+  ASSERT_EQ(inflater_thread.chunks_in_flight(), 0u);
+  ASSERT_EQ(inflated, text);
+}
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -16,66 +16,129 @@
 
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 
+#include <string.h>
+
 #include <string>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/thread_pool.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
+#include "src/trace_processor/storage/stats.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/types/trace_processor_context.h"
+#include "src/trace_processor/util/status_macros.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 GzipTraceParser::GzipTraceParser(TraceProcessorContext* context)
-    : context_(context) {}
+    : context_(context) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (context->config.pipelined_ingestion) {
+    inflater_thread_.reset(
+        new GzipInflaterThread(base::ThreadPool::DefaultNumThreads()));
+    return;
+  }
+#endif
+  inflater_.reset(new GzipInflater());
+}
 
 GzipTraceParser::~GzipTraceParser() = default;
 
 util::Status GzipTraceParser::Parse(std::unique_ptr<uint8_t[]> data,
                                     size_t size) {
-  uint8_t* start = data.get();
-  size_t len = size;
+  return ParseBlob(TraceBlobView(std::move(data), 0, size));
+}
 
+util::Status GzipTraceParser::ParseBlob(TraceBlobView blob) {
   if (!inner_) {
     inner_.reset(new ForwardingTraceParser(context_));
 
     // .ctrace files begin with: "TRACE:\n" or "done. TRACE:\n" strip this if
     // present.
-    base::StringView beginning(reinterpret_cast<char*>(start), size);
+    base::StringView beginning(reinterpret_cast<const char*>(blob.data()),
+                               blob.length());
 
     static const char* kSystraceFileHeader = "TRACE:\n";
     size_t offset = Find(kSystraceFileHeader, beginning);
     if (offset != std::string::npos) {
-      start += strlen(kSystraceFileHeader) + offset;
-      len -= strlen(kSystraceFileHeader) + offset;
+      size_t header_size = strlen(kSystraceFileHeader) + offset;
+      blob = blob.slice(blob.offset() + header_size,
+                        blob.length() - header_size);
     }
   }
-  decompressor_.SetInput(start, len);
-
-  // Our default uncompressed buffer size is 32MB as it allows for good
-  // throughput.
-  using ResultCode = GzipDecompressor::ResultCode;
-  constexpr size_t kUncompressedBufferSize = 32 * 1024 * 1024;
-
-  for (auto ret = ResultCode::kOk; ret != ResultCode::kEof;) {
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[kUncompressedBufferSize]);
-    auto result =
-        decompressor_.Decompress(buffer.get(), kUncompressedBufferSize);
-    ret = result.ret;
-    if (ret == ResultCode::kError || ret == ResultCode::kNoProgress)
-      return util::ErrStatus("Unable to decompress gzip/ctrace trace");
-    if (ret == ResultCode::kNeedsMoreInput)
-      break;
 
+  if (!inflater_thread_) {
+    inflated_.clear();
     util::Status status =
-        inner_->Parse(std::move(buffer), result.bytes_written);
-    if (!status.ok())
-      return status;
+        inflater_->Inflate(blob.data(), blob.length(), &inflated_);
+    RETURN_IF_ERROR(ParseInflated());
+    return status;
   }
+
+  // Bound the memory used by the pipeline: parse the chunks which have
+  // already been inflated before queueing more.
+  while (inflater_thread_->chunks_in_flight() >= kMaxChunksInFlight) {
+    bool popped = false;
+    RETURN_IF_ERROR(ParseNextInflatedChunk(/*block=*/true, &popped));
+  }
+  inflater_thread_->Push(std::move(blob));
+
+  // Opportunistically parse whatever the inflating thread has done so far.
+  for (bool popped = true; popped;)
+    RETURN_IF_ERROR(ParseNextInflatedChunk(/*block=*/false, &popped));
+  return util::OkStatus();
+}
+
+util::Status GzipTraceParser::ParseNextInflatedChunk(bool block,
+                                                     bool* popped) {
+  util::Status inflate_status;
+  *popped = inflater_thread_->Pop(block, &inflated_, &inflate_status);
+  if (!*popped)
+    return util::OkStatus();
+  RETURN_IF_ERROR(ParseInflated());
+  return inflate_status;
+}
+
+util::Status GzipTraceParser::ParseInflated() {
+  for (TraceBlobView& buffer : inflated_)
+    RETURN_IF_ERROR(inner_->ParseBlob(std::move(buffer)));
+  inflated_.clear();
   return util::OkStatus();
 }
 
-void GzipTraceParser::NotifyEndOfFile() {}
+util::Status GzipTraceParser::Flush() {
+  // Wait for the inflating thread to catch up, then let the inner parser
+  // process what was inflated.
+  while (inflater_thread_ && inflater_thread_->chunks_in_flight() > 0) {
+    bool popped = false;
+    RETURN_IF_ERROR(ParseNextInflatedChunk(/*block=*/true, &popped));
+  }
+  return inner_ ? inner_->Flush() : util::OkStatus();
+}
+
+void GzipTraceParser::NotifyEndOfFile() {
+  if (inflater_thread_) {
+    // Drain the pipeline. Errors can't be propagated to the caller at this
+    // point so the best we can do is to stop parsing and log them.
+    inflater_thread_->PushEndOfFile();
+    for (bool popped = true; popped;) {
+      util::Status status = ParseNextInflatedChunk(/*block=*/true, &popped);
+      if (!status.ok()) {
+        PERFETTO_ELOG("Failed parsing the end of the trace: %s",
+                      status.c_message());
+        context_->storage->IncrementStats(stats::pipelined_tokenizer_errors);
+        break;
+      }
+    }
+    inflater_thread_.reset();
+  }
+  if (inner_)
+    inner_->NotifyEndOfFile();
+}
 
 }  // namespace trace_processor
 }  // namespace perfetto
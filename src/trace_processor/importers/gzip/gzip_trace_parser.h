@@ -17,8 +17,11 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_TRACE_PARSER_H_
 
+#include <memory>
+#include <vector>
+
 #include "src/trace_processor/chunked_trace_reader.h"
-#include "src/trace_processor/importers/gzip/gzip_utils.h"
+#include "src/trace_processor/importers/gzip/gzip_inflater.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -32,12 +35,29 @@ class GzipTraceParser : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseBlob(TraceBlobView) override;
+  util::Status Flush() override;
   void NotifyEndOfFile() override;
 
  private:
+  // Max number of chunks which can be queued into |inflater_thread_|, before
+  // Parse() blocks waiting for the inflating thread to catch up.
+  static constexpr size_t kMaxChunksInFlight = 8;
+
+  util::Status ParseNextInflatedChunk(bool block, bool* popped);
+  util::Status ParseInflated();
+
   TraceProcessorContext* const context_;
-  GzipDecompressor decompressor_;
   std::unique_ptr<ChunkedTraceReader> inner_;
+
+  // Only one of the two is set, depending on whether
+  // Config::pipelined_ingestion is enabled.
+  std::unique_ptr<GzipInflater> inflater_;
+  std::unique_ptr<GzipInflaterThread> inflater_thread_;
+
+  // The buffers inflated out of the current chunk. Kept across calls to reuse
+  // the allocation.
+  std::vector<TraceBlobView> inflated_;
 };
 
 }  // namespace trace_processor
@@ -102,5 +102,13 @@ GzipDecompressor::Result GzipDecompressor::Decompress(uint8_t* out,
 #endif
 }
 
+size_t GzipDecompressor::AvailIn() const {
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  return z_stream_->avail_in;
+#else
+  return 0;
+#endif
+}
+
 }  // namespace trace_processor
 }  // namespace perfetto
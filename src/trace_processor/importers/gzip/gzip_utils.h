@@ -17,6 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_UTILS_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_GZIP_GZIP_UTILS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <memory>
 
 struct z_stream_s;
@@ -59,6 +62,11 @@ class GzipDecompressor {
   // Decompresses the input previously provided in |SetInput|.
   Result Decompress(uint8_t* out, size_t out_size);
 
+  // Returns the number of bytes of the input previously provided in |SetInput|
+  // which have not been consumed yet (e.g. the bytes following the end of a
+  // gzip member, after |Decompress| returned |ResultCode::kEof|).
+  size_t AvailIn() const;
+
   // Sets the state of the decompressor to reuse with other gzip streams.
   void Reset();
 
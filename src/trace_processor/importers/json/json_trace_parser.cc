@@ -29,6 +29,7 @@
 #include "src/trace_processor/importers/common/track_tracker.h"
 #include "src/trace_processor/importers/json/json_tracker.h"
 #include "src/trace_processor/importers/json/json_utils.h"
+#include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 
 namespace perfetto {
@@ -50,54 +51,46 @@ void JsonTraceParser::ParseTracePacket(int64_t timestamp,
   PERFETTO_DCHECK(json::IsJsonSupported());
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
-  PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kJsonValue ||
+  PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kJsonEvent ||
                   ttp.type == TimestampedTracePiece::Type::kSystraceLine);
   if (ttp.type == TimestampedTracePiece::Type::kSystraceLine) {
     systrace_line_parser_.ParseLine(*ttp.systrace_line);
     return;
   }
 
-  const Json::Value& value = *(ttp.json_value);
+  const JsonEvent& event = *ttp.json_event;
 
   ProcessTracker* procs = context_->process_tracker.get();
   TraceStorage* storage = context_->storage.get();
   SliceTracker* slice_tracker = context_->slice_tracker.get();
 
-  auto& ph = value["ph"];
-  if (!ph.isString())
+  if (event.phase == 0)
     return;
-  char phase = *ph.asCString();
 
-  base::Optional<uint32_t> opt_pid;
-  base::Optional<uint32_t> opt_tid;
-
-  if (value.isMember("pid"))
-    opt_pid = json::CoerceToUint32(value["pid"]);
-  if (value.isMember("tid"))
-    opt_tid = json::CoerceToUint32(value["tid"]);
-
-  uint32_t pid = opt_pid.value_or(0);
-  uint32_t tid = opt_tid.value_or(pid);
-
-  base::StringView cat = value.isMember("cat")
-                             ? base::StringView(value["cat"].asCString())
-                             : base::StringView();
-  base::StringView name = value.isMember("name")
-                              ? base::StringView(value["name"].asCString())
-                              : base::StringView();
-
-  StringId cat_id = storage->InternString(cat);
-  StringId name_id = storage->InternString(name);
+  uint32_t pid = event.pid;
+  uint32_t tid = event.tid;
+  StringId cat_id = event.cat;
+  StringId name_id = event.name;
   UniqueTid utid = procs->UpdateThread(tid, pid);
 
-  auto args_inserter = [this, &value](ArgsTracker::BoundInserter* inserter) {
-    if (value.isMember("args")) {
-      json::AddJsonValueToArgs(value["args"], /* flat_key = */ "args",
+  // The args are only parsed now: the tokenizer only extracts what it needs
+  // to sort the events and keeps the args as JSON text.
+  base::Optional<Json::Value> args;
+  if (event.args) {
+    const char* data = reinterpret_cast<const char*>(event.args->data());
+    args = json::ParseJsonString(base::StringView(data, event.args->length()));
+    if (!args)
+      storage->IncrementStats(stats::json_parser_failure);
+  }
+
+  auto args_inserter = [this, &args](ArgsTracker::BoundInserter* inserter) {
+    if (args) {
+      json::AddJsonValueToArgs(*args, /* flat_key = */ "args",
                                /* key = */ "args", context_->storage.get(),
                                inserter);
     }
   };
-  switch (phase) {
+  switch (event.phase) {
     case 'B': {  // TRACE_EVENT_BEGIN.
       TrackId track_id = context_->track_tracker->InternThreadTrack(utid);
       slice_tracker->Begin(timestamp, track_id, cat_id, name_id, args_inserter);
@@ -109,26 +102,25 @@ void JsonTraceParser::ParseTracePacket(int64_t timestamp,
       break;
     }
     case 'X': {  // TRACE_EVENT (scoped event).
-      base::Optional<int64_t> opt_dur =
-          JsonTracker::GetOrCreate(context_)->CoerceToTs(value["dur"]);
-      if (!opt_dur.has_value())
+      if (!event.has_dur)
         return;
       TrackId track_id = context_->track_tracker->InternThreadTrack(utid);
-      slice_tracker->Scoped(timestamp, track_id, cat_id, name_id,
-                            opt_dur.value(), args_inserter);
+      slice_tracker->Scoped(timestamp, track_id, cat_id, name_id, event.dur,
+                            args_inserter);
       break;
     }
     case 'M': {  // Metadata events (process and thread names).
-      if (strcmp(value["name"].asCString(), "thread_name") == 0 &&
-          !value["args"]["name"].empty()) {
-        const char* thread_name = value["args"]["name"].asCString();
+      if (!args || !(*args)["name"].isString())
+        break;
+      base::StringView name = storage->GetString(name_id);
+      if (name == "thread_name") {
+        const char* thread_name = (*args)["name"].asCString();
         auto thread_name_id = context_->storage->InternString(thread_name);
         procs->UpdateThreadName(tid, thread_name_id);
         break;
       }
-      if (strcmp(value["name"].asCString(), "process_name") == 0 &&
-          !value["args"]["name"].empty()) {
-        const char* proc_name = value["args"]["name"].asCString();
+      if (name == "process_name") {
+        const char* proc_name = (*args)["name"].asCString();
         procs->SetProcessMetadata(pid, base::nullopt, proc_name);
         break;
       }
@@ -14,9 +14,10 @@
  * limitations under the License.
  */
 
-
 #include "src/trace_processor/importers/json/json_trace_tokenizer.h"
 
+#include <string.h>
+
 #include "perfetto/base/build_config.h"
 #include "perfetto/ext/base/string_utils.h"
 
@@ -99,6 +100,124 @@ ReadStringRes ReadOneJsonString(const char* start,
   }
   return ReadStringRes::kNeedsMoreData;
 }
+
+const char* SkipWhitespace(const char* s, const char* end) {
+  while (s < end && isspace(*s))
+    s++;
+  return s;
+}
+
+// Returns a pointer past the closing quote of the JSON string whose opening
+// quote is at |s|, or nullptr if the string doesn't end before |end|.
+const char* SkipString(const char* s, const char* end) {
+  for (const char* begin = s + 1;;) {
+    const char* quote = static_cast<const char*>(
+        memchr(begin, '"', static_cast<size_t>(end - begin)));
+    if (!quote)
+      return nullptr;
+
+    // The quote is escaped if it's preceded by an odd number of backslashes.
+    size_t backslashes = 0;
+    for (const char* b = quote; b > begin && b[-1] == '\\'; b--)
+      backslashes++;
+    if (backslashes % 2 == 0)
+      return quote + 1;
+    begin = quote + 1;
+  }
+}
+
+enum class SkipValueRes {
+  kSkipped,
+  kNeedsMoreData,
+  kFatalError,
+};
+
+// Skips the JSON value starting at |s| and sets |next| to the character after
+// it. Only the nesting of arrays and dictionaries is checked: the values are
+// parsed later, if they are needed at all.
+SkipValueRes SkipValue(const char* s, const char* end, const char** next) {
+  if (*s == '"') {
+    const char* string_end = SkipString(s, end);
+    if (!string_end)
+      return SkipValueRes::kNeedsMoreData;
+    *next = string_end;
+    return SkipValueRes::kSkipped;
+  }
+
+  if (*s == '{' || *s == '[') {
+    // Track the brackets which are still open to check they are closed by a
+    // matching one.
+    std::string open_brackets;
+    for (const char* p = s; p < end; p++) {
+      switch (*p) {
+        case '"':
+          p = SkipString(p, end);
+          if (!p)
+            return SkipValueRes::kNeedsMoreData;
+          p--;
+          break;
+        case '{':
+          open_brackets.push_back('}');
+          break;
+        case '[':
+          open_brackets.push_back(']');
+          break;
+        case '}':
+        case ']':
+          if (open_brackets.back() != *p)
+            return SkipValueRes::kFatalError;
+          open_brackets.pop_back();
+          if (open_brackets.empty()) {
+            *next = p + 1;
+            return SkipValueRes::kSkipped;
+          }
+          break;
+      }
+    }
+    return SkipValueRes::kNeedsMoreData;
+  }
+
+  // A number, true, false or null, which ends at the next delimiter.
+  if (*s != '-' && !isalnum(*s))
+    return SkipValueRes::kFatalError;
+  for (const char* p = s; p < end; p++) {
+    if (*p == ',' || *p == '}' || *p == ']' || isspace(*p)) {
+      *next = p;
+      return SkipValueRes::kSkipped;
+    }
+  }
+  return SkipValueRes::kNeedsMoreData;
+}
+
+// Returns the field of |event| which stores the value of |key|, or nullptr if
+// the value of |key| is not needed.
+base::StringView* GetRawField(base::StringView key, RawJsonEvent* event) {
+  switch (key.size()) {
+    case 2:
+      if (key == "ph")
+        return &event->ph;
+      if (key == "ts")
+        return &event->ts;
+      break;
+    case 3:
+      if (key == "dur")
+        return &event->dur;
+      if (key == "pid")
+        return &event->pid;
+      if (key == "tid")
+        return &event->tid;
+      if (key == "cat")
+        return &event->cat;
+      break;
+    case 4:
+      if (key == "name")
+        return &event->name;
+      if (key == "args")
+        return &event->args;
+      break;
+  }
+  return nullptr;
+}
 #endif
 
 }  // namespace
@@ -167,6 +286,73 @@ ReadDictRes ReadOneJsonDict(const char* start,
   return ReadDictRes::kNeedsMoreData;
 }
 
+ReadEventRes ReadOneJsonEvent(const char* start,
+                              const char* end,
+                              RawJsonEvent* event,
+                              const char** next) {
+  const char* s = start;
+  while (s < end && (isspace(*s) || *s == ','))
+    s++;
+  if (s == end)
+    return ReadEventRes::kNeedsMoreData;
+  if (*s == ']') {
+    // We've reached the end of [traceEvents] array.
+    // There might be other top level keys in the json (e.g. metadata)
+    // after.
+    *next = s + 1;
+    return ReadEventRes::kEndOfArray;
+  }
+  if (*s == '}')
+    return ReadEventRes::kEndOfTrace;
+  if (*s != '{')
+    return ReadEventRes::kFatalError;
+
+  *event = RawJsonEvent();
+  for (s++;;) {
+    s = SkipWhitespace(s, end);
+    if (s == end)
+      return ReadEventRes::kNeedsMoreData;
+    if (*s == '}') {
+      *next = s + 1;
+      return ReadEventRes::kFoundEvent;
+    }
+    if (*s == ',') {
+      s++;
+      continue;
+    }
+    if (*s != '"')
+      return ReadEventRes::kFatalError;
+
+    // Keys of trace events never need unescaping: an escaped key just won't
+    // match any of the keys of RawJsonEvent.
+    const char* key_end = SkipString(s, end);
+    if (!key_end)
+      return ReadEventRes::kNeedsMoreData;
+    base::StringView key(s + 1, static_cast<size_t>(key_end - s - 2));
+
+    s = SkipWhitespace(key_end, end);
+    if (s == end)
+      return ReadEventRes::kNeedsMoreData;
+    if (*s != ':')
+      return ReadEventRes::kFatalError;
+    s = SkipWhitespace(s + 1, end);
+    if (s == end)
+      return ReadEventRes::kNeedsMoreData;
+
+    const char* value_end = nullptr;
+    SkipValueRes res = SkipValue(s, end, &value_end);
+    if (res == SkipValueRes::kFatalError)
+      return ReadEventRes::kFatalError;
+    if (res == SkipValueRes::kNeedsMoreData)
+      return ReadEventRes::kNeedsMoreData;
+
+    base::StringView* field = GetRawField(key, event);
+    if (field)
+      *field = base::StringView(s, static_cast<size_t>(value_end - s));
+    s = value_end;
+  }
+}
+
 ReadKeyRes ReadOneJsonKey(const char* start,
                           const char* end,
                           std::string* key,
@@ -273,10 +459,21 @@ util::Status JsonTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> data,
   PERFETTO_DCHECK(json::IsJsonSupported());
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
-  buffer_.insert(buffer_.end(), data.get(), data.get() + size);
-  const char* buf = buffer_.data();
+  // The trace events keep a slice of the chunk for their args, so only copy
+  // it when it has to be glued to what was left over from the previous one.
+  size_t blob_size = size;
+  if (!buffer_.empty()) {
+    blob_size = buffer_.size() + size;
+    std::unique_ptr<uint8_t[]> glued(new uint8_t[blob_size]);
+    memcpy(glued.get(), buffer_.data(), buffer_.size());
+    memcpy(glued.get() + buffer_.size(), data.get(), size);
+    data = std::move(glued);
+    buffer_.clear();
+  }
+  TraceBlobView blob(std::move(data), 0, blob_size);
+  const char* buf = reinterpret_cast<const char*>(blob.data());
   const char* next = buf;
-  const char* end = buf + buffer_.size();
+  const char* end = buf + blob_size;
 
   JsonTracker* json_tracker = JsonTracker::GetOrCreate(context_);
 
@@ -326,12 +523,12 @@ util::Status JsonTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> data,
                     : TracePosition::kTraceEventsArray;
   }
 
-  auto status = ParseInternal(next, end, &next);
+  auto status = ParseInternal(blob, next, end, &next);
   if (!status.ok())
     return status;
 
   offset_ += static_cast<uint64_t>(next - buf);
-  buffer_.erase(buffer_.begin(), buffer_.begin() + (next - buf));
+  buffer_.assign(next, end);
   return util::OkStatus();
 #else
   perfetto::base::ignore_result(data);
@@ -345,11 +542,11 @@ util::Status JsonTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> data,
 }
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
-util::Status JsonTraceTokenizer::ParseInternal(const char* start,
+util::Status JsonTraceTokenizer::ParseInternal(const TraceBlobView& blob,
+                                               const char* start,
                                                const char* end,
                                                const char** out) {
   PERFETTO_DCHECK(json::IsJsonSupported());
-  JsonTracker* json_tracker = JsonTracker::GetOrCreate(context_);
   auto* trace_sorter = context_->sorter.get();
 
   const char* next = start;
@@ -372,13 +569,13 @@ util::Status JsonTraceTokenizer::ParseInternal(const char* start,
 
       if (key == "traceEvents") {
         position_ = TracePosition::kTraceEventsArray;
-        return ParseInternal(next + 1, end, out);
+        return ParseInternal(blob, next + 1, end, out);
       } else if (key == "systemTraceEvents") {
         position_ = TracePosition::kSystemTraceEventsString;
-        return ParseInternal(next + 1, end, out);
+        return ParseInternal(blob, next + 1, end, out);
       } else if (key == "metadata") {
         position_ = TracePosition::kWaitingForMetadataDictionary;
-        return ParseInternal(next + 1, end, out);
+        return ParseInternal(blob, next + 1, end, out);
       } else {
         // If we don't recognize the key, just ignore the rest of the trace and
         // go to EOF.
@@ -404,15 +601,17 @@ util::Status JsonTraceTokenizer::ParseInternal(const char* start,
 
         if (res == ReadSystemLineRes::kEndOfSystemTrace) {
           position_ = TracePosition::kDictionaryKey;
-          return ParseInternal(next, end, out);
+          return ParseInternal(blob, next, end, out);
         }
 
         if (base::StartsWith(raw_line, "#") || raw_line.empty())
           continue;
 
+        // The line is parsed only after being sorted: it keeps its own text.
         std::unique_ptr<SystraceLine> line(new SystraceLine());
-        util::Status status =
-            systrace_line_tokenizer_.Tokenize(raw_line, line.get());
+        line->owned_text = std::move(raw_line);
+        util::Status status = systrace_line_tokenizer_.Tokenize(
+            base::StringView(line->owned_text), line.get());
         if (!status.ok())
           return status;
         trace_sorter->PushSystraceLine(std::move(line));
@@ -440,36 +639,22 @@ util::Status JsonTraceTokenizer::ParseInternal(const char* start,
     }
     case TracePosition::kTraceEventsArray: {
       while (next < end) {
-        std::unique_ptr<Json::Value> value(new Json::Value());
-        const auto res = ReadOneJsonDict(next, end, value.get(), &next);
-        if (res == ReadDictRes::kFatalError)
+        RawJsonEvent raw_event;
+        const auto res = ReadOneJsonEvent(next, end, &raw_event, &next);
+        if (res == ReadEventRes::kFatalError)
           return util::ErrStatus("Encountered fatal error while parsing JSON");
-        if (res == ReadDictRes::kEndOfTrace ||
-            res == ReadDictRes::kNeedsMoreData) {
+        if (res == ReadEventRes::kEndOfTrace ||
+            res == ReadEventRes::kNeedsMoreData) {
           break;
         }
 
-        if (res == ReadDictRes::kEndOfArray) {
+        if (res == ReadEventRes::kEndOfArray) {
           position_ = format_ == TraceFormat::kOuterDictionary
                           ? TracePosition::kDictionaryKey
                           : TracePosition::kEof;
           break;
         }
-
-        base::Optional<int64_t> opt_ts =
-            json_tracker->CoerceToTs((*value)["ts"]);
-        int64_t ts = 0;
-        if (opt_ts.has_value()) {
-          ts = opt_ts.value();
-        } else {
-          // Metadata events may omit ts. In all other cases error:
-          auto& ph = (*value)["ph"];
-          if (!ph.isString() || *ph.asCString() != 'M') {
-            context_->storage->IncrementStats(stats::json_tokenizer_failure);
-            continue;
-          }
-        }
-        trace_sorter->PushJsonValue(ts, std::move(value));
+        PushEvent(blob, raw_event);
       }
       break;
     }
@@ -480,6 +665,51 @@ util::Status JsonTraceTokenizer::ParseInternal(const char* start,
   *out = next;
   return util::OkStatus();
 }
+
+void JsonTraceTokenizer::PushEvent(const TraceBlobView& blob,
+                                   const RawJsonEvent& raw_event) {
+  JsonTracker* json_tracker = JsonTracker::GetOrCreate(context_);
+  TraceStorage* storage = context_->storage.get();
+
+  JsonEvent event;
+  if (!raw_event.ph.empty() && raw_event.ph.at(0) == '"' &&
+      raw_event.ph.size() > 2) {
+    event.phase = raw_event.ph.at(1);
+  }
+
+  base::Optional<int64_t> opt_ts = json_tracker->CoerceToTs(raw_event.ts);
+  int64_t ts = 0;
+  if (opt_ts.has_value()) {
+    ts = opt_ts.value();
+  } else if (event.phase != 'M') {
+    // Metadata events may omit ts. In all other cases error:
+    storage->IncrementStats(stats::json_tokenizer_failure);
+    return;
+  }
+
+  base::Optional<int64_t> opt_dur = json_tracker->CoerceToTs(raw_event.dur);
+  event.has_dur = opt_dur.has_value();
+  event.dur = opt_dur.value_or(0);
+  event.pid = json::CoerceToUint32(raw_event.pid).value_or(0);
+  event.tid = json::CoerceToUint32(raw_event.tid).value_or(event.pid);
+
+  // Interning here rather than when parsing the event avoids copying the name
+  // and category until then. Both run on the same thread for JSON traces.
+  auto intern = [this, storage](base::StringView raw_value) {
+    base::Optional<base::StringView> str =
+        json::UnescapeString(raw_value, &unescape_buffer_);
+    return str ? storage->InternString(*str) : kNullStringId;
+  };
+  event.name = intern(raw_event.name);
+  event.cat = intern(raw_event.cat);
+
+  if (!raw_event.args.empty()) {
+    const uint8_t* args =
+        reinterpret_cast<const uint8_t*>(raw_event.args.data());
+    event.args = blob.slice(blob.offset_of(args), raw_event.args.size());
+  }
+  context_->sorter->PushJsonEvent(ts, std::move(event));
+}
 #endif
 
 void JsonTraceTokenizer::NotifyEndOfFile() {}
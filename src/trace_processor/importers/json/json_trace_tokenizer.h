@@ -19,9 +19,14 @@
 
 #include <stdint.h>
 
+#include <string>
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
 #include "src/trace_processor/chunked_trace_reader.h"
 #include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
 #include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/trace_blob_view.h"
 
 namespace Json {
 class Value;
@@ -53,6 +58,40 @@ ReadDictRes ReadOneJsonDict(const char* start,
                             Json::Value* value,
                             const char** next);
 
+// The raw JSON text of the values of the keys of a trace event which are used
+// to import it. Strings keep their quotes; keys which are not in the event are
+// left empty.
+// Visible for testing.
+struct RawJsonEvent {
+  base::StringView ph;
+  base::StringView ts;
+  base::StringView dur;
+  base::StringView pid;
+  base::StringView tid;
+  base::StringView name;
+  base::StringView cat;
+  base::StringView args;
+};
+
+enum class ReadEventRes {
+  kFoundEvent,
+  kNeedsMoreData,
+  kEndOfTrace,
+  kEndOfArray,
+  kFatalError,
+};
+
+// Scans at most one trace event (a JSON dictionary) and returns a pointer to
+// the end of it. Unlike ReadOneJsonDict(), the event is not parsed: only the
+// location of the values of the keys in RawJsonEvent is recorded, without
+// copying or allocating anything. Other values (and the contents of args) are
+// skipped over, and only checked to be well delimited.
+// Visible for testing.
+ReadEventRes ReadOneJsonEvent(const char* start,
+                              const char* end,
+                              RawJsonEvent* event,
+                              const char** next);
+
 enum class ReadKeyRes {
   kFoundKey,
   kNeedsMoreData,
@@ -131,9 +170,15 @@ class JsonTraceTokenizer : public ChunkedTraceReader {
   };
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
-  util::Status ParseInternal(const char* start,
+  // |blob| holds the data from |start| to |end|: the trace events keep a
+  // slice of it for their args.
+  util::Status ParseInternal(const TraceBlobView& blob,
+                             const char* start,
                              const char* end,
                              const char** next);
+
+  // Pushes the trace event |raw_event| to the sorter.
+  void PushEvent(const TraceBlobView& blob, const RawJsonEvent& raw_event);
 #endif
 
   TraceProcessorContext* const context_;
@@ -147,6 +192,9 @@ class JsonTraceTokenizer : public ChunkedTraceReader {
   // Used to glue together JSON objects that span across two (or more)
   // Parse boundaries.
   std::vector<char> buffer_;
+
+  // Holds the unescaped names and categories of trace events.
+  std::string unescape_buffer_;
 };
 
 }  // namespace trace_processor
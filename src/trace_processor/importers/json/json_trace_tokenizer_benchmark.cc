@@ -0,0 +1,163 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the import of JSON traces. The trace is a synthetic Chrome
+// JSON trace of complete and begin/end events with args.
+// BM_JsonTraceReadEvents compares extracting the fields of the events with
+// ReadOneJsonEvent() to parsing each of them into a Json::Value with
+// ReadOneJsonDict(), as the tokenizer used to do. BM_JsonTraceImport measures
+// the import end to end, through the TraceProcessor API.
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/importers/json/json_trace_tokenizer.h"
+#include "src/trace_processor/importers/json/json_utils.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
+
+namespace {
+
+using perfetto::trace_processor::RawJsonEvent;
+using perfetto::trace_processor::ReadDictRes;
+using perfetto::trace_processor::ReadEventRes;
+using perfetto::trace_processor::ReadOneJsonDict;
+using perfetto::trace_processor::ReadOneJsonEvent;
+using perfetto::trace_processor::TraceProcessor;
+namespace json = perfetto::trace_processor::json;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+constexpr size_t kChunkSize = 1024 * 1024;
+
+// Returns the traceEvents array of a JSON trace with |num_events| events,
+// spread across a few threads, with args like the ones of Chrome traces.
+std::string CreateJsonTraceEvents(uint32_t num_events) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  std::string trace = "[\n";
+  uint64_t ts = 1000000;
+  for (uint32_t i = 0; i < num_events; i++) {
+    uint32_t tid = 1 + rnd_engine() % 16;
+    ts += rnd_engine() % 100;
+    std::string name = "Task" + std::to_string(rnd_engine() % 256);
+    std::string common = R"("pid":1,"tid":)" + std::to_string(tid) +
+                         R"(,"ts":)" + std::to_string(ts) +
+                         R"(,"cat":"toplevel")";
+    std::string args = R"({"src_file":"../../base/task/sequence_manager.cc",)"
+                       R"("src_func":"RunTask","id":)" +
+                       std::to_string(i) + R"(,"flow":{"in":true}})";
+    if (i % 2 == 0) {
+      trace += R"({"name":")" + name + R"(","ph":"X",)" + common +
+               R"(,"dur":)" + std::to_string(rnd_engine() % 50) +
+               R"(,"args":)" + args + "},\n";
+    } else {
+      trace += R"({"name":")" + name + R"(","ph":"B",)" + common +
+               R"(,"args":)" + args + "},\n";
+      trace += R"({"name":")" + name + R"(","ph":"E",)" + common +
+               R"(,"args":{}},)" + "\n";
+    }
+  }
+  trace += R"({"name":"thread_name","ph":"M","pid":1,"tid":1,)"
+           R"("args":{"name":"CrBrowserMain"}}])";
+  return trace;
+}
+
+void ReadEventsArgs(benchmark::internal::Benchmark* b) {
+  b->ArgName("jsoncpp")->Arg(0)->Arg(1);
+}
+
+// Extracts the fields of all the events of |trace| which are needed to sort
+// them, as the tokenizer does.
+static void BM_JsonTraceReadEvents(benchmark::State& state) {
+  const bool jsoncpp = state.range(0) != 0;
+  uint32_t num_events = IsBenchmarkFunctionalOnly() ? 1000 : 200 * 1000;
+  std::string trace = CreateJsonTraceEvents(num_events);
+  const char* end = trace.data() + trace.size();
+
+  std::string unescape_buffer;
+  for (auto _ : state) {
+    uint64_t num_read = 0;
+    int64_t sum = 0;
+    const char* next = trace.data() + 1;
+    if (jsoncpp) {
+      for (;;) {
+        Json::Value value;
+        if (ReadOneJsonDict(next, end, &value, &next) !=
+            ReadDictRes::kFoundDict) {
+          break;
+        }
+        sum += json::CoerceToTs(json::TimeUnit::kUs, value["ts"]).value_or(0);
+        sum += json::CoerceToUint32(value["tid"]).value_or(0);
+        benchmark::DoNotOptimize(value["name"].asCString());
+        num_read++;
+      }
+    } else {
+      for (;;) {
+        RawJsonEvent event;
+        if (ReadOneJsonEvent(next, end, &event, &next) !=
+            ReadEventRes::kFoundEvent) {
+          break;
+        }
+        sum += json::CoerceToTs(json::TimeUnit::kUs, event.ts).value_or(0);
+        sum += json::CoerceToUint32(event.tid).value_or(0);
+        benchmark::DoNotOptimize(
+            json::UnescapeString(event.name, &unescape_buffer));
+        num_read++;
+      }
+    }
+    PERFETTO_CHECK(num_read >= num_events);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+}
+BENCHMARK(BM_JsonTraceReadEvents)
+    ->Apply(ReadEventsArgs)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_JsonTraceImport(benchmark::State& state) {
+  uint32_t num_events = IsBenchmarkFunctionalOnly() ? 1000 : 200 * 1000;
+  std::string trace =
+      R"({"traceEvents":)" + CreateJsonTraceEvents(num_events) + "}";
+
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance({});
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), &trace[off], size);
+      PERFETTO_CHECK(tp->Parse(std::move(buf), size).ok());
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+}
+BENCHMARK(BM_JsonTraceImport)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
@@ -87,6 +87,70 @@ TEST(JsonTraceTokenizerTest, ReadDictFatalError) {
   ASSERT_EQ(next, nullptr);
 }
 
+TEST(JsonTraceTokenizerTest, ReadEventSuccess) {
+  const char* start =
+      R"({"name": "a\\\"}", "ph": "X", "ts": 12.5, "dur": 3, "pid": 1,)"
+      R"( "tid": "2", "cat": "c", "s": "{", "args": {"k": [1, {"x": "]"}]}},)";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  RawJsonEvent event;
+
+  ASSERT_EQ(ReadOneJsonEvent(start, end, &event, &next),
+            ReadEventRes::kFoundEvent);
+  ASSERT_EQ(next, end - 1);
+  ASSERT_EQ(event.name.ToStdString(), R"("a\\\"}")");
+  ASSERT_EQ(event.ph.ToStdString(), R"("X")");
+  ASSERT_EQ(event.ts.ToStdString(), "12.5");
+  ASSERT_EQ(event.dur.ToStdString(), "3");
+  ASSERT_EQ(event.pid.ToStdString(), "1");
+  ASSERT_EQ(event.tid.ToStdString(), R"("2")");
+  ASSERT_EQ(event.cat.ToStdString(), R"("c")");
+  ASSERT_EQ(event.args.ToStdString(), R"({"k": [1, {"x": "]"}]})");
+}
+
+TEST(JsonTraceTokenizerTest, ReadEventMissingKeys) {
+  const char* start = R"( , {"ph":"M","args":{}} ])";
+  const char* end = start + strlen(start);
+  const char* next = nullptr;
+  RawJsonEvent event;
+
+  ASSERT_EQ(ReadOneJsonEvent(start, end, &event, &next),
+            ReadEventRes::kFoundEvent);
+  ASSERT_EQ(event.ph.ToStdString(), R"("M")");
+  ASSERT_EQ(event.args.ToStdString(), "{}");
+  ASSERT_TRUE(event.ts.empty());
+  ASSERT_TRUE(event.name.empty());
+
+  ASSERT_EQ(ReadOneJsonEvent(next, end, &event, &next),
+            ReadEventRes::kEndOfArray);
+  ASSERT_EQ(next, end);
+}
+
+TEST(JsonTraceTokenizerTest, ReadEventNeedMoreData) {
+  // Every prefix of an event needs more data to be read.
+  std::string json = R"({"name": "a\\\"b", "ts": 10, "args": {"a": [1]}})";
+  for (size_t i = 0; i < json.size(); ++i) {
+    const char* next = nullptr;
+    RawJsonEvent event;
+    ASSERT_EQ(ReadOneJsonEvent(json.data(), json.data() + i, &event, &next),
+              ReadEventRes::kNeedsMoreData)
+        << json.substr(0, i);
+    ASSERT_EQ(next, nullptr);
+  }
+}
+
+TEST(JsonTraceTokenizerTest, ReadEventFatalError) {
+  for (const char* start : {R"({helloworld})", R"({"ph" "X"})",
+                            R"({"args": {"a": [1}]})", R"("ph")"}) {
+    const char* end = start + strlen(start);
+    const char* next = nullptr;
+    RawJsonEvent event;
+    ASSERT_EQ(ReadOneJsonEvent(start, end, &event, &next),
+              ReadEventRes::kFatalError)
+        << start;
+  }
+}
+
 TEST(JsonTraceTokenizerTest, ReadKeyIntValue) {
   const char* start = R"("Test": 01234, )";
   const char* middle = start + strlen(R"("Test": )");
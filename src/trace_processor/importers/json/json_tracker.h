@@ -47,6 +47,9 @@ class JsonTracker : public Destructible {
   base::Optional<int64_t> CoerceToTs(const Json::Value& value) {
     return json::CoerceToTs(time_unit_, value);
   }
+  base::Optional<int64_t> CoerceToTs(base::StringView raw_value) {
+    return json::CoerceToTs(time_unit_, raw_value);
+  }
 
  private:
   json::TimeUnit time_unit_ = json::TimeUnit::kUs;
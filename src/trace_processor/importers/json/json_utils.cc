@@ -18,6 +18,9 @@
 
 #include "perfetto/base/build_config.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <limits>
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
@@ -29,11 +32,113 @@ namespace trace_processor {
 namespace json {
 namespace {
 
-#if PERFETTO_BUILDFLAG(PERFETTO_TP_JSON)
 int64_t TimeUnitToNs(TimeUnit unit) {
   return static_cast<int64_t>(unit);
 }
-#endif
+
+// Large enough for any number which fits in an int64_t or a double, written
+// the way JSON writers do.
+constexpr size_t kMaxNumberLength = 64;
+
+// Copies |str| to |buf| with a terminating NUL, as needed by strtoll and
+// strtod. Returns false if |str| doesn't fit.
+bool CopyToCString(base::StringView str, char (&buf)[kMaxNumberLength]) {
+  if (str.size() >= kMaxNumberLength)
+    return false;
+  if (str.size() > 0)
+    memcpy(buf, str.data(), str.size());
+  buf[str.size()] = '\0';
+  return true;
+}
+
+bool IsRawString(base::StringView raw_value) {
+  return raw_value.size() >= 2 && raw_value.at(0) == '"' &&
+         raw_value.at(raw_value.size() - 1) == '"';
+}
+
+// Parses the characters of a string holding an integer the same way as the
+// Json::Value overloads do (i.e. with strtoll).
+base::Optional<int64_t> ParseIntegerString(base::StringView raw_value) {
+  char buf[kMaxNumberLength];
+  if (!CopyToCString(raw_value.substr(1, raw_value.size() - 2), buf))
+    return base::nullopt;
+  char* end;
+  int64_t n = strtoll(buf, &end, 10);
+  if (*end != '\0')
+    return base::nullopt;
+  return n;
+}
+
+// A JSON number, which can be parsed as an integer or as a real number, like
+// Json::Value does.
+struct RawNumber {
+  bool is_real = false;
+  int64_t integer = 0;
+  double real = 0;
+};
+
+base::Optional<RawNumber> ParseNumber(base::StringView raw_value) {
+  char buf[kMaxNumberLength];
+  if (raw_value.empty() || !CopyToCString(raw_value, buf))
+    return base::nullopt;
+  if (buf[0] != '-' && (buf[0] < '0' || buf[0] > '9'))
+    return base::nullopt;
+
+  RawNumber number;
+  char* end;
+  number.is_real = strpbrk(buf, ".eE") != nullptr;
+  if (number.is_real) {
+    number.real = strtod(buf, &end);
+  } else if (buf[0] == '-') {
+    number.integer = strtoll(buf, &end, 10);
+  } else {
+    // Like Json::Value, large positive integers are read as unsigned.
+    number.integer = static_cast<int64_t>(strtoull(buf, &end, 10));
+  }
+  if (*end != '\0')
+    return base::nullopt;
+  return number;
+}
+
+void AppendUtf8(uint32_t code_point, std::string* out) {
+  if (code_point < 0x80) {
+    out->push_back(static_cast<char>(code_point));
+  } else if (code_point < 0x800) {
+    out->push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else if (code_point < 0x10000) {
+    out->push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  } else {
+    out->push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    out->push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+}
+
+// Parses the 4 hex digits of a \uXXXX escape sequence starting at |s|.
+base::Optional<uint32_t> ParseHex4(const char* s, const char* end) {
+  if (end - s < 4)
+    return base::nullopt;
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    char c = s[i];
+    uint32_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = static_cast<uint32_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      digit = static_cast<uint32_t>(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      digit = static_cast<uint32_t>(c - 'A' + 10);
+    } else {
+      return base::nullopt;
+    }
+    value = value << 4 | digit;
+  }
+  return value;
+}
 
 }  // namespace
 
@@ -117,6 +222,114 @@ base::Optional<uint32_t> CoerceToUint32(const Json::Value& value) {
 #endif
 }
 
+base::Optional<int64_t> CoerceToTs(TimeUnit unit, base::StringView raw_value) {
+  if (IsRawString(raw_value)) {
+    base::Optional<int64_t> n = ParseIntegerString(raw_value);
+    if (!n)
+      return base::nullopt;
+    return *n * TimeUnitToNs(unit);
+  }
+  base::Optional<RawNumber> number = ParseNumber(raw_value);
+  if (!number)
+    return base::nullopt;
+  if (number->is_real)
+    return static_cast<int64_t>(number->real * TimeUnitToNs(unit));
+  return number->integer * TimeUnitToNs(unit);
+}
+
+base::Optional<int64_t> CoerceToInt64(base::StringView raw_value) {
+  if (IsRawString(raw_value))
+    return ParseIntegerString(raw_value);
+  base::Optional<RawNumber> number = ParseNumber(raw_value);
+  if (!number)
+    return base::nullopt;
+  if (number->is_real) {
+    // Like Json::Value::asUInt64(), only accept reals which fit in an uint64.
+    if (!(number->real >= 0 &&
+          number->real < static_cast<double>(
+                             std::numeric_limits<uint64_t>::max()))) {
+      return base::nullopt;
+    }
+    return static_cast<int64_t>(static_cast<uint64_t>(number->real));
+  }
+  return number->integer;
+}
+
+base::Optional<uint32_t> CoerceToUint32(base::StringView raw_value) {
+  base::Optional<int64_t> result = CoerceToInt64(raw_value);
+  if (!result.has_value())
+    return base::nullopt;
+  int64_t n = result.value();
+  if (n < 0 || n > std::numeric_limits<uint32_t>::max())
+    return base::nullopt;
+  return static_cast<uint32_t>(n);
+}
+
+base::Optional<base::StringView> UnescapeString(base::StringView raw_value,
+                                                std::string* buffer) {
+  if (!IsRawString(raw_value))
+    return base::nullopt;
+  const char* begin = raw_value.data() + 1;
+  const char* end = raw_value.data() + raw_value.size() - 1;
+  const char* backslash = static_cast<const char*>(
+      memchr(begin, '\\', static_cast<size_t>(end - begin)));
+  if (!backslash)
+    return base::StringView(begin, static_cast<size_t>(end - begin));
+
+  buffer->assign(begin, backslash);
+  for (const char* s = backslash; s < end; s++) {
+    if (*s != '\\') {
+      buffer->push_back(*s);
+      continue;
+    }
+    if (++s == end)
+      return base::nullopt;
+    switch (*s) {
+      case '"':
+      case '\\':
+      case '/':
+        buffer->push_back(*s);
+        break;
+      case 'b':
+        buffer->push_back('\b');
+        break;
+      case 'f':
+        buffer->push_back('\f');
+        break;
+      case 'n':
+        buffer->push_back('\n');
+        break;
+      case 'r':
+        buffer->push_back('\r');
+        break;
+      case 't':
+        buffer->push_back('\t');
+        break;
+      case 'u': {
+        base::Optional<uint32_t> code_point = ParseHex4(s + 1, end);
+        if (!code_point)
+          return base::nullopt;
+        s += 4;
+        // Characters outside of the BMP are escaped as a surrogate pair.
+        if (*code_point >= 0xD800 && *code_point < 0xDC00 && end - s > 6 &&
+            s[1] == '\\' && s[2] == 'u') {
+          base::Optional<uint32_t> low = ParseHex4(s + 3, end);
+          if (low && *low >= 0xDC00 && *low < 0xE000) {
+            code_point =
+                0x10000 + ((*code_point - 0xD800) << 10) + (*low - 0xDC00);
+            s += 6;
+          }
+        }
+        AppendUtf8(*code_point, buffer);
+        break;
+      }
+      default:
+        return base::nullopt;
+    }
+  }
+  return base::StringView(*buffer);
+}
+
 base::Optional<Json::Value> ParseJsonString(base::StringView raw_string) {
   PERFETTO_DCHECK(IsJsonSupported());
 
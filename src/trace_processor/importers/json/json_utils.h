@@ -19,6 +19,8 @@
 
 #include <stdint.h>
 
+#include <string>
+
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_view.h"
 
@@ -45,6 +47,20 @@ base::Optional<int64_t> CoerceToTs(TimeUnit unit, const Json::Value& value);
 base::Optional<int64_t> CoerceToInt64(const Json::Value& value);
 base::Optional<uint32_t> CoerceToUint32(const Json::Value& value);
 
+// Same as above for the raw JSON text of a value (e.g. 42, "42" or 4.2e1, as
+// extracted by JsonTraceTokenizer), which doesn't need to be parsed into a
+// Json::Value first.
+base::Optional<int64_t> CoerceToTs(TimeUnit unit, base::StringView raw_value);
+base::Optional<int64_t> CoerceToInt64(base::StringView raw_value);
+base::Optional<uint32_t> CoerceToUint32(base::StringView raw_value);
+
+// Returns the characters of the raw JSON string |raw_value| (including its
+// quotes), or nullopt if |raw_value| is not a string. Escape sequences are
+// replaced in |buffer|, which the returned view then points to: strings
+// without escape sequences are returned without being copied.
+base::Optional<base::StringView> UnescapeString(base::StringView raw_value,
+                                                std::string* buffer);
+
 // Parses the given JSON string into a JSON::Value object.
 // This function should only be called if |IsJsonSupported()| returns true.
 base::Optional<Json::Value> ParseJsonString(base::StringView raw_string);
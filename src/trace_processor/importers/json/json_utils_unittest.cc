@@ -54,6 +54,50 @@ TEST(JsonTraceUtilsTest, CoerceToTs) {
   ASSERT_FALSE(CoerceToTs(TimeUnit::kMs, Json::Value("1234!")).has_value());
 }
 
+TEST(JsonTraceUtilsTest, CoerceRawValues) {
+  ASSERT_EQ(CoerceToUint32(base::StringView("42")).value_or(0), 42u);
+  ASSERT_EQ(CoerceToUint32(base::StringView(R"("42")")).value_or(0), 42u);
+  ASSERT_FALSE(CoerceToUint32(base::StringView("-1")).has_value());
+  ASSERT_EQ(CoerceToInt64(base::StringView("-42")).value_or(0), -42);
+  ASSERT_EQ(CoerceToInt64(base::StringView("42.9")).value_or(-1), 42);
+  ASSERT_EQ(
+      CoerceToInt64(base::StringView("18446744073709551615")).value_or(0), -1);
+  ASSERT_FALSE(CoerceToInt64(base::StringView(R"("1234!")")).has_value());
+  ASSERT_FALSE(CoerceToInt64(base::StringView("true")).has_value());
+  ASSERT_FALSE(CoerceToInt64(base::StringView("{}")).has_value());
+  ASSERT_FALSE(CoerceToInt64(base::StringView()).has_value());
+
+  ASSERT_EQ(CoerceToTs(TimeUnit::kUs, base::StringView("42")).value_or(-1),
+            42000);
+  ASSERT_EQ(CoerceToTs(TimeUnit::kUs, base::StringView("42.1")).value_or(-1),
+            42100);
+  ASSERT_EQ(CoerceToTs(TimeUnit::kUs, base::StringView("4.2e1")).value_or(-1),
+            42000);
+  ASSERT_EQ(
+      CoerceToTs(TimeUnit::kMs, base::StringView(R"("42")")).value_or(-1),
+      42000000);
+  ASSERT_FALSE(CoerceToTs(TimeUnit::kNs, base::StringView("4x")).has_value());
+  ASSERT_FALSE(
+      CoerceToTs(TimeUnit::kNs, base::StringView("null")).has_value());
+}
+
+TEST(JsonTraceUtilsTest, UnescapeString) {
+  std::string buffer;
+  base::StringView raw = R"("foo")";
+  base::Optional<base::StringView> str = UnescapeString(raw, &buffer);
+  ASSERT_EQ(str->ToStdString(), "foo");
+  ASSERT_EQ(str->data(), raw.data() + 1);
+
+  str = UnescapeString(R"("a\"b\\c\/\n\t")", &buffer);
+  ASSERT_EQ(str->ToStdString(), "a\"b\\c/\n\t");
+  str = UnescapeString(R"("A\u00e9\u20ac\ud83d\ude00")", &buffer);
+  ASSERT_EQ(str->ToStdString(), "A\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+
+  ASSERT_FALSE(UnescapeString("42", &buffer).has_value());
+  ASSERT_FALSE(UnescapeString(R"("\x")", &buffer).has_value());
+  ASSERT_FALSE(UnescapeString(R"("\u12")", &buffer).has_value());
+}
+
 }  // namespace
 }  // namespace json
 }  // namespace trace_processor
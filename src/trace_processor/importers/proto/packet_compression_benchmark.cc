@@ -0,0 +1,257 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the codecs of TracePacket.compressed_packets (deflate) and
+// TracePacket.lz4_compressed_packets. The packets of a trace are split in
+// batches of at most 480KB, like perfetto_cmd and the tracing service do, and
+// each batch is compressed independently.
+// BM_PacketCompression measures the cost of compressing the batches, as paid
+// on the device, and reports the compression ratio. BM_PacketDecompression
+// measures the cost of decompressing them, using the same functions as the
+// trace processor importer.
+// The traces are a synthetic ftrace trace and, when they are available (see
+// tools/install-build-deps), the example traces of test/data.
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/lz4.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "src/base/test/utils.h"
+#include "src/trace_processor/importers/proto/proto_trace_framer.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+using perfetto::trace_processor::DecompressLz4TracePackets;
+using perfetto::trace_processor::DecompressTracePackets;
+using perfetto::trace_processor::GzipDecompressor;
+using perfetto::trace_processor::TraceBlobView;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// The max size of the uncompressed data of each compressed packet, as in
+// perfetto_cmd's Lz4PacketWriter and in the tracing service.
+constexpr size_t kMaxBatchSize = 480 * 1024;
+
+enum Codec : int64_t {
+  kLz4 = 0,
+  // Deflate at the compression level used by perfetto_cmd's ZipPacketWriter.
+  kDeflate = 1,
+  // Deflate at its fastest compression level.
+  kDeflateFast = 2,
+};
+
+const char* const kTraces[] = {
+    nullptr,  // The synthetic trace.
+    "test/data/example_android_trace_30s.pb",
+    "test/data/android_sched_and_ps.pb",
+};
+
+// Returns a serialized Trace containing |num_bundles| ftrace bundles of
+// sched_switch events.
+std::string CreateFtraceTrace(uint32_t num_bundles) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
+  uint64_t ts = 1000;
+  for (uint32_t i = 0; i < num_bundles; i++) {
+    auto* packet = trace->add_packet();
+    packet->set_trusted_packet_sequence_id(1);
+    auto* bundle = packet->set_ftrace_events();
+    bundle->set_cpu(i % 8);
+    for (uint32_t j = 0; j < 64; j++) {
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts += rnd_engine() % 1000);
+      event->set_pid(rnd_engine() % 1000);
+      auto* sched_switch = event->set_sched_switch();
+      sched_switch->set_prev_comm("thread_" + std::to_string(j));
+      sched_switch->set_prev_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_prev_prio(120);
+      sched_switch->set_prev_state(1);
+      sched_switch->set_next_comm("thread_" + std::to_string(j + 1));
+      sched_switch->set_next_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_next_prio(120);
+    }
+  }
+  return trace.SerializeAsString();
+}
+
+// Splits the packets of the serialized |trace| in batches of at most
+// kMaxBatchSize bytes (unless a single packet is larger than that).
+bool SplitInBatches(const std::string& trace, std::vector<std::string>* out) {
+  perfetto::protos::pbzero::Trace::Decoder decoder(
+      reinterpret_cast<const uint8_t*>(trace.data()), trace.size());
+  const char* batch_start = trace.data();
+  const char* batch_end = batch_start;
+  for (auto it = decoder.packet(); it; ++it) {
+    protozero::ConstBytes packet = *it;
+    const char* packet_end =
+        reinterpret_cast<const char*>(packet.data + packet.size);
+    if (static_cast<size_t>(packet_end - batch_start) > kMaxBatchSize &&
+        batch_end != batch_start) {
+      out->emplace_back(batch_start, batch_end);
+      batch_start = batch_end;
+    }
+    batch_end = packet_end;
+  }
+  if (batch_end != batch_start)
+    out->emplace_back(batch_start, batch_end);
+  return decoder.bytes_left() == 0 && !out->empty();
+}
+
+bool LoadBatches(benchmark::State& state, std::vector<std::string>* out) {
+  const char* path = kTraces[state.range(0)];
+  std::string trace;
+  if (!path) {
+    trace = CreateFtraceTrace(IsBenchmarkFunctionalOnly() ? 64 : 16 * 1024);
+  } else if (!perfetto::base::ReadFile(perfetto::base::GetTestDataPath(path),
+                                       &trace)) {
+    state.SkipWithError("Trace not found, run tools/install-build-deps");
+    return false;
+  }
+  if (!SplitInBatches(trace, out)) {
+    state.SkipWithError("Failed to parse the trace");
+    return false;
+  }
+  return true;
+}
+
+// Compresses |batch| as the contents of a compressed_packets (or
+// lz4_compressed_packets) field.
+std::string Compress(Codec codec,
+                     perfetto::base::Lz4Compressor* lz4,
+                     const std::string& batch) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(batch.data());
+  std::string out;
+  if (codec == kLz4) {
+    out.resize(protozero::proto_utils::kMaxSimpleFieldEncodedSize +
+               perfetto::base::Lz4CompressBound(batch.size()));
+    uint8_t* start = reinterpret_cast<uint8_t*>(&out[0]);
+    uint8_t* ptr = protozero::proto_utils::WriteVarInt(batch.size(), start);
+    ptr += lz4->Compress(data, batch.size(), ptr);
+    out.resize(static_cast<size_t>(ptr - start));
+    return out;
+  }
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  uLongf size = compressBound(static_cast<uLong>(batch.size()));
+  out.resize(size);
+  PERFETTO_CHECK(compress2(reinterpret_cast<Bytef*>(&out[0]), &size, data,
+                           static_cast<uLong>(batch.size()),
+                           codec == kDeflate ? 6 : 1) == Z_OK);
+  out.resize(size);
+#endif
+  return out;
+}
+
+void CodecArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"trace", "codec"});
+  for (int64_t trace = 0; trace < static_cast<int64_t>(
+                                      perfetto::base::ArraySize(kTraces));
+       trace++) {
+    b->Args({trace, kLz4});
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+    b->Args({trace, kDeflate});
+    b->Args({trace, kDeflateFast});
+#endif
+  }
+}
+
+static void BM_PacketCompression(benchmark::State& state) {
+  const Codec codec = static_cast<Codec>(state.range(1));
+  std::vector<std::string> batches;
+  if (!LoadBatches(state, &batches))
+    return;
+
+  perfetto::base::Lz4Compressor lz4;
+  size_t uncompressed_size = 0;
+  size_t compressed_size = 0;
+  for (auto _ : state) {
+    uncompressed_size = 0;
+    compressed_size = 0;
+    for (const std::string& batch : batches) {
+      std::string compressed = Compress(codec, &lz4, batch);
+      uncompressed_size += batch.size();
+      compressed_size += compressed.size();
+      benchmark::DoNotOptimize(compressed);
+    }
+  }
+  state.counters["ratio"] =
+      benchmark::Counter(static_cast<double>(uncompressed_size) /
+                         static_cast<double>(compressed_size));
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(uncompressed_size));
+}
+BENCHMARK(BM_PacketCompression)
+    ->Apply(CodecArgs)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_PacketDecompression(benchmark::State& state) {
+  const Codec codec = static_cast<Codec>(state.range(1));
+  std::vector<std::string> batches;
+  if (!LoadBatches(state, &batches))
+    return;
+
+  perfetto::base::Lz4Compressor lz4;
+  std::vector<std::string> compressed;
+  size_t uncompressed_size = 0;
+  for (const std::string& batch : batches) {
+    compressed.emplace_back(Compress(codec, &lz4, batch));
+    uncompressed_size += batch.size();
+  }
+
+  GzipDecompressor decompressor;
+  for (auto _ : state) {
+    size_t decompressed_size = 0;
+    for (const std::string& field : compressed) {
+      const uint8_t* data = reinterpret_cast<const uint8_t*>(field.data());
+      TraceBlobView packets =
+          codec == kLz4
+              ? DecompressLz4TracePackets(data, field.size())
+              : DecompressTracePackets(&decompressor, data, field.size());
+      decompressed_size += packets.length();
+    }
+    PERFETTO_CHECK(decompressed_size == uncompressed_size);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(uncompressed_size));
+}
+BENCHMARK(BM_PacketDecompression)
+    ->Apply(CodecArgs)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/proto_trace_framer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/lz4.h"
+#include "perfetto/ext/base/thread_pool.h"
+#include "perfetto/ext/base/thread_utils.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/proto_decoder.h"
+#include "perfetto/protozero/proto_utils.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+using protozero::proto_utils::MakeTagLengthDelimited;
+using protozero::proto_utils::ParseVarInt;
+
+namespace {
+
+constexpr uint8_t kTracePacketTag =
+    MakeTagLengthDelimited(protos::pbzero::Trace::kPacketFieldNumber);
+
+// If the only field of |packet| is compressed_packets or
+// lz4_compressed_packets, which is how the packets written by perfetto_cmd's
+// ZipPacketWriter and Lz4PacketWriter look like, returns its id. Returns 0
+// otherwise.
+uint32_t GetOnlyCompressedPacketsField(const uint8_t* data, size_t size) {
+  using protos::pbzero::TracePacket;
+  protozero::ProtoDecoder decoder(data, size);
+  uint32_t field_id = 0;
+  for (auto f = decoder.ReadField(); f.valid(); f = decoder.ReadField()) {
+    if ((f.id() != TracePacket::kCompressedPacketsFieldNumber &&
+         f.id() != TracePacket::kLz4CompressedPacketsFieldNumber) ||
+        (field_id != 0 && f.id() != field_id)) {
+      return 0;
+    }
+    field_id = f.id();
+  }
+  return decoder.bytes_left() == 0 ? field_id : 0;
+}
+
+// Appends to |out| the TracePackets contained in the |inflated| contents of a
+// compressed_packets field, with a buffer_idx of 0. Returns false if
+// |inflated| is not a sequence of whole TracePackets.
+bool SplitInflatedPackets(
+    const TraceBlobView& inflated,
+    std::vector<ProtoTraceFramer::FramedChunk::Packet>* out) {
+  const uint8_t* start = inflated.data();
+  const uint8_t* end = start + inflated.length();
+  if (!start)
+    return false;
+  for (const uint8_t* ptr = start; (end - ptr) > 2;) {
+    const uint8_t* packet_start = ptr;
+    if (PERFETTO_UNLIKELY(*ptr != kTracePacketTag))
+      return false;
+    uint64_t packet_size = 0;
+    ptr = ParseVarInt(++ptr, end, &packet_size);
+    size_t packet_offset = static_cast<size_t>(ptr - start);
+    ptr += packet_size;
+    if (PERFETTO_UNLIKELY((ptr - packet_start) < 2 || ptr > end))
+      return false;
+    out->emplace_back(ProtoTraceFramer::FramedChunk::Packet{
+        0, static_cast<uint32_t>(packet_offset),
+        static_cast<uint32_t>(packet_size)});
+  }
+  return true;
+}
+
+}  // namespace
+
+TraceBlobView DecompressTracePackets(GzipDecompressor* decompressor,
+                                     const uint8_t* input,
+                                     size_t input_size) {
+  PERFETTO_DCHECK(gzip::IsGzipSupported());
+
+  uint8_t out[4096];
+
+  std::vector<uint8_t> data;
+  data.reserve(input_size);
+
+  // Ensure that the decompressor is able to cope with a new stream of data.
+  decompressor->Reset();
+  decompressor->SetInput(input, input_size);
+
+  using ResultCode = GzipDecompressor::ResultCode;
+  for (auto ret = ResultCode::kOk; ret != ResultCode::kEof;) {
+    auto res = decompressor->Decompress(out, base::ArraySize(out));
+    ret = res.ret;
+    if (ret == ResultCode::kError || ret == ResultCode::kNoProgress ||
+        ret == ResultCode::kNeedsMoreInput)
+      return TraceBlobView(nullptr, 0, 0);
+
+    data.insert(data.end(), out, out + res.bytes_written);
+  }
+
+  std::unique_ptr<uint8_t[]> output(new uint8_t[data.size()]);
+  memcpy(output.get(), data.data(), data.size());
+  return TraceBlobView(std::move(output), 0, data.size());
+}
+
+TraceBlobView DecompressLz4TracePackets(const uint8_t* input,
+                                        size_t input_size) {
+  const uint8_t* end = input + input_size;
+  uint64_t size = 0;
+  const uint8_t* block = ParseVarInt(input, end, &size);
+  // LZ4 can't compress data by more than ~255 times (each byte of a match
+  // length counts for at most 255 bytes), which bounds the allocation below.
+  if (block == input || size > static_cast<uint64_t>(input_size) * 256)
+    return TraceBlobView(nullptr, 0, 0);
+
+  std::unique_ptr<uint8_t[]> output(new uint8_t[size]);
+  if (!base::Lz4Decompress(block, static_cast<size_t>(end - block),
+                           output.get(), static_cast<size_t>(size))) {
+    return TraceBlobView(nullptr, 0, 0);
+  }
+  return TraceBlobView(std::move(output), 0, static_cast<size_t>(size));
+}
+
+ProtoTraceFramer::ProtoTraceFramer(bool inflate_compressed_packets,
+                                   base::ThreadPool* inflate_pool)
+    : inflate_compressed_packets_(inflate_compressed_packets),
+      inflate_pool_(inflate_pool) {}
+
+ProtoTraceFramer::~ProtoTraceFramer() = default;
+
+util::Status ProtoTraceFramer::Frame(std::unique_ptr<uint8_t[]> owned_buf,
+                                     size_t size,
+                                     FramedChunk* out) {
+  return Frame(TraceBlobView(std::move(owned_buf), 0, size), out);
+}
+
+util::Status ProtoTraceFramer::Frame(TraceBlobView owned_buf,
+                                     FramedChunk* out) {
+  PERFETTO_DCHECK(owned_buf.offset() == 0);
+  const uint8_t* data = owned_buf.data();
+  size_t size = owned_buf.length();
+  if (!partial_buf_.empty()) {
+    // It takes ~5 bytes for a proto preamble + the varint size.
+    const size_t kHeaderBytes = 5;
+    if (PERFETTO_UNLIKELY(partial_buf_.size() < kHeaderBytes)) {
+      size_t missing_len = std::min(kHeaderBytes - partial_buf_.size(), size);
+      partial_buf_.insert(partial_buf_.end(), &data[0], &data[missing_len]);
+      if (partial_buf_.size() < kHeaderBytes)
+        return util::OkStatus();
+      data += missing_len;
+      size -= missing_len;
+    }
+
+    // At this point we have enough data in |partial_buf_| to read at least the
+    // field header and know the size of the next TracePacket.
+    const uint8_t* pos = &partial_buf_[0];
+    uint8_t proto_field_tag = *pos;
+    uint64_t field_size = 0;
+    const uint8_t* next = ParseVarInt(++pos, &*partial_buf_.end(), &field_size);
+    bool parse_failed = next == pos;
+    pos = next;
+    if (proto_field_tag != kTracePacketTag || field_size == 0 || parse_failed) {
+      return util::ErrStatus(
+          "Failed parsing a TracePacket from the partial buffer");
+    }
+
+    // At this point we know how big the TracePacket is.
+    size_t hdr_size = static_cast<size_t>(pos - &partial_buf_[0]);
+    size_t size_incl_header = static_cast<size_t>(field_size + hdr_size);
+    PERFETTO_DCHECK(size_incl_header > partial_buf_.size());
+
+    // There is a good chance that between the |partial_buf_| and the new |data|
+    // of the current call we have enough bytes to frame a TracePacket.
+    if (partial_buf_.size() + size >= size_incl_header) {
+      // Create a new buffer for the whole TracePacket and copy into that:
+      // 1) The beginning of the TracePacket (including the proto header) from
+      //    the partial buffer.
+      // 2) The rest of the TracePacket from the current |data| buffer (note
+      //    that we might have consumed already a few bytes form |data| earlier
+      //    in this function, hence we need to keep |off| into account).
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size_incl_header]);
+      memcpy(&buf[0], partial_buf_.data(), partial_buf_.size());
+      // |size_missing| is the number of bytes for the rest of the TracePacket
+      // in |data|.
+      size_t size_missing = size_incl_header - partial_buf_.size();
+      memcpy(&buf[partial_buf_.size()], &data[0], size_missing);
+      data += size_missing;
+      size -= size_missing;
+      partial_buf_.clear();
+      TraceBlobView packet(std::move(buf), 0, size_incl_header);
+      const uint8_t* packet_start = packet.data();
+      util::Status status = FrameWholePackets(
+          std::move(packet), packet_start, size_incl_header, out);
+      if (PERFETTO_UNLIKELY(!status.ok()))
+        return status;
+    } else {
+      partial_buf_.insert(partial_buf_.end(), data, &data[size]);
+      return util::OkStatus();
+    }
+  }
+  return FrameWholePackets(std::move(owned_buf), data, size, out);
+}
+
+util::Status ProtoTraceFramer::FrameWholePackets(TraceBlobView owned_buf,
+                                                 const uint8_t* data,
+                                                 size_t size,
+                                                 FramedChunk* out) {
+  PERFETTO_DCHECK(data >= owned_buf.data());
+  const uint8_t* start = owned_buf.data();
+  const uint32_t buffer_idx = static_cast<uint32_t>(out->buffers.size());
+  const size_t packets_before = out->packets.size();
+
+  protos::pbzero::Trace::Decoder decoder(data, size);
+  for (auto it = decoder.packet(); it; ++it) {
+    protozero::ConstBytes packet = *it;
+    out->packets.emplace_back(FramedChunk::Packet{
+        buffer_idx, static_cast<uint32_t>(packet.data - start),
+        static_cast<uint32_t>(packet.size)});
+  }
+
+  const size_t bytes_left = decoder.bytes_left();
+  if (bytes_left > 0) {
+    PERFETTO_DCHECK(partial_buf_.empty());
+    partial_buf_.insert(partial_buf_.end(), &data[decoder.read_offset()],
+                        &data[decoder.read_offset() + bytes_left]);
+  }
+
+  // Don't retain buffers which turned out to contain no whole packet.
+  if (out->packets.size() == packets_before)
+    return util::OkStatus();
+
+  const size_t buf_size = static_cast<size_t>(data - start) + size;
+  out->buffers.emplace_back(owned_buf.slice(0, buf_size));
+  if (inflate_compressed_packets_)
+    MaybeInflate(out);
+  return util::OkStatus();
+}
+
+// Replaces the packets of the last buffer of |out| which contain only
+// compressed_packets with the packets they contain. The inflated packets are
+// stored in new buffers, appended to |out|.
+void ProtoTraceFramer::MaybeInflate(FramedChunk* out) {
+  const uint32_t buffer_idx = static_cast<uint32_t>(out->buffers.size() - 1);
+  auto first = std::find_if(
+      out->packets.begin(), out->packets.end(),
+      [buffer_idx](const FramedChunk::Packet& p) {
+        return p.buffer_idx == buffer_idx;
+      });
+  const size_t first_idx = static_cast<size_t>(first - out->packets.begin());
+
+  std::vector<FramedChunk::Packet> packets(
+      out->packets.begin() + static_cast<ptrdiff_t>(first_idx),
+      out->packets.end());
+  out->packets.resize(first_idx);
+
+  // Inflate all the compressed packets of the buffer upfront, so that they can
+  // be inflated in parallel.
+  struct InflatedPacket {
+    size_t packet_idx;
+    bool lz4;
+    TraceBlobView buffer;
+    std::vector<FramedChunk::Packet> packets;
+    bool valid;
+  };
+  const uint8_t* buf = out->buffers[buffer_idx].data();
+  std::vector<InflatedPacket> inflated;
+  for (size_t i = 0; i < packets.size(); i++) {
+    uint32_t field_id =
+        GetOnlyCompressedPacketsField(buf + packets[i].offset, packets[i].size);
+    bool lz4 = field_id ==
+               protos::pbzero::TracePacket::kLz4CompressedPacketsFieldNumber;
+    if (lz4 || (field_id != 0 && gzip::IsGzipSupported())) {
+      inflated.push_back(
+          InflatedPacket{i, lz4, TraceBlobView(nullptr, 0, 0), {}, false});
+    }
+  }
+  auto inflate = [&packets, buf](GzipDecompressor* decompressor,
+                                 InflatedPacket* item) {
+    const FramedChunk::Packet& packet = packets[item->packet_idx];
+    protos::pbzero::TracePacket::Decoder decoder(buf + packet.offset,
+                                                 packet.size);
+    if (item->lz4) {
+      protozero::ConstBytes field = decoder.lz4_compressed_packets();
+      item->buffer = DecompressLz4TracePackets(field.data, field.size);
+    } else {
+      protozero::ConstBytes field = decoder.compressed_packets();
+      item->buffer =
+          DecompressTracePackets(decompressor, field.data, field.size);
+    }
+    item->valid = SplitInflatedPackets(item->buffer, &item->packets);
+  };
+  if (inflate_pool_ && inflated.size() > 1) {
+    inflate_pool_->ParallelFor(inflated.size(), [&](size_t i) {
+      GzipDecompressor decompressor;
+      inflate(&decompressor, &inflated[i]);
+    });
+  } else {
+    for (InflatedPacket& item : inflated)
+      inflate(&decompressor_, &item);
+  }
+
+  auto next_inflated = inflated.begin();
+  for (size_t i = 0; i < packets.size(); i++) {
+    if (next_inflated == inflated.end() || next_inflated->packet_idx != i) {
+      out->packets.emplace_back(packets[i]);
+      continue;
+    }
+    InflatedPacket& item = *next_inflated++;
+
+    // Leave the packet as-is on failure: the tokenizer will go through the
+    // same (failing) path it would have followed without this framer.
+    if (!item.valid) {
+      out->packets.emplace_back(packets[i]);
+      continue;
+    }
+    const uint32_t inner_buffer_idx =
+        static_cast<uint32_t>(out->buffers.size());
+    out->buffers.emplace_back(std::move(item.buffer));
+    for (FramedChunk::Packet& packet : item.packets) {
+      packet.buffer_idx = inner_buffer_idx;
+      out->packets.emplace_back(packet);
+    }
+  }
+}
+
+ProtoTraceFramerThread::ProtoTraceFramerThread(bool inflate_compressed_packets,
+                                               uint32_t num_inflate_threads)
+    : inflate_pool_(num_inflate_threads && inflate_compressed_packets
+                        ? new base::ThreadPool(num_inflate_threads,
+                                               "PacketInflate")
+                        : nullptr),
+      framer_(inflate_compressed_packets, inflate_pool_.get()),
+      thread_(&ProtoTraceFramerThread::ThreadMain, this) {}
+
+ProtoTraceFramerThread::~ProtoTraceFramerThread() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  input_cv_.notify_one();
+  thread_.join();
+}
+
+void ProtoTraceFramerThread::Push(TraceBlobView chunk) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PERFETTO_DCHECK(!input_eof_);
+    input_.emplace_back(std::move(chunk));
+  }
+  chunks_in_flight_++;
+  input_cv_.notify_one();
+}
+
+void ProtoTraceFramerThread::PushEndOfFile() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    input_eof_ = true;
+  }
+  input_cv_.notify_one();
+}
+
+bool ProtoTraceFramerThread::Pop(bool block,
+                                 ProtoTraceFramer::FramedChunk* out,
+                                 util::Status* status) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (block) {
+    output_cv_.wait(lock, [this] { return !output_.empty() || output_eof_; });
+  }
+  if (output_.empty())
+    return false;
+  *out = std::move(output_.front().framed);
+  *status = std::move(output_.front().status);
+  output_.pop_front();
+  chunks_in_flight_--;
+  return true;
+}
+
+void ProtoTraceFramerThread::ThreadMain() {
+  base::MaybeSetThreadName("TraceFramer");
+  for (;;) {
+    TraceBlobView chunk(nullptr, 0, 0);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      input_cv_.wait(lock,
+                     [this] { return quit_ || input_eof_ || !input_.empty(); });
+      if (quit_)
+        return;
+      if (input_.empty()) {
+        PERFETTO_DCHECK(input_eof_);
+        output_eof_ = true;
+        output_cv_.notify_one();
+        return;
+      }
+      chunk = std::move(input_.front());
+      input_.pop_front();
+    }
+
+    OutputChunk output;
+    output.status = framer_.Frame(std::move(chunk), &output.framed);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      output_.emplace_back(std::move(output));
+    }
+    output_cv_.notify_one();
+  }
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
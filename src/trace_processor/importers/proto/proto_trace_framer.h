@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_FRAMER_H_
+#define SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_FRAMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/importers/gzip/gzip_utils.h"
+#include "src/trace_processor/trace_blob_view.h"
+
+namespace perfetto {
+namespace base {
+class ThreadPool;
+}  // namespace base
+
+namespace trace_processor {
+
+// Inflates the contents of a TracePacket.compressed_packets field into a new
+// buffer. Returns an empty TraceBlobView if the data could not be inflated.
+TraceBlobView DecompressTracePackets(GzipDecompressor*,
+                                     const uint8_t* data,
+                                     size_t size);
+
+// Same as above, for the contents of a TracePacket.lz4_compressed_packets
+// field.
+TraceBlobView DecompressLz4TracePackets(const uint8_t* data, size_t size);
+
+// Splits a stream of bytes of a proto trace, pushed in arbitrarily sized
+// chunks, into TracePacket boundaries. TracePackets that span across two (or
+// more) chunks are glued together into a new buffer.
+// This class does not touch any TraceProcessorContext state, which allows to
+// run it on a different thread than the rest of the import pipeline.
+class ProtoTraceFramer {
+ public:
+  // The TracePackets framed out of one input chunk, in stream order. Each
+  // packet refers to a [offset, offset + size) range of one of |buffers|.
+  // The framer doesn't retain any reference to |buffers|, so a FramedChunk
+  // can be handed over to another thread.
+  struct FramedChunk {
+    struct Packet {
+      uint32_t buffer_idx;
+      uint32_t offset;
+      uint32_t size;
+    };
+
+    std::vector<TraceBlobView> buffers;
+    std::vector<Packet> packets;
+  };
+
+  // If |inflate_compressed_packets| is true, TracePackets which consist only
+  // of a compressed_packets (or lz4_compressed_packets) field are replaced, in
+  // place, by the TracePackets they contain. If |inflate_pool| is not null,
+  // the compressed packets of a chunk are inflated in parallel on it.
+  explicit ProtoTraceFramer(bool inflate_compressed_packets = false,
+                            base::ThreadPool* inflate_pool = nullptr);
+  ~ProtoTraceFramer();
+
+  // Appends to |out| all the TracePackets that can be framed after pushing
+  // |size| bytes of |buf|. Packets framed before an error is encountered are
+  // still appended to |out|.
+  util::Status Frame(std::unique_ptr<uint8_t[]> buf,
+                     size_t size,
+                     FramedChunk* out);
+
+  // Same as above, for a chunk which starts at the beginning of its buffer
+  // (i.e. |chunk.offset()| == 0). Whole packets in |chunk| are referenced,
+  // not copied.
+  util::Status Frame(TraceBlobView chunk, FramedChunk* out);
+
+ private:
+  util::Status FrameWholePackets(TraceBlobView owned_buf,
+                                 const uint8_t* data,
+                                 size_t size,
+                                 FramedChunk* out);
+  void MaybeInflate(FramedChunk* out);
+
+  const bool inflate_compressed_packets_;
+  base::ThreadPool* const inflate_pool_;
+
+  // Used to glue together trace packets that span across two (or more)
+  // Frame() boundaries.
+  std::vector<uint8_t> partial_buf_;
+
+  GzipDecompressor decompressor_;
+};
+
+// Runs a ProtoTraceFramer on a dedicated thread so that framing (and inflating
+// compressed packets) of the next chunks overlaps with the tokenization and
+// parsing of the current one on the calling thread.
+// All the methods must be called on the same (consumer) thread.
+class ProtoTraceFramerThread {
+ public:
+  // If |num_inflate_threads| is non-zero, compressed packets are inflated in
+  // parallel on a pool of that many extra threads.
+  explicit ProtoTraceFramerThread(bool inflate_compressed_packets,
+                                  uint32_t num_inflate_threads = 0);
+  ~ProtoTraceFramerThread();
+
+  // Hands over a chunk to the framing thread. Never blocks: callers are
+  // expected to bound the memory usage by looking at chunks_in_flight().
+  void Push(TraceBlobView chunk);
+
+  // Signals that no more chunks will be pushed.
+  void PushEndOfFile();
+
+  // Pops the next framed chunk, in the same order chunks were pushed. If
+  // |block| is false, returns false if the framing thread has not finished
+  // the next chunk yet. If |block| is true, waits for it and returns false
+  // only once all chunks have been popped after PushEndOfFile().
+  bool Pop(bool block, ProtoTraceFramer::FramedChunk* out, util::Status*);
+
+  // Number of chunks pushed and not popped yet.
+  size_t chunks_in_flight() const { return chunks_in_flight_; }
+
+ private:
+  struct OutputChunk {
+    ProtoTraceFramer::FramedChunk framed;
+    util::Status status;
+  };
+
+  void ThreadMain();
+
+  std::unique_ptr<base::ThreadPool> inflate_pool_;
+  ProtoTraceFramer framer_;
+  size_t chunks_in_flight_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable input_cv_;
+  std::condition_variable output_cv_;
+  std::deque<TraceBlobView> input_;  // Guarded by |mutex_|.
+  std::deque<OutputChunk> output_;   // Guarded by |mutex_|.
+  bool input_eof_ = false;           // Guarded by |mutex_|.
+  bool output_eof_ = false;          // Guarded by |mutex_|.
+  bool quit_ = false;                // Guarded by |mutex_|.
+
+  std::thread thread_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_IMPORTERS_PROTO_PROTO_TRACE_FRAMER_H_
@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/proto/proto_trace_framer.h"
+
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/lz4.h"
+#include "perfetto/ext/base/thread_pool.h"
+#include "perfetto/protozero/proto_utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "test/gtest_and_gmock.h"
+
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using FramedChunk = ProtoTraceFramer::FramedChunk;
+using ::testing::ElementsAreArray;
+
+// Returns a serialized Trace proto with |num_packets| packets, each carrying
+// a different timestamp and a payload of variable size.
+std::vector<uint8_t> CreateTrace(uint32_t first_ts, uint32_t num_packets) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  for (uint32_t i = 0; i < num_packets; i++) {
+    auto* packet = trace->add_packet();
+    packet->set_timestamp(first_ts + i);
+    packet->set_trusted_packet_sequence_id(1);
+    packet->set_synchronization_marker(std::string(i * 7 % 300, 'x'));
+  }
+  return trace.SerializeAsArray();
+}
+
+std::unique_ptr<uint8_t[]> Copy(const uint8_t* data, size_t size) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+  memcpy(buf.get(), data, size);
+  return buf;
+}
+
+// Returns the timestamps of the framed packets, in order.
+void AppendTimestamps(const FramedChunk& chunk, std::vector<uint64_t>* out) {
+  for (const FramedChunk::Packet& p : chunk.packets) {
+    const TraceBlobView& buffer = chunk.buffers[p.buffer_idx];
+    protos::pbzero::TracePacket::Decoder decoder(buffer.data() + p.offset,
+                                                 p.size);
+    out->push_back(decoder.timestamp());
+  }
+}
+
+std::vector<uint64_t> Iota(uint64_t first, uint64_t num) {
+  std::vector<uint64_t> ret;
+  for (uint64_t i = 0; i < num; i++)
+    ret.push_back(first + i);
+  return ret;
+}
+
+TEST(ProtoTraceFramerTest, OneChunk) {
+  std::vector<uint8_t> trace = CreateTrace(0, 100);
+  ProtoTraceFramer framer;
+  FramedChunk chunk;
+  ASSERT_TRUE(
+      framer.Frame(Copy(trace.data(), trace.size()), trace.size(), &chunk)
+          .ok());
+
+  std::vector<uint64_t> timestamps;
+  AppendTimestamps(chunk, &timestamps);
+  ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 100)));
+}
+
+TEST(ProtoTraceFramerTest, PacketsSpanningChunks) {
+  std::vector<uint8_t> trace = CreateTrace(0, 100);
+  for (size_t chunk_size : {1u, 2u, 3u, 7u, 64u, 513u}) {
+    ProtoTraceFramer framer;
+    std::vector<uint64_t> timestamps;
+    for (size_t off = 0; off < trace.size(); off += chunk_size) {
+      size_t size = std::min(chunk_size, trace.size() - off);
+      FramedChunk chunk;
+      ASSERT_TRUE(framer.Frame(Copy(&trace[off], size), size, &chunk).ok());
+      AppendTimestamps(chunk, &timestamps);
+    }
+    ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 100))) << chunk_size;
+  }
+}
+
+TEST(ProtoTraceFramerTest, SharedBufferIsNotCopied) {
+  std::vector<uint8_t> trace = CreateTrace(0, 100);
+  std::shared_ptr<const uint8_t> mapping(
+      Copy(trace.data(), trace.size()).release(),
+      std::default_delete<const uint8_t[]>());
+  const size_t kChunkSize = 1000;
+  ProtoTraceFramer framer;
+  std::vector<uint64_t> timestamps;
+  size_t num_shared_buffers = 0;
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    std::shared_ptr<const uint8_t> chunk_buf(mapping, mapping.get() + off);
+    FramedChunk chunk;
+    ASSERT_TRUE(framer
+                    .Frame(TraceBlobView::FromSharedBuffer(
+                               std::move(chunk_buf), 0, size),
+                           &chunk)
+                    .ok());
+    AppendTimestamps(chunk, &timestamps);
+
+    // Only the packets spanning across two chunks are copied.
+    for (const TraceBlobView& buffer : chunk.buffers) {
+      const uint8_t* data = buffer.data();
+      if (data >= mapping.get() && data < mapping.get() + trace.size())
+        num_shared_buffers++;
+    }
+  }
+  ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 100)));
+  ASSERT_EQ(num_shared_buffers,
+            (trace.size() + kChunkSize - 1) / kChunkSize);
+}
+
+TEST(ProtoTraceFramerTest, InvalidPartialPacket) {
+  std::vector<uint8_t> trace = CreateTrace(0, 1);
+  ProtoTraceFramer framer;
+  FramedChunk chunk;
+  ASSERT_TRUE(framer.Frame(Copy(trace.data(), 1), 1, &chunk).ok());
+
+  // Break the varint of the packet size.
+  std::vector<uint8_t> garbage(8, 0xff);
+  ASSERT_FALSE(
+      framer.Frame(Copy(garbage.data(), garbage.size()), garbage.size(), &chunk)
+          .ok());
+}
+
+TEST(ProtoTraceFramerTest, FramerThreadPreservesOrder) {
+  std::vector<uint8_t> trace = CreateTrace(0, 1000);
+  ProtoTraceFramerThread framer_thread(/*inflate_compressed_packets=*/false);
+  std::vector<uint64_t> timestamps;
+  FramedChunk chunk;
+  util::Status status;
+  const size_t kChunkSize = 97;
+  for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+    size_t size = std::min(kChunkSize, trace.size() - off);
+    framer_thread.Push(TraceBlobView(Copy(&trace[off], size), 0, size));
+    while (framer_thread.Pop(/*block=*/false, &chunk, &status)) {
+      ASSERT_TRUE(status.ok());
+      AppendTimestamps(chunk, &timestamps);
+    }
+  }
+  framer_thread.PushEndOfFile();
+  while (framer_thread.Pop(/*block=*/true, &chunk, &status)) {
+    ASSERT_TRUE(status.ok());
+    AppendTimestamps(chunk, &timestamps);
+  }
+  ASSERT_EQ(framer_thread.chunks_in_flight(), 0u);
+  ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 1000)));
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+TEST(ProtoTraceFramerTest, InflateCompressedPackets) {
+  // The compressed packets contain the timestamps [10, 20).
+  std::vector<uint8_t> inner = CreateTrace(10, 10);
+  uLongf compressed_size = compressBound(static_cast<uLong>(inner.size()));
+  std::vector<uint8_t> compressed(compressed_size);
+  ASSERT_EQ(compress(compressed.data(), &compressed_size, inner.data(),
+                     static_cast<uLong>(inner.size())),
+            Z_OK);
+  compressed.resize(compressed_size);
+
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  for (uint32_t i = 0; i < 10; i++)
+    trace->add_packet()->set_timestamp(i);
+  trace->add_packet()->set_compressed_packets(compressed.data(),
+                                              compressed.size());
+  for (uint32_t i = 20; i < 30; i++)
+    trace->add_packet()->set_timestamp(i);
+  std::vector<uint8_t> buf = trace.SerializeAsArray();
+
+  ProtoTraceFramer framer(/*inflate_compressed_packets=*/true);
+  FramedChunk chunk;
+  ASSERT_TRUE(framer.Frame(Copy(buf.data(), buf.size()), buf.size(), &chunk)
+                  .ok());
+  std::vector<uint64_t> timestamps;
+  AppendTimestamps(chunk, &timestamps);
+  ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 30)));
+
+  // Without inflation, the compressed packet is passed through as-is.
+  ProtoTraceFramer passthrough_framer;
+  chunk = FramedChunk();
+  ASSERT_TRUE(passthrough_framer
+                  .Frame(Copy(buf.data(), buf.size()), buf.size(), &chunk)
+                  .ok());
+  ASSERT_EQ(chunk.packets.size(), 21u);
+}
+
+TEST(ProtoTraceFramerTest, InflateCompressedPacketsInParallel) {
+  // Every other group of 10 packets is compressed.
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  for (uint32_t group = 0; group < 20; group++) {
+    if (group % 2 == 0) {
+      for (uint32_t i = 0; i < 10; i++)
+        trace->add_packet()->set_timestamp(group * 10 + i);
+      continue;
+    }
+    std::vector<uint8_t> inner = CreateTrace(group * 10, 10);
+    uLongf compressed_size = compressBound(static_cast<uLong>(inner.size()));
+    std::vector<uint8_t> compressed(compressed_size);
+    ASSERT_EQ(compress(compressed.data(), &compressed_size, inner.data(),
+                       static_cast<uLong>(inner.size())),
+              Z_OK);
+    trace->add_packet()->set_compressed_packets(compressed.data(),
+                                                compressed_size);
+  }
+  std::vector<uint8_t> buf = trace.SerializeAsArray();
+
+  base::ThreadPool pool(2);
+  ProtoTraceFramer framer(/*inflate_compressed_packets=*/true, &pool);
+  FramedChunk chunk;
+  ASSERT_TRUE(framer.Frame(Copy(buf.data(), buf.size()), buf.size(), &chunk)
+                  .ok());
+  std::vector<uint64_t> timestamps;
+  AppendTimestamps(chunk, &timestamps);
+  ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 200)));
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+TEST(ProtoTraceFramerTest, InflateLz4CompressedPackets) {
+  // Every other group of 10 packets is compressed, like Lz4PacketWriter does.
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  base::Lz4Compressor compressor;
+  for (uint32_t group = 0; group < 20; group++) {
+    if (group % 2 == 0) {
+      for (uint32_t i = 0; i < 10; i++)
+        trace->add_packet()->set_timestamp(group * 10 + i);
+      continue;
+    }
+    std::vector<uint8_t> inner = CreateTrace(group * 10, 10);
+    std::vector<uint8_t> field(
+        protozero::proto_utils::kMaxSimpleFieldEncodedSize +
+        base::Lz4CompressBound(inner.size()));
+    uint8_t* ptr = protozero::proto_utils::WriteVarInt(inner.size(), &field[0]);
+    ptr += compressor.Compress(inner.data(), inner.size(), ptr);
+    trace->add_packet()->set_lz4_compressed_packets(
+        field.data(), static_cast<size_t>(ptr - &field[0]));
+  }
+  // A corrupt block is passed through as-is.
+  trace->add_packet()->set_lz4_compressed_packets("\x10garbage");
+  std::vector<uint8_t> buf = trace.SerializeAsArray();
+
+  base::ThreadPool pool(1);
+  for (bool parallel : {false, true}) {
+    ProtoTraceFramer framer(/*inflate_compressed_packets=*/true,
+                            parallel ? &pool : nullptr);
+    FramedChunk chunk;
+    ASSERT_TRUE(framer.Frame(Copy(buf.data(), buf.size()), buf.size(), &chunk)
+                    .ok());
+    ASSERT_EQ(chunk.packets.size(), 201u);
+    chunk.packets.pop_back();
+    std::vector<uint64_t> timestamps;
+    AppendTimestamps(chunk, &timestamps);
+    ASSERT_THAT(timestamps, ElementsAreArray(Iota(0, 200)));
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -89,7 +89,7 @@ void ProtoTraceParser::ParseTracePacket(int64_t ts, TimestampedTracePiece ttp) {
     data = &ttp.packet_data;
   } else {
     PERFETTO_DCHECK(ttp.type == TimestampedTracePiece::Type::kTrackEvent);
-    data = ttp.track_event_data.get();
+    data = ttp.track_event_data;
   }
 
   const TraceBlobView& blob = data->packet;
@@ -179,6 +179,16 @@ void ProtoTraceParser::ParseFtracePacket(uint32_t cpu,
   context_->args_tracker->Flush();
 }
 
+void ProtoTraceParser::ParseDecodedFtracePacket(
+    uint32_t cpu,
+    int64_t /*ts*/,
+    TimestampedTracePiece ttp,
+    const DecodedFtraceEvent& decoded) {
+  PERFETTO_DCHECK(context_->ftrace_module);
+  context_->ftrace_module->ParseDecodedFtracePacket(cpu, ttp, decoded);
+  context_->args_tracker->Flush();
+}
+
 void ProtoTraceParser::ParseTraceStats(ConstBytes blob) {
   protos::pbzero::TraceStats::Decoder evt(blob.data, blob.size);
   auto* storage = context_->storage.get();
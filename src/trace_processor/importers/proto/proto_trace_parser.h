@@ -55,6 +55,10 @@ class ProtoTraceParser : public TraceParser {
   void ParseFtracePacket(uint32_t cpu,
                          int64_t timestamp,
                          TimestampedTracePiece) override;
+  void ParseDecodedFtracePacket(uint32_t cpu,
+                                int64_t timestamp,
+                                TimestampedTracePiece,
+                                const DecodedFtraceEvent&) override;
 
   void ParseTracePacketImpl(int64_t ts,
                             TimestampedTracePiece,
@@ -22,6 +22,7 @@
 #include "perfetto/base/logging.h"
 #include "perfetto/ext/base/optional.h"
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/thread_pool.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/protozero/proto_decoder.h"
 #include "perfetto/protozero/proto_utils.h"
@@ -36,6 +37,7 @@
 #include "src/trace_processor/storage/stats.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/trace_sorter.h"
+#include "src/trace_processor/util/status_macros.h"
 
 #include "protos/perfetto/common/builtin_clock.pbzero.h"
 #include "protos/perfetto/config/trace_config.pbzero.h"
@@ -55,129 +57,68 @@ namespace {
 constexpr uint8_t kTracePacketTag =
     MakeTagLengthDelimited(protos::pbzero::Trace::kPacketFieldNumber);
 
-TraceBlobView Decompress(GzipDecompressor* decompressor, TraceBlobView input) {
-  PERFETTO_DCHECK(gzip::IsGzipSupported());
-
-  uint8_t out[4096];
-
-  std::vector<uint8_t> data;
-  data.reserve(input.length());
-
-  // Ensure that the decompressor is able to cope with a new stream of data.
-  decompressor->Reset();
-  decompressor->SetInput(input.data(), input.length());
-
-  using ResultCode = GzipDecompressor::ResultCode;
-  for (auto ret = ResultCode::kOk; ret != ResultCode::kEof;) {
-    auto res = decompressor->Decompress(out, base::ArraySize(out));
-    ret = res.ret;
-    if (ret == ResultCode::kError || ret == ResultCode::kNoProgress ||
-        ret == ResultCode::kNeedsMoreInput)
-      return TraceBlobView(nullptr, 0, 0);
+}  // namespace
 
-    data.insert(data.end(), out, out + res.bytes_written);
+ProtoTraceTokenizer::ProtoTraceTokenizer(TraceProcessorContext* ctx)
+    : context_(ctx) {
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM)
+  if (ctx->config.pipelined_ingestion) {
+    framer_thread_.reset(
+        new ProtoTraceFramerThread(/*inflate_compressed_packets=*/true,
+                                   base::ThreadPool::DefaultNumThreads()));
+    return;
   }
-
-  std::unique_ptr<uint8_t[]> output(new uint8_t[data.size()]);
-  memcpy(output.get(), data.data(), data.size());
-  return TraceBlobView(std::move(output), 0, data.size());
+#endif
+  framer_.reset(new ProtoTraceFramer());
 }
 
-}  // namespace
-
-ProtoTraceTokenizer::ProtoTraceTokenizer(TraceProcessorContext* ctx)
-    : context_(ctx) {}
 ProtoTraceTokenizer::~ProtoTraceTokenizer() = default;
 
 util::Status ProtoTraceTokenizer::Parse(std::unique_ptr<uint8_t[]> owned_buf,
                                         size_t size) {
-  uint8_t* data = &owned_buf[0];
-  if (!partial_buf_.empty()) {
-    // It takes ~5 bytes for a proto preamble + the varint size.
-    const size_t kHeaderBytes = 5;
-    if (PERFETTO_UNLIKELY(partial_buf_.size() < kHeaderBytes)) {
-      size_t missing_len = std::min(kHeaderBytes - partial_buf_.size(), size);
-      partial_buf_.insert(partial_buf_.end(), &data[0], &data[missing_len]);
-      if (partial_buf_.size() < kHeaderBytes)
-        return util::OkStatus();
-      data += missing_len;
-      size -= missing_len;
-    }
+  return ParseBlob(TraceBlobView(std::move(owned_buf), 0, size));
+}
 
-    // At this point we have enough data in |partial_buf_| to read at least the
-    // field header and know the size of the next TracePacket.
-    const uint8_t* pos = &partial_buf_[0];
-    uint8_t proto_field_tag = *pos;
-    uint64_t field_size = 0;
-    const uint8_t* next = ParseVarInt(++pos, &*partial_buf_.end(), &field_size);
-    bool parse_failed = next == pos;
-    pos = next;
-    if (proto_field_tag != kTracePacketTag || field_size == 0 || parse_failed) {
-      return util::ErrStatus(
-          "Failed parsing a TracePacket from the partial buffer");
-    }
+util::Status ProtoTraceTokenizer::ParseBlob(TraceBlobView blob) {
+  if (!framer_thread_) {
+    framed_chunk_.buffers.clear();
+    framed_chunk_.packets.clear();
+    util::Status frame_status = framer_->Frame(std::move(blob), &framed_chunk_);
+    RETURN_IF_ERROR(ParseFramedChunk(&framed_chunk_));
+    return frame_status;
+  }
 
-    // At this point we know how big the TracePacket is.
-    size_t hdr_size = static_cast<size_t>(pos - &partial_buf_[0]);
-    size_t size_incl_header = static_cast<size_t>(field_size + hdr_size);
-    PERFETTO_DCHECK(size_incl_header > partial_buf_.size());
-
-    // There is a good chance that between the |partial_buf_| and the new |data|
-    // of the current call we have enough bytes to parse a TracePacket.
-    if (partial_buf_.size() + size >= size_incl_header) {
-      // Create a new buffer for the whole TracePacket and copy into that:
-      // 1) The beginning of the TracePacket (including the proto header) from
-      //    the partial buffer.
-      // 2) The rest of the TracePacket from the current |data| buffer (note
-      //    that we might have consumed already a few bytes form |data| earlier
-      //    in this function, hence we need to keep |off| into account).
-      std::unique_ptr<uint8_t[]> buf(new uint8_t[size_incl_header]);
-      memcpy(&buf[0], partial_buf_.data(), partial_buf_.size());
-      // |size_missing| is the number of bytes for the rest of the TracePacket
-      // in |data|.
-      size_t size_missing = size_incl_header - partial_buf_.size();
-      memcpy(&buf[partial_buf_.size()], &data[0], size_missing);
-      data += size_missing;
-      size -= size_missing;
-      partial_buf_.clear();
-      uint8_t* buf_start = &buf[0];  // Note that buf is std::moved below.
-      util::Status status =
-          ParseInternal(std::move(buf), buf_start, size_incl_header);
-      if (PERFETTO_UNLIKELY(!status.ok()))
-        return status;
-    } else {
-      partial_buf_.insert(partial_buf_.end(), data, &data[size]);
-      return util::OkStatus();
-    }
+  // Bound the memory used by the pipeline: tokenize the chunks which have
+  // already been framed before queueing more.
+  while (framer_thread_->chunks_in_flight() >= kMaxChunksInFlight) {
+    bool popped = false;
+    RETURN_IF_ERROR(ParseNextFramedChunk(/*block=*/true, &popped));
   }
-  return ParseInternal(std::move(owned_buf), data, size);
+  framer_thread_->Push(std::move(blob));
+
+  // Opportunistically tokenize whatever the framing thread has done so far.
+  for (bool popped = true; popped;)
+    RETURN_IF_ERROR(ParseNextFramedChunk(/*block=*/false, &popped));
+  return util::OkStatus();
 }
 
-util::Status ProtoTraceTokenizer::ParseInternal(
-    std::unique_ptr<uint8_t[]> owned_buf,
-    uint8_t* data,
-    size_t size) {
-  PERFETTO_DCHECK(data >= &owned_buf[0]);
-  const uint8_t* start = &owned_buf[0];
-  const size_t data_off = static_cast<size_t>(data - start);
-  TraceBlobView whole_buf(std::move(owned_buf), data_off, size);
-
-  protos::pbzero::Trace::Decoder decoder(data, size);
-  for (auto it = decoder.packet(); it; ++it) {
-    protozero::ConstBytes packet = *it;
-    size_t field_offset = whole_buf.offset_of(packet.data);
-    util::Status status =
-        ParsePacket(whole_buf.slice(field_offset, packet.size));
-    if (PERFETTO_UNLIKELY(!status.ok()))
-      return status;
-  }
+util::Status ProtoTraceTokenizer::ParseNextFramedChunk(bool block,
+                                                       bool* popped) {
+  util::Status frame_status;
+  *popped = framer_thread_->Pop(block, &framed_chunk_, &frame_status);
+  if (!*popped)
+    return util::OkStatus();
+  RETURN_IF_ERROR(ParseFramedChunk(&framed_chunk_));
+  return frame_status;
+}
 
-  const size_t bytes_left = decoder.bytes_left();
-  if (bytes_left > 0) {
-    PERFETTO_DCHECK(partial_buf_.empty());
-    partial_buf_.insert(partial_buf_.end(), &data[decoder.read_offset()],
-                        &data[decoder.read_offset() + bytes_left]);
+util::Status ProtoTraceTokenizer::ParseFramedChunk(FramedChunk* chunk) {
+  for (const FramedChunk::Packet& packet : chunk->packets) {
+    const TraceBlobView& buffer = chunk->buffers[packet.buffer_idx];
+    RETURN_IF_ERROR(ParsePacket(buffer.slice(packet.offset, packet.size)));
   }
+  chunk->buffers.clear();
+  chunk->packets.clear();
   return util::OkStatus();
 }
 
@@ -308,15 +249,20 @@ util::Status ProtoTraceTokenizer::ParsePacket(TraceBlobView packet) {
     }
   }
 
-  if (decoder.has_compressed_packets()) {
-    if (!gzip::IsGzipSupported())
-      return util::Status("Cannot decode compressed packets. Zlib not enabled");
-
-    protozero::ConstBytes field = decoder.compressed_packets();
-    const size_t field_off = packet.offset_of(field.data);
-    TraceBlobView compressed_packets = packet.slice(field_off, field.size);
-    TraceBlobView packets =
-        Decompress(&decompressor_, std::move(compressed_packets));
+  if (decoder.has_compressed_packets() ||
+      decoder.has_lz4_compressed_packets()) {
+    TraceBlobView packets(nullptr, 0, 0);
+    if (decoder.has_lz4_compressed_packets()) {
+      protozero::ConstBytes field = decoder.lz4_compressed_packets();
+      packets = DecompressLz4TracePackets(field.data, field.size);
+    } else {
+      if (!gzip::IsGzipSupported()) {
+        return util::Status(
+            "Cannot decode compressed packets. Zlib not enabled");
+      }
+      protozero::ConstBytes field = decoder.compressed_packets();
+      packets = DecompressTracePackets(&decompressor_, field.data, field.size);
+    }
 
     const uint8_t* start = packets.data();
     const uint8_t* end = packets.data() + packets.length();
@@ -476,7 +422,37 @@ util::Status ProtoTraceTokenizer::ParseClockSnapshot(ConstBytes blob,
   return util::OkStatus();
 }
 
-void ProtoTraceTokenizer::NotifyEndOfFile() {}
+util::Status ProtoTraceTokenizer::Flush() {
+  if (!framer_thread_)
+    return util::OkStatus();
+
+  // Wait for the framing thread to catch up. The bytes of a packet which is
+  // not complete yet stay in the framer until the rest of it is pushed.
+  while (framer_thread_->chunks_in_flight() > 0) {
+    bool popped = false;
+    RETURN_IF_ERROR(ParseNextFramedChunk(/*block=*/true, &popped));
+  }
+  return util::OkStatus();
+}
+
+void ProtoTraceTokenizer::NotifyEndOfFile() {
+  if (!framer_thread_)
+    return;
+
+  // Drain the pipeline. Errors can't be propagated to the caller at this point
+  // so the best we can do is to stop parsing and log them.
+  framer_thread_->PushEndOfFile();
+  for (bool popped = true; popped;) {
+    util::Status status = ParseNextFramedChunk(/*block=*/true, &popped);
+    if (!status.ok()) {
+      PERFETTO_ELOG("Failed parsing the end of the trace: %s",
+                    status.c_message());
+      context_->storage->IncrementStats(stats::pipelined_tokenizer_errors);
+      break;
+    }
+  }
+  framer_thread_.reset();
+}
 
 }  // namespace trace_processor
 }  // namespace perfetto
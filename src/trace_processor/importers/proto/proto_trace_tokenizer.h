@@ -25,6 +25,7 @@
 #include "src/trace_processor/chunked_trace_reader.h"
 #include "src/trace_processor/importers/gzip/gzip_utils.h"
 #include "src/trace_processor/importers/proto/proto_incremental_state.h"
+#include "src/trace_processor/importers/proto/proto_trace_framer.h"
 #include "src/trace_processor/trace_blob_view.h"
 
 namespace protozero {
@@ -57,13 +58,20 @@ class ProtoTraceTokenizer : public ChunkedTraceReader {
 
   // ChunkedTraceReader implementation.
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t size) override;
+  util::Status ParseBlob(TraceBlobView) override;
+  util::Status Flush() override;
   void NotifyEndOfFile() override;
 
  private:
   using ConstBytes = protozero::ConstBytes;
-  util::Status ParseInternal(std::unique_ptr<uint8_t[]> owned_buf,
-                             uint8_t* data,
-                             size_t size);
+  using FramedChunk = ProtoTraceFramer::FramedChunk;
+
+  // Max number of chunks which can be queued into |framer_thread_|, before
+  // Parse() blocks waiting for the framing thread to catch up.
+  static constexpr size_t kMaxChunksInFlight = 8;
+
+  util::Status ParseFramedChunk(FramedChunk*);
+  util::Status ParseNextFramedChunk(bool block, bool* popped);
   util::Status ParsePacket(TraceBlobView);
   util::Status ParseClockSnapshot(ConstBytes blob, uint32_t seq_id);
   void HandleIncrementalStateCleared(
@@ -82,9 +90,13 @@ class ProtoTraceTokenizer : public ChunkedTraceReader {
 
   TraceProcessorContext* context_;
 
-  // Used to glue together trace packets that span across two (or more)
-  // Parse() boundaries.
-  std::vector<uint8_t> partial_buf_;
+  // Splits the input chunks into TracePackets. Only one of the two is set,
+  // depending on whether Config::pipelined_ingestion is enabled.
+  std::unique_ptr<ProtoTraceFramer> framer_;
+  std::unique_ptr<ProtoTraceFramerThread> framer_thread_;
+
+  // Reused across Parse() calls to avoid reallocations.
+  FramedChunk framed_chunk_;
 
   // Temporary. Currently trace packets do not have a timestamp, so the
   // timestamp given is latest_timestamp_.
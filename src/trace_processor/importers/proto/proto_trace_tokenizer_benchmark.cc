@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark for the import of proto traces, end to end, through the
+// TraceProcessor API. The trace is a synthetic ftrace-heavy trace, optionally
+// wrapped into compressed_packets like perfetto_cmd does with
+// compress_long_traces. Each variant is run with and without
+// Config::pipelined_ingestion and Config::parallel_ftrace_decoding.
+// BM_ProtoTraceReadFile compares loading the same trace from a file with
+// ReadTrace() and ReadTraceMapped().
+
+#include <string.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/ext/base/utils.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/read_trace.h"
+#include "perfetto/trace_processor/trace_processor.h"
+
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+using perfetto::trace_processor::Config;
+using perfetto::trace_processor::ReadTrace;
+using perfetto::trace_processor::ReadTraceMapped;
+using perfetto::trace_processor::TraceProcessor;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+constexpr uint32_t kNumCpus = 8;
+constexpr uint32_t kEventsPerBundle = 64;
+constexpr size_t kChunkSize = 1024 * 1024;
+
+// Returns a serialized Trace containing |num_bundles| ftrace bundles of
+// sched_switch events, round-robin across |kNumCpus| CPUs.
+std::vector<uint8_t> CreateFtraceTrace(uint32_t num_bundles) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  protozero::HeapBuffered<perfetto::protos::pbzero::Trace> trace;
+  uint64_t ts = 1000;
+  for (uint32_t i = 0; i < num_bundles; i++) {
+    auto* packet = trace->add_packet();
+    packet->set_trusted_packet_sequence_id(1);
+    auto* bundle = packet->set_ftrace_events();
+    bundle->set_cpu(i % kNumCpus);
+    for (uint32_t j = 0; j < kEventsPerBundle; j++) {
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts += rnd_engine() % 1000);
+      event->set_pid(rnd_engine() % 1000);
+      auto* sched_switch = event->set_sched_switch();
+      sched_switch->set_prev_comm("thread_" + std::to_string(j));
+      sched_switch->set_prev_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_prev_prio(120);
+      sched_switch->set_prev_state(1);
+      sched_switch->set_next_comm("thread_" + std::to_string(j + 1));
+      sched_switch->set_next_pid(static_cast<int32_t>(rnd_engine() % 1000));
+      sched_switch->set_next_prio(120);
+    }
+  }
+  return trace.SerializeAsArray();
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+// Wraps every |packets_per_group| packets of |trace| into a TracePacket with
+// a compressed_packets field.
+std::vector<uint8_t> CompressTrace(const std::vector<uint8_t>& trace,
+                                   uint32_t packets_per_group) {
+  protozero::HeapBuffered<perfetto::protos::pbzero::Trace> out;
+  perfetto::protos::pbzero::Trace::Decoder decoder(trace.data(), trace.size());
+  std::vector<uint8_t> group;
+  auto flush_group = [&out, &group]() {
+    uLongf compressed_size = compressBound(static_cast<uLong>(group.size()));
+    std::vector<uint8_t> compressed(compressed_size);
+    PERFETTO_CHECK(compress(compressed.data(), &compressed_size, group.data(),
+                            static_cast<uLong>(group.size())) == Z_OK);
+    out->add_packet()->set_compressed_packets(compressed.data(),
+                                              compressed_size);
+    group.clear();
+  };
+  uint32_t num_packets = 0;
+  for (auto it = decoder.packet(); it; ++it) {
+    protozero::ConstBytes packet = *it;
+    protozero::HeapBuffered<perfetto::protos::pbzero::Trace> wrapper;
+    wrapper->AppendBytes(perfetto::protos::pbzero::Trace::kPacketFieldNumber,
+                         packet.data, packet.size);
+    std::vector<uint8_t> serialized = wrapper.SerializeAsArray();
+    group.insert(group.end(), serialized.begin(), serialized.end());
+    if (++num_packets % packets_per_group == 0)
+      flush_group();
+  }
+  if (!group.empty())
+    flush_group();
+  return out.SerializeAsArray();
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+void ImportArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"pipelined", "compressed", "parallel_ftrace"});
+  b->Args({0, 0, 0});
+  b->Args({1, 0, 0});
+  b->Args({0, 0, 1});
+  b->Args({1, 0, 1});
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  b->Args({0, 1, 0});
+  b->Args({1, 1, 0});
+  b->Args({1, 1, 1});
+#endif
+}
+
+static void BM_ProtoTraceImport(benchmark::State& state) {
+  const bool pipelined = state.range(0) != 0;
+  const bool compressed = state.range(1) != 0;
+  const bool parallel_ftrace = state.range(2) != 0;
+
+  uint32_t num_bundles = IsBenchmarkFunctionalOnly() ? 64 : 16 * 1024;
+  std::vector<uint8_t> trace = CreateFtraceTrace(num_bundles);
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+  if (compressed)
+    trace = CompressTrace(trace, /*packets_per_group=*/32);
+#else
+  PERFETTO_CHECK(!compressed);
+#endif
+
+  for (auto _ : state) {
+    Config config;
+    config.pipelined_ingestion = pipelined;
+    config.parallel_ftrace_decoding = parallel_ftrace;
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    for (size_t off = 0; off < trace.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), &trace[off], size);
+      PERFETTO_CHECK(tp->Parse(std::move(buf), size).ok());
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+}
+BENCHMARK(BM_ProtoTraceImport)->Apply(ImportArgs)->Unit(benchmark::kMillisecond);
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID)
+// Returns the anonymous (i.e. not file-backed) resident memory of the process,
+// which is where the trace data retained by ReadTrace() lives.
+double GetAnonRssMb() {
+  std::string status;
+  if (!perfetto::base::ReadFile("/proc/self/status", &status))
+    return 0;
+  size_t pos = status.find("RssAnon:");
+  if (pos == std::string::npos)
+    return 0;
+  return static_cast<double>(
+             strtoull(status.c_str() + pos + strlen("RssAnon:"), nullptr, 10)) /
+         1024;
+}
+#else
+double GetAnonRssMb() {
+  return 0;
+}
+#endif
+
+static void BM_ProtoTraceReadFile(benchmark::State& state) {
+  const bool mmap = state.range(0) != 0;
+
+  uint32_t num_bundles = IsBenchmarkFunctionalOnly() ? 64 : 16 * 1024;
+  std::vector<uint8_t> trace = CreateFtraceTrace(num_bundles);
+  perfetto::base::TempFile file = perfetto::base::TempFile::Create();
+  PERFETTO_CHECK(perfetto::base::WriteAll(file.fd(), trace.data(),
+                                          trace.size()) ==
+                 static_cast<ssize_t>(trace.size()));
+
+  // Growth of the anonymous memory during the import, i.e. mostly the trace
+  // data retained on the heap.
+  double anon_rss_mb = 0;
+  for (auto _ : state) {
+    double anon_rss_before_mb = GetAnonRssMb();
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance({});
+    perfetto::trace_processor::util::Status status =
+        mmap ? ReadTraceMapped(tp.get(), file.path().c_str())
+             : ReadTrace(tp.get(), file.path().c_str());
+    PERFETTO_CHECK(status.ok());
+    anon_rss_mb = GetAnonRssMb() - anon_rss_before_mb;
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(trace.size()));
+  state.counters["anon_rss_mb"] = anon_rss_mb;
+}
+BENCHMARK(BM_ProtoTraceReadFile)
+    ->ArgName("mmap")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
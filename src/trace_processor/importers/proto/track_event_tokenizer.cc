@@ -206,8 +206,7 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
       state->current_generation()->GetTrackEventDefaults();
 
   int64_t timestamp;
-  std::unique_ptr<TrackEventData> data(
-      new TrackEventData(std::move(*packet_blob), state->current_generation()));
+  TrackEventData data(std::move(*packet_blob), state->current_generation());
 
   // TODO(eseckler): Remove handling of timestamps relative to ThreadDescriptors
   // once all producers have switched to clock-domain timestamps (e.g.
@@ -254,11 +253,11 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
       context_->storage->IncrementStats(stats::tokenizer_skipped_packets);
       return;
     }
-    data->thread_timestamp = state->IncrementAndGetTrackEventThreadTimeNs(
+    data.thread_timestamp = state->IncrementAndGetTrackEventThreadTimeNs(
         event.thread_time_delta_us() * 1000);
   } else if (event.has_thread_time_absolute_us()) {
     // One-off absolute timestamps don't affect delta computation.
-    data->thread_timestamp = event.thread_time_absolute_us() * 1000;
+    data.thread_timestamp = event.thread_time_absolute_us() * 1000;
   }
 
   if (event.has_thread_instruction_count_delta()) {
@@ -268,12 +267,12 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
       context_->storage->IncrementStats(stats::tokenizer_skipped_packets);
       return;
     }
-    data->thread_instruction_count =
+    data.thread_instruction_count =
         state->IncrementAndGetTrackEventThreadInstructionCount(
             event.thread_instruction_count_delta());
   } else if (event.has_thread_instruction_count_absolute()) {
     // One-off absolute timestamps don't affect delta computation.
-    data->thread_instruction_count = event.thread_instruction_count_absolute();
+    data.thread_instruction_count = event.thread_instruction_count_absolute();
   }
 
   // TODO(eseckler): Also convert & attach counter values from TYPE_COUNTER
@@ -313,7 +312,7 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
       return;
     }
 
-    data->counter_value = *value;
+    data.counter_value = *value;
   }
 
   if (event.has_extra_counter_values()) {
@@ -357,7 +356,7 @@ void TrackEventTokenizer::TokenizeTrackEventPacket(
         context_->storage->IncrementStats(stats::track_event_tokenizer_errors);
         return;
       }
-      data->extra_counter_values[index] = *value;
+      data.extra_counter_values[index] = *value;
     }
   }
 
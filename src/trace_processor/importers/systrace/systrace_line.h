@@ -18,21 +18,35 @@
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_H_
 
 #include <inttypes.h>
+
 #include <string>
 
+#include "perfetto/ext/base/string_view.h"
+
 namespace perfetto {
 namespace trace_processor {
 
+// A tokenized systrace line. The string fields point into the text of the
+// line: when the line is parsed while its text is still around (e.g. by
+// SystraceTraceParser), no copy of it is made at all. When the line outlives
+// its text (e.g. when it's pushed to the TraceSorter), the text is moved into
+// |owned_text| before tokenizing it, which is why the struct is not copyable
+// or movable.
 struct SystraceLine {
-  int64_t ts;
-  uint32_t pid;
-  uint32_t cpu;
-
-  std::string task;
-  std::string pid_str;
-  std::string tgid_str;
-  std::string event_name;
-  std::string args_str;
+  SystraceLine() = default;
+  SystraceLine(const SystraceLine&) = delete;
+  SystraceLine& operator=(const SystraceLine&) = delete;
+
+  int64_t ts = 0;
+  uint32_t pid = 0;
+  uint32_t cpu = 0;
+
+  base::StringView task;
+  base::StringView tgid_str;
+  base::StringView event_name;
+  base::StringView args_str;
+
+  std::string owned_text;
 };
 
 }  // namespace trace_processor
@@ -16,7 +16,6 @@
 
 #include "src/trace_processor/importers/systrace/systrace_line_parser.h"
 
-#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
 #include "src/trace_processor/importers/common/event_tracker.h"
@@ -29,9 +28,9 @@
 #include "src/trace_processor/types/task_state.h"
 
 #include <inttypes.h>
-#include <cctype>
+#include <string.h>
+
 #include <string>
-#include <unordered_map>
 
 namespace perfetto {
 namespace trace_processor {
@@ -44,39 +43,60 @@ SystraceLineParser::SystraceLineParser(TraceProcessorContext* ctx)
 util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   context_->process_tracker->GetOrCreateThread(line.pid);
   context_->process_tracker->UpdateThreadName(
-      line.pid, context_->storage->InternString(base::StringView(line.task)));
+      line.pid, context_->storage->InternString(line.task));
 
   if (!line.tgid_str.empty() && line.tgid_str != "-----") {
-    base::Optional<uint32_t> tgid = base::StringToUInt32(line.tgid_str);
+    base::Optional<uint32_t> tgid =
+        base::StringToUInt32(line.tgid_str.ToStdString());
     if (tgid) {
       context_->process_tracker->UpdateThread(line.pid, tgid.value());
     }
   }
 
-  std::unordered_map<std::string, std::string> args;
-  for (base::StringSplitter ss(line.args_str, ' '); ss.Next();) {
-    std::string key;
-    std::string value;
-    for (base::StringSplitter inner(ss.cur_token(), '='); inner.Next();) {
-      if (key.empty()) {
-        key = inner.cur_token();
-      } else {
-        value = inner.cur_token();
-      }
+  // The args are split in place: there are only a handful of them per line,
+  // so looking them up linearly is cheaper than building a map.
+  args_.clear();
+  const char* const args_end = line.args_str.end();
+  for (const char* ptr = line.args_str.begin(); ptr < args_end;) {
+    if (*ptr == ' ') {
+      ptr++;
+      continue;
+    }
+    const char* token_end = static_cast<const char*>(
+        memchr(ptr, ' ', static_cast<size_t>(args_end - ptr)));
+    if (!token_end)
+      token_end = args_end;
+    base::StringView token(ptr, static_cast<size_t>(token_end - ptr));
+    size_t eq = token.find('=');
+    if (eq == base::StringView::npos) {
+      args_.emplace_back(token, base::StringView());
+    } else {
+      args_.emplace_back(token.substr(0, eq), token.substr(eq + 1));
     }
-    args.emplace(std::move(key), std::move(value));
+    ptr = token_end;
   }
+  auto arg = [this](base::StringView key) {
+    for (const auto& key_and_value : args_) {
+      if (key_and_value.first == key)
+        return key_and_value.second;
+    }
+    return base::StringView();
+  };
+  auto arg_str = [&arg](base::StringView key) {
+    return arg(key).ToStdString();
+  };
+
   if (line.event_name == "sched_switch") {
-    auto prev_state_str = args["prev_state"];
+    auto prev_state_str = arg_str("prev_state");
     int64_t prev_state =
         ftrace_utils::TaskState(prev_state_str.c_str()).raw_state();
 
-    auto prev_pid = base::StringToUInt32(args["prev_pid"]);
-    auto prev_comm = base::StringView(args["prev_comm"]);
-    auto prev_prio = base::StringToInt32(args["prev_prio"]);
-    auto next_pid = base::StringToUInt32(args["next_pid"]);
-    auto next_comm = base::StringView(args["next_comm"]);
-    auto next_prio = base::StringToInt32(args["next_prio"]);
+    auto prev_pid = base::StringToUInt32(arg_str("prev_pid"));
+    auto prev_comm = arg("prev_comm");
+    auto prev_prio = base::StringToInt32(arg_str("prev_prio"));
+    auto next_pid = base::StringToUInt32(arg_str("next_pid"));
+    auto next_comm = arg("next_comm");
+    auto next_prio = base::StringToInt32(arg_str("next_prio"));
 
     if (!(prev_pid.has_value() && prev_prio.has_value() &&
           next_pid.has_value() && next_prio.has_value())) {
@@ -89,22 +109,23 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   } else if (line.event_name == "tracing_mark_write" ||
              line.event_name == "0" || line.event_name == "print") {
     SystraceParser::GetOrCreate(context_)->ParsePrintEvent(
-        line.ts, line.pid, line.args_str.c_str());
+        line.ts, line.pid, line.args_str);
   } else if (line.event_name == "sched_wakeup") {
-    auto comm = args["comm"];
-    base::Optional<uint32_t> wakee_pid = base::StringToUInt32(args["pid"]);
+    auto comm = arg("comm");
+    base::Optional<uint32_t> wakee_pid = base::StringToUInt32(arg_str("pid"));
     if (!wakee_pid.has_value()) {
       return util::Status("Could not convert wakee_pid");
     }
 
-    StringId name_id = context_->storage->InternString(base::StringView(comm));
+    StringId name_id = context_->storage->InternString(comm);
     auto wakee_utid =
         context_->process_tracker->UpdateThreadName(wakee_pid.value(), name_id);
     context_->event_tracker->PushInstant(line.ts, sched_wakeup_name_id_,
                                          wakee_utid, RefType::kRefUtid);
   } else if (line.event_name == "cpu_idle") {
-    base::Optional<uint32_t> event_cpu = base::StringToUInt32(args["cpu_id"]);
-    base::Optional<double> new_state = base::StringToDouble(args["state"]);
+    base::Optional<uint32_t> event_cpu =
+        base::StringToUInt32(arg_str("cpu_id"));
+    base::Optional<double> new_state = base::StringToDouble(arg_str("state"));
     if (!event_cpu.has_value()) {
       return util::Status("Could not convert event cpu");
     }
@@ -116,15 +137,15 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         cpuidle_name_id_, event_cpu.value());
     context_->event_tracker->PushCounter(line.ts, new_state.value(), track);
   } else if (line.event_name == "binder_transaction") {
-    auto id = base::StringToInt32(args["transaction"]);
-    auto dest_node = base::StringToInt32(args["dest_node"]);
-    auto dest_tgid = base::StringToInt32(args["dest_proc"]);
-    auto dest_tid = base::StringToInt32(args["dest_thread"]);
-    auto is_reply = base::StringToInt32(args["reply"]).value() == 1;
-    auto flags_str = args["flags"];
+    auto id = base::StringToInt32(arg_str("transaction"));
+    auto dest_node = base::StringToInt32(arg_str("dest_node"));
+    auto dest_tgid = base::StringToInt32(arg_str("dest_proc"));
+    auto dest_tid = base::StringToInt32(arg_str("dest_thread"));
+    auto is_reply = base::StringToInt32(arg_str("reply")).value() == 1;
+    auto flags_str = arg_str("flags");
     char* end;
     uint32_t flags = static_cast<uint32_t>(strtol(flags_str.c_str(), &end, 16));
-    std::string code_str = args["code"] + " Java Layer Dependent";
+    std::string code_str = arg_str("code") + " Java Layer Dependent";
     StringId code = context_->storage->InternString(base::StringView(code_str));
     if (!dest_tgid.has_value()) {
       return util::Status("Could not convert dest_tgid");
@@ -142,7 +163,7 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
         line.ts, line.pid, id.value(), dest_node.value(), dest_tgid.value(),
         dest_tid.value(), is_reply, flags, code);
   } else if (line.event_name == "binder_transaction_received") {
-    auto id = base::StringToInt32(args["transaction"]);
+    auto id = base::StringToInt32(arg_str("transaction"));
     if (!id.has_value()) {
       return util::Status("Could not convert transaction id");
     }
@@ -155,8 +176,8 @@ util::Status SystraceLineParser::ParseLine(const SystraceLine& line) {
   } else if (line.event_name == "binder_unlock") {
     BinderTracker::GetOrCreate(context_)->Unlock(line.ts, line.pid);
   } else if (line.event_name == "binder_transaction_alloc_buf") {
-    auto data_size = base::StringToUInt64(args["data_size"]);
-    auto offsets_size = base::StringToUInt64(args["offsets_size"]);
+    auto data_size = base::StringToUInt64(arg_str("data_size"));
+    auto offsets_size = base::StringToUInt64(arg_str("offsets_size"));
     if (!data_size.has_value()) {
       return util::Status("Could not convert data size");
     }
@@ -17,6 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_LINE_PARSER_H_
 
+#include <utility>
+#include <vector>
+
+#include "perfetto/ext/base/string_view.h"
 #include "perfetto/trace_processor/status.h"
 
 #include "src/trace_processor/importers/systrace/systrace_line.h"
@@ -36,6 +40,10 @@ class SystraceLineParser {
   TraceProcessorContext* const context_;
   const StringId sched_wakeup_name_id_ = kNullStringId;
   const StringId cpuidle_name_id_ = kNullStringId;
+
+  // The (key, value) args of the line being parsed. Kept across lines to
+  // reuse the allocation.
+  std::vector<std::pair<base::StringView, base::StringView>> args_;
 };
 
 }  // namespace trace_processor
@@ -16,37 +16,172 @@
 
 #include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
 
-#include "perfetto/ext/base/string_utils.h"
+#include <string.h>
+
+#include <limits>
 
-// On windows std::isspace if overloaded in <locale>. MSBUILD via bazel
-// attempts to use that version instead of the intended one defined in
-// <cctype>
-#include <cctype>
+#include "perfetto/ext/base/string_utils.h"
 
 namespace perfetto {
 namespace trace_processor {
 
 namespace {
-std::string SubstrTrim(const std::string& input) {
-  std::string s = input;
-  s.erase(s.begin(), std::find_if(s.begin(), s.end(),
-                                  [](char ch) { return !std::isspace(ch); }));
-  s.erase(std::find_if(s.rbegin(), s.rend(),
-                       [](char ch) { return !std::isspace(ch); })
-              .base(),
-          s.end());
-  return s;
+
+// The same characters as std::isspace() in the "C" locale (and as \s in the
+// regex this tokenizer used to be based on).
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
 }
-}  // namespace
 
-SystraceLineTokenizer::SystraceLineTokenizer()
-    : line_matcher_(std::regex(R"(-(\d+)\s+\(?\s*(\d+|-+)?\)?\s?\[(\d+)\]\s*)"
-                               R"([a-zA-Z0-9.]{0,5}\s+(\d+\.\d+):\s+(\S+):)")) {
+inline bool IsDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// The irq/preemption flags, e.g. "d..3" or "...1".
+inline bool IsFlag(char c) {
+  return IsDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         c == '.';
+}
+
+inline const char* SkipSpaces(const char* ptr, const char* end) {
+  while (ptr < end && IsSpace(*ptr))
+    ptr++;
+  return ptr;
+}
+
+inline const char* SkipDigits(const char* ptr, const char* end) {
+  while (ptr < end && IsDigit(*ptr))
+    ptr++;
+  return ptr;
+}
+
+base::StringView Trim(const char* begin, const char* end) {
+  while (begin < end && IsSpace(*begin))
+    begin++;
+  while (end > begin && IsSpace(end[-1]))
+    end--;
+  return base::StringView(begin, static_cast<size_t>(end - begin));
+}
+
+inline base::StringView MakeView(const char* begin, const char* end) {
+  return base::StringView(begin, static_cast<size_t>(end - begin));
+}
+
+base::Optional<uint32_t> ParseUInt32(base::StringView digits) {
+  uint64_t value = 0;
+  for (char c : digits) {
+    value = value * 10 + static_cast<uint64_t>(c - '0');
+    if (value > std::numeric_limits<uint32_t>::max())
+      return base::nullopt;
+  }
+  return static_cast<uint32_t>(value);
+}
+
+// The fields which follow the task name in a line.
+struct Fields {
+  const char* begin;
+  const char* end;
+  base::StringView pid;
+  base::StringView tgid;
+  base::StringView cpu;
+  base::StringView ts;
+  base::StringView event_name;
+};
+
+// Matches "<ts>: <event_name>:" at |ptr|.
+bool MatchTimestampAndEvent(const char* ptr, const char* end, Fields* fields) {
+  const char* ts = ptr;
+  ptr = SkipDigits(ptr, end);
+  if (ptr == ts || ptr == end || *ptr != '.')
+    return false;
+  const char* fraction = ++ptr;
+  ptr = SkipDigits(ptr, end);
+  if (ptr == fraction || ptr == end || *ptr != ':')
+    return false;
+  fields->ts = MakeView(ts, ptr);
+
+  const char* name = SkipSpaces(++ptr, end);
+  if (name == ptr)
+    return false;
+
+  // The event name is everything up to the last colon before the next space:
+  // e.g. "tracing_mark_write: B|1|foo" gives "tracing_mark_write".
+  const char* name_end = name;
+  const char* colon = nullptr;
+  for (; name_end < end && !IsSpace(*name_end); name_end++) {
+    if (*name_end == ':')
+      colon = name_end;
+  }
+  if (colon == nullptr || colon == name)
+    return false;
+  fields->event_name = MakeView(name, colon);
+  fields->end = colon + 1;
+  return true;
 }
 
+// Matches the fields following the task name, starting from the '-' at |ptr|:
+// "-<pid> (<tgid>) [<cpu>] <flags> <ts>: <event_name>:", where the tgid and
+// the flags are optional.
+bool MatchFields(const char* ptr, const char* end, Fields* fields) {
+  fields->begin = ptr++;
+
+  const char* pid = ptr;
+  ptr = SkipDigits(ptr, end);
+  if (ptr == pid)
+    return false;
+  fields->pid = MakeView(pid, ptr);
+
+  const char* after_pid = ptr;
+  ptr = SkipSpaces(ptr, end);
+  if (ptr == after_pid)
+    return false;
+
+  // The tgid is either a number or some dashes (when it's unknown).
+  if (ptr < end && *ptr == '(')
+    ptr = SkipSpaces(ptr + 1, end);
+  const char* tgid = ptr;
+  if (ptr < end && IsDigit(*ptr)) {
+    ptr = SkipDigits(ptr, end);
+  } else {
+    while (ptr < end && *ptr == '-')
+      ptr++;
+  }
+  fields->tgid = MakeView(tgid, ptr);
+  if (ptr < end && *ptr == ')')
+    ptr++;
+  if (ptr < end && IsSpace(*ptr))
+    ptr++;
+
+  if (ptr == end || *ptr != '[')
+    return false;
+  const char* cpu = ++ptr;
+  ptr = SkipDigits(ptr, end);
+  if (ptr == cpu || ptr == end || *ptr != ']')
+    return false;
+  fields->cpu = MakeView(cpu, ptr);
+
+  // The flags are at most 5 characters long and can be missing altogether,
+  // in which case the timestamp follows the cpu directly.
+  const char* after_cpu = ++ptr;
+  const char* flags = SkipSpaces(ptr, end);
+  const char* flags_end = flags;
+  while (flags_end < end && flags_end - flags < 5 && IsFlag(*flags_end))
+    flags_end++;
+  if (flags_end != flags && flags_end < end && IsSpace(*flags_end) &&
+      MatchTimestampAndEvent(SkipSpaces(flags_end, end), end, fields)) {
+    return true;
+  }
+  return flags != after_cpu && MatchTimestampAndEvent(flags, end, fields);
+}
+
+}  // namespace
+
+SystraceLineTokenizer::SystraceLineTokenizer() = default;
+
 // TODO(hjd): This should be more robust to being passed random input.
 // This can happen if we mess up detecting a gzip trace for example.
-util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
+util::Status SystraceLineTokenizer::Tokenize(base::StringView buffer,
                                              SystraceLine* line) {
   // An example line from buffer looks something like the following:
   // kworker/u16:1-77    (   77) [004] ....   316.196720: 0:
@@ -58,39 +193,48 @@ util::Status SystraceLineTokenizer::Tokenize(const std::string& buffer,
   // Also the irq fields can be missing (we don't parse these anyway)
   // <idle>-0     [000]  0.002188: task_newtask: pid=1 ...
   //
-  // The task name can contain any characters e.g -:[(/ and for this reason
-  // it is much easier to use a regex (even though it is slower than parsing
-  // manually)
-
-  std::smatch matches;
-  bool matched = std::regex_search(buffer, matches, line_matcher_);
-  if (!matched) {
-    return util::ErrStatus("Not a known systrace event format (line: %s)",
-                           buffer.c_str());
+  // The task name can contain any characters e.g -:[(/ so, rather than
+  // looking for the end of the task name, we try to match the rest of the
+  // fields at every '-' of the line, from left to right.
+  const char* const begin = buffer.data();
+  const char* const end = begin + buffer.size();
+  Fields fields;
+  for (const char* ptr = begin;; ptr++) {
+    ptr = static_cast<const char*>(
+        memchr(ptr, '-', static_cast<size_t>(end - ptr)));
+    if (!ptr) {
+      return util::ErrStatus("Not a known systrace event format (line: %.*s)",
+                             static_cast<int>(buffer.size()), begin);
+    }
+    if (MatchFields(ptr, end, &fields))
+      break;
   }
 
-  std::string pid_str = matches[1].str();
-  std::string cpu_str = matches[3].str();
-  std::string ts_str = matches[4].str();
+  line->task = Trim(begin, fields.begin);
+  line->tgid_str = fields.tgid;
+  line->event_name = fields.event_name;
+  line->args_str = Trim(fields.end, end);
 
-  line->task = SubstrTrim(matches.prefix());
-  line->tgid_str = matches[2].str();
-  line->event_name = matches[5].str();
-  line->args_str = SubstrTrim(matches.suffix());
-
-  base::Optional<uint32_t> maybe_pid = base::StringToUInt32(pid_str);
+  base::Optional<uint32_t> maybe_pid = ParseUInt32(fields.pid);
   if (!maybe_pid.has_value()) {
-    return util::Status("Could not convert pid " + pid_str);
+    return util::Status("Could not convert pid " + fields.pid.ToStdString());
   }
   line->pid = maybe_pid.value();
 
-  base::Optional<uint32_t> maybe_cpu = base::StringToUInt32(cpu_str);
+  base::Optional<uint32_t> maybe_cpu = ParseUInt32(fields.cpu);
   if (!maybe_cpu.has_value()) {
-    return util::Status("Could not convert cpu " + cpu_str);
+    return util::Status("Could not convert cpu " + fields.cpu.ToStdString());
   }
   line->cpu = maybe_cpu.value();
 
-  base::Optional<double> maybe_ts = base::StringToDouble(ts_str);
+  // strtod() needs a null terminated string.
+  char ts_str[32];
+  base::Optional<double> maybe_ts;
+  if (fields.ts.size() < sizeof(ts_str)) {
+    memcpy(ts_str, fields.ts.data(), fields.ts.size());
+    ts_str[fields.ts.size()] = '\0';
+    maybe_ts = base::CStringToDouble(ts_str);
+  }
   if (!maybe_ts.has_value()) {
     return util::Status("Could not convert ts");
   }
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+TEST(SystraceLineTokenizerTest, WithTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("   kworker/u16:1-77    (   77) [004] ....   "
+                            "316.196720: 0: B|77|__scm_call_armv8_64|0",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "kworker/u16:1");
+  EXPECT_EQ(line.pid, 77u);
+  EXPECT_EQ(line.tgid_str, "77");
+  EXPECT_EQ(line.cpu, 4u);
+  EXPECT_EQ(line.ts, 316196720000);
+  EXPECT_EQ(line.event_name, "0");
+  EXPECT_EQ(line.args_str, "B|77|__scm_call_armv8_64|0");
+}
+
+TEST(SystraceLineTokenizerTest, UnknownTgid) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("<idle>-0     (-----) [001] d..2 1.000000: "
+                            "sched_switch: prev_comm=swapper/1 prev_pid=0",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "<idle>");
+  EXPECT_EQ(line.pid, 0u);
+  EXPECT_EQ(line.tgid_str, "-----");
+  EXPECT_EQ(line.cpu, 1u);
+  EXPECT_EQ(line.ts, 1000000000);
+  EXPECT_EQ(line.event_name, "sched_switch");
+  EXPECT_EQ(line.args_str, "prev_comm=swapper/1 prev_pid=0");
+}
+
+TEST(SystraceLineTokenizerTest, MissingTgidAndFlags) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("<idle>-0     [000] ...2     0.002188: "
+                            "task_newtask: pid=1",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "<idle>");
+  EXPECT_TRUE(line.tgid_str.empty());
+  EXPECT_EQ(line.ts, 2188000);
+  EXPECT_EQ(line.event_name, "task_newtask");
+
+  ASSERT_TRUE(
+      tokenizer.Tokenize("<idle>-0     [000]  0.002188: task_newtask: pid=1",
+                         &line)
+          .ok());
+  EXPECT_EQ(line.task, "<idle>");
+  EXPECT_EQ(line.cpu, 0u);
+  EXPECT_EQ(line.ts, 2188000);
+  EXPECT_EQ(line.event_name, "task_newtask");
+  EXPECT_EQ(line.args_str, "pid=1");
+}
+
+TEST(SystraceLineTokenizerTest, TaskWithSpecialCharacters) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(tokenizer
+                  .Tokenize("  Binder:1-2 [3] (4)-1234  ( 1200) [002] ...1 "
+                            "10.5: tracing_mark_write: E|1200",
+                            &line)
+                  .ok());
+  EXPECT_EQ(line.task, "Binder:1-2 [3] (4)");
+  EXPECT_EQ(line.pid, 1234u);
+  EXPECT_EQ(line.tgid_str, "1200");
+  EXPECT_EQ(line.cpu, 2u);
+  EXPECT_EQ(line.ts, 10500000000);
+  EXPECT_EQ(line.event_name, "tracing_mark_write");
+  EXPECT_EQ(line.args_str, "E|1200");
+}
+
+TEST(SystraceLineTokenizerTest, EventNameWithColons) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  ASSERT_TRUE(
+      tokenizer.Tokenize("task-1 [000] .... 1.0: foo:bar: baz: qux", &line)
+          .ok());
+  EXPECT_EQ(line.event_name, "foo:bar");
+  EXPECT_EQ(line.args_str, "baz: qux");
+}
+
+TEST(SystraceLineTokenizerTest, Malformed) {
+  SystraceLineTokenizer tokenizer;
+  SystraceLine line;
+  EXPECT_FALSE(tokenizer.Tokenize("", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("# tracer: nop", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("task-1 [000] .... 1: foo: bar", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("task-1 [000] .... 1.0 foo: bar", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("task-1 [000] .... 1.0: foo", &line).ok());
+  EXPECT_FALSE(tokenizer.Tokenize("task-1[000] .... 1.0: foo: bar", &line).ok());
+  EXPECT_FALSE(
+      tokenizer.Tokenize("task-1 [000] ....... 1.0: foo: bar", &line).ok());
+  EXPECT_FALSE(
+      tokenizer.Tokenize("task-99999999999 [000] .... 1.0: foo: bar", &line)
+          .ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -17,15 +17,15 @@
 #include "src/trace_processor/importers/systrace/systrace_trace_parser.h"
 
 #include "perfetto/base/logging.h"
-#include "perfetto/ext/base/string_splitter.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "src/trace_processor/importers/common/process_tracker.h"
 #include "src/trace_processor/trace_sorter.h"
 
 #include <inttypes.h>
-#include <cctype>
+#include <string.h>
+
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 namespace perfetto {
 namespace trace_processor {
@@ -48,6 +48,28 @@ std::vector<base::StringView> SplitOnSpaces(base::StringView str) {
   return result;
 }
 
+bool StartsWith(base::StringView str, base::StringView prefix) {
+  return str.size() >= prefix.size() &&
+         str.substr(0, prefix.size()) == prefix;
+}
+
+// Every line is checked for the end of the script tag: use memchr() to skip
+// to the candidates, as most lines don't contain any.
+bool Contains(base::StringView str, base::StringView needle) {
+  const char* ptr = str.data();
+  const char* const end = str.end();
+  while (static_cast<size_t>(end - ptr) >= needle.size()) {
+    ptr = static_cast<const char*>(memchr(
+        ptr, needle.at(0), static_cast<size_t>(end - ptr) - needle.size() + 1));
+    if (!ptr)
+      return false;
+    if (memcmp(ptr, needle.data(), needle.size()) == 0)
+      return true;
+    ptr++;
+  }
+  return false;
+}
+
 bool IsProcessDumpShortHeader(const std::vector<base::StringView>& tokens) {
   return tokens.size() == 4 && tokens[0] == "USER" && tokens[1] == "PID" &&
          tokens[2] == "TID" && tokens[3] == "CMD";
@@ -66,112 +88,132 @@ SystraceTraceParser::~SystraceTraceParser() = default;
 
 util::Status SystraceTraceParser::Parse(std::unique_ptr<uint8_t[]> owned_buf,
                                         size_t size) {
-  if (state_ == ParseState::kEndOfSystrace)
+  if (state_ == ParseState::kEndOfSystrace || size == 0)
     return util::OkStatus();
-  partial_buf_.insert(partial_buf_.end(), &owned_buf[0], &owned_buf[size]);
 
+  const char* next = reinterpret_cast<const char*>(owned_buf.get());
+  const char* const end = next + size;
   if (state_ == ParseState::kBeforeParse) {
-    state_ = partial_buf_[0] == '<' ? ParseState::kHtmlBeforeSystrace
-                                    : ParseState::kSystrace;
+    state_ = *next == '<' ? ParseState::kHtmlBeforeSystrace
+                          : ParseState::kSystrace;
+  }
+
+  // Complete the line left over by the previous Parse() call, if any.
+  if (!partial_line_.empty()) {
+    const char* line_end = static_cast<const char*>(memchr(next, '\n', size));
+    if (!line_end) {
+      partial_line_.append(next, size);
+      return util::OkStatus();
+    }
+    partial_line_.append(next, line_end);
+    util::Status status = ParseSingleLine(base::StringView(partial_line_));
+    partial_line_.clear();
+    if (!status.ok())
+      return status;
+    next = line_end + 1;
+  }
+
+  // memchr() is vectorized by all the libcs we care about, which makes
+  // looking for the end of the lines close to free.
+  while (state_ != ParseState::kEndOfSystrace) {
+    const char* line_end = static_cast<const char*>(
+        memchr(next, '\n', static_cast<size_t>(end - next)));
+    if (!line_end)
+      break;
+    util::Status status = ParseSingleLine(
+        base::StringView(next, static_cast<size_t>(line_end - next)));
+    if (!status.ok())
+      return status;
+    next = line_end + 1;
   }
+  if (state_ != ParseState::kEndOfSystrace)
+    partial_line_.assign(next, end);
+  return util::OkStatus();
+}
 
+util::Status SystraceTraceParser::ParseSingleLine(base::StringView buffer) {
   // There can be multiple trace data sections in an HTML trace, we want to
   // ignore any that don't contain systrace data. In the future it would be
   // good to also parse the process dump section.
   const char kTraceDataSection[] =
       R"(<script class="trace-data" type="application/text">)";
-  auto start_it = partial_buf_.begin();
-  for (;;) {
-    auto line_it = std::find(start_it, partial_buf_.end(), '\n');
-    if (line_it == partial_buf_.end())
-      break;
+  const char kScriptEnd[] = R"(</script>)";
 
-    std::string buffer(start_it, line_it);
-
-    if (state_ == ParseState::kHtmlBeforeSystrace) {
-      if (base::Contains(buffer, kTraceDataSection)) {
-        state_ = ParseState::kTraceDataSection;
-      }
-    } else if (state_ == ParseState::kTraceDataSection) {
-      if (base::StartsWith(buffer, "#")) {
-        state_ = ParseState::kSystrace;
-      } else if (base::StartsWith(buffer, "PROCESS DUMP")) {
+  if (state_ == ParseState::kHtmlBeforeSystrace) {
+    if (Contains(buffer, kTraceDataSection)) {
+      state_ = ParseState::kTraceDataSection;
+    }
+  } else if (state_ == ParseState::kTraceDataSection) {
+    if (StartsWith(buffer, "#")) {
+      state_ = ParseState::kSystrace;
+    } else if (StartsWith(buffer, "PROCESS DUMP")) {
+      state_ = ParseState::kProcessDumpLong;
+    } else if (Contains(buffer, kScriptEnd)) {
+      state_ = ParseState::kHtmlBeforeSystrace;
+    }
+  } else if (state_ == ParseState::kSystrace) {
+    if (Contains(buffer, kScriptEnd)) {
+      state_ = ParseState::kEndOfSystrace;
+    } else if (!StartsWith(buffer, "#") && !buffer.empty()) {
+      SystraceLine line;
+      util::Status status = line_tokenizer_.Tokenize(buffer, &line);
+      if (!status.ok())
+        return status;
+      line_parser_.ParseLine(line);
+    }
+  } else if (state_ == ParseState::kProcessDumpLong ||
+             state_ == ParseState::kProcessDumpShort) {
+    if (Contains(buffer, kScriptEnd)) {
+      state_ = ParseState::kHtmlBeforeSystrace;
+    } else {
+      std::vector<base::StringView> tokens = SplitOnSpaces(buffer);
+      if (IsProcessDumpShortHeader(tokens)) {
+        state_ = ParseState::kProcessDumpShort;
+      } else if (IsProcessDumpLongHeader(tokens)) {
         state_ = ParseState::kProcessDumpLong;
-      } else if (base::Contains(buffer, R"(</script>)")) {
-        state_ = ParseState::kHtmlBeforeSystrace;
-      }
-    } else if (state_ == ParseState::kSystrace) {
-      if (base::Contains(buffer, R"(</script>)")) {
-        state_ = ParseState::kEndOfSystrace;
-        break;
-      } else if (!base::StartsWith(buffer, "#") && !buffer.empty()) {
-        SystraceLine line;
-        util::Status status = line_tokenizer_.Tokenize(buffer, &line);
-        if (!status.ok())
-          return status;
-        line_parser_.ParseLine(std::move(line));
-      }
-    } else if (state_ == ParseState::kProcessDumpLong ||
-               state_ == ParseState::kProcessDumpShort) {
-      if (base::Contains(buffer, R"(</script>)")) {
-        state_ = ParseState::kHtmlBeforeSystrace;
-      } else {
-        std::vector<base::StringView> tokens =
-            SplitOnSpaces(base::StringView(buffer));
-        if (IsProcessDumpShortHeader(tokens)) {
-          state_ = ParseState::kProcessDumpShort;
-        } else if (IsProcessDumpLongHeader(tokens)) {
-          state_ = ParseState::kProcessDumpLong;
-        } else if (state_ == ParseState::kProcessDumpLong &&
-                   tokens.size() >= 10) {
-          // Format is:
-          // user pid ppid vsz rss wchan pc s name my cmd line
-          const base::Optional<uint32_t> pid =
-              base::StringToUInt32(tokens[1].ToStdString());
-          const base::Optional<uint32_t> ppid =
-              base::StringToUInt32(tokens[2].ToStdString());
-          base::StringView name = tokens[8];
-          // Command line may contain spaces, merge all remaining tokens:
-          const char* cmd_start = tokens[9].data();
-          base::StringView cmd(
-              cmd_start,
-              static_cast<size_t>((buffer.data() + buffer.size()) - cmd_start));
-          if (!pid || !ppid) {
-            PERFETTO_ELOG("Could not parse line '%s'", buffer.c_str());
-            return util::ErrStatus("Could not parse PROCESS DUMP line");
-          }
-          ctx_->process_tracker->SetProcessMetadata(pid.value(), ppid, name);
-        } else if (state_ == ParseState::kProcessDumpShort &&
-                   tokens.size() >= 4) {
-          // Format is:
-          // username pid tid my cmd line
-          const base::Optional<uint32_t> tgid =
-              base::StringToUInt32(tokens[1].ToStdString());
-          const base::Optional<uint32_t> tid =
-              base::StringToUInt32(tokens[2].ToStdString());
-          // Command line may contain spaces, merge all remaining tokens:
-          const char* cmd_start = tokens[3].data();
-          base::StringView cmd(
-              cmd_start,
-              static_cast<size_t>((buffer.data() + buffer.size()) - cmd_start));
-          StringId cmd_id =
-              ctx_->storage->mutable_string_pool()->InternString(cmd);
-          if (!tid || !tgid) {
-            PERFETTO_ELOG("Could not parse line '%s'", buffer.c_str());
-            return util::ErrStatus("Could not parse PROCESS DUMP line");
-          }
-          UniqueTid utid =
-              ctx_->process_tracker->UpdateThread(tid.value(), tgid.value());
-          ctx_->process_tracker->SetThreadNameIfUnset(utid, cmd_id);
+      } else if (state_ == ParseState::kProcessDumpLong &&
+                 tokens.size() >= 10) {
+        // Format is:
+        // user pid ppid vsz rss wchan pc s name my cmd line
+        const base::Optional<uint32_t> pid =
+            base::StringToUInt32(tokens[1].ToStdString());
+        const base::Optional<uint32_t> ppid =
+            base::StringToUInt32(tokens[2].ToStdString());
+        base::StringView name = tokens[8];
+        // Command line may contain spaces, merge all remaining tokens:
+        const char* cmd_start = tokens[9].data();
+        base::StringView cmd(cmd_start,
+                             static_cast<size_t>(buffer.end() - cmd_start));
+        if (!pid || !ppid) {
+          PERFETTO_ELOG("Could not parse line '%s'",
+                        buffer.ToStdString().c_str());
+          return util::ErrStatus("Could not parse PROCESS DUMP line");
+        }
+        ctx_->process_tracker->SetProcessMetadata(pid.value(), ppid, name);
+      } else if (state_ == ParseState::kProcessDumpShort &&
+                 tokens.size() >= 4) {
+        // Format is:
+        // username pid tid my cmd line
+        const base::Optional<uint32_t> tgid =
+            base::StringToUInt32(tokens[1].ToStdString());
+        const base::Optional<uint32_t> tid =
+            base::StringToUInt32(tokens[2].ToStdString());
+        // Command line may contain spaces, merge all remaining tokens:
+        const char* cmd_start = tokens[3].data();
+        base::StringView cmd(cmd_start,
+                             static_cast<size_t>(buffer.end() - cmd_start));
+        StringId cmd_id =
+            ctx_->storage->mutable_string_pool()->InternString(cmd);
+        if (!tid || !tgid) {
+          PERFETTO_ELOG("Could not parse line '%s'",
+                        buffer.ToStdString().c_str());
+          return util::ErrStatus("Could not parse PROCESS DUMP line");
         }
+        UniqueTid utid =
+            ctx_->process_tracker->UpdateThread(tid.value(), tgid.value());
+        ctx_->process_tracker->SetThreadNameIfUnset(utid, cmd_id);
       }
     }
-    start_it = line_it + 1;
-  }
-  if (state_ == ParseState::kEndOfSystrace) {
-    partial_buf_.clear();
-  } else {
-    partial_buf_.erase(partial_buf_.begin(), start_it);
   }
   return util::OkStatus();
 }
@@ -17,8 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_TRACE_PARSER_H_
 #define SRC_TRACE_PROCESSOR_IMPORTERS_SYSTRACE_SYSTRACE_TRACE_PARSER_H_
 
-#include <deque>
-#include <regex>
+#include <string>
+
+#include "perfetto/ext/base/string_view.h"
 
 #include "src/trace_processor/chunked_trace_reader.h"
 #include "src/trace_processor/importers/systrace/systrace_line_parser.h"
@@ -39,6 +40,8 @@ class SystraceTraceParser : public ChunkedTraceReader {
   void NotifyEndOfFile() override;
 
  private:
+  util::Status ParseSingleLine(base::StringView line);
+
   enum ParseState {
     kBeforeParse,
     kHtmlBeforeSystrace,
@@ -51,9 +54,10 @@ class SystraceTraceParser : public ChunkedTraceReader {
 
   ParseState state_ = ParseState::kBeforeParse;
 
-  // Used to glue together trace packets that span across two (or more)
-  // Parse() boundaries.
-  std::deque<uint8_t> partial_buf_;
+  // Used to glue together lines that span across two (or more) Parse()
+  // boundaries. All the other lines are parsed in place, directly from the
+  // buffer passed to Parse().
+  std::string partial_line_;
 
   SystraceLineTokenizer line_tokenizer_;
   SystraceLineParser line_parser_;
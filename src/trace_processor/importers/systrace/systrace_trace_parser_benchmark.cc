@@ -0,0 +1,157 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks for the import of text systrace traces. The trace is a synthetic
+// 1GB dump of sched_switch, sched_wakeup and tracing_mark_write events, like
+// the ones captured by atrace.
+// BM_SystraceTokenizeLines measures splitting the dump in lines and tokenizing
+// them, which is done in place without copying the lines.
+// BM_SystraceImport measures the import end to end, through the TraceProcessor
+// API.
+
+#include <string.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/string_view.h"
+#include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/importers/systrace/systrace_line.h"
+#include "src/trace_processor/importers/systrace/systrace_line_tokenizer.h"
+
+namespace {
+
+using perfetto::base::StringView;
+using perfetto::trace_processor::SystraceLine;
+using perfetto::trace_processor::SystraceLineTokenizer;
+using perfetto::trace_processor::TraceProcessor;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+constexpr size_t kChunkSize = 1024 * 1024;
+
+// Returns a systrace dump of about 1GB (1MB in functional test mode). The dump
+// is generated only once and shared by all the benchmarks, as generating it
+// takes longer than importing it.
+const std::string& GetSystraceDump() {
+  static const std::string* dump = [] {
+    static constexpr uint32_t kRandomSeed = 42;
+    std::minstd_rand0 rnd_engine(kRandomSeed);
+    const size_t size =
+        IsBenchmarkFunctionalOnly() ? 1024 * 1024 : 1024 * 1024 * 1024;
+
+    std::string* out = new std::string("# tracer: nop\n#\n");
+    out->reserve(size + 1024);
+    uint64_t ts_us = 1000000;
+    char line[512];
+    while (out->size() < size) {
+      ts_us += rnd_engine() % 100;
+      uint32_t cpu = rnd_engine() % 8;
+      uint32_t tgid = 1000 + rnd_engine() % 32;
+      uint32_t tid = tgid + rnd_engine() % 4;
+      std::string task = "Thread-" + std::to_string(tid);
+      uint32_t secs = static_cast<uint32_t>(ts_us / 1000000);
+      uint32_t usecs = static_cast<uint32_t>(ts_us % 1000000);
+      int len = 0;
+      switch (rnd_engine() % 4) {
+        case 0:
+          len = snprintf(
+              line, sizeof(line),
+              "%16s-%-5u (%5u) [%03u] d..2 %5u.%06u: sched_switch: "
+              "prev_comm=%s prev_pid=%u prev_prio=120 prev_state=S ==> "
+              "next_comm=swapper/%u next_pid=0 next_prio=120\n",
+              task.c_str(), tid, tgid, cpu, secs, usecs, task.c_str(), tid,
+              cpu);
+          break;
+        case 1:
+          len = snprintf(line, sizeof(line),
+                         "%16s-%-5u (%5u) [%03u] d.h3 %5u.%06u: sched_wakeup: "
+                         "comm=%s pid=%u prio=120 target_cpu=%03u\n",
+                         task.c_str(), tid, tgid, cpu, secs, usecs,
+                         task.c_str(), tid, cpu);
+          break;
+        case 2:
+          len = snprintf(line, sizeof(line),
+                         "%16s-%-5u (%5u) [%03u] ...1 %5u.%06u: "
+                         "tracing_mark_write: B|%u|DrawFrame %u\n",
+                         task.c_str(), tid, tgid, cpu, secs, usecs, tgid,
+                         static_cast<uint32_t>(rnd_engine() % 1000));
+          break;
+        case 3:
+          len = snprintf(line, sizeof(line),
+                         "%16s-%-5u (%5u) [%03u] ...1 %5u.%06u: "
+                         "tracing_mark_write: E|%u\n",
+                         task.c_str(), tid, tgid, cpu, secs, usecs, tgid);
+          break;
+      }
+      out->append(line, static_cast<size_t>(len));
+    }
+    return out;
+  }();
+  return *dump;
+}
+
+static void BM_SystraceTokenizeLines(benchmark::State& state) {
+  const std::string& dump = GetSystraceDump();
+  const char* const end = dump.data() + dump.size();
+
+  SystraceLineTokenizer tokenizer;
+  for (auto _ : state) {
+    uint64_t num_lines = 0;
+    int64_t sum = 0;
+    for (const char* next = dump.data(); next < end;) {
+      const char* line_end = static_cast<const char*>(
+          memchr(next, '\n', static_cast<size_t>(end - next)));
+      StringView buffer(next, static_cast<size_t>(line_end - next));
+      next = line_end + 1;
+      if (buffer.empty() || buffer.at(0) == '#')
+        continue;
+      SystraceLine line;
+      PERFETTO_CHECK(tokenizer.Tokenize(buffer, &line).ok());
+      sum += line.ts + line.pid + static_cast<int64_t>(line.args_str.size());
+      num_lines++;
+    }
+    PERFETTO_CHECK(num_lines > 0);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(dump.size()));
+}
+BENCHMARK(BM_SystraceTokenizeLines)->Unit(benchmark::kMillisecond);
+
+static void BM_SystraceImport(benchmark::State& state) {
+  const std::string& dump = GetSystraceDump();
+
+  for (auto _ : state) {
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance({});
+    for (size_t off = 0; off < dump.size(); off += kChunkSize) {
+      size_t size = std::min(kChunkSize, dump.size() - off);
+      std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+      memcpy(buf.get(), &dump[off], size);
+      PERFETTO_CHECK(tp->Parse(std::move(buf), size).ok());
+    }
+    tp->NotifyEndOfFile();
+  }
+  state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) *
+                          static_cast<int64_t>(dump.size()));
+}
+BENCHMARK(BM_SystraceImport)->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -16,11 +16,15 @@
 
 #include "perfetto/trace_processor/read_trace.h"
 
+#include <algorithm>
+
 #include "perfetto/ext/base/scoped_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/trace_processor/trace_processor.h"
 
 #include "src/trace_processor/importers/gzip/gzip_utils.h"
+#include "src/trace_processor/importers/proto/proto_trace_framer.h"
+#include "src/trace_processor/util/status_macros.h"
 
 #include "protos/perfetto/trace/trace.pbzero.h"
 #include "protos/perfetto/trace/trace_packet.pbzero.h"
@@ -36,9 +40,49 @@
 #include <aio.h>
 #endif
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+#define PERFETTO_HAS_MMAP() 1
+#else
+#define PERFETTO_HAS_MMAP() 0
+#endif
+
+#if PERFETTO_HAS_MMAP()
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
+#if PERFETTO_HAS_MMAP()
+namespace {
+
+// Maps the whole regular file |fd| read-only. Returns nullptr if the file
+// can't be mapped.
+std::shared_ptr<const uint8_t> MapFile(int fd, size_t* size) {
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+    return nullptr;
+  size_t map_size = static_cast<size_t>(st.st_size);
+  void* addr = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  // The trace is parsed front to back: let the kernel read ahead more and
+  // reclaim the pages already parsed first.
+  madvise(addr, map_size, MADV_SEQUENTIAL);
+  *size = map_size;
+  return std::shared_ptr<const uint8_t>(
+      static_cast<const uint8_t*>(addr), [map_size](const uint8_t* p) {
+        munmap(const_cast<uint8_t*>(p), map_size);
+      });
+}
+
+}  // namespace
+#endif  // PERFETTO_HAS_MMAP()
+
 util::Status ReadTrace(
     TraceProcessor* tp,
     const char* filename,
@@ -126,22 +170,131 @@ util::Status ReadTrace(
   return util::OkStatus();
 }
 
+util::Status ReadTraceMapped(
+    TraceProcessor* tp,
+    const char* filename,
+    const std::function<void(uint64_t parsed_size)>& progress_callback) {
+#if PERFETTO_HAS_MMAP()
+  std::shared_ptr<const uint8_t> mapping;
+  size_t file_size = 0;
+  {
+    base::ScopedFile fd(base::OpenFile(filename, O_RDONLY));
+    if (!fd)
+      return util::ErrStatus("Could not open trace file (path: %s)", filename);
+    mapping = MapFile(*fd, &file_size);
+  }
+  if (!mapping)
+    return ReadTrace(tp, filename, progress_callback);
+
+  // The chunks are slices of the mapping, not copies, so they can be larger
+  // than the ones of ReadTrace(). This reduces the number of TracePackets
+  // which span across two chunks and need to be glued together in a copy.
+  constexpr size_t kChunkSize = 16 * 1024 * 1024;
+  size_t offset = 0;
+  for (int i = 0; offset < file_size; i++) {
+    if (progress_callback && i % 8 == 0)
+      progress_callback(offset);
+
+    size_t size = std::min(kChunkSize, file_size - offset);
+    // Shares the ownership of |mapping|, which is unmapped once the last
+    // chunk is released.
+    std::shared_ptr<const uint8_t> chunk(mapping, mapping.get() + offset);
+    util::Status status = tp->ParseSharedBuffer(std::move(chunk), size);
+    if (PERFETTO_UNLIKELY(!status.ok()))
+      return status;
+    offset += size;
+  }
+  mapping.reset();
+
+  tp->NotifyEndOfFile();
+  tp->SetCurrentTraceName(filename);
+
+  if (progress_callback)
+    progress_callback(file_size);
+  return util::OkStatus();
+#else   // PERFETTO_HAS_MMAP()
+  return ReadTrace(tp, filename, progress_callback);
+#endif  // PERFETTO_HAS_MMAP()
+}
+
+TraceFileTailer::TraceFileTailer(TraceProcessor* tp, std::string filename)
+    : tp_(tp), filename_(std::move(filename)) {}
+
+TraceFileTailer::~TraceFileTailer() {
+  // Takes the ownership of the file to close it.
+  base::ScopedFile fd(fd_);
+}
+
+util::Status TraceFileTailer::ReadNewData(uint64_t* new_bytes) {
+  RETURN_IF_ERROR(ParseNewData(new_bytes));
+  return tp_->Flush();
+}
+
+util::Status TraceFileTailer::Finish() {
+  RETURN_IF_ERROR(ParseNewData(nullptr));
+  finished_ = true;
+  tp_->NotifyEndOfFile();
+  return util::OkStatus();
+}
+
+util::Status TraceFileTailer::ParseNewData(uint64_t* new_bytes) {
+  if (finished_)
+    return util::ErrStatus("Cannot read %s after its end", filename_.c_str());
+  if (fd_ < 0) {
+    fd_ = base::OpenFile(filename_, O_RDONLY).release();
+    if (fd_ < 0) {
+      return util::ErrStatus("Could not open trace file (path: %s)",
+                             filename_.c_str());
+    }
+    tp_->SetCurrentTraceName(filename_);
+  }
+
+  // The file offset is kept across calls: read() picks up where the previous
+  // call hit the end of the file, once more data is appended.
+  constexpr size_t kChunkSize = 1024 * 1024;
+  uint64_t size = 0;
+  for (;;) {
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[kChunkSize]);
+    auto rsize = read(fd_, buf.get(), kChunkSize);
+    if (rsize < 0) {
+      return util::ErrStatus("Failed reading trace file (path: %s)",
+                             filename_.c_str());
+    }
+    if (rsize == 0)
+      break;
+    size += static_cast<uint64_t>(rsize);
+    bytes_read_ += static_cast<uint64_t>(rsize);
+    RETURN_IF_ERROR(tp_->Parse(std::move(buf), static_cast<size_t>(rsize)));
+  }
+  if (new_bytes)
+    *new_bytes = size;
+  return util::OkStatus();
+}
+
 util::Status DecompressTrace(const uint8_t* data,
                              size_t size,
                              std::vector<uint8_t>* output) {
-  if (!gzip::IsGzipSupported()) {
-    return util::ErrStatus(
-        "Cannot decompress trace in build where zlib is disabled");
-  }
-
   protos::pbzero::Trace::Decoder decoder(data, size);
   GzipDecompressor decompressor;
   for (auto it = decoder.packet(); it; ++it) {
     protos::pbzero::TracePacket::Decoder packet(*it);
+    if (packet.has_lz4_compressed_packets()) {
+      auto bytes = packet.lz4_compressed_packets();
+      TraceBlobView packets = DecompressLz4TracePackets(bytes.data, bytes.size);
+      if (!packets.data())
+        return util::ErrStatus("Failed while decompressing LZ4 block");
+      output->insert(output->end(), packets.data(),
+                     packets.data() + packets.length());
+      continue;
+    }
     if (!packet.has_compressed_packets()) {
       it->SerializeAndAppendTo(output);
       continue;
     }
+    if (!gzip::IsGzipSupported()) {
+      return util::ErrStatus(
+          "Cannot decompress trace in build where zlib is disabled");
+    }
 
     // Make sure that to reset the stream between the gzip streams.
     auto bytes = packet.compressed_packets();
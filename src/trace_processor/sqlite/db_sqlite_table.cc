@@ -16,7 +16,10 @@
 
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
 
+#include <algorithm>
+
 #include "perfetto/ext/base/string_writer.h"
+#include "src/trace_processor/db/secondary_index.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/tp_metatrace.h"
@@ -46,8 +49,9 @@ base::Optional<FilterOp> SqliteOpToFilterOp(int sqlite_op) {
       return FilterOp::kIsNull;
     case SQLITE_INDEX_CONSTRAINT_ISNOTNULL:
       return FilterOp::kIsNotNull;
-    case SQLITE_INDEX_CONSTRAINT_LIKE:
     case SQLITE_INDEX_CONSTRAINT_GLOB:
+      return FilterOp::kGlob;
+    case SQLITE_INDEX_CONSTRAINT_LIKE:
       return base::nullopt;
     default:
       PERFETTO_FATAL("Currently unsupported constraint");
@@ -98,6 +102,10 @@ void DbSqliteTable::RegisterTable(sqlite3* db,
                                   Table::Schema schema,
                                   const Table* table,
                                   const std::string& name) {
+  for (Table::Schema::Column& col : schema.columns) {
+    const auto* table_col = table->GetColumnByName(col.name.c_str());
+    col.is_indexable = table_col && SecondaryIndex::IsSupported(*table_col);
+  }
   Context context{cache, schema, TableComputation::kStatic, table, nullptr};
   SqliteTable::Register<DbSqliteTable, Context>(db, std::move(context), name);
 }
@@ -120,6 +128,12 @@ void DbSqliteTable::RegisterTable(
                                                 false, requires_args);
 }
 
+void DbSqliteTable::SetStaticTable(Table::Schema schema, const Table* table) {
+  PERFETTO_DCHECK(computation_ == TableComputation::kStatic);
+  schema_ = std::move(schema);
+  static_table_ = table;
+}
+
 util::Status DbSqliteTable::Init(int, const char* const*, Schema* schema) {
   *schema = ComputeSchema(schema_, name().c_str());
   return util::OkStatus();
@@ -178,8 +192,11 @@ void DbSqliteTable::BestIndex(const Table::Schema& schema,
     // SqliteOpToFilterOp will return nullopt for any constraint which we don't
     // support filtering ourselves. Only omit filtering by SQLite when we can
     // handle filtering.
+    // Globs are the exception: we only filter string columns with them (see
+    // |Cursor::Filter|) so SQLite always needs to double check the result.
     base::Optional<FilterOp> opt_op = SqliteOpToFilterOp(cs[i].op);
-    info->sqlite_omit_constraint[i] = opt_op.has_value();
+    info->sqlite_omit_constraint[i] =
+        opt_op.has_value() && *opt_op != FilterOp::kGlob;
   }
 
   // We can sort on any column correctly.
@@ -289,8 +306,11 @@ DbSqliteTable::QueryCost DbSqliteTable::EstimateCost(
       // a good approximation. Otherwise, we'll need to do a full table scan.
       // Alternatively, if the column is sorted, we can use the same binary
       // search logic so we have the same low cost (even better because we don't
-      // have to sort at all).
-      filter_cost += cs.size() == 1 || col_schema.is_sorted
+      // have to sort at all). The same is true for indexable columns as an
+      // index will be built for them if they are filtered on often.
+      bool is_cheap_eq =
+          cs.size() == 1 || col_schema.is_sorted || col_schema.is_indexable;
+      filter_cost += is_cheap_eq
                          ? (2 * current_row_count) / log2(current_row_count)
                          : current_row_count;
 
@@ -326,6 +346,9 @@ std::unique_ptr<SqliteTable::Cursor> DbSqliteTable::CreateCursor() {
   return std::unique_ptr<Cursor>(new Cursor(this, cache_));
 }
 
+constexpr uint32_t DbSqliteTable::Cursor::kMinBatchSize;
+constexpr uint32_t DbSqliteTable::Cursor::kMaxBatchSize;
+
 DbSqliteTable::Cursor::Cursor(DbSqliteTable* sqlite_table, QueryCache* cache)
     : SqliteTable::Cursor(sqlite_table),
       db_sqlite_table_(sqlite_table),
@@ -390,9 +413,9 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     r->AddArg("Table", db_sqlite_table_->name());
   });
 
-  // Clear out the iterator before filtering to ensure the destructor is run
-  // before the table's destructor.
-  iterator_ = base::nullopt;
+  // The batches refer to the rows of the previous table so throw them away.
+  for (ColumnBatch& batch : batches_)
+    batch.size = 0;
 
   // We reuse this vector to reduce memory allocations on nested subqueries.
   constraints_.resize(qc.constraints().size());
@@ -408,6 +431,15 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
       continue;
 
     SqlValue value = SqliteValueToSqlValue(argv[i]);
+
+    // SQLite converts both sides of a glob to strings; as we don't, only
+    // filter string columns with string patterns and let SQLite handle the
+    // rest.
+    if (*opt_op == FilterOp::kGlob &&
+        (db_sqlite_table_->schema_.columns[col].type != SqlValue::kString ||
+         value.type != SqlValue::kString)) {
+      continue;
+    }
     constraints_[constraints_pos++] = Constraint{col, *opt_op, value};
   }
   constraints_.resize(constraints_pos);
@@ -479,6 +511,9 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
         case FilterOp::kIsNotNull:
           writer.AppendString("IS NOT");
           break;
+        case FilterOp::kGlob:
+          writer.AppendString("GLOB");
+          break;
       }
       writer.AppendChar(' ');
 
@@ -546,9 +581,10 @@ int DbSqliteTable::Cursor::Filter(const QueryConstraints& qc,
     if (!orders_.empty())
       db_table_ = db_table_->Sort(orders_);
 
-    iterator_ = db_table_->IterateRows();
+    row_ = 0;
+    batches_.resize(db_table_->GetColumnCount(), ColumnBatch{0, 0, {}});
 
-    eof_ = !*iterator_;
+    eof_ = db_table_->row_count() == 0;
   }
 
   return SQLITE_OK;
@@ -558,8 +594,7 @@ int DbSqliteTable::Cursor::Next() {
   if (mode_ == Mode::kSingleRow) {
     eof_ = true;
   } else {
-    iterator_->Next();
-    eof_ = !*iterator_;
+    eof_ = ++row_ >= db_table_->row_count();
   }
   return SQLITE_OK;
 }
@@ -568,11 +603,59 @@ int DbSqliteTable::Cursor::Eof() {
   return eof_;
 }
 
+void DbSqliteTable::Cursor::ColumnFromBatch(sqlite3_context* ctx,
+                                            uint32_t col) {
+  PERFETTO_DCHECK(mode_ == Mode::kTable);
+
+  ColumnBatch& batch = batches_[col];
+  uint32_t i = row_ - batch.start_row;
+  if (i >= batch.size) {
+    uint32_t batch_size = batch.size == 0
+                              ? kMinBatchSize
+                              : std::min(batch.size * 2, kMaxBatchSize);
+    uint32_t end_row = std::min(row_ + batch_size, db_table_->row_count());
+    db_table_->GetColumn(col).GetRows(row_, end_row, &batch.rows);
+    batch.start_row = row_;
+    batch.size = end_row - row_;
+    i = 0;
+  }
+
+  const trace_processor::Column::Rows& rows = batch.rows;
+  if (!rows.is_null.empty() && rows.is_null[i]) {
+    sqlite3_result_null(ctx);
+    return;
+  }
+  switch (rows.type) {
+    case SqlValue::Type::kLong:
+      sqlite3_result_int64(ctx, rows.longs[i]);
+      break;
+    case SqlValue::Type::kDouble:
+      sqlite3_result_double(ctx, rows.doubles[i]);
+      break;
+    case SqlValue::Type::kString:
+      // As in |Column|, strings come from the string pool so they outlive the
+      // batch.
+      if (rows.strings[i]) {
+        sqlite3_result_text(ctx, rows.strings[i], -1,
+                            sqlite_utils::kSqliteStatic);
+      } else {
+        sqlite3_result_null(ctx);
+      }
+      break;
+    case SqlValue::Type::kNull:
+    case SqlValue::Type::kBytes:
+      PERFETTO_FATAL("Unexpected column type");
+  }
+}
+
 int DbSqliteTable::Cursor::Column(sqlite3_context* ctx, int raw_col) {
   uint32_t column = static_cast<uint32_t>(raw_col);
-  SqlValue value = mode_ == Mode::kSingleRow
-                       ? SourceTable()->GetColumn(column).Get(*single_row_)
-                       : iterator_->Get(column);
+  if (mode_ == Mode::kTable) {
+    ColumnFromBatch(ctx, column);
+    return SQLITE_OK;
+  }
+
+  SqlValue value = SourceTable()->GetColumn(column).Get(*single_row_);
   switch (value.type) {
     case SqlValue::Type::kLong:
       sqlite3_result_int64(ctx, value.long_value);
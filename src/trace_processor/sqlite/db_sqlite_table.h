@@ -17,6 +17,9 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_DB_SQLITE_TABLE_H_
 
+#include <map>
+#include <string>
+
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
@@ -89,6 +92,26 @@ class DbSqliteTable : public SqliteTable {
       kTable,
     };
 
+    // The values of a column for consecutive rows of |db_table_|: SQLite
+    // requests values one cell at a time so, in table mode, columns are read
+    // in batches to avoid looking up the column type and row for every cell.
+    struct ColumnBatch {
+      uint32_t start_row;
+      uint32_t size;
+      trace_processor::Column::Rows rows;
+    };
+
+    // Batches start small so that queries only reading a few rows (e.g. with
+    // a LIMIT or an EXISTS) don't materialize rows they don't need; their
+    // size then doubles with every batch read up to the max size.
+    static constexpr uint32_t kMinBatchSize = 16;
+    static constexpr uint32_t kMaxBatchSize = 1024;
+
+    // Implementation of |Column| for Mode::kTable: returns the value of the
+    // column |col| at the current row to SQLite, reading the next batch of
+    // values of the column if needed.
+    void ColumnFromBatch(sqlite3_context*, uint32_t col);
+
     // Tries to create a sorted table to cache in |sorted_cache_table_| if the
     // constraint set matches the requirements.
     void TryCacheCreateSortedTable(const QueryConstraints&, FilterHistory);
@@ -116,7 +139,8 @@ class DbSqliteTable : public SqliteTable {
 
     // Only valid for Mode::kTable.
     base::Optional<Table> db_table_;
-    base::Optional<Table::Iterator> iterator_;
+    uint32_t row_ = 0;
+    std::vector<ColumnBatch> batches_;
 
     bool eof_ = true;
 
@@ -134,6 +158,10 @@ class DbSqliteTable : public SqliteTable {
     std::vector<Constraint> constraints_;
     std::vector<Order> orders_;
   };
+  // Static tables indexed by name. Used by the operator tables which compute
+  // their table from other tables (e.g. hash_join).
+  using StaticTableMap = std::map<std::string, const Table*>;
+
   struct QueryCost {
     double cost;
     uint32_t rows;
@@ -166,7 +194,7 @@ class DbSqliteTable : public SqliteTable {
   // Table implementation.
   util::Status Init(int,
                     const char* const*,
-                    SqliteTable::Schema*) override final;
+                    SqliteTable::Schema*) override;
   std::unique_ptr<SqliteTable::Cursor> CreateCursor() override;
   int ModifyConstraints(QueryConstraints*) override final;
   int BestIndex(const QueryConstraints&, BestIndexInfo*) override final;
@@ -186,6 +214,12 @@ class DbSqliteTable : public SqliteTable {
                                 uint32_t row_count,
                                 const QueryConstraints& qc);
 
+ protected:
+  // Allows subclasses which only compute their table in Init (e.g. from the
+  // arguments of the table) to serve it as the static table of this table.
+  // Should be called before DbSqliteTable::Init.
+  void SetStaticTable(Table::Schema schema, const Table* table);
+
  private:
   QueryCache* cache_ = nullptr;
   Table::Schema schema_;
@@ -26,15 +26,20 @@ namespace {
 Table::Schema CreateSchema() {
   Table::Schema schema;
   schema.columns.push_back({"id", SqlValue::Type::kLong, true /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexable */});
   schema.columns.push_back({"type", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexable */});
   schema.columns.push_back({"test1", SqlValue::Type::kLong, false /* is_id */,
-                            true /* is_sorted */, false /* is_hidden */});
+                            true /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexable */});
   schema.columns.push_back({"test2", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexable */});
   schema.columns.push_back({"test3", SqlValue::Type::kLong, false /* is_id */,
-                            false /* is_sorted */, false /* is_hidden */});
+                            false /* is_sorted */, false /* is_hidden */,
+                            false /* is_indexable */});
   return schema;
 }
 
@@ -118,6 +123,25 @@ TEST(DbSqliteTable, MultiSortedEqCheaperThanMultiUnsortedEq) {
   ASSERT_EQ(sorted_cost.rows, unsorted_cost.rows);
 }
 
+TEST(DbSqliteTable, MultiIndexableEqCheaperThanMultiUnsortedEq) {
+  auto schema = CreateSchema();
+  constexpr uint32_t kRowCount = 1234;
+
+  QueryConstraints eq;
+  eq.AddConstraint(3u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+  eq.AddConstraint(4u, SQLITE_INDEX_CONSTRAINT_EQ, 0u);
+
+  auto unindexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, eq);
+
+  schema.columns[3].is_indexable = true;
+  auto indexed_cost = DbSqliteTable::EstimateCost(schema, kRowCount, eq);
+
+  // The number of rows should be the same but the cost of the query on the
+  // indexable column should be less.
+  ASSERT_LT(indexed_cost.cost, unindexed_cost.cost);
+  ASSERT_EQ(indexed_cost.rows, unindexed_cost.rows);
+}
+
 TEST(DbSqliteTable, EmptyTableCosting) {
   auto schema = CreateSchema();
 
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/group_by_operator_table.h"
+
+#include <algorithm>
+
+#include "perfetto/ext/base/string_utils.h"
+#include "src/trace_processor/db/secondary_index.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+struct AggregateFunction {
+  const char* name;
+  Aggregate::Op op;
+};
+
+constexpr AggregateFunction kAggregateFunctions[] = {
+    {"count", Aggregate::Op::kCount}, {"sum", Aggregate::Op::kSum},
+    {"min", Aggregate::Op::kMin},     {"max", Aggregate::Op::kMax},
+    {"avg", Aggregate::Op::kAvg},
+};
+
+std::string RemoveSpaces(std::string str) {
+  str.erase(std::remove(str.begin(), str.end(), ' '), str.end());
+  return str;
+}
+
+// Parses |arg| as an aggregate (e.g. "SUM(dur)") of a column of |table|.
+// Returns false if |arg| does not look like an aggregate at all.
+bool ParseAggregate(const Table& table,
+                    const std::string& arg,
+                    Aggregate* aggregate,
+                    std::string* name,
+                    util::Status* status) {
+  size_t open = arg.find('(');
+  if (open == std::string::npos || arg.back() != ')')
+    return false;
+
+  std::string function = base::ToLower(RemoveSpaces(arg.substr(0, open)));
+  std::string col_name =
+      RemoveSpaces(arg.substr(open + 1, arg.size() - open - 2));
+
+  const AggregateFunction* fn = nullptr;
+  for (const AggregateFunction& candidate : kAggregateFunctions) {
+    if (function == candidate.name)
+      fn = &candidate;
+  }
+  if (!fn) {
+    *status = util::ErrStatus("GROUP_BY: unknown aggregate %s", arg.c_str());
+    return true;
+  }
+  aggregate->op = fn->op;
+
+  if (col_name.empty() || col_name == "*") {
+    if (fn->op != Aggregate::Op::kCount) {
+      *status = util::ErrStatus("GROUP_BY: %s needs a column", arg.c_str());
+      return true;
+    }
+    aggregate->col_idx = base::nullopt;
+    *name = "count";
+    return true;
+  }
+
+  const Column* col = table.GetColumnByName(col_name.c_str());
+  if (!col) {
+    *status = util::ErrStatus("GROUP_BY: unknown column %s", col_name.c_str());
+    return true;
+  }
+  bool numeric = col->type() == SqlValue::Type::kLong ||
+                 col->type() == SqlValue::Type::kDouble;
+  if (!numeric && fn->op != Aggregate::Op::kCount) {
+    *status = util::ErrStatus("GROUP_BY: cannot compute %s of column %s",
+                              fn->name, col_name.c_str());
+    return true;
+  }
+  aggregate->col_idx = col->index_in_table();
+  *name = std::string(fn->name) + "_" + col_name;
+  return true;
+}
+
+}  // namespace
+
+GroupByOperatorTable::GroupByOperatorTable(sqlite3* db,
+                                           const StaticTableMap* tables)
+    : DbSqliteTable(db,
+                    // As for HashJoinOperatorTable, the grouped table is owned
+                    // by this table so must not be cached.
+                    Context{nullptr, Table::Schema(), TableComputation::kStatic,
+                            nullptr, nullptr}),
+      tables_(tables) {}
+
+GroupByOperatorTable::~GroupByOperatorTable() = default;
+
+void GroupByOperatorTable::RegisterTable(sqlite3* db,
+                                         const StaticTableMap* tables) {
+  SqliteTable::Register<GroupByOperatorTable, const StaticTableMap*>(
+      db, tables, "group_by", /* read_write */ false,
+      /* requires_args */ true);
+}
+
+util::Status GroupByOperatorTable::Init(int argc,
+                                        const char* const* argv,
+                                        SqliteTable::Schema* schema) {
+  // argv[0] - argv[2] are SQLite populated fields which are always present.
+  if (argc < 5)
+    return util::ErrStatus("GROUP_BY: expected a table and at least 1 column");
+
+  std::string table_name = argv[3];
+  auto it = tables_->find(table_name);
+  if (it == tables_->end())
+    return util::ErrStatus("GROUP_BY: unknown table %s", table_name.c_str());
+  const Table& table = *it->second;
+
+  Table::Schema grouped_schema;
+  grouped_schema.columns.emplace_back(Table::Schema::Column{
+      "id", SqlValue::Type::kLong, true /* is_id */, true /* is_sorted */,
+      false /* is_hidden */, false /* is_indexable */});
+
+  std::vector<uint32_t> keys;
+  std::vector<Aggregate> aggregates;
+  std::vector<std::string> aggregate_names;
+  for (int i = 4; i < argc; ++i) {
+    std::string arg = argv[i];
+    Aggregate aggregate;
+    std::string name;
+    util::Status status;
+    if (ParseAggregate(table, arg, &aggregate, &name, &status)) {
+      if (!status.ok())
+        return status;
+      aggregates.push_back(aggregate);
+      aggregate_names.push_back(name);
+      continue;
+    }
+
+    // Every key must come before the aggregates as they are the first columns
+    // of the grouped table.
+    if (!aggregates.empty())
+      return util::ErrStatus("GROUP_BY: key %s after aggregates", arg.c_str());
+    const trace_processor::Column* col = table.GetColumnByName(arg.c_str());
+    if (!col) {
+      return util::ErrStatus("GROUP_BY: column %s not found in table %s",
+                             arg.c_str(), table_name.c_str());
+    }
+    if (col->IsId() || col->type() == SqlValue::Type::kBytes)
+      return util::ErrStatus("GROUP_BY: cannot group by %s", arg.c_str());
+    keys.push_back(col->index_in_table());
+  }
+
+  grouped_.reset(new Table(table.GroupBy(keys, aggregates)));
+
+  uint32_t col_idx = 1;
+  for (uint32_t key : keys) {
+    const trace_processor::Column& col = grouped_->GetColumn(col_idx++);
+    grouped_schema.columns.emplace_back(Table::Schema::Column{
+        table.GetColumn(key).name(), col.type(), false /* is_id */,
+        col.IsSorted(), col.IsHidden(), SecondaryIndex::IsSupported(col)});
+  }
+  for (const std::string& name : aggregate_names) {
+    const trace_processor::Column& col = grouped_->GetColumn(col_idx++);
+    grouped_schema.columns.emplace_back(Table::Schema::Column{
+        name, col.type(), false /* is_id */, false /* is_sorted */,
+        false /* is_hidden */, SecondaryIndex::IsSupported(col)});
+  }
+  PERFETTO_DCHECK(col_idx == grouped_->GetColumnCount());
+
+  SetStaticTable(std::move(grouped_schema), grouped_.get());
+  return DbSqliteTable::Init(argc, argv, schema);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
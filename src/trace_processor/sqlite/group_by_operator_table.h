@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_GROUP_BY_OPERATOR_TABLE_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_GROUP_BY_OPERATOR_TABLE_H_
+
+#include <memory>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Implements a GROUP BY query over a table of the trace processor using
+// Table::GroupBy.
+//
+// Aggregating a virtual table in SQL makes SQLite step through every row of
+// the table and read every column involved. Instead, this table computes the
+// aggregates directly over the columns of the table.
+//
+// Usage:
+// CREATE VIRTUAL TABLE utid_runtime
+// USING group_by(sched_slice, utid, SUM(dur), COUNT(*), MAX(ts));
+//
+// The first argument is the table to aggregate; every other argument is
+// either the name of a key column or one of COUNT(*), COUNT(col), SUM(col),
+// MIN(col), MAX(col) and AVG(col). The returned table has an id column
+// numbering the groups followed by the key columns and the aggregates, named
+// "count" for COUNT(*) and "<aggregate>_<col>" (e.g. sum_dur) otherwise.
+// Without key columns, the aggregates are computed over the whole table.
+//
+// The aggregates are computed when the table is created so the table does not
+// reflect any later change to the aggregated table.
+class GroupByOperatorTable : public DbSqliteTable {
+ public:
+  GroupByOperatorTable(sqlite3*, const StaticTableMap* tables);
+  ~GroupByOperatorTable() override;
+
+  static void RegisterTable(sqlite3* db, const StaticTableMap* tables);
+
+  // Table implementation.
+  util::Status Init(int,
+                    const char* const*,
+                    SqliteTable::Schema*) override;
+
+ private:
+  const StaticTableMap* tables_ = nullptr;
+  std::unique_ptr<Table> grouped_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_GROUP_BY_OPERATOR_TABLE_H_
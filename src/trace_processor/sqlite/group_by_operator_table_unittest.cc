@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/group_by_operator_table.h"
+
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/slice_tables.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class GroupByOperatorTableTest : public ::testing::Test {
+ public:
+  GroupByOperatorTableTest() : slices_(&pool_, nullptr) {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    for (uint32_t i = 0; i < 10; ++i) {
+      tables::SliceTable::Row slice;
+      slice.ts = i * 100;
+      slice.dur = i;
+      slice.track_id = tables::TrackTable::Id(i % 3);
+      slice.name = pool_.InternString(i % 2 ? "odd" : "even");
+      slices_.Insert(slice);
+    }
+
+    tables_[slices_.table_name()] = &slices_;
+    GroupByOperatorTable::RegisterTable(db_.get(), &tables_);
+  }
+
+  void PrepareValidStatement(const std::string& sql) {
+    int size = static_cast<int>(sql.size());
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(*db_, sql.c_str(), size, &stmt, nullptr),
+              SQLITE_OK);
+    stmt_.reset(stmt);
+  }
+
+  void RunStatement(const std::string& sql) {
+    PrepareValidStatement(sql);
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+  }
+
+ protected:
+  StringPool pool_;
+  tables::SliceTable slices_;
+  DbSqliteTable::StaticTableMap tables_;
+
+  ScopedDb db_;
+  ScopedStmt stmt_;
+};
+
+TEST_F(GroupByOperatorTableTest, GroupByKeys) {
+  RunStatement(
+      "CREATE VIRTUAL TABLE g USING group_by(internal_slice, track_id, "
+      "COUNT(*), SUM(dur), max(ts));");
+
+  PrepareValidStatement(
+      "SELECT track_id, count, sum_dur, max_ts FROM g ORDER BY track_id");
+  std::vector<std::vector<int64_t>> expected{{0, 4, 0 + 3 + 6 + 9, 900},
+                                             {1, 3, 1 + 4 + 7, 700},
+                                             {2, 3, 2 + 5 + 8, 800}};
+  for (const auto& row : expected) {
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ROW);
+    for (uint32_t i = 0; i < row.size(); ++i)
+      ASSERT_EQ(sqlite3_column_int64(stmt_.get(), static_cast<int>(i)), row[i]);
+  }
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+
+  // The grouped table can be filtered like any other table.
+  PrepareValidStatement("SELECT track_id FROM g WHERE sum_dur > 16");
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ROW);
+  ASSERT_EQ(sqlite3_column_int64(stmt_.get(), 0), 0);
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
+TEST_F(GroupByOperatorTableTest, GroupByString) {
+  RunStatement(
+      "CREATE VIRTUAL TABLE g "
+      "USING group_by(internal_slice, name, AVG(dur));");
+
+  PrepareValidStatement("SELECT name, avg_dur FROM g ORDER BY name");
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ROW);
+  ASSERT_STREQ(
+      reinterpret_cast<const char*>(sqlite3_column_text(stmt_.get(), 0)),
+      "even");
+  ASSERT_EQ(sqlite3_column_double(stmt_.get(), 1), 4.0);
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ROW);
+  ASSERT_EQ(sqlite3_column_double(stmt_.get(), 1), 5.0);
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
+TEST_F(GroupByOperatorTableTest, InvalidArgs) {
+  const char* invalid[] = {
+      "group_by(internal_slice)",
+      "group_by(unknown, track_id)",
+      "group_by(internal_slice, unknown)",
+      "group_by(internal_slice, id, COUNT(*))",
+      "group_by(internal_slice, MEDIAN(dur))",
+      "group_by(internal_slice, SUM(*))",
+      "group_by(internal_slice, SUM(name))",
+      "group_by(internal_slice, COUNT(*), track_id)",
+  };
+  for (const char* args : invalid) {
+    std::string sql = std::string("CREATE VIRTUAL TABLE g USING ") + args;
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret == SQLITE_OK)
+      ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    ASSERT_EQ(ret, SQLITE_ERROR) << args;
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
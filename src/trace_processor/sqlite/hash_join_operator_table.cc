@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/hash_join_operator_table.h"
+
+#include <set>
+
+#include "src/trace_processor/db/secondary_index.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// Returns the column |name| of |table| if it can be used as a join key.
+util::Status FindColumn(const std::string& table_name,
+                        const Table& table,
+                        const std::string& name,
+                        uint32_t* col_idx) {
+  const Column* col = table.GetColumnByName(name.c_str());
+  if (!col) {
+    return util::ErrStatus("HASH_JOIN: column %s not found in table %s",
+                           name.c_str(), table_name.c_str());
+  }
+  if (col->type() == SqlValue::Type::kBytes) {
+    return util::ErrStatus("HASH_JOIN: cannot join on column %s of table %s",
+                           name.c_str(), table_name.c_str());
+  }
+  *col_idx = col->index_in_table();
+  return util::OkStatus();
+}
+
+}  // namespace
+
+HashJoinOperatorTable::HashJoinOperatorTable(sqlite3* db,
+                                             const StaticTableMap* tables)
+    : DbSqliteTable(db,
+                    // The joined table is destroyed with this table so must
+                    // not be cached: its address could be reused by another
+                    // table.
+                    Context{nullptr, Table::Schema(), TableComputation::kStatic,
+                            nullptr, nullptr}),
+      tables_(tables) {}
+
+HashJoinOperatorTable::~HashJoinOperatorTable() = default;
+
+void HashJoinOperatorTable::RegisterTable(sqlite3* db,
+                                          const StaticTableMap* tables) {
+  SqliteTable::Register<HashJoinOperatorTable, const StaticTableMap*>(
+      db, tables, "hash_join", /* read_write */ false,
+      /* requires_args */ true);
+}
+
+util::Status HashJoinOperatorTable::Init(int argc,
+                                         const char* const* argv,
+                                         SqliteTable::Schema* schema) {
+  // argv[0] - argv[2] are SQLite populated fields which are always present.
+  if (argc != 7) {
+    return util::ErrStatus(
+        "HASH_JOIN: expected 4 args (left table, left column, right table, "
+        "right column)");
+  }
+  std::string names[] = {argv[3], argv[4], argv[5], argv[6]};
+  const std::string& left_name = names[0];
+  const std::string& right_name = names[2];
+
+  auto left_it = tables_->find(left_name);
+  if (left_it == tables_->end())
+    return util::ErrStatus("HASH_JOIN: unknown table %s", left_name.c_str());
+  auto right_it = tables_->find(right_name);
+  if (right_it == tables_->end())
+    return util::ErrStatus("HASH_JOIN: unknown table %s", right_name.c_str());
+  const Table& left = *left_it->second;
+  const Table& right = *right_it->second;
+
+  uint32_t left_col;
+  util::Status status = FindColumn(left_name, left, names[1], &left_col);
+  if (!status.ok())
+    return status;
+  uint32_t right_col;
+  status = FindColumn(right_name, right, names[3], &right_col);
+  if (!status.ok())
+    return status;
+
+  joined_.reset(
+      new Table(left.HashJoin(JoinKey{left_col}, right, JoinKey{right_col})));
+
+  // The columns of the joined table are its own id column followed by the
+  // non-id columns of the left table and then the ones of the right table.
+  Table::Schema joined_schema;
+  joined_schema.columns.emplace_back(Table::Schema::Column{
+      "id", SqlValue::Type::kLong, true /* is_id */, true /* is_sorted */,
+      false /* is_hidden */, false /* is_indexable */});
+  std::set<std::string> left_names{"id"};
+  uint32_t col_idx = 1;
+  for (const Table* table : {&left, &right}) {
+    for (uint32_t i = 0; i < table->GetColumnCount(); ++i) {
+      const trace_processor::Column& col = table->GetColumn(i);
+      if (col.IsId())
+        continue;
+
+      const trace_processor::Column& joined_col =
+          joined_->GetColumn(col_idx++);
+      std::string name = col.name();
+      if (table == &left) {
+        left_names.insert(name);
+      } else if (left_names.count(name)) {
+        name = right_name + "_" + name;
+      }
+      joined_schema.columns.emplace_back(Table::Schema::Column{
+          name, joined_col.type(), false /* is_id */, joined_col.IsSorted(),
+          joined_col.IsHidden(), SecondaryIndex::IsSupported(joined_col)});
+    }
+  }
+  PERFETTO_DCHECK(col_idx == joined_->GetColumnCount());
+
+  SetStaticTable(std::move(joined_schema), joined_.get());
+  return DbSqliteTable::Init(argc, argv, schema);
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_SQLITE_HASH_JOIN_OPERATOR_TABLE_H_
+#define SRC_TRACE_PROCESSOR_SQLITE_HASH_JOIN_OPERATOR_TABLE_H_
+
+#include <memory>
+#include <string>
+
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// Implements an inner equi-join between two tables of the trace processor
+// using Table::HashJoin.
+//
+// Joining two virtual tables in SQL is done by SQLite with a nested loop which
+// filters the inner table once for each row of the outer table. Instead, this
+// table builds a hash table from the second table and streams the first table
+// through it, computing the whole join in one pass.
+//
+// Usage:
+// CREATE VIRTUAL TABLE sched_thread
+// USING hash_join(sched_slice, utid, thread, utid);
+//
+// The joined table has an id column numbering its rows followed by the columns
+// of the first table and then the columns of the second one; the columns of
+// the second table whose name is already used by the first table are prefixed
+// by "<table name>_". The id columns of the two tables are not part of the
+// joined table. As the second table is used to build the hash table, it should
+// be the smaller of the two.
+//
+// The join is computed when the table is created so the joined table does not
+// reflect any later change to the two tables.
+class HashJoinOperatorTable : public DbSqliteTable {
+ public:
+  HashJoinOperatorTable(sqlite3*, const StaticTableMap* tables);
+  ~HashJoinOperatorTable() override;
+
+  static void RegisterTable(sqlite3* db, const StaticTableMap* tables);
+
+  // Table implementation.
+  util::Status Init(int,
+                    const char* const*,
+                    SqliteTable::Schema*) override;
+
+ private:
+  const StaticTableMap* tables_ = nullptr;
+  std::unique_ptr<Table> joined_;
+};
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_SQLITE_HASH_JOIN_OPERATOR_TABLE_H_
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/hash_join_operator_table.h"
+
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/slice_tables.h"
+#include "src/trace_processor/tables/track_tables.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class HashJoinOperatorTableTest : public ::testing::Test {
+ public:
+  HashJoinOperatorTableTest()
+      : slices_(&pool_, nullptr), tracks_(&pool_, nullptr) {
+    sqlite3* db = nullptr;
+    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
+    db_.reset(db);
+
+    for (uint32_t i = 0; i < 3; ++i) {
+      tables::TrackTable::Row track;
+      track.name = pool_.InternString(
+          base::StringView("track" + std::to_string(i)));
+      tracks_.Insert(track);
+    }
+    for (uint32_t i = 0; i < 5; ++i) {
+      tables::SliceTable::Row slice;
+      slice.ts = i * 100;
+      slice.dur = 10;
+      slice.track_id = tables::TrackTable::Id(i % 2 == 0 ? 2 : 0);
+      slice.name = pool_.InternString("slice");
+      slices_.Insert(slice);
+    }
+
+    tables_[slices_.table_name()] = &slices_;
+    tables_[tracks_.table_name()] = &tracks_;
+    HashJoinOperatorTable::RegisterTable(db_.get(), &tables_);
+  }
+
+  void PrepareValidStatement(const std::string& sql) {
+    int size = static_cast<int>(sql.size());
+    sqlite3_stmt* stmt;
+    ASSERT_EQ(sqlite3_prepare_v2(*db_, sql.c_str(), size, &stmt, nullptr),
+              SQLITE_OK);
+    stmt_.reset(stmt);
+  }
+
+  void RunStatement(const std::string& sql) {
+    PrepareValidStatement(sql);
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+  }
+
+ protected:
+  StringPool pool_;
+  tables::SliceTable slices_;
+  tables::TrackTable tracks_;
+  DbSqliteTable::StaticTableMap tables_;
+
+  ScopedDb db_;
+  ScopedStmt stmt_;
+};
+
+TEST_F(HashJoinOperatorTableTest, JoinOnId) {
+  RunStatement(
+      "CREATE VIRTUAL TABLE j "
+      "USING hash_join(internal_slice, track_id, track, id);");
+
+  // The name column of the tracks clashes with the one of the slices.
+  PrepareValidStatement(
+      "SELECT ts, track_id, track_name FROM j WHERE ts >= 100 ORDER BY ts");
+  std::vector<std::pair<int64_t, std::string>> expected{
+      {100, "track0"}, {200, "track2"}, {300, "track0"}, {400, "track2"}};
+  for (const auto& row : expected) {
+    ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_ROW);
+    ASSERT_EQ(sqlite3_column_int64(stmt_.get(), 0), row.first);
+    ASSERT_EQ(reinterpret_cast<const char*>(
+                  sqlite3_column_text(stmt_.get(), 2)),
+              row.second);
+  }
+  ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
+}
+
+TEST_F(HashJoinOperatorTableTest, InvalidArgs) {
+  const char* invalid[] = {
+      "hash_join(internal_slice, track_id, track)",
+      "hash_join(internal_slice, track_id, unknown, id)",
+      "hash_join(internal_slice, unknown, track, id)",
+  };
+  for (const char* args : invalid) {
+    std::string sql = std::string("CREATE VIRTUAL TABLE j USING ") + args;
+    sqlite3_stmt* stmt = nullptr;
+    int ret = sqlite3_prepare_v2(*db_, sql.c_str(), -1, &stmt, nullptr);
+    if (ret == SQLITE_OK)
+      ret = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    ASSERT_EQ(ret, SQLITE_ERROR) << args;
+  }
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
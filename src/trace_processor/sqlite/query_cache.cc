@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include <algorithm>
+
+#include "src/trace_processor/storage/trace_storage.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+// static
+constexpr uint64_t QueryCache::kDefaultMaxBytes;
+
+QueryCache::QueryCache(TraceStorage* storage, uint64_t max_bytes)
+    : storage_(storage), max_bytes_(max_bytes) {}
+
+QueryCache::~QueryCache() = default;
+
+std::shared_ptr<Table> QueryCache::GetIfCached(
+    const Table* source,
+    const std::vector<Constraint>& cs) {
+  auto p = [](const Constraint& a, const Constraint& b) {
+    return a.column == b.column && a.op == b.op;
+  };
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->source != source || it->constraints.size() != cs.size())
+      continue;
+    if (!std::equal(cs.begin(), cs.end(), it->constraints.begin(), p))
+      continue;
+
+    // Tables computed before the source changed would miss its new rows or
+    // be sorted on stale values: drop them rather than returning them.
+    if (it->source_row_count != source->row_count() ||
+        it->source_generations != Generations(source, cs)) {
+      bytes_used_ -= it->bytes;
+      entries_.erase(it);
+      break;
+    }
+
+    // Move the entry to the front to mark it as the most recently used.
+    entries_.splice(entries_.begin(), entries_, it);
+    hits_++;
+    if (storage_)
+      storage_->IncrementStats(stats::query_cache_hits);
+    return entries_.front().table;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<Table> QueryCache::GetOrCache(
+    const Table* source,
+    const std::vector<Constraint>& cs,
+    std::function<Table()> fn) {
+  std::shared_ptr<Table> cached = GetIfCached(source, cs);
+  if (cached)
+    return cached;
+
+  misses_++;
+  if (storage_)
+    storage_->IncrementStats(stats::query_cache_misses);
+
+  std::shared_ptr<Table> table(new Table(fn()));
+  uint64_t bytes = ApproxBytesUsed(*table);
+
+  // Tables which would not fit even in an empty cache are handed back to the
+  // caller without evicting everything else.
+  if (bytes > max_bytes_)
+    return table;
+
+  // Evicted tables stay alive as long as a cursor still references them.
+  while (bytes_used_ + bytes > max_bytes_) {
+    PERFETTO_DCHECK(!entries_.empty());
+    bytes_used_ -= entries_.back().bytes;
+    entries_.pop_back();
+    evictions_++;
+    if (storage_)
+      storage_->IncrementStats(stats::query_cache_evictions);
+  }
+
+  CachedTable entry;
+  entry.table = table;
+  entry.bytes = bytes;
+  entry.source = source;
+  entry.constraints = cs;
+  entry.source_row_count = source->row_count();
+  entry.source_generations = Generations(source, cs);
+  entries_.emplace_front(std::move(entry));
+  bytes_used_ += bytes;
+  return table;
+}
+
+// static
+std::vector<uint32_t> QueryCache::Generations(
+    const Table* source,
+    const std::vector<Constraint>& cs) {
+  std::vector<uint32_t> generations;
+  for (const Constraint& c : cs) {
+    uint32_t col = static_cast<uint32_t>(c.column);
+    generations.push_back(col < source->GetColumnCount()
+                              ? source->GetColumn(col).generation()
+                              : 0);
+  }
+  return generations;
+}
+
+// static
+uint64_t QueryCache::ApproxBytesUsed(const Table& table) {
+  // The columns of the table point to the storage of the source table so only
+  // the row maps are owned by the cached table.
+  uint64_t bytes = sizeof(Table);
+  for (const RowMap& rm : table.row_maps())
+    bytes += sizeof(RowMap) + rm.ApproxBytesUsed();
+  return bytes;
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
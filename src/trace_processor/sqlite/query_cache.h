@@ -17,7 +17,10 @@
 #ifndef SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 #define SRC_TRACE_PROCESSOR_SQLITE_QUERY_CACHE_H_
 
-#include "perfetto/ext/base/optional.h"
+#include <functional>
+#include <list>
+#include <memory>
+#include <vector>
 
 #include "src/trace_processor/db/table.h"
 #include "src/trace_processor/sqlite/query_constraints.h"
@@ -25,7 +28,12 @@
 namespace perfetto {
 namespace trace_processor {
 
+class TraceStorage;
+
 // Implements a simple caching strategy for commonly executed queries.
+// Up to |max_bytes| of tables are kept, evicting the least recently used ones
+// first: this allows queries interleaved by the UI (or the inner side of a
+// join) to hit the cache instead of evicting each other.
 // TODO(lalitm): the design of this class is very experimental. It was mainly
 // introduced to solve a specific problem (slow process summary tracks in the
 // Perfetto UI) and should not be modified without a full design discussion.
@@ -33,46 +41,64 @@ class QueryCache {
  public:
   using Constraint = QueryConstraints::Constraint;
 
+  static constexpr uint64_t kDefaultMaxBytes = 128 * 1024 * 1024;
+
+  // If |storage| is not null, the hit, miss and eviction counts are also
+  // reported in its stats.
+  explicit QueryCache(TraceStorage* storage = nullptr,
+                      uint64_t max_bytes = kDefaultMaxBytes);
+  ~QueryCache();
+
   // Returns a cached table if the passed query set are currenly cached or
   // nullptr otherwise.
   std::shared_ptr<Table> GetIfCached(const Table* source,
-                                     const std::vector<Constraint>& cs) const {
-    if (cached_.source != source || cs.size() != cached_.constraints.size())
-      return nullptr;
-
-    auto p = [](const Constraint& a, const Constraint& b) {
-      return a.column == b.column && a.op == b.op;
-    };
-    bool same_cs =
-        std::equal(cs.begin(), cs.end(), cached_.constraints.begin(), p);
-    return same_cs ? cached_.table : nullptr;
-  }
+                                     const std::vector<Constraint>& cs);
 
   // Caches the table with the given source, constraint and order set. Returns
   // a pointer to the newly cached table.
-  std::shared_ptr<Table> GetOrCache(
-      const Table* source,
-      const std::vector<QueryConstraints::Constraint>& cs,
-      std::function<Table()> fn) {
-    std::shared_ptr<Table> cached = GetIfCached(source, cs);
-    if (cached)
-      return cached;
-
-    cached_.source = source;
-    cached_.constraints = cs;
-    cached_.table.reset(new Table(fn()));
-    return cached_.table;
-  }
+  std::shared_ptr<Table> GetOrCache(const Table* source,
+                                    const std::vector<Constraint>& cs,
+                                    std::function<Table()> fn);
+
+  // Returns the approximate memory used by |table| which is accounted against
+  // the size of the cache.
+  static uint64_t ApproxBytesUsed(const Table& table);
+
+  uint32_t size() const { return static_cast<uint32_t>(entries_.size()); }
+  uint64_t bytes_used() const { return bytes_used_; }
+  uint64_t hits() const { return hits_; }
+  uint64_t misses() const { return misses_; }
+  uint64_t evictions() const { return evictions_; }
 
  private:
   struct CachedTable {
     std::shared_ptr<Table> table;
+    uint64_t bytes = 0;
 
     const Table* source = nullptr;
     std::vector<Constraint> constraints;
+
+    // The state of |source| when |table| was computed: the source table
+    // grows (and its columns can change) when a trace is imported
+    // incrementally, see TraceProcessorStorage::Flush().
+    uint32_t source_row_count = 0;
+    std::vector<uint32_t> source_generations;
   };
 
-  CachedTable cached_;
+  // Returns the generations of the columns of |source| referred to by |cs|.
+  static std::vector<uint32_t> Generations(const Table* source,
+                                           const std::vector<Constraint>& cs);
+
+  // Entries ordered from the most to the least recently used.
+  std::list<CachedTable> entries_;
+
+  TraceStorage* storage_ = nullptr;
+  uint64_t max_bytes_ = 0;
+  uint64_t bytes_used_ = 0;
+
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/sqlite/query_cache.h"
+
+#include "src/trace_processor/storage/trace_storage.h"
+#include "src/trace_processor/tables/slice_tables.h"
+
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using Constraint = QueryConstraints::Constraint;
+
+class QueryCacheTest : public ::testing::Test {
+ protected:
+  QueryCacheTest() : table_(&pool_, nullptr) {
+    for (int64_t i = 0; i < 1000; ++i) {
+      tables::SliceTable::Row row;
+      row.ts = i;
+      row.dur = i % 7;
+      table_.Insert(row);
+    }
+  }
+
+  std::vector<Constraint> Eq(int column) {
+    Constraint c{};
+    c.column = column;
+    c.op = SQLITE_INDEX_CONSTRAINT_EQ;
+    return {c};
+  }
+
+  Table SortByDur() {
+    uint32_t col = table_.GetColumnByName("dur")->index_in_table();
+    return table_.Sort({Order{col, false}});
+  }
+
+  std::function<Table()> SortFn() {
+    return [this]() { return SortByDur(); };
+  }
+
+  uint64_t SortedBytes() { return QueryCache::ApproxBytesUsed(SortByDur()); }
+
+  StringPool pool_;
+  tables::SliceTable table_;
+};
+
+TEST_F(QueryCacheTest, HitAndMiss) {
+  TraceStorage storage;
+  QueryCache cache(&storage);
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(1)), nullptr);
+
+  auto sorted = cache.GetOrCache(&table_, Eq(1), SortFn());
+  ASSERT_NE(sorted, nullptr);
+  ASSERT_EQ(sorted->row_count(), table_.row_count());
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(1)), sorted);
+  ASSERT_EQ(cache.GetOrCache(&table_, Eq(1), SortFn()), sorted);
+
+  // The source table and the constraints are both part of the key.
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(2)), nullptr);
+  ASSERT_EQ(cache.GetIfCached(nullptr, Eq(1)), nullptr);
+
+  ASSERT_EQ(cache.hits(), 2u);
+  ASSERT_EQ(cache.misses(), 1u);
+  ASSERT_EQ(storage.stats()[stats::query_cache_hits].value, 2);
+  ASSERT_EQ(storage.stats()[stats::query_cache_misses].value, 1);
+}
+
+TEST_F(QueryCacheTest, KeepsMultipleEntries) {
+  QueryCache cache;
+  auto by_ts = cache.GetOrCache(&table_, Eq(1), SortFn());
+  auto by_dur = cache.GetOrCache(&table_, Eq(2), SortFn());
+
+  // Interleaving the two queries should not evict either of them.
+  for (uint32_t i = 0; i < 3; ++i) {
+    ASSERT_EQ(cache.GetIfCached(&table_, Eq(1)), by_ts);
+    ASSERT_EQ(cache.GetIfCached(&table_, Eq(2)), by_dur);
+  }
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_EQ(cache.evictions(), 0u);
+}
+
+TEST_F(QueryCacheTest, EvictsLeastRecentlyUsed) {
+  // Only leave space for two sorted tables.
+  TraceStorage storage;
+  QueryCache cache(&storage, SortedBytes() * 2);
+  cache.GetOrCache(&table_, Eq(1), SortFn());
+  cache.GetOrCache(&table_, Eq(2), SortFn());
+
+  // Touch the first entry so the second is the least recently used one.
+  ASSERT_NE(cache.GetIfCached(&table_, Eq(1)), nullptr);
+  auto evicted = cache.GetIfCached(&table_, Eq(2));
+  ASSERT_NE(cache.GetIfCached(&table_, Eq(1)), nullptr);
+
+  cache.GetOrCache(&table_, Eq(3), SortFn());
+  ASSERT_EQ(cache.size(), 2u);
+  ASSERT_LE(cache.bytes_used(), SortedBytes() * 2);
+  ASSERT_NE(cache.GetIfCached(&table_, Eq(1)), nullptr);
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(2)), nullptr);
+  ASSERT_NE(cache.GetIfCached(&table_, Eq(3)), nullptr);
+  ASSERT_EQ(cache.evictions(), 1u);
+  ASSERT_EQ(storage.stats()[stats::query_cache_evictions].value, 1);
+
+  // Tables still referenced outside the cache stay valid after eviction.
+  ASSERT_EQ(evicted->row_count(), table_.row_count());
+}
+
+TEST_F(QueryCacheTest, DropsStaleEntries) {
+  TraceStorage storage;
+  QueryCache cache(&storage);
+  int dur = static_cast<int>(table_.GetColumnByName("dur")->index_in_table());
+  auto sorted = cache.GetOrCache(&table_, Eq(dur), SortFn());
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(dur)), sorted);
+
+  // New rows, e.g. from an incremental import of the trace.
+  tables::SliceTable::Row row;
+  row.ts = 1000;
+  table_.Insert(row);
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(dur)), nullptr);
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.bytes_used(), 0u);
+
+  auto resorted = cache.GetOrCache(&table_, Eq(dur), SortFn());
+  ASSERT_EQ(resorted->row_count(), table_.row_count());
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(dur)), resorted);
+
+  // Changes to the constrained column also invalidate the entry, while
+  // changes to other columns don't.
+  table_.mutable_ts()->Set(0, 2000);
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(dur)), resorted);
+  table_.mutable_dur()->Set(0, 100);
+  ASSERT_EQ(cache.GetIfCached(&table_, Eq(dur)), nullptr);
+
+  // The original tables are still valid for the cursors using them.
+  ASSERT_EQ(sorted->row_count(), table_.row_count() - 1);
+}
+
+TEST_F(QueryCacheTest, TableLargerThanCache) {
+  QueryCache cache(nullptr, SortedBytes() - 1);
+  auto sorted = cache.GetOrCache(&table_, Eq(1), SortFn());
+  ASSERT_EQ(sorted->row_count(), table_.row_count());
+  ASSERT_EQ(cache.size(), 0u);
+  ASSERT_EQ(cache.bytes_used(), 0u);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -21,6 +21,7 @@
 
 #include <algorithm>
 #include <set>
+#include <unordered_map>
 #include <utility>
 
 #include "perfetto/base/logging.h"
@@ -55,22 +56,26 @@ base::Optional<std::string> HasDuplicateColumns(
 
 }  // namespace
 
-SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, const TraceStorage*)
-    : db_(db) {}
-
-void SpanJoinOperatorTable::RegisterTable(sqlite3* db,
-                                          const TraceStorage* storage) {
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_join",
-                                               /* read_write */ false,
-                                               /* requires_args */ true);
-
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_left_join",
-                                               /* read_write */ false,
-                                               /* requires_args */ true);
-
-  SqliteTable::Register<SpanJoinOperatorTable>(db, storage, "span_outer_join",
-                                               /* read_write */ false,
-                                               /* requires_args */ true);
+SpanJoinOperatorTable::SpanJoinOperatorTable(sqlite3* db, Context context)
+    : db_(db),
+      overlapping_tables_(context.overlapping_tables),
+      partition_pool_(context.partition_pool) {}
+
+void SpanJoinOperatorTable::RegisterTable(sqlite3* db, Context context) {
+  SqliteTable::Register<SpanJoinOperatorTable, Context>(
+      db, context, "span_join",
+      /* read_write */ false,
+      /* requires_args */ true);
+
+  SqliteTable::Register<SpanJoinOperatorTable, Context>(
+      db, context, "span_left_join",
+      /* read_write */ false,
+      /* requires_args */ true);
+
+  SqliteTable::Register<SpanJoinOperatorTable, Context>(
+      db, context, "span_outer_join",
+      /* read_write */ false,
+      /* requires_args */ true);
 }
 
 util::Status SpanJoinOperatorTable::Init(int argc,
@@ -252,6 +257,57 @@ SpanJoinOperatorTable::ComputeSqlConstraintsForDefinition(
   return constraints;
 }
 
+std::string SpanJoinOperatorTable::ComputeSqlSourceForDefinition(
+    const TableDefinition& defn,
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  // The rows of a table which emits shadows also define where its shadows
+  // are so all the rows need to be read.
+  if (!overlapping_tables_ || defn.ShouldEmitPresentPartitionShadow() ||
+      defn.ShouldEmitMissingPartitionShadow()) {
+    return defn.name();
+  }
+  auto it = overlapping_tables_->find(defn.name());
+  if (it == overlapping_tables_->end())
+    return defn.name();
+
+  // Compute the range [start, end) which the ts of all the returned spans are
+  // constrained to.
+  constexpr int64_t kMin = std::numeric_limits<int64_t>::min();
+  constexpr int64_t kMax = std::numeric_limits<int64_t>::max();
+  int64_t start = kMin;
+  int64_t end = kMax;
+  for (size_t i = 0; i < qc.constraints().size(); i++) {
+    const auto& cs = qc.constraints()[i];
+    if (static_cast<size_t>(cs.column) != Column::kTimestamp ||
+        sqlite3_value_type(argv[i]) != SQLITE_INTEGER) {
+      continue;
+    }
+    int64_t value = sqlite3_value_int64(argv[i]);
+    int64_t next = value == kMax ? kMax : value + 1;
+    if (sqlite_utils::IsOpEq(cs.op)) {
+      start = std::max(start, value);
+      end = std::min(end, next);
+    } else if (sqlite_utils::IsOpGe(cs.op)) {
+      start = std::max(start, value);
+    } else if (sqlite_utils::IsOpGt(cs.op)) {
+      start = std::max(start, next);
+    } else if (sqlite_utils::IsOpLe(cs.op)) {
+      end = std::min(end, next);
+    } else if (sqlite_utils::IsOpLt(cs.op)) {
+      end = std::min(end, value);
+    }
+  }
+  if (start == kMin && end == kMax)
+    return defn.name();
+
+  // A returned span is the intersection of a span of each table so both of
+  // these also have to overlap the range. As this table doesn't emit shadows,
+  // its other spans can be skipped without changing the returned spans.
+  return it->second + "(" + std::to_string(start) + ", " +
+         std::to_string(end) + ")";
+}
+
 util::Status SpanJoinOperatorTable::CreateTableDefinition(
     const TableDescriptor& desc,
     EmitShadowType emit_shadow_type,
@@ -335,6 +391,15 @@ int SpanJoinOperatorTable::Cursor::Filter(const QueryConstraints& qc,
                                           FilterHistory) {
   PERFETTO_TP_TRACE("SPAN_JOIN_XFILTER");
 
+  // Partitions are only independent if both tables are partitioned.
+  is_materialized_ =
+      table_->partition_pool_ &&
+      table_->partitioning_ == PartitioningType::kSamePartitioning;
+  if (is_materialized_) {
+    util::Status status = JoinPartitionsInParallel(qc, argv);
+    return status.ok() ? SQLITE_OK : SQLITE_ERROR;
+  }
+
   util::Status status = t1_.Initialize(qc, argv);
   if (!status.ok())
     return SQLITE_ERROR;
@@ -348,6 +413,11 @@ int SpanJoinOperatorTable::Cursor::Filter(const QueryConstraints& qc,
 }
 
 int SpanJoinOperatorTable::Cursor::Next() {
+  if (is_materialized_) {
+    joined_row_idx_++;
+    return SQLITE_OK;
+  }
+
   util::Status status = next_query_->Next();
   if (!status.ok())
     return SQLITE_ERROR;
@@ -472,11 +542,185 @@ SpanJoinOperatorTable::Cursor::FindEarliestFinishQuery() {
   return t1_less ? &t1_ : &t2_;
 }
 
+util::Status SpanJoinOperatorTable::Cursor::JoinPartitionsInParallel(
+    const QueryConstraints& qc,
+    sqlite3_value** argv) {
+  // SQLite can only be used from this thread so read both tables first.
+  t1_rows_.reset(new MaterializedTable());
+  util::Status status = t1_.Materialize(qc, argv, t1_rows_.get());
+  if (!status.ok())
+    return status;
+
+  t2_rows_.reset(new MaterializedTable());
+  status = t2_.Materialize(qc, argv, t2_rows_.get());
+  if (!status.ok())
+    return status;
+
+  // Pair up the partitions of the two tables. Partitions present in only one
+  // of them still need to be joined as they can overlap with shadows.
+  using Partition = MaterializedTable::Partition;
+  std::vector<std::pair<Partition*, Partition*>> tasks;
+  auto t1_it = t1_rows_->partitions.begin();
+  auto t2_it = t2_rows_->partitions.begin();
+  while (t1_it != t1_rows_->partitions.end() ||
+         t2_it != t2_rows_->partitions.end()) {
+    if (t2_it == t2_rows_->partitions.end() ||
+        (t1_it != t1_rows_->partitions.end() &&
+         t1_it->partition < t2_it->partition)) {
+      tasks.emplace_back(&*t1_it++, nullptr);
+    } else if (t1_it == t1_rows_->partitions.end() ||
+               t2_it->partition < t1_it->partition) {
+      tasks.emplace_back(nullptr, &*t2_it++);
+    } else {
+      tasks.emplace_back(&*t1_it++, &*t2_it++);
+    }
+  }
+
+  std::vector<std::vector<JoinedRow>> results(tasks.size());
+  std::vector<util::Status> statuses(tasks.size());
+  {
+    PERFETTO_TP_TRACE("SPAN_JOIN_PARTITIONS");
+    table_->partition_pool_->ParallelFor(tasks.size(), [&](size_t i) {
+      statuses[i] = JoinPartition(tasks[i].first, tasks[i].second, &results[i]);
+    });
+  }
+
+  // As the partitions are in increasing order, concatenating their results
+  // keeps the rows in the same order as when joining them one by one.
+  size_t size = 0;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    if (!statuses[i].ok())
+      return statuses[i];
+    size += results[i].size();
+  }
+  joined_rows_.clear();
+  joined_rows_.reserve(size);
+  for (const std::vector<JoinedRow>& result : results)
+    joined_rows_.insert(joined_rows_.end(), result.begin(), result.end());
+  joined_row_idx_ = 0;
+  return util::OkStatus();
+}
+
+util::Status SpanJoinOperatorTable::Cursor::JoinPartition(
+    MaterializedTable::Partition* t1_partition,
+    MaterializedTable::Partition* t2_partition,
+    std::vector<JoinedRow>* out) const {
+  PERFETTO_DCHECK(t1_partition || t2_partition);
+  int64_t partition =
+      t1_partition ? t1_partition->partition : t2_partition->partition;
+
+  // The partitions are only read by this task so can be sorted in place.
+  MaterializedTable::Partition t1_empty{partition, {}};
+  MaterializedTable::Partition t2_empty{partition, {}};
+  const MaterializedTable* t1_rows = t1_rows_.get();
+  const MaterializedTable* t2_rows = t2_rows_.get();
+  auto sort_by_ts = [](const MaterializedTable* rows,
+                       MaterializedTable::Partition* p) {
+    std::stable_sort(p->rows.begin(), p->rows.end(),
+                     [rows](uint32_t a, uint32_t b) {
+                       return rows->ts[a] < rows->ts[b];
+                     });
+  };
+  if (t1_partition) {
+    sort_by_ts(t1_rows, t1_partition);
+  } else {
+    t1_partition = &t1_empty;
+  }
+  if (t2_partition) {
+    sort_by_ts(t2_rows, t2_partition);
+  } else {
+    t2_partition = &t2_empty;
+  }
+
+  // Run the same join as for a single partition on a separate cursor.
+  Cursor cursor(table_, table_->db_);
+  util::Status status =
+      cursor.t1_.InitializeFromPartition(t1_rows, t1_partition);
+  if (!status.ok())
+    return status;
+  status = cursor.t2_.InitializeFromPartition(t2_rows, t2_partition);
+  if (!status.ok())
+    return status;
+
+  status = cursor.FindOverlappingSpan();
+  while (status.ok() && !cursor.Eof()) {
+    const Query& t1 = cursor.t1_;
+    const Query& t2 = cursor.t2_;
+    JoinedRow row;
+    row.ts = std::max(t1.ts(), t2.ts());
+    row.dur = std::min(t1.raw_ts_end(), t2.raw_ts_end()) - row.ts;
+    row.partition = t1.IsReal() ? t1.partition() : t2.partition();
+    row.t1_row = t1.IsReal() ? t1.materialized_row() : JoinedRow::kNoRow;
+    row.t2_row = t2.IsReal() ? t2.materialized_row() : JoinedRow::kNoRow;
+    out->push_back(row);
+
+    status = cursor.next_query_->Next();
+    if (status.ok())
+      status = cursor.FindOverlappingSpan();
+  }
+  return status;
+}
+
 int SpanJoinOperatorTable::Cursor::Eof() {
+  if (is_materialized_)
+    return joined_row_idx_ >= joined_rows_.size();
   return t1_.IsEof() || t2_.IsEof();
 }
 
+void SpanJoinOperatorTable::Cursor::ReportMaterializedResult(
+    sqlite3_context* context,
+    int N) {
+  const JoinedRow& row = joined_rows_[joined_row_idx_];
+  switch (N) {
+    case Column::kTimestamp:
+      sqlite3_result_int64(context, static_cast<sqlite3_int64>(row.ts));
+      return;
+    case Column::kDuration:
+      sqlite3_result_int64(context, static_cast<sqlite3_int64>(row.dur));
+      return;
+    case Column::kPartition:
+      sqlite3_result_int64(context, static_cast<sqlite3_int64>(row.partition));
+      return;
+  }
+
+  const auto& locator =
+      table_->global_index_to_column_locator_[static_cast<size_t>(N)];
+  bool is_t1 = locator.defn == t1_.definition();
+  const MaterializedTable* rows = is_t1 ? t1_rows_.get() : t2_rows_.get();
+  uint32_t row_idx = is_t1 ? row.t1_row : row.t2_row;
+  if (row_idx == JoinedRow::kNoRow) {
+    sqlite3_result_null(context);
+    return;
+  }
+  const SqlValue& value =
+      rows->values[row_idx * rows->num_columns + locator.col_index];
+  switch (value.type) {
+    case SqlValue::Type::kLong:
+      sqlite3_result_int64(context, value.long_value);
+      break;
+    case SqlValue::Type::kDouble:
+      sqlite3_result_double(context, value.double_value);
+      break;
+    case SqlValue::Type::kString:
+      // The materialized rows are only freed by the next call to Filter (or
+      // by destroying this cursor) at which point SQLite no longer uses the
+      // string.
+      sqlite3_result_text(context, value.string_value, -1,
+                          sqlite_utils::kSqliteStatic);
+      break;
+    case SqlValue::Type::kNull:
+    case SqlValue::Type::kBytes:
+      sqlite3_result_null(context);
+      break;
+  }
+}
+
 int SpanJoinOperatorTable::Cursor::Column(sqlite3_context* context, int N) {
+  if (is_materialized_) {
+    ReportMaterializedResult(context, N);
+    return SQLITE_OK;
+  }
+
   PERFETTO_DCHECK(t1_.IsReal() || t2_.IsReal());
 
   switch (N) {
@@ -532,10 +776,100 @@ util::Status SpanJoinOperatorTable::Query::Initialize(
     sqlite3_value** argv) {
   *this = Query(table_, definition(), db_);
   sql_query_ = CreateSqlQuery(
-      table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv));
+      table_->ComputeSqlSourceForDefinition(*defn_, qc, argv),
+      table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv),
+      true /* sorted */);
+  return Rewind();
+}
+
+util::Status SpanJoinOperatorTable::Query::InitializeFromPartition(
+    const MaterializedTable* rows,
+    const MaterializedTable::Partition* partition) {
+  *this = Query(table_, definition(), db_);
+  materialized_rows_ = rows;
+  materialized_partition_ = partition;
   return Rewind();
 }
 
+util::Status SpanJoinOperatorTable::Query::Materialize(
+    const QueryConstraints& qc,
+    sqlite3_value** argv,
+    MaterializedTable* rows) {
+  PERFETTO_DCHECK(defn_->IsPartitioned());
+
+  // The rows are grouped by partition and sorted by ts here rather than by
+  // SQLite as this can be done for each partition in parallel.
+  std::string sql = CreateSqlQuery(
+      table_->ComputeSqlSourceForDefinition(*defn_, qc, argv),
+      table_->ComputeSqlConstraintsForDefinition(*defn_, qc, argv),
+      false /* sorted */);
+  sqlite3_stmt* raw_stmt = nullptr;
+  int res = sqlite3_prepare_v2(db_, sql.c_str(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  ScopedStmt stmt(raw_stmt);
+  if (res != SQLITE_OK)
+    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+
+  rows->num_columns = static_cast<uint32_t>(defn_->columns().size());
+  rows->strings.reset(new StringPool());
+
+  auto ts_idx = static_cast<int>(defn_->ts_idx());
+  auto dur_idx = static_cast<int>(defn_->dur_idx());
+  auto partition_idx = static_cast<int>(defn_->partition_idx());
+  auto num_columns = static_cast<int>(rows->num_columns);
+  std::unordered_map<int64_t, std::vector<uint32_t>> partitions;
+  while ((res = sqlite3_step(*stmt)) == SQLITE_ROW) {
+    // Rows with null partition keys are skipped as in |CursorNext()|.
+    if (sqlite3_column_type(*stmt, partition_idx) == SQLITE_NULL)
+      continue;
+
+    auto row = static_cast<uint32_t>(rows->ts.size());
+    rows->ts.push_back(sqlite3_column_int64(*stmt, ts_idx));
+    rows->dur.push_back(sqlite3_column_int64(*stmt, dur_idx));
+    partitions[sqlite3_column_int64(*stmt, partition_idx)].push_back(row);
+
+    for (int i = 0; i < num_columns; ++i) {
+      switch (sqlite3_column_type(*stmt, i)) {
+        case SQLITE_INTEGER:
+          rows->values.push_back(
+              SqlValue::Long(sqlite3_column_int64(*stmt, i)));
+          break;
+        case SQLITE_FLOAT:
+          rows->values.push_back(
+              SqlValue::Double(sqlite3_column_double(*stmt, i)));
+          break;
+        case SQLITE_TEXT: {
+          auto ptr =
+              reinterpret_cast<const char*>(sqlite3_column_text(*stmt, i));
+          StringPool::Id id = rows->strings->InternString(base::StringView(
+              ptr, static_cast<size_t>(sqlite3_column_bytes(*stmt, i))));
+          rows->values.push_back(
+              SqlValue::String(rows->strings->Get(id).c_str()));
+          break;
+        }
+        default:
+          // Like in |ReportSqliteResult()|, blobs are reported as null.
+          rows->values.push_back(SqlValue());
+          break;
+      }
+    }
+  }
+  if (res != SQLITE_DONE)
+    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+
+  rows->partitions.reserve(partitions.size());
+  for (auto& it : partitions) {
+    rows->partitions.emplace_back(
+        MaterializedTable::Partition{it.first, std::move(it.second)});
+  }
+  std::sort(rows->partitions.begin(), rows->partitions.end(),
+            [](const MaterializedTable::Partition& a,
+               const MaterializedTable::Partition& b) {
+              return a.partition < b.partition;
+            });
+  return util::OkStatus();
+}
+
 util::Status SpanJoinOperatorTable::Query::Next() {
   util::Status status = NextSliceState();
   if (!status.ok())
@@ -654,19 +988,24 @@ util::Status SpanJoinOperatorTable::Query::NextSliceState() {
 }
 
 util::Status SpanJoinOperatorTable::Query::Rewind() {
-  sqlite3_stmt* stmt = nullptr;
-  int res =
-      sqlite3_prepare_v2(db_, sql_query_.c_str(),
-                         static_cast<int>(sql_query_.size()), &stmt, nullptr);
-  stmt_.reset(stmt);
+  if (materialized_rows_) {
+    materialized_pos_ = 0;
+    cursor_eof_ = materialized_partition_->rows.empty();
+  } else {
+    sqlite3_stmt* stmt = nullptr;
+    int res =
+        sqlite3_prepare_v2(db_, sql_query_.c_str(),
+                           static_cast<int>(sql_query_.size()), &stmt, nullptr);
+    stmt_.reset(stmt);
 
-  cursor_eof_ = res != SQLITE_OK;
-  if (res != SQLITE_OK)
-    return util::ErrStatus("%s", sqlite3_errmsg(db_));
+    cursor_eof_ = res != SQLITE_OK;
+    if (res != SQLITE_OK)
+      return util::ErrStatus("%s", sqlite3_errmsg(db_));
 
-  util::Status status = CursorNext();
-  if (!status.ok())
-    return status;
+    util::Status status = CursorNext();
+    if (!status.ok())
+      return status;
+  }
 
   // Setup the first slice as a missing partition shadow from the lowest
   // partition until the first slice partition. We will handle finding the real
@@ -689,6 +1028,11 @@ util::Status SpanJoinOperatorTable::Query::Rewind() {
 }
 
 util::Status SpanJoinOperatorTable::Query::CursorNext() {
+  if (materialized_rows_) {
+    cursor_eof_ = ++materialized_pos_ >= materialized_partition_->rows.size();
+    return util::OkStatus();
+  }
+
   auto* stmt = stmt_.get();
   int res;
   if (defn_->IsPartitioned()) {
@@ -709,21 +1053,25 @@ util::Status SpanJoinOperatorTable::Query::CursorNext() {
 }
 
 std::string SpanJoinOperatorTable::Query::CreateSqlQuery(
-    const std::vector<std::string>& cs) const {
+    const std::string& source,
+    const std::vector<std::string>& cs,
+    bool sorted) const {
   std::vector<std::string> col_names;
   for (const SqliteTable::Column& c : defn_->columns()) {
     col_names.push_back("`" + c.name() + "`");
   }
 
   std::string sql = "SELECT " + base::Join(col_names, ", ");
-  sql += " FROM " + defn_->name();
+  sql += " FROM " + source;
   if (!cs.empty()) {
     sql += " WHERE " + base::Join(cs, " AND ");
   }
-  sql += " ORDER BY ";
-  sql += defn_->IsPartitioned()
-             ? base::Join({"`" + defn_->partition_col() + "`", "ts"}, ", ")
-             : "ts";
+  if (sorted) {
+    sql += " ORDER BY ";
+    sql += defn_->IsPartitioned()
+               ? base::Join({"`" + defn_->partition_col() + "`", "ts"}, ", ")
+               : "ts";
+  }
   sql += ";";
   PERFETTO_DLOG("%s", sql.c_str());
   return sql;
@@ -28,8 +28,10 @@
 #include <unordered_map>
 #include <vector>
 
+#include "perfetto/ext/base/thread_pool.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/containers/string_pool.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
 #include "src/trace_processor/sqlite/sqlite_table.h"
 
@@ -132,6 +134,42 @@ class SpanJoinOperatorTable : public SqliteTable {
     uint32_t partition_idx_ = std::numeric_limits<uint32_t>::max();
   };
 
+  // The rows of a partitioned child table read into memory so that its
+  // partitions can be joined on threads which don't have access to SQLite.
+  struct MaterializedTable {
+    // The rows of a single partition; these are sorted by ts right before the
+    // partition is joined.
+    struct Partition {
+      int64_t partition;
+      std::vector<uint32_t> rows;
+    };
+
+    std::vector<int64_t> ts;
+    std::vector<int64_t> dur;
+
+    // The value of the column |col| of the row |row| is at index
+    // |row * num_columns + col|. Strings are interned in |strings|.
+    std::vector<SqlValue> values;
+    uint32_t num_columns = 0;
+    std::unique_ptr<StringPool> strings;
+
+    // Sorted by partition.
+    std::vector<Partition> partitions;
+  };
+
+  // A row of the result of a join computed from materialized tables: the
+  // other columns are read from the row of each table (if the span of that
+  // table is real rather than a shadow).
+  struct JoinedRow {
+    static constexpr uint32_t kNoRow = std::numeric_limits<uint32_t>::max();
+
+    int64_t ts;
+    int64_t dur;
+    int64_t partition;
+    uint32_t t1_row;
+    uint32_t t2_row;
+  };
+
   // Stores information about a single subquery into one of the two child
   // tables.
   //
@@ -166,6 +204,19 @@ class SpanJoinOperatorTable : public SqliteTable {
     // Initializes the query with the given constraints and query parameters.
     util::Status Initialize(const QueryConstraints& qc, sqlite3_value** argv);
 
+    // Initializes the query to read the rows of |partition| (which can be
+    // empty) from |rows| rather than from SQLite. |partition| needs to be
+    // sorted by ts.
+    util::Status InitializeFromPartition(
+        const MaterializedTable* rows,
+        const MaterializedTable::Partition* partition);
+
+    // Reads all the rows matching the given constraints and query parameters
+    // into |rows|, grouped by partition.
+    util::Status Materialize(const QueryConstraints& qc,
+                             sqlite3_value** argv,
+                             MaterializedTable* rows);
+
     // Forwards the query to the next valid slice.
     util::Status Next();
 
@@ -224,6 +275,13 @@ class SpanJoinOperatorTable : public SqliteTable {
       return ts_end_;
     }
 
+    // Returns the index of the current real slice in the materialized table
+    // this query reads from.
+    uint32_t materialized_row() const {
+      PERFETTO_DCHECK(IsReal() && materialized_rows_);
+      return materialized_partition_->rows[materialized_pos_];
+    }
+
     const TableDefinition* definition() const { return defn_; }
 
    private:
@@ -242,8 +300,11 @@ class SpanJoinOperatorTable : public SqliteTable {
     // Forwards the cursor to point to the next real slice.
     util::Status CursorNext();
 
-    // Creates an SQL query from the given set of constraint strings.
-    std::string CreateSqlQuery(const std::vector<std::string>& cs) const;
+    // Creates an SQL query reading the rows of |source| from the given set of
+    // constraint strings, sorted by partition and ts if |sorted| is true.
+    std::string CreateSqlQuery(const std::string& source,
+                               const std::vector<std::string>& cs,
+                               bool sorted) const;
 
     // Returns whether the current slice pointed to is a present partition
     // shadow.
@@ -267,12 +328,16 @@ class SpanJoinOperatorTable : public SqliteTable {
 
     int64_t CursorTs() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (materialized_rows_)
+        return materialized_rows_->ts[CursorMaterializedRow()];
       auto ts_idx = static_cast<int>(defn_->ts_idx());
       return sqlite3_column_int64(stmt_.get(), ts_idx);
     }
 
     int64_t CursorDur() const {
       PERFETTO_DCHECK(!cursor_eof_);
+      if (materialized_rows_)
+        return materialized_rows_->dur[CursorMaterializedRow()];
       auto dur_idx = static_cast<int>(defn_->dur_idx());
       return sqlite3_column_int64(stmt_.get(), dur_idx);
     }
@@ -280,10 +345,16 @@ class SpanJoinOperatorTable : public SqliteTable {
     int64_t CursorPartition() const {
       PERFETTO_DCHECK(!cursor_eof_);
       PERFETTO_DCHECK(defn_->IsPartitioned());
+      if (materialized_rows_)
+        return materialized_partition_->partition;
       auto partition_idx = static_cast<int>(defn_->partition_idx());
       return sqlite3_column_int64(stmt_.get(), partition_idx);
     }
 
+    uint32_t CursorMaterializedRow() const {
+      return materialized_partition_->rows[materialized_pos_];
+    }
+
     State state_ = State::kMissingPartitionShadow;
     bool cursor_eof_ = false;
 
@@ -301,6 +372,13 @@ class SpanJoinOperatorTable : public SqliteTable {
     std::string sql_query_;
     ScopedStmt stmt_;
 
+    // Only set when reading the rows of a partition of a materialized table,
+    // in which case |materialized_pos_| is the index of the cursor row in
+    // |materialized_partition_->rows|.
+    const MaterializedTable* materialized_rows_ = nullptr;
+    const MaterializedTable::Partition* materialized_partition_ = nullptr;
+    size_t materialized_pos_ = 0;
+
     const TableDefinition* defn_ = nullptr;
     sqlite3* db_ = nullptr;
     SpanJoinOperatorTable* table_ = nullptr;
@@ -332,6 +410,20 @@ class SpanJoinOperatorTable : public SqliteTable {
 
     Query* FindEarliestFinishQuery();
 
+    // Reads the rows of both tables and joins their partitions in parallel
+    // on the partition pool, storing the result in |joined_rows_|.
+    util::Status JoinPartitionsInParallel(const QueryConstraints& qc,
+                                          sqlite3_value** argv);
+
+    // Appends the result of the join of a partition of each table to |out|;
+    // either partition can be null if the partition is missing in its table.
+    // Only accesses materialized rows so can be called from any thread.
+    util::Status JoinPartition(MaterializedTable::Partition* t1_partition,
+                               MaterializedTable::Partition* t2_partition,
+                               std::vector<JoinedRow>* out) const;
+
+    void ReportMaterializedResult(sqlite3_context* context, int N);
+
     Query t1_;
     Query t2_;
 
@@ -340,12 +432,38 @@ class SpanJoinOperatorTable : public SqliteTable {
     // Only valid for kMixedPartition.
     int64_t last_mixed_partition_ = std::numeric_limits<int64_t>::min();
 
+    // Only used when the partitions are joined in parallel, in which case
+    // the rows are returned from |joined_rows_| rather than from |t1_| and
+    // |t2_|.
+    bool is_materialized_ = false;
+    std::unique_ptr<MaterializedTable> t1_rows_;
+    std::unique_ptr<MaterializedTable> t2_rows_;
+    std::vector<JoinedRow> joined_rows_;
+    size_t joined_row_idx_ = 0;
+
     SpanJoinOperatorTable* table_;
   };
 
-  SpanJoinOperatorTable(sqlite3*, const TraceStorage*);
+  // Maps the names of tables to the name of a table function returning their
+  // rows overlapping a range of timestamps using an interval index (see
+  // ExperimentalOverlappingGenerator).
+  using OverlappingTableMap = std::map<std::string, std::string>;
+
+  // The state shared by all the span join tables of a database.
+  struct Context {
+    // Can be null.
+    const OverlappingTableMap* overlapping_tables = nullptr;
+
+    // If set, joins of two tables partitioned by the same column read both
+    // tables into memory and join their partitions in parallel on this pool,
+    // rather than streaming through both tables one partition at a time. The
+    // result is materialized before being returned, in the same order.
+    base::ThreadPool* partition_pool = nullptr;
+  };
 
-  static void RegisterTable(sqlite3* db, const TraceStorage* storage);
+  SpanJoinOperatorTable(sqlite3*, Context);
+
+  static void RegisterTable(sqlite3* db, Context context);
 
   // Table implementation.
   util::Status Init(int, const char* const*, SqliteTable::Schema*) override;
@@ -408,6 +526,11 @@ class SpanJoinOperatorTable : public SqliteTable {
       const QueryConstraints& qc,
       sqlite3_value** argv);
 
+  // Returns the table (or table function) to read the rows of |defn| from.
+  std::string ComputeSqlSourceForDefinition(const TableDefinition& defn,
+                                            const QueryConstraints& qc,
+                                            sqlite3_value** argv);
+
   std::string GetNameForGlobalColumnIndex(const TableDefinition& defn,
                                           int global_column);
 
@@ -420,6 +543,8 @@ class SpanJoinOperatorTable : public SqliteTable {
   std::unordered_map<size_t, ColumnLocator> global_index_to_column_locator_;
 
   sqlite3* const db_;
+  const OverlappingTableMap* const overlapping_tables_;
+  base::ThreadPool* const partition_pool_;
 };
 
 }  // namespace trace_processor
@@ -0,0 +1,137 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <sqlite3.h>
+
+#include "perfetto/ext/base/thread_pool.h"
+#include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/sqlite/span_join_operator_table.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+using benchmark::Counter;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void ExecOrDie(sqlite3* db, const std::string& sql) {
+  PERFETTO_CHECK(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) ==
+                 SQLITE_OK);
+}
+
+// Fills |table| with |size| spans spread over |num_partitions| threads: the
+// spans of a thread don't overlap each other, like thread states or slices
+// at a given depth. The rows are inserted in timestamp order, so SQLite needs
+// to sort them by partition for the join.
+void FillSpans(sqlite3* db,
+               const std::string& table,
+               uint32_t size,
+               uint32_t num_partitions,
+               uint32_t seed) {
+  ExecOrDie(db, "CREATE TABLE " + table +
+                    "(ts BIG INT, dur BIG INT, utid INT, " + table +
+                    "_value INT)");
+  std::minstd_rand0 rnd_engine(seed);
+  sqlite3_stmt* raw_stmt = nullptr;
+  std::string insert = "INSERT INTO " + table + " VALUES(?, ?, ?, ?)";
+  PERFETTO_CHECK(sqlite3_prepare_v2(db, insert.c_str(), -1, &raw_stmt,
+                                    nullptr) == SQLITE_OK);
+  ScopedStmt stmt(raw_stmt);
+  ExecOrDie(db, "BEGIN");
+  for (uint32_t i = 0; i < size; ++i) {
+    uint32_t partition = i % num_partitions;
+    int64_t ts = (i / num_partitions) * 1000 + rnd_engine() % 100;
+    sqlite3_bind_int64(*stmt, 1, ts);
+    sqlite3_bind_int64(*stmt, 2, rnd_engine() % 900);
+    sqlite3_bind_int64(*stmt, 3, partition);
+    sqlite3_bind_int64(*stmt, 4, rnd_engine());
+    PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_DONE);
+    sqlite3_reset(*stmt);
+  }
+  ExecOrDie(db, "COMMIT");
+}
+
+// Joins two tables with 4096 partitions, either streaming through the
+// partitions (|threads| == 0) or joining them in parallel on |threads|
+// threads.
+void BenchmarkSpanJoin(benchmark::State& state, uint32_t threads) {
+  const uint32_t size = IsBenchmarkFunctionalOnly() ? 4096 : 1024 * 1024;
+  const uint32_t num_partitions = 4096;
+
+  std::unique_ptr<base::ThreadPool> pool;
+  if (threads > 0)
+    pool.reset(new base::ThreadPool(threads - 1, "SpanJoin"));
+
+  sqlite3_initialize();
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+
+  SpanJoinOperatorTable::Context context;
+  context.partition_pool = pool.get();
+  SpanJoinOperatorTable::RegisterTable(*db, context);
+
+  FillSpans(*db, "thread_state", size, num_partitions, 476);
+  FillSpans(*db, "slice", size, num_partitions, 477);
+  ExecOrDie(*db,
+            "CREATE VIRTUAL TABLE sp USING span_join("
+            "thread_state PARTITIONED utid, slice PARTITIONED utid)");
+
+  const std::string sql =
+      "SELECT COUNT(*), SUM(dur), SUM(thread_state_value + slice_value) "
+      "FROM sp";
+  sqlite3_stmt* raw_stmt = nullptr;
+  PERFETTO_CHECK(sqlite3_prepare_v2(*db, sql.c_str(), -1, &raw_stmt,
+                                    nullptr) == SQLITE_OK);
+  ScopedStmt stmt(raw_stmt);
+
+  int64_t count = 0;
+  for (auto _ : state) {
+    PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+    count = sqlite3_column_int64(*stmt, 0);
+    benchmark::DoNotOptimize(count);
+    sqlite3_reset(*stmt);
+  }
+  state.counters["rows"] =
+      Counter(static_cast<double>(count), Counter::kIsIterationInvariantRate);
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
+
+static void BM_SpanJoinStreaming(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkSpanJoin(state, 0);
+}
+BENCHMARK(BM_SpanJoinStreaming)->Unit(benchmark::kMillisecond);
+
+static void BM_SpanJoinParallel(benchmark::State& state) {
+  perfetto::trace_processor::BenchmarkSpanJoin(
+      state, static_cast<uint32_t>(state.range(0)));
+}
+BENCHMARK(BM_SpanJoinParallel)
+    ->Unit(benchmark::kMillisecond)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8);
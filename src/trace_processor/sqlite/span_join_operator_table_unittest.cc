@@ -16,22 +16,32 @@
 
 #include "src/trace_processor/sqlite/span_join_operator_table.h"
 
+#include <random>
+#include <string>
+#include <vector>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
 namespace trace_processor {
 namespace {
 
-class SpanJoinOperatorTableTest : public ::testing::Test {
- public:
-  SpanJoinOperatorTableTest() {
-    sqlite3* db = nullptr;
-    PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
-    PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
-    db_.reset(db);
+ScopedDb CreateDb(base::ThreadPool* partition_pool) {
+  sqlite3* db = nullptr;
+  PERFETTO_CHECK(sqlite3_initialize() == SQLITE_OK);
+  PERFETTO_CHECK(sqlite3_open(":memory:", &db) == SQLITE_OK);
 
-    SpanJoinOperatorTable::RegisterTable(db_.get(), nullptr);
-  }
+  SpanJoinOperatorTable::Context context;
+  context.partition_pool = partition_pool;
+  SpanJoinOperatorTable::RegisterTable(db, context);
+  return ScopedDb(db);
+}
+
+// Runs all the tests both with and without joining partitions in parallel.
+class SpanJoinOperatorTableTest : public ::testing::TestWithParam<bool> {
+ public:
+  SpanJoinOperatorTableTest()
+      : pool_(2), db_(CreateDb(GetParam() ? &pool_ : nullptr)) {}
 
   void PrepareValidStatement(const std::string& sql) {
     int size = static_cast<int>(sql.size());
@@ -55,11 +65,16 @@ class SpanJoinOperatorTableTest : public ::testing::Test {
   }
 
  protected:
+  base::ThreadPool pool_;
   ScopedDb db_;
   ScopedStmt stmt_;
 };
 
-TEST_F(SpanJoinOperatorTableTest, JoinTwoSpanTables) {
+INSTANTIATE_TEST_SUITE_P(Parallel,
+                         SpanJoinOperatorTableTest,
+                         ::testing::Bool());
+
+TEST_P(SpanJoinOperatorTableTest, JoinTwoSpanTables) {
   RunStatement(
       "CREATE TEMP TABLE f("
       "ts BIG INT PRIMARY KEY, "
@@ -121,7 +136,7 @@ TEST_F(SpanJoinOperatorTableTest, JoinTwoSpanTables) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
-TEST_F(SpanJoinOperatorTableTest, NullPartitionKey) {
+TEST_P(SpanJoinOperatorTableTest, NullPartitionKey) {
   RunStatement(
       "CREATE TEMP TABLE f("
       "ts BIG INT PRIMARY KEY, "
@@ -185,7 +200,7 @@ TEST_F(SpanJoinOperatorTableTest, NullPartitionKey) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
-TEST_F(SpanJoinOperatorTableTest, MixedPartitioning) {
+TEST_P(SpanJoinOperatorTableTest, MixedPartitioning) {
   RunStatement(
       "CREATE TEMP TABLE f("
       "ts BIG INT PRIMARY KEY, "
@@ -223,7 +238,7 @@ TEST_F(SpanJoinOperatorTableTest, MixedPartitioning) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
-TEST_F(SpanJoinOperatorTableTest, NoPartitioning) {
+TEST_P(SpanJoinOperatorTableTest, NoPartitioning) {
   RunStatement(
       "CREATE TEMP TABLE f("
       "ts BIG INT PRIMARY KEY, "
@@ -254,6 +269,86 @@ TEST_F(SpanJoinOperatorTableTest, NoPartitioning) {
   ASSERT_EQ(sqlite3_step(stmt_.get()), SQLITE_DONE);
 }
 
+// Returns all the values returned by |sql| as strings.
+std::vector<std::string> Query(sqlite3* db, const std::string& sql) {
+  sqlite3_stmt* raw_stmt = nullptr;
+  PERFETTO_CHECK(sqlite3_prepare_v2(db, sql.c_str(), -1, &raw_stmt, nullptr) ==
+                 SQLITE_OK);
+  ScopedStmt stmt(raw_stmt);
+  std::vector<std::string> values;
+  while (sqlite3_step(*stmt) == SQLITE_ROW) {
+    for (int i = 0; i < sqlite3_column_count(*stmt); ++i) {
+      auto text = reinterpret_cast<const char*>(sqlite3_column_text(*stmt, i));
+      values.emplace_back(text ? text : "NULL");
+    }
+  }
+  return values;
+}
+
+TEST(SpanJoinOperatorTableParallelTest, MatchesSerial) {
+  base::ThreadPool pool(2);
+  ScopedDb serial_db = CreateDb(nullptr);
+  ScopedDb parallel_db = CreateDb(&pool);
+
+  // Spans which don't overlap within a partition, with some partitions only
+  // present in one of the tables and some null partitions.
+  std::vector<std::string> statements = {
+      "CREATE TABLE f(ts BIG INT, dur BIG INT, cpu INT, name STRING)",
+      "CREATE TABLE s(ts BIG INT, dur BIG INT, cpu INT, value DOUBLE)",
+  };
+  std::minstd_rand0 rnd_engine(42);
+  for (int64_t cpu = 0; cpu < 16; ++cpu) {
+    for (const char* table : {"f", "s"}) {
+      if (rnd_engine() % 4 == 0)
+        continue;
+      int64_t ts = 0;
+      for (uint32_t i = 0; i < 20; ++i) {
+        ts += 1 + rnd_engine() % 10;
+        int64_t dur = rnd_engine() % 10 == 0 ? -1 : rnd_engine() % 10;
+        std::string partition =
+            rnd_engine() % 20 == 0 ? "NULL" : std::to_string(cpu);
+        std::string value = table[0] == 'f'
+                                ? "'name" + std::to_string(i % 3) + "'"
+                                : std::to_string(i) + ".5";
+        statements.emplace_back("INSERT INTO " + std::string(table) +
+                                " VALUES(" + std::to_string(ts) + ", " +
+                                std::to_string(dur) + ", " + partition + ", " +
+                                value + ")");
+        ts += dur > 0 ? dur : 0;
+      }
+    }
+  }
+  for (sqlite3* db : {*serial_db, *parallel_db}) {
+    for (const std::string& statement : statements) {
+      PERFETTO_CHECK(sqlite3_exec(db, statement.c_str(), nullptr, nullptr,
+                                  nullptr) == SQLITE_OK);
+    }
+  }
+
+  const char* joins[] = {"span_join", "span_left_join", "span_outer_join"};
+  const char* filters[] = {"", " WHERE ts > 50", " WHERE name = 'name1'",
+                           " WHERE cpu = 3"};
+  for (const char* join : joins) {
+    std::string create = std::string("CREATE VIRTUAL TABLE sp USING ") + join +
+                         "(f PARTITIONED cpu, s PARTITIONED cpu)";
+    for (sqlite3* db : {*serial_db, *parallel_db}) {
+      ASSERT_EQ(sqlite3_exec(db, create.c_str(), nullptr, nullptr, nullptr),
+                SQLITE_OK);
+    }
+    for (const char* filter : filters) {
+      std::string sql = std::string("SELECT * FROM sp") + filter;
+      std::vector<std::string> expected = Query(*serial_db, sql);
+      ASSERT_FALSE(expected.empty()) << join << filter;
+      ASSERT_EQ(Query(*parallel_db, sql), expected) << join << filter;
+    }
+    for (sqlite3* db : {*serial_db, *parallel_db}) {
+      ASSERT_EQ(
+          sqlite3_exec(db, "DROP TABLE sp", nullptr, nullptr, nullptr),
+          SQLITE_OK);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
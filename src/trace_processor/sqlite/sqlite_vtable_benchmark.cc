@@ -26,13 +26,25 @@
 #include <sqlite3.h>
 
 #include "perfetto/base/compiler.h"
+#include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/group_by_operator_table.h"
+#include "src/trace_processor/sqlite/hash_join_operator_table.h"
+#include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/tables/slice_tables.h"
 
 namespace {
 
 using benchmark::Counter;
+using perfetto::trace_processor::DbSqliteTable;
+using perfetto::trace_processor::GroupByOperatorTable;
+using perfetto::trace_processor::HashJoinOperatorTable;
+using perfetto::trace_processor::QueryCache;
 using perfetto::trace_processor::ScopedDb;
 using perfetto::trace_processor::ScopedStmt;
+using perfetto::trace_processor::StringPool;
+using perfetto::trace_processor::tables::SliceTable;
+using perfetto::trace_processor::tables::TrackTable;
 
 bool IsBenchmarkFunctionalOnly() {
   return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
@@ -200,4 +212,245 @@ static void BM_SqliteStepAndResult(benchmark::State& state) {
 
 BENCHMARK(BM_SqliteStepAndResult)->Apply(BenchmarkArgs);
 
+// Measures the speed of reading all the rows and columns of a table through
+// DbSqliteTable (i.e. what the UI does when it streams large query results).
+static void BM_DbSqliteTableSelectAll(benchmark::State& state) {
+  static constexpr uint32_t kRandomSeed = 476;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  const uint32_t size = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
+  StringPool pool;
+  SliceTable slices(&pool, nullptr);
+  int64_t ts = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    SliceTable::Row row;
+    ts += rnd_engine() % 1000;
+    row.ts = ts;
+    row.dur = rnd_engine() % 1000;
+    row.track_id = TrackTable::Id(rnd_engine() % 64);
+    row.category = pool.InternString("cat");
+    row.name = pool.InternString(perfetto::base::StringView(
+        "slice" + std::to_string(rnd_engine() % 1024)));
+    row.depth = rnd_engine() % 8;
+    if (i > 0 && rnd_engine() % 2)
+      row.parent_id = SliceTable::Id(rnd_engine() % i);
+    slices.Insert(row);
+  }
+
+  sqlite3_initialize();
+  QueryCache cache;
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+
+  // Registering a table also adds its name to this table.
+  sqlite3_exec(*db, "CREATE TABLE perfetto_tables(name STRING)", nullptr,
+               nullptr, nullptr);
+  DbSqliteTable::RegisterTable(*db, &cache, SliceTable::Schema(), &slices,
+                               slices.table_name());
+
+  ScopedStmt stmt;
+  sqlite3_stmt* raw_stmt;
+  std::string sql = "SELECT * FROM " + std::string(slices.table_name());
+  int err = sqlite3_prepare_v2(*db, sql.c_str(), static_cast<int>(sql.size()),
+                               &raw_stmt, nullptr);
+  PERFETTO_CHECK(err == SQLITE_OK);
+  stmt.reset(raw_stmt);
+
+  // Only string columns need to be read as text: look at the first row to find
+  // out which ones they are.
+  PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+  std::vector<bool> is_text;
+  for (int col = 0; col < sqlite3_column_count(*stmt); col++)
+    is_text.push_back(sqlite3_column_type(*stmt, col) == SQLITE_TEXT);
+
+  for (auto _ : state) {
+    uint32_t rows = 0;
+    int64_t value = 0;
+    sqlite3_reset(*stmt);
+    while (sqlite3_step(*stmt) == SQLITE_ROW) {
+      for (int col = 0; col < static_cast<int>(is_text.size()); col++) {
+        if (is_text[static_cast<size_t>(col)]) {
+          value ^= sqlite3_column_text(*stmt, col)[0];
+        } else {
+          value ^= sqlite3_column_int64(*stmt, col);
+        }
+      }
+      rows++;
+    }
+    PERFETTO_CHECK(rows == size);
+    benchmark::DoNotOptimize(value);
+  }
+
+  state.counters["rows"] = Counter(static_cast<double>(size),
+                                   Counter::kIsIterationInvariantRate);
+}
+
+BENCHMARK(BM_DbSqliteTableSelectAll)->Unit(benchmark::kMillisecond);
+
+// Fills |slices| with |size| slices spread over the 1024 rows of |tracks|.
+void FillSlicesAndTracks(uint32_t size,
+                         StringPool* pool,
+                         TrackTable* tracks,
+                         SliceTable* slices) {
+  static constexpr uint32_t kRandomSeed = 476;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  const uint32_t track_count = 1024;
+  for (uint32_t i = 0; i < track_count; ++i) {
+    TrackTable::Row row;
+    row.name = pool->InternString(
+        perfetto::base::StringView("track" + std::to_string(i)));
+    tracks->Insert(row);
+  }
+  for (uint32_t i = 0; i < size; ++i) {
+    SliceTable::Row row;
+    row.ts = i;
+    row.dur = rnd_engine() % 1000;
+    row.track_id = TrackTable::Id(rnd_engine() % track_count);
+    slices->Insert(row);
+  }
+}
+
+// Opens a database with |slices| and |tracks| registered both as
+// DbSqliteTables and for the operator tables.
+ScopedDb OpenDbWithTables(QueryCache* cache,
+                          SliceTable* slices,
+                          TrackTable* tracks,
+                          DbSqliteTable::StaticTableMap* tables) {
+  sqlite3_initialize();
+  ScopedDb db;
+  sqlite3* raw_db = nullptr;
+  PERFETTO_CHECK(sqlite3_open(":memory:", &raw_db) == SQLITE_OK);
+  db.reset(raw_db);
+
+  sqlite3_exec(*db, "CREATE TABLE perfetto_tables(name STRING)", nullptr,
+               nullptr, nullptr);
+  DbSqliteTable::RegisterTable(*db, cache, SliceTable::Schema(), slices,
+                               slices->table_name());
+  DbSqliteTable::RegisterTable(*db, cache, TrackTable::Schema(), tracks,
+                               tracks->table_name());
+  (*tables)[slices->table_name()] = slices;
+  (*tables)[tracks->table_name()] = tracks;
+  HashJoinOperatorTable::RegisterTable(*db, tables);
+  GroupByOperatorTable::RegisterTable(*db, tables);
+  return db;
+}
+
+void ExecOrDie(sqlite3* db, const char* sql) {
+  PERFETTO_CHECK(sqlite3_exec(db, sql, nullptr, nullptr, nullptr) ==
+                 SQLITE_OK);
+}
+
+// Runs |sql| and returns the |col|-th column of the first row.
+int64_t QueryInt64(sqlite3* db, const char* sql, int col) {
+  ScopedStmt stmt;
+  sqlite3_stmt* raw_stmt;
+  PERFETTO_CHECK(sqlite3_prepare_v2(db, sql, -1, &raw_stmt, nullptr) ==
+                 SQLITE_OK);
+  stmt.reset(raw_stmt);
+  PERFETTO_CHECK(sqlite3_step(*stmt) == SQLITE_ROW);
+  return sqlite3_column_int64(*stmt, col);
+}
+
+// Compares joining a large table with a small one using SQLite's nested loop
+// join (which filters the inner table once per row of the outer table) with
+// using the hash_join operator table.
+void BenchmarkJoin(benchmark::State& state, bool hash_join) {
+  const uint32_t size = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
+  StringPool pool;
+  TrackTable tracks(&pool, nullptr);
+  SliceTable slices(&pool, nullptr);
+  FillSlicesAndTracks(size, &pool, &tracks, &slices);
+
+  QueryCache cache;
+  DbSqliteTable::StaticTableMap tables;
+  ScopedDb db = OpenDbWithTables(&cache, &slices, &tracks, &tables);
+
+  for (auto _ : state) {
+    // The hash join is computed when the table is created so include this in
+    // the measurement.
+    if (hash_join) {
+      ExecOrDie(*db,
+                "CREATE VIRTUAL TABLE j "
+                "USING hash_join(internal_slice, track_id, track, id)");
+    }
+
+    const char* sql =
+        hash_join ? "SELECT SUM(dur), COUNT(track_name) FROM j"
+                  : "SELECT SUM(s.dur), COUNT(t.name) FROM internal_slice s "
+                    "JOIN track t ON s.track_id = t.id";
+    PERFETTO_CHECK(QueryInt64(*db, sql, 1) == size);
+
+    if (hash_join)
+      ExecOrDie(*db, "DROP TABLE j");
+  }
+
+  state.counters["rows"] = Counter(static_cast<double>(size),
+                                   Counter::kIsIterationInvariantRate);
+}
+
+static void BM_SqliteNestedLoopJoin(benchmark::State& state) {
+  BenchmarkJoin(state, false);
+}
+
+BENCHMARK(BM_SqliteNestedLoopJoin)->Unit(benchmark::kMillisecond);
+
+static void BM_HashJoinOperatorTable(benchmark::State& state) {
+  BenchmarkJoin(state, true);
+}
+
+BENCHMARK(BM_HashJoinOperatorTable)->Unit(benchmark::kMillisecond);
+
+// Compares aggregating a table with SQLite's GROUP BY with using the group_by
+// operator table.
+void BenchmarkGroupBy(benchmark::State& state, bool group_by_table) {
+  const uint32_t size = IsBenchmarkFunctionalOnly() ? 1024 : 1024 * 1024;
+  StringPool pool;
+  TrackTable tracks(&pool, nullptr);
+  SliceTable slices(&pool, nullptr);
+  FillSlicesAndTracks(size, &pool, &tracks, &slices);
+
+  QueryCache cache;
+  DbSqliteTable::StaticTableMap tables;
+  ScopedDb db = OpenDbWithTables(&cache, &slices, &tracks, &tables);
+
+  for (auto _ : state) {
+    // The aggregates are computed when the table is created so include this
+    // in the measurement.
+    if (group_by_table) {
+      ExecOrDie(*db,
+                "CREATE VIRTUAL TABLE g USING group_by(internal_slice, "
+                "track_id, SUM(dur), COUNT(*))");
+    }
+
+    const char* sql =
+        group_by_table
+            ? "SELECT SUM(count), MAX(sum_dur) FROM g"
+            : "SELECT SUM(count), MAX(sum_dur) FROM (SELECT track_id, "
+              "SUM(dur) AS sum_dur, COUNT(*) AS count FROM internal_slice "
+              "GROUP BY track_id)";
+    PERFETTO_CHECK(QueryInt64(*db, sql, 0) == size);
+
+    if (group_by_table)
+      ExecOrDie(*db, "DROP TABLE g");
+  }
+
+  state.counters["rows"] = Counter(static_cast<double>(size),
+                                   Counter::kIsIterationInvariantRate);
+}
+
+static void BM_SqliteGroupBy(benchmark::State& state) {
+  BenchmarkGroupBy(state, false);
+}
+
+BENCHMARK(BM_SqliteGroupBy)->Unit(benchmark::kMillisecond);
+
+static void BM_GroupByOperatorTable(benchmark::State& state) {
+  BenchmarkGroupBy(state, true);
+}
+
+BENCHMARK(BM_GroupByOperatorTable)->Unit(benchmark::kMillisecond);
+
 }  // namespace
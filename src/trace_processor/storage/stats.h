@@ -107,12 +107,37 @@ namespace stats {
   F(track_event_parser_errors,                kSingle,  kInfo,     kAnalysis), \
   F(track_event_tokenizer_errors,             kSingle,  kInfo,     kAnalysis), \
   F(tokenizer_skipped_packets,                kSingle,  kInfo,     kAnalysis), \
+  F(pipelined_tokenizer_errors,               kSingle,  kError,    kAnalysis,  \
+      "Errors which happened while draining the pipelined ingestion at the "   \
+      "end of the trace. Everything after the error has been dropped."),       \
+  F(sorter_spilled_events,                    kSingle,  kInfo,     kAnalysis,  \
+      "Number of events which exceeded the sorter memory budget and have "     \
+      "been moved to a temporary file while sorting."),                        \
+  F(sorter_spilled_bytes,                     kSingle,  kInfo,     kAnalysis), \
+  F(sorter_spill_write_errors,                kSingle,  kInfo,     kAnalysis,  \
+      "The sorter failed to write its spill file. The events have been kept "  \
+      "in memory, going over the memory budget."),                             \
+  F(sorter_spill_read_errors,                 kSingle,  kDataLoss, kAnalysis,  \
+      "The sorter failed to read back events it spilled to disk. These "       \
+      "events have been dropped."),                                            \
+  F(peak_rss_bytes,                           kSingle,  kInfo,     kAnalysis,  \
+      "Peak resident set size of the process at the end of the import of "     \
+      "the trace. Not available on all platforms."),                           \
+  F(query_cache_hits,                         kSingle,  kInfo,     kAnalysis,  \
+      "Number of queries served from tables cached by previous queries."),     \
+  F(query_cache_misses,                       kSingle,  kInfo,     kAnalysis,  \
+      "Number of queries which had to compute their table as it was not "      \
+      "cached."),                                                              \
+  F(query_cache_evictions,                    kSingle,  kInfo,     kAnalysis,  \
+      "Number of tables dropped from the query cache to stay in its memory "   \
+      "budget."),                                                              \
   F(vmstat_unknown_keys,                      kSingle,  kError,    kAnalysis), \
   F(vulkan_allocations_invalid_string_id,     kSingle,  kError,    kTrace),    \
   F(clock_sync_failure,                       kSingle,  kError,    kAnalysis), \
   F(clock_sync_cache_miss,                    kSingle,  kInfo,     kAnalysis), \
   F(process_tracker_errors,                   kSingle,  kError,    kAnalysis), \
   F(json_tokenizer_failure,                   kSingle,  kError,    kTrace),    \
+  F(json_parser_failure,                      kSingle,  kError,    kTrace),    \
   F(heap_graph_invalid_string_id,             kIndexed, kError,    kTrace),    \
   F(heap_graph_non_finalized_graph,           kSingle,  kError,    kTrace),    \
   F(heap_graph_malformed_packet,              kIndexed, kError,    kTrace),    \
@@ -148,7 +173,8 @@ namespace stats {
   F(perf_samples_skipped,                     kSingle,  kInfo,     kTrace),    \
   F(perf_samples_skipped_dataloss,            kSingle,  kDataLoss, kTrace),    \
   F(thread_time_in_state_out_of_order,        kSingle,  kError,    kAnalysis), \
-  F(thread_time_in_state_unknown_cpu_freq,    kSingle,  kError,    kAnalysis)
+  F(thread_time_in_state_unknown_cpu_freq,    kSingle,  kError,    kAnalysis), \
+  F(column_compaction_bytes_saved,            kSingle,  kInfo,     kAnalysis)
 // clang-format on
 
 enum Type {
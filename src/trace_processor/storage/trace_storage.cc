@@ -16,11 +16,15 @@
 
 #include "src/trace_processor/storage/trace_storage.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <algorithm>
 #include <limits>
 
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/no_destructor.h"
+#include "perfetto/ext/base/scoped_file.h"
 
 namespace perfetto {
 namespace trace_processor {
@@ -71,7 +75,16 @@ const std::vector<NullTermStringView>& GetRefTypeStringMap() {
   return map.ref();
 }
 
-TraceStorage::TraceStorage(const Config&) {
+TraceStorage::TraceStorage(const Config& config) {
+  if (!config.string_pool_file.empty()) {
+    base::ScopedFile fd(
+        base::OpenFile(config.string_pool_file, O_RDWR | O_CREAT, 0600));
+    if (!fd || !string_pool_.SetBackingFile(std::move(fd))) {
+      PERFETTO_ELOG("Could not store strings in %s, keeping them in memory",
+                    config.string_pool_file.c_str());
+    }
+  }
+
   // Reserve utid/upid 0. These are special as embedders (e.g. Perfetto UI)
   // exclude them by filtering them out. If the parsed trace contains ftrace
   // data, ProcessTracker::SetPidZeroIgnoredForIdleProcess will create a mapping
@@ -91,6 +104,73 @@ TraceStorage::TraceStorage(const Config&) {
 
 TraceStorage::~TraceStorage() {}
 
+std::vector<const macros_internal::MacroTable*> TraceStorage::GetAllTables()
+    const {
+  auto tables = const_cast<TraceStorage*>(this)->GetAllMutableTables();
+  return std::vector<const macros_internal::MacroTable*>(tables.begin(),
+                                                         tables.end());
+}
+
+std::vector<macros_internal::MacroTable*> TraceStorage::GetAllMutableTables() {
+  return {
+      &metadata_table_,
+      &track_table_,
+      &gpu_track_table_,
+      &process_track_table_,
+      &thread_track_table_,
+      &counter_track_table_,
+      &thread_counter_track_table_,
+      &process_counter_track_table_,
+      &cpu_counter_track_table_,
+      &irq_counter_track_table_,
+      &softirq_counter_track_table_,
+      &gpu_counter_track_table_,
+      &gpu_counter_group_table_,
+      &arg_table_,
+      &thread_table_,
+      &process_table_,
+      &slice_table_,
+      &sched_slice_table_,
+      &gpu_slice_table_,
+      &counter_table_,
+      &instant_table_,
+      &raw_table_,
+      &cpu_table_,
+      &cpu_freq_table_,
+      &android_log_table_,
+      &stack_profile_mapping_table_,
+      &stack_profile_frame_table_,
+      &stack_profile_callsite_table_,
+      &heap_profile_allocation_table_,
+      &cpu_profile_stack_sample_table_,
+      &package_list_table_,
+      &profiler_smaps_table_,
+      &symbol_table_,
+      &heap_graph_object_table_,
+      &heap_graph_class_table_,
+      &heap_graph_reference_table_,
+      &vulkan_memory_allocations_table_,
+      &graphics_frame_slice_table_,
+  };
+}
+
+uint64_t TraceStorage::CompactColumns() {
+  auto data_bytes = [](const NullableVectorBase& nv) {
+    NullableVectorBase::RawParts parts = nv.GetRawParts();
+    return static_cast<uint64_t>(parts.data_count) * parts.element_size;
+  };
+  uint64_t saved = 0;
+  for (macros_internal::MacroTable* table : GetAllMutableTables()) {
+    for (Column* col : table->GetMutableOwnedColumns()) {
+      NullableVectorBase* nv = col->mutable_nullable_vector_base();
+      uint64_t before = data_bytes(*nv);
+      if (nv->Compact())
+        saved += before - data_bytes(*nv);
+    }
+  }
+  return saved;
+}
+
 uint32_t TraceStorage::SqlStats::RecordQueryBegin(const std::string& query,
                                                   int64_t time_queued,
                                                   int64_t time_started) {
@@ -593,6 +593,15 @@ class TraceStorage {
     return &graphics_frame_slice_table_;
   }
 
+  // Returns all the tables of the storage, e.g. to snapshot them.
+  std::vector<const macros_internal::MacroTable*> GetAllTables() const;
+  std::vector<macros_internal::MacroTable*> GetAllMutableTables();
+
+  // Compresses the storage of the integer columns of all the tables when this
+  // saves enough memory (see NullableVectorBase::Compact). Returns the number
+  // of bytes saved.
+  uint64_t CompactColumns();
+
   const StringPool& string_pool() const { return string_pool_; }
   StringPool* mutable_string_pool() { return &string_pool_; }
 
@@ -0,0 +1,649 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/trace_storage_snapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/string_view.h"
+#include "src/trace_processor/containers/bit_vector.h"
+#include "src/trace_processor/containers/row_map.h"
+#include "src/trace_processor/storage/trace_storage.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define PERFETTO_TP_HAS_MMAP() 1
+#else
+#define PERFETTO_TP_HAS_MMAP() 0
+#endif
+
+namespace perfetto {
+namespace trace_processor {
+
+namespace {
+
+// A snapshot is laid out as:
+// [magic][version]
+// [string pool: blocks, large strings]
+// [stats]
+// [thread slices][virtual track slices]
+// [tables: for each, its name, row maps and owned columns]
+// [end magic]
+// All the integers are stored as 64-bit values and all the arrays are
+// prefixed by their size in bytes and padded to a multiple of 8 bytes. This
+// keeps everything 8-byte aligned.
+constexpr char kMagic[8] = {'P', 'F', 'T', 'P', 'S', 'N', 'A', 'P'};
+constexpr char kEndMagic[8] = {'P', 'F', 'T', 'P', 'S', 'E', 'N', 'D'};
+constexpr size_t kAlignment = 8;
+
+// How RowMaps are stored: either as the range of rows between two values or
+// as a bitmap of the rows (which is what RowMap would use in memory).
+enum class RowMapEncoding : uint64_t {
+  kRange = 0,
+  kBitmap = 1,
+};
+
+size_t AlignUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+// Writes a snapshot to a file, through a buffer to avoid issuing a syscall for
+// each value.
+class SnapshotWriter {
+ public:
+  explicit SnapshotWriter(base::ScopedFile fd) : fd_(std::move(fd)) {}
+
+  void WriteU64(uint64_t value) { WriteBytes(&value, sizeof(value)); }
+  void WriteI64(int64_t value) { WriteBytes(&value, sizeof(value)); }
+
+  // Writes |size| bytes from |data|, prefixed by their size and padded to the
+  // alignment.
+  void WriteArray(const void* data, size_t size) {
+    WriteU64(size);
+    WriteBytes(data, size);
+    static constexpr char kPadding[kAlignment] = {};
+    WriteBytes(kPadding, AlignUp(size) - size);
+  }
+
+  void WriteString(base::StringView str) {
+    WriteArray(str.data(), str.size());
+  }
+
+  // Writes the magic bytes |magic|.
+  void WriteMagic(const char (&magic)[8]) { WriteBytes(magic, sizeof(magic)); }
+
+  // Flushes the buffer and returns whether all the writes succeeded.
+  bool Finish() {
+    Flush();
+    return ok_;
+  }
+
+ private:
+  static constexpr size_t kBufferSize = 1024 * 1024;
+
+  void WriteBytes(const void* data, size_t size) {
+    if (buffer_.size() + size > kBufferSize)
+      Flush();
+    if (size >= kBufferSize) {
+      // Large arrays (e.g. columns) are written directly.
+      ok_ &= base::WriteAll(*fd_, data, size) == static_cast<ssize_t>(size);
+    } else {
+      buffer_.append(static_cast<const char*>(data), size);
+    }
+  }
+
+  void Flush() {
+    if (buffer_.empty())
+      return;
+    ok_ &= base::WriteAll(*fd_, buffer_.data(), buffer_.size()) ==
+           static_cast<ssize_t>(buffer_.size());
+    buffer_.clear();
+  }
+
+  base::ScopedFile fd_;
+  std::string buffer_;
+  bool ok_ = true;
+};
+
+// Reads the values written by SnapshotWriter from the contents of a snapshot.
+// All the methods return false if the snapshot is truncated or if the value
+// read is out of range.
+class SnapshotReader {
+ public:
+  SnapshotReader(const uint8_t* data, size_t size)
+      : ptr_(data), end_(data + size) {}
+
+  bool ReadU64(uint64_t* value) { return ReadBytes(value, sizeof(*value)); }
+
+  bool ReadI64(int64_t* value) { return ReadBytes(value, sizeof(*value)); }
+
+  bool ReadU32(uint32_t* value) {
+    uint64_t raw = 0;
+    if (!ReadU64(&raw) || raw > std::numeric_limits<uint32_t>::max())
+      return false;
+    *value = static_cast<uint32_t>(raw);
+    return true;
+  }
+
+  // Returns a view of the next array in the snapshot, without copying it.
+  bool ReadArray(base::StringView* array) {
+    uint64_t size = 0;
+    if (!ReadU64(&size) || size > static_cast<uint64_t>(end_ - ptr_) ||
+        AlignUp(static_cast<size_t>(size)) >
+            static_cast<size_t>(end_ - ptr_)) {
+      return false;
+    }
+    *array = base::StringView(reinterpret_cast<const char*>(ptr_),
+                              static_cast<size_t>(size));
+    ptr_ += AlignUp(static_cast<size_t>(size));
+    return true;
+  }
+
+  bool ReadMagic(const char (&magic)[8]) {
+    char bytes[sizeof(magic)];
+    return ReadBytes(bytes, sizeof(bytes)) &&
+           memcmp(bytes, magic, sizeof(bytes)) == 0;
+  }
+
+  bool at_end() const { return ptr_ == end_; }
+
+ private:
+  bool ReadBytes(void* out, size_t size) {
+    if (size > static_cast<size_t>(end_ - ptr_))
+      return false;
+    memcpy(out, ptr_, size);
+    ptr_ += size;
+    return true;
+  }
+
+  const uint8_t* ptr_;
+  const uint8_t* end_;
+};
+
+// The contents of a snapshot file, either mapped in memory or read into a
+// buffer on platforms without mmap.
+class SnapshotFile {
+ public:
+  ~SnapshotFile() {
+#if PERFETTO_TP_HAS_MMAP()
+    if (mapping_)
+      munmap(mapping_, size_);
+#endif
+  }
+
+  util::Status Open(const std::string& path) {
+#if PERFETTO_TP_HAS_MMAP()
+    base::ScopedFile fd(base::OpenFile(path, O_RDONLY));
+    if (!fd)
+      return util::ErrStatus("Could not open snapshot %s", path.c_str());
+    struct stat st {};
+    if (fstat(*fd, &st) != 0)
+      return util::ErrStatus("Could not stat snapshot %s", path.c_str());
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+      size_t size = static_cast<size_t>(st.st_size);
+      void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, *fd, 0);
+      if (addr != MAP_FAILED) {
+        // The snapshot is read front to back, once.
+        madvise(addr, size, MADV_SEQUENTIAL);
+        mapping_ = addr;
+        size_ = size;
+        return util::OkStatus();
+      }
+    }
+#endif
+    if (!base::ReadFile(path, &contents_))
+      return util::ErrStatus("Could not read snapshot %s", path.c_str());
+    size_ = contents_.size();
+    return util::OkStatus();
+  }
+
+  const uint8_t* data() const {
+    return mapping_ ? static_cast<const uint8_t*>(mapping_)
+                    : reinterpret_cast<const uint8_t*>(contents_.data());
+  }
+  size_t size() const { return size_; }
+
+ private:
+  void* mapping_ = nullptr;
+  std::string contents_;
+  size_t size_ = 0;
+};
+
+// Returns false if the rows of |row_map| are not sorted, which is not the
+// case for any of the RowMaps of storage tables.
+bool WriteRowMap(SnapshotWriter* writer, const RowMap& row_map) {
+  uint32_t size = row_map.size();
+  writer->WriteU64(size);
+  if (size == 0) {
+    writer->WriteU64(static_cast<uint64_t>(RowMapEncoding::kRange));
+    writer->WriteU64(0);
+    writer->WriteU64(0);
+    return true;
+  }
+
+  uint32_t first = row_map.Get(0);
+  uint32_t last = row_map.Get(size - 1);
+  if (last < first)
+    return false;
+
+  std::vector<uint64_t> words((static_cast<size_t>(last) + 64) / 64);
+  std::vector<uint32_t> rows(4096);
+  bool contiguous = true;
+  uint32_t prev = 0;
+  for (uint32_t start = 0; start < size;
+       start += static_cast<uint32_t>(rows.size())) {
+    uint32_t end =
+        std::min(size, start + static_cast<uint32_t>(rows.size()));
+    row_map.GetRows(start, end, rows.data());
+    for (uint32_t i = 0; i < end - start; ++i) {
+      uint32_t row = rows[i];
+      if (start + i > 0) {
+        if (row <= prev || row > last)
+          return false;
+        contiguous &= row == prev + 1;
+      }
+      words[row / 64] |= 1ull << (row % 64);
+      prev = row;
+    }
+  }
+
+  if (contiguous) {
+    writer->WriteU64(static_cast<uint64_t>(RowMapEncoding::kRange));
+    writer->WriteU64(first);
+    writer->WriteU64(static_cast<uint64_t>(last) + 1);
+  } else {
+    writer->WriteU64(static_cast<uint64_t>(RowMapEncoding::kBitmap));
+    writer->WriteU64(static_cast<uint64_t>(last) + 1);
+    writer->WriteArray(words.data(), words.size() * sizeof(uint64_t));
+  }
+  return true;
+}
+
+bool ReadRowMap(SnapshotReader* reader, RowMap* row_map) {
+  uint32_t size = 0;
+  uint64_t encoding = 0;
+  if (!reader->ReadU32(&size) || !reader->ReadU64(&encoding))
+    return false;
+
+  switch (static_cast<RowMapEncoding>(encoding)) {
+    case RowMapEncoding::kRange: {
+      uint32_t start = 0;
+      uint32_t end = 0;
+      if (!reader->ReadU32(&start) || !reader->ReadU32(&end) || end < start ||
+          end - start != size) {
+        return false;
+      }
+      *row_map = RowMap(start, end);
+      return true;
+    }
+    case RowMapEncoding::kBitmap: {
+      uint32_t num_bits = 0;
+      base::StringView words;
+      if (!reader->ReadU32(&num_bits) || !reader->ReadArray(&words) ||
+          words.size() != (static_cast<size_t>(num_bits) + 63) / 64 * 8) {
+        return false;
+      }
+      const char* words_data = words.data();
+      BitVector bv = BitVector::RangeWords(
+          0, num_bits, [words_data](uint32_t start, uint32_t) {
+            uint64_t word = 0;
+            memcpy(&word, words_data + start / 64 * sizeof(word),
+                   sizeof(word));
+            return word;
+          });
+      if (bv.GetNumBitsSet() != size)
+        return false;
+      *row_map = RowMap(std::move(bv));
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T>
+void WriteDeque(SnapshotWriter* writer, const std::deque<T>& deque) {
+  std::vector<T> values(deque.begin(), deque.end());
+  writer->WriteArray(values.data(), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool ReadVector(SnapshotReader* reader, std::vector<T>* values) {
+  base::StringView array;
+  if (!reader->ReadArray(&array) || array.size() % sizeof(T) != 0)
+    return false;
+  values->resize(array.size() / sizeof(T));
+  if (!array.empty())
+    memcpy(values->data(), array.data(), array.size());
+  return true;
+}
+
+// ThreadSlices and VirtualTrackSlices have the same layout.
+template <typename Slices>
+void WriteSlices(SnapshotWriter* writer, const Slices& slices) {
+  WriteDeque(writer, slices.slice_ids());
+  WriteDeque(writer, slices.thread_timestamp_ns());
+  WriteDeque(writer, slices.thread_duration_ns());
+  WriteDeque(writer, slices.thread_instruction_counts());
+  WriteDeque(writer, slices.thread_instruction_deltas());
+}
+
+// |add_slice| adds a slice to the slices being read, taking the same arguments
+// as AddThreadSlice/AddVirtualTrackSlice.
+template <typename AddSliceFn>
+bool ReadSlices(SnapshotReader* reader, AddSliceFn add_slice) {
+  std::vector<uint32_t> slice_ids;
+  std::vector<int64_t> timestamps;
+  std::vector<int64_t> durations;
+  std::vector<int64_t> instruction_counts;
+  std::vector<int64_t> instruction_deltas;
+  if (!ReadVector(reader, &slice_ids) || !ReadVector(reader, &timestamps) ||
+      !ReadVector(reader, &durations) ||
+      !ReadVector(reader, &instruction_counts) ||
+      !ReadVector(reader, &instruction_deltas)) {
+    return false;
+  }
+  size_t count = slice_ids.size();
+  if (timestamps.size() != count || durations.size() != count ||
+      instruction_counts.size() != count ||
+      instruction_deltas.size() != count) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    add_slice(slice_ids[i], timestamps[i], durations[i], instruction_counts[i],
+              instruction_deltas[i]);
+  }
+  return true;
+}
+
+bool WriteTable(SnapshotWriter* writer,
+                const macros_internal::MacroTable& table) {
+  writer->WriteString(base::StringView(table.table_name()));
+
+  writer->WriteU64(table.row_maps().size());
+  for (const RowMap& row_map : table.row_maps()) {
+    if (!WriteRowMap(writer, row_map))
+      return false;
+  }
+
+  std::vector<const Column*> columns = table.GetOwnedColumns();
+  writer->WriteU64(columns.size());
+  for (const Column* col : columns) {
+    NullableVectorBase::RawParts parts =
+        col->nullable_vector_base()->GetRawParts();
+    writer->WriteString(base::StringView(col->name()));
+    writer->WriteU64(static_cast<uint64_t>(col->type()));
+    writer->WriteU64(parts.element_size);
+    writer->WriteU64(parts.encoding);
+    writer->WriteU64(parts.size);
+    if (!WriteRowMap(writer, *parts.non_null))
+      return false;
+    writer->WriteArray(parts.data,
+                       static_cast<size_t>(parts.data_count) *
+                           parts.element_size);
+  }
+  return true;
+}
+
+util::Status ReadTable(SnapshotReader* reader,
+                       macros_internal::MacroTable* table) {
+  const char* name = table->table_name();
+
+  uint32_t num_row_maps = 0;
+  if (!reader->ReadU32(&num_row_maps))
+    return util::ErrStatus("Truncated table %s", name);
+  if (num_row_maps != table->row_maps().size())
+    return util::ErrStatus("Mismatched parents for table %s", name);
+  std::vector<RowMap> row_maps(num_row_maps);
+  for (RowMap& row_map : row_maps) {
+    if (!ReadRowMap(reader, &row_map))
+      return util::ErrStatus("Invalid row map in table %s", name);
+    if (row_map.size() != row_maps[0].size())
+      return util::ErrStatus("Mismatched row maps in table %s", name);
+  }
+  uint32_t row_count = row_maps.empty() ? 0 : row_maps.back().size();
+
+  std::vector<Column*> columns = table->GetMutableOwnedColumns();
+  uint32_t num_columns = 0;
+  if (!reader->ReadU32(&num_columns))
+    return util::ErrStatus("Truncated table %s", name);
+  if (num_columns != columns.size())
+    return util::ErrStatus("Mismatched columns in table %s", name);
+  for (Column* col : columns) {
+    base::StringView col_name;
+    uint64_t type = 0;
+    uint32_t element_size = 0;
+    uint32_t encoding = 0;
+    uint32_t size = 0;
+    RowMap non_null;
+    base::StringView data;
+    if (!reader->ReadArray(&col_name) || !reader->ReadU64(&type) ||
+        !reader->ReadU32(&element_size) || !reader->ReadU32(&encoding) ||
+        !reader->ReadU32(&size) ||
+        !ReadRowMap(reader, &non_null) || !reader->ReadArray(&data)) {
+      return util::ErrStatus("Invalid column in table %s", name);
+    }
+    // Compressed columns are stored as 64-bit words whatever their type.
+    NullableVectorBase* storage = col->mutable_nullable_vector_base();
+    uint32_t expected_element_size = encoding == 0
+                                         ? storage->GetRawParts().element_size
+                                         : sizeof(uint64_t);
+    if (col_name != base::StringView(col->name()) ||
+        type != static_cast<uint64_t>(col->type()) ||
+        element_size != expected_element_size) {
+      return util::ErrStatus("Mismatched column %s.%s", name, col->name());
+    }
+    if (size != row_count || data.size() % element_size != 0 ||
+        !storage->SetRawParts(
+            data.data(), static_cast<uint32_t>(data.size() / element_size),
+            encoding, std::move(non_null), size)) {
+      return util::ErrStatus("Invalid column %s.%s", name, col->name());
+    }
+  }
+  table->RestoreRowMaps(std::move(row_maps));
+  return util::OkStatus();
+}
+
+}  // namespace
+
+util::Status SaveTraceStorageSnapshot(const TraceStorage& storage,
+                                      const std::string& path) {
+  // Write to a temporary file first so that |path| is never left with a
+  // partial snapshot.
+  std::string tmp_path = path + ".tmp";
+  base::ScopedFile fd(
+      base::OpenFile(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, 0644));
+  if (!fd)
+    return util::ErrStatus("Could not create snapshot %s", tmp_path.c_str());
+  SnapshotWriter writer(std::move(fd));
+
+  writer.WriteMagic(kMagic);
+  writer.WriteU64(kTraceStorageSnapshotVersion);
+
+  std::vector<base::StringView> blocks = storage.string_pool().GetRawBlocks();
+  writer.WriteU64(blocks.size());
+  for (base::StringView block : blocks)
+    writer.WriteString(block);
+  std::vector<base::StringView> large_strings =
+      storage.string_pool().GetRawLargeStrings();
+  writer.WriteU64(large_strings.size());
+  for (base::StringView str : large_strings)
+    writer.WriteString(str);
+
+  writer.WriteU64(stats::kNumKeys);
+  for (const TraceStorage::Stats& stat : storage.stats()) {
+    writer.WriteI64(stat.value);
+    writer.WriteU64(stat.indexed_values.size());
+    for (const auto& index_and_value : stat.indexed_values) {
+      writer.WriteI64(index_and_value.first);
+      writer.WriteI64(index_and_value.second);
+    }
+  }
+
+  WriteSlices(&writer, storage.thread_slices());
+  WriteSlices(&writer, storage.virtual_track_slices());
+
+  std::vector<const macros_internal::MacroTable*> tables =
+      storage.GetAllTables();
+  writer.WriteU64(tables.size());
+  for (const macros_internal::MacroTable* table : tables) {
+    if (!WriteTable(&writer, *table)) {
+      remove(tmp_path.c_str());
+      return util::ErrStatus("Unsorted row map in table %s",
+                             table->table_name());
+    }
+  }
+
+  writer.WriteMagic(kEndMagic);
+  if (!writer.Finish()) {
+    remove(tmp_path.c_str());
+    return util::ErrStatus("Could not write snapshot %s", tmp_path.c_str());
+  }
+  if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+    remove(tmp_path.c_str());
+    return util::ErrStatus("Could not move snapshot to %s", path.c_str());
+  }
+  return util::OkStatus();
+}
+
+util::Status LoadTraceStorageSnapshot(const std::string& path,
+                                      TraceStorage* storage) {
+  SnapshotFile file;
+  util::Status status = file.Open(path);
+  if (!status.ok())
+    return status;
+  SnapshotReader reader(file.data(), file.size());
+
+  uint64_t version = 0;
+  if (!reader.ReadMagic(kMagic) || !reader.ReadU64(&version))
+    return util::ErrStatus("%s is not a trace processor snapshot", path.c_str());
+  if (version != kTraceStorageSnapshotVersion) {
+    return util::ErrStatus("Snapshot version %" PRIu64 " is not supported",
+                           version);
+  }
+
+  // The string pool is restored as-is: the blocks are copied into new ones so
+  // that the ids of all the strings are unchanged.
+  uint32_t num_blocks = 0;
+  uint32_t num_large_strings = 0;
+  std::vector<base::StringView> blocks;
+  std::vector<base::StringView> large_strings;
+  bool pool_ok = reader.ReadU32(&num_blocks);
+  for (uint32_t i = 0; pool_ok && i < num_blocks; ++i) {
+    blocks.emplace_back();
+    pool_ok = reader.ReadArray(&blocks.back());
+  }
+  pool_ok = pool_ok && reader.ReadU32(&num_large_strings);
+  for (uint32_t i = 0; pool_ok && i < num_large_strings; ++i) {
+    large_strings.emplace_back();
+    pool_ok = reader.ReadArray(&large_strings.back());
+  }
+  if (!pool_ok ||
+      !storage->mutable_string_pool()->SetRawContents(blocks, large_strings)) {
+    return util::ErrStatus("Invalid string pool in snapshot");
+  }
+
+  // The ids of the strings interned when creating the storage are kept by
+  // TraceStorage and must still refer to the same strings.
+  for (uint32_t i = 0; i <= Variadic::kMaxType; ++i) {
+    auto type = static_cast<Variadic::Type>(i);
+    if (storage->GetString(storage->GetIdForVariadicType(type)) !=
+        Variadic::kTypeNames[i]) {
+      return util::ErrStatus("Snapshot written by an incompatible version");
+    }
+  }
+
+  uint32_t num_stats = 0;
+  if (!reader.ReadU32(&num_stats) || num_stats != stats::kNumKeys)
+    return util::ErrStatus("Snapshot written by an incompatible version");
+  for (size_t key = 0; key < stats::kNumKeys; ++key) {
+    int64_t value = 0;
+    uint32_t num_indexed = 0;
+    if (!reader.ReadI64(&value) || !reader.ReadU32(&num_indexed))
+      return util::ErrStatus("Invalid stats in snapshot");
+    if (stats::kTypes[key] == stats::kSingle) {
+      if (num_indexed != 0)
+        return util::ErrStatus("Invalid stats in snapshot");
+      storage->SetStats(key, value);
+      continue;
+    }
+    for (uint32_t i = 0; i < num_indexed; ++i) {
+      int64_t index = 0;
+      if (!reader.ReadI64(&index) || !reader.ReadI64(&value))
+        return util::ErrStatus("Invalid stats in snapshot");
+      storage->SetIndexedStats(key, static_cast<int>(index), value);
+    }
+  }
+
+  TraceStorage::ThreadSlices* thread_slices = storage->mutable_thread_slices();
+  TraceStorage::VirtualTrackSlices* virtual_track_slices =
+      storage->mutable_virtual_track_slices();
+  if (!ReadSlices(&reader,
+                  [thread_slices](uint32_t slice_id, int64_t ts, int64_t dur,
+                                  int64_t count, int64_t delta) {
+                    thread_slices->AddThreadSlice(slice_id, ts, dur, count,
+                                                  delta);
+                  }) ||
+      !ReadSlices(&reader, [virtual_track_slices](
+                               uint32_t slice_id, int64_t ts, int64_t dur,
+                               int64_t count, int64_t delta) {
+        virtual_track_slices->AddVirtualTrackSlice(slice_id, ts, dur, count,
+                                                   delta);
+      })) {
+    return util::ErrStatus("Invalid thread slices in snapshot");
+  }
+
+  std::map<std::string, macros_internal::MacroTable*> tables_by_name;
+  for (macros_internal::MacroTable* table : storage->GetAllMutableTables())
+    tables_by_name[table->table_name()] = table;
+  uint32_t num_tables = 0;
+  if (!reader.ReadU32(&num_tables) || num_tables != tables_by_name.size())
+    return util::ErrStatus("Snapshot written by an incompatible version");
+  for (uint32_t i = 0; i < num_tables; ++i) {
+    base::StringView name;
+    if (!reader.ReadArray(&name))
+      return util::ErrStatus("Truncated snapshot");
+    auto it = tables_by_name.find(name.ToStdString());
+    if (it == tables_by_name.end() || !it->second) {
+      return util::ErrStatus("Unknown or duplicate table %s in snapshot",
+                             name.ToStdString().c_str());
+    }
+    status = ReadTable(&reader, it->second);
+    if (!status.ok())
+      return status;
+    it->second = nullptr;
+  }
+
+  if (!reader.ReadMagic(kEndMagic) || !reader.at_end())
+    return util::ErrStatus("Truncated snapshot");
+  return util::OkStatus();
+}
+
+}  // namespace trace_processor
+}  // namespace perfetto
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_TRACE_PROCESSOR_STORAGE_TRACE_STORAGE_SNAPSHOT_H_
+#define SRC_TRACE_PROCESSOR_STORAGE_TRACE_STORAGE_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "perfetto/trace_processor/status.h"
+
+namespace perfetto {
+namespace trace_processor {
+
+class TraceStorage;
+
+// Snapshots save the contents of a TraceStorage (the string pool, the stats
+// and all the tables) to a file from which they can be restored without
+// parsing the trace again.
+//
+// The file stores the in-memory representation of the storage: the blocks of
+// the string pool, so that string ids stay valid, and for each table its row
+// maps and the raw entries of the NullableVector of each of its columns (or
+// their CompressedIntVector if the column was compacted). All the arrays are
+// 8-byte aligned and the file is mapped in memory to be loaded, so restoring a
+// table mostly consists in copying its columns out of the mapping.
+//
+// Snapshots are not a stable format: they can only be loaded by a build of
+// trace processor with the same |kTraceStorageSnapshotVersion| and tables,
+// which is checked when loading them.
+constexpr uint32_t kTraceStorageSnapshotVersion = 2;
+
+// Writes a snapshot of |storage| to |path|, replacing the file if it exists.
+util::Status SaveTraceStorageSnapshot(const TraceStorage& storage,
+                                      const std::string& path);
+
+// Replaces the contents of |storage| with the snapshot at |path|. |storage|
+// should not have been used to parse a trace: the state of the importers is
+// not part of the snapshot so nothing more can be parsed into it afterwards.
+util::Status LoadTraceStorageSnapshot(const std::string& path,
+                                      TraceStorage* storage);
+
+}  // namespace trace_processor
+}  // namespace perfetto
+
+#endif  // SRC_TRACE_PROCESSOR_STORAGE_TRACE_STORAGE_SNAPSHOT_H_
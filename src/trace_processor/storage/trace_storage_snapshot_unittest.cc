@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "src/trace_processor/storage/trace_storage_snapshot.h"
+
+#include <string>
+
+#include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "src/trace_processor/storage/trace_storage.h"
+#include "test/gtest_and_gmock.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+class TraceStorageSnapshotTest : public ::testing::Test {
+ public:
+  TraceStorageSnapshotTest() : file_(base::TempFile::Create()) {}
+
+ protected:
+  // Adds |count| slices to the slice table and a GPU slice for every other
+  // one, so that the GPU slice table selects a subset of its parent's rows.
+  void AddSlices(uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+      StringId name =
+          storage_.InternString(base::StringView("slice" + std::to_string(i)));
+      if (i % 2 == 0) {
+        tables::SliceTable::Row row;
+        row.ts = i * 10;
+        row.dur = 5;
+        row.name = name;
+        row.parent_id = i > 0 ? base::make_optional(
+                                    tables::SliceTable::Id{i - 1})
+                              : base::nullopt;
+        storage_.mutable_slice_table()->Insert(row);
+      } else {
+        tables::GpuSliceTable::Row row;
+        row.ts = i * 10;
+        row.dur = 5;
+        row.name = name;
+        row.render_target_name = storage_.InternString("target");
+        if (i % 3 == 0)
+          row.context_id = i;
+        storage_.mutable_gpu_slice_table()->Insert(row);
+      }
+    }
+  }
+
+  base::TempFile file_;
+  TraceStorage storage_;
+};
+
+TEST_F(TraceStorageSnapshotTest, RoundTrip) {
+  AddSlices(100);
+  std::string large_string(6 * 1024 * 1024, 'x');
+  StringId large_id = storage_.InternString(base::StringView(large_string));
+  storage_.mutable_slice_table()->mutable_category()->Set(0, large_id);
+  storage_.SetStats(stats::android_log_num_total, 42);
+  storage_.SetIndexedStats(stats::ftrace_cpu_bytes_read_begin, 3, 1024);
+  storage_.mutable_thread_slices()->AddThreadSlice(1, 100, 10, 1000, 10);
+
+  ASSERT_TRUE(SaveTraceStorageSnapshot(storage_, file_.path()).ok());
+
+  TraceStorage loaded;
+  util::Status status = LoadTraceStorageSnapshot(file_.path(), &loaded);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  const auto& slices = storage_.slice_table();
+  const auto& loaded_slices = loaded.slice_table();
+  ASSERT_EQ(loaded_slices.row_count(), slices.row_count());
+  for (uint32_t i = 0; i < slices.row_count(); ++i) {
+    ASSERT_EQ(loaded_slices.ts()[i], slices.ts()[i]);
+    ASSERT_EQ(loaded_slices.dur()[i], slices.dur()[i]);
+    ASSERT_EQ(loaded.GetString(loaded_slices.name()[i]),
+              storage_.GetString(slices.name()[i]));
+    ASSERT_EQ(loaded_slices.parent_id()[i], slices.parent_id()[i]);
+  }
+
+  const auto& gpu_slices = storage_.gpu_slice_table();
+  const auto& loaded_gpu_slices = loaded.gpu_slice_table();
+  ASSERT_EQ(loaded_gpu_slices.row_count(), gpu_slices.row_count());
+  for (uint32_t i = 0; i < gpu_slices.row_count(); ++i) {
+    ASSERT_EQ(loaded_gpu_slices.id()[i], gpu_slices.id()[i]);
+    ASSERT_EQ(loaded_gpu_slices.ts()[i], gpu_slices.ts()[i]);
+    ASSERT_EQ(loaded_gpu_slices.context_id()[i], gpu_slices.context_id()[i]);
+    ASSERT_EQ(loaded_gpu_slices.render_target_name()[i],
+              gpu_slices.render_target_name()[i]);
+  }
+
+  ASSERT_EQ(loaded.GetString(loaded_slices.category()[0]).size(),
+            large_string.size());
+  ASSERT_EQ(loaded.stats()[stats::android_log_num_total].value, 42);
+  ASSERT_EQ(loaded.stats()[stats::ftrace_cpu_bytes_read_begin]
+                .indexed_values.at(3),
+            1024);
+  ASSERT_EQ(loaded.thread_slices().slice_count(), 1u);
+  ASSERT_EQ(loaded.thread_slices().thread_instruction_counts()[0], 1000);
+
+  // The restored string pool and tables can still be added to.
+  ASSERT_EQ(loaded.InternString("slice3"), storage_.InternString("slice3"));
+  tables::GpuSliceTable::Row row;
+  row.ts = 2000;
+  loaded.mutable_gpu_slice_table()->Insert(row);
+  ASSERT_EQ(loaded.slice_table().row_count(), slices.row_count() + 1);
+  ASSERT_EQ(loaded.gpu_slice_table().row_count(), gpu_slices.row_count() + 1);
+}
+
+TEST_F(TraceStorageSnapshotTest, RoundTripCompacted) {
+  AddSlices(1000);
+  ASSERT_GT(storage_.CompactColumns(), 0u);
+  ASSERT_NE(
+      storage_.slice_table().ts().nullable_vector_base()->GetRawParts().encoding,
+      0u);
+
+  ASSERT_TRUE(SaveTraceStorageSnapshot(storage_, file_.path()).ok());
+  TraceStorage loaded;
+  util::Status status = LoadTraceStorageSnapshot(file_.path(), &loaded);
+  ASSERT_TRUE(status.ok()) << status.message();
+
+  const auto& slices = storage_.slice_table();
+  const auto& loaded_slices = loaded.slice_table();
+  ASSERT_EQ(loaded_slices.row_count(), slices.row_count());
+  for (uint32_t i = 0; i < slices.row_count(); ++i) {
+    ASSERT_EQ(loaded_slices.ts()[i], slices.ts()[i]);
+    ASSERT_EQ(loaded_slices.depth()[i], slices.depth()[i]);
+    ASSERT_EQ(loaded_slices.parent_id()[i], slices.parent_id()[i]);
+  }
+}
+
+TEST_F(TraceStorageSnapshotTest, RejectsTruncatedSnapshot) {
+  AddSlices(10);
+  ASSERT_TRUE(SaveTraceStorageSnapshot(storage_, file_.path()).ok());
+
+  std::string contents;
+  ASSERT_TRUE(base::ReadFile(file_.path(), &contents));
+  base::ScopedFile fd(base::OpenFile(file_.path(), O_WRONLY | O_TRUNC));
+  ASSERT_TRUE(fd);
+  base::WriteAll(*fd, contents.data(), contents.size() - 16);
+  fd.reset();
+
+  TraceStorage loaded;
+  ASSERT_FALSE(LoadTraceStorageSnapshot(file_.path(), &loaded).ok());
+}
+
+TEST_F(TraceStorageSnapshotTest, RejectsOtherFiles) {
+  base::WriteAll(file_.fd(), "not a snapshot", 14);
+
+  TraceStorage loaded;
+  ASSERT_FALSE(LoadTraceStorageSnapshot(file_.path(), &loaded).ok());
+}
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
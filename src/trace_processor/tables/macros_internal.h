@@ -105,6 +105,38 @@ class MacroTable : public Table {
 
   const char* table_name() const { return name_; }
 
+  // Returns the columns whose storage belongs to this table: these exclude the
+  // id column, which has no storage, and the columns of the parent table.
+  // Along with the row maps, this is what is saved in snapshots of the trace
+  // storage (see trace_storage_snapshot.h).
+  std::vector<const Column*> GetOwnedColumns() const {
+    std::vector<const Column*> owned;
+    for (const Column& col : columns_) {
+      if (col.nullable_vector_base() && &col.row_map() == &row_maps_.back())
+        owned.push_back(&col);
+    }
+    return owned;
+  }
+  std::vector<Column*> GetMutableOwnedColumns() {
+    std::vector<Column*> owned;
+    for (Column& col : columns_) {
+      if (col.nullable_vector_base() && &col.row_map() == &row_maps_.back())
+        owned.push_back(&col);
+    }
+    return owned;
+  }
+
+  // Replaces the row maps of the table when restoring it from a snapshot. The
+  // storage of the owned columns needs to be restored separately.
+  void RestoreRowMaps(std::vector<RowMap> row_maps) {
+    PERFETTO_CHECK(row_maps.size() == row_maps_.size());
+    row_count_ = row_maps.back().size();
+    for (uint32_t i = 0; i < row_maps.size(); ++i) {
+      PERFETTO_CHECK(row_maps[i].size() == row_count_);
+      row_maps_[i] = std::move(row_maps[i]);
+    }
+  }
+
  protected:
   void UpdateRowMapsAfterParentInsert() {
     if (parent_ != nullptr) {
@@ -252,7 +284,8 @@ class MacroTable : public Table {
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
                         Column::Flag::kSorted),             \
       static_cast<bool>(FlagsForColumn(ColumnIndex::name) & \
-                        Column::Flag::kHidden)});
+                        Column::Flag::kHidden),             \
+      false});
 
 // Defines the accessors for a column.
 #define PERFETTO_TP_TABLE_COL_ACCESSOR(type, name, ...)       \
@@ -400,9 +433,9 @@ class MacroTable : public Table {
     static Table::Schema Schema() {                                           \
       Table::Schema schema;                                                   \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "id", SqlValue::Type::kLong, true, true, false});                   \
+          "id", SqlValue::Type::kLong, true, true, false, false});            \
       schema.columns.emplace_back(Table::Schema::Column{                      \
-          "type", SqlValue::Type::kString, false, false, false});             \
+          "type", SqlValue::Type::kString, false, false, false, false});      \
       PERFETTO_TP_ALL_COLUMNS(DEF, PERFETTO_TP_COLUMN_SCHEMA);                \
       return schema;                                                          \
     }                                                                         \
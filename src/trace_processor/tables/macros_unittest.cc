@@ -16,6 +16,10 @@
 
 #include "src/trace_processor/tables/macros.h"
 
+#include <algorithm>
+#include <numeric>
+#include <random>
+
 #include "test/gtest_and_gmock.h"
 
 namespace perfetto {
@@ -196,6 +200,40 @@ TEST_F(TableMacrosUnittest, NullableLongComparision) {
   ASSERT_EQ(dur->Get(1).long_value, 200);
 }
 
+TEST_F(TableMacrosUnittest, NonNullLongComparision) {
+  // Insert enough rows for the filters to be computed 64 rows at a time.
+  for (int64_t i = 0; i < 10000; ++i) {
+    TestSliceTable::Row row;
+    row.depth = i % 7;
+    slice_.Insert(row);
+  }
+
+  Table out = slice_.Filter({slice_.depth().gt(3)});
+  const auto* depth = out.GetColumnByName("depth");
+  ASSERT_EQ(out.row_count(), 3u * 1428);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_GT(depth->Get(i).long_value, 3);
+  }
+
+  out = slice_.Filter({slice_.depth().le(3)});
+  ASSERT_EQ(out.row_count(), 4u * 1429);
+
+  out = slice_.Filter({slice_.depth().gt(3), slice_.depth().ne(5)});
+  depth = out.GetColumnByName("depth");
+  ASSERT_EQ(out.row_count(), 2u * 1428);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(depth->Get(i).long_value, i % 2 == 0 ? 4 : 6);
+  }
+
+  out = slice_.Filter({slice_.depth().ge(2), slice_.depth().lt(4)},
+                      RowMap::OptimizeFor::kLookupSpeed);
+  depth = out.GetColumnByName("depth");
+  ASSERT_EQ(out.row_count(), 2u * 1429);
+  for (uint32_t i = 0; i < out.row_count(); ++i) {
+    ASSERT_EQ(depth->Get(i).long_value, i % 2 == 0 ? 2 : 3);
+  }
+}
+
 TEST_F(TableMacrosUnittest, NullableLongCompareWithDouble) {
   slice_.Insert({});
 
@@ -406,6 +444,91 @@ TEST_F(TableMacrosUnittest, StringComparision) {
   ASSERT_STREQ(end_state->Get(1).string_value, "D");
 }
 
+TEST_F(TableMacrosUnittest, StringEqNotInPool) {
+  TestCpuSliceTable::Row row;
+  row.end_state = pool_.InternString("R");
+  cpu_slice_.Insert(row);
+  cpu_slice_.Insert({});
+
+  Table out = cpu_slice_.Filter({cpu_slice_.end_state().eq("S")});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  out = cpu_slice_.Filter({cpu_slice_.end_state().ne("S")});
+  ASSERT_EQ(out.row_count(), 1u);
+  ASSERT_STREQ(out.GetColumnByName("end_state")->Get(0).string_value, "R");
+}
+
+TEST_F(TableMacrosUnittest, StringGlob) {
+  TestCpuSliceTable::Row row;
+  for (const char* state : {"R", "R+", "D", "DK", "S"}) {
+    row.end_state = pool_.InternString(state);
+    cpu_slice_.Insert(row);
+  }
+  cpu_slice_.Insert({});
+
+  const auto& end_state = cpu_slice_.end_state();
+  Table out = cpu_slice_.Filter({end_state.glob_value(SqlValue::String("R*"))});
+  ASSERT_EQ(out.row_count(), 2u);
+  ASSERT_STREQ(out.GetColumnByName("end_state")->Get(0).string_value, "R");
+  ASSERT_STREQ(out.GetColumnByName("end_state")->Get(1).string_value, "R+");
+
+  out = cpu_slice_.Filter({end_state.glob_value(SqlValue::String("?"))});
+  ASSERT_EQ(out.row_count(), 3u);
+
+  out = cpu_slice_.Filter({end_state.glob_value(SqlValue::String("[DS]*"))});
+  ASSERT_EQ(out.row_count(), 3u);
+
+  out = cpu_slice_.Filter({end_state.glob_value(SqlValue::String("r*"))});
+  ASSERT_EQ(out.row_count(), 0u);
+
+  // Globs never match numerics.
+  out = cpu_slice_.Filter({cpu_slice_.cpu().glob_value(SqlValue::String("*"))});
+  ASSERT_EQ(out.row_count(), 0u);
+}
+
+TEST_F(TableMacrosUnittest, StringFilterManyRows) {
+  // Filter enough rows for the predicate to be evaluated on the distinct
+  // strings of the column and check the result against filtering each row.
+  auto check = [this](FilterOp op, const char* value) {
+    const auto& end_state = cpu_slice_.end_state();
+    Table out = cpu_slice_.Filter(
+        {Constraint{end_state.index_in_table(), op, SqlValue::String(value)}});
+    std::vector<uint32_t> expected;
+    for (uint32_t i = 0; i < cpu_slice_.row_count(); ++i) {
+      NullTermStringView str_view = end_state.GetString(i);
+      if (str_view.data() == nullptr)
+        continue;
+      std::string str = str_view.ToStdString();
+      bool matches = op == FilterOp::kLt ? str < value : str >= value;
+      if (matches)
+        expected.push_back(i);
+    }
+    ASSERT_EQ(out.row_count(), expected.size());
+    for (uint32_t i = 0; i < out.row_count(); ++i) {
+      ASSERT_EQ(out.GetColumnByName("cpu")->Get(i).long_value,
+                static_cast<int64_t>(expected[i]));
+    }
+  };
+
+  TestCpuSliceTable::Row row;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    row.cpu = i;
+    row.end_state = i % 7 == 0 ? StringPool::Id::Null()
+                               : pool_.InternString(base::StringView(
+                                     "state" + std::to_string(i % 13)));
+    cpu_slice_.Insert(row);
+  }
+  check(FilterOp::kLt, "state5");
+  check(FilterOp::kGe, "state12");
+
+  // Adding rows with new strings should be taken into account.
+  row.cpu = 1000;
+  row.end_state = pool_.InternString("state0a");
+  cpu_slice_.Insert(row);
+  check(FilterOp::kLt, "state1");
+  check(FilterOp::kGe, "state0a");
+}
+
 TEST_F(TableMacrosUnittest, FilterIdThenOther) {
   TestCpuSliceTable::Row row;
   row.cpu = 1;
@@ -426,6 +549,34 @@ TEST_F(TableMacrosUnittest, FilterIdThenOther) {
   ASSERT_STREQ(end_state->Get(0).string_value, "D");
 }
 
+TEST_F(TableMacrosUnittest, GetRows) {
+  for (uint32_t i = 0; i < 300; ++i) {
+    TestCpuSliceTable::Row row;
+    row.ts = i;
+    if (i % 4 != 0)
+      row.dur = i * 10;
+    row.cpu = i % 7;
+    if (i % 5 != 0)
+      row.end_state = pool_.InternString(base::StringView(std::to_string(i)));
+    cpu_slice_.Insert(row);
+  }
+
+  // Filter and sort the table so that its columns use different row maps.
+  Table out = cpu_slice_.Filter({cpu_slice_.cpu().ne(3)})
+                  .Sort({Order{cpu_slice_.cpu().index_in_table(), false}});
+  for (uint32_t col_idx = 0; col_idx < out.GetColumnCount(); ++col_idx) {
+    const Column& col = out.GetColumn(col_idx);
+    Column::Rows rows;
+    col.GetRows(10, out.row_count(), &rows);
+    for (uint32_t i = 0; i < out.row_count() - 10; ++i) {
+      SqlValue value = rows.Get(i);
+      SqlValue expected = col.Get(10 + i);
+      ASSERT_EQ(value.type, expected.type);
+      ASSERT_EQ(compare::SqlValue(value, expected), 0);
+    }
+  }
+}
+
 TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_TRUE(event_.ts().IsSorted());
 
@@ -445,6 +596,70 @@ TEST_F(TableMacrosUnittest, Sort) {
   ASSERT_EQ(arg_set_id->Get(2).long_value, 100);
 }
 
+TEST_F(TableMacrosUnittest, SortManyRows) {
+  // Sort enough rows for the radix sort to be used and check the result
+  // against sorting the rows with a comparator on the values.
+  std::minstd_rand0 rnd_engine(42);
+  for (uint32_t i = 0; i < 5000; ++i) {
+    TestCpuSliceTable::Row row;
+    row.ts = i;
+    row.arg_set_id = static_cast<int64_t>(rnd_engine() % 100) - 50;
+    if (rnd_engine() % 5 != 0)
+      row.dur = static_cast<int64_t>(rnd_engine()) - 1000000;
+    row.depth = rnd_engine() % 4;
+    row.cpu = i;
+    if (rnd_engine() % 9 != 0) {
+      row.end_state = pool_.InternString(
+          base::StringView("state" + std::to_string(rnd_engine() % 40)));
+    }
+    cpu_slice_.Insert(row);
+
+    TestCounterTable::Row counter_row;
+    counter_row.ts = i;
+    if (rnd_engine() % 5 != 0) {
+      static constexpr double kValues[] = {-1.5, -0.0, 0.0, 2.25, 1e10};
+      counter_row.value = kValues[rnd_engine() % 5];
+    }
+    counter_.Insert(counter_row);
+  }
+
+  auto check = [](const Table& table, const std::vector<Order>& od,
+                  const char* id_col) {
+    std::vector<uint32_t> expected(table.row_count());
+    std::iota(expected.begin(), expected.end(), 0u);
+    std::stable_sort(
+        expected.begin(), expected.end(), [&](uint32_t a, uint32_t b) {
+          for (const Order& o : od) {
+            const Column& col = table.GetColumn(o.col_idx);
+            int res = compare::SqlValue(col.Get(a), col.Get(b));
+            if (res != 0)
+              return o.desc ? res > 0 : res < 0;
+          }
+          return false;
+        });
+
+    Table out = table.Sort(od);
+    const Column* ids = out.GetColumnByName(id_col);
+    ASSERT_EQ(out.row_count(), expected.size());
+    for (uint32_t i = 0; i < out.row_count(); ++i) {
+      ASSERT_EQ(ids->Get(i).long_value, static_cast<int64_t>(expected[i]));
+    }
+  };
+
+  const auto& slice = cpu_slice_;
+  for (bool desc : {false, true}) {
+    check(slice, {Order{slice.arg_set_id().index_in_table(), desc}}, "cpu");
+    check(slice, {Order{slice.dur().index_in_table(), desc}}, "cpu");
+    check(slice, {Order{slice.end_state().index_in_table(), desc}}, "cpu");
+    check(slice, {Order{slice.id().index_in_table(), desc}}, "cpu");
+    check(slice,
+          {Order{slice.depth().index_in_table(), desc},
+           Order{slice.end_state().index_in_table(), !desc}},
+          "cpu");
+    check(counter_, {Order{counter_.value().index_in_table(), desc}}, "ts");
+  }
+}
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
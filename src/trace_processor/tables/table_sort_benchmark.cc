@@ -0,0 +1,122 @@
+// Copyright (C) 2020 The Android Open Source Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <random>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/tables/macros.h"
+
+namespace perfetto {
+namespace trace_processor {
+namespace {
+
+// Mirrors the columns of the counter and sched tables which are typically
+// sorted on.
+#define PERFETTO_TP_SORT_TEST_TABLE(NAME, PARENT, C) \
+  NAME(SortTestTable, "sort_table")                  \
+  PERFETTO_TP_ROOT_TABLE(PARENT, C)                  \
+  C(int64_t, ts)                                     \
+  C(base::Optional<int64_t>, dur)                    \
+  C(uint32_t, utid)                                  \
+  C(double, value)                                   \
+  C(StringPool::Id, name)
+
+PERFETTO_TP_TABLE(PERFETTO_TP_SORT_TEST_TABLE);
+
+SortTestTable::~SortTestTable() = default;
+
+}  // namespace
+}  // namespace trace_processor
+}  // namespace perfetto
+
+namespace {
+
+using perfetto::trace_processor::Order;
+using perfetto::trace_processor::SortTestTable;
+using perfetto::trace_processor::StringPool;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+void TableSortArgs(benchmark::internal::Benchmark* b) {
+  if (IsBenchmarkFunctionalOnly()) {
+    b->Arg(1024);
+  } else {
+    b->RangeMultiplier(8);
+    b->Range(1024, 8 * 1024 * 1024);
+  }
+}
+
+void FillTable(uint32_t size, StringPool* pool, SortTestTable* table) {
+  std::minstd_rand0 rnd_engine(42);
+  for (uint32_t i = 0; i < size; ++i) {
+    SortTestTable::Row row;
+    row.ts = static_cast<int64_t>(rnd_engine()) * 1000;
+    if (rnd_engine() % 8 != 0)
+      row.dur = static_cast<int64_t>(rnd_engine() % 1000000);
+    row.utid = rnd_engine() % 1024;
+    row.value = static_cast<double>(rnd_engine()) / 1000;
+    row.name = pool->InternString(perfetto::base::StringView(
+        "slice" + std::to_string(rnd_engine() % 4096)));
+    table->Insert(row);
+  }
+}
+
+void BenchmarkSort(benchmark::State& state, const char* column, bool desc) {
+  StringPool pool;
+  SortTestTable table(&pool, nullptr);
+  FillTable(static_cast<uint32_t>(state.range(0)), &pool, &table);
+
+  Order order{table.GetColumnByName(column)->index_in_table(), desc};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(table.Sort({order}));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) *
+                          state.range(0));
+}
+
+}  // namespace
+
+static void BM_TableSortInt64(benchmark::State& state) {
+  BenchmarkSort(state, "ts", false);
+}
+BENCHMARK(BM_TableSortInt64)->Apply(TableSortArgs);
+
+static void BM_TableSortInt64Desc(benchmark::State& state) {
+  BenchmarkSort(state, "ts", true);
+}
+BENCHMARK(BM_TableSortInt64Desc)->Apply(TableSortArgs);
+
+static void BM_TableSortNullableInt64(benchmark::State& state) {
+  BenchmarkSort(state, "dur", false);
+}
+BENCHMARK(BM_TableSortNullableInt64)->Apply(TableSortArgs);
+
+static void BM_TableSortUint32FewValues(benchmark::State& state) {
+  BenchmarkSort(state, "utid", false);
+}
+BENCHMARK(BM_TableSortUint32FewValues)->Apply(TableSortArgs);
+
+static void BM_TableSortDouble(benchmark::State& state) {
+  BenchmarkSort(state, "value", false);
+}
+BENCHMARK(BM_TableSortDouble)->Apply(TableSortArgs);
+
+static void BM_TableSortString(benchmark::State& state) {
+  BenchmarkSort(state, "name", false);
+}
+BENCHMARK(BM_TableSortString)->Apply(TableSortArgs);
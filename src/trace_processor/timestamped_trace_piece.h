@@ -20,7 +20,6 @@
 #include "perfetto/base/build_config.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "src/trace_processor/importers/fuchsia/fuchsia_record.h"
-#include "src/trace_processor/importers/json/json_utils.h"
 #include "src/trace_processor/importers/proto/packet_sequence_state.h"
 #include "src/trace_processor/importers/systrace/systrace_line.h"
 #include "src/trace_processor/storage/trace_storage.h"
@@ -71,23 +70,43 @@ struct TrackEventData : public TracePacketData {
   std::array<int64_t, kMaxNumExtraCounters> extra_counter_values = {};
 };
 
+// The fields of a trace event of a JSON trace which JsonTraceParser uses,
+// extracted by JsonTraceTokenizer without building a Json::Value.
+struct JsonEvent {
+  // The JSON of the "args" dictionary, if any. It points into the trace data
+  // the event was read from: args are only parsed when the event is.
+  base::Optional<TraceBlobView> args;
+
+  int64_t dur = 0;
+  uint32_t pid = 0;
+  uint32_t tid = 0;
+  StringId name = kNullStringId;
+  StringId cat = kNullStringId;
+
+  // The first character of "ph", or 0 if the event has no phase.
+  char phase = 0;
+  bool has_dur = false;
+};
+
 // A TimestampedTracePiece is (usually a reference to) a piece of a trace that
-// is sorted by TraceSorter.
+// is sorted by TraceSorter. TraceSorter holds millions of these, so this struct
+// is kept as small as possible: payloads larger than a TracePacketData are
+// stored out of line.
 struct TimestampedTracePiece {
-  enum class Type {
+  enum class Type : uint8_t {
     kInvalid = 0,
     kFtraceEvent,
     kTracePacket,
     kInlineSchedSwitch,
     kInlineSchedWaking,
-    kJsonValue,
+    kJsonEvent,
     kFuchsiaRecord,
     kTrackEvent,
     kSystraceLine,
   };
 
   TimestampedTracePiece(int64_t ts,
-                        uint64_t idx,
+                        uint32_t idx,
                         TraceBlobView tbv,
                         PacketSequenceStateGeneration* sequence_state)
       : packet_data{std::move(tbv), sequence_state},
@@ -95,51 +114,49 @@ struct TimestampedTracePiece {
         packet_idx(idx),
         type(Type::kTracePacket) {}
 
-  TimestampedTracePiece(int64_t ts, uint64_t idx, TraceBlobView tbv)
+  TimestampedTracePiece(int64_t ts, uint32_t idx, TraceBlobView tbv)
       : ftrace_event(std::move(tbv)),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kFtraceEvent) {}
 
-  TimestampedTracePiece(int64_t ts,
-                        uint64_t idx,
-                        std::unique_ptr<Json::Value> value)
-      : json_value(std::move(value)),
+  // |event| is not owned, see |json_event|.
+  TimestampedTracePiece(int64_t ts, uint32_t idx, JsonEvent* event)
+      : json_event(event),
         timestamp(ts),
         packet_idx(idx),
-        type(Type::kJsonValue) {}
+        type(Type::kJsonEvent) {}
 
   TimestampedTracePiece(int64_t ts,
-                        uint64_t idx,
+                        uint32_t idx,
                         std::unique_ptr<FuchsiaRecord> fr)
       : fuchsia_record(std::move(fr)),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kFuchsiaRecord) {}
 
-  TimestampedTracePiece(int64_t ts,
-                        uint64_t idx,
-                        std::unique_ptr<TrackEventData> ted)
-      : track_event_data(std::move(ted)),
+  // |ted| is not owned, see |track_event_data|.
+  TimestampedTracePiece(int64_t ts, uint32_t idx, TrackEventData* ted)
+      : track_event_data(ted),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kTrackEvent) {}
 
   TimestampedTracePiece(int64_t ts,
-                        uint64_t idx,
+                        uint32_t idx,
                         std::unique_ptr<SystraceLine> ted)
       : systrace_line(std::move(ted)),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kSystraceLine) {}
 
-  TimestampedTracePiece(int64_t ts, uint64_t idx, InlineSchedSwitch iss)
+  TimestampedTracePiece(int64_t ts, uint32_t idx, InlineSchedSwitch iss)
       : sched_switch(std::move(iss)),
         timestamp(ts),
         packet_idx(idx),
         type(Type::kInlineSchedSwitch) {}
 
-  TimestampedTracePiece(int64_t ts, uint64_t idx, InlineSchedWaking isw)
+  TimestampedTracePiece(int64_t ts, uint32_t idx, InlineSchedWaking isw)
       : sched_waking(std::move(isw)),
         timestamp(ts),
         packet_idx(idx),
@@ -164,17 +181,15 @@ struct TimestampedTracePiece {
       case Type::kInlineSchedWaking:
         new (&sched_waking) InlineSchedWaking(std::move(ttp.sched_waking));
         break;
-      case Type::kJsonValue:
-        new (&json_value)
-            std::unique_ptr<Json::Value>(std::move(ttp.json_value));
+      case Type::kJsonEvent:
+        json_event = ttp.json_event;
         break;
       case Type::kFuchsiaRecord:
         new (&fuchsia_record)
             std::unique_ptr<FuchsiaRecord>(std::move(ttp.fuchsia_record));
         break;
       case Type::kTrackEvent:
-        new (&track_event_data)
-            std::unique_ptr<TrackEventData>(std::move(ttp.track_event_data));
+        track_event_data = ttp.track_event_data;
         break;
       case Type::kSystraceLine:
         new (&systrace_line)
@@ -206,6 +221,8 @@ struct TimestampedTracePiece {
       case Type::kInvalid:
       case Type::kInlineSchedSwitch:
       case Type::kInlineSchedWaking:
+      case Type::kTrackEvent:
+      case Type::kJsonEvent:
         break;
       case Type::kFtraceEvent:
         ftrace_event.~TraceBlobView();
@@ -213,15 +230,9 @@ struct TimestampedTracePiece {
       case Type::kTracePacket:
         packet_data.~TracePacketData();
         break;
-      case Type::kJsonValue:
-        json_value.~unique_ptr();
-        break;
       case Type::kFuchsiaRecord:
         fuchsia_record.~unique_ptr();
         break;
-      case Type::kTrackEvent:
-        track_event_data.~unique_ptr();
-        break;
       case Type::kSystraceLine:
         systrace_line.~unique_ptr();
         break;
@@ -233,10 +244,13 @@ struct TimestampedTracePiece {
     return x.timestamp < ts;
   }
 
-  // For std::sort().
+  // For std::sort(). Pieces with the same timestamp are kept in the order in
+  // which they were pushed. |packet_idx| wraps around, but the pieces being
+  // sorted at any time are never 2^31 pushes apart.
   inline bool operator<(const TimestampedTracePiece& o) const {
     return timestamp < o.timestamp ||
-           (timestamp == o.timestamp && packet_idx < o.packet_idx);
+           (timestamp == o.timestamp &&
+            static_cast<int32_t>(packet_idx - o.packet_idx) < 0);
   }
 
   // Fields ordered for packing.
@@ -247,17 +261,28 @@ struct TimestampedTracePiece {
     TracePacketData packet_data;
     InlineSchedSwitch sched_switch;
     InlineSchedWaking sched_waking;
-    std::unique_ptr<Json::Value> json_value;
     std::unique_ptr<FuchsiaRecord> fuchsia_record;
-    std::unique_ptr<TrackEventData> track_event_data;
     std::unique_ptr<SystraceLine> systrace_line;
+
+    // Owned by the TraceSorter which sorts this piece and only valid until
+    // the piece has been parsed. TrackEventData and JsonEvent are by far the
+    // most frequent out of line payloads: the sorter recycles their storage to
+    // avoid a heap allocation per event.
+    TrackEventData* track_event_data;
+    JsonEvent* json_event;
   };
 
   int64_t timestamp;
-  uint64_t packet_idx;
+  uint32_t packet_idx;
   Type type;
 };
 
+// 24 bytes for the payload (16 on 32-bit platforms), 8 for the timestamp, 4
+// for the index and 1 for the type, rounded up to the alignment of the
+// timestamp.
+static_assert(sizeof(TimestampedTracePiece) <= 40,
+              "TimestampedTracePiece should be kept small");
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
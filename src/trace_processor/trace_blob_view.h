@@ -43,6 +43,17 @@ class TraceBlobView {
     PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
   }
 
+  // Refers to a buffer whose ownership is shared with other objects than
+  // TraceBlobViews, e.g. a chunk of a memory-mapped trace file. The buffer
+  // must not be modified as long as any TraceBlobView refers to it.
+  static TraceBlobView FromSharedBuffer(std::shared_ptr<const uint8_t> buffer,
+                                        size_t offset,
+                                        size_t length) {
+    PERFETTO_DCHECK(offset <= std::numeric_limits<uint32_t>::max());
+    PERFETTO_DCHECK(length <= std::numeric_limits<uint32_t>::max());
+    return TraceBlobView(SharedBuf(std::move(buffer)), offset, length);
+  }
+
   // Allow std::move().
   TraceBlobView(TraceBlobView&&) noexcept = default;
   TraceBlobView& operator=(TraceBlobView&&) = default;
@@ -83,6 +94,10 @@ class TraceBlobView {
       rcbuf_ = new RefCountedBuf(std::move(mem));
     }
 
+    explicit SharedBuf(std::shared_ptr<const uint8_t> mem) {
+      rcbuf_ = new RefCountedBuf(std::move(mem));
+    }
+
     SharedBuf(const SharedBuf& copy) : rcbuf_(copy.rcbuf_) {
       PERFETTO_DCHECK(rcbuf_->refcount > 0);
       rcbuf_->refcount++;
@@ -117,14 +132,19 @@ class TraceBlobView {
 
     bool operator==(const SharedBuf& x) const { return x.rcbuf_ == rcbuf_; }
     bool operator!=(const SharedBuf& x) const { return !(x == *this); }
-    const uint8_t* data() const { return rcbuf_->mem.get(); }
+    const uint8_t* data() const { return rcbuf_->data; }
 
    private:
+    // Exactly one of |mem| and |shared_mem| owns |data|.
     struct RefCountedBuf {
       explicit RefCountedBuf(std::unique_ptr<uint8_t[]> buf)
-          : refcount(1), mem(std::move(buf)) {}
+          : refcount(1), data(buf.get()), mem(std::move(buf)) {}
+      explicit RefCountedBuf(std::shared_ptr<const uint8_t> buf)
+          : refcount(1), data(buf.get()), shared_mem(std::move(buf)) {}
       int refcount;
+      const uint8_t* data;
       std::unique_ptr<uint8_t[]> mem;
+      std::shared_ptr<const uint8_t> shared_mem;
     };
 
     RefCountedBuf* rcbuf_ = nullptr;
@@ -133,7 +153,7 @@ class TraceBlobView {
   inline const uint8_t* start() const { return shbuf_.data(); }
 
   TraceBlobView(SharedBuf b, size_t o, size_t l)
-      : shbuf_(b),
+      : shbuf_(std::move(b)),
         offset_(static_cast<uint32_t>(o)),
         length_(static_cast<uint32_t>(l)) {}
 
@@ -14,17 +14,37 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include <algorithm>
 #include <map>
 #include <random>
 #include <string>
+#include <vector>
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/temp_file.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
+#include "perfetto/trace_processor/read_trace.h"
 #include "perfetto/trace_processor/trace_processor.h"
 #include "src/base/test/utils.h"
 #include "test/gtest_and_gmock.h"
 
+#include "protos/perfetto/config/trace_config.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/ftrace_event_bundle.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+#include "protos/perfetto/trace/trace.pbzero.h"
+#include "protos/perfetto/trace/trace_packet.pbzero.h"
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+#include <zlib.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -312,6 +332,273 @@ TEST_F(TraceProcessorIntegrationTest, NinjaLog) {
   ASSERT_EQ(it.Get(0).long_value, 276174);
 }
 
+// The sorting window of write_into_file traces is twice their flush period.
+constexpr uint32_t kFlushPeriodMs = 10;
+constexpr int64_t kWindowNs = 2 * kFlushPeriodMs * 1000 * 1000;
+
+// Returns a trace of |num_bundles| ftrace bundles of 800us each, round robin
+// across 4 CPUs. Each CPU lags 1ms behind the previous one, so the events of
+// different CPUs are interleaved in the trace like in the traces written by
+// the tracing service. The events are sched_switch and B/E print events.
+std::string CreateFtraceTrace(uint32_t num_bundles, bool write_into_file) {
+  protozero::HeapBuffered<protos::pbzero::Trace> trace;
+  auto* config = trace->add_packet()->set_trace_config();
+  config->set_write_into_file(write_into_file);
+  config->set_flush_period_ms(kFlushPeriodMs);
+
+  constexpr uint32_t kNumCpus = 4;
+  constexpr uint64_t kEventIntervalNs = 50 * 1000;
+  for (uint32_t i = 0; i < num_bundles; i++) {
+    uint32_t cpu = i % kNumCpus;
+    uint64_t ts = 1000 * 1000 * 1000 + i * 16 * kEventIntervalNs -
+                  cpu * 1000 * 1000;
+    auto* packet = trace->add_packet();
+    packet->set_trusted_packet_sequence_id(1);
+    auto* bundle = packet->set_ftrace_events();
+    bundle->set_cpu(cpu);
+    for (uint32_t j = 0; j < 16; j++) {
+      uint32_t pid = 100 + cpu * 10 + j % 4;
+      auto* event = bundle->add_event();
+      event->set_timestamp(ts += kEventIntervalNs);
+      event->set_pid(pid);
+      if (j % 8 == 0) {
+        event->set_print()->set_buf("B|" + std::to_string(pid) + "|slice" +
+                                    std::to_string(i) + "\n");
+      } else if (j % 8 == 4) {
+        event->set_print()->set_buf("E|" + std::to_string(pid) + "\n");
+      } else {
+        auto* sched_switch = event->set_sched_switch();
+        sched_switch->set_prev_comm("thread" + std::to_string(pid));
+        sched_switch->set_prev_pid(static_cast<int32_t>(pid));
+        sched_switch->set_prev_prio(120);
+        sched_switch->set_prev_state(1);
+        sched_switch->set_next_comm("thread" + std::to_string(pid + 1));
+        sched_switch->set_next_pid(static_cast<int32_t>(pid + 1));
+        sched_switch->set_next_prio(120);
+      }
+    }
+  }
+  return trace.SerializeAsString();
+}
+
+// Returns the rows of |sql|, one per line.
+std::string QueryRows(TraceProcessor* tp, const std::string& sql) {
+  std::string rows;
+  auto it = tp->ExecuteQuery(sql);
+  while (it.Next()) {
+    for (uint32_t c = 0; c < it.ColumnCount(); c++) {
+      SqlValue value = it.Get(c);
+      if (value.type == SqlValue::kLong)
+        rows += std::to_string(value.long_value);
+      else if (value.type == SqlValue::kString)
+        rows += value.string_value;
+      rows += c + 1 < it.ColumnCount() ? "," : "\n";
+    }
+  }
+  EXPECT_TRUE(it.Status().ok()) << it.Status().message();
+  return rows;
+}
+
+int64_t QueryLong(TraceProcessor* tp, const std::string& sql) {
+  auto it = tp->ExecuteQuery(sql);
+  EXPECT_TRUE(it.Next()) << sql;
+  return it.Get(0).long_value;
+}
+
+std::unique_ptr<uint8_t[]> CopyToBuffer(const std::string& data,
+                                        size_t offset,
+                                        size_t size) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[size]);
+  memcpy(buf.get(), data.data() + offset, size);
+  return buf;
+}
+
+#if PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+// Returns |data| compressed as a gzip stream, as in a .gz trace file.
+std::string Gzip(const std::string& data) {
+  z_stream stream{};
+  PERFETTO_CHECK(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                              15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+  std::string deflated(deflateBound(&stream, static_cast<uLong>(data.size())),
+                       '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&deflated[0]);
+  stream.avail_out = static_cast<uInt>(deflated.size());
+  PERFETTO_CHECK(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  deflated.resize(stream.total_out);
+  deflateEnd(&stream);
+  return deflated;
+}
+
+// With Config::pipelined_ingestion, the packets of a gzipped proto trace which
+// are still on the framer thread at the end of the file must not be lost.
+TEST(GzipTraceIntegrationTest, PipelinedIngestion) {
+  const std::string trace =
+      Gzip(CreateFtraceTrace(256, /*write_into_file=*/false));
+  std::vector<int64_t> num_sched;
+  for (bool pipelined_ingestion : {false, true}) {
+    Config config;
+    config.pipelined_ingestion = pipelined_ingestion;
+    std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
+    const size_t kChunkSize = trace.size() / 4 + 1;
+    for (size_t offset = 0; offset < trace.size(); offset += kChunkSize) {
+      size_t size = std::min(kChunkSize, trace.size() - offset);
+      ASSERT_TRUE(tp->Parse(CopyToBuffer(trace, offset, size), size).ok());
+    }
+    tp->NotifyEndOfFile();
+    num_sched.push_back(QueryLong(tp.get(), "select count(*) from sched"));
+  }
+  ASSERT_GT(num_sched[0], 0);
+  ASSERT_EQ(num_sched[1], num_sched[0]);
+}
+#endif  // PERFETTO_BUILDFLAG(PERFETTO_ZLIB)
+
+constexpr char kSchedQuery[] =
+    "select ts, cpu, dur, end_state from sched order by ts, cpu";
+constexpr char kSliceQuery[] =
+    "select ts, dur, depth, name from slice order by ts, track_id";
+
+// Tests the import of traces which are still being written, through
+// TraceProcessor::Flush(). The parameter is Config::pipelined_ingestion.
+class IncrementalImportTest : public ::testing::TestWithParam<bool> {
+ protected:
+  std::unique_ptr<TraceProcessor> CreateInstance() {
+    Config config;
+    config.pipelined_ingestion = GetParam();
+    return TraceProcessor::CreateInstance(config);
+  }
+
+  // Imports |trace| in one go.
+  std::unique_ptr<TraceProcessor> ImportAll(const std::string& trace) {
+    std::unique_ptr<TraceProcessor> tp = CreateInstance();
+    EXPECT_TRUE(tp->Parse(CopyToBuffer(trace, 0, trace.size()), trace.size())
+                    .ok());
+    tp->NotifyEndOfFile();
+    return tp;
+  }
+};
+
+TEST_P(IncrementalImportTest, SplitTrace) {
+  constexpr uint32_t kNumBundles = 256;
+  std::string trace = CreateFtraceTrace(kNumBundles, /*write_into_file=*/true);
+  std::unique_ptr<TraceProcessor> expected_tp = ImportAll(trace);
+  const int64_t num_sched = QueryLong(expected_tp.get(), "select count(*) "
+                                                         "from sched");
+  ASSERT_GT(num_sched, 0);
+  const std::string expected_sched_starts =
+      QueryRows(expected_tp.get(), "select ts, cpu from sched order by ts, cpu");
+
+  // Split the trace at random offsets, which don't match the packet
+  // boundaries.
+  std::unique_ptr<TraceProcessor> tp = CreateInstance();
+  std::minstd_rand0 rnd_engine(0);
+  std::uniform_int_distribution<size_t> dist(1, trace.size() / 16);
+  int64_t prev_count = 0;
+  int64_t prev_end_ts = 0;
+  for (size_t offset = 0; offset < trace.size();) {
+    size_t size = std::min(dist(rnd_engine), trace.size() - offset);
+    ASSERT_TRUE(tp->Parse(CopyToBuffer(trace, offset, size), size).ok());
+    offset += size;
+    ASSERT_TRUE(tp->Flush().ok());
+
+    // The rows only ever get added and they are the ones of the complete
+    // trace, in the same order.
+    int64_t count = QueryLong(tp.get(), "select count(*) from sched");
+    ASSERT_GE(count, prev_count);
+    prev_count = count;
+    std::string sched_starts =
+        QueryRows(tp.get(), "select ts, cpu from sched order by ts, cpu");
+    ASSERT_EQ(expected_sched_starts.compare(0, sched_starts.size(),
+                                            sched_starts),
+              0);
+
+    // The bounds follow the import.
+    int64_t end_ts = QueryLong(tp.get(), "select end_ts from trace_bounds");
+    ASSERT_GE(end_ts, prev_end_ts);
+    prev_end_ts = end_ts;
+  }
+
+  // All the events older than the sorting window with respect to the last
+  // one are visible before the end of the file.
+  int64_t max_ts = QueryLong(expected_tp.get(), "select max(ts) from sched");
+  ASSERT_EQ(QueryLong(tp.get(), "select count(*) from sched where ts < " +
+                                    std::to_string(max_ts - kWindowNs - 1)),
+            QueryLong(expected_tp.get(),
+                      "select count(*) from sched where ts < " +
+                          std::to_string(max_ts - kWindowNs - 1)));
+  ASSERT_GT(prev_count, 0);
+  ASSERT_LT(prev_count, num_sched);
+  ASSERT_GT(QueryLong(tp.get(), "select count(*) from slice"), 0);
+
+  tp->NotifyEndOfFile();
+  ASSERT_EQ(QueryRows(tp.get(), kSchedQuery),
+            QueryRows(expected_tp.get(), kSchedQuery));
+  ASSERT_EQ(QueryRows(tp.get(), kSliceQuery),
+            QueryRows(expected_tp.get(), kSliceQuery));
+  ASSERT_EQ(QueryRows(tp.get(), "select * from trace_bounds"),
+            QueryRows(expected_tp.get(), "select * from trace_bounds"));
+}
+
+TEST_P(IncrementalImportTest, FullySortedTraceIsImportedAtEndOfFile) {
+  std::string trace = CreateFtraceTrace(64, /*write_into_file=*/false);
+  std::unique_ptr<TraceProcessor> tp = CreateInstance();
+  size_t half = trace.size() / 2;
+  ASSERT_TRUE(tp->Parse(CopyToBuffer(trace, 0, half), half).ok());
+  ASSERT_TRUE(tp->Flush().ok());
+  ASSERT_TRUE(tp->Parse(CopyToBuffer(trace, half, trace.size() - half),
+                        trace.size() - half)
+                  .ok());
+  ASSERT_TRUE(tp->Flush().ok());
+
+  // Without write_into_file, there is no bound on how late an event can be.
+  ASSERT_EQ(QueryLong(tp.get(), "select count(*) from sched"), 0);
+  tp->NotifyEndOfFile();
+  ASSERT_EQ(QueryRows(tp.get(), kSchedQuery),
+            QueryRows(ImportAll(trace).get(), kSchedQuery));
+}
+
+TEST_P(IncrementalImportTest, TailGrowingFile) {
+  std::string trace = CreateFtraceTrace(128, /*write_into_file=*/true);
+  base::TempFile file = base::TempFile::Create();
+
+  std::unique_ptr<TraceProcessor> tp = CreateInstance();
+  TraceFileTailer tailer(tp.get(), file.path());
+  uint64_t new_bytes = 1;
+  ASSERT_TRUE(tailer.ReadNewData(&new_bytes).ok());
+  ASSERT_EQ(new_bytes, 0u);
+
+  // Append the trace to the file in a few pieces, as the tracing service
+  // would do.
+  int64_t prev_count = 0;
+  for (size_t offset = 0; offset < trace.size();) {
+    size_t size = std::min<size_t>(trace.size() / 5 + 7, trace.size() - offset);
+    ASSERT_EQ(base::WriteAll(file.fd(), trace.data() + offset, size),
+              static_cast<ssize_t>(size));
+    offset += size;
+
+    ASSERT_TRUE(tailer.ReadNewData(&new_bytes).ok());
+    ASSERT_EQ(new_bytes, size);
+    ASSERT_EQ(tailer.bytes_read(), offset);
+    int64_t count = QueryLong(tp.get(), "select count(*) from sched");
+    ASSERT_GE(count, prev_count);
+    prev_count = count;
+  }
+  ASSERT_GT(prev_count, 0);
+
+  ASSERT_TRUE(tailer.Finish().ok());
+  ASSERT_FALSE(tailer.ReadNewData().ok());
+  std::unique_ptr<TraceProcessor> expected_tp = ImportAll(trace);
+  ASSERT_EQ(QueryRows(tp.get(), kSchedQuery),
+            QueryRows(expected_tp.get(), kSchedQuery));
+  ASSERT_EQ(QueryRows(tp.get(), kSliceQuery),
+            QueryRows(expected_tp.get(), kSliceQuery));
+}
+
+INSTANTIATE_TEST_SUITE_P(PipelinedIngestion,
+                         IncrementalImportTest,
+                         ::testing::Bool());
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
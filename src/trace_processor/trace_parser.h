@@ -19,11 +19,15 @@
 
 #include <stdint.h>
 
+#include <utility>
+
 #include "src/trace_processor/timestamped_trace_piece.h"
 
 namespace perfetto {
 namespace trace_processor {
 
+struct DecodedFtraceEvent;
+
 class TraceParser {
  public:
   virtual ~TraceParser();
@@ -32,6 +36,16 @@ class TraceParser {
   virtual void ParseFtracePacket(uint32_t cpu,
                                  int64_t timestamp,
                                  TimestampedTracePiece) = 0;
+
+  // Called instead of ParseFtracePacket() for ftrace events which TraceSorter
+  // has already decoded ahead of time (see DecodeFtraceEvent()). Parsers which
+  // don't care about the pre-decoded data don't need to override this.
+  virtual void ParseDecodedFtracePacket(uint32_t cpu,
+                                        int64_t timestamp,
+                                        TimestampedTracePiece ttp,
+                                        const DecodedFtraceEvent&) {
+    ParseFtracePacket(cpu, timestamp, std::move(ttp));
+  }
 };
 
 }  // namespace trace_processor
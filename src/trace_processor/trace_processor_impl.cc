@@ -35,8 +35,11 @@
 #include "src/trace_processor/importers/gzip/gzip_trace_parser.h"
 #include "src/trace_processor/importers/json/json_trace_parser.h"
 #include "src/trace_processor/importers/json/json_trace_tokenizer.h"
+#include "src/trace_processor/importers/json/json_utils.h"
 #include "src/trace_processor/importers/proto/metadata_tracker.h"
 #include "src/trace_processor/importers/systrace/systrace_trace_parser.h"
+#include "src/trace_processor/sqlite/group_by_operator_table.h"
+#include "src/trace_processor/sqlite/hash_join_operator_table.h"
 #include "src/trace_processor/sqlite/span_join_operator_table.h"
 #include "src/trace_processor/sqlite/sql_stats_table.h"
 #include "src/trace_processor/sqlite/sqlite3_str_split.h"
@@ -45,6 +48,7 @@
 #include "src/trace_processor/sqlite/sqlite_utils.h"
 #include "src/trace_processor/sqlite/stats_table.h"
 #include "src/trace_processor/sqlite/window_operator_table.h"
+#include "src/trace_processor/storage/trace_storage_snapshot.h"
 #include "src/trace_processor/tp_metatrace.h"
 #include "src/trace_processor/types/variadic.h"
 
@@ -546,7 +550,7 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   SetupMetrics(this, *db_, &sql_metrics_);
 
   // Setup the query cache.
-  query_cache_.reset(new QueryCache());
+  query_cache_.reset(new QueryCache(context_.storage.get()));
 
   const TraceStorage* storage = context_.storage.get();
 
@@ -554,7 +558,17 @@ TraceProcessorImpl::TraceProcessorImpl(const Config& cfg)
   StatsTable::RegisterTable(*db_, storage);
 
   // Operator tables.
-  SpanJoinOperatorTable::RegisterTable(*db_, storage);
+  if (cfg.span_join_threads > 1) {
+    // The thread calling ParallelFor() also runs tasks.
+    span_join_pool_.reset(
+        new base::ThreadPool(cfg.span_join_threads - 1, "SpanJoin"));
+  }
+  SpanJoinOperatorTable::Context span_join_context;
+  span_join_context.overlapping_tables = &overlapping_tables_;
+  span_join_context.partition_pool = span_join_pool_.get();
+  SpanJoinOperatorTable::RegisterTable(*db_, span_join_context);
+  HashJoinOperatorTable::RegisterTable(*db_, &static_tables_);
+  GroupByOperatorTable::RegisterTable(*db_, &static_tables_);
   WindowOperatorTable::RegisterTable(*db_, storage);
 
   // New style tables but with some custom logic.
@@ -629,10 +643,34 @@ TraceProcessorImpl::~TraceProcessorImpl() {
 
 util::Status TraceProcessorImpl::Parse(std::unique_ptr<uint8_t[]> data,
                                        size_t size) {
+  if (snapshot_loaded_)
+    return util::ErrStatus("Cannot parse data after loading a snapshot");
   bytes_parsed_ += size;
   return TraceProcessorStorageImpl::Parse(std::move(data), size);
 }
 
+util::Status TraceProcessorImpl::ParseSharedBuffer(
+    std::shared_ptr<const uint8_t> data,
+    size_t size) {
+  if (snapshot_loaded_)
+    return util::ErrStatus("Cannot parse data after loading a snapshot");
+  bytes_parsed_ += size;
+  return TraceProcessorStorageImpl::ParseSharedBuffer(std::move(data), size);
+}
+
+util::Status TraceProcessorImpl::Flush() {
+  if (snapshot_loaded_)
+    return util::ErrStatus("Cannot parse data after loading a snapshot");
+  util::Status status = TraceProcessorStorageImpl::Flush();
+  if (!status.ok())
+    return status;
+
+  // The tables are updated in place so the new rows are already visible, only
+  // the trace bounds need to be recomputed.
+  OnTraceLoaded();
+  return util::OkStatus();
+}
+
 std::string TraceProcessorImpl::GetCurrentTraceName() {
   if (current_trace_name_.empty())
     return "";
@@ -654,12 +692,24 @@ void TraceProcessorImpl::NotifyEndOfFile() {
   context_.metadata_tracker->SetMetadata(
       metadata::trace_size_bytes,
       Variadic::Integer(static_cast<int64_t>(bytes_parsed_)));
+  if (context_.config.compact_columns) {
+    uint64_t saved = context_.storage->CompactColumns();
+    context_.storage->SetStats(stats::column_compaction_bytes_saved,
+                               static_cast<int64_t>(saved));
+  }
+  OnTraceLoaded();
+}
+
+void TraceProcessorImpl::OnTraceLoaded() {
   BuildBoundsTable(*db_, context_.storage->GetTraceTimestampBoundsNs());
 
   // Create a snapshot of all tables and views created so far. This is so later
   // we can drop all extra tables created by the UI and reset to the original
-  // state (see RestoreInitialTables).
-  initial_tables_.clear();
+  // state (see RestoreInitialTables). When the trace is imported incrementally
+  // this is only done on the first Flush(), so that the tables created by the
+  // user afterwards are not part of the snapshot.
+  if (!initial_tables_.empty())
+    return;
   auto it = ExecuteQuery(kAllTablesQuery);
   while (it.Next()) {
     auto value = it.Get(0);
@@ -668,6 +718,27 @@ void TraceProcessorImpl::NotifyEndOfFile() {
   }
 }
 
+util::Status TraceProcessorImpl::SaveSnapshot(const std::string& path) {
+  return SaveTraceStorageSnapshot(*context_.storage, path);
+}
+
+util::Status TraceProcessorImpl::LoadSnapshot(const std::string& path) {
+  if (context_.chunk_reader || snapshot_loaded_)
+    return util::ErrStatus("Snapshots must be loaded instead of a trace");
+
+  // Even if loading fails, the storage is left in an unspecified state so
+  // nothing can be parsed into it anymore.
+  snapshot_loaded_ = true;
+  util::Status status =
+      LoadTraceStorageSnapshot(path, context_.storage.get());
+  if (!status.ok())
+    return status;
+  if (current_trace_name_.empty())
+    current_trace_name_ = "Snapshot " + path;
+  OnTraceLoaded();
+  return util::OkStatus();
+}
+
 size_t TraceProcessorImpl::RestoreInitialTables() {
   std::vector<std::pair<std::string, std::string>> deletion_list;
   std::string msg = "Resetting DB to initial state, deleting table/views:";
@@ -21,16 +21,21 @@
 
 #include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "perfetto/ext/base/string_view.h"
+#include "perfetto/ext/base/thread_pool.h"
 #include "perfetto/trace_processor/basic_types.h"
 #include "perfetto/trace_processor/status.h"
 #include "perfetto/trace_processor/trace_processor.h"
+#include "src/trace_processor/dynamic/experimental_overlapping_generator.h"
 #include "src/trace_processor/sqlite/db_sqlite_table.h"
+#include "src/trace_processor/sqlite/hash_join_operator_table.h"
 #include "src/trace_processor/sqlite/query_cache.h"
 #include "src/trace_processor/sqlite/scoped_db.h"
+#include "src/trace_processor/sqlite/span_join_operator_table.h"
 #include "src/trace_processor/trace_processor_storage_impl.h"
 
 #include "src/trace_processor/metrics/metrics.h"
@@ -50,6 +55,9 @@ class TraceProcessorImpl : public TraceProcessor,
 
   // TraceProcessorStorage implementation:
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseSharedBuffer(std::shared_ptr<const uint8_t>,
+                                 size_t) override;
+  util::Status Flush() override;
   void NotifyEndOfFile() override;
 
   // TraceProcessor implementation:
@@ -68,6 +76,9 @@ class TraceProcessorImpl : public TraceProcessor,
 
   size_t RestoreInitialTables() override;
 
+  util::Status SaveSnapshot(const std::string& path) override;
+  util::Status LoadSnapshot(const std::string& path) override;
+
   std::string GetCurrentTraceName() override;
   void SetCurrentTraceName(const std::string&) override;
 
@@ -84,8 +95,21 @@ class TraceProcessorImpl : public TraceProcessor,
   void RegisterDbTable(const Table& table) {
     DbSqliteTable::RegisterTable(*db_, query_cache_.get(), Table::Schema(),
                                  &table, table.table_name());
+    static_tables_[table.table_name()] = &table;
+
+    if (ExperimentalOverlappingGenerator::IsSupported(table)) {
+      RegisterDynamicTable(std::unique_ptr<ExperimentalOverlappingGenerator>(
+          new ExperimentalOverlappingGenerator(Table::Schema(), &table,
+                                               table.table_name())));
+      overlapping_tables_[table.table_name()] =
+          ExperimentalOverlappingGenerator::TableNameFor(table.table_name());
+    }
   }
 
+  // Builds the state which depends on the trace having been loaded (either
+  // parsed, up to the last Flush() or entirely, or restored from a snapshot).
+  void OnTraceLoaded();
+
   void RegisterDynamicTable(
       std::unique_ptr<DbSqliteTable::DynamicTableGenerator> generator) {
     DbSqliteTable::RegisterTable(*db_, query_cache_.get(),
@@ -95,6 +119,15 @@ class TraceProcessorImpl : public TraceProcessor,
   ScopedDb db_;
   std::unique_ptr<QueryCache> query_cache_;
 
+  // The tables which operator tables (e.g. hash_join) can be computed from.
+  DbSqliteTable::StaticTableMap static_tables_;
+
+  // The tables which span_join can read through an interval index.
+  SpanJoinOperatorTable::OverlappingTableMap overlapping_tables_;
+
+  // Only set if partitions of span joins are joined in parallel.
+  std::unique_ptr<base::ThreadPool> span_join_pool_;
+
   DescriptorPool pool_;
   std::vector<metrics::SqlMetricFile> sql_metrics_;
 
@@ -111,6 +144,9 @@ class TraceProcessorImpl : public TraceProcessor,
 
   std::string current_trace_name_;
   uint64_t bytes_parsed_ = 0;
+
+  // Set once a snapshot has been loaded, after which nothing can be parsed.
+  bool snapshot_loaded_ = false;
 };
 
 // The pointer implementation of TraceProcessor::Iterator.
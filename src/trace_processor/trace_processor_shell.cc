@@ -90,6 +90,9 @@ namespace trace_processor {
 namespace {
 TraceProcessor* g_tp;
 
+// Only set with --follow.
+TraceFileTailer* g_tailer;
+
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_LINENOISE)
 
 bool EnsureDir(const std::string& path) {
@@ -536,6 +539,19 @@ util::Status StartInteractiveShell(uint32_t column_width) {
       continue;
     }
 
+    // Import what was appended to the trace since the previous query.
+    if (g_tailer) {
+      uint64_t new_bytes = 0;
+      util::Status status = g_tailer->ReadNewData(&new_bytes);
+      if (!status.ok()) {
+        PERFETTO_ELOG("Failed to read the new trace data: %s",
+                      status.c_message());
+      } else if (new_bytes > 0) {
+        PERFETTO_ILOG("Imported %.2f MB of new trace data",
+                      static_cast<double>(new_bytes) / 1E6);
+      }
+    }
+
     base::TimeNanos t_start = base::GetWallTimeNs();
     auto it = g_tp->ExecuteQuery(line.get());
     PrintQueryResultInteractively(&it, t_start, column_width);
@@ -703,6 +719,16 @@ struct CommandLineOptions {
   bool enable_httpd = false;
   bool wide = false;
   bool force_full_sort = false;
+  bool pipelined_ingestion = false;
+  bool parallel_ftrace_decoding = false;
+  uint64_t sorter_memory_budget_mb = 0;
+  uint32_t span_join_threads = 0;
+  bool mmap_trace_file = false;
+  bool follow_trace_file = false;
+  std::string save_snapshot_path;
+  bool from_snapshot = false;
+  std::string string_pool_file;
+  bool compact_columns = false;
   std::string metatrace_path;
 };
 
@@ -798,7 +824,40 @@ Options:
                                       writing the resulting trace into FILE.
  --full-sort                          Forces the trace processor into performing
                                       a full sort ignoring any windowing
-                                      logic.)",
+                                      logic.
+ --pipelined-ingestion                Splits proto traces into packets (and
+                                      inflates compressed packets and gzip
+                                      traces) on separate threads while
+                                      parsing.
+ --parallel-ftrace-decoding           Decodes ftrace events on all the
+                                      available cores.
+ --sorter-memory-budget-mb MB         Moves the events waiting to be sorted to
+                                      a temporary file when they take more
+                                      than MB megabytes of memory. Useful with
+                                      --full-sort on large traces.
+ --span-join-threads N                Joins the partitions of SPAN_JOIN tables
+                                      partitioned on both sides on up to N
+                                      threads.
+ --mmap                               Maps the trace file in memory instead of
+                                      reading it, so that the trace data is not
+                                      copied. The file must not be modified
+                                      while trace processor is running.
+ --follow                             Imports the trace file while it is still
+                                      being written (e.g. by a write_into_file
+                                      tracing session) and imports the data
+                                      appended to it before each query of the
+                                      interactive shell.
+ --save-snapshot FILE                 Saves the contents of trace processor
+                                      into FILE once the trace is loaded, so
+                                      that it can be reloaded faster with
+                                      --from-snapshot.
+ --from-snapshot                      Loads the trace from a file written with
+                                      --save-snapshot instead of parsing it.
+ --string-pool-file FILE              Stores the interned strings in FILE
+                                      instead of memory, reusing the strings
+                                      already in FILE if any.
+ --compact-columns                    Compresses the integer columns of the
+                                      tables once the trace is loaded.)",
                 argv[0]);
 }
 
@@ -808,6 +867,16 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     OPT_RUN_METRICS = 1000,
     OPT_METRICS_OUTPUT,
     OPT_FORCE_FULL_SORT,
+    OPT_PIPELINED_INGESTION,
+    OPT_PARALLEL_FTRACE_DECODING,
+    OPT_SORTER_MEMORY_BUDGET_MB,
+    OPT_SPAN_JOIN_THREADS,
+    OPT_MMAP,
+    OPT_FOLLOW,
+    OPT_SAVE_SNAPSHOT,
+    OPT_FROM_SNAPSHOT,
+    OPT_STRING_POOL_FILE,
+    OPT_COMPACT_COLUMNS,
   };
 
   static const struct option long_options[] = {
@@ -824,6 +893,18 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       {"run-metrics", required_argument, nullptr, OPT_RUN_METRICS},
       {"metrics-output", required_argument, nullptr, OPT_METRICS_OUTPUT},
       {"full-sort", no_argument, nullptr, OPT_FORCE_FULL_SORT},
+      {"pipelined-ingestion", no_argument, nullptr, OPT_PIPELINED_INGESTION},
+      {"parallel-ftrace-decoding", no_argument, nullptr,
+       OPT_PARALLEL_FTRACE_DECODING},
+      {"sorter-memory-budget-mb", required_argument, nullptr,
+       OPT_SORTER_MEMORY_BUDGET_MB},
+      {"span-join-threads", required_argument, nullptr, OPT_SPAN_JOIN_THREADS},
+      {"mmap", no_argument, nullptr, OPT_MMAP},
+      {"follow", no_argument, nullptr, OPT_FOLLOW},
+      {"save-snapshot", required_argument, nullptr, OPT_SAVE_SNAPSHOT},
+      {"from-snapshot", no_argument, nullptr, OPT_FROM_SNAPSHOT},
+      {"string-pool-file", required_argument, nullptr, OPT_STRING_POOL_FILE},
+      {"compact-columns", no_argument, nullptr, OPT_COMPACT_COLUMNS},
       {nullptr, 0, nullptr, 0}};
 
   bool explicit_interactive = false;
@@ -899,6 +980,66 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
       continue;
     }
 
+    if (option == OPT_PIPELINED_INGESTION) {
+      command_line_options.pipelined_ingestion = true;
+      continue;
+    }
+
+    if (option == OPT_PARALLEL_FTRACE_DECODING) {
+      command_line_options.parallel_ftrace_decoding = true;
+      continue;
+    }
+
+    if (option == OPT_SORTER_MEMORY_BUDGET_MB) {
+      base::Optional<uint64_t> budget = base::CStringToUInt64(optarg);
+      if (!budget || *budget == 0) {
+        PERFETTO_ELOG("Invalid --sorter-memory-budget-mb: %s", optarg);
+        exit(1);
+      }
+      command_line_options.sorter_memory_budget_mb = *budget;
+      continue;
+    }
+
+    if (option == OPT_SPAN_JOIN_THREADS) {
+      base::Optional<uint32_t> threads = base::CStringToUInt32(optarg);
+      if (!threads || *threads == 0) {
+        PERFETTO_ELOG("Invalid --span-join-threads: %s", optarg);
+        exit(1);
+      }
+      command_line_options.span_join_threads = *threads;
+      continue;
+    }
+
+    if (option == OPT_MMAP) {
+      command_line_options.mmap_trace_file = true;
+      continue;
+    }
+
+    if (option == OPT_FOLLOW) {
+      command_line_options.follow_trace_file = true;
+      continue;
+    }
+
+    if (option == OPT_SAVE_SNAPSHOT) {
+      command_line_options.save_snapshot_path = optarg;
+      continue;
+    }
+
+    if (option == OPT_FROM_SNAPSHOT) {
+      command_line_options.from_snapshot = true;
+      continue;
+    }
+
+    if (option == OPT_STRING_POOL_FILE) {
+      command_line_options.string_pool_file = optarg;
+      continue;
+    }
+
+    if (option == OPT_COMPACT_COLUMNS) {
+      command_line_options.compact_columns = true;
+      continue;
+    }
+
     PrintUsage(argv);
     exit(option == 'h' ? 0 : 1);
   }
@@ -906,7 +1047,8 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
   command_line_options.launch_shell =
       explicit_interactive || (command_line_options.metric_names.empty() &&
                                command_line_options.query_file_path.empty() &&
-                               command_line_options.sqlite_file_path.empty());
+                               command_line_options.sqlite_file_path.empty() &&
+                               command_line_options.save_snapshot_path.empty());
 
   // Only allow non-interactive queries to emit perf data.
   if (!command_line_options.perf_file_path.empty() &&
@@ -915,6 +1057,17 @@ CommandLineOptions ParseCommandLineOptions(int argc, char** argv) {
     exit(1);
   }
 
+  // The trace is only read again by the interactive shell.
+  if (command_line_options.follow_trace_file &&
+      (!command_line_options.launch_shell ||
+       command_line_options.enable_httpd ||
+       command_line_options.mmap_trace_file ||
+       command_line_options.from_snapshot ||
+       !command_line_options.save_snapshot_path.empty())) {
+    PrintUsage(argv);
+    exit(1);
+  }
+
   // The only case where we allow omitting the trace file path is when running
   // in --http mode. In all other cases, the last argument must be the trace
   // file.
@@ -939,12 +1092,18 @@ void ExtendPoolWithBinaryDescriptor(google::protobuf::DescriptorPool& pool,
   }
 }
 
-util::Status LoadTrace(const std::string& trace_file_path, double* size_mb) {
+util::Status LoadTrace(const std::string& trace_file_path,
+                       bool mmap_trace_file,
+                       double* size_mb) {
+  auto progress_callback = [&size_mb](size_t parsed_size) {
+    *size_mb = parsed_size / 1E6;
+    fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
+  };
   util::Status read_status =
-      ReadTrace(g_tp, trace_file_path.c_str(), [&size_mb](size_t parsed_size) {
-        *size_mb = parsed_size / 1E6;
-        fprintf(stderr, "\rLoading trace: %.2f MB\r", *size_mb);
-      });
+      mmap_trace_file ? ReadTraceMapped(g_tp, trace_file_path.c_str(),
+                                        progress_callback)
+                      : ReadTrace(g_tp, trace_file_path.c_str(),
+                                  progress_callback);
   if (!read_status.ok()) {
     return util::ErrStatus("Could not read trace file (path: %s): %s",
                            trace_file_path.c_str(), read_status.c_message());
@@ -1048,6 +1207,13 @@ util::Status TraceProcessorMain(int argc, char** argv) {
 
   Config config;
   config.force_full_sort = options.force_full_sort;
+  config.pipelined_ingestion = options.pipelined_ingestion;
+  config.parallel_ftrace_decoding = options.parallel_ftrace_decoding;
+  config.sorter_memory_budget_bytes =
+      options.sorter_memory_budget_mb * 1024 * 1024;
+  config.span_join_threads = options.span_join_threads;
+  config.string_pool_file = options.string_pool_file;
+  config.compact_columns = options.compact_columns;
 
   std::unique_ptr<TraceProcessor> tp = TraceProcessor::CreateInstance(config);
   g_tp = tp.get();
@@ -1058,10 +1224,26 @@ util::Status TraceProcessorMain(int argc, char** argv) {
   }
 
   base::TimeNanos t_load{};
+  std::unique_ptr<TraceFileTailer> tailer;
   if (!options.trace_file_path.empty()) {
     base::TimeNanos t_load_start = base::GetWallTimeNs();
     double size_mb = 0;
-    RETURN_IF_ERROR(LoadTrace(options.trace_file_path, &size_mb));
+    if (options.from_snapshot) {
+      RETURN_IF_ERROR(tp->LoadSnapshot(options.trace_file_path));
+      struct stat st {};
+      if (stat(options.trace_file_path.c_str(), &st) == 0)
+        size_mb = static_cast<double>(st.st_size) / 1E6;
+    } else if (options.follow_trace_file) {
+      // The symbolization done by LoadTrace() needs the whole trace, so it is
+      // skipped.
+      tailer.reset(new TraceFileTailer(tp.get(), options.trace_file_path));
+      g_tailer = tailer.get();
+      RETURN_IF_ERROR(tailer->ReadNewData());
+      size_mb = static_cast<double>(tailer->bytes_read()) / 1E6;
+    } else {
+      RETURN_IF_ERROR(LoadTrace(options.trace_file_path,
+                                options.mmap_trace_file, &size_mb));
+    }
     t_load = base::GetWallTimeNs() - t_load_start;
 
     double t_load_s = t_load.count() / 1E9;
@@ -1069,6 +1251,11 @@ util::Status TraceProcessorMain(int argc, char** argv) {
                   size_mb / t_load_s);
 
     RETURN_IF_ERROR(PrintStats());
+
+    if (!options.save_snapshot_path.empty()) {
+      RETURN_IF_ERROR(tp->SaveSnapshot(options.save_snapshot_path));
+      PERFETTO_ILOG("Snapshot saved to %s", options.save_snapshot_path.c_str());
+    }
   }
 
 #if PERFETTO_BUILDFLAG(PERFETTO_TP_HTTPD)
@@ -16,6 +16,7 @@
 
 #include "src/trace_processor/trace_processor_storage_impl.h"
 
+#include "perfetto/base/build_config.h"
 #include "perfetto/base/logging.h"
 #include "src/trace_processor/forwarding_trace_parser.h"
 #include "src/trace_processor/importers/common/args_tracker.h"
@@ -34,9 +35,44 @@
 #include "src/trace_processor/trace_blob_view.h"
 #include "src/trace_processor/trace_sorter.h"
 
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_LINUX) ||   \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_ANDROID) || \
+    PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+#include <sys/resource.h>
+#define PERFETTO_TP_HAS_GETRUSAGE() 1
+#else
+#define PERFETTO_TP_HAS_GETRUSAGE() 0
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+// The sorter can't return errors from the pushes which extract its events, so
+// they surface in the Parse() call which caused the extraction.
+util::Status GetSorterStatus(const TraceProcessorContext& context) {
+  return context.sorter ? context.sorter->spill_status() : util::OkStatus();
+}
+
+void RecordPeakRss(TraceStorage* storage) {
+#if PERFETTO_TP_HAS_GETRUSAGE()
+  struct rusage usage {};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return;
+#if PERFETTO_BUILDFLAG(PERFETTO_OS_MACOSX)
+  int64_t peak_rss_bytes = static_cast<int64_t>(usage.ru_maxrss);
+#else
+  int64_t peak_rss_bytes = static_cast<int64_t>(usage.ru_maxrss) * 1024;
+#endif
+  storage->SetStats(stats::peak_rss_bytes, peak_rss_bytes);
+#else
+  base::ignore_result(storage);
+#endif
+}
+
+}  // namespace
+
 TraceProcessorStorageImpl::TraceProcessorStorageImpl(const Config& cfg) {
   context_.config = cfg;
   context_.storage.reset(new TraceStorage(context_.config));
@@ -69,6 +105,47 @@ util::Status TraceProcessorStorageImpl::Parse(std::unique_ptr<uint8_t[]> data,
   auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
       stats::parse_trace_duration_ns);
   util::Status status = context_.chunk_reader->Parse(std::move(data), size);
+  if (status.ok())
+    status = GetSorterStatus(context_);
+  unrecoverable_parse_error_ |= !status.ok();
+  return status;
+}
+
+util::Status TraceProcessorStorageImpl::ParseSharedBuffer(
+    std::shared_ptr<const uint8_t> data,
+    size_t size) {
+  if (size == 0)
+    return util::OkStatus();
+  if (unrecoverable_parse_error_)
+    return util::ErrStatus(
+        "Failed unrecoverably while parsing in a previous Parse call");
+  if (!context_.chunk_reader)
+    context_.chunk_reader.reset(new ForwardingTraceParser(&context_));
+
+  auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
+      stats::parse_trace_duration_ns);
+  util::Status status = context_.chunk_reader->ParseBlob(
+      TraceBlobView::FromSharedBuffer(std::move(data), 0, size));
+  if (status.ok())
+    status = GetSorterStatus(context_);
+  unrecoverable_parse_error_ |= !status.ok();
+  return status;
+}
+
+util::Status TraceProcessorStorageImpl::Flush() {
+  if (unrecoverable_parse_error_)
+    return util::ErrStatus(
+        "Failed unrecoverably while parsing in a previous Parse call");
+  if (!context_.chunk_reader)
+    return util::OkStatus();
+
+  // The sorter doesn't need to be flushed: the events older than its window
+  // were already extracted as the newer ones were pushed.
+  auto scoped_trace = context_.storage->TraceExecutionTimeIntoStats(
+      stats::parse_trace_duration_ns);
+  util::Status status = context_.chunk_reader->Flush();
+  if (status.ok())
+    status = GetSorterStatus(context_);
   unrecoverable_parse_error_ |= !status.ok();
   return status;
 }
@@ -78,14 +155,37 @@ void TraceProcessorStorageImpl::NotifyEndOfFile() {
     return;
 
   context_.chunk_reader->NotifyEndOfFile();
-  if (context_.sorter)
+  if (context_.sorter) {
     context_.sorter->ExtractEventsForced();
+    context_.storage->SetStats(
+        stats::sorter_spilled_events,
+        static_cast<int64_t>(context_.sorter->num_spilled_events()));
+    context_.storage->SetStats(
+        stats::sorter_spilled_bytes,
+        static_cast<int64_t>(context_.sorter->num_spilled_bytes()));
+    context_.storage->SetStats(
+        stats::sorter_spill_write_errors,
+        static_cast<int64_t>(context_.sorter->num_spill_write_errors()));
+    context_.storage->SetStats(
+        stats::sorter_spill_read_errors,
+        static_cast<int64_t>(context_.sorter->num_spill_read_errors()));
+
+    // NotifyEndOfFile() can't return errors: the events which the sorter
+    // failed to read back are reported in the stats, like other errors found
+    // while draining the end of the trace.
+    util::Status status = GetSorterStatus(context_);
+    if (!status.ok()) {
+      PERFETTO_ELOG("Failed sorting the end of the trace: %s",
+                    status.c_message());
+    }
+  }
   context_.event_tracker->FlushPendingEvents();
   context_.slice_tracker->FlushPendingSlices();
   context_.heap_profile_tracker->NotifyEndOfFile();
   for (std::unique_ptr<ProtoImporterModule>& module : context_.modules) {
     module->NotifyEndOfFile();
   }
+  RecordPeakRss(context_.storage.get());
 }
 
 }  // namespace trace_processor
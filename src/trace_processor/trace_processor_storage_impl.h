@@ -33,6 +33,9 @@ class TraceProcessorStorageImpl : public TraceProcessorStorage {
   ~TraceProcessorStorageImpl() override;
 
   util::Status Parse(std::unique_ptr<uint8_t[]>, size_t) override;
+  util::Status ParseSharedBuffer(std::shared_ptr<const uint8_t>,
+                                 size_t) override;
+  util::Status Flush() override;
   void NotifyEndOfFile() override;
 
   TraceProcessorContext* context() { return &context_; }
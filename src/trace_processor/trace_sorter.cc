@@ -15,15 +15,193 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <tuple>
 #include <utility>
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/base/compiler.h"
+#include "perfetto/ext/base/file_utils.h"
 #include "perfetto/ext/base/utils.h"
 #include "src/trace_processor/importers/proto/proto_trace_parser.h"
 #include "src/trace_processor/trace_sorter.h"
 
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN) &&  \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_WASM) && \
+    !PERFETTO_BUILDFLAG(PERFETTO_OS_NACL)
+#include <unistd.h>
+
+#include "perfetto/ext/base/temp_file.h"
+#define PERFETTO_TP_HAS_SORTER_SPILLING() 1
+#else
+#define PERFETTO_TP_HAS_SORTER_SPILLING() 0
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 
+namespace {
+
+using Type = TimestampedTracePiece::Type;
+
+// Spilled events are laid out as:
+// [timestamp: int64][packet_idx: uint32][type: uint8][payload_size: uint32]
+// followed by the payload. Ftrace events, packets and track events carry their
+// bytes in the payload, preceded by the pointers and fields which go along
+// with them. Pointers stay valid as the file is only read by this process.
+constexpr size_t kSpilledHeaderSize = 8 + 4 + 1 + 4;
+
+constexpr char kCorruptedSpillFile[] = "Corrupted sorter spill file";
+
+bool CanSpill(const TimestampedTracePiece& ttp) {
+  switch (ttp.type) {
+    case Type::kFtraceEvent:
+    case Type::kTracePacket:
+    case Type::kTrackEvent:
+    case Type::kInlineSchedSwitch:
+    case Type::kInlineSchedWaking:
+      return true;
+    case Type::kInvalid:
+    case Type::kJsonEvent:
+    case Type::kFuchsiaRecord:
+    case Type::kSystraceLine:
+      return false;
+  }
+  return false;
+}
+
+// The size of the fields which precede the bytes of the event in the payload of
+// a spilled event, see SerializePiece().
+size_t SpilledFieldsSize(Type type) {
+  switch (type) {
+    case Type::kTracePacket:
+      return sizeof(PacketSequenceStateGeneration*);
+    case Type::kTrackEvent:
+      return sizeof(PacketSequenceStateGeneration*) +
+             (3 + TrackEventData::kMaxNumExtraCounters) * sizeof(int64_t);
+    case Type::kInlineSchedSwitch:
+      return sizeof(int64_t) + 2 * sizeof(int32_t) + sizeof(uint32_t);
+    case Type::kInlineSchedWaking:
+      return 3 * sizeof(int32_t) + sizeof(uint32_t);
+    case Type::kFtraceEvent:
+    case Type::kInvalid:
+    case Type::kJsonEvent:
+    case Type::kFuchsiaRecord:
+    case Type::kSystraceLine:
+      return 0;
+  }
+  return 0;
+}
+
+template <typename T>
+void AppendPod(const T& value, std::vector<uint8_t>* buf) {
+  const uint8_t* ptr = reinterpret_cast<const uint8_t*>(&value);
+  buf->insert(buf->end(), ptr, ptr + sizeof(T));
+}
+
+template <typename T>
+T ReadPod(const uint8_t** ptr) {
+  T value;
+  memcpy(&value, *ptr, sizeof(T));
+  *ptr += sizeof(T);
+  return value;
+}
+
+void SerializePiece(const TimestampedTracePiece& ttp,
+                    std::vector<uint8_t>* buf) {
+  AppendPod(ttp.timestamp, buf);
+  AppendPod(ttp.packet_idx, buf);
+  AppendPod(static_cast<uint8_t>(ttp.type), buf);
+  size_t size_offset = buf->size();
+  AppendPod(uint32_t(0), buf);
+
+  const TraceBlobView* blob = nullptr;
+  switch (ttp.type) {
+    case Type::kFtraceEvent:
+      blob = &ttp.ftrace_event;
+      break;
+    case Type::kTracePacket:
+      AppendPod(ttp.packet_data.sequence_state, buf);
+      blob = &ttp.packet_data.packet;
+      break;
+    case Type::kTrackEvent: {
+      const TrackEventData& data = *ttp.track_event_data;
+      AppendPod(data.sequence_state, buf);
+      AppendPod(data.thread_timestamp, buf);
+      AppendPod(data.thread_instruction_count, buf);
+      AppendPod(data.counter_value, buf);
+      for (int64_t value : data.extra_counter_values)
+        AppendPod(value, buf);
+      blob = &data.packet;
+      break;
+    }
+    case Type::kInlineSchedSwitch:
+      AppendPod(ttp.sched_switch.prev_state, buf);
+      AppendPod(ttp.sched_switch.next_pid, buf);
+      AppendPod(ttp.sched_switch.next_prio, buf);
+      AppendPod(ttp.sched_switch.next_comm.raw_id(), buf);
+      break;
+    case Type::kInlineSchedWaking:
+      AppendPod(ttp.sched_waking.pid, buf);
+      AppendPod(ttp.sched_waking.target_cpu, buf);
+      AppendPod(ttp.sched_waking.prio, buf);
+      AppendPod(ttp.sched_waking.comm.raw_id(), buf);
+      break;
+    case Type::kInvalid:
+    case Type::kJsonEvent:
+    case Type::kFuchsiaRecord:
+    case Type::kSystraceLine:
+      PERFETTO_FATAL("Event can't be spilled");
+  }
+  if (blob)
+    buf->insert(buf->end(), blob->data(), blob->data() + blob->length());
+
+  uint32_t size = static_cast<uint32_t>(buf->size() - size_offset - 4);
+  memcpy(buf->data() + size_offset, &size, sizeof(size));
+}
+
+#if PERFETTO_TP_HAS_SORTER_SPILLING()
+base::ScopedFile CreateSpillFile() {
+  return base::TempFile::CreateUnlinked().ReleaseFD();
+}
+
+bool ReadSpillFile(int fd, uint64_t offset, uint8_t* dst, size_t size) {
+  while (size > 0) {
+    ssize_t rsize =
+        PERFETTO_EINTR(pread(fd, dst, size, static_cast<off_t>(offset)));
+    if (rsize <= 0)
+      return false;
+    dst += rsize;
+    offset += static_cast<uint64_t>(rsize);
+    size -= static_cast<size_t>(rsize);
+  }
+  return true;
+}
+
+bool TruncateSpillFile(int fd) {
+  return ftruncate(fd, 0) == 0 && lseek(fd, 0, SEEK_SET) == 0;
+}
+#else
+base::ScopedFile CreateSpillFile() {
+  return base::ScopedFile();
+}
+
+bool ReadSpillFile(int, uint64_t, uint8_t*, size_t) {
+  return false;
+}
+
+bool TruncateSpillFile(int) {
+  return false;
+}
+#endif  // PERFETTO_TP_HAS_SORTER_SPILLING()
+
+}  // namespace
+
+constexpr size_t TraceSorter::kMaxDecodedEventsPerQueue;
+constexpr size_t TraceSorter::kEventsPerDecodingTask;
+constexpr size_t TraceSorter::kSpillBlockSize;
+constexpr uint32_t TraceSorter::kNotSpilled;
+
 TraceSorter::TraceSorter(std::unique_ptr<TraceParser> parser,
                          int64_t window_size_ns)
     : parser_(std::move(parser)), window_size_ns_(window_size_ns) {
@@ -33,6 +211,230 @@ TraceSorter::TraceSorter(std::unique_ptr<TraceParser> parser,
     PERFETTO_ELOG("TEST MODE: bypassing protobuf parsing stage");
 }
 
+TraceSorter::~TraceSorter() {
+  // The payloads of the events which haven't been extracted belong to the
+  // pools.
+  auto delete_payloads = [this](Queue& queue) {
+    for (const TimestampedTracePiece& event : queue.events_)
+      DeletePayload(event);
+  };
+  if (!queues_.empty())
+    delete_payloads(queues_[0]);
+  for (SpilledQueue& spilled : spilled_queues_)
+    delete_payloads(spilled.queue);
+}
+
+void TraceSorter::EnableParallelFtraceDecoding(uint32_t num_threads) {
+  ftrace_decoding_pool_.reset(new base::ThreadPool(num_threads, "FtraceDecode"));
+}
+
+void TraceSorter::EnableSpillingToDisk(uint64_t memory_budget_bytes) {
+#if PERFETTO_TP_HAS_SORTER_SPILLING()
+  memory_budget_bytes_ = memory_budget_bytes;
+  spill_threshold_bytes_ = memory_budget_bytes;
+#else
+  base::ignore_result(memory_budget_bytes);
+  PERFETTO_ELOG("Spilling to disk is not supported on this platform");
+#endif
+}
+
+void TraceSorter::SpillEventsToDisk() {
+  if (!spill_file_) {
+    spill_file_ = CreateSpillFile();
+    if (!spill_file_) {
+      DisableSpilling("Failed to create the sorter spill file");
+      return;
+    }
+  }
+
+  std::vector<uint8_t> buf;
+  buf.reserve(kSpillBlockSize);
+  auto flush = [this, &buf] {
+    if (base::WriteAll(*spill_file_, buf.data(), buf.size()) !=
+        static_cast<ssize_t>(buf.size())) {
+      return false;
+    }
+    spill_file_size_ += buf.size();
+    spill_file_size_total_ += buf.size();
+    buf.clear();
+    return true;
+  };
+
+  for (uint32_t i = 0; i < queues_.size(); i++) {
+    Queue& queue = queues_[i];
+    auto& events = queue.events_;
+    if (events.empty() || !std::all_of(events.begin(), events.end(), CanSpill))
+      continue;
+    if (queue.needs_sorting())
+      queue.Sort();
+
+    // The events are released only once all of them have been written. The
+    // part of the file written before a failure is left unreferenced.
+    SpilledQueue spilled;
+    spilled.queue_idx = i;
+    spilled.file_offset = spill_file_size_;
+    spilled.queue.min_ts_ = queue.min_ts_;
+    spilled.queue.max_ts_ = queue.max_ts_;
+    bool written = true;
+    for (const TimestampedTracePiece& event : events) {
+      SerializePiece(event, &buf);
+      if (buf.size() >= kSpillBlockSize && !flush()) {
+        written = false;
+        break;
+      }
+    }
+    if (!written || !flush()) {
+      DisableSpilling("Failed to write the sorter spill file");
+      return;
+    }
+    for (const TimestampedTracePiece& event : events) {
+      memory_usage_ -= MemoryUsage(event);
+      DeletePayload(event);
+    }
+    spilled.bytes_left = spill_file_size_ - spilled.file_offset;
+    num_spilled_events_ += events.size();
+    spilled_queues_.emplace_back(std::move(spilled));
+
+    // Start from scratch, also to release the memory of the queue itself.
+    queue = Queue();
+  }
+
+  // The events which can't be spilled (if any) don't count towards the
+  // budget, otherwise every push would try to spill them again.
+  spill_threshold_bytes_ = memory_usage_ + memory_budget_bytes_;
+}
+
+void TraceSorter::DisableSpilling(const char* error) {
+  // A full or unwritable temp dir isn't fatal: the events which can't be
+  // spilled stay in memory, as if spilling hadn't been enabled.
+  PERFETTO_ELOG("%s, keeping the sorter events in memory", error);
+  num_spill_write_errors_++;
+  spill_threshold_bytes_ = std::numeric_limits<uint64_t>::max();
+}
+
+bool TraceSorter::DropSpilledEvents(SpilledQueue* spilled, const char* error) {
+  num_spill_read_errors_++;
+  if (spill_status_.ok()) {
+    PERFETTO_ELOG("%s, dropping the events spilled to it", error);
+    spill_status_ = util::ErrStatus("%s", error);
+  }
+
+  // The events loaded before the error, if any, are dropped too.
+  auto& events = spilled->queue.events_;
+  for (const TimestampedTracePiece& event : events)
+    DeletePayload(event);
+  events.erase_front(events.size());
+  spilled->bytes_left = 0;
+  return false;
+}
+
+bool TraceSorter::LoadSpilledEvents(SpilledQueue* spilled) {
+  Queue& queue = spilled->queue;
+  PERFETTO_DCHECK(queue.events_.empty());
+  PERFETTO_DCHECK(spilled->bytes_left > 0);
+
+  size_t read_size = static_cast<size_t>(
+      std::min<uint64_t>(spilled->bytes_left, kSpillBlockSize));
+  for (;;) {
+    std::unique_ptr<uint8_t[]> data(new uint8_t[read_size]);
+    if (!ReadSpillFile(*spill_file_, spilled->file_offset, data.get(),
+                       read_size)) {
+      return DropSpilledEvents(spilled, "Failed to read the sorter spill file");
+    }
+    TraceBlobView block(std::move(data), 0, read_size);
+
+    const uint8_t* ptr = block.data();
+    const uint8_t* end = ptr + read_size;
+    while (static_cast<size_t>(end - ptr) >= kSpilledHeaderSize) {
+      const uint8_t* piece_start = ptr;
+      int64_t ts = ReadPod<int64_t>(&ptr);
+      uint32_t idx = ReadPod<uint32_t>(&ptr);
+      Type type = static_cast<Type>(ReadPod<uint8_t>(&ptr));
+      uint32_t size = ReadPod<uint32_t>(&ptr);
+      if (static_cast<size_t>(end - ptr) < size) {
+        ptr = piece_start;
+        break;
+      }
+      if (size < SpilledFieldsSize(type))
+        return DropSpilledEvents(spilled, kCorruptedSpillFile);
+      const uint8_t* payload_end = ptr + size;
+      auto slice_to_end = [&block, &ptr, payload_end] {
+        return block.slice(block.offset_of(ptr),
+                           static_cast<size_t>(payload_end - ptr));
+      };
+      switch (type) {
+        case Type::kFtraceEvent:
+          queue.events_.emplace_back(ts, idx, slice_to_end());
+          break;
+        case Type::kTracePacket: {
+          auto* state = ReadPod<PacketSequenceStateGeneration*>(&ptr);
+          queue.events_.emplace_back(ts, idx, slice_to_end(), state);
+          break;
+        }
+        case Type::kTrackEvent: {
+          auto* state = ReadPod<PacketSequenceStateGeneration*>(&ptr);
+          int64_t thread_timestamp = ReadPod<int64_t>(&ptr);
+          int64_t thread_instruction_count = ReadPod<int64_t>(&ptr);
+          int64_t counter_value = ReadPod<int64_t>(&ptr);
+          std::array<int64_t, TrackEventData::kMaxNumExtraCounters> extra;
+          for (int64_t& value : extra)
+            value = ReadPod<int64_t>(&ptr);
+          TrackEventData data(slice_to_end(), state);
+          data.thread_timestamp = thread_timestamp;
+          data.thread_instruction_count = thread_instruction_count;
+          data.counter_value = counter_value;
+          data.extra_counter_values = extra;
+          queue.events_.emplace_back(
+              ts, idx, track_event_data_pool_.New(std::move(data)));
+          break;
+        }
+        case Type::kInlineSchedSwitch: {
+          InlineSchedSwitch sched_switch;
+          sched_switch.prev_state = ReadPod<int64_t>(&ptr);
+          sched_switch.next_pid = ReadPod<int32_t>(&ptr);
+          sched_switch.next_prio = ReadPod<int32_t>(&ptr);
+          sched_switch.next_comm = StringId::Raw(ReadPod<uint32_t>(&ptr));
+          queue.events_.emplace_back(ts, idx, sched_switch);
+          break;
+        }
+        case Type::kInlineSchedWaking: {
+          InlineSchedWaking sched_waking;
+          sched_waking.pid = ReadPod<int32_t>(&ptr);
+          sched_waking.target_cpu = ReadPod<int32_t>(&ptr);
+          sched_waking.prio = ReadPod<int32_t>(&ptr);
+          sched_waking.comm = StringId::Raw(ReadPod<uint32_t>(&ptr));
+          queue.events_.emplace_back(ts, idx, sched_waking);
+          break;
+        }
+        case Type::kInvalid:
+        case Type::kJsonEvent:
+        case Type::kFuchsiaRecord:
+        case Type::kSystraceLine:
+          return DropSpilledEvents(spilled, kCorruptedSpillFile);
+      }
+      ptr = payload_end;
+    }
+
+    size_t consumed = static_cast<size_t>(ptr - block.data());
+    spilled->file_offset += consumed;
+    spilled->bytes_left -= consumed;
+    if (consumed > 0)
+      break;
+
+    // The first event doesn't fit in a block: read it whole.
+    if (read_size < kSpilledHeaderSize)
+      return DropSpilledEvents(spilled, kCorruptedSpillFile);
+    const uint8_t* size_ptr = block.data() + kSpilledHeaderSize - 4;
+    read_size = kSpilledHeaderSize + ReadPod<uint32_t>(&size_ptr);
+    if (read_size > spilled->bytes_left)
+      return DropSpilledEvents(spilled, kCorruptedSpillFile);
+  }
+
+  PERFETTO_DCHECK(!queue.events_.empty());
+  queue.min_ts_ = queue.events_.front().timestamp;
+  return true;
+}
+
 void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(needs_sorting());
   PERFETTO_DCHECK(sort_start_idx_ < events_.size());
@@ -48,6 +450,13 @@ void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), sort_end));
   auto sort_begin = std::lower_bound(events_.begin(), sort_end, sort_min_ts_,
                                      &TimestampedTracePiece::Compare);
+
+  // The events being re-sorted might have been decoded already, in which case
+  // the decoded events don't line up anymore.
+  size_t sort_begin_idx = static_cast<size_t>(sort_begin - events_.begin());
+  if (sort_begin_idx < num_decoded())
+    decoded_.resize(decoded_start_ + sort_begin_idx);
+
   std::sort(sort_begin, events_.end());
   sort_start_idx_ = 0;
   sort_min_ts_ = 0;
@@ -56,66 +465,162 @@ void TraceSorter::Queue::Sort() {
   PERFETTO_DCHECK(std::is_sorted(events_.begin(), events_.end()));
 }
 
+void TraceSorter::Queue::EraseFrontDecoded(size_t n) {
+  decoded_start_ += std::min(n, num_decoded());
+  if (decoded_start_ == decoded_.size()) {
+    decoded_.clear();
+    decoded_start_ = 0;
+  }
+}
+
+void TraceSorter::DecodeFtraceEventsAhead(int64_t extract_end_ts) {
+  struct Task {
+    Queue* queue;
+    size_t begin;
+    size_t end;
+  };
+  std::vector<Task> tasks;
+
+  // Queues 1+ are the ftrace ones.
+  for (size_t i = 1; i < queues_.size(); i++) {
+    Queue& queue = queues_[i];
+    auto& events = queue.events_;
+    if (events.empty())
+      continue;
+    if (queue.needs_sorting())
+      queue.Sort();
+
+    auto decode_end_it = std::upper_bound(
+        events.begin(), events.end(), extract_end_ts,
+        [](int64_t ts, const TimestampedTracePiece& ttp) {
+          return ts < ttp.timestamp;
+        });
+    size_t decode_end = std::min(
+        static_cast<size_t>(decode_end_it - events.begin()),
+        kMaxDecodedEventsPerQueue);
+    size_t decode_begin = queue.num_decoded();
+    if (decode_begin >= decode_end)
+      continue;
+
+    // Drop the decoded events which have been extracted already, so that
+    // decoded_[i] lines up with events_[i].
+    queue.decoded_.erase(
+        queue.decoded_.begin(),
+        queue.decoded_.begin() + static_cast<ssize_t>(queue.decoded_start_));
+    queue.decoded_start_ = 0;
+    queue.decoded_.resize(decode_end);
+    for (size_t begin = decode_begin; begin < decode_end;
+         begin += kEventsPerDecodingTask) {
+      tasks.push_back(
+          {&queue, begin, std::min(decode_end, begin + kEventsPerDecodingTask)});
+    }
+  }
+
+  ftrace_decoding_pool_->ParallelFor(tasks.size(), [&tasks](size_t i) {
+    const Task& task = tasks[i];
+    for (size_t idx = task.begin; idx < task.end; idx++) {
+      DecodeFtraceEvent(task.queue->events_.at(idx),
+                        &task.queue->decoded_[idx]);
+    }
+  });
+}
+
 // Removes all the events in |queues_| that are earlier than the given window
 // size and moves them to the next parser stages, respecting global timestamp
-// order. This function is a "extract min from N sorted queues", with some
-// little cleverness: we know that events tend to be bursty, so events are
-// not going to be randomly distributed on the N |queues_|.
-// Upon each iteration this function finds the first two queues (if any) that
-// have the oldest events, and extracts events from the 1st until hitting the
-// min_ts of the 2nd. Imagine the queues are as follows:
+// order. This function is a k-way merge of the N sorted queues: the non-empty
+// queues are kept in a binary min-heap keyed by the timestamp of their first
+// event. Events tend to be bursty, so rather than popping one event at a
+// time, upon each iteration this function takes the queue at the top of the
+// heap and extracts events from it until hitting the min_ts of the queue
+// which becomes the new top. Imagine the queues are as follows:
 //
 //  q0           {min_ts: 10  max_ts: 30}
 //  q1    {min_ts:5              max_ts: 35}
 //  q2              {min_ts: 12    max_ts: 40}
 //
 // We know that we can extract all events from q1 until we hit ts=10 without
-// looking at any other queue. After hitting ts=10, we need to re-look to all of
-// them to figure out the next min-event.
-// There are more suitable data structures to do this (e.g. keeping a min-heap
-// to avoid re-scanning all the queues all the times) but doesn't seem worth it.
-// With Android traces (that have 8 CPUs) this function accounts for ~1-3% cpu
-// time in a profiler.
+// looking at any other queue. After hitting ts=10, q1 is pushed back in the
+// heap (with its new min_ts) and q0 becomes the top. Each iteration costs
+// O(log N), which matters for traces with many CPUs (i.e. many queues).
 void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
   DCHECK_ftrace_batch_cpu(kNoBatch);
 
   constexpr int64_t kTsMax = std::numeric_limits<int64_t>::max();
   const bool was_empty = global_min_ts_ == kTsMax && global_max_ts_ == 0;
   int64_t extract_end_ts = global_max_ts_ - window_size_ns;
+
+  // Ties are broken by queue index, so that the order in which events with the
+  // same timestamp are extracted doesn't depend on the state of the heap. The
+  // spilled events of a queue were pushed before the ones still in memory,
+  // and the earlier spilled before the later ones.
+  auto heap_cmp = [](const QueueHeapEntry& a, const QueueHeapEntry& b) {
+    return std::tie(a.min_ts, a.queue_idx, a.spilled_idx) >
+           std::tie(b.min_ts, b.queue_idx, b.spilled_idx);
+  };
+  queue_heap_.clear();
+  for (size_t i = 0; i < queues_.size(); i++) {
+    const Queue& queue = queues_[i];
+    if (queue.events_.empty())
+      continue;
+    PERFETTO_DCHECK(queue.min_ts_ >= global_min_ts_);
+    PERFETTO_DCHECK(queue.max_ts_ <= global_max_ts_);
+    queue_heap_.push_back(
+        {queue.min_ts_, static_cast<uint32_t>(i), kNotSpilled});
+  }
+  for (size_t i = 0; i < spilled_queues_.size(); i++) {
+    const SpilledQueue& spilled = spilled_queues_[i];
+    if (spilled.queue.events_.empty() && !spilled.bytes_left)
+      continue;
+    queue_heap_.push_back({spilled.queue.min_ts_, spilled.queue_idx,
+                           static_cast<uint32_t>(i)});
+  }
+  std::make_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+
   size_t iterations = 0;
   for (;; iterations++) {
-    size_t min_queue_idx = 0;  // The index of the queue with the min(ts).
-
-    // The top-2 min(ts) among all queues.
-    // queues_[min_queue_idx].events.timestamp == min_queue_ts[0].
-    int64_t min_queue_ts[2]{kTsMax, kTsMax};
-
-    // This loop identifies the queue which starts with the earliest event and
-    // also remembers the earliest event of the 2nd queue (in min_queue_ts[1]).
-    bool has_queues_with_expired_events = false;
-    for (size_t i = 0; i < queues_.size(); i++) {
-      auto& queue = queues_[i];
-      if (queue.events_.empty())
-        continue;
-      PERFETTO_DCHECK(queue.min_ts_ >= global_min_ts_);
-      PERFETTO_DCHECK(queue.max_ts_ <= global_max_ts_);
-      if (queue.min_ts_ < min_queue_ts[0]) {
-        min_queue_ts[1] = min_queue_ts[0];
-        min_queue_ts[0] = queue.min_ts_;
-        min_queue_idx = i;
-        has_queues_with_expired_events = true;
-      } else if (queue.min_ts_ < min_queue_ts[1]) {
-        min_queue_ts[1] = queue.min_ts_;
-      }
-    }
-    if (!has_queues_with_expired_events) {
-      // All the queues have events that start after the window (i.e. they are
-      // too recent and not eligible to be extracted given the current window).
+    // All the queues have events that start after the window (i.e. they are
+    // too recent and not eligible to be extracted given the current window).
+    if (queue_heap_.empty() || queue_heap_.front().min_ts > extract_end_ts)
       break;
-    }
 
-    Queue& queue = queues_[min_queue_idx];
+    // Pop the queue which starts with the earliest event. The new top of the
+    // heap is the queue which starts with the 2nd earliest event.
+    std::pop_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
+    QueueHeapEntry min_entry = queue_heap_.back();
+    queue_heap_.pop_back();
+    int64_t next_queue_min_ts =
+        queue_heap_.empty() ? kTsMax : queue_heap_.front().min_ts;
+
+    size_t min_queue_idx = min_entry.queue_idx;
+    SpilledQueue* spilled = min_entry.spilled_idx == kNotSpilled
+                                ? nullptr
+                                : &spilled_queues_[min_entry.spilled_idx];
+    Queue& queue = spilled ? spilled->queue : queues_[min_queue_idx];
     auto& events = queue.events_;
+
+    // Once |queue| has run out of events, it leaves the heap. If it held the
+    // max entry, the global max has to be recomputed.
+    auto update_bounds_of_empty_queue = [&] {
+      queue.min_ts_ = kTsMax;
+      queue.max_ts_ = 0;
+      global_min_ts_ = next_queue_min_ts;
+      global_max_ts_ = 0;
+      for (auto& q : queues_)
+        global_max_ts_ = std::max(global_max_ts_, q.max_ts_);
+      for (auto& s : spilled_queues_)
+        global_max_ts_ = std::max(global_max_ts_, s.queue.max_ts_);
+    };
+
+    // A failed read drops the spilled events, which is reported through
+    // |spill_status_|. The other queues are extracted as usual.
+    if (spilled && events.empty() && !LoadSpilledEvents(spilled)) {
+      update_bounds_of_empty_queue();
+      continue;
+    }
+    if (ftrace_decoding_pool_ && !spilled && min_queue_idx > 0 &&
+        !queue.num_decoded()) {
+      DecodeFtraceEventsAhead(extract_end_ts);
+    }
     if (queue.needs_sorting())
       queue.Sort();
     PERFETTO_DCHECK(queue.min_ts_ == events.front().timestamp);
@@ -124,7 +629,19 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
     // Now that we identified the min-queue, extract all events from it until
     // we hit either: (1) the min-ts of the 2nd queue or (2) the window limit,
     // whichever comes first.
-    int64_t extract_until_ts = std::min(extract_end_ts, min_queue_ts[1]);
+    int64_t extract_until_ts = std::min(extract_end_ts, next_queue_min_ts);
+
+    // The events with the same timestamp as the 2nd queue are extracted too,
+    // unless that queue holds events of the same kind pushed earlier. This is
+    // only possible when some events have been spilled and the 2nd queue wins
+    // the tie-break.
+    if (!spilled_queues_.empty() && !queue_heap_.empty() &&
+        extract_until_ts == next_queue_min_ts &&
+        std::tie(min_entry.queue_idx, min_entry.spilled_idx) >
+            std::tie(queue_heap_.front().queue_idx,
+                     queue_heap_.front().spilled_idx)) {
+      extract_until_ts--;
+    }
     size_t num_extracted = 0;
     for (auto& event : events) {
       int64_t timestamp = event.timestamp;
@@ -132,47 +649,75 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
         break;
 
       ++num_extracted;
-      if (bypass_next_stage_for_testing_)
-        continue;
+      if (!spilled)
+        memory_usage_ -= MemoryUsage(event);
 
       if (min_queue_idx == 0) {
         // queues_[0] is for non-ftrace packets.
-        parser_->ParseTracePacket(timestamp, std::move(event));
-      } else {
+        TrackEventData* track_event_data =
+            event.type == Type::kTrackEvent ? event.track_event_data
+                : nullptr;
+        JsonEvent* json_event =
+            event.type == Type::kJsonEvent ? event.json_event : nullptr;
+        if (!bypass_next_stage_for_testing_)
+          parser_->ParseTracePacket(timestamp, std::move(event));
+        if (track_event_data)
+          track_event_data_pool_.Delete(track_event_data);
+        if (json_event)
+          json_event_pool_.Delete(json_event);
+      } else if (!bypass_next_stage_for_testing_) {
         // Ftrace queues start at offset 1. So queues_[1] = cpu[0] and so on.
         uint32_t cpu = static_cast<uint32_t>(min_queue_idx - 1);
-        parser_->ParseFtracePacket(cpu, timestamp, std::move(event));
+        size_t event_idx = num_extracted - 1;
+        if (event_idx < queue.num_decoded()) {
+          parser_->ParseDecodedFtracePacket(cpu, timestamp, std::move(event),
+                                            queue.decoded(event_idx));
+        } else {
+          parser_->ParseFtracePacket(cpu, timestamp, std::move(event));
+        }
       }
     }  // for (event: events)
 
-    if (!num_extracted) {
-      // No events can be extracted from any of the queues. This means that
-      // either we hit the window or all queues are empty.
-      break;
-    }
+    // The min-queue starts at or before the window limit and the 2nd queue
+    // doesn't start before it, so at least the first event is extracted.
+    PERFETTO_DCHECK(num_extracted > 0);
 
     // Now remove the entries from the event buffer and update the queue-local
     // and global time bounds.
     events.erase_front(num_extracted);
+    queue.EraseFrontDecoded(num_extracted);
+    // If the read fails, |events| stays empty as if the queue was over.
+    if (spilled && events.empty() && spilled->bytes_left)
+      LoadSpilledEvents(spilled);
 
     // Update the global_{min,max}_ts to reflect the bounds after extraction.
     if (events.empty()) {
-      queue.min_ts_ = kTsMax;
-      queue.max_ts_ = 0;
-      global_min_ts_ = min_queue_ts[1];
-
-      // If we extraced the max entry from a queue (i.e. we emptied the queue)
-      // we need to recompute the global max, because it might have been the one
-      // just extracted.
-      global_max_ts_ = 0;
-      for (auto& q : queues_)
-        global_max_ts_ = std::max(global_max_ts_, q.max_ts_);
+      update_bounds_of_empty_queue();
     } else {
       queue.min_ts_ = queue.events_.front().timestamp;
-      global_min_ts_ = std::min(queue.min_ts_, min_queue_ts[1]);
+      global_min_ts_ = std::min(queue.min_ts_, next_queue_min_ts);
+      min_entry.min_ts = queue.min_ts_;
+      queue_heap_.push_back(min_entry);
+      std::push_heap(queue_heap_.begin(), queue_heap_.end(), heap_cmp);
     }
   }  // for(;;)
 
+  // Drop the spilled queues which have been fully extracted and, once all of
+  // them are, reclaim the disk space.
+  spilled_queues_.erase(
+      std::remove_if(spilled_queues_.begin(), spilled_queues_.end(),
+                     [](const SpilledQueue& spilled) {
+                       return spilled.queue.events_.empty() &&
+                              !spilled.bytes_left;
+                     }),
+      spilled_queues_.end());
+  if (spilled_queues_.empty() && spill_file_size_ > 0) {
+    // If the file can't be truncated, it isn't written to anymore.
+    if (!TruncateSpillFile(*spill_file_))
+      DisableSpilling("Failed to truncate the sorter spill file");
+    spill_file_size_ = 0;
+  }
+
   // We decide to extract events only when we know (using the global_{min,max}
   // bounds) that there are eligible events. We should never end up in a
   // situation where we call this function but then realize that there was
@@ -187,6 +732,10 @@ void TraceSorter::SortAndExtractEventsBeyondWindow(int64_t window_size_ns) {
     dbg_min_ts = std::min(dbg_min_ts, q.min_ts_);
     dbg_max_ts = std::max(dbg_max_ts, q.max_ts_);
   }
+  for (auto& s : spilled_queues_) {
+    dbg_min_ts = std::min(dbg_min_ts, s.queue.min_ts_);
+    dbg_max_ts = std::max(dbg_max_ts, s.queue.max_ts_);
+  }
   PERFETTO_DCHECK(global_min_ts_ == dbg_min_ts);
   PERFETTO_DCHECK(global_max_ts_ == dbg_max_ts);
 #endif
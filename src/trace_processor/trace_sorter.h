@@ -17,17 +17,20 @@
 #ifndef SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 #define SRC_TRACE_PROCESSOR_TRACE_SORTER_H_
 
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "perfetto/ext/base/circular_queue.h"
+#include "perfetto/ext/base/scoped_file.h"
+#include "perfetto/ext/base/thread_pool.h"
 #include "perfetto/trace_processor/basic_types.h"
+#include "perfetto/trace_processor/status.h"
+#include "src/trace_processor/importers/ftrace/ftrace_event_decoder.h"
 #include "src/trace_processor/storage/trace_storage.h"
 #include "src/trace_processor/timestamped_trace_piece.h"
 #include "src/trace_processor/trace_blob_view.h"
 
-namespace Json {
-class Value;
-}  // namespace Json
 
 namespace perfetto {
 namespace trace_processor {
@@ -48,7 +51,8 @@ struct SystraceLine;
 //
 // Due to this, this class is oprerates as a streaming merge-sort of N+1 queues
 // (N = num cpus + 1 for non-ftrace events). Each queue in turn gets sorted (if
-// necessary) before proceeding with the global merge-sort-extract.
+// necessary) before proceeding with the global merge-sort-extract, which is a
+// heap-based k-way merge.
 // When an event is pushed through, it is just appeneded to the end of one of
 // the N queues. While appending, we keep track of the fact that the queue
 // is still ordered or just lost ordering. When an out-of-order event is
@@ -63,26 +67,48 @@ struct SystraceLine;
 // We use a logarithmic bound search operation to figure out what is the index
 // within the first partition where sorting should start, and sort all events
 // from there to the end.
+//
+// Optionally (see EnableParallelFtraceDecoding()), the ftrace events about to
+// be extracted are decoded ahead of time on a pool of worker threads, one
+// slice of a CPU queue per task, as the per-CPU queues are independent until
+// the final merge. Only the parsing of the decoded events, which inserts into
+// the tables, happens serially in timestamp order.
+//
+// Optionally (see EnableSpillingToDisk()), when the events held in the queues
+// exceed a memory budget, each queue is sorted and moved to a temporary file
+// as a "run". The runs take part in the merge like the in-memory queues, and
+// are read back from the file a block at a time. This bounds the memory used
+// by a full sort of a large trace.
 class TraceSorter {
  public:
   TraceSorter(std::unique_ptr<TraceParser> parser, int64_t window_size_ns);
+  ~TraceSorter();
+
+  // Decodes ftrace events on |num_threads| worker threads (plus the calling
+  // thread) before handing them to TraceParser::ParseDecodedFtracePacket().
+  void EnableParallelFtraceDecoding(uint32_t num_threads);
+
+  // Spills the events held in memory to a temporary file whenever they take
+  // more than |memory_budget_bytes|. Only the events of proto traces can be
+  // spilled. Not supported on Windows and in WASM, where it's a no-op.
+  void EnableSpillingToDisk(uint64_t memory_budget_bytes);
 
   inline void PushTracePacket(int64_t timestamp,
                               PacketSequenceState* state,
                               TraceBlobView packet) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     auto* queue = GetQueue(0);
-    queue->Append(TimestampedTracePiece(timestamp, packet_idx_++,
-                                        std::move(packet),
-                                        state->current_generation()));
+    AppendToQueue(queue, TimestampedTracePiece(timestamp, packet_idx_++,
+                                               std::move(packet),
+                                               state->current_generation()));
     MaybeExtractEvents(queue);
   }
 
-  inline void PushJsonValue(int64_t timestamp,
-                            std::unique_ptr<Json::Value> json_value) {
+  inline void PushJsonEvent(int64_t timestamp, JsonEvent event) {
     auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(json_value)));
+    AppendToQueue(queue, TimestampedTracePiece(
+                             timestamp, packet_idx_++,
+                             json_event_pool_.New(std::move(event))));
     MaybeExtractEvents(queue);
   }
 
@@ -90,8 +116,8 @@ class TraceSorter {
                                 std::unique_ptr<FuchsiaRecord> record) {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(record)));
+    AppendToQueue(queue, TimestampedTracePiece(timestamp, packet_idx_++,
+                                               std::move(record)));
     MaybeExtractEvents(queue);
   }
 
@@ -99,8 +125,8 @@ class TraceSorter {
     DCHECK_ftrace_batch_cpu(kNoBatch);
     auto* queue = GetQueue(0);
     int64_t timestamp = systrace_line->ts;
-    queue->Append(TimestampedTracePiece(timestamp, packet_idx_++,
-                                        std::move(systrace_line)));
+    AppendToQueue(queue, TimestampedTracePiece(timestamp, packet_idx_++,
+                                               std::move(systrace_line)));
     MaybeExtractEvents(queue);
   }
 
@@ -108,7 +134,8 @@ class TraceSorter {
                               int64_t timestamp,
                               TraceBlobView event) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
+    AppendToQueue(
+        GetQueue(cpu + 1),
         TimestampedTracePiece(timestamp, packet_idx_++, std::move(event)));
 
     // The caller must call FinalizeFtraceEventBatch() after having pushed a
@@ -128,22 +155,24 @@ class TraceSorter {
                                     int64_t timestamp,
                                     InlineSchedSwitch inline_sched_switch) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
+    AppendToQueue(
+        GetQueue(cpu + 1),
         TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_switch));
   }
   inline void PushInlineFtraceEvent(uint32_t cpu,
                                     int64_t timestamp,
                                     InlineSchedWaking inline_sched_waking) {
     set_ftrace_batch_cpu_for_DCHECK(cpu);
-    GetQueue(cpu + 1)->Append(
+    AppendToQueue(
+        GetQueue(cpu + 1),
         TimestampedTracePiece(timestamp, packet_idx_++, inline_sched_waking));
   }
 
-  inline void PushTrackEventPacket(int64_t timestamp,
-                                   std::unique_ptr<TrackEventData> data) {
+  inline void PushTrackEventPacket(int64_t timestamp, TrackEventData data) {
     auto* queue = GetQueue(0);
-    queue->Append(
-        TimestampedTracePiece(timestamp, packet_idx_++, std::move(data)));
+    AppendToQueue(queue, TimestampedTracePiece(
+                             timestamp, packet_idx_++,
+                             track_event_data_pool_.New(std::move(data))));
     MaybeExtractEvents(queue);
   }
 
@@ -157,6 +186,7 @@ class TraceSorter {
   void ExtractEventsForced() {
     SortAndExtractEventsBeyondWindow(/*window_size_ns=*/0);
     queues_.resize(0);
+    PERFETTO_DCHECK(spilled_queues_.empty());
   }
 
   // Sets the window size to be the size specified (which should be lower than
@@ -178,6 +208,17 @@ class TraceSorter {
 
   int64_t max_timestamp() const { return global_max_ts_; }
 
+  uint64_t num_spilled_events() const { return num_spilled_events_; }
+  uint64_t num_spilled_bytes() const { return spill_file_size_total_; }
+  uint64_t num_spill_write_errors() const { return num_spill_write_errors_; }
+  uint64_t num_spill_read_errors() const { return num_spill_read_errors_; }
+
+  // The first failure to read back spilled events, which have been lost. The
+  // extraction carries on without them, but the import isn't complete.
+  const util::Status& spill_status() const { return spill_status_; }
+
+  int spill_file_for_testing() const { return *spill_file_; }
+
  private:
   static constexpr uint32_t kNoBatch = std::numeric_limits<uint32_t>::max();
 
@@ -211,17 +252,170 @@ class TraceSorter {
     bool needs_sorting() const { return sort_start_idx_ != 0; }
     void Sort();
 
+    // Number of events, from the front of |events_|, which have been decoded.
+    size_t num_decoded() const { return decoded_.size() - decoded_start_; }
+    const DecodedFtraceEvent& decoded(size_t idx) const {
+      return decoded_[decoded_start_ + idx];
+    }
+    void EraseFrontDecoded(size_t n);
+
     base::CircularQueue<TimestampedTracePiece> events_;
     int64_t min_ts_ = std::numeric_limits<int64_t>::max();
     int64_t max_ts_ = 0;
     size_t sort_start_idx_ = 0;
     int64_t sort_min_ts_ = std::numeric_limits<int64_t>::max();
+
+    // Only used by ftrace queues with parallel decoding enabled.
+    // decoded_[decoded_start_ + i] is the decoded version of events_[i].
+    std::vector<DecodedFtraceEvent> decoded_;
+    size_t decoded_start_ = 0;
+  };
+
+  // Fixed-size slots for the out of line payloads of events (TrackEventData
+  // or JsonEvent), recycled once the event they belong to has been parsed.
+  // Avoids a heap allocation per event: the number of slots only grows with
+  // the number of events in the window.
+  template <typename T>
+  class PayloadPool {
+   public:
+    PayloadPool() = default;
+    ~PayloadPool() {
+      // All the payloads must have been deleted, or the buffers they refer to
+      // would be leaked.
+      PERFETTO_DCHECK(free_slots_.size() == chunks_.size() * kSlotsPerChunk);
+    }
+
+    T* New(T data) {
+      if (PERFETTO_UNLIKELY(free_slots_.empty()))
+        AddChunk();
+      Slot* slot = free_slots_.back();
+      free_slots_.pop_back();
+      return new (slot) T(std::move(data));
+    }
+
+    void Delete(T* data) {
+      data->~T();
+      free_slots_.push_back(reinterpret_cast<Slot*>(data));
+    }
+
+   private:
+    using Slot = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+    static constexpr size_t kSlotsPerChunk = 1024;
+
+    void AddChunk() {
+      chunks_.emplace_back(new Slot[kSlotsPerChunk]);
+      Slot* chunk = chunks_.back().get();
+      for (size_t i = kSlotsPerChunk; i > 0; i--)
+        free_slots_.push_back(&chunk[i - 1]);
+    }
+
+    std::vector<std::unique_ptr<Slot[]>> chunks_;
+    std::vector<Slot*> free_slots_;
+  };
+
+  // The events of a queue which have been spilled to disk, sorted. They are
+  // loaded back in |queue| a block at a time.
+  struct SpilledQueue {
+    // The index in |queues_| of the queue the events were pushed to.
+    uint32_t queue_idx = 0;
+
+    // The part of the spill file holding the events not loaded yet.
+    uint64_t file_offset = 0;
+    uint64_t bytes_left = 0;
+
+    // Only holds loaded events, which are always sorted. Its |max_ts_| is the
+    // max timestamp of all the events spilled, loaded or not.
+    Queue queue;
+  };
+
+  // An entry of the heap used to merge the queues. See
+  // SortAndExtractEventsBeyondWindow().
+  struct QueueHeapEntry {
+    int64_t min_ts;
+    uint32_t queue_idx;
+
+    // The index in |spilled_queues_| if the entry is for spilled events of
+    // queues_[queue_idx], kNotSpilled if it is for queues_[queue_idx] itself.
+    uint32_t spilled_idx;
   };
 
+  static constexpr uint32_t kNotSpilled = std::numeric_limits<uint32_t>::max();
+
+  // Size of the reads and writes of the spill file.
+  static constexpr size_t kSpillBlockSize = 256 * 1024;
+
+  // Max number of events decoded ahead of extraction, per ftrace queue. This
+  // bounds the memory used by decoded events, which is not negligible
+  // compared to the events themselves.
+  static constexpr size_t kMaxDecodedEventsPerQueue = 8192;
+
+  // Number of events decoded by each task of |ftrace_decoding_pool_|.
+  static constexpr size_t kEventsPerDecodingTask = 512;
+
   // This method passes any events older than window_size_ns to the
   // parser to be parsed and then stored.
   void SortAndExtractEventsBeyondWindow(int64_t windows_size_ns);
 
+  // Decodes, on |ftrace_decoding_pool_|, the events of the ftrace queues which
+  // have a timestamp <= |extract_end_ts|, up to kMaxDecodedEventsPerQueue.
+  void DecodeFtraceEventsAhead(int64_t extract_end_ts);
+
+  // Sorts the queues and moves their events to |spill_file_|, creating one
+  // SpilledQueue for each of them. If the file can't be written, the events
+  // stay in memory and spilling is disabled for the rest of the import.
+  void SpillEventsToDisk();
+
+  // Loads the next block of events of |spilled| from |spill_file_|. If the
+  // file can't be read or is corrupted, calls DropSpilledEvents().
+  bool LoadSpilledEvents(SpilledQueue* spilled);
+
+  // Called when |spill_file_| can't be written: counts the error and stops
+  // spilling.
+  void DisableSpilling(const char* error);
+
+  // Called when |spilled| can't be loaded back: drops its remaining events,
+  // counts the error and records it in |spill_status_|. Returns false.
+  bool DropSpilledEvents(SpilledQueue* spilled, const char* error);
+
+  // The memory held by |ttp|, including the part of the trace it refers to.
+  // This is an estimate for the payloads which are not TraceBlobViews.
+  static inline size_t MemoryUsage(const TimestampedTracePiece& ttp) {
+    using Type = TimestampedTracePiece::Type;
+    switch (ttp.type) {
+      case Type::kFtraceEvent:
+        return sizeof(ttp) + ttp.ftrace_event.length();
+      case Type::kTracePacket:
+        return sizeof(ttp) + ttp.packet_data.packet.length();
+      case Type::kTrackEvent:
+        return sizeof(ttp) + sizeof(TrackEventData) +
+               ttp.track_event_data->packet.length();
+      case Type::kJsonEvent:
+        return sizeof(ttp) + sizeof(JsonEvent) +
+               (ttp.json_event->args ? ttp.json_event->args->length() : 0);
+      case Type::kInvalid:
+      case Type::kInlineSchedSwitch:
+      case Type::kInlineSchedWaking:
+      case Type::kFuchsiaRecord:
+      case Type::kSystraceLine:
+        break;
+    }
+    return sizeof(ttp);
+  }
+
+  // Returns the payload of |ttp|, if any, to its pool.
+  inline void DeletePayload(const TimestampedTracePiece& ttp) {
+    using Type = TimestampedTracePiece::Type;
+    if (ttp.type == Type::kTrackEvent)
+      track_event_data_pool_.Delete(ttp.track_event_data);
+    else if (ttp.type == Type::kJsonEvent)
+      json_event_pool_.Delete(ttp.json_event);
+  }
+
+  inline void AppendToQueue(Queue* queue, TimestampedTracePiece ttp) {
+    memory_usage_ += MemoryUsage(ttp);
+    queue->Append(std::move(ttp));
+  }
+
   inline Queue* GetQueue(size_t index) {
     if (PERFETTO_UNLIKELY(index >= queues_.size()))
       queues_.resize(index + 1);
@@ -233,10 +427,13 @@ class TraceSorter {
     global_max_ts_ = std::max(global_max_ts_, queue->max_ts_);
     global_min_ts_ = std::min(global_min_ts_, queue->min_ts_);
 
-    // Fast path: if, globally, we are within the window size, then just exit.
-    if (global_max_ts_ - global_min_ts_ < window_size_ns_)
-      return;
-    SortAndExtractEventsBeyondWindow(window_size_ns_);
+    // Fast path: if, globally, we are within the window size, there is
+    // nothing to extract.
+    if (global_max_ts_ - global_min_ts_ >= window_size_ns_)
+      SortAndExtractEventsBeyondWindow(window_size_ns_);
+
+    if (PERFETTO_UNLIKELY(memory_usage_ > spill_threshold_bytes_))
+      SpillEventsToDisk();
   }
 
   std::unique_ptr<TraceParser> parser_;
@@ -246,6 +443,10 @@ class TraceSorter {
   // queues_[x] is the ftrace queue for CPU(x - 1).
   std::vector<Queue> queues_;
 
+  // Min-heap of the non-empty queues, only used (and valid) during
+  // SortAndExtractEventsBeyondWindow(). Kept as a member to reuse its storage.
+  std::vector<QueueHeapEntry> queue_heap_;
+
   // Events are propagated to the next stage only after (max - min) timestamp
   // is larger than this value.
   int64_t window_size_ns_;
@@ -256,12 +457,41 @@ class TraceSorter {
   // min(e.timestamp for e in queues_).
   int64_t global_min_ts_ = std::numeric_limits<int64_t>::max();
 
-  // Monotonic increasing value used to index timestamped trace pieces.
-  uint64_t packet_idx_ = 0;
+  // Monotonic increasing value used to index timestamped trace pieces. Wraps
+  // around, see TimestampedTracePiece::operator<.
+  uint32_t packet_idx_ = 0;
+
+  // Own the TrackEventData and JsonEvents of the events in |queues_[0]| (and
+  // in the SpilledQueues of queues_[0]).
+  PayloadPool<TrackEventData> track_event_data_pool_;
+  PayloadPool<JsonEvent> json_event_pool_;
+
+  // Sum of MemoryUsage() of the events in |queues_|.
+  uint64_t memory_usage_ = 0;
+
+  // Only used when spilling to disk is enabled. The events are spilled when
+  // |memory_usage_| goes above |spill_threshold_bytes_|, which is the memory
+  // budget plus the memory held by the events which can't be spilled.
+  uint64_t memory_budget_bytes_ = 0;
+  uint64_t spill_threshold_bytes_ = std::numeric_limits<uint64_t>::max();
+  base::ScopedFile spill_file_;
+  uint64_t spill_file_size_ = 0;
+  uint64_t spill_file_size_total_ = 0;
+  uint64_t num_spilled_events_ = 0;
+  uint64_t num_spill_write_errors_ = 0;
+  uint64_t num_spill_read_errors_ = 0;
+  util::Status spill_status_;
+
+  // Ordered by time of spilling. Kept across calls to
+  // SortAndExtractEventsBeyondWindow() until all their events are extracted.
+  std::vector<SpilledQueue> spilled_queues_;
 
   // Used for performance tests. True when setting TRACE_PROCESSOR_SORT_ONLY=1.
   bool bypass_next_stage_for_testing_ = false;
 
+  // Only set if parallel ftrace decoding is enabled.
+  std::unique_ptr<base::ThreadPool> ftrace_decoding_pool_;
+
 #if PERFETTO_DCHECK_IS_ON()
   // Used only for DCHECK-ing that FinalizeFtraceEventBatch() is called.
   uint32_t ftrace_batch_cpu_ = kNoBatch;
@@ -281,6 +511,9 @@ class TraceSorter {
 #endif
 };
 
+template <typename T>
+constexpr size_t TraceSorter::PayloadPool<T>::kSlotsPerChunk;
+
 }  // namespace trace_processor
 }  // namespace perfetto
 
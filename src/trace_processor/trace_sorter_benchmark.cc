@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "src/trace_processor/trace_parser.h"
+#include "src/trace_processor/trace_sorter.h"
+
+namespace {
+
+using perfetto::trace_processor::TimestampedTracePiece;
+using perfetto::trace_processor::TraceBlobView;
+using perfetto::trace_processor::TraceParser;
+using perfetto::trace_processor::TraceSorter;
+using perfetto::trace_processor::TrackEventData;
+
+bool IsBenchmarkFunctionalOnly() {
+  return getenv("BENCHMARK_FUNCTIONAL_TEST_ONLY") != nullptr;
+}
+
+// Only counts the events, so that the benchmark measures the sorter alone.
+class CountingTraceParser : public TraceParser {
+ public:
+  explicit CountingTraceParser(uint64_t* count) : count_(count) {}
+
+  void ParseTracePacket(int64_t, TimestampedTracePiece) override {
+    (*count_)++;
+  }
+  void ParseFtracePacket(uint32_t, int64_t, TimestampedTracePiece) override {
+    (*count_)++;
+  }
+
+ private:
+  uint64_t* count_;
+};
+
+constexpr uint32_t kEventsPerBundle = 64;
+
+struct Bundle {
+  uint32_t cpu;
+  std::vector<int64_t> timestamps;
+};
+
+// Generates ftrace-like input: bundles of events read round-robin from the
+// per-CPU buffers. Events are sorted within a CPU, except for a small
+// fraction of them, while the bundles of different CPUs overlap in time.
+std::vector<Bundle> CreateBundles(uint32_t num_cpus, uint32_t num_events) {
+  static constexpr uint32_t kRandomSeed = 42;
+  std::minstd_rand0 rnd_engine(kRandomSeed);
+
+  std::vector<int64_t> cpu_ts(num_cpus, 0);
+  std::vector<Bundle> bundles;
+  for (uint32_t i = 0; i < num_events / kEventsPerBundle; i++) {
+    Bundle bundle;
+    bundle.cpu = i % num_cpus;
+    int64_t& ts = cpu_ts[bundle.cpu];
+    for (uint32_t j = 0; j < kEventsPerBundle; j++) {
+      ts += rnd_engine() % (10 * num_cpus);
+      bool out_of_order = rnd_engine() % 1000 == 0;
+      bundle.timestamps.push_back(out_of_order ? ts - 1000 : ts);
+    }
+    bundles.emplace_back(std::move(bundle));
+  }
+  return bundles;
+}
+
+void SorterArgs(benchmark::internal::Benchmark* b) {
+  b->ArgNames({"cpus", "window_ms"});
+  for (int64_t cpus : {8, 32, 128}) {
+    // A window of 0 means a full sort at the end of the trace.
+    for (int64_t window_ms : {0, 10})
+      b->Args({cpus, window_ms});
+  }
+}
+
+static void BM_TraceSorter(benchmark::State& state) {
+  const uint32_t num_cpus = static_cast<uint32_t>(state.range(0));
+  const int64_t window_ns = state.range(1) * 1000 * 1000;
+  const uint32_t num_events =
+      IsBenchmarkFunctionalOnly() ? 64 * 1024 : 4 * 1024 * 1024;
+  std::vector<Bundle> bundles = CreateBundles(num_cpus, num_events);
+
+  // All the events point to the same buffer, to keep allocations out of the
+  // measurement.
+  TraceBlobView buf(std::unique_ptr<uint8_t[]>(new uint8_t[1]), 0, 1);
+
+  uint64_t count = 0;
+  for (auto _ : state) {
+    TraceSorter sorter(
+        std::unique_ptr<TraceParser>(new CountingTraceParser(&count)),
+        window_ns ? window_ns : std::numeric_limits<int64_t>::max());
+    for (const Bundle& bundle : bundles) {
+      for (int64_t ts : bundle.timestamps)
+        sorter.PushFtraceEvent(bundle.cpu, ts, buf.slice(0, 1));
+      sorter.FinalizeFtraceEventBatch(bundle.cpu);
+    }
+    sorter.ExtractEventsForced();
+  }
+  PERFETTO_CHECK(count == static_cast<uint64_t>(state.iterations()) *
+                              bundles.size() * kEventsPerBundle);
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(count), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_TraceSorter)->Apply(SorterArgs)->Unit(benchmark::kMillisecond);
+
+// Track events go through the non-ftrace queue and carry the largest payload
+// of all the pieces, so this measures the cost of holding it in the sorter.
+static void BM_TraceSorterTrackEvents(benchmark::State& state) {
+  const int64_t window_ns = state.range(0) * 1000 * 1000;
+  const uint32_t num_events =
+      IsBenchmarkFunctionalOnly() ? 64 * 1024 : 4 * 1024 * 1024;
+  std::vector<int64_t> timestamps;
+  for (const Bundle& bundle : CreateBundles(1, num_events)) {
+    timestamps.insert(timestamps.end(), bundle.timestamps.begin(),
+                      bundle.timestamps.end());
+  }
+
+  TraceBlobView buf(std::unique_ptr<uint8_t[]>(new uint8_t[1]), 0, 1);
+
+  uint64_t count = 0;
+  for (auto _ : state) {
+    TraceSorter sorter(
+        std::unique_ptr<TraceParser>(new CountingTraceParser(&count)),
+        window_ns ? window_ns : std::numeric_limits<int64_t>::max());
+    for (int64_t ts : timestamps) {
+      TrackEventData data(buf.slice(0, 1), nullptr);
+      data.thread_timestamp = ts;
+      sorter.PushTrackEventPacket(ts, std::move(data));
+    }
+    sorter.ExtractEventsForced();
+  }
+  PERFETTO_CHECK(count ==
+                 static_cast<uint64_t>(state.iterations()) * timestamps.size());
+  state.counters["events/s"] = benchmark::Counter(
+      static_cast<double>(count), benchmark::Counter::kIsRate);
+  state.counters["piece_size"] =
+      static_cast<double>(sizeof(TimestampedTracePiece));
+}
+BENCHMARK(BM_TraceSorterTrackEvents)
+    ->ArgName("window_ms")
+    ->Arg(0)
+    ->Arg(10)
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace
@@ -19,12 +19,22 @@
 #include <random>
 #include <vector>
 
+#include "perfetto/base/build_config.h"
+#include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/trace_processor/basic_types.h"
+#include "src/trace_processor/importers/ftrace/ftrace_event_decoder.h"
 #include "src/trace_processor/timestamped_trace_piece.h"
 #include "src/trace_processor/trace_sorter.h"
 #include "src/trace_processor/types/trace_processor_context.h"
 #include "test/gtest_and_gmock.h"
 
+#include "protos/perfetto/trace/ftrace/ftrace_event.pbzero.h"
+#include "protos/perfetto/trace/ftrace/sched.pbzero.h"
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+#include <unistd.h>
+#endif
+
 namespace perfetto {
 namespace trace_processor {
 namespace {
@@ -54,12 +64,29 @@ class MockTraceParser : public ProtoTraceParser {
                            isNonCompact ? ttp.ftrace_event.length() : 0);
   }
 
+  MOCK_METHOD4(MOCK_ParseDecodedFtracePacket,
+               void(uint32_t cpu,
+                    int64_t timestamp,
+                    uint32_t event_id,
+                    uint32_t next_pid));
+
+  void ParseDecodedFtracePacket(uint32_t cpu,
+                                int64_t timestamp,
+                                TimestampedTracePiece,
+                                const DecodedFtraceEvent& decoded) override {
+    MOCK_ParseDecodedFtracePacket(cpu, timestamp, decoded.event_id,
+                                  decoded.sched_switch.next_pid);
+  }
+
   MOCK_METHOD3(MOCK_ParseTracePacket,
                void(int64_t ts, const uint8_t* data, size_t length));
 
   void ParseTracePacket(int64_t ts, TimestampedTracePiece ttp) override {
-    TraceBlobView& tbv = ttp.packet_data.packet;
-    MOCK_ParseTracePacket(ts, tbv.data(), tbv.length());
+    const TracePacketData& data =
+        ttp.type == TimestampedTracePiece::Type::kTrackEvent
+            ? *ttp.track_event_data
+            : ttp.packet_data;
+    MOCK_ParseTracePacket(ts, data.packet.data(), data.packet.length());
   }
 };
 
@@ -137,6 +164,41 @@ TEST_F(TraceSorterTest, Ordering) {
   context_.sorter->ExtractEventsForced();
 }
 
+TEST_F(TraceSorterTest, TrackEvents) {
+  TraceBlobView view_1 = test_buffer_.slice(0, 1);
+  TraceBlobView view_2 = test_buffer_.slice(0, 2);
+  TraceBlobView view_3 = test_buffer_.slice(0, 3);
+  TraceBlobView view_4 = test_buffer_.slice(0, 4);
+
+  InSequence s;
+
+  // Events with the same timestamp are parsed in the order they were pushed.
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1000, view_2.data(), 2));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1000, view_3.data(), 3));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1000, view_4.data(), 4));
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(1100, view_1.data(), 1));
+
+  context_.sorter->PushTrackEventPacket(
+      1100, TrackEventData(std::move(view_1), nullptr));
+  context_.sorter->PushTrackEventPacket(
+      1000, TrackEventData(std::move(view_2), nullptr));
+  context_.sorter->PushTrackEventPacket(
+      1000, TrackEventData(std::move(view_3), nullptr));
+  context_.sorter->PushTrackEventPacket(
+      1000, TrackEventData(std::move(view_4), nullptr));
+  context_.sorter->ExtractEventsForced();
+}
+
+TEST_F(TraceSorterTest, TrackEventsNotExtracted) {
+  // The sorter must release the events it still holds when destroyed.
+  EXPECT_CALL(*parser_, MOCK_ParseTracePacket(_, _, _)).Times(0);
+  for (int64_t ts = 0; ts < 2000; ts++) {
+    context_.sorter->PushTrackEventPacket(
+        ts, TrackEventData(test_buffer_.slice(0, 1), nullptr));
+  }
+  context_.sorter.reset();
+}
+
 TEST_F(TraceSorterTest, SetWindowSize) {
   PacketSequenceState state(&context_);
   TraceBlobView view_1 = test_buffer_.slice(0, 1);
@@ -224,6 +286,275 @@ TEST_F(TraceSorterTest, MultiQueueSorting) {
   EXPECT_TRUE(expectations.empty());
 }
 
+// Pushes sched_switch events, slightly out of order, on a few CPUs and
+// extracts them in windows, so that events get decoded, re-sorted and decoded
+// again while new events come in.
+TEST_F(TraceSorterTest, ParallelFtraceDecoding) {
+  using protos::pbzero::FtraceEvent;
+  context_.sorter->EnableParallelFtraceDecoding(3);
+  context_.sorter->SetWindowSizeNs(1000);
+
+  std::minstd_rand0 rnd_engine(0);
+  const uint32_t kNumEvents = 20000;
+  int64_t last_ts = 0;
+  uint32_t num_parsed = 0;
+  EXPECT_CALL(*parser_, MOCK_ParseDecodedFtracePacket(_, _, _, _))
+      .WillRepeatedly(Invoke([&](uint32_t cpu, int64_t ts, uint32_t event_id,
+                                 uint32_t next_pid) {
+        EXPECT_GE(ts, last_ts);
+        EXPECT_EQ(event_id,
+                  static_cast<uint32_t>(FtraceEvent::kSchedSwitchFieldNumber));
+        // The events encode their timestamp and cpu in next_pid.
+        EXPECT_EQ(next_pid, static_cast<uint32_t>(ts * 10 + cpu));
+        last_ts = ts;
+        num_parsed++;
+      }));
+
+  for (uint32_t i = 0; i < kNumEvents; i++) {
+    int64_t ts = i * 100 + rnd_engine() % 150;
+    uint32_t cpu = rnd_engine() % 8;
+    protozero::HeapBuffered<FtraceEvent> event;
+    event->set_timestamp(static_cast<uint64_t>(ts));
+    event->set_pid(42);
+    auto* sched_switch = event->set_sched_switch();
+    sched_switch->set_prev_comm("prev");
+    sched_switch->set_next_comm("next");
+    sched_switch->set_next_pid(static_cast<int32_t>(ts * 10 + cpu));
+    std::vector<uint8_t> data = event.SerializeAsArray();
+    std::unique_ptr<uint8_t[]> buf(new uint8_t[data.size()]);
+    memcpy(buf.get(), data.data(), data.size());
+    context_.sorter->PushFtraceEvent(
+        cpu, ts, TraceBlobView(std::move(buf), 0, data.size()));
+    context_.sorter->FinalizeFtraceEventBatch(cpu);
+  }
+  context_.sorter->ExtractEventsForced();
+  EXPECT_EQ(num_parsed, kNumEvents);
+}
+
+// Records the timestamps and a description of the events parsed, per queue
+// of TraceSorter (the order of events with the same timestamp in different
+// queues is not defined).
+struct Recording {
+  std::vector<int64_t> timestamps;
+  std::map<uint32_t /*queue*/, std::vector<std::string>> events;
+};
+
+class RecordingTraceParser : public TraceParser {
+ public:
+  explicit RecordingTraceParser(Recording* recording)
+      : recording_(recording) {}
+
+  void ParseTracePacket(int64_t ts, TimestampedTracePiece ttp) override {
+    std::string event;
+    if (ttp.type == TimestampedTracePiece::Type::kTrackEvent) {
+      const TrackEventData& data = *ttp.track_event_data;
+      event = ToString(data.packet) + " " +
+              std::to_string(data.thread_timestamp) + " " +
+              std::to_string(data.extra_counter_values[1]);
+    } else {
+      event = ToString(ttp.packet_data.packet);
+    }
+    Record(0, ts, event);
+  }
+
+  void ParseFtracePacket(uint32_t cpu,
+                         int64_t ts,
+                         TimestampedTracePiece ttp) override {
+    std::string event;
+    switch (ttp.type) {
+      case TimestampedTracePiece::Type::kInlineSchedSwitch:
+        event = "switch " + std::to_string(ttp.sched_switch.next_pid) + " " +
+                std::to_string(ttp.sched_switch.next_comm.raw_id());
+        break;
+      case TimestampedTracePiece::Type::kInlineSchedWaking:
+        event = "waking " + std::to_string(ttp.sched_waking.pid) + " " +
+                std::to_string(ttp.sched_waking.comm.raw_id());
+        break;
+      default:
+        event = ToString(ttp.ftrace_event);
+        break;
+    }
+    Record(cpu + 1, ts, event);
+  }
+
+ private:
+  static std::string ToString(const TraceBlobView& tbv) {
+    return std::string(reinterpret_cast<const char*>(tbv.data()),
+                       tbv.length());
+  }
+
+  void Record(uint32_t queue, int64_t ts, const std::string& event) {
+    recording_->timestamps.push_back(ts);
+    recording_->events[queue].push_back(std::to_string(ts) + " " + event);
+  }
+
+  Recording* recording_;
+};
+
+TraceBlobView StringToBlob(const std::string& str) {
+  std::unique_ptr<uint8_t[]> buf(new uint8_t[str.size()]);
+  memcpy(buf.get(), str.data(), str.size());
+  return TraceBlobView(std::move(buf), 0, str.size());
+}
+
+// Pushes the same events, with many timestamps in common, to a TraceSorter
+// which keeps them in memory and to one which spills them to disk every few
+// events, and checks that they are parsed in the same order.
+TEST_F(TraceSorterTest, SpillToDisk) {
+  constexpr int64_t kMaxWindow = std::numeric_limits<int64_t>::max();
+  Recording expected;
+  Recording actual;
+  TraceSorter in_memory(
+      std::unique_ptr<TraceParser>(new RecordingTraceParser(&expected)),
+      kMaxWindow);
+  TraceSorter spilling(
+      std::unique_ptr<TraceParser>(new RecordingTraceParser(&actual)),
+      kMaxWindow);
+  spilling.EnableSpillingToDisk(16 * 1024);
+
+  PacketSequenceState state(&context_);
+  std::minstd_rand0 rnd_engine(0);
+  const uint32_t kNumEvents = 20000;
+  for (uint32_t i = 0; i < kNumEvents; i++) {
+    int64_t ts = rnd_engine() % 5000;
+    uint32_t kind = rnd_engine() % 5;
+    uint32_t cpu = rnd_engine() % 4;
+    std::string payload = "event " + std::to_string(i);
+    for (TraceSorter* sorter : {&in_memory, &spilling}) {
+      switch (kind) {
+        case 0:
+          sorter->PushTracePacket(ts, &state, StringToBlob(payload));
+          break;
+        case 1: {
+          TrackEventData data(StringToBlob(payload), nullptr);
+          data.thread_timestamp = i;
+          data.extra_counter_values[1] = i * 2;
+          sorter->PushTrackEventPacket(ts, std::move(data));
+          break;
+        }
+        case 2:
+          sorter->PushFtraceEvent(cpu, ts, StringToBlob(payload));
+          sorter->FinalizeFtraceEventBatch(cpu);
+          break;
+        case 3:
+          sorter->PushInlineFtraceEvent(
+              cpu, ts,
+              InlineSchedSwitch{0, static_cast<int32_t>(i), 120,
+                                StringId::Raw(i)});
+          sorter->FinalizeFtraceEventBatch(cpu);
+          break;
+        case 4:
+          sorter->PushInlineFtraceEvent(
+              cpu, ts,
+              InlineSchedWaking{static_cast<int32_t>(i), 1, 120,
+                                StringId::Raw(i)});
+          sorter->FinalizeFtraceEventBatch(cpu);
+          break;
+      }
+    }
+  }
+  in_memory.ExtractEventsForced();
+  spilling.ExtractEventsForced();
+
+  EXPECT_EQ(in_memory.num_spilled_events(), 0u);
+  EXPECT_GT(spilling.num_spilled_events(), kNumEvents / 2);
+  EXPECT_EQ(actual.timestamps.size(), kNumEvents);
+  EXPECT_TRUE(
+      std::is_sorted(actual.timestamps.begin(), actual.timestamps.end()));
+  EXPECT_EQ(expected.events, actual.events);
+}
+
+// Inline sched events have no payload outside of the TimestampedTracePiece,
+// so only the piece itself counts against the memory budget.
+TEST_F(TraceSorterTest, SpillInlineSchedEvents) {
+  Recording recording;
+  TraceSorter sorter(
+      std::unique_ptr<TraceParser>(new RecordingTraceParser(&recording)),
+      std::numeric_limits<int64_t>::max());
+  constexpr uint32_t kNumEvents = 1000;
+  sorter.EnableSpillingToDisk(kNumEvents / 4 * sizeof(TimestampedTracePiece));
+
+  for (uint32_t i = 0; i < kNumEvents; i++) {
+    uint32_t cpu = i % 2;
+    int64_t ts = static_cast<int64_t>(i);
+    if (i % 4 < 2) {
+      sorter.PushInlineFtraceEvent(
+          cpu, ts,
+          InlineSchedSwitch{0, static_cast<int32_t>(i), 120,
+                            StringId::Raw(i)});
+    } else {
+      sorter.PushInlineFtraceEvent(
+          cpu, ts,
+          InlineSchedWaking{static_cast<int32_t>(i), 1, 120,
+                            StringId::Raw(i)});
+    }
+    sorter.FinalizeFtraceEventBatch(cpu);
+  }
+  sorter.ExtractEventsForced();
+
+  EXPECT_GT(sorter.num_spilled_events(), 0u);
+  EXPECT_LT(sorter.num_spilled_events(), kNumEvents);
+  ASSERT_EQ(recording.timestamps.size(), kNumEvents);
+  EXPECT_TRUE(
+      std::is_sorted(recording.timestamps.begin(), recording.timestamps.end()));
+  EXPECT_EQ(recording.events[1].front(), "0 switch 0 0");
+  EXPECT_EQ(recording.events[2].back(), "999 waking 999 999");
+}
+
+TEST_F(TraceSorterTest, SpillToDiskNotExtracted) {
+  Recording recording;
+  std::unique_ptr<TraceSorter> sorter(new TraceSorter(
+      std::unique_ptr<TraceParser>(new RecordingTraceParser(&recording)),
+      std::numeric_limits<int64_t>::max()));
+  sorter->EnableSpillingToDisk(1024);
+  for (int64_t ts = 0; ts < 1000; ts++) {
+    sorter->PushTrackEventPacket(
+        ts, TrackEventData(StringToBlob("track event"), nullptr));
+  }
+
+  // Load some of the spilled events back, but not all of them.
+  sorter->SetWindowSizeNs(500);
+  EXPECT_GT(sorter->num_spilled_events(), 0u);
+  EXPECT_EQ(recording.timestamps.size(), 500u);
+
+  // The events left must be released by the sorter.
+  sorter.reset();
+}
+
+#if !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+// A spill file which is cut short while the sorter still has events in it
+// makes the sorter drop these events and report an error, but not crash.
+TEST_F(TraceSorterTest, SpillFileTruncated) {
+  Recording recording;
+  TraceSorter sorter(
+      std::unique_ptr<TraceParser>(new RecordingTraceParser(&recording)),
+      std::numeric_limits<int64_t>::max());
+  sorter.EnableSpillingToDisk(1024);
+  constexpr uint32_t kNumEvents = 1000;
+  for (uint32_t i = 0; i < kNumEvents; i++) {
+    sorter.PushTrackEventPacket(
+        i, TrackEventData(StringToBlob("track event"), nullptr));
+  }
+
+  // Load some of the spilled events back, then cut the file in the middle of
+  // the events which haven't been loaded yet.
+  sorter.SetWindowSizeNs(kNumEvents / 2);
+  ASSERT_GT(sorter.num_spilled_events(), 0u);
+  ASSERT_TRUE(sorter.spill_status().ok());
+  off_t spill_size = lseek(sorter.spill_file_for_testing(), 0, SEEK_END);
+  ASSERT_GT(spill_size, 0);
+  ASSERT_EQ(ftruncate(sorter.spill_file_for_testing(), spill_size * 3 / 4), 0);
+
+  sorter.ExtractEventsForced();
+  EXPECT_FALSE(sorter.spill_status().ok());
+  EXPECT_GT(sorter.num_spill_read_errors(), 0u);
+  EXPECT_GE(recording.timestamps.size(), kNumEvents / 2);
+  EXPECT_LT(recording.timestamps.size(), kNumEvents);
+  EXPECT_TRUE(
+      std::is_sorted(recording.timestamps.begin(), recording.timestamps.end()));
+}
+#endif  // !PERFETTO_BUILDFLAG(PERFETTO_OS_WIN)
+
 }  // namespace
 }  // namespace trace_processor
 }  // namespace perfetto
@@ -48,6 +48,7 @@
 #include "perfetto/base/build_config.h"
 #include "perfetto/base/task_runner.h"
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/lz4.h"
 #include "perfetto/ext/base/metatrace.h"
 #include "perfetto/ext/base/string_utils.h"
 #include "perfetto/ext/base/utils.h"
@@ -59,6 +60,7 @@
 #include "perfetto/ext/tracing/core/shared_memory_abi.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/protozero/scattered_heap_buffer.h"
 #include "perfetto/protozero/static_buffer.h"
 #include "perfetto/tracing/core/data_source_descriptor.h"
@@ -94,6 +96,15 @@ constexpr int kMaxConcurrentTracingSessionsPerUid = 5;
 constexpr int kMaxConcurrentTracingSessionsForStatsdUid = 10;
 constexpr int64_t kMinSecondsBetweenTracesGuardrail = 5 * 60;
 
+// Max size of the uncompressed data of each lz4_compressed_packets packet.
+// Chosen so that, even for incompressible data, the compressed packets stay
+// within the 512KB limit of trace_packet.proto.
+constexpr size_t kLz4MaxUncompressedBytes = 480 * 1024;
+static_assert(base::Lz4CompressBound(kLz4MaxUncompressedBytes) +
+                      2 * protozero::proto_utils::kMaxSimpleFieldEncodedSize <
+                  500 * 1024,
+              "lz4_compressed_packets would exceed the packet size limit");
+
 constexpr uint32_t kMillisPerHour = 3600000;
 constexpr uint32_t kMaxTracingDurationMillis = 7 * 24 * kMillisPerHour;
 
@@ -237,6 +248,62 @@ base::ScopedFile CreateTraceFile(const std::string& path) {
   return fd;
 }
 
+// Replaces |packets| with lz4_compressed_packets TracePackets which contain
+// them. Packets too large to fit in a compressed packet are left as-is.
+void CompressPacketsLz4(std::vector<TracePacket>* packets) {
+  using protozero::proto_utils::kMaxSimpleFieldEncodedSize;
+  using protozero::proto_utils::MakeTagLengthDelimited;
+  using protozero::proto_utils::WriteVarInt;
+
+  std::vector<TracePacket> compressed_packets;
+  std::vector<uint8_t> batch;
+  base::Lz4Compressor compressor;
+  auto flush_batch = [&compressed_packets, &batch, &compressor] {
+    if (batch.empty())
+      return;
+    // The field contains the uncompressed size followed by the LZ4 block.
+    Slice data = Slice::Allocate(kMaxSimpleFieldEncodedSize +
+                                 base::Lz4CompressBound(batch.size()));
+    uint8_t* ptr = WriteVarInt(batch.size(), data.own_data());
+    ptr += compressor.Compress(batch.data(), batch.size(), ptr);
+    data.size = static_cast<size_t>(ptr - data.own_data());
+
+    Slice header = Slice::Allocate(kMaxSimpleFieldEncodedSize);
+    ptr = WriteVarInt(
+        MakeTagLengthDelimited(
+            protos::pbzero::TracePacket::kLz4CompressedPacketsFieldNumber),
+        header.own_data());
+    ptr = WriteVarInt(data.size, ptr);
+    header.size = static_cast<size_t>(ptr - header.own_data());
+
+    compressed_packets.emplace_back();
+    compressed_packets.back().AddSlice(std::move(header));
+    compressed_packets.back().AddSlice(std::move(data));
+    batch.clear();
+  };
+
+  for (TracePacket& packet : *packets) {
+    char* preamble;
+    size_t preamble_size;
+    std::tie(preamble, preamble_size) = packet.GetProtoPreamble();
+    const size_t size = preamble_size + packet.size();
+    if (size > kLz4MaxUncompressedBytes) {
+      flush_batch();
+      compressed_packets.emplace_back(std::move(packet));
+      continue;
+    }
+    if (batch.size() + size > kLz4MaxUncompressedBytes)
+      flush_batch();
+    batch.insert(batch.end(), preamble, preamble + preamble_size);
+    for (const Slice& slice : packet.slices()) {
+      const uint8_t* start = static_cast<const uint8_t*>(slice.start);
+      batch.insert(batch.end(), start, start + slice.size);
+    }
+  }
+  flush_batch();
+  *packets = std::move(compressed_packets);
+}
+
 }  // namespace
 
 // These constants instead are defined in the header because are used by tests.
@@ -1826,6 +1893,14 @@ bool TracingServiceImpl::ReadBuffers(TracingSessionID tsid,
                                   ? tracing_session->max_file_size_bytes
                                   : std::numeric_limits<size_t>::max();
 
+    if (tracing_session->config.compression_type() ==
+        TraceConfig::COMPRESSION_TYPE_LZ4) {
+      CompressPacketsLz4(&packets);
+      total_slices = 0;
+      for (const TracePacket& packet : packets)
+        total_slices += packet.slices().size();
+    }
+
     // When writing into a file, the file should look like a root trace.proto
     // message. Each packet should be prepended with a proto preamble stating
     // its field id (within trace.proto) and size. Hence the addition below.
@@ -19,6 +19,7 @@
 #include <string.h>
 
 #include "perfetto/ext/base/file_utils.h"
+#include "perfetto/ext/base/lz4.h"
 #include "perfetto/ext/base/temp_file.h"
 #include "perfetto/ext/base/utils.h"
 #include "perfetto/ext/tracing/core/consumer.h"
@@ -27,6 +28,7 @@
 #include "perfetto/ext/tracing/core/shared_memory.h"
 #include "perfetto/ext/tracing/core/trace_packet.h"
 #include "perfetto/ext/tracing/core/trace_writer.h"
+#include "perfetto/protozero/proto_utils.h"
 #include "perfetto/tracing/core/data_source_config.h"
 #include "perfetto/tracing/core/data_source_descriptor.h"
 #include "src/base/test/test_task_runner.h"
@@ -1490,6 +1492,79 @@ TEST_F(TracingServiceImplTest, WriteIntoFileWithPath) {
                   Property(&protos::gen::TestEvent::str, Eq("payload")))));
 }
 
+TEST_F(TracingServiceImplTest, WriteIntoFileWithLz4Compression) {
+  std::unique_ptr<MockConsumer> consumer = CreateMockConsumer();
+  consumer->Connect(svc.get());
+
+  std::unique_ptr<MockProducer> producer = CreateMockProducer();
+  producer->Connect(svc.get(), "mock_producer");
+  producer->RegisterDataSource("data_source");
+
+  TraceConfig trace_config;
+  trace_config.add_buffers()->set_size_kb(4096);
+  auto* ds_config = trace_config.add_data_sources()->mutable_config();
+  ds_config->set_name("data_source");
+  ds_config->set_target_buffer(0);
+  trace_config.set_write_into_file(true);
+  trace_config.set_compression_type(TraceConfig::COMPRESSION_TYPE_LZ4);
+  base::TempFile tmp_file = base::TempFile::Create();
+  consumer->EnableTracing(trace_config, base::ScopedFile(dup(tmp_file.fd())));
+
+  producer->WaitForTracingSetup();
+  producer->WaitForDataSourceSetup("data_source");
+  producer->WaitForDataSourceStart("data_source");
+
+  static const int kNumTestPackets = 100;
+  std::unique_ptr<TraceWriter> writer =
+      producer->CreateTraceWriter("data_source");
+  for (int i = 0; i < kNumTestPackets; i++) {
+    auto tp = writer->NewTracePacket();
+    tp->set_for_testing()->set_str("payload_" + std::to_string(i));
+  }
+  writer->Flush();
+  writer.reset();
+
+  consumer->DisableTracing();
+  producer->WaitForDataSourceStop("data_source");
+  consumer->WaitForTracingDisabled();
+
+  // All the packets, including the ones emitted by the service, should be
+  // within lz4_compressed_packets.
+  std::string trace_raw;
+  ASSERT_TRUE(base::ReadFile(tmp_file.path().c_str(), &trace_raw));
+  protos::gen::Trace trace;
+  ASSERT_TRUE(trace.ParseFromString(trace_raw));
+  ASSERT_GT(trace.packet_size(), 0);
+  std::vector<protos::gen::TracePacket> packets;
+  for (const protos::gen::TracePacket& packet : trace.packet()) {
+    ASSERT_TRUE(packet.has_lz4_compressed_packets());
+    const std::string& field = packet.lz4_compressed_packets();
+    const uint8_t* start = reinterpret_cast<const uint8_t*>(field.data());
+    const uint8_t* end = start + field.size();
+    uint64_t uncompressed_size = 0;
+    const uint8_t* block =
+        protozero::proto_utils::ParseVarInt(start, end, &uncompressed_size);
+    ASSERT_NE(block, start);
+    std::string uncompressed(static_cast<size_t>(uncompressed_size), '\0');
+    ASSERT_TRUE(base::Lz4Decompress(
+        block, static_cast<size_t>(end - block),
+        reinterpret_cast<uint8_t*>(&uncompressed[0]), uncompressed.size()));
+    protos::gen::Trace inner_trace;
+    ASSERT_TRUE(inner_trace.ParseFromString(uncompressed));
+    packets.insert(packets.end(), inner_trace.packet().begin(),
+                   inner_trace.packet().end());
+  }
+  for (int i = 0; i < kNumTestPackets; i++) {
+    EXPECT_THAT(packets, Contains(Property(
+                             &protos::gen::TracePacket::for_testing,
+                             Property(&protos::gen::TestEvent::str,
+                                      Eq("payload_" + std::to_string(i))))));
+  }
+  EXPECT_THAT(packets,
+              Contains(Property(&protos::gen::TracePacket::has_trace_config,
+                                Eq(true))));
+}
+
 // Test the logic that allows the trace config to set the shm total size and
 // page size from the trace config. Also check that, if the config doesn't
 // specify a value we fall back on the hint provided by the producer.